@@ -2,7 +2,7 @@
 
 import cv2
 import numpy as np
-from typing import Dict, List, Union
+from typing import Dict, List, Optional, Union
 from pathlib import Path
 
 from core.detection.utils.path_utils import get_output_path
@@ -112,10 +112,14 @@ def cluster_layers_with_box_roi(
     boxes: List[Dict],
     pile_roi: Dict[str, float],
     gap_ratio: float = 0.6,
-    padding_ratio: float = 0.1
+    padding_ratio: float = 0.1,
+    layer_count_hint: Optional[int] = None
 ) -> Dict:
     """
     分层聚类 + 每层ROI + 每个box的ROI信息
+
+    :param layer_count_hint: 深度分层给出的层数先验（见 layer_count_from_depth）；
+        按间隙聚出的层数多于它时，依次合并中心最近的相邻两层（透视下同一层被拆开的情况）
     """
     if not boxes:
         return {"layer_count": 0, "layers": []}
@@ -141,6 +145,12 @@ def cluster_layers_with_box_roi(
             current.append(centers[i])
     layers.append(current)
 
+    if layer_count_hint:
+        while len(layers) > max(1, layer_count_hint):
+            means = [np.mean([c[0] for c in layer]) for layer in layers]
+            k = int(np.argmin(np.diff(means)))
+            layers[k:k + 2] = [layers[k] + layers[k + 1]]
+
     # 输出层结构
     layer_info = []
     for idx, layer in enumerate(layers, start=1):
@@ -178,6 +188,27 @@ def cluster_layers_with_box_roi(
     }
 
 
+def layer_count_from_depth(depth_layers: Optional[Dict],
+                           max_layers: int = 20) -> Optional[int]:
+    """
+    由深度分层结果（core.detection.depth.native.segment_layers）估计层数：
+    最高两个水平面（非满顶层顶面与下一层露出的顶面）的高度差即一箱高，
+    垛顶到垛底的高度除以箱高取整。只有一个水平面，或第二个水平面就是垛底（地面）时无法估计，返回 None
+    """
+    if not depth_layers:
+        return None
+    surfaces = depth_layers.get("surfaces", [])
+    if len(surfaces) < 2:
+        return None
+    top, second = surfaces[0]["height_mm"], surfaces[1]["height_mm"]
+    step = top - second
+    bottom = depth_layers["min_height_mm"]
+    if step <= 0 or second - bottom < 0.5 * step:
+        return None
+    count = int(round((top - bottom) / step))
+    return count if 1 < count <= max_layers else None
+
+
 def draw_layers_on_image(
     image_path: str,
     pile_roi: Dict[str, float],
@@ -1,19 +1,55 @@
 """场景准备逻辑：过滤YOLO输出，确定ROI"""
 
-from typing import Dict, List, Optional
+from typing import Dict, List, Optional, Union
 
+from core.detection.utils.detections import Detections
 
-def prepare_logic(yolo_output: List[Dict], conf_thr: float = 0.6) -> Optional[Dict]:
+
+def _prepare_from_set(detections: Detections, conf_thr: float) -> Optional[Dict]:
+    """prepare_logic 的列存容器版本：类别/置信度过滤和 pile 内过滤都在原生侧完成"""
+    piles = detections.select(["pile"], min_conf=conf_thr)
+    if len(piles) == 0:
+        print("⚠️ 未检测到 pile")
+        return None
+    best = int(piles.col("conf").argmax())
+    pile_roi = {
+        "x1": int(piles.col("x1")[best]),
+        "y1": int(piles.col("y1")[best]),
+        "x2": int(piles.col("x2")[best]),
+        "y2": int(piles.col("y2")[best])
+    }
+
+    inside = detections.select(min_conf=conf_thr).centers_inside(pile_roi)
+    box_set = inside.select(["box"])
+    boxes = box_set.to_dicts()
+    barcodes = inside.select(["barcode"]).to_dicts()
+    return {
+        "pile_roi": pile_roi,
+        "boxes": boxes,
+        "barcodes": barcodes,
+        "box_set": box_set,
+        "count": {
+            "boxes": len(boxes),
+            "barcodes": len(barcodes)
+        }
+    }
+
+
+def prepare_logic(yolo_output: Union[List[Dict], Detections], conf_thr: float = 0.6) -> Optional[Dict]:
     """
     过滤 YOLO 输出，只保留 pile 内目标（不做绘图）
     
     Args:
-        yolo_output: YOLO检测结果列表
+        yolo_output: YOLO检测结果列表，或 extract_detection_set 得到的列存容器
         conf_thr: 置信度阈值
         
     Returns:
-        包含pile_roi、boxes、barcodes的字典，如果未检测到pile则返回None
+        包含pile_roi、boxes、barcodes的字典，如果未检测到pile则返回None；
+        输入为容器时另含 box_set（pile 内 box 的容器，列中已有中心、宽高、面积）
     """
+    if isinstance(yolo_output, Detections):
+        return _prepare_from_set(yolo_output, conf_thr)
+
     # 1️⃣ 找到唯一 pile
     piles = [b for b in yolo_output if b["cls"] == "pile" and b["conf"] >= conf_thr]
     if not piles:
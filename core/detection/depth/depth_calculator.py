@@ -7,6 +7,8 @@ from pathlib import Path
 from typing import Optional, Tuple
 from PIL import Image
 
+from .native import postprocess_disparity
+
 
 class DepthCalculator:
     """深度计算器：从立体图像计算深度图"""
@@ -14,17 +16,20 @@ class DepthCalculator:
     def __init__(self, 
                  focal_length_px: float = 6400.0,
                  baseline_mm: float = 120.0,
-                 enable_debug: bool = True):
+                 enable_debug: bool = True,
+                 enable_disparity_fill: bool = True):
         """
         初始化深度计算器
         
         :param focal_length_px: 焦距（像素）
         :param baseline_mm: 基线长度（毫米）
         :param enable_debug: 是否启用调试输出
+        :param enable_disparity_fill: 是否对视差做原生后处理（边缘剔除、中值、填洞），camera_api 不可用时自动跳过
         """
         self.focal_length_px = focal_length_px
         self.baseline_mm = baseline_mm
         self.enable_debug = enable_debug
+        self.enable_disparity_fill = enable_disparity_fill
     
     def rotate_image(self, image_path: str, rotation_angle: int = 90,
                      output_path: Optional[str] = None,
@@ -197,7 +202,15 @@ class DepthCalculator:
         )
         
         # 计算视差图
-        disparity = stereo.compute(left_gray, right_gray).astype(np.float32) / 16.0
+        raw_disparity = stereo.compute(left_gray, right_gray)
+        
+        # 原生后处理：剔除空洞边缘、3x3 中值、以左目灰度为引导填洞，减少“无有效点”
+        if self.enable_disparity_fill:
+            filled = postprocess_disparity(raw_disparity, left_gray, enable_debug=self.enable_debug)
+            if filled is not None:
+                raw_disparity = filled
+        
+        disparity = raw_disparity.astype(np.float32) / 16.0
         
         # 保存结果目录
         os.makedirs(output_dir, exist_ok=True)
@@ -279,7 +292,8 @@ class DepthCalculator:
         # 计算深度
         depth = (self.focal_length_px * self.baseline_mm) / disparity_img
         
-        # 将过大值和无效值设为零
+        # 将过大值和无效值设为零（无效视差被替换成 0.0001 后不是 inf，需单独置零）
+        depth[disparity <= 0] = 0
         depth[np.isinf(depth)] = 0
         depth[np.isnan(depth)] = 0
         
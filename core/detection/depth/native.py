@@ -0,0 +1,119 @@
+"""深度原生加速：加载 hardware/cam_sys 编译出的 camera_api 模块
+- postprocess_disparity：SGBM 原始视差的无效区扩散、3x3 中值和左目灰度引导的联合双边填洞
+- segment_layers：深度点云水平面分割，给出各层顶面高度与范围
+模块不可用时返回 None，调用方保持原流程"""
+
+import os
+import sys
+from pathlib import Path
+from typing import Dict, Optional, Tuple
+
+import numpy as np
+
+# camera_api*.so 与抓图脚本放在同一目录
+CAM_SYS_DIR = Path(__file__).resolve().parents[3] / "hardware" / "cam_sys"
+
+_camera_api = None
+_load_failed = False
+
+
+def load_camera_api():
+    """按需导入 camera_api，失败只提示一次；检测侧（core.detection.utils.detections）和
+    条码分块检测（core.vision.tiling）也从这里取，各自检查所需接口是否存在"""
+    global _camera_api, _load_failed
+    if _camera_api is not None or _load_failed:
+        return _camera_api
+    try:
+        if str(CAM_SYS_DIR) not in sys.path and CAM_SYS_DIR.is_dir():
+            sys.path.insert(0, str(CAM_SYS_DIR))
+        import camera_api
+        _camera_api = camera_api
+    except ImportError as e:
+        _load_failed = True
+        print(f"⚠️  camera_api 原生模块不可用，深度后处理/分层、检测容器沿用 Python 流程，条码用整图检测: {e}")
+    return _camera_api
+
+
+def postprocess_disparity(raw_disparity: np.ndarray, guide_gray: np.ndarray,
+                          fill_radius: int = 8,
+                          enable_debug: bool = False) -> Optional[np.ndarray]:
+    """
+    SGBM 原始视差后处理
+
+    :param raw_disparity: stereo.compute 的输出（int16，视差x16）
+    :param guide_gray: 同尺寸左目灰度图，填洞时不跨越其中的边缘
+    :param fill_radius: 填洞窗口半径（像素），0 表示只做扩散和中值
+    :param enable_debug: 是否打印统计
+    :return: 处理后的 int16 视差；原生模块不可用时返回 None
+    """
+    camera_api = load_camera_api()
+    if camera_api is None or not hasattr(camera_api, "postprocessDisparity"):
+        return None
+    options = camera_api.DepthFillOptions()
+    options.fill_radius = fill_radius
+    filled, stats = camera_api.postprocessDisparity(
+        np.ascontiguousarray(raw_disparity, dtype=np.int16),
+        np.ascontiguousarray(guide_gray, dtype=np.uint8),
+        options)
+    if enable_debug:
+        total = raw_disparity.size
+        print(f"视差后处理: 有效点 {stats.valid_before / total * 100:.2f}% -> "
+              f"{stats.valid_after / total * 100:.2f}%（边缘剔除 {stats.masked}，填洞 {stats.filled}）")
+    return filled
+
+
+def segment_layers(depth: np.ndarray, roi: Tuple[int, int, int, int],
+                   focal_length_px: float,
+                   enable_debug: bool = False) -> Optional[Dict]:
+    """
+    深度图点云分层：在 roi 内反投影，找出各层顶面（水平面）的高度和范围，作为分层与非满层处理的先验
+
+    :param depth: 深度图（毫米，<=0 为无效）
+    :param roi: 深度图像素坐标 (x1, y1, x2, y2)
+    :param focal_length_px: 深度图对应的焦距（像素），主点取图像中心
+    :param enable_debug: 是否打印结果
+    :return: {"up", "min_height_mm", "max_height_mm", "surfaces": [...]}，surfaces 从高到低，
+             roi 为归一化坐标（0~1），原生模块不可用或点太少时返回 None
+    """
+    camera_api = load_camera_api()
+    if camera_api is None or not hasattr(camera_api, "segmentLayers"):
+        return None
+    height, width = depth.shape[:2]
+    x1, y1, x2, y2 = [int(round(v)) for v in roi]
+    intrinsics = camera_api.CameraIntrinsics(focal_length_px, focal_length_px,
+                                             width / 2.0, height / 2.0)
+    result = camera_api.segmentLayers(
+        np.ascontiguousarray(depth, dtype=np.float32), intrinsics,
+        camera_api.PixelRect(x1, y1, x2 - x1, y2 - y1))
+    if not result.success:
+        return None
+
+    surfaces = []
+    for s in result.surfaces:
+        e = s.extent
+        surfaces.append({
+            "height_mm": round(float(s.height_mm), 1),
+            "points": s.points,
+            "fraction": round(float(s.fraction), 4),
+            "roi": {
+                "x1": e.x / width,
+                "y1": e.y / height,
+                "x2": (e.x + e.width) / width,
+                "y2": (e.y + e.height) / height,
+            },
+            "depth_min_mm": round(float(s.depth_min_mm), 1),
+            "depth_max_mm": round(float(s.depth_max_mm), 1),
+        })
+    prior = {
+        "up": [round(float(v), 4) for v in result.up],
+        "up_from_ransac": result.up_from_ransac,
+        "valid_points": result.valid_points,
+        "min_height_mm": round(float(result.min_height_mm), 1),
+        "max_height_mm": round(float(result.max_height_mm), 1),
+        "surfaces": surfaces,
+    }
+    if enable_debug:
+        print(f"深度分层: {len(surfaces)} 个水平面，高度 "
+              f"{[s['height_mm'] for s in surfaces]}mm，垛高范围 "
+              f"[{prior['min_height_mm']}, {prior['max_height_mm']}]mm")
+    return prior
@@ -1,5 +1,6 @@
 """堆垛处理器工厂：根据满层判断结果自动选择对应的处理模块"""
 
+import copy
 import logging
 from typing import Dict, List, Optional, Union, Tuple
 from pathlib import Path
@@ -33,10 +34,11 @@ from .stack_processor import (
 )
 
 # 导入核心算法模块
-from core.detection.utils.yolo_utils import extract_yolo_detections
+from core.detection.utils.yolo_utils import extract_yolo_detections, extract_detection_set
+from core.detection.utils.detections import Detections
 from core.detection.core.scene_prepare import prepare_logic
 from core.detection.core.layer_filter import remove_fake_top_layer
-from core.detection.core.layer_clustering import cluster_layers_with_box_roi
+from core.detection.core.layer_clustering import cluster_layers_with_box_roi, layer_count_from_depth
 from core.detection.utils.pile_db import PileTypeDatabase
 from core.detection.utils.path_utils import ensure_output_dir
 
@@ -51,6 +53,7 @@ from core.detection.core.layer_clustering import (
 
 # 导入深度处理模块
 from core.detection.depth import DepthCalculator, DepthProcessor
+from core.detection.depth.native import segment_layers
 
 
 class StackProcessorFactory:
@@ -99,6 +102,8 @@ class StackProcessorFactory:
         self.model = None
         self.pile_db = None
         
+        # 最近一次 YOLO 结果的列存容器（camera_api 不可用时为 None，走字典列表）
+        self.detection_set = None
         # 深度图数据（numpy数组）
         self.depth_image = None
         # 深度图路径（用于深度处理）
@@ -159,27 +164,59 @@ class StackProcessorFactory:
         :param depth_image_path: 深度图路径（可选，预留参数）
         :return: 总箱数（烟箱数）
         """
+        logger.info(f"[Detection] ===== count_boxes 被调用 =====")
+        logger.info(f"[Detection] pile_id={pile_id}")
+        scene = self.analyze(image_path, depth_image_path=depth_image_path)
+        return self.count_scene(scene, pile_id)
+
+    def analyze(self, image_path: Union[str, Path],
+                depth_image_path: Optional[Union[str, Path]] = None,
+                detections=None,
+                image_size: Optional[Tuple[int, int]] = None) -> Optional[Dict]:
+        """
+        与垛型无关的部分：旋转、YOLO、深度处理、场景准备、深度分层、分层聚类
+        
+        条码还没解析出垛型时就可以先跑；同一场景可以按不同 pile_id 多次 count_scene。
+        
+        :param image_path: 图片路径（RGB图片）
+        :param depth_image_path: 深度图路径（可选）
+        :param detections: 调用方已做好的 YOLO 结果（旋转后原图坐标，Detections 或字典列表），
+                           给出时跳过本实例的推理；批量重识别（services/worker/redetect.py）成批推理后传入
+        :param image_size: 旋转后原图的 (宽, 高)；与 detections 一起给出时调用方已按同一方向旋转并推理过，
+                           不再旋转、另存 raw.jpg / 旋转图和读回主图，场景里的 processing_image_path 为未旋转的原图。
+                           可视化要画在旋转图上，开启可视化时忽略
+        :return: 场景 dict；未检测到目标、pile 或有效层时返回 None（计数为 0）
+        """
         # 确保 logging 配置了 handler（避免子模块 logger 无输出）
         if not logging.getLogger().handlers:
             logging.basicConfig(level=logging.INFO)
 
-        logger.info(f"[Detection] ===== count_boxes 被调用 =====")
-        logger.info(f"[Detection] image_path={image_path}, pile_id={pile_id}, depth_image_path={depth_image_path}")
+        logger.info(f"[Detection] image_path={image_path}, depth_image_path={depth_image_path}")
 
         # 验证和初始化
         image_path = self._validate_inputs(image_path, depth_image_path)
         vis_output_dir = self._prepare_visualization_dir()
         
         # Step 0: 旋转原图（在YOLO检测之前）
-        rotated_image_path = self._rotate_and_save_image(image_path, vis_output_dir)
-        # 使用旋转后的图像进行后续处理
-        processing_image_path = rotated_image_path if rotated_image_path else image_path
+        if detections is not None and image_size is not None and not self.enable_visualization:
+            processing_image_path = image_path
+        else:
+            image_size = None
+            rotated_image_path = self._rotate_and_save_image(image_path, vis_output_dir)
+            # 使用旋转后的图像进行后续处理
+            processing_image_path = rotated_image_path if rotated_image_path else image_path
 
         # Step 1: YOLO检测（使用旋转后的图像）
-        detections = self._run_yolo_detection(processing_image_path)
+        if detections is None:
+            detections = self._run_yolo_detection(processing_image_path)
+        elif isinstance(detections, Detections):
+            self.detection_set = detections
+            detections = detections.to_dicts()
+        else:
+            self.detection_set = None
         if not detections:
             logger.warning("[Detection] YOLO未检测到任何目标（pile可能为空或不可见）")
-            return 0
+            return None
 
         logger.info(f"[Detection] YOLO检测到 {len(detections)} 个目标")
 
@@ -190,42 +227,88 @@ class StackProcessorFactory:
         prepared = self._prepare_scene(detections, processing_image_path, vis_output_dir)
         if not prepared:
             logger.warning("[Detection] 场景准备失败，未检测到有效pile区域")
-            return 0
+            return None
         boxes, pile_roi = prepared["boxes"], prepared["pile_roi"]
         logger.info(f"[Detection] 场景准备成功: pile_roi={pile_roi}, pile内box数={len(boxes)}")
 
         # 添加图像尺寸信息到pile_roi（用于深度处理，使用旋转后的图像）
-        img = cv2.imread(str(processing_image_path))
-        if img is not None:
-            pile_roi["image_width"] = img.shape[1]
-            pile_roi["image_height"] = img.shape[0]
+        if image_size is not None:
+            pile_roi["image_width"] = int(image_size[0])
+            pile_roi["image_height"] = int(image_size[1])
+        else:
+            img = cv2.imread(str(processing_image_path))
+            if img is not None:
+                pile_roi["image_width"] = img.shape[1]
+                pile_roi["image_height"] = img.shape[0]
+
+        # Step 2.5: 深度点云分层（各层顶面高度与范围），作为分层聚类和顶层深度匹配的先验
+        depth_layers = self._segment_depth_layers(pile_roi)
+        if depth_layers:
+            pile_roi["depth_layers"] = depth_layers
+            logger.info(f"[Detection] 深度分层: 水平面高度={[s['height_mm'] for s in depth_layers['surfaces']]}mm, "
+                        f"垛高范围=[{depth_layers['min_height_mm']}, {depth_layers['max_height_mm']}]mm")
 
         # Step 3: 分层聚类（使用旋转后的图像）
         layers = self._cluster_layers(boxes, pile_roi, processing_image_path, vis_output_dir)
         if not layers:
             logger.warning("[Detection] 分层聚类失败，未提取到有效层")
-            return 0
+            return None
 
         logger.info(f"[Detection] 分层聚类完成: 层数={len(layers)}, 每层箱数={[len(l.get('boxes',[])) for l in layers]}")
 
         # Step 4: 处理层（去误层、重新索引）
         layers = self._process_layers(layers)
 
+        # 可视化：处理后的分层结果（使用旋转后的图像）
+        if self.enable_visualization:
+            self._save_layer_visualization(processing_image_path, boxes, pile_roi, layers, vis_output_dir)
+
+        return {
+            "image_path": image_path,
+            "processing_image_path": processing_image_path,
+            "vis_output_dir": vis_output_dir,
+            "detections": detections,
+            "pile_roi": pile_roi,
+            "layers": layers,
+            # 计数阶段用到的深度数据，场景可以序列化后在另一个实例上 count_scene
+            "depth_image": self.depth_image,
+            "depth_matrix_csv_path": self.depth_matrix_csv_path,
+            "original_image_dir": self.original_image_dir,
+        }
+
+    def count_scene(self, scene: Optional[Dict], pile_id: int) -> int:
+        """
+        按垛型对 analyze 的结果做满层判断和计数
+        
+        处理器会改写层和 pile_roi，这里先深拷贝，场景可以换 pile_id 重复使用。
+        深度数据取自场景，因此场景可以来自另一个实例（如检查点里反序列化的）。
+        
+        :param scene: analyze 的返回值（None 时计数为 0）
+        :param pile_id: 堆垛ID
+        :return: 总箱数（烟箱数）
+        """
+        if not scene:
+            return 0
+        layers = copy.deepcopy(scene["layers"])
+        pile_roi = copy.deepcopy(scene["pile_roi"])
+        processing_image_path = scene["processing_image_path"]
+        vis_output_dir = scene["vis_output_dir"]
+        if "depth_image" in scene:
+            self.depth_image = scene["depth_image"]
+            self.depth_matrix_csv_path = scene["depth_matrix_csv_path"]
+            self.original_image_dir = scene["original_image_dir"]
+
         # Step 5: 获取模板配置
         template_layers = self._get_template_config(pile_id, layers)
         pile_name = self.pile_db.get_pile(pile_id).get("name", str(pile_id)) if self.pile_db else str(pile_id)
         logger.info(f"[Detection] 使用垛型: pile_id={pile_id}({pile_name}), 期望层配置={template_layers}")
 
-        # 可视化：处理后的分层结果（使用旋转后的图像）
-        if self.enable_visualization:
-            self._save_layer_visualization(processing_image_path, boxes, pile_roi, layers, vis_output_dir)
-
         # Step 6: 处理堆垛（满层判断和计数）
         # 传递原始YOLO检测结果，供单层处理器提取top类使用
         total_count = self.process(layers, template_layers, pile_roi,
                                   pile_id=pile_id,
-                                  yolo_detections=detections,
-                                  image_path=image_path,
+                                  yolo_detections=scene["detections"],
+                                  image_path=scene["image_path"],
                                   output_dir=vis_output_dir)
 
         logger.info(f"[Detection] ===== 识别结果汇总 =====")
@@ -393,7 +476,11 @@ class StackProcessorFactory:
             save=False,
             conf=self.confidence_threshold
         )
-        detections = extract_yolo_detections(results)
+        self.detection_set = extract_detection_set(results)
+        if self.detection_set is not None:
+            detections = self.detection_set.to_dicts()
+        else:
+            detections = extract_yolo_detections(results)
         
         # 在debug模式下保存YOLO检测结果图
         if self.enable_debug and results:
@@ -429,7 +516,8 @@ class StackProcessorFactory:
     def _prepare_scene(self, detections: List[Dict], image_path: Path,
                       vis_output_dir: Optional[Path]) -> Optional[Dict]:
         """场景准备"""
-        prepared = prepare_logic(detections, conf_thr=self.confidence_threshold)
+        source = self.detection_set if self.detection_set is not None else detections
+        prepared = prepare_logic(source, conf_thr=self.confidence_threshold)
         
         if prepared is None:
             if self.enable_debug:
@@ -456,7 +544,10 @@ class StackProcessorFactory:
     def _cluster_layers(self, boxes: List[Dict], pile_roi: Dict[str, float],
                        image_path: Union[str, Path], vis_output_dir: Optional[Path]) -> List[Dict]:
         """分层聚类"""
-        layer_result = cluster_layers_with_box_roi(boxes, pile_roi)
+        layer_count_hint = layer_count_from_depth(pile_roi.get("depth_layers"))
+        if layer_count_hint is not None:
+            logger.info(f"[Detection] 深度分层估计层数: {layer_count_hint}")
+        layer_result = cluster_layers_with_box_roi(boxes, pile_roi, layer_count_hint=layer_count_hint)
         layers = layer_result.get("layers", [])
         
         if not layers:
@@ -492,6 +583,27 @@ class StackProcessorFactory:
         
         return layers
     
+    def _segment_depth_layers(self, pile_roi: Dict[str, float]) -> Optional[Dict]:
+        """
+        深度点云分层：pile_roi 按归一化坐标映射到深度图（与 extract_depth_at_position 一致），
+        没有深度图、缺少图像尺寸或原生模块不可用时返回 None
+        """
+        if self.depth_image is None or self.depth_image.ndim != 2:
+            return None
+        image_width = pile_roi.get("image_width")
+        image_height = pile_roi.get("image_height")
+        if not image_width or not image_height:
+            return None
+        depth_h, depth_w = self.depth_image.shape
+        roi = (pile_roi["x1"] / image_width * depth_w, pile_roi["y1"] / image_height * depth_h,
+               pile_roi["x2"] / image_width * depth_w, pile_roi["y2"] / image_height * depth_h)
+        try:
+            return segment_layers(self.depth_image, roi, self.depth_calculator.focal_length_px,
+                                  enable_debug=self.enable_debug)
+        except Exception as e:
+            logger.warning(f"[Detection] 深度分层失败，忽略: {e}")
+            return None
+
     def _process_layers(self, layers: List[Dict]) -> List[Dict]:
         """处理层：去除误层并重新索引"""
         # 暂时禁用 remove_fake_top_layer（其宽度判断逻辑有 bug，会误删真正的顶层）
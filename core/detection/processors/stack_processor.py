@@ -9,6 +9,21 @@ from pathlib import Path
 logger = logging.getLogger(__name__)
 
 
+def _depth_from_surfaces(pile_roi: Dict, x1_n: float, x2_n: float) -> Optional[float]:
+    """
+    箱子中心取不到深度时的兜底：深度分层（pile_roi["depth_layers"]）里最高水平面即顶层顶面，
+    其近端深度就是顶层箱子前脸的距离。要求该水平面与箱子在水平方向有重叠，x 为归一化坐标
+    """
+    depth_layers = pile_roi.get("depth_layers")
+    if not depth_layers or not depth_layers.get("surfaces"):
+        return None
+    top = depth_layers["surfaces"][0]
+    overlap = min(x2_n, top["roi"]["x2"]) - max(x1_n, top["roi"]["x1"])
+    if overlap <= 0.5 * (x2_n - x1_n):
+        return None
+    return top["depth_min_mm"] or None
+
+
 # ==================== 满层处理器 ====================
 
 class FullStackProcessor(ABC):
@@ -119,6 +134,8 @@ class TemplateBasedFullProcessor(FullStackProcessor):
                 res = dp2.extract_depth_at_position(depth_matrix, cx_n, cy_n)
                 if res.get("success") and res.get("value", 0) > 0:
                     depth_mm = res["value"]
+            if depth_mm is None and image_width > 0:
+                depth_mm = _depth_from_surfaces(pile_roi, bx1 / image_width, bx2 / image_width)
 
             box_data.append({
                 "idx": i,
@@ -550,6 +567,8 @@ class TemplateBasedPartialProcessor(PartialStackProcessor):
                     res = dp2.extract_depth_at_position(depth_matrix, cx_n, cy_n)
                     if res.get("success") and res.get("value", 0) > 0:
                         depth_mm = res["value"]
+            if depth_mm is None and image_width > 0:
+                depth_mm = _depth_from_surfaces(pile_roi, bx1 / image_width, bx2 / image_width)
 
             box_data.append({
                 "idx": i,
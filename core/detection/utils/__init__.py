@@ -2,13 +2,16 @@
 
 from core.detection.utils.exceptions import PileNotFoundError
 from core.detection.utils.pile_db import PileTypeDatabase
-from core.detection.utils.yolo_utils import extract_yolo_detections
+from core.detection.utils.yolo_utils import extract_yolo_detections, extract_detection_set
+from core.detection.utils.detections import Detections
 from core.detection.utils.path_utils import ensure_output_dir, get_output_path
 
 __all__ = [
     "PileNotFoundError",
     "PileTypeDatabase",
     "extract_yolo_detections",
+    "extract_detection_set",
+    "Detections",
     "ensure_output_dir",
     "get_output_path",
 ]
@@ -0,0 +1,122 @@
+"""
+YOLO 检测结果的列存容器：camera_api.DetectionSet 的封装
+坐标、分数、类别和中心/宽高/面积按列连续存放，np.asarray 直接看到原生内存（不拷贝）；
+类别过滤、pile 内过滤、ROI 相交查询和 NMS 在原生侧完成。下游需要字典的地方（分层聚类、可视化）
+由 to_dicts() 一次生成，格式与 extract_yolo_detections 相同
+"""
+
+from typing import Dict, Iterable, List, Optional
+
+import numpy as np
+
+from core.detection.depth.native import load_camera_api
+
+# 列名 -> camera_api.DetColumn 的行号
+COLUMNS = ["x1", "y1", "x2", "y2", "conf", "cls_id", "cx", "cy", "width", "height", "area"]
+
+# 框数超过该值时 ROI 相交查询先建格网索引
+INDEX_MIN_SIZE = 64
+
+
+def result_rows(res, dx: float = 0.0, dy: float = 0.0) -> np.ndarray:
+    """ultralytics 单张结果转 (N, 6) 的 [x1, y1, x2, y2, conf, cls_id]；
+    dx/dy 把分块检测的块内坐标平移到原图（见 core/vision/tiling.py）"""
+    boxes = getattr(res, "boxes", None)
+    if boxes is None or len(boxes) == 0:
+        return np.zeros((0, 6), dtype=np.float32)
+    rows = np.concatenate([
+        boxes.xyxy.cpu().numpy(),
+        boxes.conf.cpu().numpy()[:, None],
+        boxes.cls.cpu().numpy()[:, None],
+    ], axis=1).astype(np.float32)
+    if dx or dy:
+        rows[:, [0, 2]] += dx
+        rows[:, [1, 3]] += dy
+    return rows
+
+
+class Detections:
+    """检测结果容器，只读；筛选操作返回新的容器"""
+
+    def __init__(self, native_set, names: Dict[int, str]):
+        self._set = native_set
+        self.names = dict(names)
+        self._columns = np.asarray(native_set)
+
+    @classmethod
+    def from_rows(cls, rows: np.ndarray, names: Dict[int, str]) -> Optional["Detections"]:
+        """(N, 6) 行数据建容器，原生模块不可用时返回 None"""
+        camera_api = load_camera_api()
+        if camera_api is None or not hasattr(camera_api, "DetectionSet"):
+            return None
+        native_set = camera_api.DetectionSet()
+        native_set.addRows(np.ascontiguousarray(rows, dtype=np.float32))
+        return cls(native_set, names)
+
+    @classmethod
+    def from_results(cls, results, accept_classes: Optional[Iterable[str]] = None) -> Optional["Detections"]:
+        """
+        由 YOLO 推理结果建容器
+
+        :param results: model.predict 的结果列表
+        :param accept_classes: 只保留这些类别名（可选）
+        :return: 容器；原生模块不可用时返回 None
+        """
+        results = list(results or [])
+        names = {}
+        for res in results:
+            names.update(getattr(res, "names", None) or {})
+        rows = np.concatenate([result_rows(r) for r in results], axis=0) if results \
+            else np.zeros((0, 6), dtype=np.float32)
+        detections = cls.from_rows(rows, names)
+        if detections is not None and accept_classes:
+            detections = detections.select(accept_classes)
+        return detections
+
+    def __len__(self) -> int:
+        return len(self._set)
+
+    @property
+    def columns(self) -> np.ndarray:
+        """(11, N) 的 float32 视图，行顺序见 COLUMNS"""
+        return self._columns
+
+    def col(self, name: str) -> np.ndarray:
+        """单列视图，例如 col("cy")、col("height")"""
+        return self._columns[COLUMNS.index(name)]
+
+    def class_ids(self, class_names: Iterable[str]) -> List[int]:
+        wanted = set(class_names)
+        return [cid for cid, name in self.names.items() if name in wanted]
+
+    def _subset(self, indices: List[int]) -> "Detections":
+        return Detections(self._set.subset(indices), self.names)
+
+    def select(self, class_names: Optional[Iterable[str]] = None, min_conf: float = 0.0) -> "Detections":
+        """按类别名和置信度过滤；class_names 为空表示不限类别"""
+        classes = self.class_ids(class_names) if class_names else []
+        if class_names and not classes:
+            return self._subset([])
+        return self._subset(self._set.selectClasses(classes, min_conf))
+
+    def nms(self, iou_threshold: float = 0.7, class_agnostic: bool = False) -> "Detections":
+        """按置信度贪心 NMS，结果按置信度从高到低"""
+        return self._subset(self._set.nms(iou_threshold, class_agnostic))
+
+    def centers_inside(self, roi: Dict[str, float]) -> "Detections":
+        """中心落在 roi（含边界）内的框"""
+        return self._subset(self._set.centersInside(roi["x1"], roi["y1"], roi["x2"], roi["y2"]))
+
+    def intersecting(self, roi: Dict[str, float], min_cover: float = 0.0) -> "Detections":
+        """与 roi 相交的框；min_cover > 0 时要求交集占框面积不低于该比例"""
+        if len(self) > INDEX_MIN_SIZE and not self._set.indexed():
+            self._set.buildIndex(float(np.median(self.col("height"))))
+        return self._subset(self._set.intersecting(roi["x1"], roi["y1"], roi["x2"], roi["y2"], min_cover))
+
+    def to_dicts(self) -> List[Dict]:
+        """转为 extract_yolo_detections 的字典格式"""
+        x1, y1, x2, y2, conf, cls_id = (self._columns[i].tolist() for i in range(6))
+        return [
+            {"cls": self.names.get(int(c), str(int(c))), "conf": s, "x1": a, "y1": b, "x2": cc, "y2": d}
+            for a, b, cc, d, s, c in zip(x1, y1, x2, y2, conf, cls_id)
+        ]
@@ -4,6 +4,8 @@ from typing import Dict, Iterable, List, Optional
 
 from ultralytics.engine.results import Results
 
+from core.detection.utils.detections import Detections, result_rows
+
 
 def extract_yolo_detections(
     results: Iterable[Results],
@@ -27,19 +29,25 @@ def extract_yolo_detections(
 
     for res in results:
         model_names = getattr(res, "names", None) or getattr(getattr(res, "boxes", None), "names", None)
-        boxes = getattr(res, "boxes", None)
-        if boxes is None:
-            continue
-        for b in boxes:
-            cls_id = int(b.cls)
+        # 整批转 numpy 后逐行取值，不再逐框访问张量
+        for x1, y1, x2, y2, conf, cls_id in result_rows(res).tolist():
+            cls_id = int(cls_id)
             cls_name = model_names[cls_id] if model_names and cls_id in model_names else str(cls_id)
             if accept_set and cls_name not in accept_set:
                 continue
-            conf = float(b.conf)
-            x1, y1, x2, y2 = map(float, b.xyxy[0])
             yolo_dicts.append(
                 {"cls": cls_name, "conf": conf, "x1": x1, "y1": y1, "x2": x2, "y2": y2}
             )
 
     return yolo_dicts
 
+
+def extract_detection_set(
+    results: Iterable[Results],
+    accept_classes: Optional[Iterable[str]] = None,
+) -> Optional[Detections]:
+    """
+    将 YOLO 的推理结果转换为列存容器（见 core/detection/utils/detections.py），
+    场景准备、pile 内过滤等直接在容器上做；camera_api 不可用时返回 None，调用方改用 extract_yolo_detections
+    """
+    return Detections.from_results(results, accept_classes)
@@ -4,22 +4,34 @@ import json
 import datetime
 import errno
 import cv2
-from typing import List, Dict, Any
+from typing import List, Dict, Any, Optional
 from pathlib import Path
 
 from core.vision.yolo_detector import YoloDetection
+from core.vision.tiling import detect_tiled
 
 
 class BarcodeRecognizer:
+    # 分块检测默认配置：原图任一边大于 tile_size 时切块检测（见 core/vision/tiling.py）
+    DEFAULT_TILING = {
+        "enabled": True,
+        "tile_size": 640,
+        "overlap": 128,
+        "min_stddev": 12.0,
+        "batch_size": 8,
+    }
+
     def __init__(self,
                  barcode_reader_path: str = None,
                  code_type: str = 'ucc128',
-                 barcode_model_path: str = None):
+                 barcode_model_path: str = None,
+                 tiling: Optional[Dict[str, Any]] = None):
         """
         初始化条形码识别器
 
         :param barcode_reader_path: 条形码识别程序路径，如果为None则使用默认路径
         :param code_type: 条形码类型 (e.g., 'ucc128', 'code128', 'ean13')
+        :param tiling: 分块检测配置（config.json 的 barcode_tiling），键同 DEFAULT_TILING，缺省项取默认值
         """
         if barcode_reader_path is None:
             # 默认路径：从项目根目录查找
@@ -51,6 +63,7 @@ class BarcodeRecognizer:
         
         self.code_type = code_type
         self.results = []  # 存储识别结果
+        self.tiling = dict(self.DEFAULT_TILING, **(tiling or {}))
 
         # 初始化 YOLO 条码检测器（使用 barcode.pt）
         self.yolo_detector = None
@@ -66,12 +79,13 @@ class BarcodeRecognizer:
                 padding=30
             )
 
-    def process_folder(self, input_dir: str, output_json: str = None) -> List[Dict[str, Any]]:
+    def process_folder(self, input_dir: str, output_json: str = None, deadline=None) -> List[Dict[str, Any]]:
         """
         处理指定文件夹中的所有图片
 
         :param input_dir: 输入图片文件夹路径
         :param output_json: 输出JSON文件路径 (可选)
+        :param deadline: 储位时间预算（提供 expired / clamp()），耗尽后不再处理剩余图片
         :return: 识别结果列表 [ { "filename": str, "output": str, "error": str }, ... ]
         """
         # 验证输入目录是否存在
@@ -89,11 +103,16 @@ class BarcodeRecognizer:
             if "_barcode_crop_" in filename:
                 continue
 
+            if deadline is not None and deadline.expired:
+                break
+
             image_path = os.path.join(input_dir, filename)
             # YOLO 检测并裁剪条形码区域，返回裁剪后的图像路径列表
             cropped_paths = self.preprocess_image(image_path)
             for cropped_path in cropped_paths:
-                self._process_image(cropped_path, filename)
+                if deadline is not None and deadline.expired:
+                    break
+                self._process_image(cropped_path, filename, deadline)
 
         # 保存到JSON文件 (如果指定了输出路径)
         if output_json:
@@ -136,44 +155,56 @@ class BarcodeRecognizer:
         if original_image is None:
             return [image_path]
 
-        # 执行 YOLO 预测
-        results = self.yolo_detector.model.predict(
-            source=original_image,
-            conf=self.yolo_detector.confidence_threshold
-        )
-
         cropped_paths = []
-        crop_index = 0
-        for result in results:
-            boxes = result.boxes
-            for box in boxes:
-                cls = int(box.cls)
-                if cls not in self.yolo_detector.class_mapping:
-                    continue
-                category = self.yolo_detector.class_mapping[cls]
-                if category not in ('barcode', 'QR'):
-                    continue
-
-                x1, y1, x2, y2 = map(int, box.xyxy[0].tolist())
-                # 扩展边界
-                x1_pad = max(0, x1 - self.yolo_detector.padding)
-                y1_pad = max(0, y1 - self.yolo_detector.padding)
-                x2_pad = min(original_image.shape[1], x2 + self.yolo_detector.padding)
-                y2_pad = min(original_image.shape[0], y2 + self.yolo_detector.padding)
-
-                # 裁剪条形码区域
-                cropped = original_image[y1_pad:y2_pad, x1_pad:x2_pad]
-                cropped_dir = os.path.dirname(image_path)
-                name, ext = os.path.splitext(os.path.basename(image_path))
-                crop_filename = f"{name}_barcode_crop_{crop_index}{ext}"
-                crop_path = os.path.join(cropped_dir, crop_filename)
-                cv2.imwrite(crop_path, cropped)
-                cropped_paths.append(crop_path)
-                crop_index += 1
+        for crop_index, (x1, y1, x2, y2) in enumerate(self._detect_barcode_boxes(original_image)):
+            # 扩展边界
+            x1_pad = max(0, x1 - self.yolo_detector.padding)
+            y1_pad = max(0, y1 - self.yolo_detector.padding)
+            x2_pad = min(original_image.shape[1], x2 + self.yolo_detector.padding)
+            y2_pad = min(original_image.shape[0], y2 + self.yolo_detector.padding)
+
+            # 裁剪条形码区域
+            cropped = original_image[y1_pad:y2_pad, x1_pad:x2_pad]
+            cropped_dir = os.path.dirname(image_path)
+            name, ext = os.path.splitext(os.path.basename(image_path))
+            crop_filename = f"{name}_barcode_crop_{crop_index}{ext}"
+            crop_path = os.path.join(cropped_dir, crop_filename)
+            cv2.imwrite(crop_path, cropped)
+            cropped_paths.append(crop_path)
 
         return cropped_paths if cropped_paths else [image_path]
 
-    def _process_image(self, image_path: str, filename: str):
+    def _detect_barcode_boxes(self, image) -> List[tuple]:
+        """
+        检测条码/二维码框，返回原图坐标 (x1, y1, x2, y2) 列表。
+        原图大于模型输入尺寸时分块检测（块内不缩放，小标签不丢），分块模块不可用时整图检测
+        """
+        wanted = {cls for cls, category in self.yolo_detector.class_mapping.items()
+                  if category in ('barcode', 'QR')}
+        conf = self.yolo_detector.confidence_threshold
+        tile_size = int(self.tiling["tile_size"])
+
+        if self.tiling["enabled"] and max(image.shape[:2]) > tile_size:
+            detections = detect_tiled(
+                self.yolo_detector.model, image, conf,
+                tile_size=tile_size,
+                overlap=int(self.tiling["overlap"]),
+                min_stddev=float(self.tiling["min_stddev"]),
+                batch_size=int(self.tiling["batch_size"]))
+            if detections is not None:
+                return [tuple(int(v) for v in row[:4]) for row in detections
+                        if int(row[5]) in wanted]
+
+        # 执行 YOLO 预测
+        results = self.yolo_detector.model.predict(source=image, conf=conf)
+        boxes = []
+        for result in results:
+            for box in result.boxes:
+                if int(box.cls) in wanted:
+                    boxes.append(tuple(map(int, box.xyxy[0].tolist())))
+        return boxes
+
+    def _process_image(self, image_path: str, filename: str, deadline=None):
         """处理单张图片的条形码识别"""
         import logging
         logger = logging.getLogger(__name__)
@@ -201,7 +232,7 @@ class BarcodeRecognizer:
                 args,
                 capture_output=True,
                 text=True,
-                timeout=30,
+                timeout=deadline.clamp(30) if deadline is not None else 30,
                 env=env
             )
 
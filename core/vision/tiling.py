@@ -0,0 +1,62 @@
+"""
+高分辨率分块检测：扫码相机原图按模型输入尺寸切成重叠块，块内不缩放，远处箱子上的小标签也有足够像素。
+切块、无纹理块跳过、打包成批和跨块 NMS 由 hardware/cam_sys 编译出的 camera_api 完成；
+模块不可用时 detect_tiled 返回 None，调用方走整图检测
+"""
+from typing import Optional
+
+import numpy as np
+
+from core.detection.depth.native import load_camera_api
+from core.detection.utils.detections import result_rows
+
+
+def detect_tiled(model, image: np.ndarray, conf: float,
+                 tile_size: int = 640, overlap: int = 128,
+                 min_stddev: float = 12.0, batch_size: int = 8,
+                 include_full_frame: bool = True,
+                 iou_threshold: float = 0.5,
+                 enable_debug: bool = False) -> Optional[np.ndarray]:
+    """
+    分块检测
+
+    :param model: ultralytics YOLO 模型
+    :param image: BGR 原图
+    :param conf: 置信度阈值
+    :param tile_size: 块边长，取模型输入尺寸
+    :param overlap: 相邻块重叠像素，应不小于远处标签的尺寸
+    :param min_stddev: 块内灰度标准差（按 32x32 小格取最大）低于该值视为无纹理，跳过
+    :param batch_size: 每次送入模型的块数
+    :param include_full_frame: 另做一次整图检测，补上跨块太大的近处标签
+    :param iou_threshold: 跨块 NMS 的 IoU 阈值
+    :return: (N, 6) 的 [x1, y1, x2, y2, score, cls]（原图坐标）；原生模块不可用时返回 None
+    """
+    camera_api = load_camera_api()
+    if camera_api is None or not hasattr(camera_api, "planTiles"):
+        return None
+    image = np.ascontiguousarray(image)
+    options = camera_api.TileOptions()
+    options.tile_size = tile_size
+    options.overlap = overlap
+    options.min_stddev = min_stddev
+    tiles = camera_api.planTiles(image, options)
+    kept = [t for t in tiles if not t.skipped]
+
+    rows = []
+    if include_full_frame:
+        for result in model.predict(source=image, conf=conf, verbose=False):
+            rows.append(result_rows(result))
+    if kept:
+        batch = camera_api.packTiles(image, tiles, tile_size)
+        for start in range(0, len(kept), batch_size):
+            chunk = [batch[i] for i in range(start, min(start + batch_size, len(kept)))]
+            results = model.predict(source=chunk, conf=conf, imgsz=tile_size, verbose=False)
+            for tile, result in zip(kept[start:start + batch_size], results):
+                rows.append(result_rows(result, tile.rect.x, tile.rect.y))
+
+    detections = np.concatenate(rows, axis=0) if rows else np.zeros((0, 6), dtype=np.float32)
+    merged = camera_api.mergeDetections(detections, iou_threshold)
+    if enable_debug:
+        print(f"分块检测: {len(tiles)} 块（跳过无纹理 {len(tiles) - len(kept)}），"
+              f"合并前 {len(detections)} 个框，合并后 {len(merged)} 个")
+    return merged
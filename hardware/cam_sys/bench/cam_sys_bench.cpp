@@ -0,0 +1,1138 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 12:48:05
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 12:48:05
+ * @FilePath: /LeafDepot/hardware/cam_sys/bench/cam_sys_bench.cpp
+ * @Description: cam_sys 原生计算核微基准（Google Benchmark）
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncFileWriter.h"
+#include "CamController.h"
+#include "CaptureFlow.h"
+#include "CaptureGroup.h"
+#include "CaptureLoop.h"
+#include "CheckpointStore.h"
+#include "CompletionPort.h"
+#include "DecodePipeline.h"
+#include "DepthKernels.h"
+#include "DetectionSet.h"
+#include "EventBus.h"
+#include "FakeSdk.h"
+#include "FrameKernels.h"
+#include "FramePublisher.h"
+#include "FrameSync.h"
+#include "JobGraph.h"
+#include "JpegEncoder.h"
+#include "MemoryGovernor.h"
+#include "ResultRecord.h"
+#include "StreamRecorder.h"
+#include "TileKernels.h"
+
+namespace {
+
+// 常见分辨率：第四码流预览、720p、1080p、4MP 主码流
+#define FRAME_SIZES          \
+  Args({640, 360})           \
+      ->Args({1280, 720})    \
+      ->Args({1920, 1080})   \
+      ->Args({2688, 1520})
+
+// 带纹理的 YV12 测试帧，避免纯色帧让 JPEG 编码过快
+std::vector<unsigned char> makeYv12(int width, int height) {
+  std::vector<unsigned char> frame(static_cast<size_t>(width) * height * 3 / 2);
+  unsigned int seed = 12345;
+  for (int r = 0; r < height; r++) {
+    for (int c = 0; c < width; c++) {
+      seed = seed * 1103515245u + 12345u;
+      frame[static_cast<size_t>(r) * width + c] =
+          static_cast<unsigned char>(((r / 8 + c / 8) % 2) * 96 + 48 +
+                                     ((seed >> 16) & 31));
+    }
+  }
+  const size_t y_size = static_cast<size_t>(width) * height;
+  for (size_t i = 0; i < y_size / 2; i++) {
+    frame[y_size + i] = static_cast<unsigned char>(96 + (i * 7) % 64);
+  }
+  return frame;
+}
+
+// CamController 每个码流包都会 printf，计时期间把 stdout 指到 /dev/null
+class QuietStdout {
+ public:
+  QuietStdout() {
+    fflush(stdout);
+    saved_ = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+  }
+  ~QuietStdout() {
+    fflush(stdout);
+    dup2(saved_, STDOUT_FILENO);
+    close(saved_);
+  }
+
+ private:
+  int saved_;
+};
+
+// ---------------------------------------------------------------------------
+// 帧转换
+
+void BM_Yv12ToBgr(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  std::vector<unsigned char> bgr(static_cast<size_t>(w) * h * 3);
+  for (auto _ : state) {
+    FrameKernels::yv12ToBgr(&yv12[0], w, h, &bgr[0]);
+    benchmark::DoNotOptimize(&bgr[0]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(yv12.size()));
+}
+BENCHMARK(BM_Yv12ToBgr)->FRAME_SIZES->ThreadRange(1, 4)->UseRealTime();
+
+void BM_DownscaleGray4x(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  std::vector<unsigned char> small;
+  for (auto _ : state) {
+    FrameKernels::downscaleGray(&yv12[0], w, h, 4, &small);
+    benchmark::DoNotOptimize(&small[0]);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DownscaleGray4x)->FRAME_SIZES;
+
+void BM_DownscaleYv12_3x(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  std::vector<unsigned char> small;
+  int ow = 0;
+  int oh = 0;
+  for (auto _ : state) {
+    FrameKernels::downscaleYv12(&yv12[0], w, h, 3, &small, &ow, &oh);
+    benchmark::DoNotOptimize(&small[0]);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DownscaleYv12_3x)->FRAME_SIZES;
+
+// ---------------------------------------------------------------------------
+// JPEG 编码
+
+void BM_JpegEncodeYv12(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  JpegEncoder encoder(90);
+  std::vector<unsigned char> jpeg;
+  for (auto _ : state) {
+    if (!encoder.encodeYv12(&yv12[0], w, h, &jpeg)) {
+      state.SkipWithError("encodeYv12 failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["jpeg_kb"] = jpeg.size() / 1024.0;
+}
+BENCHMARK(BM_JpegEncodeYv12)->FRAME_SIZES->ThreadRange(1, 4)->UseRealTime();
+
+void BM_JpegEncodeBgr(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  std::vector<unsigned char> bgr(static_cast<size_t>(w) * h * 3);
+  FrameKernels::yv12ToBgr(&yv12[0], w, h, &bgr[0]);
+  JpegEncoder encoder(90);
+  std::vector<unsigned char> jpeg;
+  for (auto _ : state) {
+    if (!encoder.encodeBgr(&bgr[0], w, h, &jpeg)) {
+      state.SkipWithError("encodeBgr failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_JpegEncodeBgr)->FRAME_SIZES;
+
+// ROI 抓图：range(2) 为 0 整幅、1 ROI 外抹平、2 ROI 裁图 + 640 宽全景缩略图。
+// ROI 取画面中央宽 60%、高 70% 的一块（垛位区域的典型占比），jpeg_kb 为每帧输出总大小
+void BM_JpegEncodeRoi(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  const int mode = static_cast<int>(state.range(2));
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  std::vector<PixelRect> rois(1);
+  rois[0].x = w / 5;
+  rois[0].y = h * 3 / 20;
+  rois[0].width = w * 3 / 5;
+  rois[0].height = h * 7 / 10;
+  JpegEncoder encoder(90);
+  std::vector<unsigned char> scratch;
+  std::vector<unsigned char> jpeg;
+  size_t total = 0;
+  for (auto _ : state) {
+    total = 0;
+    if (mode == 0) {
+      encoder.encodeYv12(&yv12[0], w, h, &jpeg);
+      total = jpeg.size();
+    } else if (mode == 1) {
+      scratch = yv12;
+      FrameKernels::flattenOutside(&scratch[0], w, h, rois, 16);
+      encoder.encodeYv12(&scratch[0], w, h, &jpeg);
+      total = jpeg.size();
+    } else {
+      PixelRect actual;
+      FrameKernels::cropYv12(&yv12[0], w, h, rois[0], &scratch, &actual);
+      encoder.setQuality(90);
+      encoder.encodeYv12(&scratch[0], actual.width, actual.height, &jpeg);
+      total = jpeg.size();
+      int cw = 0;
+      int ch = 0;
+      FrameKernels::downscaleYv12(&yv12[0], w, h, (w + 639) / 640, &scratch,
+                                  &cw, &ch);
+      encoder.setQuality(60);
+      encoder.encodeYv12(&scratch[0], cw, ch, &jpeg);
+      total += jpeg.size();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["jpeg_kb"] = total / 1024.0;
+}
+BENCHMARK(BM_JpegEncodeRoi)
+    ->Args({1920, 1080, 0})
+    ->Args({1920, 1080, 1})
+    ->Args({1920, 1080, 2})
+    ->Args({2688, 1520, 0})
+    ->Args({2688, 1520, 1})
+    ->Args({2688, 1520, 2});
+
+// ---------------------------------------------------------------------------
+// JPEG 解码：批量重识别读历史抓图。参数为 DCT 域缩小倍数，
+// 4MP 主图 1/4 后长边 672，正好不小于 YOLO 的 640 输入
+
+// 抓图实拍接近大块平坦区域加边缘；makeYv12 的逐像素噪声会让熵解码占满
+// 时间，掩盖 IDCT 缩小的收益，这里用 64 像素棋盘格加渐变
+std::vector<unsigned char> benchJpeg(int w, int h) {
+  std::vector<unsigned char> yv12(static_cast<size_t>(w) * h * 3 / 2, 128);
+  for (int r = 0; r < h; r++) {
+    for (int c = 0; c < w; c++) {
+      yv12[static_cast<size_t>(r) * w + c] = static_cast<unsigned char>(
+          ((r / 64 + c / 64) % 2) * 96 + 32 + (r + c) % 64);
+    }
+  }
+  JpegEncoder encoder(90);
+  std::vector<unsigned char> jpeg;
+  encoder.encodeYv12(&yv12[0], w, h, &jpeg);
+  return jpeg;
+}
+
+void BM_JpegDecodeScaled(benchmark::State& state) {
+  const std::vector<unsigned char> jpeg = benchJpeg(2688, 1520);
+  JpegDecoder decoder;
+  DecodeOptions options;
+  options.scale_denom = static_cast<int>(state.range(0));
+  options.rotate = static_cast<int>(state.range(1));
+  DecodedImage image;
+  for (auto _ : state) {
+    if (!decoder.decode(&jpeg[0], jpeg.size(), options, &image)) {
+      state.SkipWithError("decode failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_JpegDecodeScaled)
+    ->Args({1, 0})
+    ->Args({2, 0})
+    ->Args({4, 0})
+    ->Args({8, 0})
+    ->Args({4, 90});
+
+// 预取解码：参数为解码线程数，64 张 4MP 图按 1/4 解码，窗口 8 张
+void BM_DecodePipeline(benchmark::State& state) {
+  const int threads = static_cast<int>(state.range(0));
+  char dir_tmpl[] = "/tmp/cam_sys_bench_XXXXXX";
+  std::string dir = mkdtemp(dir_tmpl);
+  const std::string path = dir + "/main.jpg";
+  const std::vector<unsigned char> jpeg = benchJpeg(2688, 1520);
+  FILE* fp = fopen(path.c_str(), "wb");
+  fwrite(&jpeg[0], 1, jpeg.size(), fp);
+  fclose(fp);
+  std::vector<DecodeJob> jobs(64);
+  for (size_t i = 0; i < jobs.size(); i++) {
+    jobs[i].tag = static_cast<int64_t>(i);
+    jobs[i].path = path;
+    jobs[i].options.scale_denom = 4;
+    jobs[i].options.rotate = 90;
+  }
+  for (auto _ : state) {
+    DecodePipeline pipeline(threads, 8);
+    pipeline.submit(jobs);
+    pipeline.finish();
+    DecodeResult result;
+    size_t got = 0;
+    while (!pipeline.done()) {
+      if (pipeline.next(&result, 1000)) {
+        got++;
+      }
+    }
+    if (got != jobs.size()) {
+      state.SkipWithError("images lost");
+      break;
+    }
+  }
+  unlink(path.c_str());
+  rmdir(dir.c_str());
+  state.SetItemsProcessed(state.iterations() * jobs.size());
+}
+BENCHMARK(BM_DecodePipeline)->Arg(1)->Arg(4)->UseRealTime();
+
+// 感知哈希：抓图时对 Y 平面（或 ROI）算一次
+
+void BM_Phash(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  uint64_t hash = 0;
+  for (auto _ : state) {
+    hash = FrameKernels::phash(&yv12[0], w, h, NULL);
+    benchmark::DoNotOptimize(hash);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Phash)->Args({1920, 1080})->Args({2688, 1520});
+
+// ---------------------------------------------------------------------------
+// 录制环：容量很小，稳态下每次 push 都伴随淘汰最旧的包
+
+StreamRecorder g_recorder;
+
+void BM_RecorderPushEvict(benchmark::State& state) {
+  const size_t packet = static_cast<size_t>(state.range(0));
+  if (state.thread_index() == 0) {
+    g_recorder.configure(3600.0, 4 << 20, 4096);
+  }
+  std::vector<unsigned char> data(packet, 0x47);
+  for (auto _ : state) {
+    g_recorder.push(2, &data[0], data.size());
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(packet));
+  if (state.thread_index() == 0) {
+    g_recorder.disable();
+  }
+}
+BENCHMARK(BM_RecorderPushEvict)
+    ->Arg(4 << 10)
+    ->Arg(64 << 10)
+    ->ThreadRange(1, 4)
+    ->UseRealTime();
+
+void BM_RecorderSnapshot(benchmark::State& state) {
+  StreamRecorder recorder;
+  recorder.configure(3600.0, 16 << 20, 16384);
+  std::vector<unsigned char> data(static_cast<size_t>(state.range(0)), 0x47);
+  while (recorder.bytesUsed() + data.size() <= (16u << 20)) {
+    recorder.push(2, &data[0], data.size());
+  }
+  std::vector<char> out;
+  for (auto _ : state) {
+    recorder.snapshot(&out);
+    benchmark::DoNotOptimize(&out[0]);
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(out.size()));
+}
+BENCHMARK(BM_RecorderSnapshot)->Arg(4 << 10)->Arg(64 << 10);
+
+// ---------------------------------------------------------------------------
+// 深度后处理 / 点云分层（core/detection/depth/native.py 调用的 DepthKernels）
+
+// SGBM 视差（x16）：左右两块平面，约 1% 散点空洞、交界处 24 像素遮挡带加若干 40x40 大洞
+// （SGBM 开了 speckle 过滤，实际空洞多成片）；引导图在平面交界处有边缘
+void makeDisparity(int w, int h, std::vector<int16_t>* disp,
+                   std::vector<uint8_t>* guide) {
+  disp->resize(static_cast<size_t>(w) * h);
+  guide->resize(disp->size());
+  unsigned int seed = 11;
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      seed = seed * 1103515245u + 12345u;
+      const bool left = x < w / 2;
+      const size_t i = static_cast<size_t>(y) * w + x;
+      const bool hole =
+          (seed >> 16) % 100 == 0 || (x >= w / 2 && x < w / 2 + 24);
+      (*disp)[i] = hole ? -16 : (left ? 640 : 1280);
+      (*guide)[i] = static_cast<uint8_t>((left ? 60 : 190) + ((seed >> 8) & 7));
+    }
+  }
+  for (int by = 0; by + 40 < h; by += 200) {
+    for (int bx = 0; bx + 40 < w; bx += 300) {
+      for (int y = by; y < by + 40; y++) {
+        for (int x = bx; x < bx + 40; x++) {
+          (*disp)[static_cast<size_t>(y) * w + x] = -16;
+        }
+      }
+    }
+  }
+}
+
+void BM_DepthMedian3x3(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<int16_t> disp;
+  std::vector<uint8_t> guide;
+  makeDisparity(w, h, &disp, &guide);
+  std::vector<int16_t> out(disp.size());
+  for (auto _ : state) {
+    DepthKernels::median3x3(&disp[0], w, h, &out[0], 1);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+BENCHMARK(BM_DepthMedian3x3)->Args({1280, 720})->Args({1920, 1080});
+
+// 第三个参数为线程数，0 表示按硬件线程数分块
+void BM_DepthPostprocess(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<int16_t> src;
+  std::vector<uint8_t> guide;
+  makeDisparity(w, h, &src, &guide);
+  DepthFillOptions options;
+  options.threads = static_cast<int>(state.range(2));
+  std::vector<int16_t> disp;
+  DepthFillStats stats;
+  for (auto _ : state) {
+    disp = src;
+    stats = DepthKernels::postprocess(&disp[0], &guide[0], w, h, options);
+    benchmark::DoNotOptimize(stats);
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+  state.counters["valid_before"] = 100.0 * stats.valid_before / (w * h);
+  state.counters["valid_after"] = 100.0 * stats.valid_after / (w * h);
+}
+BENCHMARK(BM_DepthPostprocess)
+    ->Args({1280, 720, 1})
+    ->Args({1280, 720, 0})
+    ->Args({1920, 1080, 1})
+    ->Args({1920, 1080, 0})
+    ->UseRealTime();
+
+// 光线求交生成的垛位深度图（毫米）：相机离地 4500mm、下俯 20 度，
+// 4 层满层（顶面 1600mm）纵深 9~21m，后半段多一层非满顶层（顶面 2000mm），约 5% 无效点
+void makeLayeredDepth(int w, int h, double f, std::vector<float>* depth) {
+  const double kCamHeight = 4500.0;
+  const double kPitch = 20.0 * 3.14159265358979 / 180.0;
+  // 沿纵深的分段：[z0, z1) 内顶面高度 top，z0 处为竖直前脸
+  const double segs[][3] = {{0, 9000, 0}, {9000, 15000, 1600},
+                            {15000, 21000, 2000}, {21000, 1e9, 0}};
+  depth->assign(static_cast<size_t>(w) * h, 0.0f);
+  unsigned int seed = 1;
+  for (int v = 0; v < h; v++) {
+    const double dy = (v - h / 2.0) / f;
+    // 光轴方向每单位深度对应的上升量与水平前进量
+    const double up = -sin(kPitch) - cos(kPitch) * dy;
+    const double fw = cos(kPitch) - sin(kPitch) * dy;
+    for (int u = 0; u < w; u++) {
+      seed = seed * 1103515245u + 12345u;
+      if ((seed >> 8) % 20 == 0 || fw <= 0) continue;
+      const double noise = ((seed >> 16) % 1000 / 1000.0 - 0.5) * 0.004;
+      double t = 0.0;
+      for (size_t s = 0; s < sizeof(segs) / sizeof(segs[0]) && t == 0.0; s++) {
+        const double t0 = segs[s][0] / fw;
+        if (t0 > 0 && kCamHeight + up * t0 < segs[s][2]) {
+          t = t0;
+        } else if (up < 0) {
+          const double tt = (segs[s][2] - kCamHeight) / up;
+          const double z = tt * fw;
+          if (z >= segs[s][0] && z < segs[s][1]) t = tt;
+        }
+      }
+      (*depth)[static_cast<size_t>(v) * w + u] = static_cast<float>(t * (1 + noise));
+    }
+  }
+}
+
+void BM_SegmentLayers(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  const double f = h * 1000.0 / 480;  // 各分辨率垂直视场一致
+  std::vector<float> depth;
+  makeLayeredDepth(w, h, f, &depth);
+  CameraIntrinsics intrinsics;
+  intrinsics.fx = intrinsics.fy = f;
+  intrinsics.cx = w / 2.0;
+  intrinsics.cy = h / 2.0;
+  PixelRect roi = {0, 0, w, h};
+  LayerSegOptions options;
+  options.threads = static_cast<int>(state.range(2));
+  LayerSegResult result;
+  for (auto _ : state) {
+    result = DepthKernels::segmentLayers(&depth[0], w, h, intrinsics, roi,
+                                         options);
+    benchmark::DoNotOptimize(result.surfaces.data());
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+  state.counters["surfaces"] = static_cast<double>(result.surfaces.size());
+}
+BENCHMARK(BM_SegmentLayers)
+    ->Args({640, 480, 1})
+    ->Args({1280, 720, 1})
+    ->Args({1280, 720, 0})
+    ->UseRealTime();
+
+// 扫码相机画面（BGR）：左下 60% x 70% 为带纹理的垛位，其余为只有噪声的墙面和地面
+std::vector<uint8_t> makeScanBgr(int w, int h) {
+  std::vector<uint8_t> bgr(static_cast<size_t>(w) * h * 3);
+  unsigned int seed = 7;
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      seed = seed * 1103515245u + 12345u;
+      const bool pile = x < w * 6 / 10 && y > h * 3 / 10;
+      const int base = pile ? ((x / 12 + y / 12) % 2) * 80 + 60 : 150;
+      uint8_t* p = &bgr[(static_cast<size_t>(y) * w + x) * 3];
+      p[0] = p[1] = p[2] = static_cast<uint8_t>(base + ((seed >> 16) & 3));
+    }
+  }
+  return bgr;
+}
+
+void BM_TilePlanPack(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  const std::vector<uint8_t> bgr = makeScanBgr(w, h);
+  TileOptions options;
+  options.threads = 1;
+  std::vector<uint8_t> batch;
+  int packed = 0;
+  size_t total = 0;
+  for (auto _ : state) {
+    std::vector<Tile> tiles =
+        TileKernels::planTiles(&bgr[0], w, h, w * 3, options);
+    batch.resize(tiles.size() * options.tile_size * options.tile_size * 3);
+    packed = TileKernels::packTiles(&bgr[0], w, h, w * 3, tiles,
+                                    options.tile_size, &batch[0], 1);
+    total = tiles.size();
+    benchmark::DoNotOptimize(batch.data());
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+  state.counters["tiles"] = static_cast<double>(total);
+  state.counters["packed"] = packed;
+}
+BENCHMARK(BM_TilePlanPack)->Args({1920, 1080})->Args({2688, 1520});
+
+// 每个标签在 2~4 个重叠块里各出一次（部分被块边缘截断），外加整图检测的一份
+void BM_TileMerge(benchmark::State& state) {
+  const int labels = static_cast<int>(state.range(0));
+  std::vector<TileDetection> dets;
+  unsigned int seed = 3;
+  for (int i = 0; i < labels; i++) {
+    seed = seed * 1103515245u + 12345u;
+    const float x = static_cast<float>((seed >> 8) % 2600);
+    const float y = static_cast<float>((seed >> 16) % 1450);
+    const int copies = 2 + static_cast<int>((seed >> 4) % 3);
+    for (int c = 0; c < copies; c++) {
+      TileDetection d = {x, y, x + 60.0f - 10.0f * (c % 2), y + 30.0f,
+                         0.9f - 0.05f * c, 0};
+      dets.push_back(d);
+    }
+  }
+  size_t kept = 0;
+  for (auto _ : state) {
+    std::vector<TileDetection> merged =
+        TileKernels::mergeDetections(dets, 0.5f, 0.8f, false);
+    kept = merged.size();
+    benchmark::DoNotOptimize(merged.data());
+  }
+  state.SetItemsProcessed(state.iterations() * dets.size());
+  state.counters["kept"] = static_cast<double>(kept);
+}
+BENCHMARK(BM_TileMerge)->Arg(16)->Arg(128);
+
+// 垛位检测结果：count 个框铺满 1920x1080，三类混合，约一半有高重叠的重复框
+DetectionSet makeDetections(int count) {
+  DetectionSet set;
+  set.reserve(count);
+  unsigned int seed = 21;
+  for (int i = 0; i < count; i++) {
+    seed = seed * 1103515245u + 12345u;
+    const float x = static_cast<float>((seed >> 8) % 1800);
+    const float y = static_cast<float>((seed >> 16) % 1000);
+    const float jitter = (i % 2) ? 4.0f : 0.0f;
+    set.add(x + jitter, y, x + 110.0f, y + 80.0f - jitter,
+            0.3f + 0.7f * ((seed >> 4) % 1000) / 1000.0f,
+            static_cast<int>((seed >> 20) % 3));
+  }
+  return set;
+}
+
+void BM_DetectionNms(benchmark::State& state) {
+  const DetectionSet set = makeDetections(static_cast<int>(state.range(0)));
+  size_t kept = 0;
+  for (auto _ : state) {
+    std::vector<int> keep = set.nms(0.7f, false);
+    kept = keep.size();
+    benchmark::DoNotOptimize(keep.data());
+  }
+  state.SetItemsProcessed(state.iterations() * set.size());
+  state.counters["kept"] = static_cast<double>(kept);
+}
+BENCHMARK(BM_DetectionNms)->Arg(64)->Arg(512)->Arg(4096);
+
+// 第二个参数为 1 时先建格网索引；查询为 64 个单箱大小的矩形（逐箱找邻居/遮挡）
+void BM_DetectionRoiQuery(benchmark::State& state) {
+  DetectionSet set = makeDetections(static_cast<int>(state.range(0)));
+  if (state.range(1)) {
+    set.buildIndex(80.0f);
+  }
+  size_t hits = 0;
+  for (auto _ : state) {
+    hits = 0;
+    for (int q = 0; q < 64; q++) {
+      const float x = 28.0f * q;
+      const float y = 15.0f * q;
+      hits += set.intersecting(x, y, x + 120.0f, y + 90.0f, 0.5f).size();
+    }
+    benchmark::DoNotOptimize(hits);
+  }
+  state.SetItemsProcessed(state.iterations() * 64);
+  state.counters["hits"] = static_cast<double>(hits);
+}
+BENCHMARK(BM_DetectionRoiQuery)
+    ->Args({512, 0})
+    ->Args({512, 1})
+    ->Args({4096, 0})
+    ->Args({4096, 1});
+
+// ---------------------------------------------------------------------------
+// 机器人状态总线：总线上积压 range(0) 条其他机器人的旧 END，
+// 每次迭代一个等待者登记、它的 END 到达、drain 取走
+
+void BM_EventBusDispatch(benchmark::State& state) {
+  const int backlog = static_cast<int>(state.range(0));
+  EventBus bus(backlog + 16);
+  std::vector<std::string> keys(3);
+  for (int i = 0; i < backlog; i++) {
+    keys[0] = "stale" + std::to_string(i) + "|end";
+    keys[1] = "task:old|end";
+    keys[2] = "*|end";
+    bus.publish(keys, "{\"method\": \"end\"}");
+  }
+  std::vector<std::string> wait_keys(2);
+  wait_keys[1] = "|end";
+  keys[1] = "task:T|end";
+  long n = 0;
+  for (auto _ : state) {
+    const std::string code = "rt" + std::to_string(n++ & 63);
+    wait_keys[0] = code + "|end";
+    keys[0] = wait_keys[0];
+    bus.wait(wait_keys);
+    bus.publish(keys, "{\"method\": \"end\"}");
+    std::vector<BusDelivery> ready = bus.drain();
+    benchmark::DoNotOptimize(ready);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["pending"] = static_cast<double>(bus.pending());
+}
+BENCHMARK(BM_EventBusDispatch)->Arg(0)->Arg(1024)->Arg(4096);
+
+// ---------------------------------------------------------------------------
+// 单储位作业图：3D 帧先到、计数先出暂定结果，扫码帧到达后解析品规并重算，
+// 即一个储位在图上的全部调度开销（不含阶段本身的计算）
+
+void BM_JobGraphBin(benchmark::State& state) {
+  std::vector<std::string> deps(2);
+  std::vector<std::string> soft(1, "spec");
+  for (auto _ : state) {
+    JobGraph g;
+    g.addInput("3d");
+    g.addInput("scan_1");
+    g.addInput("scan_2");
+    g.addStage("scene", std::vector<std::string>(1, "3d"));
+    g.addStage("barcode_1", std::vector<std::string>(1, "scan_1"));
+    g.addStage("barcode_2", std::vector<std::string>(1, "scan_2"));
+    deps[0] = "barcode_1";
+    deps[1] = "barcode_2";
+    g.addStage("spec", deps, kJoinAny);
+    g.addStage("count", std::vector<std::string>(1, "scene"), kJoinAll, soft);
+    const char* arrivals[] = {"3d", "scan_1", "scan_2"};
+    int runs = 0;
+    for (int a = 0; !g.done(); a++) {
+      if (a < 3) {
+        g.provide(arrivals[a], true);
+      }
+      std::vector<std::string> ready = g.takeReady();
+      for (size_t i = 0; i < ready.size(); i++) {
+        g.finish(ready[i], true);
+        runs++;
+      }
+    }
+    benchmark::DoNotOptimize(runs);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_JobGraphBin);
+
+// ---------------------------------------------------------------------------
+// 检查点：重启后判断阶段是否完成要重新哈希产物。参数为产物大小（KB）：
+// 扫码图约 512KB，3D 主图约 2MB，深度矩阵缓存约 8MB
+
+void BM_CheckpointVerify(benchmark::State& state) {
+  const size_t size = static_cast<size_t>(state.range(0)) * 1024;
+  char dir_tmpl[] = "/tmp/cam_sys_bench_XXXXXX";
+  std::string dir = mkdtemp(dir_tmpl);
+  const std::string path = dir + "/artifact.bin";
+  // 带纹理的内容，1024 宽的 YV12 每行 1.5KB
+  std::vector<unsigned char> data =
+      makeYv12(1024, static_cast<int>(size / 1536) + 1);
+  data.resize(size);
+  FILE* fp = fopen(path.c_str(), "wb");
+  fwrite(&data[0], 1, data.size(), fp);
+  fclose(fp);
+  {
+    CheckpointStore store(dir);
+    store.commit("scene", std::vector<std::string>(1, path), "{}");
+    for (auto _ : state) {
+      bool ok = store.valid("scene");
+      benchmark::DoNotOptimize(ok);
+    }
+    store.clear();
+  }
+  unlink(path.c_str());
+  rmdir(dir.c_str());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size));
+}
+BENCHMARK(BM_CheckpointVerify)->Arg(512)->Arg(2048)->Arg(8192);
+
+// ---------------------------------------------------------------------------
+// 内存预算：set 在解码回调线程上调用；check 由监控线程周期调用，
+// 有压力时还要走一遍收缩回调。参数为账目数
+
+void BM_MemoryGovernorSet(benchmark::State& state) {
+  MemoryGovernor& governor = MemoryGovernor::instance();
+  const long id = governor.attach("bench", 64 << 20, 0);
+  int64_t used = 0;
+  for (auto _ : state) {
+    used = (used + 4096) & ((64 << 20) - 1);
+    governor.set(id, used);
+  }
+  governor.detach(id);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryGovernorSet);
+
+void BM_MemoryGovernorCheck(benchmark::State& state) {
+  MemoryGovernor& governor = MemoryGovernor::instance();
+  const int n = static_cast<int>(state.range(0));
+  std::vector<long> ids;
+  for (int i = 0; i < n; i++) {
+    // 一半超预算；回调不释放，每次都走完整个收缩顺序
+    ids.push_back(governor.attach("bench", 1 << 20, i % 4,
+                                  [](int, int64_t) { return int64_t(0); }));
+    governor.set(ids.back(), (i % 2 ? 2 : 1) << 19);
+  }
+  // 上限 1MB，一定处于 hard
+  governor.configure(1 << 20);
+  for (auto _ : state) {
+    int level = governor.check();
+    benchmark::DoNotOptimize(level);
+  }
+  governor.configure(0);
+  governor.check();
+  for (size_t i = 0; i < ids.size(); i++) {
+    governor.detach(ids[i]);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryGovernorCheck)->Arg(8)->Arg(64);
+
+// ---------------------------------------------------------------------------
+// 帧时间对齐：每个解码帧都要过时钟估计和帧历史，同步抓图时做一次组匹配
+
+void BM_ClockObserve(benchmark::State& state) {
+  ClockOffsetEstimator clock;
+  int64_t host_us = 1000000;
+  int stamp = 0;
+  unsigned int seed = 3;
+  for (auto _ : state) {
+    seed = seed * 1103515245u + 12345u;
+    stamp += 40;
+    host_us += 40000;
+    // 到达时刻带 0~8ms 的传输抖动
+    int64_t s = clock.observe(stamp, host_us + ((seed >> 16) % 8000));
+    benchmark::DoNotOptimize(s);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClockObserve);
+
+void BM_FrameHistoryPush(benchmark::State& state) {
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  FrameHistory history;
+  history.configure(8, true);
+  TimedFrame meta;
+  meta.width = w;
+  meta.height = h;
+  for (auto _ : state) {
+    meta.frame_num++;
+    meta.host_us += 40000;
+    history.push(meta, &yv12[0], yv12.size());
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(yv12.size()));
+}
+BENCHMARK(BM_FrameHistoryPush)->FRAME_SIZES;
+
+void BM_CaptureGroupMatch(benchmark::State& state) {
+  const int cams = static_cast<int>(state.range(0));
+  std::vector<std::vector<int64_t> > times(cams);
+  unsigned int seed = 11;
+  for (int c = 0; c < cams; c++) {
+    // 每台相机 8 帧，25fps，相位随机
+    seed = seed * 1103515245u + 12345u;
+    int64_t phase = (seed >> 16) % 40000;
+    for (int k = 0; k < 8; k++) {
+      times[c].push_back(phase + k * 40000);
+    }
+  }
+  std::vector<size_t> picks;
+  int64_t spread = 0;
+  for (auto _ : state) {
+    bool ok = CaptureGroup::match(times, 40000, &picks, &spread);
+    benchmark::DoNotOptimize(ok);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CaptureGroupMatch)->Arg(2)->Arg(4)->Arg(8);
+
+// 1080p 一帧发布给 N 个订阅者并全部取走：格式在 GRAY/BGR/JPEG 间轮换、
+// 宽度上限 640，参数相同的订阅者共享同一份转换结果
+void BM_PublishFanout(benchmark::State& state) {
+  const int subs = static_cast<int>(state.range(0));
+  const int w = 1920;
+  const int h = 1080;
+  std::vector<unsigned char> yv12 = makeYv12(w, h);
+  FramePublisher publisher;
+  FrameBufferPool pool;
+  std::vector<std::shared_ptr<FrameSubscription> > consumers;
+  for (int i = 0; i < subs; i++) {
+    SubscriberOptions opt;
+    opt.format = i % 3;
+    opt.max_width = 640;
+    consumers.push_back(publisher.subscribe(opt));
+  }
+  TimedFrame meta;
+  meta.width = w;
+  meta.height = h;
+  PublishedFrame out;
+  for (auto _ : state) {
+    meta.frame_num++;
+    meta.host_us += 40000;
+    meta.yv12 = pool.copy(&yv12[0], yv12.size());
+    publisher.publish(meta);
+    meta.yv12.reset();
+    for (int i = 0; i < subs; i++) {
+      consumers[i]->next(&out, 0);
+    }
+    out = PublishedFrame();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PublishFanout)->Arg(1)->Arg(4)->Arg(8);
+
+// ---------------------------------------------------------------------------
+// 假 SDK 上的抓图路径：码流回调 → HandleRealData → 播放库 → GetJPEG → 异步落盘
+
+struct FakeCamera {
+  CamController cam;
+  int port;
+
+  FakeCamera(int width, int height) : port(-1) {
+    FakeSdkConfig cfg;
+    cfg.width = width;
+    cfg.height = height;
+    cfg.auto_stream = false;  // 由基准自己推帧，计时稳定
+    FakeSdk::configure(cfg);
+    cam.login("127.0.0.1", 8000, "bench", "bench");
+    cam.startRealPlay(1, 0, 0, 0);
+    for (int i = 0; i < 64 && port < 0; i++) {
+      int pw = 0;
+      int ph = 0;
+      if (PlayM4_GetPictureSize(i, &pw, &ph)) {
+        port = i;
+      }
+    }
+  }
+  ~FakeCamera() { cam.logout(); }
+};
+
+void BM_CaptureIngest(benchmark::State& state) {
+  QuietStdout quiet;
+  FakeCamera camera(static_cast<int>(state.range(0)),
+                    static_cast<int>(state.range(1)));
+  for (auto _ : state) {
+    FakeSdk::pump(0, 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CaptureIngest)->FRAME_SIZES;
+
+void BM_CaptureJpegToDisk(benchmark::State& state) {
+  QuietStdout quiet;
+  const int w = static_cast<int>(state.range(0));
+  const int h = static_cast<int>(state.range(1));
+  FakeCamera camera(w, h);
+  if (camera.port < 0) {
+    state.SkipWithError("fake decoder not ready");
+    return;
+  }
+  char dir_tmpl[] = "/tmp/cam_sys_bench_XXXXXX";
+  std::string dir = mkdtemp(dir_tmpl);
+  std::vector<unsigned char> buf(static_cast<size_t>(w) * h * 3 / 2);
+  const std::string path = dir + "/main.jpg";
+  for (auto _ : state) {
+    // 与 CamController::getPic 相同的调用顺序
+    int pw = 0;
+    int ph = 0;
+    unsigned int size = 0;
+    FakeSdk::pump(0, 1);
+    PlayM4_GetPictureSize(camera.port, &pw, &ph);
+    if (!PlayM4_GetJPEG(camera.port, &buf[0],
+                        static_cast<unsigned int>(buf.size()), &size)) {
+      state.SkipWithError("PlayM4_GetJPEG failed");
+      break;
+    }
+    AsyncFileWriter::instance().write(path, &buf[0], size);
+  }
+  AsyncFileWriter::instance().flush();
+  unlink(path.c_str());
+  rmdir(dir.c_str());
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CaptureJpegToDisk)->FRAME_SIZES->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// 抓图事件循环：定时器调度开销，以及多台假相机并发跑完整条抓图流程
+// （登录握手 20 ms、开流、等帧、编码、落盘、登出），参数为相机数
+
+void BM_CaptureLoopTimers(benchmark::State& state) {
+  CaptureLoop loop(2, 1);
+  const int n = static_cast<int>(state.range(0));
+  std::mutex mutex;
+  std::condition_variable cv;
+  for (auto _ : state) {
+    int left = n;
+    for (int i = 0; i < n; i++) {
+      loop.postAfter(0, [&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--left == 0) {
+          cv.notify_one();
+        }
+      });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return left == 0; });
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_CaptureLoopTimers)->Arg(64)->Arg(1024)->UseRealTime();
+
+void BM_CaptureFlows(benchmark::State& state) {
+  QuietStdout quiet;
+  FakeSdkConfig cfg;
+  cfg.width = 640;
+  cfg.height = 360;
+  cfg.packet_size = 4096;
+  cfg.login_delay_ms = 20;
+  FakeSdk::configure(cfg);
+  // 流程按相对路径 capture_img/... 落盘
+  char cwd[4096];
+  if (getcwd(cwd, sizeof(cwd)) == NULL) {
+    state.SkipWithError("getcwd failed");
+    return;
+  }
+  char dir_tmpl[] = "/tmp/cam_sys_bench_XXXXXX";
+  const std::string dir = mkdtemp(dir_tmpl);
+  if (chdir(dir.c_str()) != 0) {
+    state.SkipWithError("chdir failed");
+    return;
+  }
+
+  const int n = static_cast<int>(state.range(0));
+  std::vector<CaptureFlowOptions> flows(n);
+  for (int i = 0; i < n; i++) {
+    flows[i].address = "127.0.0.1";
+    flows[i].task_id = "bench";
+    flows[i].bin_code = "bin";
+    flows[i].camera_type = "cam" + std::to_string(i);
+    flows[i].capture_hash = false;
+  }
+  CaptureLoop loop(2, 2);
+  for (auto _ : state) {
+    std::vector<CaptureFlowResult> results = CaptureFlow::runAll(&loop, flows);
+    for (size_t i = 0; i < results.size(); i++) {
+      if (!results[i].success) {
+        state.SkipWithError("capture flow failed");
+        break;
+      }
+    }
+  }
+  loop.stop();
+
+  for (int i = 0; i < n; i++) {
+    const std::string cam_dir = "capture_img/bench/bin/" + flows[i].camera_type;
+    unlink((cam_dir + "/main.jpg").c_str());
+    rmdir(cam_dir.c_str());
+  }
+  rmdir("capture_img/bench/bin");
+  rmdir("capture_img/bench");
+  rmdir("capture_img");
+  if (chdir(cwd) == 0) {
+    rmdir(dir.c_str());
+  }
+  FakeSdk::configure(FakeSdkConfig());
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_CaptureFlows)
+    ->Arg(8)
+    ->Arg(32)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// 完成端口：参数个线程各投递 1024 个完成，消费者 poll eventfd 后成批 drain；
+// per_wake 为每次唤醒取到的完成数
+void BM_CompletionPortDrain(benchmark::State& state) {
+  const int producers = static_cast<int>(state.range(0));
+  const int per_thread = 1024;
+  CompletionPort port;
+  std::shared_ptr<void> value(new int(0));
+  for (auto _ : state) {
+    std::vector<long> tokens(producers * per_thread);
+    for (size_t i = 0; i < tokens.size(); i++) {
+      tokens[i] = port.reserve();
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < producers; t++) {
+      threads.push_back(std::thread([&, t] {
+        for (int i = 0; i < per_thread; i++) {
+          port.complete(tokens[t * per_thread + i], value);
+        }
+      }));
+    }
+    size_t got = 0;
+    struct pollfd pfd;
+    pfd.fd = port.fd();
+    pfd.events = POLLIN;
+    while (got < tokens.size()) {
+      if (poll(&pfd, 1, 1000) <= 0) {
+        break;
+      }
+      got += port.drain().size();
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+      threads[t].join();
+    }
+    if (got != tokens.size()) {
+      state.SkipWithError("completions lost");
+      break;
+    }
+  }
+  const PortStats st = port.stats();
+  state.counters["per_wake"] =
+      st.batches > 0 ? static_cast<double>(st.completed) / st.batches : 0.0;
+  state.SetItemsProcessed(state.iterations() * producers * per_thread);
+}
+BENCHMARK(BM_CompletionPortDrain)->Arg(1)->Arg(4)->UseRealTime();
+
+// 储位结果记录：一条典型最终结果（四张照片、条码和计数）编码后解码
+ResultRecord benchResultRecord() {
+  ResultRecord r;
+  r.strs[kResTaskNo] = "HS2026101801";
+  r.strs[kResBin] = "A01-02-03";
+  r.strs[kResStatus] = "成功";
+  r.strs[kResSpec] = "黄鹤楼(硬珍品)";
+  const std::string prefix = "/HS2026101801/A01-02-03/";
+  r.strs[kResPhoto3d] = prefix + "3d_camera/main_rotated.jpg";
+  r.strs[kResPhotoDepth] = prefix + "3d_camera/depth_color.jpg";
+  r.strs[kResPhotoScan1] = prefix + "scan_camera_1/main.jpg";
+  r.strs[kResPhotoScan2] = prefix + "scan_camera_2/main.jpg";
+  r.strs[kResDetectStatus] = "success";
+  r.strs[kResBarcodeStatus] = "success";
+  r.strs[kResBarcodeCode] = "123456";
+  r.strs[kResBarcodeProduct] = "黄鹤楼(硬珍品)";
+  r.strs[kResBarcodeTobacco] = "6901028";
+  for (int i = 0; i <= kResBarcodeTobacco; i++) {
+    if (i != kResError && i != kResDetectError) {
+      r.str_mask |= 1u << i;
+    }
+  }
+  r.str_mask |= 1u << kResError;
+  r.str_null_mask |= 1u << kResError;
+  r.ints[kResQuantity] = 37;
+  r.ints[kResDetectCount] = 37;
+  r.ints[kResDetectPile] = 3;
+  r.ints[kResBarcodePile] = 3;
+  r.int_mask = 0xf;
+  r.flags = kRecordHasBin | kRecordHasDetect | kRecordDetectDict |
+            kRecordHasBarcode | kRecordBarcodeDict;
+  return r;
+}
+
+void BM_ResultRecordRoundTrip(benchmark::State& state) {
+  const ResultRecord record = benchResultRecord();
+  std::string buf;
+  ResultRecord out;
+  for (auto _ : state) {
+    ResultCodec::encode(record, &buf);
+    if (!ResultCodec::decode(buf.data(), buf.size(), &out)) {
+      state.SkipWithError("decode failed");
+      break;
+    }
+    benchmark::DoNotOptimize(out.ints[kResQuantity]);
+  }
+  state.counters["bytes"] = static_cast<double>(buf.size());
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ResultRecordRoundTrip);
+
+// 等结果时按储位扫描：只解出 binLocation，不解其余字段
+void BM_ResultRecordPeek(benchmark::State& state) {
+  std::string buf;
+  ResultCodec::encode(benchResultRecord(), &buf);
+  std::string bin;
+  for (auto _ : state) {
+    if (!ResultCodec::peek(buf.data(), buf.size(), kResBin, &bin)) {
+      state.SkipWithError("peek failed");
+      break;
+    }
+    benchmark::DoNotOptimize(bin.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ResultRecordPeek);
+
+}  // namespace
+
+BENCHMARK_MAIN();
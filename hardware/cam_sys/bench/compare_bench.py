@@ -0,0 +1,112 @@
+'''
+Author: big box big box@qq.com
+Date: 2026-10-18 13:05:44
+LastEditors: big box big box@qq.com
+LastEditTime: 2026-10-18 13:05:44
+FilePath: /LeafDepot/hardware/cam_sys/bench/compare_bench.py
+Description: 对比 cam_sys_bench 的 JSON 输出与基线，超出容差的退化返回非零退出码
+
+Copyright (c) 2025 by lizh, All Rights Reserved.
+'''
+
+import argparse
+import json
+import sys
+
+# Google Benchmark 的 time_unit 换算到纳秒
+_UNIT_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load_results(path: str, metric: str) -> dict:
+    """
+    读取 --benchmark_out 生成的 JSON，返回 {基准名: 耗时(ns)}
+
+    有重复运行时优先取 median 聚合值，否则取多次运行中的最小值
+    """
+    with open(path, "r", encoding="utf-8") as f:
+        data = json.load(f)
+
+    medians, samples = {}, {}
+    for b in data.get("benchmarks", []):
+        if b.get("error_occurred"):
+            continue
+        value = b[metric] * _UNIT_NS[b.get("time_unit", "ns")]
+        name = b.get("run_name", b["name"])
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") == "median":
+                medians[name] = value
+        else:
+            samples[name] = min(value, samples.get(name, value))
+
+    results = dict(samples)
+    results.update(medians)
+    return results
+
+
+def compare(baseline: dict, current: dict, tolerance: float):
+    """返回 (报告行, 退化列表, 缺失列表)"""
+    rows, regressions, missing = [], [], []
+    for name in sorted(baseline):
+        if name not in current:
+            missing.append(name)
+            continue
+        base, cur = baseline[name], current[name]
+        ratio = cur / base if base > 0 else 1.0
+        if ratio > 1.0 + tolerance:
+            status = "退化"
+            regressions.append(name)
+        elif ratio < 1.0 - tolerance:
+            status = "提升"
+        else:
+            status = "持平"
+        rows.append((name, base, cur, ratio, status))
+    return rows, regressions, missing
+
+
+def format_ns(value: float) -> str:
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if value >= scale:
+            return f"{value / scale:.2f}{unit}"
+    return f"{value:.0f}ns"
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description='cam_sys_bench 基线对比')
+    parser.add_argument('baseline', help='基线 JSON（bench/baselines/*.json）')
+    parser.add_argument('current', help='本次运行的 --benchmark_out JSON')
+    parser.add_argument('--tolerance', type=float, default=0.15, help='允许的相对退化比例，默认 0.15')
+    parser.add_argument('--metric', choices=['real_time', 'cpu_time'], default='real_time', help='对比的耗时字段')
+    parser.add_argument('--filter', type=str, default='', help='只对比名称包含该子串的基准')
+    parser.add_argument('--fail-on-missing', action='store_true', help='基线中的基准在本次结果里缺失时也算失败')
+    args = parser.parse_args()
+
+    baseline = load_results(args.baseline, args.metric)
+    current = load_results(args.current, args.metric)
+    if args.filter:
+        baseline = {k: v for k, v in baseline.items() if args.filter in k}
+        current = {k: v for k, v in current.items() if args.filter in k}
+
+    rows, regressions, missing = compare(baseline, current, args.tolerance)
+
+    width = max([len(r[0]) for r in rows] + [10])
+    print(f"{'基准':<{width}}  {'基线':>10}  {'本次':>10}  {'比值':>6}  状态")
+    for name, base, cur, ratio, status in rows:
+        print(f"{name:<{width}}  {format_ns(base):>10}  {format_ns(cur):>10}  {ratio:>6.2f}  {status}")
+
+    new = sorted(set(current) - set(baseline))
+    if new:
+        print(f"\n基线中没有的新基准 {len(new)} 个（更新基线后才会参与对比）:")
+        for name in new:
+            print(f"  {name}")
+    if missing:
+        print(f"\n本次结果缺失的基准 {len(missing)} 个:")
+        for name in missing:
+            print(f"  {name}")
+
+    failed = bool(regressions) or (args.fail_on_missing and bool(missing))
+    print(f"\n共对比 {len(rows)} 项，退化 {len(regressions)} 项（容差 {args.tolerance:.0%}，指标 {args.metric}）")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
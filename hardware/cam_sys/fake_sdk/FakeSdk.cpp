@@ -0,0 +1,657 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 12:10:27
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 12:10:27
+ * @FilePath: /LeafDepot/hardware/cam_sys/fake_sdk/FakeSdk.cpp
+ * @Description: 海康 SDK / 播放库的进程内替身，供 bench 与 soak 在无相机环境下链接
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "FakeSdk.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "HCNetSDK/PlayM4.h"
+#include "JpegEncoder.h"
+
+namespace {
+
+const int kMaxRealPlays = 128;  // 一台 NVR 几十路同时预览
+const int kMaxPorts = 256;
+const int kMaxUsers = 64;
+const unsigned int kNoFrameError = 32;  // CamController 按 32 当作“暂无帧”重试
+
+// 伪 PS 包头：magic | width | height | frame_no
+const char kSysMagic[4] = {'F', 'S', 'Y', 'S'};
+const char kPktMagic[4] = {'F', 'P', 'K', 'T'};
+struct PacketHead {
+  char magic[4];
+  int32_t width;
+  int32_t height;
+  uint32_t frame_no;
+};
+
+struct Stream {
+  bool used;
+  LONG user;
+  REALDATACALLBACK cb;
+  void* cb_user;
+  FakeSdkConfig cfg;
+  uint32_t frame_no;
+  std::vector<BYTE> packet;
+  std::thread thread;
+  std::atomic<bool> running;
+  std::mutex send_mutex;  // pump() 与推流线程互斥
+
+  Stream() : used(false), user(-1), cb(NULL), cb_user(NULL), frame_no(0),
+             running(false) {}
+};
+
+typedef void(CALLBACK* DecCallback)(int, char*, int, FRAME_INFO*, void*, int);
+
+struct Port {
+  bool used;
+  bool opened;
+  bool playing;
+  int width;
+  int height;
+  uint32_t frame_no;
+  bool has_frame;
+  DecCallback dec_cb;
+  void* dec_user;
+  unsigned int last_error;
+  std::vector<unsigned char> yv12;
+  std::unique_ptr<JpegEncoder> encoder;
+  std::mutex mutex;
+
+  Port() { reset(); }
+  void reset() {
+    used = opened = playing = has_frame = false;
+    width = height = 0;
+    frame_no = 0;
+    dec_cb = NULL;
+    dec_user = NULL;
+    last_error = PLAYM4_NOERROR;
+  }
+};
+
+std::mutex g_mutex;  // 保护下列表项的分配/释放
+FakeSdkConfig g_config;
+FakeSdkStats g_stats;
+bool g_users[kMaxUsers];
+Stream g_streams[kMaxRealPlays];
+Port g_ports[kMaxPorts];
+thread_local DWORD t_last_error = NET_DVR_NOERROR;
+long g_login_calls = 0;
+long g_realplay_calls = 0;
+std::atomic<long> g_jpeg_calls(0);
+// 抓图语料，替换时整体换指针，正在拷贝的调用仍持有旧语料
+typedef std::vector<std::vector<unsigned char> > JpegCorpus;
+std::shared_ptr<const JpegCorpus> g_corpus;
+std::atomic<long> g_corpus_next(0);
+
+// 按脚本判断本次调用是否注入失败；调用方持有 g_mutex 或传入原子计数
+bool scriptedFault(long calls, int every) {
+  return every > 0 && calls % every == 0;
+}
+
+Port* portAt(int nPort) {
+  if (nPort < 0 || nPort >= kMaxPorts) {
+    return NULL;
+  }
+  return &g_ports[nPort];
+}
+
+// 固定的渐变图案，只在尺寸变化时整帧生成；每帧更新顶部一条带模拟画面变化
+void renderFrame(Port* port, int width, int height, uint32_t frame_no) {
+  const size_t y_size = static_cast<size_t>(width) * height;
+  if (port->width != width || port->height != height || port->yv12.empty()) {
+    port->width = width;
+    port->height = height;
+    port->yv12.resize(y_size * 3 / 2);
+    for (int r = 0; r < height; r++) {
+      unsigned char* row = &port->yv12[static_cast<size_t>(r) * width];
+      for (int c = 0; c < width; c++) {
+        row[c] = static_cast<unsigned char>(16 + ((r + c) * 219 / (width + height)));
+      }
+    }
+    memset(&port->yv12[y_size], 100, y_size / 4);
+    memset(&port->yv12[y_size + y_size / 4], 156, y_size / 4);
+  }
+  const int band = height < 16 ? height : 16;
+  memset(&port->yv12[0], static_cast<int>(frame_no % 220) + 16,
+         static_cast<size_t>(width) * band);
+}
+
+bool sendFrame(LONG handle, Stream* s) {
+  {
+    std::lock_guard<std::mutex> lock(s->send_mutex);
+    if (!s->used || s->cb == NULL) {
+      return false;
+    }
+    PacketHead head;
+    if (scriptedFault(s->frame_no + 1, s->cfg.resend_syshead_every)) {
+      memcpy(head.magic, kSysMagic, sizeof(head.magic));
+      head.width = s->cfg.width;
+      head.height = s->cfg.height;
+      head.frame_no = 0;
+      s->cb(handle, NET_DVR_SYSHEAD, reinterpret_cast<BYTE*>(&head),
+            sizeof(head), s->cb_user);
+    }
+    memcpy(head.magic, kPktMagic, sizeof(head.magic));
+    head.width = s->cfg.width;
+    head.height = s->cfg.height;
+    head.frame_no = ++s->frame_no;
+    memcpy(&s->packet[0], &head, sizeof(head));
+    s->cb(handle, NET_DVR_STREAMDATA, &s->packet[0],
+          static_cast<DWORD>(s->packet.size()), s->cb_user);
+  }
+  std::lock_guard<std::mutex> glock(g_mutex);
+  g_stats.frames_sent++;
+  return true;
+}
+
+void streamLoop(LONG handle) {
+  Stream* s = &g_streams[handle];
+  const useconds_t interval =
+      static_cast<useconds_t>(1000000 / (s->cfg.fps > 0 ? s->cfg.fps : 25));
+  while (s->running) {
+    usleep(interval);
+    if (s->running) {
+      sendFrame(handle, s);
+    }
+  }
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// 控制接口
+
+void FakeSdk::configure(const FakeSdkConfig& config) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_config = config;
+}
+
+FakeSdkConfig FakeSdk::config() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  return g_config;
+}
+
+void FakeSdk::setJpegCorpus(
+    const std::vector<std::vector<unsigned char> >& jpegs) {
+  std::shared_ptr<const JpegCorpus> corpus;
+  if (!jpegs.empty()) {
+    corpus.reset(new JpegCorpus(jpegs));
+  }
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_corpus = corpus;
+  g_corpus_next = 0;
+}
+
+bool FakeSdk::pump(LONG real_handle, int frames) {
+  if (real_handle < 0 || real_handle >= kMaxRealPlays) {
+    return false;
+  }
+  for (int i = 0; i < frames; i++) {
+    if (!sendFrame(real_handle, &g_streams[real_handle])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+FakeSdkStats FakeSdk::stats() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  return g_stats;
+}
+
+void FakeSdk::resetStats() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_stats.bad_frees = 0;
+  g_stats.frames_sent = 0;
+  g_stats.faults = 0;
+  g_login_calls = 0;
+  g_realplay_calls = 0;
+  g_jpeg_calls = 0;
+}
+
+// ---------------------------------------------------------------------------
+// NET_DVR_*
+
+BOOL NET_DVR_Init() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_stats.init_refs++;
+  return TRUE;
+}
+
+BOOL NET_DVR_Cleanup() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (g_stats.init_refs <= 0) {
+    g_stats.bad_frees++;
+    t_last_error = NET_DVR_NOINIT;
+    return FALSE;
+  }
+  g_stats.init_refs--;
+  return TRUE;
+}
+
+BOOL NET_DVR_SetLogToFile(DWORD, char*, BOOL) { return TRUE; }
+BOOL NET_DVR_SetConnectTime(DWORD, DWORD) { return TRUE; }
+BOOL NET_DVR_SetReconnect(DWORD, BOOL) { return TRUE; }
+DWORD NET_DVR_GetLastError() { return t_last_error; }
+
+namespace {
+
+// 异步登录的结果在独立线程里回调，错误码与真实 SDK 一样记在回调线程
+void loginCallbackLoop(fLoginResultCallBack cb, void* user, LONG id,
+                       DWORD error, NET_DVR_DEVICEINFO_V30 dev, int delay_ms) {
+  if (delay_ms > 0) {
+    usleep(static_cast<useconds_t>(delay_ms) * 1000);
+  }
+  t_last_error = error;
+  cb(id, id >= 0 ? 1 : 0, id >= 0 ? &dev : NULL, user);
+}
+
+}  // namespace
+
+// 异步登录时返回 0 只表示请求已发出，登录结果（含失败）以回调为准
+LONG NET_DVR_Login_V40(LPNET_DVR_USER_LOGIN_INFO pLoginInfo,
+                       LPNET_DVR_DEVICEINFO_V40 lpDeviceInfo) {
+  LONG id = -1;
+  DWORD error = NET_DVR_NOERROR;
+  NET_DVR_DEVICEINFO_V30 dev;
+  memset(&dev, 0, sizeof(dev));
+  int delay_ms = 0;
+  {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_stats.init_refs <= 0) {
+      t_last_error = NET_DVR_NOINIT;
+      return -1;
+    }
+    if (pLoginInfo == NULL ||
+        (pLoginInfo->bUseAsynLogin && pLoginInfo->cbLoginResult == NULL)) {
+      t_last_error = NET_DVR_PARAMETER_ERROR;
+      return -1;
+    }
+    delay_ms = g_config.login_delay_ms;
+    if (scriptedFault(++g_login_calls, g_config.login_fail_every)) {
+      g_stats.faults++;
+      error = NET_DVR_NETWORK_FAIL_CONNECT;
+    } else {
+      error = NET_DVR_MAX_NUM;
+      for (int i = 0; i < kMaxUsers; i++) {
+        if (!g_users[i]) {
+          g_users[i] = true;
+          g_stats.users++;
+          id = i;
+          error = NET_DVR_NOERROR;
+          snprintf(reinterpret_cast<char*>(dev.sSerialNumber),
+                   sizeof(dev.sSerialNumber), "FAKE-SDK-%02d", i);
+          dev.byChanNum = static_cast<BYTE>(g_config.channels);
+          dev.byStartChan = 1;
+          dev.byIPChanNum = static_cast<BYTE>(g_config.ip_channels & 0xff);
+          dev.byHighDChanNum = static_cast<BYTE>(g_config.ip_channels >> 8);
+          dev.byStartDChan = g_config.ip_channels > 0 ? 33 : 0;
+          break;
+        }
+      }
+    }
+  }
+
+  if (pLoginInfo->bUseAsynLogin) {
+    std::thread(loginCallbackLoop, pLoginInfo->cbLoginResult,
+                pLoginInfo->pUser, id, error, dev, delay_ms)
+        .detach();
+    return 0;
+  }
+  if (delay_ms > 0) {
+    usleep(static_cast<useconds_t>(delay_ms) * 1000);
+  }
+  if (id < 0) {
+    t_last_error = error;
+    return -1;
+  }
+  if (lpDeviceInfo) {
+    memset(lpDeviceInfo, 0, sizeof(*lpDeviceInfo));
+    lpDeviceInfo->struDeviceV30 = dev;
+  }
+  return id;
+}
+
+BOOL NET_DVR_Logout(LONG lUserID) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (lUserID < 0 || lUserID >= kMaxUsers || !g_users[lUserID]) {
+    g_stats.bad_frees++;
+    t_last_error = NET_DVR_USERNOTEXIST;
+    return FALSE;
+  }
+  g_users[lUserID] = false;
+  g_stats.users--;
+  return TRUE;
+}
+
+LONG NET_DVR_RealPlay_V40(LONG lUserID, LPNET_DVR_PREVIEWINFO lpPreviewInfo,
+                          REALDATACALLBACK fRealDataCallBack_V30, void* pUser) {
+  LONG handle = -1;
+  Stream* s = NULL;
+  {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (lUserID < 0 || lUserID >= kMaxUsers || !g_users[lUserID]) {
+      t_last_error = NET_DVR_USERNOTEXIST;
+      return -1;
+    }
+    if (lpPreviewInfo == NULL) {
+      t_last_error = NET_DVR_PARAMETER_ERROR;
+      return -1;
+    }
+    if (scriptedFault(++g_realplay_calls, g_config.realplay_fail_every)) {
+      g_stats.faults++;
+      t_last_error = NET_DVR_NETWORK_RECV_TIMEOUT;
+      return -1;
+    }
+    for (int i = 0; i < kMaxRealPlays; i++) {
+      if (!g_streams[i].used) {
+        handle = i;
+        break;
+      }
+    }
+    if (handle < 0) {
+      t_last_error = NET_DVR_MAX_NUM;
+      return -1;
+    }
+    s = &g_streams[handle];
+    std::lock_guard<std::mutex> slock(s->send_mutex);
+    s->used = true;
+    s->user = lUserID;
+    s->cb = fRealDataCallBack_V30;
+    s->cb_user = pUser;
+    s->cfg = g_config;
+    s->frame_no = 0;
+    s->packet.assign(s->cfg.packet_size > static_cast<int>(sizeof(PacketHead))
+                         ? s->cfg.packet_size
+                         : sizeof(PacketHead),
+                     0x47);
+    g_stats.real_plays++;
+  }
+
+  // 与真实 SDK 一样，回调可能在 RealPlay 返回之前就开始
+  if (s->cb) {
+    PacketHead head;
+    memcpy(head.magic, kSysMagic, sizeof(head.magic));
+    head.width = s->cfg.width;
+    head.height = s->cfg.height;
+    head.frame_no = 0;
+    s->cb(handle, NET_DVR_SYSHEAD, reinterpret_cast<BYTE*>(&head),
+          sizeof(head), s->cb_user);
+    sendFrame(handle, s);
+  }
+  if (s->cfg.auto_stream) {
+    s->running = true;
+    s->thread = std::thread(streamLoop, handle);
+  }
+  return handle;
+}
+
+BOOL NET_DVR_StopRealPlay(LONG lRealHandle) {
+  if (lRealHandle < 0 || lRealHandle >= kMaxRealPlays) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_stats.bad_frees++;
+    return FALSE;
+  }
+  Stream* s = &g_streams[lRealHandle];
+  s->running = false;
+  if (s->thread.joinable()) {
+    s->thread.join();
+  }
+  std::lock_guard<std::mutex> slock(s->send_mutex);
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!s->used) {
+    g_stats.bad_frees++;
+    return FALSE;
+  }
+  s->used = false;
+  s->cb = NULL;
+  std::vector<BYTE>().swap(s->packet);
+  g_stats.real_plays--;
+  return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// PlayM4_*
+
+int PlayM4_GetPort(int* nPort) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  for (int i = 0; i < kMaxPorts; i++) {
+    if (!g_ports[i].used) {
+      std::lock_guard<std::mutex> plock(g_ports[i].mutex);
+      g_ports[i].reset();
+      g_ports[i].used = true;
+      g_stats.ports++;
+      *nPort = i;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+int PlayM4_FreePort(int nPort) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  Port* port = portAt(nPort);
+  if (port == NULL || !port->used) {
+    g_stats.bad_frees++;
+    return FALSE;
+  }
+  std::lock_guard<std::mutex> plock(port->mutex);
+  port->reset();
+  std::vector<unsigned char>().swap(port->yv12);
+  port->encoder.reset();
+  g_stats.ports--;
+  return TRUE;
+}
+
+int PlayM4_SetStreamOpenMode(int nPort, unsigned int) {
+  Port* port = portAt(nPort);
+  return port != NULL && port->used;
+}
+
+int PlayM4_OpenStream(int nPort, unsigned char* pFileHeadBuf,
+                      unsigned int nSize, unsigned int) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return FALSE;
+  }
+  std::lock_guard<std::mutex> lock(port->mutex);
+  if (!port->used || pFileHeadBuf == NULL || nSize < sizeof(PacketHead) ||
+      memcmp(pFileHeadBuf, kSysMagic, sizeof(kSysMagic)) != 0) {
+    port->last_error = PLAYM4_PARA_OVER;
+    return FALSE;
+  }
+  port->opened = true;
+  return TRUE;
+}
+
+int PlayM4_CloseStream(int nPort) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return FALSE;
+  }
+  std::lock_guard<std::mutex> lock(port->mutex);
+  if (!port->opened) {
+    port->last_error = PLAYM4_ORDER_ERROR;
+    return FALSE;
+  }
+  port->opened = false;
+  port->has_frame = false;
+  return TRUE;
+}
+
+int PlayM4_Play(int nPort, PLAYM4_HWND) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return FALSE;
+  }
+  std::lock_guard<std::mutex> lock(port->mutex);
+  if (!port->opened) {
+    port->last_error = PLAYM4_ORDER_ERROR;
+    return FALSE;
+  }
+  port->playing = true;
+  return TRUE;
+}
+
+int PlayM4_Stop(int nPort) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return FALSE;
+  }
+  std::lock_guard<std::mutex> lock(port->mutex);
+  port->playing = false;
+  return TRUE;
+}
+
+int PlayM4_SetDecCallBackExMend(int nPort, DecCallback DecCBFun, char*, int,
+                                void* nUser) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return FALSE;
+  }
+  std::lock_guard<std::mutex> lock(port->mutex);
+  port->dec_cb = DecCBFun;
+  port->dec_user = nUser;
+  return TRUE;
+}
+
+int PlayM4_InputData(int nPort, unsigned char* pBuf, unsigned int nSize) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return FALSE;
+  }
+  DecCallback cb = NULL;
+  void* cb_user = NULL;
+  FRAME_INFO info;
+  {
+    std::lock_guard<std::mutex> lock(port->mutex);
+    if (!port->playing) {
+      port->last_error = PLAYM4_ORDER_ERROR;
+      return FALSE;
+    }
+    PacketHead head;
+    if (pBuf == NULL || nSize < sizeof(head)) {
+      port->last_error = PLAYM4_PARA_OVER;
+      return FALSE;
+    }
+    memcpy(&head, pBuf, sizeof(head));
+    if (memcmp(head.magic, kPktMagic, sizeof(kPktMagic)) != 0) {
+      return TRUE;  // 非视频包，忽略
+    }
+    renderFrame(port, head.width, head.height, head.frame_no);
+    port->frame_no = head.frame_no;
+    port->has_frame = true;
+    cb = port->dec_cb;
+    cb_user = port->dec_user;
+    info.nWidth = port->width;
+    info.nHeight = port->height;
+    info.nStamp = static_cast<int>(head.frame_no * 40);
+    info.nType = T_YV12;
+    info.nFrameRate = 25;
+    info.dwFrameNum = head.frame_no;
+  }
+  if (cb) {
+    cb(nPort, reinterpret_cast<char*>(&port->yv12[0]),
+       static_cast<int>(port->yv12.size()), &info, cb_user, 0);
+  }
+  return TRUE;
+}
+
+unsigned int PlayM4_GetLastError(int nPort) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return PLAYM4_PARA_OVER;
+  }
+  std::lock_guard<std::mutex> lock(port->mutex);
+  return port->last_error;
+}
+
+int PlayM4_GetPictureSize(int nPort, int* pWidth, int* pHeight) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return FALSE;
+  }
+  std::lock_guard<std::mutex> lock(port->mutex);
+  if (!port->has_frame) {
+    port->last_error = kNoFrameError;
+    return FALSE;
+  }
+  *pWidth = port->width;
+  *pHeight = port->height;
+  return TRUE;
+}
+
+int PlayM4_GetJPEG(int nPort, unsigned char* pJpeg, unsigned int nBufSize,
+                   unsigned int* pJpegSize) {
+  Port* port = portAt(nPort);
+  if (port == NULL) {
+    return FALSE;
+  }
+  const FakeSdkConfig cfg = FakeSdk::config();  // 先于端口锁取 g_mutex
+  std::shared_ptr<const JpegCorpus> corpus;
+  {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    corpus = g_corpus;
+  }
+  if (scriptedFault(++g_jpeg_calls, cfg.jpeg_fail_every)) {
+    {
+      std::lock_guard<std::mutex> lock(g_mutex);
+      g_stats.faults++;
+    }
+    std::lock_guard<std::mutex> lock(port->mutex);
+    port->last_error = PLAYM4_ORDER_ERROR;
+    return FALSE;
+  }
+  const int quality = cfg.jpeg_quality;
+  std::lock_guard<std::mutex> lock(port->mutex);
+  if (!port->has_frame) {
+    port->last_error = kNoFrameError;
+    return FALSE;
+  }
+  if (corpus) {
+    const std::vector<unsigned char>& jpeg =
+        (*corpus)[static_cast<size_t>(g_corpus_next++) % corpus->size()];
+    *pJpegSize = static_cast<unsigned int>(jpeg.size());
+    if (jpeg.size() > nBufSize) {
+      port->last_error = PLAYM4_BUF_OVER;
+      return FALSE;
+    }
+    memcpy(pJpeg, &jpeg[0], jpeg.size());
+    return TRUE;
+  }
+  if (!port->encoder) {
+    port->encoder.reset(new JpegEncoder(quality));
+  }
+  std::vector<unsigned char> jpeg;
+  if (!port->encoder->encodeYv12(&port->yv12[0], port->width, port->height,
+                                 &jpeg)) {
+    port->last_error = PLAYM4_ALLOC_MEMORY_ERROR;
+    return FALSE;
+  }
+  *pJpegSize = static_cast<unsigned int>(jpeg.size());
+  if (jpeg.size() > nBufSize) {
+    port->last_error = PLAYM4_BUF_OVER;
+    return FALSE;
+  }
+  memcpy(pJpeg, &jpeg[0], jpeg.size());
+  return TRUE;
+}
+
+// 调试用的逐帧落盘，替身里不产生文件
+int PlayM4_ConvertToJpegFile(char*, int, int, int, int, char*) { return TRUE; }
+int PlayM4_ConvertToBmpFile(char*, int, int, int, int, char*) { return TRUE; }
@@ -0,0 +1,84 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 12:10:27
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 12:10:27
+ * @FilePath: /LeafDepot/hardware/cam_sys/fake_sdk/FakeSdk.h
+ * @Description: 海康 SDK / 播放库的进程内替身，供 bench 与 soak 在无相机环境下链接
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <vector>
+
+#include "HCNetSDK/HCNetSDK.h"
+
+// 只实现 CamController 用到的 NET_DVR_* / PlayM4_* 接口：
+// - RealPlay 返回前同步送出系统头和第一帧，之后（auto_stream 时）按 fps 推流
+// - 码流包是带帧号的伪 PS 包，播放库端口按帧号“解码”出固定图案的 YV12 帧
+// - PlayM4_GetJPEG 用 JpegEncoder 真实编码，抓图路径的耗时有参考意义；
+//   设置了图片语料时改为轮流返回语料里的 JPEG（压测用真实画面喂给下游检测）
+// - 端口、句柄、Init/Cleanup 都有计数，重复释放会返回失败，便于发现泄漏
+// - bUseAsynLogin 时登录结果在 SDK 线程里经 cbLoginResult 回调（等 login_delay_ms 后）
+struct FakeSdkConfig {
+  int width;
+  int height;
+  int fps;
+  int packet_size;    // 每帧码流包大小，模拟码率
+  int channels;       // 登录时报告的模拟/本机通道数（从 1 开始）
+  int ip_channels;    // 登录时报告的 IP 通道数（从 33 开始，模拟 NVR）
+  bool auto_stream;   // false 时只在 pump() 时送帧
+  int jpeg_quality;
+  int login_delay_ms;  // 登录握手耗时，同步登录阻塞调用方，异步登录延后回调
+
+  // 故障脚本：每 N 次调用失败一次，0 表示不注入
+  int login_fail_every;
+  int realplay_fail_every;
+  int jpeg_fail_every;
+  int resend_syshead_every;  // 每 N 帧重发一次系统头，模拟断线重连
+
+  FakeSdkConfig()
+      : width(1920),
+        height(1080),
+        fps(25),
+        packet_size(64 * 1024),
+        channels(1),
+        ip_channels(0),
+        auto_stream(true),
+        jpeg_quality(90),
+        login_delay_ms(0),
+        login_fail_every(0),
+        realplay_fail_every(0),
+        jpeg_fail_every(0),
+        resend_syshead_every(0) {}
+};
+
+struct FakeSdkStats {
+  int init_refs;      // NET_DVR_Init 减去 NET_DVR_Cleanup
+  int users;          // 已登录未登出
+  int real_plays;     // 正在预览的句柄
+  int ports;          // 已申请未释放的播放库端口
+  int bad_frees;      // 对无效句柄/端口的释放次数
+  long frames_sent;
+  long faults;        // 按脚本注入的失败次数
+};
+
+class FakeSdk {
+ public:
+  // 影响之后新开的预览，已开的预览保持原配置
+  static void configure(const FakeSdkConfig& config);
+  static FakeSdkConfig config();
+
+  // 抓图语料：非空时 PlayM4_GetJPEG 按调用顺序轮流返回其中的 JPEG，
+  // 不再编码图案（仍要求端口已解码出帧）；传空清除。解码帧始终是图案
+  static void setJpegCorpus(
+      const std::vector<std::vector<unsigned char> >& jpegs);
+
+  // 同步向预览句柄推 frames 帧（在调用线程里触发码流回调）
+  static bool pump(LONG real_handle, int frames);
+
+  static FakeSdkStats stats();
+  // 清零 bad_frees / frames_sent / faults 以及故障脚本的调用计数
+  static void resetStats();
+};
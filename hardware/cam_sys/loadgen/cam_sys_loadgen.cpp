@@ -0,0 +1,1275 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 22:48:31
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 22:48:31
+ * @FilePath: /LeafDepot/hardware/cam_sys/loadgen/cam_sys_loadgen.cpp
+ * @Description: 仓库级端到端压测：N 台模拟机器人 + 假相机，驱动 gateway 并统计时延与饱和度
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncFileWriter.h"
+#include "CamController.h"
+#include "FakeSdk.h"
+#include "StreamRecorder.h"
+
+namespace {
+
+double nowSec() { return StreamRecorder::nowMicros() / 1e6; }
+
+// ---------------------------------------------------------------------------
+// 行驶时间分布（秒）：fixed:T | uniform:A,B | normal:MU,SIGMA |
+// lognormal:MU,SIGMA（MU/SIGMA 为 ln 秒的均值与标准差）
+
+struct TravelDist {
+  enum Kind { kFixed, kUniform, kNormal, kLognormal };
+  Kind kind;
+  double a;
+  double b;
+
+  TravelDist() : kind(kFixed), a(15.0), b(0.0) {}
+};
+
+bool parseTravel(const std::string& spec, TravelDist* d) {
+  const size_t colon = spec.find(':');
+  if (colon == std::string::npos) {
+    return false;
+  }
+  const std::string kind = spec.substr(0, colon);
+  const std::string args = spec.substr(colon + 1);
+  double a = 0.0;
+  double b = 0.0;
+  const int n = sscanf(args.c_str(), "%lf,%lf", &a, &b);
+  if (kind == "fixed" && n >= 1 && a >= 0.0) {
+    d->kind = TravelDist::kFixed;
+  } else if (kind == "uniform" && n == 2 && a >= 0.0 && b >= a) {
+    d->kind = TravelDist::kUniform;
+  } else if (kind == "normal" && n == 2 && b >= 0.0) {
+    d->kind = TravelDist::kNormal;
+  } else if (kind == "lognormal" && n == 2 && b >= 0.0) {
+    d->kind = TravelDist::kLognormal;
+  } else {
+    return false;
+  }
+  d->a = a;
+  d->b = b;
+  return true;
+}
+
+double sampleTravel(const TravelDist& d, std::mt19937* rng) {
+  double v = d.a;
+  switch (d.kind) {
+    case TravelDist::kUniform:
+      v = std::uniform_real_distribution<double>(d.a, d.b)(*rng);
+      break;
+    case TravelDist::kNormal:
+      v = std::normal_distribution<double>(d.a, d.b)(*rng);
+      break;
+    case TravelDist::kLognormal:
+      v = std::lognormal_distribution<double>(d.a, d.b)(*rng);
+      break;
+    default:
+      break;
+  }
+  return std::max(0.0, v);
+}
+
+// ---------------------------------------------------------------------------
+// JSON：报文结构固定，只需要拼字符串和按键取字符串值
+
+std::string jsonQuote(const std::string& s) {
+  std::string out = "\"";
+  for (size_t i = 0; i < s.size(); i++) {
+    const unsigned char c = static_cast<unsigned char>(s[i]);
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      out += esc;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  return out + "\"";
+}
+
+// 从 from 起找第一个 "key": "value"，取出 value（转义只去掉反斜杠，\uXXXX 不处理），
+// end 返回 value 之后的位置
+bool jsonString(const std::string& text, const std::string& key, size_t from,
+                std::string* value, size_t* end) {
+  const std::string quoted = "\"" + key + "\"";
+  for (size_t p = text.find(quoted, from); p != std::string::npos;
+       p = text.find(quoted, p + 1)) {
+    size_t i = text.find_first_not_of(" \t\r\n", p + quoted.size());
+    if (i == std::string::npos || text[i] != ':') {
+      continue;
+    }
+    i = text.find_first_not_of(" \t\r\n", i + 1);
+    if (i == std::string::npos || text[i] != '"') {
+      continue;
+    }
+    value->clear();
+    for (i++; i < text.size() && text[i] != '"'; i++) {
+      if (text[i] == '\\' && i + 1 < text.size()) {
+        i++;
+      }
+      *value += text[i];
+    }
+    if (end) {
+      *end = i;
+    }
+    return i < text.size();
+  }
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// 极简 HTTP/1.1（Connection: close），只覆盖 RCS 接口和 gateway 的 JSON 接口
+
+struct HttpRequest {
+  std::string method;
+  std::string path;
+  std::string query;
+  std::string body;
+};
+
+bool sendAll(int fd, const std::string& data) {
+  size_t off = 0;
+  while (off < data.size()) {
+    const ssize_t n =
+        send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    off += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+void setTimeouts(int fd, int timeout_ms) {
+  struct timeval tv;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// 头部里的 Content-Length，没有时返回 -1
+long contentLength(const std::string& head) {
+  std::string lower(head);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  const size_t p = lower.find("\r\ncontent-length:");
+  if (p == std::string::npos) {
+    return -1;
+  }
+  return atol(lower.c_str() + p + 17);
+}
+
+bool chunkedBody(const std::string& head) {
+  std::string lower(head);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  return lower.find("\r\ntransfer-encoding: chunked") != std::string::npos;
+}
+
+std::string decodeChunked(const std::string& data) {
+  std::string out;
+  size_t p = 0;
+  while (p < data.size()) {
+    const size_t eol = data.find("\r\n", p);
+    if (eol == std::string::npos) {
+      break;
+    }
+    const size_t len = strtoul(data.c_str() + p, NULL, 16);
+    if (len == 0 || eol + 2 + len > data.size()) {
+      break;
+    }
+    out.append(data, eol + 2, len);
+    p = eol + 2 + len + 2;
+  }
+  return out;
+}
+
+bool readRequest(int fd, HttpRequest* req) {
+  std::string data;
+  char buf[4096];
+  size_t head_end = std::string::npos;
+  while (head_end == std::string::npos) {
+    const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0 || data.size() > 64 * 1024) {
+      return false;
+    }
+    data.append(buf, n);
+    head_end = data.find("\r\n\r\n");
+  }
+  const std::string head = data.substr(0, head_end);
+  const long length = std::max(0L, contentLength(head));
+  std::string body = data.substr(head_end + 4);
+  while (static_cast<long>(body.size()) < length) {
+    const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return false;
+    }
+    body.append(buf, n);
+  }
+  char method[16] = {0};
+  char target[2048] = {0};
+  if (sscanf(head.c_str(), "%15s %2047s", method, target) != 2) {
+    return false;
+  }
+  req->method = method;
+  req->path = target;
+  const size_t q = req->path.find('?');
+  if (q != std::string::npos) {
+    req->query = req->path.substr(q + 1);
+    req->path.resize(q);
+  }
+  req->body = body.substr(0, length);
+  return true;
+}
+
+void sendJson(int fd, int status, const std::string& text) {
+  const char* reason = status == 200 ? "OK" : (status == 404 ? "Not Found"
+                                                             : "Bad Request");
+  char head[256];
+  snprintf(head, sizeof(head),
+           "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+           "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+           status, reason, text.size());
+  sendAll(fd, head + text);
+}
+
+// 发一个请求并读完响应，返回状态码，失败返回 -1
+int httpCall(const std::string& host, unsigned short port,
+             const std::string& method, const std::string& target,
+             const std::string& body, std::string* response, int timeout_ms) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* res = NULL;
+  char port_str[8];
+  snprintf(port_str, sizeof(port_str), "%u", port);
+  if (getaddrinfo(host.c_str(), port_str, &hints, &res) != 0 || !res) {
+    return -1;
+  }
+  const int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (fd < 0) {
+    freeaddrinfo(res);
+    return -1;
+  }
+  setTimeouts(fd, timeout_ms);
+  const bool connected = connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+  freeaddrinfo(res);
+  char head[512];
+  snprintf(head, sizeof(head),
+           "%s %s HTTP/1.1\r\nHost: %s:%u\r\n"
+           "Content-Type: application/json\r\nContent-Length: %zu\r\n"
+           "Connection: close\r\n\r\n",
+           method.c_str(), target.c_str(), host.c_str(), port, body.size());
+  if (!connected || !sendAll(fd, head + body)) {
+    close(fd);
+    return -1;
+  }
+  std::string data;
+  char buf[8192];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    data.append(buf, n);
+    const size_t head_end = data.find("\r\n\r\n");
+    const long length = head_end == std::string::npos
+                            ? -1
+                            : contentLength(data.substr(0, head_end));
+    if (length >= 0 &&
+        data.size() >= head_end + 4 + static_cast<size_t>(length)) {
+      break;
+    }
+  }
+  close(fd);
+  int status = -1;
+  if (sscanf(data.c_str(), "HTTP/%*s %d", &status) != 1) {
+    return -1;
+  }
+  const size_t head_end = data.find("\r\n\r\n");
+  if (response && head_end != std::string::npos) {
+    const std::string resp_head = data.substr(0, head_end);
+    *response = data.substr(head_end + 4);
+    if (chunkedBody(resp_head)) {
+      *response = decodeChunked(*response);
+    }
+  }
+  return status;
+}
+
+// ---------------------------------------------------------------------------
+// 选项
+
+struct Options {
+  int robots;
+  std::string travel_spec;
+  TravelDist travel;
+  double time_scale;         // 行驶时间倍率，<1 时快速跑通流程
+  bool standalone;           // 不连 gateway：本进程代替 gateway 下发/continue
+  double turnaround_sec;     // standalone 下 END 到 continue 的模拟处理时间
+  std::string gateway_host;
+  unsigned short gateway_port;
+  unsigned short listen_port;
+  std::string bind_address;
+  std::string rcs_prefix;
+  int tasks;
+  int bins;
+  std::string corpus;
+  std::vector<std::string> cameras;
+  int width;
+  int height;
+  int capture_wait_ms;
+  std::string root;          // capture_img 所在目录（gateway 的项目根目录）
+  int poll_ms;
+  int bin_timeout_sec;       // 机器人在储位等 continue 的上限
+  int task_timeout_sec;
+  bool keep_tasks;           // 任务结束后不调用 cancel-inventory 释放 gateway
+  unsigned int seed;
+  std::string csv;
+  std::string log;
+
+  Options()
+      : robots(4),
+        travel_spec("fixed:15"),
+        time_scale(1.0),
+        standalone(false),
+        turnaround_sec(2.0),
+        gateway_host("127.0.0.1"),
+        gateway_port(8000),
+        listen_port(4001),
+        bind_address("0.0.0.0"),
+        rcs_prefix("/rcs/rtas"),
+        tasks(1),
+        bins(20),
+        width(1920),
+        height(1080),
+        capture_wait_ms(3000),
+        poll_ms(500),
+        bin_timeout_sec(300),
+        task_timeout_sec(3600),
+        keep_tasks(false),
+        seed(1) {
+    cameras.push_back("3d_camera");
+    cameras.push_back("scan_camera_1");
+    cameras.push_back("scan_camera_2");
+  }
+};
+
+// ---------------------------------------------------------------------------
+// 模拟 RCS：机器人池 + 任务队列
+
+// 一个储位的时间线（nowSec），未发生的为 0
+struct BinRecord {
+  std::string task_no;
+  std::string bin;
+  std::string robot_task_code;
+  int robot;
+  double t_submit;
+  double t_assigned;  // 机器人开始执行（第一个储位为领到任务，之后为上一储位放行）
+  double t_arrived;
+  double t_captured;
+  double t_end;       // END 回调已发出
+  double t_continue;  // 收到 continue（或超时/取消）放行
+  double callback_ms[3];  // start / outbin / end 回调的往返时间，失败为 -1
+  bool captured;
+  bool continued;
+
+  BinRecord()
+      : robot(-1), t_submit(0), t_assigned(0), t_arrived(0), t_captured(0),
+        t_end(0), t_continue(0), captured(false), continued(false) {
+    callback_ms[0] = callback_ms[1] = callback_ms[2] = -1.0;
+  }
+};
+
+struct RobotTask {
+  std::string code;
+  std::vector<size_t> records;  // 按路线顺序，下标指向 LoadGen::records_
+  int continues;
+  bool cancelled;
+
+  RobotTask() : continues(0), cancelled(false) {}
+};
+
+class LoadGen {
+ public:
+  explicit LoadGen(const Options& opt)
+      : opt_(opt), stopping_(false), next_code_(0), busy_robots_(0),
+        peak_queue_(0), active_captures_(0), peak_captures_(0),
+        listen_fd_(-1) {}
+
+  ~LoadGen() { stop(); }
+
+  bool start() {
+    if (!opt_.standalone && !listen()) {
+      return false;
+    }
+    for (int i = 0; i < opt_.robots; i++) {
+      robots_.push_back(std::thread(&LoadGen::robotLoop, this, i));
+    }
+    return true;
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        return;
+      }
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    if (accept_thread_.joinable()) {
+      accept_thread_.join();
+    }
+    for (size_t i = 0; i < robots_.size(); i++) {
+      robots_[i].join();
+    }
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+      listen_fd_ = -1;
+    }
+  }
+
+  // 登记本进程生成的储位属于哪个任务，抓图按它写到 capture_img/<task>/<bin>/
+  void expectBins(const std::string& task_no,
+                  const std::vector<std::string>& bins) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < bins.size(); i++) {
+      bin_task_[bins[i]] = task_no;
+    }
+  }
+
+  std::string submit(const std::vector<std::string>& route) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    char code[32];
+    snprintf(code, sizeof(code), "LOADGEN-%06d", ++next_code_);
+    std::shared_ptr<RobotTask> task(new RobotTask());
+    task->code = code;
+    const double t = nowSec();
+    for (size_t i = 0; i < route.size(); i++) {
+      BinRecord rec;
+      std::map<std::string, std::string>::const_iterator it =
+          bin_task_.find(route[i]);
+      rec.task_no = it == bin_task_.end() ? "" : it->second;
+      rec.bin = route[i];
+      rec.robot_task_code = task->code;
+      rec.t_submit = t;
+      task->records.push_back(records_.size());
+      records_.push_back(rec);
+    }
+    tasks_[task->code] = task;
+    queue_.push_back(task);
+    peak_queue_ = std::max(peak_queue_, static_cast<int>(queue_.size()));
+    cv_.notify_all();
+    return task->code;
+  }
+
+  // 放行当前储位；任务未知时返回 false
+  bool continueTask(const std::string& code, bool cancel) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, std::shared_ptr<RobotTask> >::iterator it =
+        tasks_.find(code);
+    if (it == tasks_.end()) {
+      return false;
+    }
+    it->second->continues++;
+    it->second->cancelled = it->second->cancelled || cancel;
+    cv_.notify_all();
+    return true;
+  }
+
+  // 等该任务第一个储位发出 END，超时返回 false
+  bool waitEnd(const std::string& code, double timeout_sec) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const double deadline = nowSec() + timeout_sec;
+    while (!stopping_) {
+      std::map<std::string, std::shared_ptr<RobotTask> >::const_iterator it =
+          tasks_.find(code);
+      if (it == tasks_.end()) {
+        return false;
+      }
+      if (!it->second->records.empty() &&
+          records_[it->second->records[0]].t_end > 0) {
+        return true;
+      }
+      const double left = deadline - nowSec();
+      if (left <= 0) {
+        return false;
+      }
+      cv_.wait_for(lock, std::chrono::milliseconds(
+                             static_cast<int>(std::min(left, 0.5) * 1000)));
+    }
+    return false;
+  }
+
+  std::vector<BinRecord> records() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::vector<BinRecord>(records_.begin(), records_.end());
+  }
+
+  int peakQueue() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_queue_;
+  }
+  int peakCaptures() const { return peak_captures_; }
+
+ private:
+  bool listen() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+      perror("socket");
+      return false;
+    }
+    int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt_.listen_port);
+    if (inet_pton(AF_INET, opt_.bind_address.c_str(), &addr.sin_addr) != 1 ||
+        bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+        ::listen(listen_fd_, 64) != 0) {
+      fprintf(stderr, "[loadgen] 监听 %s:%u 失败: %s\n",
+              opt_.bind_address.c_str(), opt_.listen_port, strerror(errno));
+      return false;
+    }
+    accept_thread_ = std::thread(&LoadGen::acceptLoop, this);
+    return true;
+  }
+
+  // RCS 接口的处理都只是入队/置位，直接在接收线程里串行处理
+  void acceptLoop() {
+    while (!stopping_) {
+      struct pollfd pfd;
+      pfd.fd = listen_fd_;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, 200) <= 0) {
+        continue;
+      }
+      const int fd = accept(listen_fd_, NULL, NULL);
+      if (fd < 0) {
+        continue;
+      }
+      setTimeouts(fd, 2000);
+      serve(fd);
+      close(fd);
+    }
+  }
+
+  void serve(int fd) {
+    HttpRequest req;
+    if (!readRequest(fd, &req)) {
+      return;
+    }
+    const std::string base = opt_.rcs_prefix + "/api/robot/controller/task";
+    std::string data;
+    if (req.method == "POST" && req.path == base + "/submit") {
+      std::vector<std::string> route;
+      size_t p = req.body.find("\"targetRoute\"");
+      std::string code;
+      while (p != std::string::npos &&
+             jsonString(req.body, "code", p, &code, &p)) {
+        route.push_back(code);
+      }
+      if (route.empty()) {
+        sendJson(fd, 400, "{\"code\":\"FAIL\",\"message\":"
+                          "\"targetRoute不能为空\"}");
+        return;
+      }
+      data = "{\"robotTaskCode\":" + jsonQuote(submit(route)) +
+             ",\"extra\":null}";
+    } else if (req.method == "POST" && (req.path == base + "/extend/continue" ||
+                                        req.path == base + "/cancel")) {
+      std::string code;
+      jsonString(req.body, "robotTaskCode", 0, &code, NULL);
+      continueTask(code, req.path == base + "/cancel");
+      data = "{\"robotTaskCode\":" + jsonQuote(code) +
+             ",\"nextSeq\":1,\"extra\":null}";
+    } else {
+      sendJson(fd, 404, "{\"code\":\"FAIL\",\"message\":\"not found\"}");
+      return;
+    }
+    sendJson(fd, 200, "{\"code\":\"SUCCESS\",\"message\":\"成功\","
+                      "\"data\":" + data + "}");
+  }
+
+  // 与 sim_rcs_server 相同的回调格式，返回往返毫秒数，失败返回 -1
+  double postCallback(int robot, const std::string& code,
+                      const std::string& method, const std::string& bin) {
+    if (opt_.standalone) {
+      return -1.0;
+    }
+    char robot_code[24];  // "ROBOT" + int 最长 11 位 + 结尾
+    snprintf(robot_code, sizeof(robot_code), "ROBOT%03d", robot + 1);
+    char timestamp[32];
+    snprintf(timestamp, sizeof(timestamp), "%.3f", nowSec());
+    const std::string extra = "[{\"method\":" + jsonQuote(method) +
+                              ",\"timestamp\":" + timestamp +
+                              ",\"data\":{\"location\":" + jsonQuote(bin) +
+                              "}}]";
+    const std::string payload =
+        "{\"robotTaskCode\":" + jsonQuote(code) + ",\"singleRobotCode\":" +
+        jsonQuote(robot_code) + ",\"extra\":" + jsonQuote(extra) + "}";
+    const double t0 = nowSec();
+    const int status =
+        httpCall(opt_.gateway_host, opt_.gateway_port, "POST",
+                 "/api/robot/reporter/task", payload, NULL, 10000);
+    return status == 200 ? (nowSec() - t0) * 1000.0 : -1.0;
+  }
+
+  // 按抓图脚本的顺序逐台相机 登录/开流/抓图/关流/登出，等文件落盘
+  bool capture(std::vector<std::unique_ptr<CamController> >* cams,
+               const std::string& task_no, const std::string& bin) {
+    if (task_no.empty()) {
+      return false;  // 不是本进程下发的任务，不知道 gateway 的任务号
+    }
+    const int active = ++active_captures_;
+    int peak = peak_captures_;
+    while (active > peak &&
+           !peak_captures_.compare_exchange_weak(peak, active)) {
+    }
+    bool ok = true;
+    for (size_t i = 0; i < cams->size(); i++) {
+      CamController* cam = (*cams)[i].get();
+      cam->setTaskInfo(task_no, bin);
+      cam->setCameraType(opt_.cameras[i]);
+      if (!cam->login("192.168.1.64", 8000, "admin", "loadgen") ||
+          !cam->startRealPlay(1, 0, 0, 1)) {
+        cam->logout();
+        ok = false;
+        continue;
+      }
+      cam->getCapture();
+      cam->stopRealPlay();
+      cam->logout();
+    }
+    AsyncFileWriter::instance().flush();
+    active_captures_--;
+    for (size_t i = 0; ok && i < opt_.cameras.size(); i++) {
+      const std::string path = "capture_img/" + task_no + "/" + bin + "/" +
+                               opt_.cameras[i] + "/main.jpg";
+      ok = access(path.c_str(), F_OK) == 0;
+    }
+    return ok;
+  }
+
+  void robotLoop(int index) {
+    std::mt19937 rng(opt_.seed + index);
+    std::vector<std::unique_ptr<CamController> > cams;
+    for (size_t i = 0; i < opt_.cameras.size(); i++) {
+      cams.push_back(std::unique_ptr<CamController>(new CamController()));
+      cams.back()->setCaptureWaitMs(opt_.capture_wait_ms);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (!stopping_ && queue_.empty()) {
+        cv_.wait(lock);
+      }
+      if (stopping_) {
+        break;
+      }
+      std::shared_ptr<RobotTask> task = queue_.front();
+      queue_.pop_front();
+      busy_robots_++;
+      for (size_t k = 0; k < task->records.size() && !stopping_; k++) {
+        if (task->cancelled) {
+          break;
+        }
+        const size_t r = task->records[k];
+        records_[r].robot = index;
+        records_[r].t_assigned = nowSec();
+        const std::string task_no = records_[r].task_no;
+        const std::string bin = records_[r].bin;
+        const double travel =
+            sampleTravel(opt_.travel, &rng) * opt_.time_scale;
+        lock.unlock();
+
+        const double start_ms = postCallback(index, task->code, "start", bin);
+        {
+          std::unique_lock<std::mutex> wait(mutex_);
+          cv_.wait_for(wait,
+                       std::chrono::milliseconds(
+                           static_cast<long>(travel * 1000)),
+                       [this] { return stopping_; });
+        }
+        const double t_arrived = nowSec();
+        const bool captured = capture(&cams, task_no, bin);
+        const double t_captured = nowSec();
+        const double outbin_ms =
+            postCallback(index, task->code, "outbin", bin);
+        const double end_ms = postCallback(index, task->code, "end", bin);
+
+        lock.lock();
+        BinRecord& rec = records_[r];
+        rec.t_arrived = t_arrived;
+        rec.t_captured = t_captured;
+        rec.t_end = nowSec();
+        rec.captured = captured;
+        rec.callback_ms[0] = start_ms;
+        rec.callback_ms[1] = outbin_ms;
+        rec.callback_ms[2] = end_ms;
+        cv_.notify_all();
+        // 停在储位上等 continue（真实 RCS 的行为），超时后自行放行
+        const bool released = cv_.wait_for(
+            lock, std::chrono::seconds(opt_.bin_timeout_sec),
+            [this, &task, k] {
+              return stopping_ || task->cancelled ||
+                     task->continues > static_cast<int>(k);
+            });
+        records_[r].t_continue = nowSec();
+        records_[r].continued = released && !stopping_;
+      }
+      busy_robots_--;
+      cv_.notify_all();
+    }
+  }
+
+  const Options& opt_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_;
+  int next_code_;
+  std::deque<BinRecord> records_;  // 只追加，下标稳定
+  std::map<std::string, std::shared_ptr<RobotTask> > tasks_;
+  std::deque<std::shared_ptr<RobotTask> > queue_;
+  std::map<std::string, std::string> bin_task_;
+  int busy_robots_;
+  int peak_queue_;
+  std::atomic<int> active_captures_;
+  std::atomic<int> peak_captures_;
+  std::vector<std::thread> robots_;
+  int listen_fd_;
+  std::thread accept_thread_;
+};
+
+// ---------------------------------------------------------------------------
+// 任务驱动
+
+struct TaskRecord {
+  std::string task_no;
+  std::vector<std::string> bins;
+  double t_start;
+  double t_done;
+  std::string status;
+  std::vector<double> poll_ms;  // gateway 进度接口的往返时间
+
+  TaskRecord() : t_start(0), t_done(0) {}
+};
+
+// 储位号按 排-列-层 生成，各任务不重复，gateway 的寻路排序可以正常解析
+std::vector<std::string> makeBins(int task, int bins) {
+  std::vector<std::string> out;
+  for (int b = 0; b < bins; b++) {
+    char code[16];
+    snprintf(code, sizeof(code), "%02d-%02d-%02d", 10 + task % 80,
+             1 + b / 8, 1 + b % 8);
+    out.push_back(code);
+  }
+  return out;
+}
+
+// 本进程代替 gateway：逐个下发，END 后模拟处理，先下发下一个再 continue 上一个
+void runStandaloneTask(LoadGen* gen, const Options& opt, TaskRecord* task) {
+  task->t_start = nowSec();
+  task->status = "completed";
+  std::string code = gen->submit(std::vector<std::string>(1, task->bins[0]));
+  for (size_t i = 0; i < task->bins.size(); i++) {
+    if (!gen->waitEnd(code, opt.bin_timeout_sec)) {
+      task->status = "failed";
+      break;
+    }
+    usleep(static_cast<useconds_t>(opt.turnaround_sec * 1e6));
+    std::string next;
+    if (i + 1 < task->bins.size()) {
+      next = gen->submit(std::vector<std::string>(1, task->bins[i + 1]));
+    }
+    gen->continueTask(code, false);
+    code = next;
+  }
+  task->t_done = nowSec();
+}
+
+// 经 gateway 跑一个盘点任务：start-inventory 后轮询进度直到结束
+void runGatewayTask(const Options& opt, TaskRecord* task) {
+  std::string body = "{\"taskNo\":" + jsonQuote(task->task_no) +
+                     ",\"binLocations\":[";
+  for (size_t i = 0; i < task->bins.size(); i++) {
+    body += (i ? "," : "") + jsonQuote(task->bins[i]);
+  }
+  body += "]}";
+  std::string resp;
+  task->t_start = nowSec();
+  const int status =
+      httpCall(opt.gateway_host, opt.gateway_port, "POST",
+               "/api/inventory/start-inventory", body, &resp, 30000);
+  if (status != 200) {
+    fprintf(stderr, "[loadgen] start-inventory %s 失败: HTTP %d %s\n",
+            task->task_no.c_str(), status, resp.c_str());
+    task->status = "rejected";
+    task->t_done = nowSec();
+    return;
+  }
+  const double deadline = task->t_start + opt.task_timeout_sec;
+  task->status = "timeout";
+  while (nowSec() < deadline) {
+    usleep(opt.poll_ms * 1000);
+    const double t0 = nowSec();
+    const int code = httpCall(opt.gateway_host, opt.gateway_port, "GET",
+                              "/api/inventory/progress?taskNo=" + task->task_no,
+                              "", &resp, 10000);
+    task->poll_ms.push_back(code == 200 ? (nowSec() - t0) * 1000.0 : -1.0);
+    // data 里第一个 status 是任务状态（各储位的 status 在其后的列表中）
+    const size_t data = resp.find("\"data\"");
+    std::string s;
+    if (code != 200 || data == std::string::npos ||
+        !jsonString(resp, "status", data, &s, NULL)) {
+      continue;
+    }
+    if (s == "completed" || s == "partial" || s == "failed" ||
+        s == "cancelled") {
+      task->status = s;
+      break;
+    }
+  }
+  task->t_done = nowSec();
+  if (!opt.keep_tasks) {
+    // 已结束的任务不确认就会挡住下一个 start-inventory
+    httpCall(opt.gateway_host, opt.gateway_port, "POST",
+             "/api/inventory/cancel-inventory?taskNo=" + task->task_no, "",
+             NULL, 10000);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// 统计输出
+
+struct Percentiles {
+  size_t n;
+  double p50;
+  double p90;
+  double p99;
+  double max;
+};
+
+Percentiles percentiles(std::vector<double> v) {
+  Percentiles p = {v.size(), 0, 0, 0, 0};
+  if (v.empty()) {
+    return p;
+  }
+  std::sort(v.begin(), v.end());
+  const size_t n = v.size();
+  p.p50 = v[std::min(n - 1, n * 50 / 100)];
+  p.p90 = v[std::min(n - 1, n * 90 / 100)];
+  p.p99 = v[std::min(n - 1, n * 99 / 100)];
+  p.max = v.back();
+  return p;
+}
+
+// 按终端显示宽度补齐（UTF-8 三字节字符按两列算）
+std::string padName(const std::string& name, int width) {
+  int cols = 0;
+  for (size_t i = 0; i < name.size(); i++) {
+    const unsigned char c = static_cast<unsigned char>(name[i]);
+    cols += (c & 0xC0) == 0x80 ? 0 : (c >= 0xE0 ? 2 : 1);
+  }
+  return name + std::string(std::max(0, width - cols), ' ');
+}
+
+void printRow(FILE* out, const char* name, const std::vector<double>& v,
+              const char* unit) {
+  const Percentiles p = percentiles(v);
+  fprintf(out, "[loadgen]   %s n=%-5zu p50=%8.2f p90=%8.2f p99=%8.2f "
+          "max=%8.2f %s\n", padName(name, 14).c_str(), p.n, p.p50, p.p90,
+          p.p99, p.max, unit);
+}
+
+bool loadCorpus(const std::string& dir,
+                std::vector<std::vector<unsigned char> >* jpegs) {
+  DIR* d = opendir(dir.c_str());
+  if (!d) {
+    return false;
+  }
+  std::vector<std::string> names;
+  struct dirent* e;
+  while ((e = readdir(d)) != NULL) {
+    std::string name = e->d_name;
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (lower.size() > 4 &&
+        (lower.compare(lower.size() - 4, 4, ".jpg") == 0 ||
+         (lower.size() > 5 &&
+          lower.compare(lower.size() - 5, 5, ".jpeg") == 0))) {
+      names.push_back(name);
+    }
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  for (size_t i = 0; i < names.size(); i++) {
+    FILE* fp = fopen((dir + "/" + names[i]).c_str(), "rb");
+    if (!fp) {
+      continue;
+    }
+    std::vector<unsigned char> data;
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+      data.insert(data.end(), buf, buf + n);
+    }
+    fclose(fp);
+    if (!data.empty()) {
+      jpegs->push_back(data);
+    }
+  }
+  return !jpegs->empty();
+}
+
+void usage(const char* prog) {
+  fprintf(stderr,
+          "用法: %s [--robots N] [--travel fixed:T|uniform:A,B|normal:M,S|"
+          "lognormal:M,S]\n"
+          "          [--time-scale X] [--tasks N] [--bins N] [--standalone]\n"
+          "          [--turnaround-sec X] [--gateway HOST:PORT]\n"
+          "          [--listen PORT] [--bind ADDR] [--rcs-prefix P]\n"
+          "          [--corpus DIR]"
+          " [--cameras a,b,c] [--size WxH] [--capture-wait-ms N]\n"
+          "          [--root DIR] [--poll-ms N] [--bin-timeout-sec N]\n"
+          "          [--task-timeout-sec N] [--keep-tasks] [--seed N]\n"
+          "          [--csv path] [--log path]\n",
+          prog);
+}
+
+bool parseArgs(int argc, char** argv, Options* opt) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    bool has_value = i + 1 < argc;
+    if (a == "--robots" && has_value) {
+      opt->robots = atoi(argv[++i]);
+    } else if (a == "--travel" && has_value) {
+      opt->travel_spec = argv[++i];
+    } else if (a == "--time-scale" && has_value) {
+      opt->time_scale = atof(argv[++i]);
+    } else if (a == "--tasks" && has_value) {
+      opt->tasks = atoi(argv[++i]);
+    } else if (a == "--bins" && has_value) {
+      opt->bins = atoi(argv[++i]);
+    } else if (a == "--standalone") {
+      opt->standalone = true;
+    } else if (a == "--turnaround-sec" && has_value) {
+      opt->turnaround_sec = atof(argv[++i]);
+    } else if (a == "--gateway" && has_value) {
+      std::string v = argv[++i];
+      const size_t colon = v.rfind(':');
+      if (colon == std::string::npos) {
+        return false;
+      }
+      opt->gateway_host = v.substr(0, colon);
+      opt->gateway_port =
+          static_cast<unsigned short>(atoi(v.c_str() + colon + 1));
+    } else if (a == "--listen" && has_value) {
+      opt->listen_port = static_cast<unsigned short>(atoi(argv[++i]));
+    } else if (a == "--bind" && has_value) {
+      opt->bind_address = argv[++i];
+    } else if (a == "--rcs-prefix" && has_value) {
+      opt->rcs_prefix = argv[++i];
+    } else if (a == "--corpus" && has_value) {
+      opt->corpus = argv[++i];
+    } else if (a == "--cameras" && has_value) {
+      opt->cameras.clear();
+      std::string v = argv[++i];
+      size_t p = 0;
+      while (p <= v.size()) {
+        const size_t q = std::min(v.find(',', p), v.size());
+        if (q > p) {
+          opt->cameras.push_back(v.substr(p, q - p));
+        }
+        p = q + 1;
+      }
+    } else if (a == "--size" && has_value) {
+      if (sscanf(argv[++i], "%dx%d", &opt->width, &opt->height) != 2) {
+        return false;
+      }
+    } else if (a == "--capture-wait-ms" && has_value) {
+      opt->capture_wait_ms = atoi(argv[++i]);
+    } else if (a == "--root" && has_value) {
+      opt->root = argv[++i];
+    } else if (a == "--poll-ms" && has_value) {
+      opt->poll_ms = atoi(argv[++i]);
+    } else if (a == "--bin-timeout-sec" && has_value) {
+      opt->bin_timeout_sec = atoi(argv[++i]);
+    } else if (a == "--task-timeout-sec" && has_value) {
+      opt->task_timeout_sec = atoi(argv[++i]);
+    } else if (a == "--keep-tasks") {
+      opt->keep_tasks = true;
+    } else if (a == "--seed" && has_value) {
+      opt->seed = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+    } else if (a == "--csv" && has_value) {
+      opt->csv = argv[++i];
+    } else if (a == "--log" && has_value) {
+      opt->log = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  // 假 SDK 最多 64 个同时登录，每台机器人同一时刻只登录一台相机
+  return parseTravel(opt->travel_spec, &opt->travel) && opt->robots > 0 &&
+         opt->robots <= 32 && opt->tasks > 0 && opt->tasks <= 80 &&
+         opt->bins > 0 && opt->bins <= 792 && opt->time_scale >= 0.0 &&
+         opt->cameras.size() <= 8 && opt->width > 0 && opt->height > 0 &&
+         opt->capture_wait_ms >= 0 && opt->poll_ms > 0 &&
+         opt->bin_timeout_sec > 0 && opt->task_timeout_sec > 0;
+}
+
+double cpuSeconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec +
+         ru.ru_stime.tv_usec / 1e6;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parseArgs(argc, argv, &opt)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // 输出路径按启动目录解析，之后切换到 --root（抓图写到 <root>/capture_img）
+  char cwd[4096];
+  if (getcwd(cwd, sizeof(cwd)) != NULL) {
+    if (!opt.csv.empty() && opt.csv[0] != '/') {
+      opt.csv = std::string(cwd) + "/" + opt.csv;
+    }
+    if (!opt.log.empty() && opt.log[0] != '/') {
+      opt.log = std::string(cwd) + "/" + opt.log;
+    }
+    if (!opt.corpus.empty() && opt.corpus[0] != '/') {
+      opt.corpus = std::string(cwd) + "/" + opt.corpus;
+    }
+  }
+  if (!opt.root.empty() && chdir(opt.root.c_str()) != 0) {
+    perror("chdir");
+    return 2;
+  }
+
+  FakeSdkConfig cfg;
+  cfg.width = opt.width;
+  cfg.height = opt.height;
+  cfg.packet_size = 32 * 1024;
+  FakeSdk::configure(cfg);
+  std::vector<std::vector<unsigned char> > corpus;
+  if (!opt.corpus.empty()) {
+    if (!loadCorpus(opt.corpus, &corpus)) {
+      fprintf(stderr, "[loadgen] 图片语料为空: %s\n", opt.corpus.c_str());
+      return 2;
+    }
+    FakeSdk::setJpegCorpus(corpus);
+  }
+
+  // CamController 每个码流包都会 printf，重定向到日志文件或 /dev/null
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  FILE* report = fdopen(saved_stdout, "w");
+  int log_fd = open(opt.log.empty() ? "/dev/null" : opt.log.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  dup2(log_fd, STDOUT_FILENO);
+  close(log_fd);
+  AsyncFileWriter::instance();
+
+  fprintf(report,
+          "[loadgen] 模式=%s 机器人=%d 行驶=%s x%.2f 任务=%d 储位/任务=%d "
+          "相机=%zu 语料=%zu 张\n",
+          opt.standalone ? "standalone" : "gateway", opt.robots,
+          opt.travel_spec.c_str(), opt.time_scale, opt.tasks, opt.bins,
+          opt.cameras.size(), corpus.size());
+  if (!opt.standalone) {
+    fprintf(report, "[loadgen] RCS 监听 %s:%u%s，gateway %s:%u\n",
+            opt.bind_address.c_str(), opt.listen_port, opt.rcs_prefix.c_str(),
+            opt.gateway_host.c_str(), opt.gateway_port);
+  }
+  fflush(report);
+
+  LoadGen gen(opt);
+  if (!gen.start()) {
+    return 2;
+  }
+
+  std::vector<TaskRecord> tasks(opt.tasks);
+  char task_tmpl[32];
+  for (int t = 0; t < opt.tasks; t++) {
+    snprintf(task_tmpl, sizeof(task_tmpl), "LG%ld%02d",
+             static_cast<long>(time(NULL)) % 100000000, t);
+    tasks[t].task_no = task_tmpl;
+    tasks[t].bins = makeBins(t, opt.bins);
+    gen.expectBins(tasks[t].task_no, tasks[t].bins);
+  }
+
+  const double t0 = nowSec();
+  const double cpu0 = cpuSeconds();
+  if (opt.standalone) {
+    // 各任务并发执行，共用机器人池
+    std::vector<std::thread> drivers;
+    for (int t = 0; t < opt.tasks; t++) {
+      drivers.push_back(
+          std::thread(runStandaloneTask, &gen, std::cref(opt), &tasks[t]));
+    }
+    for (size_t i = 0; i < drivers.size(); i++) {
+      drivers[i].join();
+    }
+  } else {
+    // gateway 同一时刻只允许一个盘点任务，按顺序跑
+    for (int t = 0; t < opt.tasks; t++) {
+      runGatewayTask(opt, &tasks[t]);
+      fprintf(report, "[loadgen] 任务 %s 结束: %s，用时 %.1fs\n",
+              tasks[t].task_no.c_str(), tasks[t].status.c_str(),
+              tasks[t].t_done - tasks[t].t_start);
+      fflush(report);
+    }
+  }
+  const double wall = nowSec() - t0;
+  const double cpu = cpuSeconds() - cpu0;
+  gen.stop();
+  AsyncFileWriter::instance().flush();
+
+  const std::vector<BinRecord> recs = gen.records();
+  std::vector<double> queue_s, travel_s, capture_s, turnaround_s, cycle_s;
+  std::vector<double> callback_ms, poll_ms, makespan_s, drain_s;
+  std::map<std::string, double> last_end;
+  double robot_busy = 0.0;
+  double capture_busy = 0.0;
+  int finished = 0;
+  int captured = 0;
+  int callback_failures = 0;
+  for (size_t i = 0; i < recs.size(); i++) {
+    const BinRecord& r = recs[i];
+    if (r.t_end <= 0) {
+      continue;
+    }
+    queue_s.push_back(r.t_assigned - r.t_submit);
+    travel_s.push_back(r.t_arrived - r.t_assigned);
+    capture_s.push_back(r.t_captured - r.t_arrived);
+    capture_busy += r.t_captured - r.t_arrived;
+    captured += r.captured ? 1 : 0;
+    for (int k = 0; k < 3 && !opt.standalone; k++) {
+      if (r.callback_ms[k] >= 0) {
+        callback_ms.push_back(r.callback_ms[k]);
+      } else {
+        callback_failures++;
+      }
+    }
+    last_end[r.task_no] = std::max(last_end[r.task_no], r.t_end);
+    if (r.t_continue > 0) {
+      turnaround_s.push_back(r.t_continue - r.t_end);
+      cycle_s.push_back(r.t_continue - r.t_submit);
+      robot_busy += r.t_continue - r.t_assigned;
+      finished += r.continued ? 1 : 0;
+    }
+  }
+  bool tasks_ok = true;
+  for (size_t t = 0; t < tasks.size(); t++) {
+    makespan_s.push_back(tasks[t].t_done - tasks[t].t_start);
+    if (last_end.count(tasks[t].task_no)) {
+      drain_s.push_back(tasks[t].t_done - last_end[tasks[t].task_no]);
+    }
+    for (size_t k = 0; k < tasks[t].poll_ms.size(); k++) {
+      if (tasks[t].poll_ms[k] >= 0) {
+        poll_ms.push_back(tasks[t].poll_ms[k]);
+      }
+    }
+    tasks_ok = tasks_ok && (tasks[t].status == "completed" ||
+                            tasks[t].status == "partial");
+  }
+
+  if (!opt.csv.empty()) {
+    FILE* csv = fopen(opt.csv.c_str(), "w");
+    if (csv) {
+      fprintf(csv, "task_no,bin,robot,robot_task_code,queue_s,travel_s,"
+              "capture_s,turnaround_s,cycle_s,start_ms,outbin_ms,end_ms,"
+              "captured,continued\n");
+      for (size_t i = 0; i < recs.size(); i++) {
+        const BinRecord& r = recs[i];
+        const bool ended = r.t_end > 0;
+        const bool released = r.t_continue > 0;
+        fprintf(csv, "%s,%s,%d,%s,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f,%.1f,"
+                "%d,%d\n", r.task_no.c_str(), r.bin.c_str(), r.robot,
+                r.robot_task_code.c_str(),
+                r.t_assigned > 0 ? r.t_assigned - r.t_submit : -1.0,
+                ended ? r.t_arrived - r.t_assigned : -1.0,
+                ended ? r.t_captured - r.t_arrived : -1.0,
+                released ? r.t_continue - r.t_end : -1.0,
+                released ? r.t_continue - r.t_submit : -1.0,
+                r.callback_ms[0], r.callback_ms[1], r.callback_ms[2],
+                r.captured ? 1 : 0, r.continued ? 1 : 0);
+      }
+      fclose(csv);
+    }
+  }
+
+  const long ncpu = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  fprintf(report, "[loadgen] 用时 %.1fs，储位 %zu（放行 %d，抓图成功 %d）\n",
+          wall, recs.size(), finished, captured);
+  fprintf(report, "[loadgen] 时延:\n");
+  printRow(report, "任务总用时", makespan_s, "s");
+  printRow(report, "末储位后收尾", drain_s, "s");
+  printRow(report, "排队等机器人", queue_s, "s");
+  printRow(report, "行驶", travel_s, "s");
+  printRow(report, "抓图", capture_s, "s");
+  printRow(report, "END后等放行", turnaround_s, "s");
+  printRow(report, "储位周期", cycle_s, "s");
+  if (!opt.standalone) {
+    printRow(report, "回调往返", callback_ms, "ms");
+    printRow(report, "进度查询往返", poll_ms, "ms");
+  }
+  fprintf(report, "[loadgen] 饱和度:\n");
+  fprintf(report, "[loadgen]   机器人占用 %.1f%%，排队峰值 %d\n",
+          wall > 0 ? 100.0 * robot_busy / (wall * opt.robots) : 0.0,
+          gen.peakQueue());
+  fprintf(report, "[loadgen]   同时抓图 平均 %.2f，峰值 %d\n",
+          wall > 0 ? capture_busy / wall : 0.0, gen.peakCaptures());
+  fprintf(report, "[loadgen]   本进程 CPU %.1f%%（%ld 核）\n",
+          wall > 0 ? 100.0 * cpu / (wall * ncpu) : 0.0, ncpu);
+  if (!opt.standalone) {
+    fprintf(report, "[loadgen]   回调失败 %d 次\n", callback_failures);
+  }
+
+  const bool ok = tasks_ok && finished == static_cast<int>(recs.size()) &&
+                  callback_failures == 0;
+  fprintf(report, "[loadgen] %s\n", ok ? "PASS" : "FAIL");
+  fclose(report);
+  return ok ? 0 : 1;
+}
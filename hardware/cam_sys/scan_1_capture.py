@@ -15,16 +15,34 @@ import os
 import traceback
 import argparse
 
-def main(task_no: str, bin_location: str):
+def main(task_no: str, bin_location: str, deadline_ms: int = None, channel: int = 1,
+         preview_port: int = 0, rois=None, roi_mode: str = "smooth",
+         preview_bind: str = "127.0.0.1", capture_hash: bool = False):
     """
     主函数，执行SCAN抓图流程
     
     Args:
         task_no: 任务编号
         bin_location: 储位名称
+        deadline_ms: 本储位剩余时间预算（毫秒），None 表示不限制，<= 0 表示预算已耗尽
+        channel: 预览通道号（相机直连为 1，经 NVR 接入时为 NVR 上的 IP 通道号）
+        preview_port: Web 实时预览端口（MJPEG over HTTP），0 表示不开启
+        rois: [(x, y, w, h), ...] 原图像素坐标的 ROI，为空时整幅抓图
+        roi_mode: smooth（ROI 外抹平）或 crop（ROI 裁图 + 全景缩略图）
+        preview_bind: 预览监听地址，默认只在本机；预览没有鉴权，对外开放须显式配置
+        capture_hash: 是否写 main.phash（要缓存解码帧像素，只在开启 reuse_unchanged_bins 时由 gateway 传入）
     """
     print(f"任务编号: {task_no}")
     print(f"储位名称: {bin_location}")
+
+    if deadline_ms is not None and deadline_ms <= 0:
+        print("❌ 储位时间预算已耗尽，不再抓图")
+        return {
+            "success": False,
+            "error": "储位时间预算已耗尽",
+            "task_no": task_no,
+            "bin_location": bin_location
+        }
     
     # 获取当前目录
     current_dir = os.path.dirname(os.path.abspath(__file__))
@@ -75,6 +93,11 @@ def main(task_no: str, bin_location: str):
         print("创建CamController对象...")
         cam = camera_api.CamController()
         print("✅ CamController对象创建成功")
+
+        # 储位时间预算：超时后 C++ 侧的登录/等待解码器/抓图重试立即退出
+        if deadline_ms is not None:
+            print(f"时间预算: {deadline_ms} ms")
+            cam.setCancelToken(camera_api.CancelToken.withTimeout(deadline_ms))
         
         # 登录（带重试）
         print("尝试登录相机...")
@@ -99,10 +122,33 @@ def main(task_no: str, bin_location: str):
         # 设置相机类型
         print("设置相机类型...")
         cam.setCameraType("scan_camera_1")
+
+        # 码流录制（排查计数错误、离线回放用），设置 CAM_RECORD_SECONDS>0 时开启
+        record_seconds = float(os.environ.get("CAM_RECORD_SECONDS", "0"))
+        if record_seconds > 0:
+            cam.enableRecording(record_seconds, 64)
+
+        # 按 ROI 抓图：ROI 内画质不变，ROI 外抹平或只留缩略图，显著减小文件
+        if rois:
+            roi_options = camera_api.RoiCaptureOptions()
+            roi_options.mode = camera_api.RoiMode.CROP if roi_mode == "crop" else camera_api.RoiMode.SMOOTH
+            cam.setCaptureRois([camera_api.PixelRect(*r) for r in rois], roi_options)
+
+        # 抓图同时写 main.phash（画面感知哈希），worker 据此判断复盘储位画面是否变化
+        if capture_hash:
+            cam.enableCaptureHash(True)
+
+        # 实时预览：画面取自抓图码流的解码帧，不新开相机会话；无人观看时不编码
+        preview = None
+        if preview_port > 0:
+            preview = camera_api.PreviewServer()
+            preview.addSource("scan_camera_1", cam)
+            if not preview.start(preview_port, preview_bind):
+                preview = None
         
         # 预览主码流
         print("开始预览...")
-        cam.startRealPlay(1, 0, 0, 1)
+        cam.startRealPlay(channel, 0, 0, 1)
         
         # 捕获主码流
         print("获取捕获...")
@@ -112,6 +158,9 @@ def main(task_no: str, bin_location: str):
         print("停止预览...")
         cam.stopRealPlay()
         
+        if preview is not None:
+            preview.stop()
+
         print("退出登录...")
         cam.logout()
         
@@ -164,12 +213,21 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser(description='SCAN_1_抓图脚本')
     parser.add_argument('--task-no', type=str, required=True, help='任务编号')
     parser.add_argument('--bin-location', type=str, required=True, help='储位名称')
+    parser.add_argument('--deadline-ms', type=int, default=None, help='本储位剩余时间预算（毫秒），不传表示不限制')
+    parser.add_argument('--channel', type=int, default=1, help='预览通道号，默认 1（经 NVR 接入时填 IP 通道号）')
+    parser.add_argument('--preview-port', type=int, default=0, help='Web 实时预览端口，0 表示不开启')
+    parser.add_argument('--preview-bind', type=str, default='127.0.0.1', help='预览监听地址，默认只在本机')
+    parser.add_argument('--capture-hash', action='store_true', help='写 main.phash，供复盘时判断画面是否变化')
+    parser.add_argument('--roi', action='append', default=[], help='ROI 区域 x,y,w,h（原图像素），可重复')
+    parser.add_argument('--roi-mode', choices=['smooth', 'crop'], default='smooth', help='ROI 编码方式')
     
     # 解析参数
     args = parser.parse_args()
     
     # 调用主函数
-    result = main(args.task_no, args.bin_location)
+    result = main(args.task_no, args.bin_location, args.deadline_ms, args.channel,
+                  args.preview_port, [tuple(int(v) for v in r.split(',')) for r in args.roi],
+                  args.roi_mode, args.preview_bind, args.capture_hash)
     
     # 退出码
     exit_code = 0 if result.get("success", False) else 1
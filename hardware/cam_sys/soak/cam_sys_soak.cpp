@@ -0,0 +1,515 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 14:02:16
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 14:02:16
+ * @FilePath: /LeafDepot/hardware/cam_sys/soak/cam_sys_soak.cpp
+ * @Description: CamController 长时间浸泡测试：内存增长与句柄泄漏检测
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncFileWriter.h"
+#include "CamController.h"
+#include "DeviceSession.h"
+#include "FakeSdk.h"
+
+namespace {
+
+struct Options {
+  int instances;
+  int cycles;          // 每个实例的循环次数
+  int captures;        // 每次开流后的抓图次数
+  bool warm;           // 常驻模式：只登录一次、码流常开，反复抓图
+  int recycle_every;   // 每 N 个循环重建一次 CamController（0 不重建）
+  int device_channels; // >0 时每个实例是一台带 N 路 IP 通道的 NVR，用 DeviceSession 驱动
+  int width;
+  int height;
+  int fps;
+  int sample_ms;
+  double max_rss_growth_mb;
+  bool faults;
+  std::string csv;
+  std::string log;
+
+  Options()
+      : instances(4),
+        cycles(1000),
+        captures(1),
+        warm(false),
+        recycle_every(50),
+        device_channels(0),
+        width(1280),
+        height(720),
+        fps(25),
+        sample_ms(500),
+        max_rss_growth_mb(8.0),
+        faults(true) {}
+};
+
+struct Sample {
+  double t_sec;
+  long rss_kb;
+  int fds;
+  int threads;
+  FakeSdkStats sdk;
+  long cycles;
+};
+
+long readRssKb() {
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if (!fp) {
+    return -1;
+  }
+  long size = 0;
+  long resident = 0;
+  if (fscanf(fp, "%ld %ld", &size, &resident) != 2) {
+    resident = -1;
+  }
+  fclose(fp);
+  return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int countFds() {
+  DIR* dir = opendir("/proc/self/fd");
+  if (!dir) {
+    return -1;
+  }
+  int n = 0;
+  while (readdir(dir) != NULL) {
+    n++;
+  }
+  closedir(dir);
+  return n - 3;  // ".", ".." 以及 opendir 自己的 fd
+}
+
+// 统计本进程的线程数，不计 io_uring 内核工作线程（iou-wrk-*），
+// 它们由内核按负载增减、空闲一段时间后才退出，不属于泄漏
+int countThreads() {
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir) {
+    return -1;
+  }
+  int threads = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    std::string path = std::string("/proc/self/task/") + entry->d_name + "/comm";
+    char comm[64] = {0};
+    FILE* fp = fopen(path.c_str(), "r");
+    if (fp) {
+      if (fgets(comm, sizeof(comm), fp) == NULL) {
+        comm[0] = '\0';
+      }
+      fclose(fp);
+    }
+    if (strncmp(comm, "iou-", 4) != 0) {
+      threads++;
+    }
+  }
+  closedir(dir);
+  return threads;
+}
+
+double nowSec() {
+  return StreamRecorder::nowMicros() / 1e6;
+}
+
+// 开流-抓图-关流-登出；返回 false 表示本轮被注入的故障打断（属于预期）
+bool runCycle(CamController* cam, int index, long cycle, const Options& opt) {
+  if (!cam->login("192.168.1.64", 8000, "admin", "soak")) {
+    return false;
+  }
+  // 交替主码流/第四码流，与 3d_capture.py 的调用顺序一致
+  unsigned short stream = (cycle % 2 == 0) ? 0 : 3;
+  if (!cam->startRealPlay(1, stream, 0, 1)) {
+    return false;
+  }
+  cam->setTaskInfo("soak", "bin_" + std::to_string(index));
+  cam->setCameraType("cam_" + std::to_string(index));
+  for (int k = 0; k < opt.captures; k++) {
+    cam->getCapture();
+  }
+  cam->stopRealPlay();
+  cam->logout();
+  return true;
+}
+
+// NVR 模式：一次登录，所有 IP 通道并发开流，逐路抓图后全部关流、登出
+bool runDeviceCycle(DeviceSession* dev, int index, long cycle,
+                    const Options& opt) {
+  if (!dev->login("192.168.1.64", 8000, "admin", "soak")) {
+    return false;
+  }
+  std::vector<int> nos;
+  std::vector<ChannelInfo> chans = dev->channels();
+  for (size_t i = 0; i < chans.size(); i++) {
+    if (chans[i].digital) {
+      nos.push_back(chans[i].channel);
+    }
+  }
+  unsigned short stream = (cycle % 2 == 0) ? 0 : 3;
+  int started = dev->startStreams(nos, stream, 0, 1);
+  for (size_t i = 0; i < nos.size(); i++) {
+    CamController* cam = dev->channel(nos[i]);
+    cam->setCaptureWaitMs(20);
+    cam->setTaskInfo("soak", "bin_" + std::to_string(index));
+    for (int k = 0; k < opt.captures && cam->stats().streaming; k++) {
+      cam->getCapture();
+    }
+  }
+  dev->stopStreams();
+  dev->logout();
+  return started == static_cast<int>(nos.size());
+}
+
+void worker(int index, const Options& opt, std::atomic<long>* done,
+            std::atomic<long>* interrupted) {
+  if (opt.device_channels > 0) {
+    std::unique_ptr<DeviceSession> dev(new DeviceSession());
+    for (long c = 0; c < opt.cycles; c++) {
+      if (opt.recycle_every > 0 && c > 0 && c % opt.recycle_every == 0) {
+        dev.reset(new DeviceSession());
+      }
+      if (!runDeviceCycle(dev.get(), index, c, opt)) {
+        (*interrupted)++;
+        dev->logout();
+      }
+      (*done)++;
+    }
+    return;
+  }
+
+  std::unique_ptr<CamController> cam(new CamController());
+  cam->setCaptureWaitMs(20);
+
+  if (opt.warm) {
+    // 常驻模式：码流一直开着，每 recycle_every 次抓图重开一次码流
+    bool streaming = false;
+    for (long c = 0; c < opt.cycles; c++) {
+      if (!streaming) {
+        streaming = cam->login("192.168.1.64", 8000, "admin", "soak") &&
+                    cam->startRealPlay(1, 0, 0, 1);
+        cam->setTaskInfo("soak", "bin_" + std::to_string(index));
+        cam->setCameraType("cam_" + std::to_string(index));
+      }
+      if (streaming) {
+        cam->getCapture();
+      } else {
+        (*interrupted)++;
+      }
+      if (!streaming || (opt.recycle_every > 0 && (c + 1) % opt.recycle_every == 0)) {
+        cam->stopRealPlay();
+        streaming = false;
+      }
+      (*done)++;
+    }
+    cam->logout();
+    return;
+  }
+
+  for (long c = 0; c < opt.cycles; c++) {
+    if (opt.recycle_every > 0 && c > 0 && c % opt.recycle_every == 0) {
+      cam.reset(new CamController());
+      cam->setCaptureWaitMs(20);
+    }
+    if (!runCycle(cam.get(), index, c, opt)) {
+      (*interrupted)++;
+      cam->logout();
+    }
+    (*done)++;
+  }
+}
+
+double median(std::vector<long> values) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+// 最小二乘斜率：每千个循环的 RSS 增长（KB）
+double rssSlopePerKCycles(const std::vector<Sample>& samples, size_t from) {
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = from; i < samples.size(); i++) {
+    double x = samples[i].cycles / 1000.0;
+    double y = samples[i].rss_kb;
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double den = n * sxx - sx * sx;
+  return (n < 3 || den == 0) ? 0.0 : (n * sxy - sx * sy) / den;
+}
+
+void usage(const char* prog) {
+  fprintf(stderr,
+          "用法: %s [--instances N] [--cycles N] [--captures N] [--warm]\n"
+          "          [--recycle-every N] [--device-channels N] [--size WxH]\n"
+          "          [--fps N] [--sample-ms N]\n"
+          "          [--max-rss-growth-mb X] [--no-faults] [--csv path] [--log path]\n",
+          prog);
+}
+
+bool parseArgs(int argc, char** argv, Options* opt) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    bool has_value = i + 1 < argc;
+    if (a == "--instances" && has_value) {
+      opt->instances = atoi(argv[++i]);
+    } else if (a == "--cycles" && has_value) {
+      opt->cycles = atoi(argv[++i]);
+    } else if (a == "--captures" && has_value) {
+      opt->captures = atoi(argv[++i]);
+    } else if (a == "--warm") {
+      opt->warm = true;
+    } else if (a == "--recycle-every" && has_value) {
+      opt->recycle_every = atoi(argv[++i]);
+    } else if (a == "--device-channels" && has_value) {
+      opt->device_channels = atoi(argv[++i]);
+    } else if (a == "--size" && has_value) {
+      if (sscanf(argv[++i], "%dx%d", &opt->width, &opt->height) != 2) {
+        return false;
+      }
+    } else if (a == "--fps" && has_value) {
+      opt->fps = atoi(argv[++i]);
+    } else if (a == "--sample-ms" && has_value) {
+      opt->sample_ms = atoi(argv[++i]);
+    } else if (a == "--max-rss-growth-mb" && has_value) {
+      opt->max_rss_growth_mb = atof(argv[++i]);
+    } else if (a == "--no-faults") {
+      opt->faults = false;
+    } else if (a == "--csv" && has_value) {
+      opt->csv = argv[++i];
+    } else if (a == "--log" && has_value) {
+      opt->log = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  return opt->instances > 0 && opt->instances <= 8 && opt->cycles > 0 &&
+         opt->device_channels >= 0 && opt->device_channels <= 64;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parseArgs(argc, argv, &opt)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // 输出路径按启动目录解析，之后会切换到临时目录
+  char cwd[4096];
+  if (getcwd(cwd, sizeof(cwd)) != NULL) {
+    if (!opt.csv.empty() && opt.csv[0] != '/') {
+      opt.csv = std::string(cwd) + "/" + opt.csv;
+    }
+    if (!opt.log.empty() && opt.log[0] != '/') {
+      opt.log = std::string(cwd) + "/" + opt.log;
+    }
+  }
+
+  // 在临时目录里跑，抓图和 sdkLog 不污染当前目录
+  char dir_tmpl[] = "/tmp/cam_sys_soak_XXXXXX";
+  std::string work_dir = mkdtemp(dir_tmpl);
+  if (chdir(work_dir.c_str()) != 0) {
+    perror("chdir");
+    return 2;
+  }
+
+  FakeSdkConfig cfg;
+  cfg.width = opt.width;
+  cfg.height = opt.height;
+  cfg.fps = opt.fps;
+  cfg.packet_size = 32 * 1024;
+  cfg.ip_channels = opt.device_channels;
+  if (opt.faults) {
+    // 互质的周期，让各类故障与码流切换错开出现
+    cfg.login_fail_every = 37;
+    cfg.realplay_fail_every = 41;
+    cfg.jpeg_fail_every = 23;
+    cfg.resend_syshead_every = 97;
+  }
+  FakeSdk::configure(cfg);
+
+  // CamController 每个码流包都会 printf，重定向到日志文件或 /dev/null
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  FILE* report = fdopen(saved_stdout, "w");
+  int log_fd = open(opt.log.empty() ? "/dev/null" : opt.log.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  dup2(log_fd, STDOUT_FILENO);
+  close(log_fd);
+
+  // 写入器的线程是进程级常驻的，先启动它再取基线
+  AsyncFileWriter::instance();
+  const int base_fds = countFds();
+  const int base_threads = countThreads();
+  const long base_rss = readRssKb();
+
+  fprintf(report,
+          "[soak] 模式=%s 实例=%d 循环=%d 抓图/循环=%d 分辨率=%dx%d 故障注入=%s\n",
+          opt.device_channels > 0 ? "device" : (opt.warm ? "warm" : "cycle"),
+          opt.instances, opt.cycles, opt.captures,
+          opt.width, opt.height, opt.faults ? "开" : "关");
+  fprintf(report, "[soak] 基线: rss=%ldKB fds=%d threads=%d 工作目录=%s\n",
+          base_rss, base_fds, base_threads, work_dir.c_str());
+  fflush(report);
+
+  std::atomic<long> done(0);
+  std::atomic<long> interrupted(0);
+  std::vector<std::thread> workers;
+  const double t0 = nowSec();
+  for (int i = 0; i < opt.instances; i++) {
+    workers.push_back(std::thread(worker, i, std::cref(opt), &done, &interrupted));
+  }
+
+  std::vector<Sample> samples;
+  const long total = static_cast<long>(opt.instances) * opt.cycles;
+  int peak_threads = 0;
+  int peak_ports = 0;
+  while (true) {
+    Sample s;
+    s.t_sec = nowSec() - t0;
+    s.rss_kb = readRssKb();
+    s.fds = countFds();
+    s.threads = countThreads();
+    s.sdk = FakeSdk::stats();
+    s.cycles = done;
+    samples.push_back(s);
+    peak_threads = std::max(peak_threads, s.threads);
+    peak_ports = std::max(peak_ports, s.sdk.ports);
+    if (samples.size() % 20 == 0) {
+      fprintf(report,
+              "[soak] %6.1fs 循环 %ld/%ld rss=%ldKB fds=%d threads=%d ports=%d\n",
+              s.t_sec, s.cycles, total, s.rss_kb, s.fds, s.threads, s.sdk.ports);
+      fflush(report);
+    }
+    if (s.cycles >= total) {
+      break;
+    }
+    usleep(opt.sample_ms * 1000);
+  }
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+  AsyncFileWriter::instance().flush();
+
+  const double elapsed = nowSec() - t0;
+  const int end_fds = countFds();
+  const int end_threads = countThreads();
+  const long end_rss = readRssKb();
+  const FakeSdkStats sdk = FakeSdk::stats();
+
+  if (!opt.csv.empty()) {
+    FILE* csv = fopen(opt.csv.c_str(), "w");
+    if (csv) {
+      fprintf(csv, "t_sec,cycles,rss_kb,fds,threads,ports,real_plays,users\n");
+      for (size_t i = 0; i < samples.size(); i++) {
+        const Sample& s = samples[i];
+        fprintf(csv, "%.2f,%ld,%ld,%d,%d,%d,%d,%d\n", s.t_sec, s.cycles,
+                s.rss_kb, s.fds, s.threads, s.sdk.ports, s.sdk.real_plays,
+                s.sdk.users);
+      }
+      fclose(csv);
+    }
+  }
+
+  // RSS：跳过前 20% 的预热样本（分配器、libjpeg、写入器缓冲区逐步到位），
+  // 比较预热后第一个 10% 窗口与最后 10% 窗口的中位数
+  const size_t warm = samples.size() / 5;
+  const size_t win = std::max<size_t>(1, samples.size() / 10);
+  std::vector<long> head_rss;
+  std::vector<long> tail_rss;
+  for (size_t i = warm; i < samples.size() && i < warm + win; i++) {
+    head_rss.push_back(samples[i].rss_kb);
+  }
+  for (size_t i = samples.size() > win ? samples.size() - win : 0;
+       i < samples.size(); i++) {
+    tail_rss.push_back(samples[i].rss_kb);
+  }
+  const double rss_growth_mb = (median(tail_rss) - median(head_rss)) / 1024.0;
+  const double slope = rssSlopePerKCycles(samples, warm);
+
+  std::vector<std::string> failures;
+  char buf[256];
+  if (rss_growth_mb > opt.max_rss_growth_mb) {
+    snprintf(buf, sizeof(buf), "RSS 增长 %.1fMB 超过上限 %.1fMB",
+             rss_growth_mb, opt.max_rss_growth_mb);
+    failures.push_back(buf);
+  }
+  if (end_fds != base_fds) {
+    snprintf(buf, sizeof(buf), "fd 泄漏: 基线 %d, 结束 %d", base_fds, end_fds);
+    failures.push_back(buf);
+  }
+  if (end_threads != base_threads) {
+    snprintf(buf, sizeof(buf), "线程泄漏: 基线 %d, 结束 %d", base_threads,
+             end_threads);
+    failures.push_back(buf);
+  }
+  const int max_streams =
+      opt.instances * (opt.device_channels > 0 ? opt.device_channels : 1);
+  if (peak_ports > max_streams) {
+    snprintf(buf, sizeof(buf), "播放库端口峰值 %d 超过码流路数 %d", peak_ports,
+             max_streams);
+    failures.push_back(buf);
+  }
+  if (sdk.ports != 0 || sdk.real_plays != 0 || sdk.users != 0) {
+    snprintf(buf, sizeof(buf), "结束时仍有 ports=%d real_plays=%d users=%d",
+             sdk.ports, sdk.real_plays, sdk.users);
+    failures.push_back(buf);
+  }
+  if (sdk.init_refs != 0) {
+    snprintf(buf, sizeof(buf), "NET_DVR_Init/Cleanup 不配对: 余 %d",
+             sdk.init_refs);
+    failures.push_back(buf);
+  }
+  if (sdk.bad_frees != 0) {
+    snprintf(buf, sizeof(buf), "重复或无效释放 %d 次", sdk.bad_frees);
+    failures.push_back(buf);
+  }
+
+  fprintf(report,
+          "[soak] 完成 %ld 个循环，用时 %.1fs（%.1f 循环/秒），故障中断 %ld 次，注入故障 %ld 次，送帧 %ld\n",
+          total, elapsed, total / elapsed, interrupted.load(), sdk.faults,
+          sdk.frames_sent);
+  fprintf(report,
+          "[soak] rss: 基线 %ldKB -> 结束 %ldKB，预热后增长 %.2fMB，斜率 %.1fKB/千循环\n",
+          base_rss, end_rss, rss_growth_mb, slope);
+  fprintf(report, "[soak] fds %d -> %d, threads %d -> %d (峰值 %d), ports 峰值 %d\n",
+          base_fds, end_fds, base_threads, end_threads, peak_threads,
+          peak_ports);
+  for (size_t i = 0; i < failures.size(); i++) {
+    fprintf(report, "[soak] FAIL: %s\n", failures[i].c_str());
+  }
+  fprintf(report, "[soak] %s\n", failures.empty() ? "PASS" : "FAIL");
+  fflush(report);
+
+  if (chdir("/") == 0) {
+    std::string command = "rm -rf " + work_dir;
+    if (system(command.c_str()) != 0) {
+      fprintf(report, "[soak] 警告: 清理工作目录失败 %s\n", work_dir.c_str());
+    }
+  }
+  return failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 00:12:37
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 00:12:37
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/ArrivalTrigger.cpp
+ * @Description: 机器人到位即抓图：本机 socket 收到到达报文后直接触发同步抓图
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "ArrivalTrigger.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const int kReceivePollMs = 200;  // stop 最多等这么久
+const size_t kMaxMessage = 1024;
+
+bool fillAddress(const std::string& path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+    printf("到位抓图: socket 路径无效: %s\n", path.c_str());
+    return false;
+  }
+  memcpy(addr->sun_path, path.c_str(), path.size());
+  return true;
+}
+
+void appendQuoted(std::string* out, const std::string& s) {
+  out->push_back('"');
+  for (size_t i = 0; i < s.size(); i++) {
+    const unsigned char c = static_cast<unsigned char>(s[i]);
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(static_cast<char>(c));
+    } else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out->append(buf);
+    } else {
+      out->push_back(static_cast<char>(c));
+    }
+  }
+  out->push_back('"');
+}
+
+}  // namespace
+
+ArrivalTrigger::ArrivalTrigger(CaptureGroup* group)
+    : group_(group), fd_(-1), running_(false), unmatched_(0) {}
+
+ArrivalTrigger::~ArrivalTrigger() { stop(); }
+
+std::string ArrivalTrigger::resultKey(const std::string& robot_code,
+                                      const std::string& bin_code) {
+  return robot_code + "|" + bin_code;
+}
+
+bool ArrivalTrigger::listen(const std::string& socket_path) {
+  if (running_) {
+    return true;
+  }
+  struct sockaddr_un addr;
+  if (!fillAddress(socket_path, &addr)) {
+    return false;
+  }
+  int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    printf("到位抓图: 创建 socket 失败: %s\n", strerror(errno));
+    return false;
+  }
+  // 上次进程异常退出时留下的 socket 文件
+  unlink(socket_path.c_str());
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    printf("到位抓图: 绑定 %s 失败: %s\n", socket_path.c_str(),
+           strerror(errno));
+    close(fd);
+    return false;
+  }
+  fd_ = fd;
+  socket_path_ = socket_path;
+  running_ = true;
+  thread_ = std::thread(&ArrivalTrigger::receiveLoop, this);
+  printf("到位抓图: 监听 %s\n", socket_path.c_str());
+  return true;
+}
+
+void ArrivalTrigger::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  close(fd_);
+  fd_ = -1;
+  unlink(socket_path_.c_str());
+  printf("到位抓图: 已停止\n");
+}
+
+void ArrivalTrigger::arm(const std::string& robot_code,
+                         const std::string& task_id,
+                         const std::string& bin_code,
+                         const TriggerOptions& options) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Armed& a = armed_[std::make_pair(robot_code, bin_code)];
+  a.task_id = task_id;
+  a.options = options;
+}
+
+bool ArrivalTrigger::disarm(const std::string& robot_code,
+                            const std::string& bin_code) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return armed_.erase(std::make_pair(robot_code, bin_code)) > 0;
+}
+
+size_t ArrivalTrigger::armed() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return armed_.size();
+}
+
+bool ArrivalTrigger::notify(const std::string& socket_path,
+                            const std::string& robot_code,
+                            const std::string& bin_code) {
+  struct sockaddr_un addr;
+  if (!fillAddress(socket_path, &addr)) {
+    return false;
+  }
+  int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  char stamp[32];
+  snprintf(stamp, sizeof(stamp), "%" PRId64, EventBus::nowMicros());
+  const std::string message = robot_code + "\t" + bin_code + "\t" + stamp;
+  const ssize_t n =
+      sendto(fd, message.data(), message.size(), MSG_DONTWAIT,
+             reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+  close(fd);
+  if (n != static_cast<ssize_t>(message.size())) {
+    printf("到位抓图: 发送到达报文失败 (%s): %s\n", socket_path.c_str(),
+           strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void ArrivalTrigger::receiveLoop() {
+  char buf[kMaxMessage];
+  while (running_) {
+    struct pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, kReceivePollMs) <= 0) {
+      continue;
+    }
+    const ssize_t n = recv(fd_, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n <= 0) {
+      continue;
+    }
+    handle(std::string(buf, static_cast<size_t>(n)), EventBus::nowMicros());
+  }
+}
+
+void ArrivalTrigger::handle(const std::string& message, int64_t received_us) {
+  // 去掉行尾换行，方便用 socat/nc 手工发报文
+  size_t end = message.size();
+  while (end > 0 && (message[end - 1] == '\n' || message[end - 1] == '\r')) {
+    end--;
+  }
+  std::string fields[3];
+  size_t start = 0;
+  for (int k = 0; k < 3 && start <= end; k++) {
+    size_t tab = message.find('\t', start);
+    if (tab == std::string::npos || tab > end || k == 2) {
+      tab = end;
+    }
+    fields[k] = message.substr(start, tab - start);
+    start = tab + 1;
+  }
+  const std::string& robot_code = fields[0];
+  int64_t arrival_us = received_us;
+  if (!fields[2].empty()) {
+    const int64_t sent_us = strtoll(fields[2].c_str(), NULL, 10);
+    if (sent_us > 0 && sent_us <= received_us) {
+      arrival_us = sent_us;
+    }
+  }
+
+  std::string bin_code = fields[1];
+  Armed armed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ArmedMap::iterator it = armed_.end();
+    if (bin_code.empty()) {
+      it = armed_.lower_bound(std::make_pair(robot_code, std::string()));
+      if (it != armed_.end() && it->first.first != robot_code) {
+        it = armed_.end();
+      }
+    } else {
+      it = armed_.find(std::make_pair(robot_code, bin_code));
+    }
+    if (it == armed_.end()) {
+      unmatched_++;
+      printf("到位抓图: 未登记的到达 %s / %s，忽略\n", robot_code.c_str(),
+             bin_code.c_str());
+      return;
+    }
+    bin_code = it->first.second;
+    armed = it->second;
+    armed_.erase(it);
+  }
+  fire(robot_code, bin_code, armed, arrival_us);
+}
+
+void ArrivalTrigger::fire(const std::string& robot_code,
+                          const std::string& bin_code, const Armed& armed,
+                          int64_t arrival_us) {
+  std::vector<SyncedFrame> frames;
+  double spread_ms = -1.0;
+  if (group_ != NULL) {
+    group_->setTaskInfo(armed.task_id, bin_code);
+    frames = group_->capture(armed.options.tolerance_ms,
+                             armed.options.timeout_ms,
+                             armed.options.max_age_ms);
+    spread_ms = group_->lastSpreadMs();
+  }
+  const int64_t done_us = EventBus::nowMicros();
+
+  bool success = !frames.empty();
+  int64_t frame_us = 0;
+  std::string list = "[";
+  for (size_t i = 0; i < frames.size(); i++) {
+    const SyncedFrame& f = frames[i];
+    success = success && !f.path.empty();
+    frame_us = std::max(frame_us, f.host_us);
+    char nums[128];
+    snprintf(nums, sizeof(nums),
+             ", \"stream_type\": %d, \"host_us\": %" PRId64
+             ", \"skew_ms\": %.2f}",
+             f.stream_type, f.host_us, f.skew_ms);
+    list += i ? ", {\"camera\": " : "{\"camera\": ";
+    appendQuoted(&list, f.camera_type);
+    list += ", \"path\": ";
+    appendQuoted(&list, f.path);
+    list += nums;
+  }
+  list += "]";
+
+  std::string payload = "{\"robot_code\": ";
+  appendQuoted(&payload, robot_code);
+  payload += ", \"task_no\": ";
+  appendQuoted(&payload, armed.task_id);
+  payload += ", \"bin\": ";
+  appendQuoted(&payload, bin_code);
+  char nums[192];
+  snprintf(nums, sizeof(nums),
+           ", \"success\": %s, \"arrival_us\": %" PRId64
+           ", \"frame_us\": %" PRId64 ", \"done_us\": %" PRId64
+           ", \"spread_ms\": %.2f, \"frames\": ",
+           success ? "true" : "false", arrival_us, frame_us, done_us,
+           spread_ms);
+  payload += nums;
+  payload += list;
+  payload += "}";
+
+  if (success) {
+    printf("到位抓图完成: %s / %s, 到达→成像 %.1f ms, 到达→抓图完成 %.1f ms\n",
+           robot_code.c_str(), bin_code.c_str(),
+           (frame_us - arrival_us) / 1000.0, (done_us - arrival_us) / 1000.0);
+  } else {
+    printf("到位抓图失败: %s / %s\n", robot_code.c_str(), bin_code.c_str());
+  }
+  results_.publish(std::vector<std::string>(1, resultKey(robot_code, bin_code)),
+                   payload);
+}
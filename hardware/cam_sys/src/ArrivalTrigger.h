@@ -0,0 +1,96 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 00:12:37
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 00:12:37
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/ArrivalTrigger.h
+ * @Description: 机器人到位即抓图：本机 socket 收到到达报文后直接触发同步抓图
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "CaptureGroup.h"
+#include "EventBus.h"
+
+struct TriggerOptions {
+  int tolerance_ms;  // 同 CaptureGroup::capture
+  int timeout_ms;
+  int max_age_ms;    // 0 表示只用到达之后的新帧（机器人已停稳）
+
+  TriggerOptions() : tolerance_ms(40), timeout_ms(1500), max_age_ms(0) {}
+};
+
+// 抓图服务按 (robotTaskCode, 储位) 登记触发；到达报文经本机 UNIX 数据报 socket
+// 送到监听线程，命中登记就在该线程里直接做一次 CaptureGroup::capture，
+// 不经过 gateway 的工作流唤醒、脚本启动、登录和开流。
+// 报文为一行 "<robotTaskCode>\t<储位>[\t<发送时刻 us>]"，储位为空时取该
+// robotTaskCode 登记的第一个储位；发送时刻为 CLOCK_MONOTONIC 微秒，缺省按收到时刻。
+// 完成后在 results() 上以 resultKey(robotTaskCode, 储位) 发布一条 JSON：
+//   {"robot_code", "task_no", "bin", "success", "arrival_us", "frame_us",
+//    "done_us", "spread_ms", "frames": [{"camera", "path", "stream_type",
+//    "host_us", "skew_ms"}]}
+// Python 侧把 results().fd() 交给事件循环即可等结果。组内相机须已登录开流，
+// 且比触发器活得久；同一时刻只有一次抓图，后到的报文在 socket 里排队。
+class ArrivalTrigger {
+ public:
+  explicit ArrivalTrigger(CaptureGroup* group);
+  ~ArrivalTrigger();
+
+  // 绑定 socket_path（已存在的同名文件先删除）并启动监听线程
+  bool listen(const std::string& socket_path);
+  void stop();
+  bool running() const { return running_; }
+  const std::string& socketPath() const { return socket_path_; }
+
+  // 登记/撤销；同一 (robotTaskCode, 储位) 重复登记时覆盖
+  void arm(const std::string& robot_code, const std::string& task_id,
+           const std::string& bin_code, const TriggerOptions& options);
+  bool disarm(const std::string& robot_code, const std::string& bin_code);
+  size_t armed();
+  // 收到但没有命中登记的报文数
+  long unmatched() const { return unmatched_; }
+
+  EventBus& results() { return results_; }
+  static std::string resultKey(const std::string& robot_code,
+                               const std::string& bin_code);
+
+  // 客户端：向 socket_path 发一条到达报文（带发送时刻），不等待抓图
+  static bool notify(const std::string& socket_path,
+                     const std::string& robot_code,
+                     const std::string& bin_code);
+
+ private:
+  ArrivalTrigger(const ArrivalTrigger&);
+  ArrivalTrigger& operator=(const ArrivalTrigger&);
+
+  struct Armed {
+    std::string task_id;
+    TriggerOptions options;
+  };
+  typedef std::map<std::pair<std::string, std::string>, Armed> ArmedMap;
+
+  void receiveLoop();
+  void handle(const std::string& message, int64_t received_us);
+  void fire(const std::string& robot_code, const std::string& bin_code,
+            const Armed& armed, int64_t arrival_us);
+
+  CaptureGroup* group_;
+  EventBus results_;
+  std::mutex mutex_;
+  ArmedMap armed_;
+  std::string socket_path_;
+  int fd_;
+  std::atomic<bool> running_;
+  std::atomic<long> unmatched_;
+  std::thread thread_;
+};
@@ -0,0 +1,463 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 09:12:31
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 09:12:31
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/AsyncFileWriter.cpp
+ * @Description: 异步文件写入器（io_uring，失败时回退到线程池）
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "AsyncFileWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+const unsigned kRingEntries = 64;     // SQ 深度，同时也是在途请求上限
+const int kFixedSlots = 4;            // 注册的固定缓冲区个数
+const size_t kFixedSlotSize = 2 << 20;  // 每块 2MB，覆盖绝大多数 JPEG
+const int kFallbackThreads = 2;
+const __u64 kWakeupTag = 0;  // 关闭时用于唤醒收割线程的 NOP
+
+int sysIoUringSetup(unsigned entries, io_uring_params* p) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sysIoUringEnter(int fd, unsigned to_submit, unsigned min_complete,
+                    unsigned flags) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0));
+}
+
+int sysIoUringRegister(int fd, unsigned opcode, const void* arg,
+                       unsigned nr_args) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+}  // namespace
+
+// mmap 出来的 SQ/CQ 环，只由提交线程写 SQ、收割线程读 CQ
+struct AsyncFileWriter::Ring {
+  int fd;
+  unsigned sq_entries;
+  void* sq_ptr;
+  size_t sq_len;
+  void* cq_ptr;
+  size_t cq_len;
+  io_uring_sqe* sqes;
+  size_t sqes_len;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  io_uring_cqe* cqes;
+  bool fixed_buffers;
+  std::atomic<unsigned> inflight;
+};
+
+AsyncFileWriter& AsyncFileWriter::instance() {
+  static AsyncFileWriter writer;
+  return writer;
+}
+
+AsyncFileWriter::AsyncFileWriter()
+    : ring_(NULL), slot_size_(0), stopping_(false), pending_(0) {
+  const char* backend = getenv("CAM_SYS_WRITER");
+  bool want_ring = !(backend && strcmp(backend, "threads") == 0);
+
+  if (want_ring && setupRing()) {
+    printf("[AsyncFileWriter] 使用 io_uring 后端 (固定缓冲区:%s)\n",
+           ring_->fixed_buffers ? "是" : "否");
+    threads_.push_back(std::thread(&AsyncFileWriter::submitLoop, this));
+    threads_.push_back(std::thread(&AsyncFileWriter::reapLoop, this));
+  } else {
+    printf("[AsyncFileWriter] 使用线程池后端 (%d 线程)\n", kFallbackThreads);
+    for (int i = 0; i < kFallbackThreads; i++) {
+      threads_.push_back(std::thread(&AsyncFileWriter::workerLoop, this));
+    }
+  }
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stopping_ = true;
+  }
+  queue_cv_.notify_all();
+
+  if (ring_) {
+    // 先等提交线程退出，之后由本线程独占 SQ，投递 NOP 唤醒收割线程
+    threads_[0].join();
+    unsigned tail = *ring_->sq_tail;
+    unsigned idx = tail & *ring_->sq_mask;
+    io_uring_sqe* sqe = &ring_->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = kWakeupTag;
+    ring_->sq_array[idx] = idx;
+    __atomic_store_n(ring_->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    sysIoUringEnter(ring_->fd, 1, 0, 0);
+    threads_[1].join();
+
+    munmap(ring_->sqes, ring_->sqes_len);
+    if (ring_->cq_ptr != ring_->sq_ptr) {
+      munmap(ring_->cq_ptr, ring_->cq_len);
+    }
+    munmap(ring_->sq_ptr, ring_->sq_len);
+    close(ring_->fd);
+    delete ring_;
+    ring_ = NULL;
+  } else {
+    for (size_t i = 0; i < threads_.size(); i++) {
+      threads_[i].join();
+    }
+  }
+}
+
+bool AsyncFileWriter::setupRing() {
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = sysIoUringSetup(kRingEntries, &p);
+  if (fd < 0) {
+    printf("[AsyncFileWriter] io_uring_setup 失败, errno=%d\n", errno);
+    return false;
+  }
+
+  Ring* r = new Ring();
+  r->fd = fd;
+  r->sq_entries = p.sq_entries;
+  r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    r->sq_len = r->cq_len = (r->sq_len > r->cq_len) ? r->sq_len : r->cq_len;
+  }
+
+  r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (r->sq_ptr == MAP_FAILED) {
+    close(fd);
+    delete r;
+    return false;
+  }
+  r->cq_ptr = single_mmap ? r->sq_ptr
+                          : mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, fd,
+                                 IORING_OFF_CQ_RING);
+  r->sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+  r->sqes = static_cast<io_uring_sqe*>(
+      mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+           fd, IORING_OFF_SQES));
+  if (r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED) {
+    if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr != MAP_FAILED && !single_mmap) munmap(r->cq_ptr, r->cq_len);
+    munmap(r->sq_ptr, r->sq_len);
+    close(fd);
+    delete r;
+    return false;
+  }
+
+  char* sq = static_cast<char*>(r->sq_ptr);
+  char* cq = static_cast<char*>(r->cq_ptr);
+  r->sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+  r->sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+  r->sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+  r->sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+  r->cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+  r->cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+  r->cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+  r->cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+  r->inflight = 0;
+
+  // 注册固定缓冲区；受 RLIMIT_MEMLOCK 限制可能失败，失败则全部走 heap
+  slot_mem_.resize(kFixedSlots * kFixedSlotSize);
+  std::vector<iovec> iovs(kFixedSlots);
+  for (int i = 0; i < kFixedSlots; i++) {
+    iovs[i].iov_base = &slot_mem_[i * kFixedSlotSize];
+    iovs[i].iov_len = kFixedSlotSize;
+  }
+  r->fixed_buffers =
+      sysIoUringRegister(fd, IORING_REGISTER_BUFFERS, &iovs[0], kFixedSlots) == 0;
+  if (r->fixed_buffers) {
+    slot_size_ = kFixedSlotSize;
+    for (int i = kFixedSlots - 1; i >= 0; i--) free_slots_.push_back(i);
+  } else {
+    printf("[AsyncFileWriter] 注册固定缓冲区失败, errno=%d\n", errno);
+    std::vector<char>().swap(slot_mem_);
+  }
+
+  ring_ = r;
+  return true;
+}
+
+bool AsyncFileWriter::write(const std::string& path, const void* data,
+                            size_t size, Callback cb) {
+  Request* req = new Request();
+  req->path = path;
+  req->slot = -1;
+  req->size = size;
+  req->offset = 0;
+  req->fd = -1;
+  req->cb = cb;
+
+  if (size <= slot_size_) {
+    std::lock_guard<std::mutex> lock(slot_mutex_);
+    if (!free_slots_.empty()) {
+      req->slot = free_slots_.back();
+      free_slots_.pop_back();
+    }
+  }
+  if (req->slot >= 0) {
+    memcpy(&slot_mem_[req->slot * slot_size_], data, size);
+  } else {
+    const char* p = static_cast<const char*>(data);
+    req->heap.assign(p, p + size);
+  }
+  return enqueue(req);
+}
+
+bool AsyncFileWriter::write(const std::string& path, std::vector<char>&& data,
+                            Callback cb) {
+  Request* req = new Request();
+  req->path = path;
+  req->slot = -1;
+  req->size = data.size();
+  req->offset = 0;
+  req->fd = -1;
+  req->cb = cb;
+  req->heap.swap(data);
+  return enqueue(req);
+}
+
+bool AsyncFileWriter::enqueue(Request* req) {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!stopping_) {
+      pending_++;
+      queue_.push_back(req);
+      req = NULL;
+    }
+  }
+  if (req) {
+    printf("[AsyncFileWriter] 写入器已关闭，丢弃: %s\n", req->path.c_str());
+    delete req;
+    return false;
+  }
+  queue_cv_.notify_one();
+  return true;
+}
+
+const char* AsyncFileWriter::dataOf(const Request* req) const {
+  if (req->slot >= 0) {
+    return &slot_mem_[req->slot * slot_size_];
+  }
+  return req->heap.empty() ? NULL : &req->heap[0];
+}
+
+void AsyncFileWriter::finish(Request* req, bool ok) {
+  std::string tmp = req->path + ".tmp";
+  if (req->fd >= 0) {
+    close(req->fd);
+    req->fd = -1;
+  }
+  if (ok) {
+    ok = rename(tmp.c_str(), req->path.c_str()) == 0;
+  }
+  if (!ok) {
+    unlink(tmp.c_str());
+    printf("[AsyncFileWriter] 写入失败: %s\n", req->path.c_str());
+  }
+
+  if (req->slot >= 0) {
+    std::lock_guard<std::mutex> lock(slot_mutex_);
+    free_slots_.push_back(req->slot);
+  }
+  if (req->cb) {
+    req->cb(req->path, ok);
+  }
+  delete req;
+
+  {
+    std::lock_guard<std::mutex> lock(flush_mutex_);
+    pending_--;
+  }
+  flush_cv_.notify_all();
+}
+
+void AsyncFileWriter::flush() {
+  std::unique_lock<std::mutex> lock(flush_mutex_);
+  while (pending_.load() > 0) {
+    flush_cv_.wait(lock);
+  }
+}
+
+void AsyncFileWriter::submitLoop() {
+  std::vector<Request*> batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      // 在途请求达到 SQ 深度时等待收割线程腾出位置，保证 CQ 不溢出
+      while (!(stopping_ && queue_.empty()) &&
+             (queue_.empty() || ring_->inflight.load() >= ring_->sq_entries)) {
+        queue_cv_.wait(lock);
+      }
+      if (stopping_ && queue_.empty()) {
+        break;
+      }
+      unsigned room = ring_->sq_entries - ring_->inflight.load();
+      while (!queue_.empty() && batch.size() < room) {
+        batch.push_back(queue_.front());
+        queue_.pop_front();
+      }
+    }
+
+    unsigned tail = *ring_->sq_tail;
+    unsigned queued = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+      Request* req = batch[i];
+      if (req->fd < 0) {
+        std::string tmp = req->path + ".tmp";
+        req->fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                       0644);
+        if (req->fd < 0) {
+          printf("[AsyncFileWriter] 无法打开文件: %s, errno=%d\n", tmp.c_str(),
+                 errno);
+          finish(req, false);
+          continue;
+        }
+      }
+      if (req->size == 0) {
+        finish(req, true);
+        continue;
+      }
+
+      unsigned idx = (tail + queued) & *ring_->sq_mask;
+      io_uring_sqe* sqe = &ring_->sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->fd = req->fd;
+      sqe->off = req->offset;
+      sqe->len = static_cast<__u32>(req->size - req->offset);
+      sqe->user_data = reinterpret_cast<__u64>(req);
+      if (req->slot >= 0) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->addr = reinterpret_cast<__u64>(dataOf(req) + req->offset);
+        sqe->buf_index = static_cast<__u16>(req->slot);
+      } else {
+        sqe->opcode = IORING_OP_WRITEV;
+        req->iov.iov_base = const_cast<char*>(dataOf(req)) + req->offset;
+        req->iov.iov_len = req->size - req->offset;
+        sqe->addr = reinterpret_cast<__u64>(&req->iov);
+        sqe->len = 1;
+      }
+      ring_->sq_array[idx] = idx;
+      queued++;
+    }
+    batch.clear();
+    if (queued == 0) {
+      continue;
+    }
+
+    ring_->inflight += queued;
+    __atomic_store_n(ring_->sq_tail, tail + queued, __ATOMIC_RELEASE);
+    // 一次系统调用提交整批
+    int ret;
+    do {
+      ret = sysIoUringEnter(ring_->fd, queued, 0, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+      printf("[AsyncFileWriter] io_uring_enter 提交失败, errno=%d\n", errno);
+    }
+  }
+}
+
+void AsyncFileWriter::reapLoop() {
+  bool running = true;
+  while (running) {
+    int ret = sysIoUringEnter(ring_->fd, 0, 1, IORING_ENTER_GETEVENTS);
+    if (ret < 0 && errno != EINTR) {
+      printf("[AsyncFileWriter] io_uring_enter 等待失败, errno=%d\n", errno);
+    }
+
+    unsigned head = *ring_->cq_head;
+    unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+    std::vector<Request*> requeue;
+    while (head != tail) {
+      io_uring_cqe* cqe = &ring_->cqes[head & *ring_->cq_mask];
+      head++;
+      if (cqe->user_data == kWakeupTag) {
+        running = false;
+        continue;
+      }
+
+      Request* req = reinterpret_cast<Request*>(cqe->user_data);
+      int res = cqe->res;
+      ring_->inflight--;
+      if (res == -EINTR || res == -EAGAIN) {
+        requeue.push_back(req);
+      } else if (res <= 0) {
+        printf("[AsyncFileWriter] 写入出错: %s, res=%d\n", req->path.c_str(),
+               res);
+        finish(req, false);
+      } else {
+        req->offset += static_cast<size_t>(res);
+        if (req->offset < req->size) {
+          requeue.push_back(req);  // 短写，剩余部分重新提交
+        } else {
+          finish(req, true);
+        }
+      }
+    }
+    __atomic_store_n(ring_->cq_head, head, __ATOMIC_RELEASE);
+
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      for (size_t i = 0; i < requeue.size(); i++) {
+        queue_.push_front(requeue[i]);
+      }
+    }
+    queue_cv_.notify_all();
+  }
+}
+
+void AsyncFileWriter::workerLoop() {
+  while (true) {
+    Request* req = NULL;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      while (!stopping_ && queue_.empty()) {
+        queue_cv_.wait(lock);
+      }
+      if (queue_.empty()) {
+        break;
+      }
+      req = queue_.front();
+      queue_.pop_front();
+    }
+
+    std::string tmp = req->path + ".tmp";
+    bool ok = false;
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (fp) {
+      ok = fwrite(dataOf(req), sizeof(char), req->size, fp) == req->size;
+      ok = (fclose(fp) == 0) && ok;
+    } else {
+      printf("[AsyncFileWriter] 无法打开文件: %s\n", tmp.c_str());
+    }
+    finish(req, ok);
+  }
+}
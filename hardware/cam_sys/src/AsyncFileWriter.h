@@ -0,0 +1,98 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 09:12:31
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 09:12:31
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/AsyncFileWriter.h
+ * @Description: 异步文件写入器（io_uring，失败时回退到线程池）
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 抓图、调试图、深度缓存等产物的异步落盘。
+// 生产者只做一次内存拷贝（优先拷入已注册的固定缓冲区）就返回，不会阻塞在存储上。
+// 数据先写入 "<path>.tmp"，写完后 rename 为 "<path>"，然后调用完成回调，
+// 因此按文件名轮询的一方（Python 侧 glob *.jpg）只会看到完整文件。
+class AsyncFileWriter {
+ public:
+  // path 为最终文件路径，ok 表示写入并 rename 成功
+  typedef std::function<void(const std::string& path, bool ok)> Callback;
+
+  static AsyncFileWriter& instance();
+
+  // 拷贝 data 后立即返回；写入器已关闭时返回 false
+  bool write(const std::string& path, const void* data, size_t size,
+             Callback cb = Callback());
+  // 接管 data 的所有权，不做拷贝
+  bool write(const std::string& path, std::vector<char>&& data,
+             Callback cb = Callback());
+
+  // 阻塞等待所有已提交的写入完成（进程退出/登出前调用）
+  void flush();
+
+  size_t pending() const { return pending_.load(); }
+  bool usingIoUring() const { return ring_ != NULL; }
+
+ private:
+  AsyncFileWriter();
+  ~AsyncFileWriter();
+  AsyncFileWriter(const AsyncFileWriter&);
+  AsyncFileWriter& operator=(const AsyncFileWriter&);
+
+  struct Ring;
+
+  struct Request {
+    std::string path;
+    std::vector<char> heap;  // 未使用固定缓冲区时的数据
+    int slot;                // 固定缓冲区下标，-1 表示使用 heap
+    size_t size;
+    size_t offset;  // 已写入字节数（处理短写）
+    int fd;
+    struct iovec iov;  // IORING_OP_WRITEV 使用
+    Callback cb;
+  };
+
+  bool enqueue(Request* req);
+  const char* dataOf(const Request* req) const;
+  void finish(Request* req, bool ok);
+
+  // io_uring 后端：提交线程批量提交 SQE，收割线程处理 CQE
+  bool setupRing();
+  void submitLoop();
+  void reapLoop();
+
+  // 线程池后端
+  void workerLoop();
+
+  Ring* ring_;
+
+  // 已注册的固定缓冲区
+  std::vector<char> slot_mem_;
+  size_t slot_size_;
+  std::vector<int> free_slots_;
+  std::mutex slot_mutex_;
+
+  std::deque<Request*> queue_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  bool stopping_;
+
+  std::atomic<size_t> pending_;
+  std::mutex flush_mutex_;
+  std::condition_variable flush_cv_;
+
+  std::vector<std::thread> threads_;
+};
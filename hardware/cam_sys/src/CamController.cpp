@@ -9,14 +9,32 @@
  * Copyright (c) 2025 by lizh, All Rights Reserved.
  */
 #include "CamController.h"
+#include <algorithm>
 #include <map>
 
-// 全局的播放库port号 - 现在作为CamController的静态成员变量
-LONG CamController::m_lPort[16] = {-1, -1, -1, -1, -1, -1, -1, -1,
-                                   -1, -1, -1, -1, -1, -1, -1, -1};
+#include "AsyncFileWriter.h"
+#include "MemoryGovernor.h"
 
 // 静态成员变量初始化
 int CamController::times = 0;
+std::mutex CamController::sdk_mutex_;
+int CamController::sdk_refs_ = 0;
+const size_t CamController::kMinHistoryDepth;
+const size_t CamController::kMinRecordBytes;
+
+namespace {
+
+const int kFullFrameQuality = 90;  // 未设置 ROI 时整幅编码的质量（与 JpegEncoder 默认一致）
+
+// 拷贝字符串到 SDK 的定长字段，保证以 '\0' 结尾且不越界读取源串
+template <size_t N>
+void copyField(char (&dst)[N], const std::string& src) {
+  size_t n = src.size() < N - 1 ? src.size() : N - 1;
+  memcpy(dst, src.c_str(), n);
+  dst[n] = '\0';
+}
+
+}  // namespace
 
 /// 播放库硬解码回调 - 改为静态成员函数
 void CALLBACK CamController::DisplayCBFun(DISPLAY_INFO_YUV* pstDisplayInfo,
@@ -24,15 +42,12 @@ void CALLBACK CamController::DisplayCBFun(DISPLAY_INFO_YUV* pstDisplayInfo,
   CamController* pThis = static_cast<CamController*>(pUser);
   if (pThis) {
     if (pThis->times % 100 == 0) {
-      FILE* fp = NULL;
       std::string ansiString = "example" +
                                std::to_string(pstDisplayInfo->nPort) + "___" +
                                std::to_string(pThis->times / 100) + ".yuv";
-      fp = fopen(ansiString.c_str(), "wb");
-      if (fp) {
-        fwrite(pstDisplayInfo->pBuf, sizeof(char), pstDisplayInfo->nBufLen, fp);
-        fclose(fp);
-      }
+      // 异步落盘，不阻塞播放库回调线程
+      AsyncFileWriter::instance().write(ansiString, pstDisplayInfo->pBuf,
+                                        pstDisplayInfo->nBufLen);
     }
     pThis->times++;
     printf("Buf长度:%d\n画面宽:%d\n画面高:%d\n数据类型:%d\nn播放库句柄:%d\n",
@@ -49,11 +64,16 @@ void CALLBACK CamController::DecCBFunIm(int nPort, char* pBuf, int nSize,
   // 注意：回调函数中的nUser是char*类型，我们需要将它转换回CamController*
   CamController* pThis = reinterpret_cast<CamController*>(nUser);
   if (pThis) {
-    printf("字节数据大小：%d\n", nSize);
-    printf("相对时间戳：%d\n", pFrameInfo->nStamp);
+    // 调试用：设置 CAM_DUMP_FRAMES=1 时逐帧打印，并每100次回调保存一次数据；
+    // 默认不打印，否则每一帧都要在解码线程上写终端
+    static const bool dump_frames = getenv("CAM_DUMP_FRAMES") != NULL;
+    if (dump_frames) {
+      printf("字节数据大小：%d\n", nSize);
+      printf("相对时间戳：%d\n", pFrameInfo->nStamp);
+    }
+    pThis->onDecodedFrame(pBuf, nSize, pFrameInfo);
 
-    // 每100次回调保存一次数据
-    if (pThis->times % 100 == 0) {
+    if (dump_frames && pThis->times % 100 == 0) {
       // 注意：这里需要正确构造文件名
       std::string ansiString = "example" + std::to_string(pFrameInfo->nStamp) +
                                "___" + std::to_string(pThis->times / 100) +
@@ -78,6 +98,78 @@ void CALLBACK CamController::DecCBFunIm(int nPort, char* pBuf, int nSize,
   }
 }
 
+// 记录帧的时间信息：nStamp 与最近一个码流包的到达时刻喂给时钟估计器，
+// 换算出主机时钟下的成像时刻后写入帧历史
+void CamController::onDecodedFrame(const char* buf, int size,
+                                   const FRAME_INFO* info) {
+  int64_t arrival_us = last_packet_us_.load();
+  if (arrival_us == 0) {
+    arrival_us = StreamRecorder::nowMicros();
+  }
+  TimedFrame frame;
+  {
+    std::lock_guard<std::mutex> lock(clock_mutex_);
+    frame.stamp_ms = clock_.observe(info->nStamp, arrival_us);
+    frame.host_us = clock_.valid() ? clock_.toHostUs(frame.stamp_ms) : arrival_us;
+  }
+  frame.arrival_us = arrival_us;
+  frames_++;
+  frame.frame_num = info->dwFrameNum;
+  frame.width = info->nWidth;
+  frame.height = info->nHeight;
+
+  // 只缓存 YV12 帧的像素，其他格式只记时间。
+  // 帧历史和订阅者需要像素时只拷贝一次，二者共享同一块缓冲区
+  size_t yv12_size = static_cast<size_t>(info->nWidth) * info->nHeight * 3 / 2;
+  bool is_yv12 = info->nType == T_YV12 && yv12_size > 0 &&
+                 static_cast<size_t>(size) >= yv12_size;
+  bool publish = is_yv12 && publisher_.wants(frame.host_us);
+  if (is_yv12 && (publish || history_.keepPixels())) {
+    frame.yv12 =
+        frame_pool_.copy(reinterpret_cast<const unsigned char*>(buf), yv12_size);
+  }
+  history_.push(frame);
+  if (publish) {
+    publisher_.publish(frame);
+  }
+  if (frame_waiter_count_ > 0) {
+    fireFrameWaiters(&frame);
+  }
+  if (is_yv12) {
+    frame_bytes_ = yv12_size;
+  }
+  if (mem_account_ != 0 && (frames_ & 31) == 0) {
+    updateMemory();
+  }
+}
+
+// 异步登录回调（SDK 线程）：dwResult 为 1 表示成功
+void CALLBACK CamController::LoginResultCallBack(
+    LONG lUserID, DWORD dwResult, LPNET_DVR_DEVICEINFO_V30 /*lpDeviceInfo*/,
+    void* pUser) {
+  CamController* pThis = static_cast<CamController*>(pUser);
+  if (pThis == NULL) {
+    return;
+  }
+  const bool ok = dwResult == 1 && lUserID >= 0;
+  const DWORD error = ok ? 0 : NET_DVR_GetLastError();
+  LoginCallback cb;
+  {
+    std::lock_guard<std::mutex> lock(pThis->login_mutex_);
+    cb.swap(pThis->login_cb_);
+    if (ok) {
+      pThis->lUserID = lUserID;
+      pThis->owns_login_ = true;
+    }
+  }
+  if (!ok) {
+    printf("异步登录失败, error code: %d\n", error);
+  }
+  if (cb) {
+    cb(ok, error);
+  }
+}
+
 // sdk码流回调 - 改为静态成员函数
 void CALLBACK CamController::g_RealDataCallBack_V30(LONG lRealHandle,
                                                     DWORD dwDataType,
@@ -92,6 +184,8 @@ void CALLBACK CamController::g_RealDataCallBack_V30(LONG lRealHandle,
 
   CamController* pThis = static_cast<CamController*>(pUser);
   if (pThis) {
+    // 录制放在这里而不是 HandleRealData 中，避免回放时重复录制
+    pThis->recorder_.push(dwDataType, pBuffer, dwBufSize);
     pThis->HandleRealData(lRealHandle, dwDataType, pBuffer, dwBufSize);
   }
 }
@@ -103,59 +197,77 @@ void CamController::HandleRealData(LONG lRealHandle, DWORD dwDataType,
   BOOL inData = FALSE;
   LONG lPort = -1;
 
+  packets_++;
+  bytes_ += dwBufSize;
+
   // 静态 map：记录 lRealHandle → 码流编号（递增分配）
+  // 多个实例的码流回调在不同 SDK 线程上并发，需要加锁
+  static std::mutex handle_mutex;
   static std::map<LONG, int> handle_to_stream;
   static int stream_counter = 0;
-  if (handle_to_stream.find(lRealHandle) == handle_to_stream.end()) {
-    handle_to_stream[lRealHandle] = ++stream_counter;
+  int stream_id = 0;
+  {
+    std::lock_guard<std::mutex> lock(handle_mutex);
+    if (handle_to_stream.find(lRealHandle) == handle_to_stream.end()) {
+      handle_to_stream[lRealHandle] = ++stream_counter;
+    }
+    stream_id = handle_to_stream[lRealHandle];
   }
-  int stream_id = handle_to_stream[lRealHandle];
   const char* stream_tag = (stream_id == 1) ? "[第1码流-主码流]" :
                            (stream_id == 2) ? "[第2码流-第四码流]" : "[其他码流]";
 
   switch (dwDataType) {
     case NET_DVR_SYSHEAD:  // 系统头
       printf("%s [HandleRealData] NET_DVR_SYSHEAD dwBufSize=%d\n", stream_tag, dwBufSize);
+      sysheads_++;
+      // 断线重连后 SDK 会再次送系统头，先释放旧端口，否则每次重连泄漏一个
+      releasePort();
+      // 新的码流时间戳从头开始，时钟偏移重新估计
+      {
+        std::lock_guard<std::mutex> lock(clock_mutex_);
+        clock_.reset();
+      }
       if (!PlayM4_GetPort(&lPort)) {
         printf("%s 申请播放库资源失败\n", stream_tag);
         break;
       }
       printf("%s 播放库句柄：%d\n", stream_tag, lPort);
 
-      // 用 lRealHandle 作为索引存储端口，每个流独立
-      m_lPort[lRealHandle] = lPort;
+      // 每个实例只有一路码流，端口存在实例上，不再受句柄号范围限制
+      m_lPort = lPort;
 
       if (dwBufSize > 0) {
-        if (!PlayM4_SetStreamOpenMode(m_lPort[lRealHandle], STREAME_REALTIME)) {
+        if (!PlayM4_SetStreamOpenMode(m_lPort, STREAME_REALTIME)) {
           printf("%s PlayM4_SetStreamOpenMode Error, err=%d\n", stream_tag,
-                 PlayM4_GetLastError(m_lPort[lRealHandle]));
+                 PlayM4_GetLastError(m_lPort));
           break;
         } else {
           printf("%s PlayM4_SetStreamOpenMode Sus!\n", stream_tag);
         }
 
-        if (!PlayM4_OpenStream(m_lPort[lRealHandle], pBuffer, dwBufSize,
+        if (!PlayM4_OpenStream(m_lPort, pBuffer, dwBufSize,
                                5 * 1024 * 1024)) {
           printf("%s PlayM4_OpenStream Error, err=%d\n", stream_tag,
-                 PlayM4_GetLastError(m_lPort[lRealHandle]));
+                 PlayM4_GetLastError(m_lPort));
           break;
         } else {
           printf("%s PlayM4_OpenStream Sus!\n", stream_tag);
         }
 
-        if (!PlayM4_SetDecCallBackExMend(m_lPort[lRealHandle], DecCBFunIm,
-                                         reinterpret_cast<char*>(this), 0,
-                                         NULL)) {
+        // 用户指针是最后一个参数（pDest/nDestSize 是可选的输出缓冲区），
+        // 之前传在 pDest 上，回调里拿到的 nUser 一直是 NULL
+        if (!PlayM4_SetDecCallBackExMend(m_lPort, DecCBFunIm,
+                                         NULL, 0, this)) {
           printf("%s PlayM4_SetDecCallBackExMend Error, err=%d\n", stream_tag,
-                 PlayM4_GetLastError(m_lPort[lRealHandle]));
+                 PlayM4_GetLastError(m_lPort));
           break;
         } else {
           printf("%s PlayM4_SetDecodeEngine Sus!\n", stream_tag);
         }
 
-        if (!PlayM4_Play(m_lPort[lRealHandle], NULL)) {
+        if (!PlayM4_Play(m_lPort, NULL)) {
           printf("%s PlayM4_Play Error, err=%d\n", stream_tag,
-                 PlayM4_GetLastError(m_lPort[lRealHandle]));
+                 PlayM4_GetLastError(m_lPort));
           break;
         } else {
           printf("%s PlayM4_Play Sus!\n", stream_tag);
@@ -164,11 +276,12 @@ void CamController::HandleRealData(LONG lRealHandle, DWORD dwDataType,
       break;
 
     case NET_DVR_STREAMDATA:  // 码流数据
-      if (dwBufSize > 0 && m_lPort[lRealHandle] != -1) {
-        while (!PlayM4_InputData(m_lPort[lRealHandle], pBuffer, dwBufSize)) {
-          int dwError = PlayM4_GetLastError(m_lPort[lRealHandle]);
+      last_packet_us_ = StreamRecorder::nowMicros();
+      if (dwBufSize > 0 && m_lPort != -1) {
+        while (!PlayM4_InputData(m_lPort, pBuffer, dwBufSize)) {
+          int dwError = PlayM4_GetLastError(m_lPort);
           printf("%s PlayM4_InputData 播放库句柄ID=%d,错误码=%d\n",
-                 stream_tag, m_lPort[lRealHandle], dwError);
+                 stream_tag, m_lPort, dwError);
           if (dwError == 11) {
             continue;
           }
@@ -178,8 +291,8 @@ void CamController::HandleRealData(LONG lRealHandle, DWORD dwDataType,
       break;
 
     default:  // 其他数据
-      if (dwBufSize > 0 && m_lPort[lRealHandle] != -1) {
-        if (!PlayM4_InputData(m_lPort[lRealHandle], pBuffer, dwBufSize)) {
+      if (dwBufSize > 0 && m_lPort != -1) {
+        if (!PlayM4_InputData(m_lPort, pBuffer, dwBufSize)) {
           break;
         }
       }
@@ -201,41 +314,58 @@ void CamController::getPic() {
     printf("错误: task_id_, bin_code_ 或 camera_type_ 未设置!\n");
     return;
   }
+  if (capture_token_.cancelled()) {
+    printf("抓图已取消（储位时间预算耗尽）\n");
+    return;
+  }
+
+  // 设置了 ROI 时从解码帧按 ROI 编码，不走播放库整幅 JPEG
+  bool use_roi = false;
+  {
+    std::lock_guard<std::mutex> lock(roi_mutex_);
+    use_roi = !rois_.empty();
+  }
+  if (use_roi) {
+    if (captureRoiFrame(StreamRecorder::nowMicros())) {
+      captures_++;
+      triggerRecording("capture");
+    } else {
+      capture_failures_++;
+      triggerRecording("error");
+    }
+    return;
+  }
 
   // 构建基础路径
-  std::string basePath =
-      "capture_img/" + task_id_ + "/" + bin_code_ + "/" + camera_type_;
+  std::string basePath = captureDir();
 
   // 创建目录（如果不存在）
   createDirectory(basePath);
 
-  // 根据 stream_type_ 确定文件名
-  std::string fileName;
-  if (stream_type_ == 0) {
-    fileName = "main.jpg";
-  } else if (stream_type_ == 3) {
-    fileName = "depth.jpg";
-  } else {
-    printf("未知的 stream_type_: %d，使用默认文件名\n", stream_type_);
-    fileName = "default.jpg";
-  }
+  std::string fileName = captureFileName();
 
   // 抓10张图（可以根据需要调整次数）
-  while (i++ < 1) {
+  const int kShots = 1;
+  while (i++ < kShots) {
     // 获取当前视频文件的分辨率（带重试，最多等10秒）
     int retry = 0;
     bFlag = FALSE;
     while (retry < 10 && !bFlag) {
-      bFlag = PlayM4_GetPictureSize(m_lPort[lRealPlayHandle], &dwWidth, &dwHeight);
+      bFlag = PlayM4_GetPictureSize(m_lPort, &dwWidth, &dwHeight);
       if (bFlag == FALSE) {
-        dwErr = PlayM4_GetLastError(m_lPort[lRealPlayHandle]);
+        dwErr = PlayM4_GetLastError(m_lPort);
         printf("PlayM4_GetPictureSize error %d，重试 %d/10\n", dwErr, retry + 1);
-        sleep(1);
+        if (!capture_token_.sleepFor(1000)) {
+          printf("获取分辨率被取消（储位时间预算耗尽）\n");
+          break;
+        }
       }
       retry++;
     }
     if (bFlag == FALSE) {
       printf("PlayM4_GetPictureSize 最终失败，error code: %d\n", dwErr);
+      capture_failures_++;
+      triggerRecording("error");
       break;
     }
     printf("获取分辨率成功: %dx%d\n", dwWidth, dwHeight);
@@ -254,12 +384,15 @@ void CamController::getPic() {
     retry = 0;
     bFlag = FALSE;
     while (retry < 10 && !bFlag) {
-      bFlag = PlayM4_GetJPEG(m_lPort[lRealPlayHandle], m_pCapBuf, dwSize, &dwCapSize);
+      bFlag = PlayM4_GetJPEG(m_lPort, m_pCapBuf, dwSize, &dwCapSize);
       if (bFlag == FALSE) {
-        dwErr = PlayM4_GetLastError(m_lPort[lRealPlayHandle]);
+        dwErr = PlayM4_GetLastError(m_lPort);
         if (dwErr == 32) {  // PLAY_NO_VIDEO_FRAME
           printf("PlayM4_GetJPEG error 32（暂无帧），重试 %d/10\n", retry + 1);
-          sleep(1);
+          if (!capture_token_.sleepFor(1000)) {
+            printf("抓图被取消（储位时间预算耗尽）\n");
+            break;
+          }
         } else {
           printf("PlayM4_GetJPEG, error code: %d\n", dwErr);
           break;
@@ -269,32 +402,62 @@ void CamController::getPic() {
     }
     if (bFlag == FALSE) {
       printf("PlayM4_GetJPEG 最终失败\n");
+      capture_failures_++;
       delete[] m_pCapBuf;
+      triggerRecording("error");
       break;
     }
 
     if (bFlag) {
+      captures_++;
+      // 播放库 JPEG 取的是当前显示帧，用帧历史里最新的一帧算哈希
+      TimedFrame latest;
+      if (capture_hash_ && history_.latest(&latest) && latest.yv12) {
+        writeCaptureHash(latest);
+      }
       // 构建完整文件路径
       std::string filePath = basePath + "/" + fileName;
 
-      FILE* fp = fopen(filePath.c_str(), "wb");
-      if (fp) {
-        fwrite(m_pCapBuf, sizeof(char), dwCapSize, fp);
-        fclose(fp);
-        printf("抓图保存到: %s (大小=%d)\n", filePath.c_str(), dwCapSize);
-      } else {
-        printf("无法打开文件: %s\n", filePath.c_str());
-      }
+      // 提交异步写入后立即返回，写完（tmp 文件 rename 完成）才会出现 *.jpg
+      DWORD capSize = dwCapSize;
+      AsyncFileWriter::instance().write(
+          filePath, m_pCapBuf, dwCapSize,
+          [capSize](const std::string& path, bool ok) {
+            if (ok) {
+              printf("抓图保存到: %s (大小=%d)\n", path.c_str(), capSize);
+            } else {
+              printf("无法写入文件: %s\n", path.c_str());
+            }
+          });
     }
 
     if (m_pCapBuf != NULL) {
       delete[] m_pCapBuf;
       m_pCapBuf = NULL;
     }
+    triggerRecording("capture");
     printf("完成第%d张抓图\n", i);
-    // 等待1秒后进入下一次抓图
-    sleep(1);
+    // 等待1秒后进入下一次抓图（最后一张不再等待，getCapture 会 join 本线程）
+    if (i < kShots && !capture_token_.sleepFor(1000)) {
+      break;
+    }
+  }
+}
+
+// 辅助函数：当前任务的抓图目录
+std::string CamController::captureDir() const {
+  return "capture_img/" + task_id_ + "/" + bin_code_ + "/" + camera_type_;
+}
+
+// 辅助函数：根据 stream_type_ 确定文件名
+std::string CamController::captureFileName() const {
+  if (stream_type_ == 0) {
+    return "main.jpg";
+  } else if (stream_type_ == 3) {
+    return "depth.jpg";
   }
+  printf("未知的 stream_type_: %d，使用默认文件名\n", stream_type_);
+  return "default.jpg";
 }
 
 // 辅助函数：创建目录
@@ -308,7 +471,49 @@ void CamController::createDirectory(const std::string& path) {
   }
 }
 
-CamController::CamController() {
+CamController::CamController()
+    : stream_type_(0),
+      lUserID(-1),
+      lRealPlayHandle(-1),
+      m_lPort(-1),
+      owns_login_(true),
+      channel_(0),
+      packets_(0),
+      bytes_(0),
+      frames_(0),
+      sysheads_(0),
+      captures_(0),
+      capture_failures_(0),
+      capture_wait_ms_(3000),
+      replay_running_(false),
+      last_packet_us_(0),
+      capture_hash_(false),
+      last_hash_(0),
+      frame_waiter_count_(0),
+      next_wait_id_(0),
+      mem_account_(0),
+      frame_bytes_(0),
+      history_depth_(0),
+      record_bytes_(0) {
+  acquireSdk();
+}
+
+CamController::~CamController() {
+  // 先摘掉内存账目，收缩回调不会再碰到正在析构的成员
+  if (mem_account_ != 0) {
+    MemoryGovernor::instance().detach(mem_account_);
+  }
+  stopReplay();
+  // 未显式 logout 时在这里关预览、登出；已登出则不再等待落盘
+  logout(lUserID >= 0 || lRealPlayHandle >= 0);
+  releaseSdk();
+}
+
+void CamController::acquireSdk() {
+  std::lock_guard<std::mutex> lock(sdk_mutex_);
+  if (sdk_refs_++ > 0) {
+    return;
+  }
   // 初始化
   NET_DVR_Init();
   char ansiStringss[] = "./sdkLog";
@@ -318,41 +523,52 @@ CamController::CamController() {
   NET_DVR_SetReconnect(10000, true);
 }
 
-CamController::~CamController() {
-  if (lRealPlayHandle >= 0) {
-    // 关闭预览
-    NET_DVR_StopRealPlay(lRealPlayHandle);
-    // 释放播放库资源
-    PlayM4_Stop(m_lPort[lRealPlayHandle]);
-    // 关闭流
-    PlayM4_CloseStream(m_lPort[lRealPlayHandle]);
-    // 释放播放端口
-    PlayM4_FreePort(m_lPort[lRealPlayHandle]);
+void CamController::releaseSdk() {
+  std::lock_guard<std::mutex> lock(sdk_mutex_);
+  if (--sdk_refs_ == 0) {
+    // 最后一个实例析构时才释放sdk资源，其他实例的登录和预览不受影响
+    NET_DVR_Cleanup();
   }
+}
 
-  if (lUserID >= 0) {
-    // 退出登录
-    NET_DVR_Logout(lUserID);
-    // 释放sdk资源
-    NET_DVR_Cleanup();
+// 释放本实例的播放库端口；端口号清回 -1，重复调用是安全的
+void CamController::releasePort() {
+  if (m_lPort < 0) {
+    return;
   }
+  // 释放播放库资源
+  PlayM4_Stop(m_lPort);
+  // 关闭流
+  PlayM4_CloseStream(m_lPort);
+  // 释放播放端口
+  PlayM4_FreePort(m_lPort);
+  m_lPort = -1;
 }
 
 bool CamController::login(const std::string& deviceAddress, unsigned short port,
                           const std::string& userName,
                           const std::string& password) {
+  if (cancel_token_.cancelled()) {
+    printf("登录已取消（储位时间预算耗尽）\n");
+    return false;
+  }
+
+  // 重复登录时先登出旧会话，避免泄漏 lUserID
+  if (lUserID >= 0) {
+    logout();
+  }
+
   // 登录参数，包括设备地址、登录用户、密码等
   NET_DVR_USER_LOGIN_INFO struLoginInfo = {0};
   struLoginInfo.bUseAsynLogin = 0;  // 同步登录方式
-  memcpy(struLoginInfo.sDeviceAddress, deviceAddress.c_str(),
-         NAME_LEN);            // 设备IP地址
+  copyField(struLoginInfo.sDeviceAddress, deviceAddress);  // 设备IP地址
   struLoginInfo.wPort = port;  // 设备服务端口
   // struLoginInfo.sUserName = ini.readstring(sSection, "username", "error",
   // dwSize); //设备登录用户名
-  memcpy(struLoginInfo.sUserName, userName.c_str(), NAME_LEN);
+  copyField(struLoginInfo.sUserName, userName);
   // struLoginInfo.sPassword = ini.readstring(sSection, "password", "error",
   // dwSize); //设备登录密码
-  memcpy(struLoginInfo.sPassword, password.c_str(), NAME_LEN);
+  copyField(struLoginInfo.sPassword, password);
 
   // 设备信息, 输出参数
   NET_DVR_DEVICEINFO_V40 struDeviceInfoV40 = {0};
@@ -360,38 +576,125 @@ bool CamController::login(const std::string& deviceAddress, unsigned short port,
   lUserID = NET_DVR_Login_V40(&struLoginInfo, &struDeviceInfoV40);
   if (lUserID < 0) {
     printf("Login failed, error code: %d\n", NET_DVR_GetLastError());
-    NET_DVR_Cleanup();
     return false;
   }
+  owns_login_ = true;
 
   return true;
 }
 
-bool CamController::logout() {
-  if (lRealPlayHandle >= 0) {
-    // 关闭预览
-    NET_DVR_StopRealPlay(lRealPlayHandle);
-    // 释放播放库资源
-    PlayM4_Stop(m_lPort[lRealPlayHandle]);
-    // 关闭流
-    PlayM4_CloseStream(m_lPort[lRealPlayHandle]);
-    // 释放播放端口
-    PlayM4_FreePort(m_lPort[lRealPlayHandle]);
+bool CamController::loginAsync(const std::string& deviceAddress,
+                               unsigned short port,
+                               const std::string& userName,
+                               const std::string& password,
+                               const LoginCallback& done) {
+  if (cancel_token_.cancelled()) {
+    printf("登录已取消（储位时间预算耗尽）\n");
+    return false;
+  }
+  if (lUserID >= 0) {
+    logout(false);
+  }
+  {
+    std::lock_guard<std::mutex> lock(login_mutex_);
+    if (login_cb_) {
+      printf("上一次异步登录尚未返回\n");
+      return false;
+    }
+    login_cb_ = done;
   }
 
-  // 退出登录
-  NET_DVR_Logout(lUserID);
-  // 释放sdk资源
-  NET_DVR_Cleanup();
+  NET_DVR_USER_LOGIN_INFO struLoginInfo = {0};
+  struLoginInfo.bUseAsynLogin = 1;  // 异步登录，结果经 cbLoginResult 返回
+  struLoginInfo.cbLoginResult = LoginResultCallBack;
+  struLoginInfo.pUser = this;
+  copyField(struLoginInfo.sDeviceAddress, deviceAddress);
+  struLoginInfo.wPort = port;
+  copyField(struLoginInfo.sUserName, userName);
+  copyField(struLoginInfo.sPassword, password);
 
+  NET_DVR_DEVICEINFO_V40 struDeviceInfoV40 = {0};
+  if (NET_DVR_Login_V40(&struLoginInfo, &struDeviceInfoV40) < 0) {
+    printf("异步登录请求失败, error code: %d\n", NET_DVR_GetLastError());
+    std::lock_guard<std::mutex> lock(login_mutex_);
+    login_cb_ = LoginCallback();
+    return false;
+  }
   return true;
 }
 
+bool CamController::logout(bool flush_writes) {
+  if (lRealPlayHandle >= 0) {
+    stopRealPlay();
+  }
+  joinCapture(true);
+  // 阻塞在 next 上的订阅者立即返回
+  publisher_.closeAll();
+  fireFrameWaiters(NULL);
+
+  // 脚本在 logout 后即退出进程，先等待尚未落盘的抓图写完
+  if (flush_writes) {
+    AsyncFileWriter::instance().flush();
+  }
+
+  if (lUserID < 0) {
+    return false;
+  }
+  if (!owns_login_) {
+    // 登录属于 DeviceSession，只解除挂接
+    lUserID = -1;
+    return true;
+  }
+  // 退出登录；NET_DVR_Cleanup 由最后一个实例析构时调用
+  BOOL ok = NET_DVR_Logout(lUserID);
+  lUserID = -1;
+  return ok == TRUE;
+}
+
 bool CamController::startRealPlay(unsigned short channel,
                                   unsigned short stream_type,
                                   unsigned short linkMode,
                                   unsigned short blocked) {
+  if (!openRealPlay(channel, stream_type, linkMode, blocked)) {
+    return false;
+  }
+  // 等待播放库有数据，否则后面无法使用播放库抓图
+  // 循环检测直到有视频帧（最多等待30秒，每秒检测一次）
+  printf("等待解码器初始化...\n");
+  int wait_count = 0;
+  while (wait_count < 30) {
+    LONG testWidth = 0, testHeight = 0;
+    // 只检查本实例这一路的端口，其他实例的码流就绪不代表这一路就绪
+    LONG port = m_lPort;
+    if (port >= 0 && PlayM4_GetPictureSize(port, &testWidth, &testHeight)) {
+      printf("解码器就绪，端口=%d，分辨率=%dx%d\n", port, testWidth, testHeight);
+      return true;
+    }
+    if (!cancel_token_.sleepFor(1000)) {
+      printf("等待解码器被取消（储位时间预算耗尽）\n");
+      return false;
+    }
+    wait_count++;
+    printf("等待解码器... %d/30\n", wait_count);
+  }
+  printf("警告: 解码器30秒内未能就绪，继续尝试抓图\n");
+  return true;
+}
+
+bool CamController::openRealPlay(unsigned short channel,
+                                 unsigned short stream_type,
+                                 unsigned short linkMode,
+                                 unsigned short blocked) {
+  if (cancel_token_.cancelled()) {
+    printf("预览已取消（储位时间预算耗尽）\n");
+    return false;
+  }
+  // 切换码流前先关掉上一路预览，否则句柄和播放库端口都会泄漏
+  if (lRealPlayHandle >= 0) {
+    stopRealPlay();
+  }
   stream_type_ = stream_type;
+  channel_ = channel;
   NET_DVR_PREVIEWINFO struPlayInfo = {0};
   struPlayInfo.hPlayWnd =
       NULL;  // 需要SDK解码时句柄设为有效值，仅取流不解码时可设为空
@@ -409,56 +712,88 @@ bool CamController::startRealPlay(unsigned short channel,
 
   if (lRealPlayHandle < 0) {
     printf("NET_DVR_RealPlay_V40 error %d\n", NET_DVR_GetLastError());
-    NET_DVR_Logout(lUserID);
-    NET_DVR_Cleanup();
-    return false;
-  }
-  // 等待播放库有数据，否则后面无法使用播放库抓图
-  // 循环检测直到有视频帧（最多等待30秒，每秒检测一次）
-  printf("等待解码器初始化...\n");
-  int wait_count = 0;
-  while (wait_count < 30) {
-    LONG testWidth = 0, testHeight = 0;
-    // 找一个有效的端口
-    for (int idx = 0; idx < 16; idx++) {
-      if (m_lPort[idx] >= 0) {
-        if (PlayM4_GetPictureSize(m_lPort[idx], &testWidth, &testHeight)) {
-          printf("解码器就绪，端口=%d，分辨率=%dx%d\n", idx, testWidth, testHeight);
-          return true;
-        }
-      }
+    // 共用的设备登录不能因为一路开流失败就登出
+    if (owns_login_) {
+      NET_DVR_Logout(lUserID);
+      lUserID = -1;
     }
-    sleep(1);
-    wait_count++;
-    printf("等待解码器... %d/30\n", wait_count);
+    return false;
   }
-  printf("警告: 解码器30秒内未能就绪，继续尝试抓图\n");
-  return true;
-
   return true;
 }
 
 bool CamController::stopRealPlay() {
+  // 抓图线程还在用播放库端口，先让它退出
+  joinCapture(true);
+  if (lRealPlayHandle < 0) {
+    return false;
+  }
+  if (lRealPlayHandle == kReplayHandle && replay_thread_.joinable()) {
+    stopReplay();
+    return true;
+  }
+  // 先停止码流回调，再释放回调里使用的播放库端口
   NET_DVR_StopRealPlay(lRealPlayHandle);
-  // 释放播放库资源
-  PlayM4_Stop(m_lPort[lRealPlayHandle]);
-  // 关闭流
-  PlayM4_CloseStream(m_lPort[lRealPlayHandle]);
-  // 释放播放端口
-  PlayM4_FreePort(m_lPort[lRealPlayHandle]);
+  releasePort();
+  lRealPlayHandle = -1;
+  // 下一路码流的帧不能和这一路的旧帧混在一起配组
+  history_.clear();
+  last_packet_us_ = 0;
+  fireFrameWaiters(NULL);
 
   return true;
 }
 
 void CamController::getCapture() {
-  // 创建并启动抓图线程
-  std::thread t1(&CamController::getPic, this);
+  joinCapture(false);
+
+  // 创建并启动抓图线程；线程内的重试受 capture_token_ 约束，不会无限挂起
+  capture_token_ = cancel_token_.child(kCaptureTimeoutMs);
+  capture_thread_ = std::thread(&CamController::getPic, this);
+
+  // 等待继续预览秒（截止时间先到则提前返回）
+  cancel_token_.sleepFor(capture_wait_ms_);
+
+  // 不再分离线程：等抓图结束再返回，之后的 stopRealPlay 才能安全释放端口
+  joinCapture(false);
+}
+
+void CamController::joinCapture(bool cancel) {
+  if (!capture_thread_.joinable()) {
+    return;
+  }
+  if (cancel) {
+    capture_token_.cancel();
+  }
+  capture_thread_.join();
+}
 
-  // 播放库抓图分离线程
-  t1.detach();
+void CamController::attach(LONG user_id) {
+  if (lUserID >= 0) {
+    logout();
+  }
+  lUserID = user_id;
+  owns_login_ = false;
+}
+
+StreamStats CamController::stats() {
+  StreamStats st;
+  st.channel = channel_;
+  st.stream_type = stream_type_;
+  st.streaming = lRealPlayHandle >= 0;
+  st.packets = packets_;
+  st.bytes = bytes_;
+  st.frames = frames_;
+  st.sysheads = sysheads_;
+  st.captures = captures_;
+  st.capture_failures = capture_failures_;
+  TimedFrame last;
+  st.last_frame_us = history_.latest(&last) ? last.arrival_us : 0;
+  return st;
+}
 
-  // 等待继续预览秒
-  sleep(3);
+void CamController::setCancelToken(const CancelToken& token) {
+  cancel_token_ = token;
 }
 
 void CamController::setCameraType(std::string camera_type) {
@@ -469,3 +804,472 @@ void CamController::setTaskInfo(std::string task_id, std::string bin_code) {
   task_id_ = task_id;
   bin_code_ = bin_code;
 }
+
+void CamController::enableRecording(double seconds, unsigned int capacity_mb) {
+  recorder_.configure(seconds, static_cast<size_t>(capacity_mb) << 20);
+  record_bytes_ = static_cast<size_t>(capacity_mb) << 20;
+  attachMemory();
+  printf("码流录制已开启: 最近 %.1f 秒, 缓冲 %u MB\n", seconds, capacity_mb);
+}
+
+void CamController::disableRecording() {
+  recorder_.disable();
+  record_bytes_ = 0;
+  if (mem_account_ != 0) {
+    updateMemory();
+  }
+}
+
+void CamController::attachMemory() {
+  std::lock_guard<std::mutex> lock(mem_mutex_);
+  if (mem_account_ == 0) {
+    // 录制环和同步用的帧历史是排障、对齐的辅助，缓存里优先让出
+    mem_account_ = MemoryGovernor::instance().attach(
+        "camera/" + (camera_type_.empty() ? std::string("?") : camera_type_),
+        0, 10, [this](int level, int64_t) { return shrinkMemory(level); });
+  }
+  updateMemory();
+}
+
+void CamController::updateMemory() {
+  MemoryGovernor& governor = MemoryGovernor::instance();
+  governor.setBudget(mem_account_,
+                     static_cast<int64_t>(history_depth_ * frame_bytes_ +
+                                          record_bytes_));
+  governor.set(mem_account_,
+               static_cast<int64_t>(history_.pixelBytes() +
+                                    recorder_.capacityBytes()));
+}
+
+// soft：帧历史减半；hard：帧历史降到最少，录制环减半。
+// 压力过去后不自动恢复，下一次 enableFrameHistory/enableRecording 时按原配置重建
+int64_t CamController::shrinkMemory(int level) {
+  int64_t freed = 0;
+  const size_t depth = history_.depth();
+  if (history_.keepPixels() && depth > kMinHistoryDepth) {
+    const size_t target =
+        level >= kMemHard ? kMinHistoryDepth
+                          : std::max(kMinHistoryDepth, depth / 2);
+    freed += history_.shrink(target);
+    printf("[%s] 内存压力: 帧历史 %zu -> %zu 帧\n", camera_type_.c_str(),
+           depth, target);
+  }
+  const size_t capacity = recorder_.capacityBytes();
+  if (level >= kMemHard && capacity > kMinRecordBytes) {
+    const size_t target = std::max(kMinRecordBytes, capacity / 2);
+    recorder_.configure(recorder_.windowSec(), target);
+    freed += static_cast<int64_t>(capacity - target);
+    printf("[%s] 内存压力: 录制环 %zu MB -> %zu MB\n", camera_type_.c_str(),
+           capacity >> 20, target >> 20);
+  }
+  updateMemory();
+  return freed;
+}
+
+std::string CamController::triggerRecording(const std::string& reason) {
+  if (!recorder_.enabled()) {
+    return "";
+  }
+  std::vector<char> content;
+  if (!recorder_.snapshot(&content)) {
+    printf("码流录制环为空，跳过落盘\n");
+    return "";
+  }
+
+  std::string dir = (task_id_.empty() || bin_code_.empty())
+                        ? std::string("capture_img/recordings")
+                        : captureDir();
+  createDirectory(dir);
+  std::string path = dir + "/stream_" + std::to_string(stream_type_) + "_" +
+                     reason + ".psr";
+  size_t bytes = content.size();
+  AsyncFileWriter::instance().write(path, std::move(content));
+  printf("码流录制落盘: %s (大小=%zu)\n", path.c_str(), bytes);
+  return path;
+}
+
+bool CamController::startReplay(const std::string& path, bool realtime) {
+  if (replay_running_) {
+    printf("回放已在进行中\n");
+    return false;
+  }
+  // 上一次回放已自然结束：回收线程和端口
+  stopReplay();
+  if (lRealPlayHandle >= 0) {
+    // 直接覆盖句柄会泄漏实时预览的 NET_DVR 句柄和播放库端口
+    printf("实时预览进行中，先 stopRealPlay 再回放\n");
+    return false;
+  }
+  std::vector<RecordedPacket> packets;
+  if (!StreamRecorder::load(path, &packets)) {
+    return false;
+  }
+  printf("开始回放: %s, 共 %zu 个包\n", path.c_str(), packets.size());
+
+  // 回放占用独立的端口下标，getPic 通过 lRealPlayHandle 找到它
+  lRealPlayHandle = kReplayHandle;
+  replay_running_ = true;
+  replay_thread_ =
+      std::thread(&CamController::replayLoop, this, packets, realtime);
+  return true;
+}
+
+void CamController::replayLoop(std::vector<RecordedPacket> packets,
+                               bool realtime) {
+  const int64_t start_us = StreamRecorder::nowMicros();
+  for (size_t i = 0; i < packets.size() && replay_running_; i++) {
+    RecordedPacket& pkt = packets[i];
+    if (realtime) {
+      // 分段睡眠，便于 stopReplay 及时生效
+      int64_t wait_us = start_us + static_cast<int64_t>(pkt.ts_us) -
+                        StreamRecorder::nowMicros();
+      while (wait_us > 0 && replay_running_) {
+        usleep(static_cast<useconds_t>(wait_us > 100000 ? 100000 : wait_us));
+        wait_us = start_us + static_cast<int64_t>(pkt.ts_us) -
+                  StreamRecorder::nowMicros();
+      }
+    }
+    if (pkt.data.empty()) {
+      continue;
+    }
+    HandleRealData(kReplayHandle, pkt.data_type, &pkt.data[0],
+                   static_cast<DWORD>(pkt.data.size()));
+  }
+  // 文件放完也清标志，下一次 startReplay 不必先 stopReplay
+  replay_running_ = false;
+  printf("回放结束\n");
+}
+
+void CamController::stopReplay() {
+  if (!replay_thread_.joinable()) {
+    return;
+  }
+  replay_running_ = false;
+  replay_thread_.join();
+
+  releasePort();
+  if (lRealPlayHandle == kReplayHandle) {
+    lRealPlayHandle = -1;
+  }
+  history_.clear();
+  last_packet_us_ = 0;
+}
+
+std::shared_ptr<FrameSubscription> CamController::subscribe(
+    const SubscriberOptions& options) {
+  return publisher_.subscribe(options);
+}
+
+size_t CamController::subscribers() { return publisher_.subscribers(); }
+
+void CamController::enableFrameHistory(int depth) {
+  history_.configure(depth > 0 ? static_cast<size_t>(depth) : 1, true);
+  history_depth_ = depth > 0 ? static_cast<size_t>(depth) : 1;
+  attachMemory();
+  printf("帧历史已开启: 缓存最近 %d 帧像素\n", depth);
+}
+
+std::vector<TimedFrame> CamController::frameHistory() {
+  return history_.snapshot();
+}
+
+bool CamController::latestFrame(TimedFrame* frame) {
+  return history_.latest(frame);
+}
+
+bool CamController::clockOffset(double* offset_ms, double* jitter_ms) {
+  std::lock_guard<std::mutex> lock(clock_mutex_);
+  if (!clock_.valid()) {
+    return false;
+  }
+  *offset_ms = clock_.offsetUs() / 1000.0;
+  *jitter_ms = clock_.jitterUs() / 1000.0;
+  return true;
+}
+
+std::string CamController::saveFrame(const TimedFrame& frame) {
+  return saveFrame(frame, AsyncFileWriter::Callback());
+}
+
+std::string CamController::saveFrame(const TimedFrame& frame,
+                                     const AsyncFileWriter::Callback& done) {
+  if (!frame.yv12 || frame.width <= 0 || frame.height <= 0) {
+    printf("帧没有缓存像素（未开启 enableFrameHistory？），无法保存\n");
+    return "";
+  }
+  if (task_id_.empty() || bin_code_.empty() || camera_type_.empty()) {
+    printf("错误: task_id_, bin_code_ 或 camera_type_ 未设置!\n");
+    return "";
+  }
+  std::string path = writeFrameJpeg(frame, "同步抓图", done);
+  if (!path.empty() && capture_hash_) {
+    writeCaptureHash(frame);
+  }
+  return path;
+}
+
+long CamController::waitFrame(int64_t since_us, bool need_pixels,
+                              const FrameCallback& cb) {
+  FrameWaiter waiter;
+  waiter.since_us = since_us;
+  waiter.need_pixels = need_pixels;
+  waiter.cb = cb;
+  {
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    waiter.id = ++next_wait_id_;
+    frame_waiters_.push_back(waiter);
+    frame_waiter_count_++;
+  }
+  // 先登记再查历史：登记之后到达的帧由解码回调负责，不会漏掉
+  TimedFrame latest;
+  if (history_.latest(&latest) && latest.arrival_us >= since_us &&
+      (!need_pixels || latest.yv12)) {
+    if (cancelFrameWait(waiter.id)) {
+      cb(true, latest);
+    }
+  }
+  return waiter.id;
+}
+
+bool CamController::cancelFrameWait(long id) {
+  std::lock_guard<std::mutex> lock(wait_mutex_);
+  for (size_t i = 0; i < frame_waiters_.size(); i++) {
+    if (frame_waiters_[i].id == id) {
+      frame_waiters_.erase(frame_waiters_.begin() + i);
+      frame_waiter_count_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+// frame 为空表示码流关闭：所有等待者以 ok=false 回调
+void CamController::fireFrameWaiters(const TimedFrame* frame) {
+  std::vector<FrameWaiter> fired;
+  {
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    std::vector<FrameWaiter>::iterator it = frame_waiters_.begin();
+    while (it != frame_waiters_.end()) {
+      if (frame == NULL || (frame->arrival_us >= it->since_us &&
+                            (!it->need_pixels || frame->yv12))) {
+        fired.push_back(*it);
+        it = frame_waiters_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    frame_waiter_count_ = static_cast<int>(frame_waiters_.size());
+  }
+  const TimedFrame none = TimedFrame();
+  for (size_t i = 0; i < fired.size(); i++) {
+    fired[i].cb(frame != NULL, frame != NULL ? *frame : none);
+  }
+}
+
+void CamController::setCaptureRois(const std::vector<PixelRect>& rois,
+                                   const RoiCaptureOptions& options) {
+  if (rois.empty()) {
+    clearCaptureRois();
+    return;
+  }
+  // 已由 CaptureGroup 开启更深的历史时不要缩小
+  if (!history_.keepPixels()) {
+    enableFrameHistory(2);
+  }
+  std::lock_guard<std::mutex> lock(roi_mutex_);
+  rois_ = rois;
+  roi_options_ = options;
+}
+
+void CamController::clearCaptureRois() {
+  std::lock_guard<std::mutex> lock(roi_mutex_);
+  rois_.clear();
+}
+
+// 等一帧 since_us 之后到达的解码帧（getPic 调用之后的画面，与 PlayM4_GetJPEG 取当前帧一致）
+bool CamController::captureRoiFrame(int64_t since_us) {
+  const int kPollMs = 100;
+  const int kMaxPolls = 100;  // 最多等 10 秒，与播放库抓图的重试上限相同
+  for (int retry = 0; retry < kMaxPolls; retry++) {
+    TimedFrame frame;
+    if (history_.latest(&frame) && frame.yv12 && frame.arrival_us >= since_us) {
+      if (writeFrameJpeg(frame, "ROI 抓图").empty()) {
+        return false;
+      }
+      if (capture_hash_) {
+        writeCaptureHash(frame);
+      }
+      return true;
+    }
+    if (!capture_token_.sleepFor(kPollMs)) {
+      printf("ROI 抓图被取消（储位时间预算耗尽）\n");
+      return false;
+    }
+  }
+  printf("ROI 抓图失败: 10 秒内没有新的 YV12 解码帧\n");
+  return false;
+}
+
+void CamController::enableCaptureHash(bool enable) {
+  if (enable && !history_.keepPixels()) {
+    enableFrameHistory(2);
+  }
+  capture_hash_ = enable;
+}
+
+void CamController::writeCaptureHash(const TimedFrame& frame) {
+  // 有 ROI 时只看垛位区域，区域外的人员走动、叉车不算变化
+  PixelRect rect;
+  rect.x = 0;
+  rect.y = 0;
+  rect.width = frame.width;
+  rect.height = frame.height;
+  {
+    std::lock_guard<std::mutex> lock(roi_mutex_);
+    if (!rois_.empty()) {
+      int x0 = rois_[0].x;
+      int y0 = rois_[0].y;
+      int x1 = rois_[0].x + rois_[0].width;
+      int y1 = rois_[0].y + rois_[0].height;
+      for (size_t i = 1; i < rois_.size(); i++) {
+        x0 = std::min(x0, rois_[i].x);
+        y0 = std::min(y0, rois_[i].y);
+        x1 = std::max(x1, rois_[i].x + rois_[i].width);
+        y1 = std::max(y1, rois_[i].y + rois_[i].height);
+      }
+      rect.x = x0;
+      rect.y = y0;
+      rect.width = x1 - x0;
+      rect.height = y1 - y0;
+    }
+  }
+  const uint64_t hash =
+      FrameKernels::phash(&(*frame.yv12)[0], frame.width, frame.height, &rect);
+  last_hash_ = hash;
+  if (hash == 0) {
+    // 没有哈希时不写 main.phash，复盘时该储位照常识别
+    printf("[%s] 画面区域过小或没有纹理，不写感知哈希\n", camera_type_.c_str());
+    return;
+  }
+
+  char json[256];
+  int n = snprintf(json, sizeof(json),
+                   "{\"phash\": \"%016llx\", \"roi\": [%d, %d, %d, %d], "
+                   "\"width\": %d, \"height\": %d}\n",
+                   static_cast<unsigned long long>(hash), rect.x, rect.y,
+                   rect.width, rect.height, frame.width, frame.height);
+  const std::string name = captureFileName();
+  const std::string path =
+      captureDir() + "/" + name.substr(0, name.rfind('.')) + ".phash";
+  AsyncFileWriter::instance().write(path, json, static_cast<size_t>(n));
+}
+
+std::string CamController::writeFrameJpeg(
+    const TimedFrame& frame, const char* log_tag,
+    const AsyncFileWriter::Callback& done) {
+  std::vector<PixelRect> rois;
+  RoiCaptureOptions opt;
+  {
+    std::lock_guard<std::mutex> lock(roi_mutex_);
+    rois = rois_;
+    opt = roi_options_;
+  }
+  for (size_t i = 0; i < rois.size(); i++) {
+    rois[i].x -= opt.margin;
+    rois[i].y -= opt.margin;
+    rois[i].width += 2 * opt.margin;
+    rois[i].height += 2 * opt.margin;
+  }
+
+  const int w = frame.width;
+  const int h = frame.height;
+  const unsigned char* yv12 = &(*frame.yv12)[0];
+  std::string dir = captureDir();
+  createDirectory(dir);
+  const std::string name = captureFileName();
+  const std::string stem = name.substr(0, name.rfind('.'));
+  const std::string path = dir + "/" + name;
+  std::string tag = log_tag;
+  AsyncFileWriter::Callback log_write = [tag](const std::string& p, bool ok) {
+    if (ok) {
+      printf("%s保存到: %s\n", tag.c_str(), p.c_str());
+    } else {
+      printf("无法写入文件: %s\n", p.c_str());
+    }
+  };
+  // 主文件另外通知调用方；写入器已关闭（write 返回 false）时也要回调
+  AsyncFileWriter::Callback main_write = log_write;
+  if (done) {
+    main_write = [log_write, done](const std::string& p, bool ok) {
+      log_write(p, ok);
+      done(p, ok);
+    };
+  }
+
+  std::lock_guard<std::mutex> lock(encoder_mutex_);
+  std::vector<unsigned char> jpeg;
+  if (rois.empty() || opt.mode == kRoiSmooth) {
+    const unsigned char* src = yv12;
+    if (!rois.empty()) {
+      roi_scratch_.assign(yv12, yv12 + static_cast<size_t>(w) * h * 3 / 2);
+      FrameKernels::flattenOutside(&roi_scratch_[0], w, h, rois, opt.block);
+      src = &roi_scratch_[0];
+    }
+    encoder_.setQuality(rois.empty() ? kFullFrameQuality : opt.quality);
+    if (!encoder_.encodeYv12(src, w, h, &jpeg)) {
+      printf("帧 JPEG 编码失败: %dx%d\n", w, h);
+      return "";
+    }
+    if (!AsyncFileWriter::instance().write(path, &jpeg[0], jpeg.size(),
+                                           main_write)) {
+      main_write(path, false);
+    }
+    return path;
+  }
+
+  // kRoiCrop：各 ROI 原画质裁图 + 全景缩略图 + 位置说明
+  std::string index = "{\"width\": " + std::to_string(w) +
+                      ", \"height\": " + std::to_string(h) + ", \"rois\": [";
+  encoder_.setQuality(opt.quality);
+  int saved = 0;
+  for (size_t i = 0; i < rois.size(); i++) {
+    PixelRect actual;
+    if (!FrameKernels::cropYv12(yv12, w, h, rois[i], &roi_scratch_, &actual) ||
+        !encoder_.encodeYv12(&roi_scratch_[0], actual.width, actual.height,
+                             &jpeg)) {
+      printf("ROI %zu 裁图/编码失败\n", i);
+      continue;
+    }
+    std::string file = stem + "_roi" + std::to_string(i) + ".jpg";
+    AsyncFileWriter::instance().write(dir + "/" + file, &jpeg[0], jpeg.size(),
+                                      log_write);
+    index += std::string(saved > 0 ? ", " : "") + "{\"file\": \"" + file +
+             "\", \"x\": " + std::to_string(actual.x) +
+             ", \"y\": " + std::to_string(actual.y) +
+             ", \"width\": " + std::to_string(actual.width) +
+             ", \"height\": " + std::to_string(actual.height) + "}";
+    saved++;
+  }
+
+  int factor = 1;
+  if (opt.context_width > 0 && w > opt.context_width) {
+    factor = (w + opt.context_width - 1) / opt.context_width;
+  }
+  int cw = 0;
+  int ch = 0;
+  FrameKernels::downscaleYv12(yv12, w, h, factor, &roi_scratch_, &cw, &ch);
+  encoder_.setQuality(opt.context_quality);
+  if (!encoder_.encodeYv12(&roi_scratch_[0], cw, ch, &jpeg)) {
+    printf("全景缩略图编码失败: %dx%d\n", cw, ch);
+    return "";
+  }
+  index += "], \"context\": {\"file\": \"" + name +
+           "\", \"scale\": " + std::to_string(factor) + "}}\n";
+  AsyncFileWriter::instance().write(dir + "/" + stem + "_roi.json",
+                                    index.data(), index.size(), log_write);
+  if (!AsyncFileWriter::instance().write(path, &jpeg[0], jpeg.size(),
+                                         main_write)) {
+    main_write(path, false);
+  }
+  return saved > 0 ? path : "";
+}
@@ -15,34 +15,161 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "AsyncFileWriter.h"
+#include "CancelToken.h"
+#include "FrameKernels.h"
+#include "FramePublisher.h"
+#include "FrameSync.h"
 #include "HCNetSDK/HCNetSDK.h"
 #include "HCNetSDK/PlayM4.h"
+#include "JpegEncoder.h"
+#include "StreamRecorder.h"
+
+// 一路码流的运行统计
+struct StreamStats {
+  int channel;
+  int stream_type;
+  bool streaming;
+  uint64_t packets;           // 收到的码流包
+  uint64_t bytes;
+  uint64_t frames;            // 解码出的帧
+  uint64_t sysheads;          // 系统头次数，大于 1 说明发生过重连
+  uint64_t captures;          // 成功的抓图
+  uint64_t capture_failures;
+  int64_t last_frame_us;      // 最近一帧的主机单调时刻，没有帧时为 0
+};
+
+// 按 ROI 抓图的编码方式
+enum RoiMode {
+  kRoiSmooth = 0,  // ROI 外抹平后整幅编码，文件名、分辨率和坐标都不变
+  kRoiCrop = 1,    // 每个 ROI 单独裁出原画质编码，另存一张低分辨率全景缩略图
+};
+
+struct RoiCaptureOptions {
+  int mode;           // RoiMode
+  int margin;         // ROI 四周外扩的像素，留出框选误差
+  int block;          // kRoiSmooth 抹平块边长（亮度像素），16 与 JPEG MCU 对齐
+  int context_width;  // kRoiCrop 全景缩略图宽度上限
+  int context_quality;
+  int quality;        // ROI 内（或裁出部分）的 JPEG 质量
+
+  RoiCaptureOptions()
+      : mode(kRoiSmooth), margin(32), block(16), context_width(640),
+        context_quality(60), quality(90) {}
+};
 
 class CamController {
  public:
+  // 异步登录结果，在 SDK 线程回调；error 为失败时的 NET_DVR 错误码
+  typedef std::function<void(bool ok, DWORD error)> LoginCallback;
+  // 等帧结果，在解码回调线程（或 waitFrame 的调用线程）回调；
+  // ok=false 表示码流已关闭，frame 无效
+  typedef std::function<void(bool ok, const TimedFrame& frame)> FrameCallback;
+
   CamController();
   ~CamController();
 
   // 设备连接管理
   bool login(const std::string& deviceAddress, unsigned short port,
              const std::string& userName, const std::string& password);
-  bool logout();
+  // 异步登录（bUseAsynLogin）：请求发出后立即返回，结果经 done 回调。
+  // 返回 false 表示请求未能发出，done 不会被调用。回调前不能析构本对象
+  bool loginAsync(const std::string& deviceAddress, unsigned short port,
+                  const std::string& userName, const std::string& password,
+                  const LoginCallback& done);
+  // flush_writes 为 false 时不等待 AsyncFileWriter 里其他相机的写入
+  bool logout(bool flush_writes = true);
+  // 挂到已登录的 DeviceSession 上：之后只管理这一路码流，logout 不会登出设备
+  void attach(LONG user_id);
 
   bool startRealPlay(unsigned short channel, unsigned short stream_type,
                      unsigned short linkMode, unsigned short blocked);
+  // 只开流不等解码器就绪（startRealPlay 去掉等待循环），就绪由 waitFrame 通知
+  bool openRealPlay(unsigned short channel, unsigned short stream_type,
+                    unsigned short linkMode, unsigned short blocked);
 
   bool stopRealPlay();
 
+  // 启动抓图线程，继续预览 capture_wait_ms 后等待抓图线程结束再返回
   void getCapture();
+  void setCaptureWaitMs(int ms) { capture_wait_ms_ = ms; }
 
   void setTaskInfo(std::string task_id, std::string bin_code);
 
   void setCameraType(std::string camera_type);
 
+  // 设置本储位的截止时间/取消令牌：登录、等待解码器、抓图重试都会检查它，
+  // 超时或取消后立即返回而不是继续占用相机和 CPU
+  void setCancelToken(const CancelToken& token);
+
+  // 码流录制：在内存环中保留最近 seconds 秒的原始 PS 包，
+  // 抓图完成或出错时自动落盘到抓图目录下的 stream_<码流>_<原因>.psr
+  void enableRecording(double seconds, unsigned int capacity_mb);
+  void disableRecording();
+  // 手动触发落盘，返回文件路径（无数据时返回空串）
+  std::string triggerRecording(const std::string& reason);
+
+  // 回放录制文件：按录制时的节奏把包送入 HandleRealData，无需相机即可抓图
+  bool startReplay(const std::string& path, bool realtime);
+  void stopReplay();
+
+  // 解码帧历史：每帧都带换算到主机单调时钟的成像时刻（host_us）。
+  // 默认只记录最近 32 帧的时间信息；enableFrameHistory 后额外缓存 depth 帧 YV12 像素，
+  // 供 CaptureGroup 从多台相机中挑出同一时刻的帧
+  void enableFrameHistory(int depth);
+  std::vector<TimedFrame> frameHistory();
+  bool latestFrame(TimedFrame* frame);
+  // 码流时钟相对主机单调时钟的偏移与抖动（毫秒），样本不足时返回 false
+  bool clockOffset(double* offset_ms, double* jitter_ms);
+  // 把历史中的一帧编码为 JPEG，异步写到抓图目录（文件名同 getCapture），返回路径，失败返回空串
+  std::string saveFrame(const TimedFrame& frame);
+  // 同上，主文件落盘（或失败）后在写线程回调 done；返回空串时 done 不会被调用
+  std::string saveFrame(const TimedFrame& frame,
+                        const AsyncFileWriter::Callback& done);
+
+  // 等一帧 arrival_us >= since_us 的解码帧（need_pixels 时还要求带像素），
+  // 已有满足条件的帧时立即回调。每个等待只回调一次，码流关闭时以 ok=false 回调。
+  // 返回等待编号，cancelFrameWait 撤销后不再回调（返回 false 表示已经或正在回调）
+  long waitFrame(int64_t since_us, bool need_pixels, const FrameCallback& cb);
+  bool cancelFrameWait(long id);
+
+  // 订阅本路解码帧：一路码流分发给多个使用方（预览、录像、检测……），
+  // 每个订阅者各自的帧率/分辨率/格式，不再为每个使用方单独开流。
+  // 订阅在重连后继续有效，返回的对象析构即退订
+  std::shared_ptr<FrameSubscription> subscribe(const SubscriberOptions& options);
+  size_t subscribers();
+
+  // 设置 ROI 后抓图（getCapture 和 saveFrame）不再用播放库整幅 JPEG，而是取最新解码帧按 ROI 编码：
+  // kRoiSmooth 写 main.jpg（ROI 外只剩块均值），kRoiCrop 写 main.jpg 为全景缩略图、
+  // main_roi<i>.jpg 为各 ROI 原画质裁图，并写 main_roi.json 记录各裁图在原图中的位置。
+  // 会开启帧历史的像素缓存；rois 为空等同 clearCaptureRois
+  void setCaptureRois(const std::vector<PixelRect>& rois,
+                      const RoiCaptureOptions& options);
+  void clearCaptureRois();
+
+  // 抓图时额外计算画面（设置了 ROI 时为 ROI 外接矩形）Y 平面的感知哈希，
+  // 写到抓图目录下的 main.phash（JSON），供复盘同一储位时判断画面是否变化。会开启帧历史的像素缓存
+  void enableCaptureHash(bool enable);
+  // 最近一次抓图的哈希，尚未计算或画面无法哈希（见 FrameKernels::phash）时为 0
+  uint64_t lastCaptureHash() const { return last_hash_; }
+
+  StreamStats stats();
+
+  // NET_DVR_Init/Cleanup 是进程级的，多个实例（以及 DeviceSession）共用，按引用计数调用
+  static void acquireSdk();
+  static void releaseSdk();
+
+  const std::string& cameraType() const { return camera_type_; }
+  unsigned short streamType() const { return stream_type_; }
+
  private:
   std::string task_id_;
   std::string bin_code_;
@@ -51,10 +178,79 @@ class CamController {
 
   LONG lUserID;
   LONG lRealPlayHandle;
+  LONG m_lPort;       // 本实例码流的播放库port号
+  bool owns_login_;   // false 表示 lUserID 借自 DeviceSession，不由本实例登出
+  unsigned short channel_;
+
+  // 统计计数在码流/解码回调线程里累加
+  std::atomic<uint64_t> packets_;
+  std::atomic<uint64_t> bytes_;
+  std::atomic<uint64_t> frames_;
+  std::atomic<uint64_t> sysheads_;
+  std::atomic<uint64_t> captures_;
+  std::atomic<uint64_t> capture_failures_;
+
+  CancelToken cancel_token_;
+  CancelToken capture_token_;  // 本次抓图的令牌，stop/logout 时取消
+  std::thread capture_thread_;
+  int capture_wait_ms_;
+  static const int kCaptureTimeoutMs = 30000;  // 单次抓图线程的上限
+  StreamRecorder recorder_;
+  std::thread replay_thread_;
+  std::atomic<bool> replay_running_;
+  static const LONG kReplayHandle = 15;  // 回放时的预览句柄
+
+  std::mutex clock_mutex_;
+  ClockOffsetEstimator clock_;
+  std::atomic<int64_t> last_packet_us_;  // 最近一个码流包到达时刻
+  FrameHistory history_;
+  FramePublisher publisher_;
+  FrameBufferPool frame_pool_;  // 只在解码回调线程使用
+  std::mutex encoder_mutex_;
+  JpegEncoder encoder_;
+  std::mutex roi_mutex_;
+  std::vector<PixelRect> rois_;
+  RoiCaptureOptions roi_options_;
+  std::vector<unsigned char> roi_scratch_;  // 受 encoder_mutex_ 保护
+  std::atomic<bool> capture_hash_;
+  std::atomic<uint64_t> last_hash_;
+
+  // 异步登录：pUser 指向本对象，回调时取走 login_cb_
+  std::mutex login_mutex_;
+  LoginCallback login_cb_;
+
+  // 等帧者：没有等待时解码回调只读一次原子计数
+  struct FrameWaiter {
+    long id;
+    int64_t since_us;
+    bool need_pixels;
+    FrameCallback cb;
+  };
+  std::mutex wait_mutex_;
+  std::vector<FrameWaiter> frame_waiters_;
+  std::atomic<int> frame_waiter_count_;
+  long next_wait_id_;
+  void fireFrameWaiters(const TimedFrame* frame);
+
+  // 帧历史像素和录制环计入 MemoryGovernor，开启其中之一时才登记
+  std::mutex mem_mutex_;
+  std::atomic<long> mem_account_;
+  std::atomic<size_t> frame_bytes_;    // 最近一帧 YV12 的大小
+  std::atomic<size_t> history_depth_;  // 开启时的帧历史深度（预算）
+  std::atomic<size_t> record_bytes_;   // 开启时的录制环容量（预算）
+  static const size_t kMinHistoryDepth = 2;  // 同步抓图至少要 2 帧
+  static const size_t kMinRecordBytes = 8 << 20;
+  void attachMemory();
+  void updateMemory();
+  int64_t shrinkMemory(int level);
 
   static int times;
-  static LONG m_lPort[16];  // 全局的播放库port号
   void getPic();
+  void joinCapture(bool cancel);
+  void releasePort();
+
+  static std::mutex sdk_mutex_;
+  static int sdk_refs_;
 
   // 静态回调函数
   static void CALLBACK DisplayCBFun(DISPLAY_INFO_YUV* pstDisplayInfo,
@@ -62,6 +258,9 @@ class CamController {
   static void CALLBACK DecCBFunIm(int nPort, char* pBuf, int nSize,
                                   FRAME_INFO* pFrameInfo, void* pUser,
                                   int nReserved2);
+  static void CALLBACK
+  LoginResultCallBack(LONG lUserID, DWORD dwResult,
+                      LPNET_DVR_DEVICEINFO_V30 lpDeviceInfo, void* pUser);
   static void CALLBACK g_RealDataCallBack_V30(LONG lRealHandle,
                                               DWORD dwDataType, BYTE* pBuffer,
                                               DWORD dwBufSize, void* pUser);
@@ -70,5 +269,18 @@ class CamController {
   void HandleRealData(LONG lRealHandle, DWORD dwDataType, BYTE* pBuffer,
                       DWORD dwBufSize);
 
+  void replayLoop(std::vector<RecordedPacket> packets, bool realtime);
+
+  void onDecodedFrame(const char* buf, int size, const FRAME_INFO* info);
+
+  // 按 ROI 设置编码并提交落盘，返回主文件路径；未设置 ROI 时整幅编码
+  std::string writeFrameJpeg(const TimedFrame& frame, const char* log_tag,
+                             const AsyncFileWriter::Callback& done =
+                                 AsyncFileWriter::Callback());
+  bool captureRoiFrame(int64_t since_us);
+  void writeCaptureHash(const TimedFrame& frame);
+
+  std::string captureDir() const;
+  std::string captureFileName() const;
   void createDirectory(const std::string& path);
 };
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 11:02:47
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 11:02:47
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CancelToken.cpp
+ * @Description: 截止时间/取消令牌，在各阶段边界和重试循环中协作式检查
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "CancelToken.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const Clock::time_point kNoDeadline = Clock::time_point::max();
+
+}  // namespace
+
+struct CancelToken::State {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool cancelled;
+  Clock::time_point deadline;
+  std::vector<std::weak_ptr<State> > children;
+
+  State() : cancelled(false), deadline(kNoDeadline) {}
+};
+
+CancelToken::CancelToken() : state_(std::make_shared<State>()) {}
+
+CancelToken::CancelToken(const std::shared_ptr<State>& state)
+    : state_(state) {}
+
+CancelToken CancelToken::withTimeout(int64_t timeout_ms) {
+  return CancelToken().child(timeout_ms);
+}
+
+CancelToken CancelToken::child(int64_t timeout_ms) const {
+  std::shared_ptr<State> st = std::make_shared<State>();
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  st->cancelled = state_->cancelled;
+  st->deadline = state_->deadline;
+  if (timeout_ms >= 0) {
+    Clock::time_point own =
+        Clock::now() + std::chrono::milliseconds(timeout_ms);
+    if (own < st->deadline) {
+      st->deadline = own;
+    }
+  }
+  // 长期存活的父令牌会反复派生子令牌（每次抓图一个），先清掉已释放的
+  std::vector<std::weak_ptr<State> >& children = state_->children;
+  children.erase(std::remove_if(children.begin(), children.end(),
+                                [](const std::weak_ptr<State>& w) {
+                                  return w.expired();
+                                }),
+                 children.end());
+  children.push_back(st);
+  return CancelToken(st);
+}
+
+void CancelToken::cancel() {
+  std::vector<std::weak_ptr<State> > children;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->cancelled) {
+      return;
+    }
+    state_->cancelled = true;
+    children.swap(state_->children);
+  }
+  state_->cv.notify_all();
+
+  for (size_t i = 0; i < children.size(); i++) {
+    std::shared_ptr<State> st = children[i].lock();
+    if (st) {
+      CancelToken(st).cancel();
+    }
+  }
+}
+
+bool CancelToken::cancelled() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->cancelled || Clock::now() >= state_->deadline;
+}
+
+int64_t CancelToken::remainingMs() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  if (state_->cancelled) {
+    return 0;
+  }
+  if (state_->deadline == kNoDeadline) {
+    return -1;
+  }
+  Clock::time_point now = Clock::now();
+  if (now >= state_->deadline) {
+    return 0;
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             state_->deadline - now)
+      .count();
+}
+
+bool CancelToken::sleepFor(int64_t ms) const {
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  Clock::time_point until = Clock::now() + std::chrono::milliseconds(ms);
+  if (state_->deadline < until) {
+    until = state_->deadline;
+  }
+  while (!state_->cancelled && Clock::now() < until) {
+    state_->cv.wait_until(lock, until);
+  }
+  return !state_->cancelled && Clock::now() < state_->deadline;
+}
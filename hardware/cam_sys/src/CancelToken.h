@@ -0,0 +1,43 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 11:02:47
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 11:02:47
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CancelToken.h
+ * @Description: 截止时间/取消令牌，在各阶段边界和重试循环中协作式检查
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+
+// 可拷贝的令牌，拷贝之间共享同一状态。
+// 取消父令牌会级联取消所有子令牌；子令牌的截止时间不晚于父令牌。
+// 默认构造的令牌没有截止时间，也永远不会被取消（除非显式 cancel）。
+class CancelToken {
+ public:
+  CancelToken();
+
+  static CancelToken withTimeout(int64_t timeout_ms);
+
+  // 派生子令牌：截止时间取 min(父截止时间, 现在 + timeout_ms)，timeout_ms<0 表示沿用父令牌
+  CancelToken child(int64_t timeout_ms) const;
+
+  void cancel();
+  // 已被取消或已超过截止时间
+  bool cancelled() const;
+  // 剩余毫秒数；没有截止时间返回 -1，已过期返回 0
+  int64_t remainingMs() const;
+
+  // 可被取消打断的睡眠；返回 false 表示睡眠期间被取消或已超时
+  bool sleepFor(int64_t ms) const;
+
+ private:
+  struct State;
+  explicit CancelToken(const std::shared_ptr<State>& state);
+
+  std::shared_ptr<State> state_;
+};
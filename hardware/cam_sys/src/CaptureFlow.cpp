@@ -0,0 +1,348 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 16:05:48
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 16:05:48
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CaptureFlow.cpp
+ * @Description: 单台相机的抓图流程：登录 → 开流 → 等就绪 → 取帧 → 编码 → 落盘，在 CaptureLoop 上逐步推进
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "CaptureFlow.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <condition_variable>
+
+#include "StreamRecorder.h"
+
+namespace {
+
+const char* const kStepNames[] = {"登录", "开流", "等待解码器", "取帧",
+                                  "编码",  "落盘", "完成"};
+
+const char* stepName(int step) {
+  return step >= kStepLogin && step <= kStepDone ? kStepNames[step] : "未知";
+}
+
+struct LoginResult {
+  bool ok;
+  unsigned int error;
+};
+
+struct FrameResult {
+  bool ok;
+  TimedFrame frame;
+};
+
+struct EncodeResult {
+  std::string path;
+  double encode_ms;
+};
+
+}  // namespace
+
+CaptureFlow::CaptureFlow(CaptureLoop* loop, const CaptureFlowOptions& options,
+                         const Callback& done)
+    : loop_(loop),
+      options_(options),
+      done_(done),
+      step_(kStepLogin),
+      cancelled_(false),
+      finished_(false),
+      begin_us_(0),
+      deadline_us_(0),
+      result_() {
+  result_.camera_type = options.camera_type;
+  result_.success = false;
+  result_.failed_step = kStepLogin;
+  result_.login_ms = 0.0;
+  result_.total_ms = 0.0;
+}
+
+std::shared_ptr<CaptureFlow> CaptureFlow::start(
+    CaptureLoop* loop, const CaptureFlowOptions& options,
+    const Callback& done) {
+  std::shared_ptr<CaptureFlow> flow(new CaptureFlow(loop, options, done));
+  if (!flow->run(flow).start(loop)) {
+    printf("[抓图流程] %s: 事件循环已停止\n", options.camera_type.c_str());
+    flow->result_.error = "事件循环已停止";
+    if (done) {
+      done(flow->result_);
+    }
+  }
+  return flow;
+}
+
+std::vector<CaptureFlowResult> CaptureFlow::runAll(
+    CaptureLoop* loop, const std::vector<CaptureFlowOptions>& flows) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<CaptureFlowResult> results(flows.size());
+  size_t finished = 0;
+  for (size_t i = 0; i < flows.size(); i++) {
+    start(loop, flows[i], [&, i](const CaptureFlowResult& r) {
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i] = r;
+      finished++;
+      cv.notify_all();
+    });
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&] { return finished == flows.size(); });
+  return results;
+}
+
+void CaptureFlow::cancel() {
+  std::function<void()> interrupt;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    interrupt = interrupt_;
+  }
+  if (interrupt) {
+    interrupt();
+  }
+}
+
+int CaptureFlow::step() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return step_;
+}
+
+void CaptureFlow::setStep(int step) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  step_ = step;
+}
+
+bool CaptureFlow::cancelled() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cancelled_;
+}
+
+double CaptureFlow::sinceMs(int64_t t) const {
+  return (StreamRecorder::nowMicros() - t) / 1000.0;
+}
+
+int CaptureFlow::timeoutFor(int timeout_ms) const {
+  if (deadline_us_ > 0) {
+    const int64_t left = (deadline_us_ - StreamRecorder::nowMicros()) / 1000;
+    timeout_ms = static_cast<int>(std::min<int64_t>(timeout_ms, left));
+  }
+  return std::max(0, timeout_ms);
+}
+
+template <typename T>
+const std::shared_ptr<CaptureWait<T> >& CaptureFlow::interruptible(
+    const std::shared_ptr<CaptureWait<T> >& wait) {
+  std::function<void()> interrupt = [wait] {
+    wait->expire(kWaitCancelled);
+  };
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interrupt_ = interrupt;
+    if (!cancelled_) {
+      return wait;
+    }
+  }
+  interrupt();
+  return wait;
+}
+
+void CaptureFlow::fail(const std::string& error) {
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  const int step = this->step();
+  result_.success = false;
+  result_.failed_step = step;
+  result_.error = error;
+  printf("[抓图流程] %s %s失败: %s\n", options_.camera_type.c_str(),
+         stepName(step), error.c_str());
+}
+
+void CaptureFlow::failWait(CaptureWaitOutcome outcome) {
+  if (outcome == kWaitCancelled) {
+    fail("已取消");
+    return;
+  }
+  // timeoutFor 按整毫秒截断，截止时间触发的定时器最多早 1ms
+  const bool by_deadline = deadline_us_ > 0 &&
+                           StreamRecorder::nowMicros() + 1000 >= deadline_us_;
+  fail(by_deadline ? "超出流程时间预算" : "超时");
+}
+
+CaptureTask CaptureFlow::run(std::shared_ptr<CaptureFlow> /*self*/) {
+  begin_us_ = StreamRecorder::nowMicros();
+  if (options_.deadline_ms >= 0) {
+    deadline_us_ =
+        begin_us_ + static_cast<int64_t>(options_.deadline_ms) * 1000;
+  }
+  CaptureWaitOutcome outcome = kWaitPending;
+
+  // 登录：SDK 异步登录（bUseAsynLogin），结果在 SDK 线程回调
+  if (options_.streams.empty()) {
+    fail("没有要抓的码流");
+  } else {
+    cam_.reset(new CamController());
+    cam_->setTaskInfo(options_.task_id, options_.bin_code);
+    cam_->setCameraType(options_.camera_type);
+    // 取帧和编码都用解码帧的像素，不走播放库 GetJPEG 的重试
+    cam_->enableFrameHistory(2);
+    if (!options_.rois.empty()) {
+      cam_->setCaptureRois(options_.rois, options_.roi_options);
+    }
+    cam_->enableCaptureHash(options_.capture_hash);
+
+    std::shared_ptr<CaptureWait<LoginResult> > login =
+        std::make_shared<CaptureWait<LoginResult> >(loop_);
+    if (!cam_->loginAsync(options_.address, options_.port, options_.user,
+                          options_.password, [login](bool ok, DWORD error) {
+                            login->complete(LoginResult{ok, error});
+                          })) {
+      fail("登录请求未能发出");
+    } else {
+      outcome = co_await interruptible(login)->wait(
+          timeoutFor(options_.login_timeout_ms));
+      if (outcome != kWaitCompleted) {
+        failWait(outcome);
+        // 超时之后才登录成功：等回调到了再登出这个迟到的会话
+        co_await login->done();
+      } else if (!login->value().ok) {
+        fail("错误码 " + std::to_string(login->value().error));
+      } else {
+        result_.login_ms = sinceMs(begin_us_);
+      }
+    }
+  }
+
+  // 同一台相机的多路码流依次抓
+  CamController* cam = cam_.get();
+  for (size_t i = 0; !finished_ && i < options_.streams.size(); i++) {
+    const int stream = options_.streams[i];
+    CaptureShot shot = CaptureShot();
+    shot.stream_type = stream;
+    setStep(kStepStream);
+    int64_t step_us = StreamRecorder::nowMicros();
+    // 非阻塞取流：开流请求发出即返回，第一帧解码出来才算就绪
+    if (!cam->openRealPlay(options_.channel,
+                           static_cast<unsigned short>(stream),
+                           options_.link_mode, 0)) {
+      fail("码流 " + std::to_string(stream));
+      break;
+    }
+
+    // 就绪：第一帧解码出来；之后再预览 settle_ms，取其后到达的第一帧
+    std::shared_ptr<CaptureWait<FrameResult> > frame;
+    for (int pass = 0; pass < 2; pass++) {
+      const bool grab = pass == 1;
+      setStep(grab ? kStepGrab : kStepReady);
+      const int64_t since =
+          grab ? step_us + static_cast<int64_t>(options_.settle_ms) * 1000
+               : 0;
+      frame = std::make_shared<CaptureWait<FrameResult> >(loop_);
+      const long frame_wait = cam->waitFrame(
+          since, grab, [frame](bool ok, const TimedFrame& f) {
+            frame->complete(FrameResult{ok, f});
+          });
+      outcome = co_await interruptible(frame)->wait(
+          timeoutFor(grab ? options_.settle_ms + options_.grab_timeout_ms
+                          : options_.ready_timeout_ms));
+      if (outcome != kWaitCompleted) {
+        cam->cancelFrameWait(frame_wait);
+        failWait(outcome);
+        break;
+      }
+      if (!frame->value().ok) {
+        fail("码流已关闭");
+        break;
+      }
+      if (grab) {
+        shot.grab_ms = sinceMs(step_us);
+        shot.frame_us = frame->value().frame.host_us;
+      } else {
+        shot.ready_ms = sinceMs(step_us);
+      }
+      step_us = StreamRecorder::nowMicros();
+    }
+    if (finished_) {
+      break;
+    }
+
+    // 编码在工作线程，落盘完成由写线程回调；两者共用 write_timeout_ms
+    setStep(kStepEncode);
+    std::shared_ptr<CaptureWait<EncodeResult> > encoded =
+        std::make_shared<CaptureWait<EncodeResult> >(loop_);
+    std::shared_ptr<CaptureWait<bool> > written =
+        std::make_shared<CaptureWait<bool> >(loop_);
+    const TimedFrame grabbed = frame->value().frame;
+    loop_->offload([cam, grabbed, encoded, written] {
+      const int64_t t0 = StreamRecorder::nowMicros();
+      const std::string path = cam->saveFrame(
+          grabbed,
+          [written](const std::string&, bool ok) { written->complete(ok); });
+      encoded->complete(
+          EncodeResult{path, (StreamRecorder::nowMicros() - t0) / 1000.0});
+    });
+    outcome = co_await interruptible(encoded)->wait(
+        timeoutFor(options_.write_timeout_ms));
+    if (outcome != kWaitCompleted) {
+      failWait(outcome);
+      // 编码还在用相机，结束后才能登出
+      co_await encoded->done();
+      break;
+    }
+    shot.encode_ms = encoded->value().encode_ms;
+    if (encoded->value().path.empty()) {
+      fail("码流 " + std::to_string(stream));
+      break;
+    }
+    shot.path = encoded->value().path;
+    setStep(kStepWrite);
+    outcome = co_await interruptible(written)->wait(timeoutFor(
+        options_.write_timeout_ms - static_cast<int>(sinceMs(step_us))));
+    if (outcome != kWaitCompleted) {
+      failWait(outcome);
+      break;
+    }
+    if (!written->value()) {
+      fail("码流 " + std::to_string(stream));
+      break;
+    }
+    shot.write_ms = std::max(0.0, sinceMs(step_us) - shot.encode_ms);
+    result_.shots.push_back(shot);
+
+    // 停流（阻塞）后开下一路
+    co_await loop_->offloaded([cam] { cam->stopRealPlay(); });
+    if (cancelled()) {
+      fail("已取消");
+    }
+  }
+
+  if (!finished_) {
+    setStep(kStepDone);
+    finished_ = true;
+    result_.success = true;
+    result_.failed_step = kStepDone;
+  }
+  // 登出之后才回调 done
+  co_await loop_->offloaded([this] {
+    if (cam_) {
+      cam_->logout(false);
+      cam_.reset();
+    }
+  });
+  result_.total_ms = sinceMs(begin_us_);
+  if (result_.success) {
+    printf("[抓图流程] %s 完成: %zu 路码流, 登录 %.0fms, 共 %.0fms\n",
+           result_.camera_type.c_str(), result_.shots.size(),
+           result_.login_ms, result_.total_ms);
+  }
+  Callback done;
+  done.swap(done_);
+  if (done) {
+    done(result_);
+  }
+}
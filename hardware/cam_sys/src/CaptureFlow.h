@@ -0,0 +1,142 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 16:05:48
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 16:05:48
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CaptureFlow.h
+ * @Description: 单台相机的抓图流程：登录 → 开流 → 等就绪 → 取帧 → 编码 → 落盘，在 CaptureLoop 上逐步推进
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CamController.h"
+#include "CaptureLoop.h"
+
+enum CaptureStep {
+  kStepLogin = 0,
+  kStepStream = 1,  // 开流
+  kStepReady = 2,   // 等第一帧解码出来（解码器就绪）
+  kStepGrab = 3,    // 等 settle 之后带像素的新帧
+  kStepEncode = 4,
+  kStepWrite = 5,
+  kStepDone = 6,
+};
+
+struct CaptureFlowOptions {
+  std::string address;
+  unsigned short port;
+  std::string user;
+  std::string password;
+  unsigned short channel;
+  std::vector<int> streams;  // 依次抓的码流，文件名见 CamController
+  unsigned short link_mode;
+  std::string task_id;
+  std::string bin_code;
+  std::string camera_type;
+  std::vector<PixelRect> rois;  // 为空时整幅编码
+  RoiCaptureOptions roi_options;
+  bool capture_hash;  // 写 main.phash，复盘沿用结果时才需要，默认关
+
+  // 各步超时（毫秒），从该步开始计；deadline_ms 为整个流程的上限，负数不限，
+  // 0 表示预算已耗尽（第一步即失败）
+  int login_timeout_ms;
+  int ready_timeout_ms;
+  int grab_timeout_ms;
+  int write_timeout_ms;  // 编码 + 落盘
+  int settle_ms;         // 就绪后继续预览多久再取帧（曝光、码率稳定）
+  int deadline_ms;
+
+  CaptureFlowOptions()
+      : port(8000), user("admin"), channel(1), streams(1, 0), link_mode(0),
+        capture_hash(false), login_timeout_ms(10000), ready_timeout_ms(30000),
+        grab_timeout_ms(10000), write_timeout_ms(10000), settle_ms(0),
+        deadline_ms(-1) {}
+};
+
+// 一路码流的抓图；耗时均从上一步完成算起
+struct CaptureShot {
+  int stream_type;
+  std::string path;
+  int64_t frame_us;  // 所用帧的主机成像时刻
+  double ready_ms;   // 开流到第一帧
+  double grab_ms;
+  double encode_ms;
+  double write_ms;
+};
+
+struct CaptureFlowResult {
+  std::string camera_type;
+  bool success;
+  int failed_step;    // CaptureStep，成功时为 kStepDone
+  std::string error;
+  std::vector<CaptureShot> shots;  // 已完成的码流
+  double login_ms;
+  double total_ms;    // 开始到相机释放（登出）完成
+};
+
+// 流程是 CaptureLoop 上的一个协程，按 登录 → 开流 → 等就绪 → 取帧 → 编码 → 落盘
+// 顺序写下来：每一步发起后 co_await，由 SDK 回调或超时定时器把协程 post 回循环，
+// 谁先到谁生效，晚到的一方被忽略。阻塞调用（编码、停流、登出）在 CaptureLoop 的
+// 工作线程执行；流程结束（成功、失败或 cancel）后相机一定已经登出，再回调 done。
+// 对象由协程帧持有，调用方不必保存 start 的返回值。
+class CaptureFlow {
+ public:
+  typedef std::function<void(const CaptureFlowResult& result)> Callback;
+
+  // done 在 CaptureLoop 线程回调；loop 须比流程活得久
+  static std::shared_ptr<CaptureFlow> start(CaptureLoop* loop,
+                                            const CaptureFlowOptions& options,
+                                            const Callback& done);
+  // 并发跑完一组流程，阻塞到全部结束，结果与 flows 顺序一致
+  static std::vector<CaptureFlowResult> runAll(
+      CaptureLoop* loop, const std::vector<CaptureFlowOptions>& flows);
+
+  // 以当前步骤失败结束（error 为“已取消”），已结束时无效
+  void cancel();
+  int step();
+
+ private:
+  CaptureFlow(CaptureLoop* loop, const CaptureFlowOptions& options,
+              const Callback& done);
+
+  // 流程主体；参数（指向本对象）复制在协程帧里，流程结束前对象不会析构
+  CaptureTask run(std::shared_ptr<CaptureFlow> self);
+
+  void setStep(int step);
+  // 本步超时与整体截止时间取先到者
+  int timeoutFor(int timeout_ms) const;
+  // 接下来要 co_await 的等待，cancel 时以“已取消”结束它
+  template <typename T>
+  const std::shared_ptr<CaptureWait<T> >& interruptible(
+      const std::shared_ptr<CaptureWait<T> >& wait);
+  bool cancelled();
+  void fail(const std::string& error);
+  // 等待以超时或取消结束
+  void failWait(CaptureWaitOutcome outcome);
+  double sinceMs(int64_t t) const;
+
+  CaptureLoop* loop_;
+  CaptureFlowOptions options_;
+  Callback done_;
+  std::unique_ptr<CamController> cam_;
+
+  std::mutex mutex_;  // 保护 step_、cancelled_、interrupt_
+  int step_;
+  bool cancelled_;
+  std::function<void()> interrupt_;
+
+  // 以下只在协程里访问
+  bool finished_;
+  int64_t begin_us_;
+  int64_t deadline_us_;  // 0 表示不限
+  CaptureFlowResult result_;
+};
@@ -0,0 +1,185 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 14:52:10
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 14:52:10
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CaptureGroup.cpp
+ * @Description: 多相机同步抓图：按主机时钟下的成像时刻挑出同一时刻的一组帧
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "CaptureGroup.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "StreamRecorder.h"
+
+namespace {
+
+const int kPollMs = 5;  // 等新帧的轮询间隔，远小于帧间隔
+
+bool byHostTime(const TimedFrame& a, const TimedFrame& b) {
+  return a.host_us < b.host_us;
+}
+
+// 升序序列中离 t 最近的下标
+size_t nearest(const std::vector<int64_t>& v, int64_t t) {
+  size_t i = std::lower_bound(v.begin(), v.end(), t) - v.begin();
+  if (i == v.size()) {
+    return i - 1;
+  }
+  if (i > 0 && t - v[i - 1] <= v[i] - t) {
+    return i - 1;
+  }
+  return i;
+}
+
+}  // namespace
+
+CaptureGroup::CaptureGroup() : last_spread_ms_(-1.0) {}
+
+void CaptureGroup::add(CamController* cam, int history_depth) {
+  if (cam == NULL) {
+    return;
+  }
+  cam->enableFrameHistory(history_depth);
+  cams_.push_back(cam);
+}
+
+void CaptureGroup::clear() { cams_.clear(); }
+
+void CaptureGroup::setTaskInfo(const std::string& task_id,
+                               const std::string& bin_code) {
+  for (size_t i = 0; i < cams_.size(); i++) {
+    cams_[i]->setTaskInfo(task_id, bin_code);
+  }
+}
+
+bool CaptureGroup::match(const std::vector<std::vector<int64_t> >& times,
+                         int64_t tolerance_us, std::vector<size_t>* picks,
+                         int64_t* spread_us) {
+  const size_t n = times.size();
+  if (n == 0) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (times[i].empty()) {
+      return false;
+    }
+  }
+
+  bool found = false;
+  int64_t best_start = 0;
+  int64_t best_spread = 0;
+  std::vector<size_t> cur(n);
+  for (size_t a = 0; a < n; a++) {
+    for (size_t k = 0; k < times[a].size(); k++) {
+      const int64_t anchor = times[a][k];
+      int64_t lo = anchor;
+      int64_t hi = anchor;
+      for (size_t j = 0; j < n; j++) {
+        cur[j] = (j == a) ? k : nearest(times[j], anchor);
+        lo = std::min(lo, times[j][cur[j]]);
+        hi = std::max(hi, times[j][cur[j]]);
+      }
+      const int64_t spread = hi - lo;
+      if (spread > tolerance_us) {
+        continue;
+      }
+      // 优先最新的一组（画面最接近当前状态），同样新时取跨度小的
+      if (!found || lo > best_start ||
+          (lo == best_start && spread < best_spread)) {
+        found = true;
+        best_start = lo;
+        best_spread = spread;
+        *picks = cur;
+      }
+    }
+  }
+  if (found && spread_us != NULL) {
+    *spread_us = best_spread;
+  }
+  return found;
+}
+
+std::vector<SyncedFrame> CaptureGroup::capture(int tolerance_ms,
+                                               int timeout_ms,
+                                               int max_age_ms) {
+  std::vector<SyncedFrame> result;
+  last_spread_ms_ = -1.0;
+  if (cams_.empty()) {
+    printf("同步抓图: 组内没有相机\n");
+    return result;
+  }
+
+  const int64_t start_us = StreamRecorder::nowMicros();
+  const int64_t oldest_us = start_us - static_cast<int64_t>(max_age_ms) * 1000;
+  const int64_t deadline_us = start_us + static_cast<int64_t>(timeout_ms) * 1000;
+  const int64_t tolerance_us = static_cast<int64_t>(tolerance_ms) * 1000;
+
+  std::vector<std::vector<TimedFrame> > frames(cams_.size());
+  std::vector<std::vector<int64_t> > times(cams_.size());
+  std::vector<size_t> picks;
+  int64_t spread_us = 0;
+  bool matched = false;
+  while (true) {
+    for (size_t i = 0; i < cams_.size(); i++) {
+      std::vector<TimedFrame> history = cams_[i]->frameHistory();
+      frames[i].clear();
+      for (size_t k = 0; k < history.size(); k++) {
+        // 只用缓存了像素的、调用前 max_age_ms 以后收到的帧
+        if (history[k].yv12 && history[k].arrival_us >= oldest_us) {
+          frames[i].push_back(history[k]);
+        }
+      }
+      // 时钟重新估计后 host_us 可能不随写入顺序单调
+      std::sort(frames[i].begin(), frames[i].end(), byHostTime);
+      times[i].resize(frames[i].size());
+      for (size_t k = 0; k < frames[i].size(); k++) {
+        times[i][k] = frames[i][k].host_us;
+      }
+    }
+    if (match(times, tolerance_us, &picks, &spread_us)) {
+      matched = true;
+      break;
+    }
+    if (StreamRecorder::nowMicros() >= deadline_us) {
+      break;
+    }
+    if (!cancel_token_.sleepFor(kPollMs)) {
+      printf("同步抓图已取消（储位时间预算耗尽）\n");
+      return result;
+    }
+  }
+  if (!matched) {
+    printf("同步抓图超时: %d ms 内未找到时间差 ≤ %d ms 的一组帧\n", timeout_ms,
+           tolerance_ms);
+    return result;
+  }
+
+  int64_t first_us = frames[0][picks[0]].host_us;
+  for (size_t i = 1; i < cams_.size(); i++) {
+    first_us = std::min(first_us, frames[i][picks[i]].host_us);
+  }
+  for (size_t i = 0; i < cams_.size(); i++) {
+    const TimedFrame& f = frames[i][picks[i]];
+    SyncedFrame out;
+    out.camera_type = cams_[i]->cameraType();
+    out.stream_type = cams_[i]->streamType();
+    out.host_us = f.host_us;
+    out.stamp_ms = f.stamp_ms;
+    out.frame_num = f.frame_num;
+    out.width = f.width;
+    out.height = f.height;
+    out.skew_ms = (f.host_us - first_us) / 1000.0;
+    out.path = cams_[i]->saveFrame(f);
+    result.push_back(out);
+  }
+  last_spread_ms_ = spread_us / 1000.0;
+  printf("同步抓图完成: %zu 台相机, 时间跨度 %.1f ms, 等待 %.1f ms\n",
+         result.size(), last_spread_ms_,
+         (StreamRecorder::nowMicros() - start_us) / 1000.0);
+  return result;
+}
@@ -0,0 +1,72 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 14:52:10
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 14:52:10
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CaptureGroup.h
+ * @Description: 多相机同步抓图：按主机时钟下的成像时刻挑出同一时刻的一组帧
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "CamController.h"
+#include "CancelToken.h"
+
+// 组内一台相机选中的帧
+struct SyncedFrame {
+  std::string camera_type;
+  int stream_type;
+  int64_t host_us;  // 主机单调时钟下的成像时刻
+  int64_t stamp_ms;
+  uint32_t frame_num;
+  int width;
+  int height;
+  double skew_ms;    // 相对组内最早一帧的时间差
+  std::string path;  // 落盘路径，编码/写入失败时为空
+
+  SyncedFrame()
+      : stream_type(0), host_us(0), stamp_ms(0), frame_num(0), width(0),
+        height(0), skew_ms(0.0) {}
+};
+
+// 相机都已登录并开流后加入组；capture 从各相机的帧历史里选出成像时刻
+// 最接近的一组，不需要额外等待画面稳定。组不持有相机，相机须比组活得久。
+class CaptureGroup {
+ public:
+  CaptureGroup();
+
+  // history_depth 为每台相机缓存像素的帧数，25fps 下 8 帧约覆盖 320ms
+  void add(CamController* cam, int history_depth = 8);
+  void clear();
+  size_t size() const { return cams_.size(); }
+
+  void setCancelToken(const CancelToken& token) { cancel_token_ = token; }
+  // 组内各相机的任务号/储位（决定抓图目录），须在 capture 之前、不与之并发调用
+  void setTaskInfo(const std::string& task_id, const std::string& bin_code);
+
+  // 在 timeout_ms 内等到一组各相机成像时刻相差不超过 tolerance_ms 的帧，
+  // 编码为 JPEG 写入各相机的抓图目录后返回；超时或取消返回空。
+  // 只使用调用前 max_age_ms 以内的帧，0 表示只用调用之后的新帧
+  std::vector<SyncedFrame> capture(int tolerance_ms, int timeout_ms,
+                                   int max_age_ms = 0);
+
+  // 上一次 capture 选中组的时间跨度（毫秒），失败为 -1
+  double lastSpreadMs() const { return last_spread_ms_; }
+
+  // 纯匹配：times[i] 为第 i 路按升序排列的帧时刻。以每一帧为锚点，
+  // 各路取离锚点最近的帧，在跨度不超过 tolerance_us 的组合中选最早帧最新的一组
+  static bool match(const std::vector<std::vector<int64_t> >& times,
+                    int64_t tolerance_us, std::vector<size_t>* picks,
+                    int64_t* spread_us);
+
+ private:
+  std::vector<CamController*> cams_;
+  CancelToken cancel_token_;
+  double last_spread_ms_;
+};
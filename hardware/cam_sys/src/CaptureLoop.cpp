@@ -0,0 +1,245 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 16:05:48
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 16:05:48
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CaptureLoop.cpp
+ * @Description: 抓图事件循环：少量线程执行 SDK 回调和定时器驱动的续体，编码等耗时步骤交给工作线程
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "CaptureLoop.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "StreamRecorder.h"
+
+namespace {
+
+thread_local const CaptureLoop* t_loop = NULL;
+
+}  // namespace
+
+bool CaptureTask::start(CaptureLoop* loop) {
+  if (loop->resume(handle_)) {
+    return true;
+  }
+  handle_.destroy();
+  return false;
+}
+
+bool CaptureLoop::Offloaded::await_suspend(std::coroutine_handle<> handle) {
+  // offload 成功后协程随时可能在别的线程恢复，之后不能再碰 this
+  if (loop_->offload(work_, [handle] { handle.resume(); })) {
+    return true;
+  }
+  ok_ = false;
+  return false;
+}
+
+CaptureLoop::CaptureLoop(int threads, int workers)
+    : next_timer_(0),
+      stopping_(false),
+      tasks_(0),
+      fired_(0),
+      cancelled_(0),
+      offloaded_(0),
+      max_lag_us_(0),
+      total_lag_us_(0),
+      work_stopping_(false) {
+  for (int i = 0; i < std::max(1, threads); i++) {
+    threads_.push_back(std::thread(&CaptureLoop::loopThread, this));
+  }
+  for (int i = 0; i < std::max(1, workers); i++) {
+    workers_.push_back(std::thread(&CaptureLoop::workerThread, this));
+  }
+}
+
+CaptureLoop::~CaptureLoop() { stop(); }
+
+bool CaptureLoop::post(const Task& task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      return false;
+    }
+    ready_.push_back(task);
+  }
+  cv_.notify_one();
+  return true;
+}
+
+long CaptureLoop::postAfter(int delay_ms, const Task& task) {
+  const int64_t due = StreamRecorder::nowMicros() +
+                      static_cast<int64_t>(std::max(0, delay_ms)) * 1000;
+  long id = 0;
+  bool earliest = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      return 0;
+    }
+    id = ++next_timer_;
+    earliest = timer_heap_.empty() || due < timer_heap_.top().first;
+    timer_heap_.push(TimerKey(due, id));
+    timers_[id] = task;
+  }
+  // 只有新定时器比原来最早的还早时，等待中的线程才需要重新算超时
+  if (earliest) {
+    cv_.notify_one();
+  }
+  return id;
+}
+
+bool CaptureLoop::cancel(long timer_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (timers_.erase(timer_id) == 0) {
+    return false;
+  }
+  cancelled_++;
+  return true;
+}
+
+bool CaptureLoop::offload(const Task& work, const Task& then) {
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    if (work_stopping_) {
+      return false;
+    }
+    work_.push_back(std::make_pair(work, then));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    offloaded_++;
+  }
+  work_cv_.notify_one();
+  return true;
+}
+
+void CaptureLoop::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    work_stopping_ = true;
+  }
+  cv_.notify_all();
+  work_cv_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++) {
+    if (threads_[i].joinable()) {
+      threads_[i].join();
+    }
+  }
+  for (size_t i = 0; i < workers_.size(); i++) {
+    if (workers_[i].joinable()) {
+      workers_[i].join();
+    }
+  }
+  // 任务里可能持有流程对象，在锁外析构
+  std::deque<Task> ready;
+  std::map<long, Task> timers;
+  std::deque<std::pair<Task, Task> > work;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready.swap(ready_);
+    timers.swap(timers_);
+    while (!timer_heap_.empty()) {
+      timer_heap_.pop();
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    work.swap(work_);
+  }
+}
+
+bool CaptureLoop::inLoop() const { return t_loop == this; }
+
+CaptureLoopStats CaptureLoop::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CaptureLoopStats st;
+  st.tasks = tasks_;
+  st.timers = fired_;
+  st.cancelled = cancelled_;
+  st.offloaded = offloaded_;
+  st.pending_timers = timers_.size();
+  st.max_lag_ms = max_lag_us_ / 1000.0;
+  st.mean_lag_ms = fired_ > 0 ? total_lag_us_ / 1000.0 / fired_ : 0.0;
+  return st;
+}
+
+void CaptureLoop::loopThread() {
+  t_loop = this;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    // 到期的定时器优先于普通任务，超时判定不被积压的任务推迟
+    Task task;
+    bool timer = false;
+    int64_t wait_us = -1;
+    while (!timer_heap_.empty()) {
+      const TimerKey top = timer_heap_.top();
+      std::map<long, Task>::iterator it = timers_.find(top.second);
+      if (it == timers_.end()) {
+        timer_heap_.pop();  // 已撤销
+        continue;
+      }
+      const int64_t now = StreamRecorder::nowMicros();
+      if (top.first > now) {
+        wait_us = top.first - now;
+        break;
+      }
+      timer_heap_.pop();
+      task.swap(it->second);
+      timers_.erase(it);
+      const int64_t lag = now - top.first;
+      max_lag_us_ = std::max(max_lag_us_, lag);
+      total_lag_us_ += lag;
+      fired_++;
+      timer = true;
+      break;
+    }
+    if (!timer && !ready_.empty()) {
+      task.swap(ready_.front());
+      ready_.pop_front();
+      tasks_++;
+    }
+    if (!task) {
+      if (!ready_.empty() || timer) {
+        continue;
+      }
+      if (wait_us < 0) {
+        cv_.wait(lock);
+      } else {
+        cv_.wait_for(lock, std::chrono::microseconds(wait_us));
+      }
+      continue;
+    }
+    lock.unlock();
+    task();
+    task = Task();  // 捕获的对象在锁外析构
+    lock.lock();
+  }
+  t_loop = NULL;
+}
+
+void CaptureLoop::workerThread() {
+  std::unique_lock<std::mutex> lock(work_mutex_);
+  while (true) {
+    work_cv_.wait(lock, [this] { return work_stopping_ || !work_.empty(); });
+    if (work_stopping_) {
+      return;
+    }
+    std::pair<Task, Task> item = work_.front();
+    work_.pop_front();
+    lock.unlock();
+    item.first();
+    if (item.second) {
+      post(item.second);
+    }
+    item = std::pair<Task, Task>();
+    lock.lock();
+  }
+}
@@ -0,0 +1,313 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 16:05:48
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 16:05:48
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CaptureLoop.h
+ * @Description: 抓图事件循环：少量线程执行 SDK 回调和定时器驱动的续体，编码等耗时步骤交给工作线程
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct CaptureLoopStats {
+  uint64_t tasks;           // 执行过的 post 任务
+  uint64_t timers;          // 到期执行的定时器
+  uint64_t cancelled;       // 到期前撤销的定时器
+  uint64_t offloaded;       // 交给工作线程的任务
+  size_t pending_timers;
+  double max_lag_ms;        // 定时器实际执行晚于到期时刻的最大值
+  double mean_lag_ms;
+};
+
+class CaptureLoop;
+
+// 抓图协程的返回类型：start 之后在循环线程上开始执行，跑完自行销毁协程帧。
+// 协程的挂起点（CaptureLoop::offloaded、CaptureWait 的 wait/done）都由循环线程恢复，
+// 同一协程任何时刻只在一个线程上运行。创建后必须 start，否则协程帧不会释放
+class CaptureTask {
+ public:
+  struct promise_type {
+    CaptureTask get_return_object() {
+      return CaptureTask(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  // 循环已停止时销毁协程并返回 false
+  bool start(CaptureLoop* loop);
+
+ private:
+  explicit CaptureTask(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// 抓图流程不再一台相机占一个线程睡眠轮询：每一步发起后立即返回，
+// SDK 回调（登录结果、解码帧、落盘完成）和超时定时器把协程 post 回循环继续，
+// 几十台相机的流程由 threads 个循环线程推进。
+//
+// 循环线程上的任务要短（只做状态切换和非阻塞的 SDK 调用），
+// 否则会推迟其他任务和定时器；编码、停流、登出这类会阻塞的步骤用 offload
+// 放到 workers 个工作线程，完成后 then 回到循环线程（协程里用 co_await offloaded）。
+// 多个循环线程之间不保证顺序，回调形式的续体需自行加锁。线程安全。
+class CaptureLoop {
+ public:
+  typedef std::function<void()> Task;
+
+  // co_await loop->offloaded(work)：work 在工作线程执行，之后协程回到循环线程继续。
+  // 结果为 false 表示循环已停止、work 没有执行
+  class Offloaded {
+   public:
+    Offloaded(CaptureLoop* loop, const Task& work)
+        : loop_(loop), work_(work), ok_(true) {}
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    bool await_resume() const noexcept { return ok_; }
+
+   private:
+    CaptureLoop* loop_;
+    Task work_;
+    bool ok_;
+  };
+
+  explicit CaptureLoop(int threads = 2, int workers = 2);
+  ~CaptureLoop();
+
+  // stop 之后提交的任务直接丢弃，返回 false
+  bool post(const Task& task);
+  // delay_ms 后在循环线程执行，返回定时器编号（stop 之后返回 0）
+  long postAfter(int delay_ms, const Task& task);
+  // 尚未执行的定时器撤销成功返回 true
+  bool cancel(long timer_id);
+  // work 在工作线程执行，结束后 then（可为空）post 回循环线程
+  bool offload(const Task& work, const Task& then = Task());
+  Offloaded offloaded(const Task& work) { return Offloaded(this, work); }
+  // 在循环线程恢复协程
+  bool resume(std::coroutine_handle<> handle) {
+    return post([handle] { handle.resume(); });
+  }
+
+  // 丢弃未执行的任务和定时器并等待线程退出；重复调用是安全的
+  void stop();
+  // 当前线程是否为本循环的循环线程
+  bool inLoop() const;
+
+  CaptureLoopStats stats();
+
+ private:
+  CaptureLoop(const CaptureLoop&);
+  CaptureLoop& operator=(const CaptureLoop&);
+
+  // (到期时刻 us, 定时器编号)，小者先出
+  typedef std::pair<int64_t, long> TimerKey;
+
+  void loopThread();
+  void workerThread();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Task> ready_;
+  std::priority_queue<TimerKey, std::vector<TimerKey>,
+                      std::greater<TimerKey> >
+      timer_heap_;
+  std::map<long, Task> timers_;  // 已撤销的编号不在这里，出堆时跳过
+  long next_timer_;
+  bool stopping_;
+  uint64_t tasks_;
+  uint64_t fired_;
+  uint64_t cancelled_;
+  uint64_t offloaded_;
+  int64_t max_lag_us_;
+  int64_t total_lag_us_;
+
+  std::mutex work_mutex_;
+  std::condition_variable work_cv_;
+  std::deque<std::pair<Task, Task> > work_;
+  bool work_stopping_;
+
+  std::vector<std::thread> threads_;
+  std::vector<std::thread> workers_;
+};
+
+enum CaptureWaitOutcome {
+  kWaitPending = 0,
+  kWaitCompleted,
+  kWaitTimedOut,
+  kWaitCancelled,
+};
+
+// 协程里一次带超时的等待：操作完成（complete）、超时定时器、外部取消（expire）
+// 谁先到谁生效，胜者把协程 post 回循环恢复，晚到的一方被忽略。
+// complete 可在任意线程调用，也可以早于 co_await（操作同步完成）。
+// 超时或取消后操作本身可能还在跑，co_await done() 等它真正结束
+// （例如仍在用相机的登录、编码，结束后才能登出）。线程安全
+template <typename T>
+class CaptureWait : public std::enable_shared_from_this<CaptureWait<T> > {
+ public:
+  class Until {
+   public:
+    Until(CaptureWait* wait, int timeout_ms)
+        : wait_(wait), timeout_ms_(timeout_ms) {}
+    bool await_ready() { return wait_->outcome() != kWaitPending; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      return wait_->suspend(handle, timeout_ms_);
+    }
+    CaptureWaitOutcome await_resume() { return wait_->outcome(); }
+
+   private:
+    CaptureWait* wait_;
+    int timeout_ms_;
+  };
+
+  class Done {
+   public:
+    explicit Done(CaptureWait* wait) : wait_(wait) {}
+    bool await_ready() { return wait_->completed(); }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      return wait_->drain(handle);
+    }
+    void await_resume() {}
+
+   private:
+    CaptureWait* wait_;
+  };
+
+  explicit CaptureWait(CaptureLoop* loop)
+      : loop_(loop),
+        outcome_(kWaitPending),
+        completed_(false),
+        waiting_(false),
+        draining_(false),
+        timer_id_(0) {}
+
+  // co_await wait(ms)：等到完成、超时或取消，返回 CaptureWaitOutcome；
+  // timeout_ms 为负数时不设超时
+  Until wait(int timeout_ms) { return Until(this, timeout_ms); }
+  // co_await done()：等操作真正结束（不论本次等待以什么结束）
+  Done done() { return Done(this); }
+
+  void complete(const T& value) {
+    std::coroutine_handle<> handle;
+    long timer_id = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (completed_) {
+        return;
+      }
+      completed_ = true;
+      value_ = value;
+      if (outcome_ == kWaitPending) {
+        outcome_ = kWaitCompleted;
+        if (waiting_) {
+          handle = handle_;
+          timer_id = timer_id_;
+        }
+      } else if (draining_) {
+        draining_ = false;
+        handle = handle_;
+      }
+    }
+    if (timer_id != 0) {
+      loop_->cancel(timer_id);
+    }
+    if (handle) {
+      loop_->resume(handle);
+    }
+  }
+
+  // 等待尚未结束时以 outcome（超时或取消）结束
+  void expire(CaptureWaitOutcome outcome) {
+    std::coroutine_handle<> handle;
+    long timer_id = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (outcome_ != kWaitPending) {
+        return;
+      }
+      outcome_ = outcome;
+      if (waiting_) {
+        handle = handle_;
+        timer_id = timer_id_;
+      }
+    }
+    if (timer_id != 0) {
+      loop_->cancel(timer_id);
+    }
+    if (handle) {
+      loop_->resume(handle);
+    }
+  }
+
+  CaptureWaitOutcome outcome() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return outcome_;
+  }
+  bool completed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return completed_;
+  }
+  // 完成后才有效
+  const T& value() const { return value_; }
+
+ private:
+  CaptureWait(const CaptureWait&);
+  CaptureWait& operator=(const CaptureWait&);
+
+  // 返回 false 表示已有结果，协程不挂起
+  bool suspend(std::coroutine_handle<> handle, int timeout_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (outcome_ != kWaitPending) {
+      return false;
+    }
+    handle_ = handle;
+    waiting_ = true;
+    if (timeout_ms >= 0) {
+      std::shared_ptr<CaptureWait> self = this->shared_from_this();
+      timer_id_ = loop_->postAfter(
+          timeout_ms, [self] { self->expire(kWaitTimedOut); });
+    }
+    return true;
+  }
+
+  bool drain(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (completed_) {
+      return false;
+    }
+    handle_ = handle;
+    draining_ = true;
+    return true;
+  }
+
+  CaptureLoop* loop_;
+  std::mutex mutex_;
+  CaptureWaitOutcome outcome_;
+  bool completed_;
+  bool waiting_;   // 协程已挂起在 wait 上
+  bool draining_;  // 协程已挂起在 done 上
+  long timer_id_;
+  std::coroutine_handle<> handle_;
+  T value_;
+};
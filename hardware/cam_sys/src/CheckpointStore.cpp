@@ -0,0 +1,473 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 09:26:18
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 09:26:18
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CheckpointStore.cpp
+ * @Description: 单储位检查点：记录已完成的阶段及其产物的内容哈希，重启后从第一个未完成阶段继续
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "CheckpointStore.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+const char* const CheckpointStore::kLogName = "checkpoint.log";
+
+namespace {
+
+const uint64_t kP1 = 11400714785074694791ULL;
+const uint64_t kP2 = 14029467366897019727ULL;
+const uint64_t kP3 = 1609587929392839161ULL;
+const uint64_t kP4 = 9650029242287828579ULL;
+const uint64_t kP5 = 2870177450012600261ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t read64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint32_t read32(const unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+inline uint64_t round64(uint64_t acc, uint64_t input) {
+  acc += input * kP2;
+  acc = rotl(acc, 31);
+  return acc * kP1;
+}
+
+inline uint64_t merge64(uint64_t acc, uint64_t val) {
+  acc ^= round64(0, val);
+  return acc * kP1 + kP4;
+}
+
+int64_t wallMicros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// 逐级创建目录（mkdir -p）
+bool makeDirs(const std::string& dir) {
+  if (dir.empty()) {
+    return false;
+  }
+  for (size_t pos = 1; pos <= dir.size(); pos++) {
+    if (pos < dir.size() && dir[pos] != '/') {
+      continue;
+    }
+    const std::string part = dir.substr(0, pos);
+    if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) {
+      printf("CheckpointStore: 创建目录失败 %s: %s\n", part.c_str(),
+             strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+
+// 字段内的反斜杠、制表符和换行转义，日志一行一条记录
+std::string escape(const std::string& s) {
+  std::string out;
+  out.reserve(s.size());
+  for (size_t i = 0; i < s.size(); i++) {
+    switch (s[i]) {
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      default:
+        out += s[i];
+    }
+  }
+  return out;
+}
+
+std::string unescape(const std::string& s) {
+  std::string out;
+  out.reserve(s.size());
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] != '\\' || i + 1 == s.size()) {
+      out += s[i];
+      continue;
+    }
+    const char c = s[++i];
+    out += c == 't' ? '\t' : c == 'n' ? '\n' : c == 'r' ? '\r' : c;
+  }
+  return out;
+}
+
+std::vector<std::string> split(const std::string& line) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  for (;;) {
+    const size_t tab = line.find('\t', start);
+    if (tab == std::string::npos) {
+      fields.push_back(line.substr(start));
+      return fields;
+    }
+    fields.push_back(line.substr(start, tab - start));
+    start = tab + 1;
+  }
+}
+
+std::string hex64(uint64_t v) {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016" PRIx64, v);
+  return buf;
+}
+
+}  // namespace
+
+uint64_t CheckpointStore::xxh64(const void* data, size_t size,
+                                uint64_t seed) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  const unsigned char* const end = p + size;
+  uint64_t h;
+  if (size >= 32) {
+    const unsigned char* const limit = end - 32;
+    uint64_t v1 = seed + kP1 + kP2;
+    uint64_t v2 = seed + kP2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - kP1;
+    do {
+      v1 = round64(v1, read64(p));
+      v2 = round64(v2, read64(p + 8));
+      v3 = round64(v3, read64(p + 16));
+      v4 = round64(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge64(h, v1);
+    h = merge64(h, v2);
+    h = merge64(h, v3);
+    h = merge64(h, v4);
+  } else {
+    h = seed + kP5;
+  }
+  h += static_cast<uint64_t>(size);
+  for (; p + 8 <= end; p += 8) {
+    h ^= round64(0, read64(p));
+    h = rotl(h, 27) * kP1 + kP4;
+  }
+  if (p + 4 <= end) {
+    h ^= static_cast<uint64_t>(read32(p)) * kP1;
+    h = rotl(h, 23) * kP2 + kP3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= (*p) * kP5;
+    h = rotl(h, 11) * kP1;
+  }
+  h ^= h >> 33;
+  h *= kP2;
+  h ^= h >> 29;
+  h *= kP3;
+  h ^= h >> 32;
+  return h;
+}
+
+bool CheckpointStore::hashFile(const std::string& path, uint64_t* hash,
+                               int64_t* size) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return false;
+  }
+  *size = static_cast<int64_t>(st.st_size);
+  if (st.st_size == 0) {
+    close(fd);
+    *hash = xxh64(NULL, 0);
+    return true;
+  }
+  void* map = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ,
+                   MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  madvise(map, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+  *hash = xxh64(map, static_cast<size_t>(st.st_size));
+  munmap(map, static_cast<size_t>(st.st_size));
+  return true;
+}
+
+CheckpointStore::CheckpointStore(const std::string& dir) : dir_(dir) {
+  while (dir_.size() > 1 && dir_[dir_.size() - 1] == '/') {
+    dir_.erase(dir_.size() - 1);
+  }
+  log_path_ = dir_ + "/" + kLogName;
+  makeDirs(dir_);
+  load();
+}
+
+void CheckpointStore::load() {
+  FILE* fp = fopen(log_path_.c_str(), "rb");
+  if (fp == NULL) {
+    return;
+  }
+  std::string content;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    content.append(buf, n);
+  }
+  fclose(fp);
+
+  // 末尾没有换行说明上次写到一半，截掉残行，否则下一条记录会接在它后面
+  const size_t last_nl = content.rfind('\n');
+  const size_t complete = last_nl == std::string::npos ? 0 : last_nl + 1;
+  if (complete < content.size()) {
+    printf("CheckpointStore: 截掉残缺记录 %s (%zu 字节)\n", log_path_.c_str(),
+           content.size() - complete);
+    if (truncate(log_path_.c_str(), static_cast<off_t>(complete)) != 0) {
+      printf("CheckpointStore: 截断失败 %s: %s\n", log_path_.c_str(),
+             strerror(errno));
+    }
+  }
+  size_t start = 0;
+  int bad = 0;
+  while (start < complete) {
+    const size_t nl = content.find('\n', start);
+    if (!parseLine(content.substr(start, nl - start))) {
+      bad++;
+    }
+    start = nl + 1;
+  }
+  if (bad > 0) {
+    printf("CheckpointStore: %s 有 %d 条记录校验失败，已跳过\n",
+           log_path_.c_str(), bad);
+  }
+}
+
+bool CheckpointStore::parseLine(const std::string& line) {
+  const size_t tab = line.rfind('\t');
+  if (tab == std::string::npos) {
+    return false;
+  }
+  const std::string body = line.substr(0, tab);
+  if (line.substr(tab + 1) != hex64(xxh64(body.data(), body.size()))) {
+    return false;
+  }
+  const std::vector<std::string> f = split(body);
+  if (f.size() < 3) {
+    return false;
+  }
+  const std::string stage = unescape(f[1]);
+  std::vector<std::string>::iterator pos =
+      std::find(order_.begin(), order_.end(), stage);
+  if (pos != order_.end()) {
+    order_.erase(pos);
+  }
+  if (f[0] == "X") {
+    entries_.erase(stage);
+    return true;
+  }
+  if (f[0] != "C" || f.size() < 5) {
+    return false;
+  }
+  CheckpointEntry e;
+  e.stage = stage;
+  e.time_us = strtoll(f[2].c_str(), NULL, 10);
+  const size_t count = strtoul(f[3].c_str(), NULL, 10);
+  if (f.size() != 5 + count * 3) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    e.paths.push_back(unescape(f[4 + i * 3]));
+    e.sizes.push_back(strtoll(f[5 + i * 3].c_str(), NULL, 10));
+    e.hashes.push_back(strtoull(f[6 + i * 3].c_str(), NULL, 16));
+  }
+  e.payload = unescape(f[4 + count * 3]);
+  entries_[stage] = e;
+  order_.push_back(stage);
+  return true;
+}
+
+bool CheckpointStore::append(const std::string& body) {
+  const std::string line =
+      body + "\t" + hex64(xxh64(body.data(), body.size())) + "\n";
+  const int fd =
+      open(log_path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    printf("CheckpointStore: 打开日志失败 %s: %s\n", log_path_.c_str(),
+           strerror(errno));
+    return false;
+  }
+  // O_APPEND 下一次 write 整行追加，同一目录的多个实例不会交错
+  const ssize_t n = write(fd, line.data(), line.size());
+  close(fd);
+  if (n != static_cast<ssize_t>(line.size())) {
+    printf("CheckpointStore: 写日志失败 %s\n", log_path_.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool CheckpointStore::commit(const std::string& stage,
+                             const std::vector<std::string>& artifacts,
+                             const std::string& payload) {
+  CheckpointEntry e;
+  e.stage = stage;
+  e.payload = payload;
+  e.time_us = wallMicros();
+  // 哈希在锁外算，多个阶段并行提交时不互相等待
+  for (size_t i = 0; i < artifacts.size(); i++) {
+    uint64_t hash = 0;
+    int64_t size = 0;
+    if (!hashFile(artifacts[i], &hash, &size)) {
+      printf("CheckpointStore: 阶段 %s 的产物不可读: %s\n", stage.c_str(),
+             artifacts[i].c_str());
+      return false;
+    }
+    e.paths.push_back(artifacts[i]);
+    e.sizes.push_back(size);
+    e.hashes.push_back(hash);
+  }
+  char nums[64];
+  snprintf(nums, sizeof(nums), "\t%" PRId64 "\t%zu", e.time_us,
+           e.paths.size());
+  std::string body = "C\t" + escape(stage) + nums;
+  for (size_t i = 0; i < e.paths.size(); i++) {
+    snprintf(nums, sizeof(nums), "\t%" PRId64 "\t", e.sizes[i]);
+    body += "\t" + escape(e.paths[i]) + nums + hex64(e.hashes[i]);
+  }
+  body += "\t" + escape(payload);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!append(body)) {
+    return false;
+  }
+  std::vector<std::string>::iterator pos =
+      std::find(order_.begin(), order_.end(), stage);
+  if (pos != order_.end()) {
+    order_.erase(pos);
+  }
+  entries_[stage] = e;
+  order_.push_back(stage);
+  return true;
+}
+
+bool CheckpointStore::invalidate(const std::string& stage) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.find(stage) == entries_.end()) {
+    return true;
+  }
+  char stamp[32];
+  snprintf(stamp, sizeof(stamp), "\t%" PRId64, wallMicros());
+  if (!append("X\t" + escape(stage) + stamp)) {
+    return false;
+  }
+  entries_.erase(stage);
+  order_.erase(std::find(order_.begin(), order_.end(), stage));
+  return true;
+}
+
+bool CheckpointStore::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  order_.clear();
+  if (unlink(log_path_.c_str()) != 0 && errno != ENOENT) {
+    printf("CheckpointStore: 删除日志失败 %s: %s\n", log_path_.c_str(),
+           strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool CheckpointStore::verify(const CheckpointEntry& e) const {
+  for (size_t i = 0; i < e.paths.size(); i++) {
+    // 先比大小，截断、重写成别的大小时不必读内容
+    struct stat st;
+    if (stat(e.paths[i].c_str(), &st) != 0 ||
+        static_cast<int64_t>(st.st_size) != e.sizes[i]) {
+      return false;
+    }
+    uint64_t hash = 0;
+    int64_t size = 0;
+    if (!hashFile(e.paths[i], &hash, &size) || size != e.sizes[i] ||
+        hash != e.hashes[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CheckpointStore::has(const std::string& stage) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.find(stage) != entries_.end();
+}
+
+bool CheckpointStore::valid(const std::string& stage) {
+  CheckpointEntry e;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, CheckpointEntry>::const_iterator it =
+        entries_.find(stage);
+    if (it == entries_.end()) {
+      return false;
+    }
+    e = it->second;
+  }
+  return verify(e);
+}
+
+std::string CheckpointStore::payload(const std::string& stage) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, CheckpointEntry>::const_iterator it =
+      entries_.find(stage);
+  return it == entries_.end() ? std::string() : it->second.payload;
+}
+
+int CheckpointStore::resumeAt(const std::vector<std::string>& stages) {
+  for (size_t i = 0; i < stages.size(); i++) {
+    if (!valid(stages[i])) {
+      return static_cast<int>(i);
+    }
+  }
+  return static_cast<int>(stages.size());
+}
+
+std::vector<std::string> CheckpointStore::stages() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return order_;
+}
+
+std::vector<CheckpointEntry> CheckpointStore::entries() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<CheckpointEntry> out;
+  out.reserve(order_.size());
+  for (size_t i = 0; i < order_.size(); i++) {
+    out.push_back(entries_[order_[i]]);
+  }
+  return out;
+}
@@ -0,0 +1,89 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 09:26:18
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 09:26:18
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CheckpointStore.h
+ * @Description: 单储位检查点：记录已完成的阶段及其产物的内容哈希，重启后从第一个未完成阶段继续
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 一个已完成阶段：产物路径、大小和 xxh64 内容哈希，以及阶段结果（调用方的 JSON）
+struct CheckpointEntry {
+  std::string stage;
+  std::string payload;
+  std::vector<std::string> paths;
+  std::vector<int64_t> sizes;
+  std::vector<uint64_t> hashes;
+  int64_t time_us;  // 提交时刻，CLOCK_REALTIME 微秒（跨重启可比）
+};
+
+// 储位目录下的 checkpoint.log 是只追加的日志，每行一条记录并带校验：
+//   C <阶段> <时刻> <产物数> (<路径> <大小> <哈希>)* <结果> <校验>
+//   X <阶段> <时刻> <校验>            （作废）
+// 同一阶段以最后一条为准。进程在写一半时被杀，末尾的残行在下次打开时截掉；
+// 校验不对的行跳过。日志不做 fsync：掉电丢了记录只是多算一遍，
+// 产物没落盘而记录还在时，内容哈希对不上，valid 同样返回 false。
+//
+// valid 会重新读取并哈希所有产物，产物被改写、截断或删除都视为未完成。
+// 线程安全；同一目录可以有多个实例（各自只看到打开时和自己追加的记录）。
+class CheckpointStore {
+ public:
+  static const char* const kLogName;  // "checkpoint.log"
+
+  // dir 不存在时创建
+  explicit CheckpointStore(const std::string& dir);
+
+  const std::string& dir() const { return dir_; }
+
+  // 哈希各产物并追加记录；产物缺失或日志写入失败返回 false
+  bool commit(const std::string& stage,
+              const std::vector<std::string>& artifacts,
+              const std::string& payload);
+  // 追加作废记录，之后 has/valid 返回 false
+  bool invalidate(const std::string& stage);
+  // 删除日志和内存中的记录（产物不动）
+  bool clear();
+
+  // 有记录（不核对产物）
+  bool has(const std::string& stage);
+  // 有记录且所有产物的大小和内容哈希与提交时一致
+  bool valid(const std::string& stage);
+  // 阶段结果；没有记录时为空串
+  std::string payload(const std::string& stage);
+  // 按 stages 的顺序返回第一个不 valid 的下标，全部完成时为 stages.size()
+  int resumeAt(const std::vector<std::string>& stages);
+  // 有记录的阶段，按最近一次提交的先后
+  std::vector<std::string> stages();
+  std::vector<CheckpointEntry> entries();
+
+  // 文件的 xxh64（种子 0）；读取失败返回 false
+  static bool hashFile(const std::string& path, uint64_t* hash,
+                       int64_t* size);
+  static uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+ private:
+  CheckpointStore(const CheckpointStore&);
+  CheckpointStore& operator=(const CheckpointStore&);
+
+  void load();
+  bool parseLine(const std::string& line);
+  bool append(const std::string& body);
+  bool verify(const CheckpointEntry& e) const;
+
+  std::mutex mutex_;
+  std::string dir_;
+  std::string log_path_;
+  std::map<std::string, CheckpointEntry> entries_;
+  std::vector<std::string> order_;
+};
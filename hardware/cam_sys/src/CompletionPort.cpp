@@ -0,0 +1,141 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 19:37:52
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 19:37:52
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CompletionPort.cpp
+ * @Description: 原生异步操作的完成端口：任意线程投递完成，事件循环经 eventfd 成批取走
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "CompletionPort.h"
+
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "StreamRecorder.h"
+
+CompletionPort::CompletionPort()
+    : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      next_token_(0),
+      completed_(0),
+      dropped_(0),
+      signals_(0),
+      batches_(0),
+      max_batch_(0),
+      max_latency_us_(0) {
+  if (fd_ < 0) {
+    printf("CompletionPort: eventfd 创建失败，只能轮询 drain\n");
+  }
+}
+
+CompletionPort::~CompletionPort() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+long CompletionPort::reserve() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const long token = ++next_token_;
+  outstanding_[token] = std::function<void()>();
+  return token;
+}
+
+bool CompletionPort::onCancel(long token, const std::function<void()>& fn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unordered_map<long, std::function<void()> >::iterator it =
+      outstanding_.find(token);
+  if (it == outstanding_.end()) {
+    return false;
+  }
+  it->second = fn;
+  return true;
+}
+
+bool CompletionPort::complete(long token, const std::shared_ptr<void>& value) {
+  std::function<void()> hook;  // 在锁外析构
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unordered_map<long, std::function<void()> >::iterator it =
+      outstanding_.find(token);
+  if (it == outstanding_.end()) {
+    dropped_++;
+    return false;
+  }
+  hook.swap(it->second);
+  outstanding_.erase(it);
+  PortCompletion c;
+  c.token = token;
+  c.value = value;
+  c.done_us = StreamRecorder::nowMicros();
+  ready_.push_back(c);
+  // 就绪表原本非空时事件循环已被唤醒、尚未 drain，不必再写
+  if (ready_.size() == 1 && fd_ >= 0) {
+    const uint64_t one = 1;
+    if (write(fd_, &one, sizeof(one)) != sizeof(one)) {
+      // 计数器溢出前 drain 一定会被调用，失败可忽略
+    }
+    signals_++;
+  }
+  return true;
+}
+
+bool CompletionPort::cancel(long token) {
+  std::function<void()> hook;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<long, std::function<void()> >::iterator it =
+        outstanding_.find(token);
+    if (it == outstanding_.end()) {
+      return false;
+    }
+    hook.swap(it->second);
+    outstanding_.erase(it);
+  }
+  // 回调可能同步走到 complete（如流程撤销后立即结束），不能持锁调用
+  if (hook) {
+    hook();
+  }
+  return true;
+}
+
+std::vector<PortCompletion> CompletionPort::drain() {
+  std::vector<PortCompletion> out;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ >= 0) {
+    uint64_t count = 0;
+    if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+      // EAGAIN：没有新的完成
+    }
+  }
+  out.swap(ready_);
+  if (!out.empty()) {
+    const int64_t now = StreamRecorder::nowMicros();
+    batches_++;
+    completed_ += out.size();
+    max_batch_ = std::max(max_batch_, out.size());
+    max_latency_us_ = std::max(max_latency_us_, now - out.front().done_us);
+  }
+  return out;
+}
+
+size_t CompletionPort::outstanding() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return outstanding_.size();
+}
+
+PortStats CompletionPort::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PortStats st;
+  st.completed = completed_;
+  st.dropped = dropped_;
+  st.signals = signals_;
+  st.batches = batches_;
+  st.max_batch = max_batch_;
+  st.outstanding = outstanding_.size();
+  st.max_latency_ms = max_latency_us_ / 1000.0;
+  return st;
+}
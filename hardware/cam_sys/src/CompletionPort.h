@@ -0,0 +1,82 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 19:37:52
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 19:37:52
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/CompletionPort.h
+ * @Description: 原生异步操作的完成端口：任意线程投递完成，事件循环经 eventfd 成批取走
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// 一次完成：token 为 reserve 返回的编号，value 由发起方决定类型
+struct PortCompletion {
+  long token;
+  std::shared_ptr<void> value;
+  int64_t done_us;  // complete 时刻，CLOCK_MONOTONIC
+};
+
+struct PortStats {
+  uint64_t completed;      // 已交给 drain 的完成
+  uint64_t dropped;        // 撤销之后才到、被丢弃的完成
+  uint64_t signals;        // 写 eventfd 的次数
+  uint64_t batches;        // 取到完成的 drain 次数
+  size_t max_batch;        // 单次 drain 取到的最多完成数
+  size_t outstanding;      // 已登记、尚未完成或撤销
+  double max_latency_ms;   // complete 到被 drain 取走的最大间隔
+};
+
+// 原生操作发起前 reserve 一个编号，完成时在任意线程 complete(编号, 结果)；
+// 完成线程不碰 Python，也不需要 GIL。
+//
+// 只有就绪表由空变为非空时才写 eventfd，事件循环被唤醒一次、drain 一次
+// 取走这期间积累的全部完成，唤醒次数随完成的密度下降。线程安全。
+class CompletionPort {
+ public:
+  CompletionPort();
+  ~CompletionPort();
+
+  // eventfd（非阻塞），有完成待取时可读；创建失败时为 -1，此时只能轮询 drain
+  int fd() const { return fd_; }
+
+  long reserve();
+  // 登记撤销时要做的事（如取消对应的原生操作）；编号已完成或已撤销时返回 false
+  bool onCancel(long token, const std::function<void()>& fn);
+  // 投递完成；编号已撤销或无效时丢弃并返回 false
+  bool complete(long token, const std::shared_ptr<void>& value);
+  // 撤销尚未完成的编号并在当前线程调用 onCancel 登记的回调；
+  // 返回 false 表示已经完成（结果在下一次 drain 里）或编号无效
+  bool cancel(long token);
+
+  // 取走所有已完成的结果并清零 eventfd
+  std::vector<PortCompletion> drain();
+
+  size_t outstanding();
+  PortStats stats();
+
+ private:
+  CompletionPort(const CompletionPort&);
+  CompletionPort& operator=(const CompletionPort&);
+
+  std::mutex mutex_;
+  int fd_;
+  long next_token_;
+  std::unordered_map<long, std::function<void()> > outstanding_;
+  std::vector<PortCompletion> ready_;
+  uint64_t completed_;
+  uint64_t dropped_;
+  uint64_t signals_;
+  uint64_t batches_;
+  size_t max_batch_;
+  int64_t max_latency_us_;
+};
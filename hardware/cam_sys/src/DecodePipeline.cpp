@@ -0,0 +1,177 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 23:05:41
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 23:05:41
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/DecodePipeline.cpp
+ * @Description: 多线程 JPEG 预取解码，按提交顺序交付，在途结果有上限
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "DecodePipeline.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <utility>
+
+namespace {
+
+double elapsedMs(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+}  // namespace
+
+DecodePipeline::DecodePipeline(int threads, int depth)
+    : depth_(depth > 0 ? depth : 1),
+      claimed_(0),
+      delivered_(0),
+      finished_(false),
+      stop_(false) {
+  memset(&stats_, 0, sizeof(stats_));
+  slots_.resize(depth_);
+  if (threads <= 0) {
+    threads = 1;
+  }
+  // 线程多于窗口没有意义：多出来的线程永远领不到任务
+  if (threads > depth_) {
+    threads = depth_;
+  }
+  for (int i = 0; i < threads; i++) {
+    threads_.push_back(std::thread(&DecodePipeline::run, this));
+  }
+}
+
+DecodePipeline::~DecodePipeline() { close(); }
+
+void DecodePipeline::submit(const std::vector<DecodeJob>& jobs) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_ || stop_) {
+      printf("[DecodePipeline] 已结束提交，忽略 %zu 个任务\n", jobs.size());
+      return;
+    }
+    pending_.insert(pending_.end(), jobs.begin(), jobs.end());
+    stats_.submitted += jobs.size();
+  }
+  work_cv_.notify_all();
+}
+
+void DecodePipeline::finish() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  finished_ = true;
+  ready_cv_.notify_all();
+}
+
+bool DecodePipeline::done() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stop_ || (finished_ && pending_.empty() && delivered_ == claimed_);
+}
+
+void DecodePipeline::run() {
+  JpegDecoder decoder;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    const std::chrono::steady_clock::time_point wait_start =
+        std::chrono::steady_clock::now();
+    bool stalled = false;
+    while (!stop_ && (pending_.empty() ||
+                      claimed_ >= delivered_ + static_cast<uint64_t>(depth_))) {
+      stalled = stalled || !pending_.empty();
+      work_cv_.wait(lock);
+    }
+    if (stalled) {
+      stats_.stall_ms += elapsedMs(wait_start);
+    }
+    if (stop_) {
+      return;
+    }
+    const uint64_t seq = claimed_++;
+    DecodeJob job;
+    job.tag = pending_.front().tag;
+    job.path.swap(pending_.front().path);
+    job.options = pending_.front().options;
+    pending_.pop_front();
+    lock.unlock();
+
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    DecodeResult result;
+    result.tag = job.tag;
+    result.ok = decoder.decodeFile(job.path, job.options, &result.image);
+    result.decode_ms = elapsedMs(start);
+    result.path.swap(job.path);
+
+    lock.lock();
+    if (stop_) {
+      return;
+    }
+    stats_.decode_ms += result.decode_ms;
+    if (result.ok) {
+      stats_.pixel_bytes += result.image.data->size();
+    }
+    Slot& slot = slots_[seq % depth_];
+    slot.result = std::move(result);
+    slot.ready = true;
+    if (seq == delivered_) {
+      ready_cv_.notify_all();
+    }
+  }
+}
+
+bool DecodePipeline::next(DecodeResult* out, int timeout_ms) {
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(mutex_);
+  Slot* slot = NULL;
+  bool ready = ready_cv_.wait_for(
+      lock, std::chrono::milliseconds(timeout_ms > 0 ? timeout_ms : 0), [&] {
+        if (stop_) {
+          return true;
+        }
+        slot = &slots_[delivered_ % depth_];
+        return slot->ready ||
+               (finished_ && pending_.empty() && delivered_ == claimed_);
+      });
+  stats_.wait_ms += elapsedMs(start);
+  if (!ready || stop_ || !slot->ready) {
+    return false;
+  }
+  *out = std::move(slot->result);
+  slot->result = DecodeResult();
+  slot->ready = false;
+  delivered_++;
+  stats_.delivered++;
+  if (!out->ok) {
+    stats_.failed++;
+  }
+  lock.unlock();
+  // 窗口前移一格，停着的解码线程可以领下一个任务
+  work_cv_.notify_one();
+  return true;
+}
+
+void DecodePipeline::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_ && threads_.empty()) {
+      return;
+    }
+    stop_ = true;
+    pending_.clear();
+  }
+  work_cv_.notify_all();
+  ready_cv_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++) {
+    threads_[i].join();
+  }
+  threads_.clear();
+}
+
+DecodeStats DecodePipeline::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
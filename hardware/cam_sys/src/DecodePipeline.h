@@ -0,0 +1,98 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 23:05:41
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 23:05:41
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/DecodePipeline.h
+ * @Description: 多线程 JPEG 预取解码，按提交顺序交付，在途结果有上限
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "JpegDecoder.h"
+
+struct DecodeJob {
+  int64_t tag;  // 调用方的编号，原样带回
+  std::string path;
+  DecodeOptions options;
+
+  DecodeJob() : tag(0) {}
+};
+
+struct DecodeResult {
+  int64_t tag;
+  std::string path;
+  bool ok;
+  DecodedImage image;  // ok 为 false 时为空
+  double decode_ms;    // 读文件加解码
+
+  DecodeResult() : tag(0), ok(false), decode_ms(0.0) {}
+};
+
+struct DecodeStats {
+  uint64_t submitted;
+  uint64_t delivered;   // 已被 next 取走
+  uint64_t failed;      // 其中解码失败的
+  uint64_t pixel_bytes; // 解码输出的总字节
+  double decode_ms;     // 各线程解码耗时之和
+  double wait_ms;       // next 等结果的时间：大说明解码跟不上
+  double stall_ms;      // 解码线程因窗口满而停的时间：大说明消费跟不上
+};
+
+// 批量重识别的解码前端：解码线程按提交顺序领任务，已领未取走的任务
+// 不超过 depth 个，next() 严格按提交顺序交付。在途像素内存因此不超过
+// depth 张图，消费者慢时解码线程停下等待，而不是把整批图解进内存。
+class DecodePipeline {
+ public:
+  DecodePipeline(int threads, int depth);
+  ~DecodePipeline();
+
+  // 追加任务，不阻塞；finish() 之后提交的任务被忽略
+  void submit(const std::vector<DecodeJob>& jobs);
+  // 不再提交：已提交的全部交付后 next 返回 false、done() 为 true
+  void finish();
+  // 取下一张（提交顺序）；等待超过 timeout_ms 或已全部交付时返回 false
+  bool next(DecodeResult* out, int timeout_ms);
+  bool done();
+  // 停止解码线程，丢弃未交付的结果；析构时自动调用
+  void close();
+
+  DecodeStats stats();
+
+ private:
+  DecodePipeline(const DecodePipeline&);
+  DecodePipeline& operator=(const DecodePipeline&);
+
+  struct Slot {
+    bool ready;
+    DecodeResult result;
+
+    Slot() : ready(false) {}
+  };
+
+  void run();
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;   // 有可领的任务或关闭
+  std::condition_variable ready_cv_;  // 下一个要交付的结果就绪
+  std::vector<std::thread> threads_;
+  std::deque<DecodeJob> pending_;     // 未领的任务，队首序号为 claimed_
+  std::vector<Slot> slots_;           // 序号 % depth，窗口 [delivered_, claimed_)
+  const int depth_;
+  uint64_t claimed_;
+  uint64_t delivered_;
+  bool finished_;
+  bool stop_;
+  DecodeStats stats_;
+};
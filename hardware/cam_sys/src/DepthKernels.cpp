@@ -0,0 +1,719 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 19:05:37
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 19:05:37
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/DepthKernels.cpp
+ * @Description: SGBM 视差后处理与深度点云分层（水平面分割）
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "DepthKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// 每块至少这么多行，小图不值得开线程
+const int kMinRowsPerBand = 32;
+const int kMaxThreads = 8;
+
+int bandCount(int height, int threads) {
+  if (threads <= 0) {
+    threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (threads <= 0) {
+      threads = 1;
+    }
+    threads = std::min(threads, kMaxThreads);
+  }
+  return std::max(1, std::min(threads, height / kMinRowsPerBand));
+}
+
+// 把 [0, height) 按行切成 bands 块，fn(y0, y1, band) 在各自线程上跑
+template <typename Fn>
+void parallelRows(int height, int bands, Fn fn) {
+  if (bands <= 1) {
+    fn(0, height, 0);
+    return;
+  }
+  std::vector<std::thread> workers;
+  workers.reserve(bands - 1);
+  for (int b = 1; b < bands; b++) {
+    const int y0 = static_cast<int>(static_cast<int64_t>(height) * b / bands);
+    const int y1 =
+        static_cast<int>(static_cast<int64_t>(height) * (b + 1) / bands);
+    workers.push_back(std::thread(fn, y0, y1, b));
+  }
+  fn(0, height / bands, 0);
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+inline int16_t med3(int16_t a, int16_t b, int16_t c) {
+  return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+int countValid(const uint8_t* mask, size_t n) {
+  int count = 0;
+  for (size_t i = 0; i < n; i++) {
+    count += mask[i];
+  }
+  return count;
+}
+
+// ROI 内反投影出的采样点（SoA，便于逐分量向量化）
+struct PointCloud {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<int> px;  // 深度图像素坐标
+  std::vector<int> py;
+
+  void append(const PointCloud& other) {
+    x.insert(x.end(), other.x.begin(), other.x.end());
+    y.insert(y.end(), other.y.begin(), other.y.end());
+    z.insert(z.end(), other.z.begin(), other.z.end());
+    px.insert(px.end(), other.px.begin(), other.px.end());
+    py.insert(py.end(), other.py.begin(), other.py.end());
+  }
+};
+
+// 3x3 对称矩阵最小特征值对应的特征向量（Jacobi 旋转），用于平面拟合求法向
+void smallestEigenvector(double a[3][3], double out[3]) {
+  double v[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+  for (int sweep = 0; sweep < 32; sweep++) {
+    const double off =
+        a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if (off < 1e-18) {
+      break;
+    }
+    for (int p = 0; p < 2; p++) {
+      for (int q = p + 1; q < 3; q++) {
+        if (fabs(a[p][q]) < 1e-30) {
+          continue;
+        }
+        const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        const double t = (theta >= 0.0 ? 1.0 : -1.0) /
+                         (fabs(theta) + sqrt(theta * theta + 1.0));
+        const double c = 1.0 / sqrt(t * t + 1.0);
+        const double sn = t * c;
+        for (int k = 0; k < 3; k++) {
+          const double akp = a[k][p];
+          const double akq = a[k][q];
+          a[k][p] = c * akp - sn * akq;
+          a[k][q] = sn * akp + c * akq;
+        }
+        for (int k = 0; k < 3; k++) {
+          const double apk = a[p][k];
+          const double aqk = a[q][k];
+          a[p][k] = c * apk - sn * aqk;
+          a[q][k] = sn * apk + c * aqk;
+        }
+        for (int k = 0; k < 3; k++) {
+          const double vkp = v[k][p];
+          const double vkq = v[k][q];
+          v[k][p] = c * vkp - sn * vkq;
+          v[k][q] = sn * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  int m = 0;
+  for (int i = 1; i < 3; i++) {
+    if (a[i][i] < a[m][m]) {
+      m = i;
+    }
+  }
+  for (int i = 0; i < 3; i++) {
+    out[i] = v[i][m];
+  }
+}
+
+// q 分位（0~1），values 会被重排
+template <typename T>
+T percentile(std::vector<T>* values, double q) {
+  if (values->empty()) {
+    return T();
+  }
+  const size_t k = std::min(values->size() - 1,
+                            static_cast<size_t>(q * (values->size() - 1) + 0.5));
+  std::nth_element(values->begin(), values->begin() + k, values->end());
+  return (*values)[k];
+}
+
+}  // namespace
+
+void DepthKernels::invalidMask(const int16_t* disp, int width, int height,
+                               int min_disparity, int grow, uint8_t* mask,
+                               int threads) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  const int16_t min_d = static_cast<int16_t>(min_disparity);
+  const int bands = bandCount(height, threads);
+  if (grow <= 0) {
+    parallelRows(height, bands, [=](int y0, int y1, int) {
+      const size_t begin = static_cast<size_t>(y0) * width;
+      const size_t end = static_cast<size_t>(y1) * width;
+      for (size_t i = begin; i < end; i++) {
+        mask[i] = disp[i] > min_d ? 1 : 0;
+      }
+    });
+    return;
+  }
+
+  // 方形邻域腐蚀有效区 = 水平与垂直两遍一维“与”
+  std::vector<uint8_t> tmp(static_cast<size_t>(width) * height);
+  uint8_t* h = &tmp[0];
+  parallelRows(height, bands, [=](int y0, int y1, int) {
+    std::vector<uint8_t> valid(width);
+    for (int y = y0; y < y1; y++) {
+      const int16_t* src = disp + static_cast<size_t>(y) * width;
+      uint8_t* out = h + static_cast<size_t>(y) * width;
+      for (int x = 0; x < width; x++) {
+        valid[x] = src[x] > min_d ? 1 : 0;
+      }
+      memcpy(out, &valid[0], width);
+      for (int k = 1; k <= grow && k < width; k++) {
+        for (int x = k; x < width; x++) {
+          out[x] &= valid[x - k];
+        }
+        for (int x = 0; x < width - k; x++) {
+          out[x] &= valid[x + k];
+        }
+      }
+    }
+  });
+  parallelRows(height, bands, [=](int y0, int y1, int) {
+    for (int y = y0; y < y1; y++) {
+      uint8_t* out = mask + static_cast<size_t>(y) * width;
+      memcpy(out, h + static_cast<size_t>(y) * width, width);
+      const int top = std::max(0, y - grow);
+      const int bottom = std::min(height - 1, y + grow);
+      for (int yy = top; yy <= bottom; yy++) {
+        if (yy == y) {
+          continue;
+        }
+        const uint8_t* row = h + static_cast<size_t>(yy) * width;
+        for (int x = 0; x < width; x++) {
+          out[x] &= row[x];
+        }
+      }
+    }
+  });
+}
+
+void DepthKernels::median3x3(const int16_t* src, int width, int height,
+                             int16_t* dst, int threads) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  // 先把每列的三个值排好序（lo/mid/hi），中值 = med3(三列 lo 的最大值,
+  // 三列 mid 的中值, 三列 hi 的最小值)。两端各补一列复制边界
+  parallelRows(height, bandCount(height, threads), [=](int y0, int y1, int) {
+    std::vector<int16_t> lo(width + 2);
+    std::vector<int16_t> mid(width + 2);
+    std::vector<int16_t> hi(width + 2);
+    for (int y = y0; y < y1; y++) {
+      const int16_t* a = src + static_cast<size_t>(std::max(0, y - 1)) * width;
+      const int16_t* b = src + static_cast<size_t>(y) * width;
+      const int16_t* c =
+          src + static_cast<size_t>(std::min(height - 1, y + 1)) * width;
+      int16_t* l = &lo[1];
+      int16_t* m = &mid[1];
+      int16_t* u = &hi[1];
+      for (int x = 0; x < width; x++) {
+        const int16_t p = std::min(a[x], b[x]);
+        const int16_t q = std::max(a[x], b[x]);
+        l[x] = std::min(p, c[x]);
+        u[x] = std::max(q, c[x]);
+        m[x] = std::max(p, std::min(q, c[x]));
+      }
+      lo[0] = lo[1];
+      mid[0] = mid[1];
+      hi[0] = hi[1];
+      lo[width + 1] = lo[width];
+      mid[width + 1] = mid[width];
+      hi[width + 1] = hi[width];
+      int16_t* out = dst + static_cast<size_t>(y) * width;
+      for (int x = 0; x < width; x++) {
+        const int16_t max_lo = std::max(std::max(lo[x], lo[x + 1]), lo[x + 2]);
+        const int16_t min_hi = std::min(std::min(hi[x], hi[x + 1]), hi[x + 2]);
+        const int16_t med_mid = med3(mid[x], mid[x + 1], mid[x + 2]);
+        out[x] = med3(max_lo, med_mid, min_hi);
+      }
+    }
+  });
+}
+
+int DepthKernels::jointBilateralFill(int16_t* disp, uint8_t* mask,
+                                     const uint8_t* guide, int width,
+                                     int height,
+                                     const DepthFillOptions& options) {
+  const int r = options.fill_radius;
+  if (width <= 0 || height <= 0 || r <= 0 || guide == NULL) {
+    return 0;
+  }
+  const double sigma_s =
+      options.sigma_space > 0.0 ? options.sigma_space : std::max(1.0, r / 2.0);
+  const double sigma_c = std::max(1.0, options.sigma_color);
+  // 查表均以差值居中：ws[r + dx]、wc[255 + dg]，内层循环不用取绝对值和分支
+  std::vector<float> ws(2 * r + 1);
+  for (int d = -r; d <= r; d++) {
+    ws[r + d] = static_cast<float>(exp(-0.5 * d * d / (sigma_s * sigma_s)));
+  }
+  std::vector<float> wc(511);
+  for (int d = -255; d <= 255; d++) {
+    wc[255 + d] = static_cast<float>(exp(-0.5 * d * d / (sigma_c * sigma_c)));
+  }
+  const float* wsp = &ws[0];
+  const float* wcp = &wc[0];
+  const float min_weight = static_cast<float>(options.min_weight);
+
+  // 水平一遍：有效点原样带权重 1，无效点用同行有效邻点加权，权重和作为置信度
+  const size_t total = static_cast<size_t>(width) * height;
+  std::vector<float> hval(total);
+  std::vector<float> hconf(total);
+  float* hv = &hval[0];
+  float* hc = &hconf[0];
+  const int bands = bandCount(height, options.threads);
+  parallelRows(height, bands, [=](int y0, int y1, int) {
+    std::vector<int> prefix(width + 1);
+    for (int y = y0; y < y1; y++) {
+      const size_t row = static_cast<size_t>(y) * width;
+      const int16_t* d = disp + row;
+      const uint8_t* mk = mask + row;
+      const uint8_t* g = guide + row;
+      // 有效点前缀和：窗口内没有有效点（大空洞内部）的直接跳过
+      prefix[0] = 0;
+      for (int x = 0; x < width; x++) {
+        prefix[x + 1] = prefix[x] + mk[x];
+      }
+      for (int x = 0; x < width; x++) {
+        if (mk[x]) {
+          hv[row + x] = d[x];
+          hc[row + x] = 1.0f;
+          continue;
+        }
+        const int x0 = std::max(0, x - r);
+        const int x1 = std::min(width - 1, x + r);
+        if (prefix[x1 + 1] == prefix[x0]) {
+          hv[row + x] = 0.0f;
+          hc[row + x] = 0.0f;
+          continue;
+        }
+        const float* wsx = wsp + r - x + x0;
+        const float* wcg = wcp + 255 - g[x];
+        float acc = 0.0f;
+        float wsum = 0.0f;
+        for (int xx = x0; xx <= x1; xx++) {
+          const float w = wsx[xx - x0] * wcg[g[xx]] * mk[xx];
+          acc += w * d[xx];
+          wsum += w;
+        }
+        hv[row + x] = wsum > 0.0f ? acc / wsum : 0.0f;
+        hc[row + x] = std::min(wsum, 1.0f);
+      }
+    }
+  });
+
+  // 垂直一遍：对原本无效的点在同列上综合水平结果，按置信度再加权
+  std::vector<int> filled(bands, 0);
+  int* filled_p = &filled[0];
+  std::vector<uint8_t> newly(total, 0);
+  uint8_t* newly_p = &newly[0];
+  parallelRows(height, bands, [=](int y0, int y1, int band) {
+    int count = 0;
+    // 各列窗口 [y-r, y+r] 内有水平结果的点数，逐行滑动更新
+    std::vector<int> column(width, 0);
+    for (int yy = std::max(0, y0 - r); yy < std::min(height, y0 + r); yy++) {
+      const float* c = hc + static_cast<size_t>(yy) * width;
+      for (int x = 0; x < width; x++) {
+        column[x] += c[x] > 0.0f;
+      }
+    }
+    for (int y = y0; y < y1; y++) {
+      const size_t row = static_cast<size_t>(y) * width;
+      const int top = std::max(0, y - r);
+      const int bottom = std::min(height - 1, y + r);
+      if (y + r < height) {
+        const float* c = hc + static_cast<size_t>(y + r) * width;
+        for (int x = 0; x < width; x++) {
+          column[x] += c[x] > 0.0f;
+        }
+      }
+      if (y - r - 1 >= 0) {
+        const float* c = hc + static_cast<size_t>(y - r - 1) * width;
+        for (int x = 0; x < width; x++) {
+          column[x] -= c[x] > 0.0f;
+        }
+      }
+      for (int x = 0; x < width; x++) {
+        if (mask[row + x] || column[x] == 0) {
+          continue;
+        }
+        const float* wsy = wsp + r - y + top;
+        const float* wcg = wcp + 255 - guide[row + x];
+        float acc = 0.0f;
+        float wsum = 0.0f;
+        for (int yy = top; yy <= bottom; yy++) {
+          const size_t i = static_cast<size_t>(yy) * width + x;
+          const float w = wsy[yy - top] * wcg[guide[i]] * hc[i];
+          acc += w * hv[i];
+          wsum += w;
+        }
+        if (wsum >= min_weight) {
+          disp[row + x] = static_cast<int16_t>(lrintf(acc / wsum));
+          newly_p[row + x] = 1;
+          count++;
+        }
+      }
+    }
+    filled_p[band] = count;
+  });
+
+  // 填上的点最后统一置有效，垂直一遍只读原始掩码
+  int total_filled = 0;
+  for (int b = 0; b < bands; b++) {
+    total_filled += filled[b];
+  }
+  for (size_t i = 0; i < total; i++) {
+    mask[i] |= newly[i];
+  }
+  return total_filled;
+}
+
+DepthFillStats DepthKernels::postprocess(int16_t* disp, const uint8_t* guide,
+                                         int width, int height,
+                                         const DepthFillOptions& options) {
+  DepthFillStats stats;
+  memset(&stats, 0, sizeof(stats));
+  if (disp == NULL || width <= 0 || height <= 0) {
+    return stats;
+  }
+  const size_t total = static_cast<size_t>(width) * height;
+  const int16_t min_d = static_cast<int16_t>(options.min_disparity);
+  for (size_t i = 0; i < total; i++) {
+    stats.valid_before += disp[i] > min_d ? 1 : 0;
+  }
+
+  std::vector<uint8_t> mask(total);
+  invalidMask(disp, width, height, options.min_disparity,
+              options.invalid_grow, &mask[0], options.threads);
+  stats.masked = stats.valid_before - countValid(&mask[0], total);
+
+  if (options.median) {
+    std::vector<int16_t> med(total);
+    median3x3(disp, width, height, &med[0], options.threads);
+    // 只在结果仍有效时替换：不扩散时空洞边缘的中值可能混进无效值
+    for (size_t i = 0; i < total; i++) {
+      const bool use = (mask[i] != 0) & (med[i] > min_d);
+      disp[i] = use ? med[i] : disp[i];
+    }
+  }
+
+  // 被扩散掉的点先标成无效值，填洞只参考掩码内的点
+  const int16_t invalid = static_cast<int16_t>(options.min_disparity - 16);
+  for (size_t i = 0; i < total; i++) {
+    disp[i] = mask[i] ? disp[i] : invalid;
+  }
+  stats.filled = jointBilateralFill(disp, &mask[0], guide, width, height,
+                                    options);
+  stats.valid_after = countValid(&mask[0], total);
+  return stats;
+}
+
+LayerSegResult DepthKernels::segmentLayers(const float* depth, int width,
+                                           int height,
+                                           const CameraIntrinsics& intrinsics,
+                                           const PixelRect& roi,
+                                           const LayerSegOptions& options) {
+  LayerSegResult result;
+  if (depth == NULL || width <= 0 || height <= 0 || intrinsics.fx <= 0.0 ||
+      intrinsics.fy <= 0.0) {
+    return result;
+  }
+  const int x0 = std::max(0, roi.x);
+  const int y0 = std::max(0, roi.y);
+  const int x1 = std::min(width, roi.x + roi.width);
+  const int y1 = std::min(height, roi.y + roi.height);
+  if (x1 <= x0 || y1 <= y0) {
+    return result;
+  }
+  const int stride = std::max(1, options.stride);
+  const int rows = (y1 - y0 + stride - 1) / stride;
+  const float min_z = static_cast<float>(options.min_depth_mm);
+  const float max_z = static_cast<float>(options.max_depth_mm);
+  const float inv_fx = static_cast<float>(1.0 / intrinsics.fx);
+  const float inv_fy = static_cast<float>(1.0 / intrinsics.fy);
+  const float cx = static_cast<float>(intrinsics.cx);
+  const float cy = static_cast<float>(intrinsics.cy);
+
+  // 1. 反投影：X = (u - cx) * Z / fx，Y = (v - cy) * Z / fy（Y 向下）
+  const int bands = bandCount(rows, options.threads);
+  std::vector<PointCloud> parts(bands);
+  parallelRows(rows, bands, [&](int r0, int r1, int band) {
+    PointCloud& part = parts[band];
+    for (int r = r0; r < r1; r++) {
+      const int v = y0 + r * stride;
+      const float* row = depth + static_cast<size_t>(v) * width;
+      const float ry = (v - cy) * inv_fy;
+      for (int u = x0; u < x1; u += stride) {
+        const float z = row[u];
+        if (!(z >= min_z && z <= max_z)) {
+          continue;
+        }
+        part.x.push_back((u - cx) * inv_fx * z);
+        part.y.push_back(ry * z);
+        part.z.push_back(z);
+        part.px.push_back(u);
+        part.py.push_back(v);
+      }
+    }
+  });
+  PointCloud cloud;
+  for (int b = 0; b < bands; b++) {
+    cloud.append(parts[b]);
+  }
+  const int n = static_cast<int>(cloud.z.size());
+  result.valid_points = n;
+  if (n < 3) {
+    return result;
+  }
+
+  // 2. RANSAC：在均匀抽取的子集上找法向接近先验 -Y 的最大平面，作为竖直方向
+  const int m = std::min(n, std::max(3, options.ransac_samples));
+  std::vector<float> sx(m);
+  std::vector<float> sy(m);
+  std::vector<float> sz(m);
+  for (int i = 0; i < m; i++) {
+    const int k = static_cast<int>(static_cast<int64_t>(i) * n / m);
+    sx[i] = cloud.x[k];
+    sy[i] = cloud.y[k];
+    sz[i] = cloud.z[k];
+  }
+  const float tol = static_cast<float>(options.surface_tolerance_mm);
+  const double cos_max = cos(options.max_tilt_deg * M_PI / 180.0);
+  const int iterations = std::max(1, options.ransac_iterations);
+  const int ransac_bands = bandCount(iterations, options.threads);
+  std::vector<int> best_count(ransac_bands, 0);
+  std::vector<float> best_plane(ransac_bands * 4, 0.0f);
+  parallelRows(iterations, ransac_bands, [&](int i0, int i1, int band) {
+    uint32_t seed = 2654435761u * static_cast<uint32_t>(band + 1);
+    for (int it = i0; it < i1; it++) {
+      int idx[3];
+      for (int j = 0; j < 3; j++) {
+        seed = seed * 1103515245u + 12345u;
+        idx[j] = static_cast<int>((seed >> 8) % static_cast<uint32_t>(m));
+      }
+      const float ax = sx[idx[1]] - sx[idx[0]];
+      const float ay = sy[idx[1]] - sy[idx[0]];
+      const float az = sz[idx[1]] - sz[idx[0]];
+      const float bx = sx[idx[2]] - sx[idx[0]];
+      const float by = sy[idx[2]] - sy[idx[0]];
+      const float bz = sz[idx[2]] - sz[idx[0]];
+      float nx = ay * bz - az * by;
+      float ny = az * bx - ax * bz;
+      float nz = ax * by - ay * bx;
+      const float len = sqrtf(nx * nx + ny * ny + nz * nz);
+      if (len < 1e-3f) {
+        continue;
+      }
+      nx /= len;
+      ny /= len;
+      nz /= len;
+      if (ny > 0.0f) {  // 朝上（-Y）
+        nx = -nx;
+        ny = -ny;
+        nz = -nz;
+      }
+      if (-ny < cos_max) {
+        continue;
+      }
+      const float d = nx * sx[idx[0]] + ny * sy[idx[0]] + nz * sz[idx[0]];
+      int count = 0;
+      for (int i = 0; i < m; i++) {
+        const float dist = nx * sx[i] + ny * sy[i] + nz * sz[i] - d;
+        count += fabsf(dist) < tol;
+      }
+      if (count > best_count[band]) {
+        best_count[band] = count;
+        best_plane[band * 4 + 0] = nx;
+        best_plane[band * 4 + 1] = ny;
+        best_plane[band * 4 + 2] = nz;
+        best_plane[band * 4 + 3] = d;
+      }
+    }
+  });
+  int best = 0;
+  for (int b = 1; b < ransac_bands; b++) {
+    if (best_count[b] > best_count[best]) {
+      best = b;
+    }
+  }
+  float up[3] = {0.0f, -1.0f, 0.0f};
+  if (best_count[best] >= options.min_fraction * m) {
+    // 内点 PCA 精修法向
+    const float* plane = &best_plane[best * 4];
+    double mean[3] = {0.0, 0.0, 0.0};
+    int inliers = 0;
+    for (int i = 0; i < m; i++) {
+      const float dist =
+          plane[0] * sx[i] + plane[1] * sy[i] + plane[2] * sz[i] - plane[3];
+      if (fabsf(dist) < tol) {
+        mean[0] += sx[i];
+        mean[1] += sy[i];
+        mean[2] += sz[i];
+        inliers++;
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      mean[k] /= inliers;
+    }
+    double cov[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+    for (int i = 0; i < m; i++) {
+      const float dist =
+          plane[0] * sx[i] + plane[1] * sy[i] + plane[2] * sz[i] - plane[3];
+      if (fabsf(dist) >= tol) {
+        continue;
+      }
+      const double p[3] = {sx[i] - mean[0], sy[i] - mean[1], sz[i] - mean[2]};
+      for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+          cov[r][c] += p[r] * p[c];
+        }
+      }
+    }
+    double normal[3];
+    smallestEigenvector(cov, normal);
+    if (normal[1] > 0.0) {
+      normal[0] = -normal[0];
+      normal[1] = -normal[1];
+      normal[2] = -normal[2];
+    }
+    // 精修后偏离先验太多（退化内点）时仍用 RANSAC 法向
+    if (-normal[1] >= cos_max) {
+      for (int k = 0; k < 3; k++) {
+        up[k] = static_cast<float>(normal[k]);
+      }
+    } else {
+      for (int k = 0; k < 3; k++) {
+        up[k] = plane[k];
+      }
+    }
+    result.up_from_ransac = true;
+  }
+  for (int k = 0; k < 3; k++) {
+    result.up[k] = up[k];
+  }
+
+  // 3. 沿竖直方向的高度
+  std::vector<float> heights(n);
+  const float* px = &cloud.x[0];
+  const float* py = &cloud.y[0];
+  const float* pz = &cloud.z[0];
+  for (int i = 0; i < n; i++) {
+    heights[i] = up[0] * px[i] + up[1] * py[i] + up[2] * pz[i];
+  }
+  {
+    std::vector<float> sorted(heights);
+    result.min_height_mm = percentile(&sorted, 0.02);
+    result.max_height_mm = percentile(&sorted, 0.98);
+  }
+
+  // 4. 高度直方图：水平面是尖峰，竖直的垛前立面是平台，
+  //    用窗口计数减去两侧窗口均值（突出度）区分
+  const float bin = static_cast<float>(std::max(1.0, options.bin_mm));
+  const float h_lo = result.min_height_mm - 2.0f * tol;
+  const float h_hi = result.max_height_mm + 2.0f * tol;
+  const int nbins =
+      std::min(100000, static_cast<int>((h_hi - h_lo) / bin) + 1);
+  std::vector<int> counts(nbins, 0);
+  for (int i = 0; i < n; i++) {
+    const int b = static_cast<int>((heights[i] - h_lo) / bin);
+    if (b >= 0 && b < nbins) {
+      counts[b]++;
+    }
+  }
+  std::vector<int> prefix(nbins + 1, 0);
+  for (int b = 0; b < nbins; b++) {
+    prefix[b + 1] = prefix[b] + counts[b];
+  }
+  const int win = std::max(0, static_cast<int>(tol / bin + 0.5f));
+  std::vector<int> score(nbins);
+  for (int b = 0; b < nbins; b++) {
+    score[b] = prefix[std::min(nbins, b + win + 1)] - prefix[std::max(0, b - win)];
+  }
+  const int span = 2 * win + 1;
+  std::vector<std::pair<float, int> > candidates;
+  for (int b = 0; b < nbins; b++) {
+    const int left = b - span >= 0 ? score[b - span] : 0;
+    const int right = b + span < nbins ? score[b + span] : 0;
+    const float prominence = score[b] - 0.5f * (left + right);
+    if (prominence >= options.min_fraction * n && prominence > 0.0f) {
+      candidates.push_back(std::make_pair(-prominence, b));
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  std::vector<float> peaks;
+  const float separation = static_cast<float>(options.min_separation_mm);
+  for (size_t c = 0; c < candidates.size() && peaks.size() < 16; c++) {
+    const float h = h_lo + (candidates[c].second + 0.5f) * bin;
+    bool close = false;
+    for (size_t k = 0; k < peaks.size(); k++) {
+      if (fabsf(peaks[k] - h) < separation) {
+        close = true;
+        break;
+      }
+    }
+    if (!close) {
+      peaks.push_back(h);
+    }
+  }
+
+  // 5. 每个水平面取内点，统计高度均值与图像/深度范围
+  for (size_t k = 0; k < peaks.size(); k++) {
+    std::vector<int> us;
+    std::vector<int> vs;
+    std::vector<float> zs;
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+      if (fabsf(heights[i] - peaks[k]) <= tol) {
+        us.push_back(cloud.px[i]);
+        vs.push_back(cloud.py[i]);
+        zs.push_back(pz[i]);
+        sum += heights[i];
+      }
+    }
+    if (zs.empty()) {
+      continue;
+    }
+    LayerSurface surface;
+    surface.points = static_cast<int>(zs.size());
+    surface.height_mm = static_cast<float>(sum / zs.size());
+    surface.fraction = static_cast<float>(zs.size()) / n;
+    const int u0 = percentile(&us, 0.02);
+    const int u1 = percentile(&us, 0.98);
+    const int v0 = percentile(&vs, 0.02);
+    const int v1 = percentile(&vs, 0.98);
+    surface.extent.x = u0;
+    surface.extent.y = v0;
+    surface.extent.width = u1 - u0 + 1;
+    surface.extent.height = v1 - v0 + 1;
+    surface.depth_min_mm = percentile(&zs, 0.02);
+    surface.depth_max_mm = percentile(&zs, 0.98);
+    result.surfaces.push_back(surface);
+  }
+  std::sort(result.surfaces.begin(), result.surfaces.end(),
+            [](const LayerSurface& a, const LayerSurface& b) {
+              return a.height_mm > b.height_mm;
+            });
+  result.success = true;
+  return result;
+}
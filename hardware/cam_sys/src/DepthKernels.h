@@ -0,0 +1,132 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 19:05:37
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 19:05:37
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/DepthKernels.h
+ * @Description: SGBM 视差后处理与深度点云分层（水平面分割）
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "FrameKernels.h"
+
+// 视差均为 cv::StereoSGBM::compute 的原始输出（CV_16S，视差x16），
+// 小于等于 min_disparity 的为无效点（SGBM 无匹配时写 (minDisparity-1)*16）
+struct DepthFillOptions {
+  int min_disparity;   // 原始单位（x16），默认 0，与 calculate_depth 的 <=0 无效一致
+  int invalid_grow;    // 无效区向外扩的像素数：空洞边缘的视差多半不可靠
+  bool median;         // 有效点做 3x3 中值（只用有效结果替换）
+  int fill_radius;     // 填洞窗口半径，水平、垂直各一遍；0 关闭填洞
+  double sigma_space;  // 距离权重，<=0 时取 fill_radius/2
+  double sigma_color;  // 引导图灰度差权重，跨越物体边缘的邻点权重很小
+  double min_weight;   // 权重和低于该值的点保持无效（周围都是另一物体时不硬填）
+  int threads;         // 按行分块并行，0 表示硬件线程数
+
+  DepthFillOptions()
+      : min_disparity(0), invalid_grow(1), median(true), fill_radius(8),
+        sigma_space(0.0), sigma_color(10.0), min_weight(0.1), threads(0) {}
+};
+
+struct DepthFillStats {
+  int valid_before;  // 原始有效点
+  int masked;        // 因扩散被标为无效的点
+  int filled;        // 填上的点
+  int valid_after;
+};
+
+// 针孔内参（像素），与深度图同一坐标系（旋转后的深度图要用旋转后的主点）
+struct CameraIntrinsics {
+  double fx;
+  double fy;
+  double cx;
+  double cy;
+
+  CameraIntrinsics() : fx(0.0), fy(0.0), cx(0.0), cy(0.0) {}
+};
+
+struct LayerSegOptions {
+  int stride;                   // 反投影采样步长（像素）
+  double min_depth_mm;          // 有效深度范围，之外视为无效
+  double max_depth_mm;
+  double bin_mm;                // 高度直方图分箱
+  double surface_tolerance_mm;  // 点归属某个水平面的高度容差
+  double min_separation_mm;     // 两个水平面至少相差这么高（应小于一箱高）
+  double min_fraction;          // 水平面点数占 ROI 有效点的最小比例
+  double max_tilt_deg;          // 水平面法向与先验“上”方向（-Y）的最大夹角
+  int ransac_iterations;
+  int ransac_samples;           // 参与 RANSAC 打分的点数上限
+  int threads;                  // 0 表示硬件线程数
+
+  LayerSegOptions()
+      : stride(2), min_depth_mm(500.0), max_depth_mm(30000.0), bin_mm(20.0),
+        surface_tolerance_mm(40.0), min_separation_mm(150.0),
+        min_fraction(0.03), max_tilt_deg(40.0), ransac_iterations(200),
+        ransac_samples(20000), threads(0) {}
+};
+
+// 一个水平面（某层顶面的可见部分）
+struct LayerSurface {
+  float height_mm;     // 沿估计的竖直方向到光心的高度，向上为正
+  int points;          // 采样点数
+  float fraction;      // 占 ROI 有效采样点比例
+  PixelRect extent;    // 深度图上的范围（2%~98% 分位）
+  float depth_min_mm;  // 光轴方向距离范围（2%~98% 分位），近端即该层前沿
+  float depth_max_mm;
+};
+
+struct LayerSegResult {
+  bool success;
+  float up[3];          // 相机坐标系下的竖直向上方向
+  bool up_from_ransac;  // false 表示没找到足够大的水平面，沿用先验 -Y
+  int valid_points;
+  float min_height_mm;  // ROI 内点高度 2% / 98% 分位，对应垛底与垛顶
+  float max_height_mm;
+  std::vector<LayerSurface> surfaces;  // 从高到低
+
+  LayerSegResult()
+      : success(false), up_from_ransac(false), valid_points(0),
+        min_height_mm(0.0f), max_height_mm(0.0f) {
+    up[0] = 0.0f;
+    up[1] = -1.0f;
+    up[2] = 0.0f;
+  }
+};
+
+// 纯函数，线程安全。中值与掩码为无分支的逐行循环，交给编译器向量化
+class DepthKernels {
+ public:
+  // mask 置 1 表示有效；grow>0 时把无效区按方形邻域向外扩 grow 像素
+  static void invalidMask(const int16_t* disp, int width, int height,
+                          int min_disparity, int grow, uint8_t* mask,
+                          int threads = 0);
+
+  // 3x3 中值（边界复制），dst 与 src 不能重叠
+  static void median3x3(const int16_t* src, int width, int height,
+                        int16_t* dst, int threads = 0);
+
+  // 对 mask 为 0 的点做可分离的联合双边插值：先水平再垂直，
+  // 权重 = 距离高斯 x 引导图（左目灰度）灰度差高斯。
+  // 填上的点写入 disp 并把 mask 置 1，返回填上的点数
+  static int jointBilateralFill(int16_t* disp, uint8_t* mask,
+                                const uint8_t* guide, int width, int height,
+                                const DepthFillOptions& options);
+
+  // 完整流程：掩码 -> 中值 -> 填洞。disp 原地修改，仍无效的点写 min_disparity - 16
+  static DepthFillStats postprocess(int16_t* disp, const uint8_t* guide,
+                                    int width, int height,
+                                    const DepthFillOptions& options);
+
+  // 深度图（毫米，<=0 无效）在 roi 内按内参反投影成点云，RANSAC 找主水平面
+  // 确定竖直方向，再按高度直方图分出各层顶面，给出高度和范围作为分层先验
+  static LayerSegResult segmentLayers(const float* depth, int width,
+                                      int height,
+                                      const CameraIntrinsics& intrinsics,
+                                      const PixelRect& roi,
+                                      const LayerSegOptions& options);
+};
@@ -0,0 +1,303 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 22:02:45
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 22:02:45
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/DetectionSet.cpp
+ * @Description: YOLO 检测结果容器（按列存放）：NMS、类别过滤与 ROI 相交查询
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "DetectionSet.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+// 格网一边最多这么多格，框特别分散时自动放大格子
+const int kMaxGridSide = 1024;
+
+// 坐标落在第几格，裁到 [0, cells)
+inline int cellOf(float v, float origin, float cell, int cells) {
+  const int k = static_cast<int>(floorf((v - origin) / cell));
+  return std::max(0, std::min(cells - 1, k));
+}
+
+}  // namespace
+
+DetectionSet::DetectionSet()
+    : size_(0),
+      capacity_(0),
+      indexed_(false),
+      cell_(0.0f),
+      origin_x_(0.0f),
+      origin_y_(0.0f),
+      grid_w_(0),
+      grid_h_(0) {}
+
+void DetectionSet::grow(int capacity) {
+  if (capacity <= capacity_) {
+    return;
+  }
+  std::vector<float> data(static_cast<size_t>(kDetColumns) * capacity, 0.0f);
+  for (int c = 0; c < kDetColumns && size_ > 0; c++) {
+    memcpy(&data[static_cast<size_t>(c) * capacity],
+           &data_[static_cast<size_t>(c) * capacity_], sizeof(float) * size_);
+  }
+  data_.swap(data);
+  capacity_ = capacity;
+}
+
+void DetectionSet::reserve(int capacity) { grow(capacity); }
+
+void DetectionSet::add(float x1, float y1, float x2, float y2, float score,
+                       int cls) {
+  if (size_ == capacity_) {
+    grow(std::max(16, capacity_ * 2));
+  }
+  const int i = size_++;
+  col(kDetX1)[i] = x1;
+  col(kDetY1)[i] = y1;
+  col(kDetX2)[i] = x2;
+  col(kDetY2)[i] = y2;
+  col(kDetScore)[i] = score;
+  col(kDetClass)[i] = static_cast<float>(cls);
+  col(kDetCx)[i] = 0.5f * (x1 + x2);
+  col(kDetCy)[i] = 0.5f * (y1 + y2);
+  const float w = fabsf(x2 - x1);
+  const float h = fabsf(y2 - y1);
+  col(kDetWidth)[i] = w;
+  col(kDetHeight)[i] = h;
+  col(kDetArea)[i] = w * h;
+  indexed_ = false;
+}
+
+void DetectionSet::addRows(const float* rows, int count) {
+  grow(size_ + count);
+  for (int i = 0; i < count; i++) {
+    const float* r = rows + static_cast<size_t>(i) * 6;
+    add(r[0], r[1], r[2], r[3], r[4], static_cast<int>(r[5]));
+  }
+}
+
+void DetectionSet::clear() {
+  size_ = 0;
+  indexed_ = false;
+}
+
+std::vector<int> DetectionSet::selectClasses(const std::vector<int>& classes,
+                                             float min_score) const {
+  std::vector<int> out;
+  const float* score = column(kDetScore);
+  const float* cls = column(kDetClass);
+  for (int i = 0; i < size_; i++) {
+    if (score[i] < min_score) {
+      continue;
+    }
+    if (!classes.empty() &&
+        std::find(classes.begin(), classes.end(),
+                  static_cast<int>(cls[i])) == classes.end()) {
+      continue;
+    }
+    out.push_back(i);
+  }
+  return out;
+}
+
+std::vector<int> DetectionSet::nms(float iou_threshold,
+                                   bool class_agnostic) const {
+  const int n = size_;
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  const float* score = column(kDetScore);
+  std::stable_sort(order.begin(), order.end(),
+                   [score](int a, int b) { return score[a] > score[b]; });
+
+  // 按分数排好的紧凑列，内层循环顺序访问
+  std::vector<float> sx1(n), sy1(n), sx2(n), sy2(n), sarea(n), scls(n);
+  for (int k = 0; k < n; k++) {
+    const int i = order[k];
+    sx1[k] = value(i, kDetX1);
+    sy1[k] = value(i, kDetY1);
+    sx2[k] = value(i, kDetX2);
+    sy2[k] = value(i, kDetY2);
+    sarea[k] = value(i, kDetArea);
+    scls[k] = class_agnostic ? 0.0f : value(i, kDetClass);
+  }
+  std::vector<unsigned char> suppressed(n, 0);
+  std::vector<int> kept;
+  for (int k = 0; k < n; k++) {
+    if (suppressed[k]) {
+      continue;
+    }
+    kept.push_back(order[k]);
+    const float ax1 = sx1[k], ay1 = sy1[k], ax2 = sx2[k], ay2 = sy2[k];
+    const float aa = sarea[k], ac = scls[k];
+    unsigned char* sup = &suppressed[0];
+    for (int j = k + 1; j < n; j++) {
+      const float iw =
+          std::max(0.0f, std::min(ax2, sx2[j]) - std::max(ax1, sx1[j]));
+      const float ih =
+          std::max(0.0f, std::min(ay2, sy2[j]) - std::max(ay1, sy1[j]));
+      const float inter = iw * ih;
+      // inter > thr * union，避免除法
+      const bool over = inter > iou_threshold * (aa + sarea[j] - inter);
+      sup[j] |= static_cast<unsigned char>(over & (scls[j] == ac));
+    }
+  }
+  return kept;
+}
+
+std::vector<int> DetectionSet::centersInside(float x1, float y1, float x2,
+                                             float y2) const {
+  std::vector<int> out;
+  const float* cx = column(kDetCx);
+  const float* cy = column(kDetCy);
+  for (int i = 0; i < size_; i++) {
+    if (cx[i] >= x1 && cx[i] <= x2 && cy[i] >= y1 && cy[i] <= y2) {
+      out.push_back(i);
+    }
+  }
+  return out;
+}
+
+std::vector<int> DetectionSet::intersecting(float x1, float y1, float x2,
+                                            float y2, float min_cover) const {
+  std::vector<int> out;
+  if (size_ == 0) {
+    return out;
+  }
+  const float* bx1 = column(kDetX1);
+  const float* by1 = column(kDetY1);
+  const float* bx2 = column(kDetX2);
+  const float* by2 = column(kDetY2);
+  const float* area = column(kDetArea);
+  // 相交且（min_cover > 0 时）交集占自身面积足够
+  auto hit = [=](int i) {
+    const float iw = std::min(x2, bx2[i]) - std::max(x1, bx1[i]);
+    const float ih = std::min(y2, by2[i]) - std::max(y1, by1[i]);
+    return iw > 0.0f && ih > 0.0f &&
+           (min_cover <= 0.0f || iw * ih >= min_cover * area[i]);
+  };
+
+  if (!indexed_) {
+    // 整列扫描：先无分支地算出命中标记，再收集下标
+    std::vector<unsigned char> mask(size_);
+    const float cover = std::max(0.0f, min_cover);
+    for (int i = 0; i < size_; i++) {
+      const float iw = std::min(x2, bx2[i]) - std::max(x1, bx1[i]);
+      const float ih = std::min(y2, by2[i]) - std::max(y1, by1[i]);
+      mask[i] = static_cast<unsigned char>((iw > 0.0f) & (ih > 0.0f) &
+                                           (iw * ih >= cover * area[i]));
+    }
+    for (int i = 0; i < size_; i++) {
+      if (mask[i]) {
+        out.push_back(i);
+      }
+    }
+    return out;
+  }
+
+  const int gx0 = cellOf(x1, origin_x_, cell_, grid_w_);
+  const int gy0 = cellOf(y1, origin_y_, cell_, grid_h_);
+  const int gx1 = cellOf(x2, origin_x_, cell_, grid_w_);
+  const int gy1 = cellOf(y2, origin_y_, cell_, grid_h_);
+  for (int gy = gy0; gy <= gy1; gy++) {
+    for (int gx = gx0; gx <= gx1; gx++) {
+      const int k = gy * grid_w_ + gx;
+      for (int p = cell_start_[k]; p < cell_start_[k + 1]; p++) {
+        const int i = cell_items_[p];
+        // 跨多格的框只在它与查询范围重叠的左上第一格里处理，省去去重
+        if (std::max(gx0, box_cell_x_[i]) != gx ||
+            std::max(gy0, box_cell_y_[i]) != gy) {
+          continue;
+        }
+        if (hit(i)) {
+          out.push_back(i);
+        }
+      }
+    }
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+void DetectionSet::buildIndex(float cell_size) {
+  indexed_ = false;
+  cell_start_.clear();
+  cell_items_.clear();
+  if (size_ == 0 || cell_size <= 0.0f) {
+    return;
+  }
+  const float* bx1 = column(kDetX1);
+  const float* by1 = column(kDetY1);
+  const float* bx2 = column(kDetX2);
+  const float* by2 = column(kDetY2);
+  float min_x = bx1[0], min_y = by1[0], max_x = bx2[0], max_y = by2[0];
+  for (int i = 1; i < size_; i++) {
+    min_x = std::min(min_x, bx1[i]);
+    min_y = std::min(min_y, by1[i]);
+    max_x = std::max(max_x, bx2[i]);
+    max_y = std::max(max_y, by2[i]);
+  }
+  cell_ = std::max(cell_size,
+                   std::max(max_x - min_x, max_y - min_y) / kMaxGridSide);
+  origin_x_ = min_x;
+  origin_y_ = min_y;
+  grid_w_ = static_cast<int>((max_x - min_x) / cell_) + 1;
+  grid_h_ = static_cast<int>((max_y - min_y) / cell_) + 1;
+
+  // 两遍：先数每格的框数，再按前缀和填入
+  std::vector<int> span(static_cast<size_t>(size_) * 4);
+  box_cell_x_.resize(size_);
+  box_cell_y_.resize(size_);
+  cell_start_.assign(static_cast<size_t>(grid_w_) * grid_h_ + 1, 0);
+  for (int i = 0; i < size_; i++) {
+    int* s = &span[static_cast<size_t>(i) * 4];
+    s[0] = cellOf(bx1[i], origin_x_, cell_, grid_w_);
+    s[1] = cellOf(by1[i], origin_y_, cell_, grid_h_);
+    s[2] = cellOf(bx2[i], origin_x_, cell_, grid_w_);
+    s[3] = cellOf(by2[i], origin_y_, cell_, grid_h_);
+    box_cell_x_[i] = s[0];
+    box_cell_y_[i] = s[1];
+    for (int gy = s[1]; gy <= s[3]; gy++) {
+      for (int gx = s[0]; gx <= s[2]; gx++) {
+        cell_start_[gy * grid_w_ + gx + 1]++;
+      }
+    }
+  }
+  for (size_t k = 1; k < cell_start_.size(); k++) {
+    cell_start_[k] += cell_start_[k - 1];
+  }
+  cell_items_.resize(cell_start_.back());
+  std::vector<int> fill(cell_start_.begin(), cell_start_.end() - 1);
+  for (int i = 0; i < size_; i++) {
+    const int* s = &span[static_cast<size_t>(i) * 4];
+    for (int gy = s[1]; gy <= s[3]; gy++) {
+      for (int gx = s[0]; gx <= s[2]; gx++) {
+        cell_items_[fill[gy * grid_w_ + gx]++] = i;
+      }
+    }
+  }
+  indexed_ = true;
+}
+
+DetectionSet DetectionSet::subset(const std::vector<int>& indices) const {
+  DetectionSet out;
+  out.reserve(static_cast<int>(indices.size()));
+  for (size_t k = 0; k < indices.size(); k++) {
+    const int i = indices[k];
+    if (i < 0 || i >= size_) {
+      continue;
+    }
+    out.add(value(i, kDetX1), value(i, kDetY1), value(i, kDetX2),
+            value(i, kDetY2), value(i, kDetScore),
+            static_cast<int>(value(i, kDetClass)));
+  }
+  return out;
+}
@@ -0,0 +1,97 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 22:02:45
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 22:02:45
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/DetectionSet.h
+ * @Description: YOLO 检测结果容器（按列存放）：NMS、类别过滤与 ROI 相交查询
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+// 列顺序。整个容器是一块 kDetColumns x capacity 的 float，每列连续（SoA），
+// Python 侧通过缓冲区协议直接看到 (kDetColumns, size) 的数组，不拷贝
+enum DetColumn {
+  kDetX1 = 0,
+  kDetY1,
+  kDetX2,
+  kDetY2,
+  kDetScore,
+  kDetClass,  // 类别 id（float 存放，小整数精确）
+  kDetCx,     // 以下为 add 时算好的派生量
+  kDetCy,
+  kDetWidth,
+  kDetHeight,
+  kDetArea,
+  kDetColumns
+};
+
+// 非线程安全：构建完成后只读查询可以并发
+class DetectionSet {
+ public:
+  DetectionSet();
+
+  void reserve(int capacity);
+  void add(float x1, float y1, float x2, float y2, float score, int cls);
+  // rows 为 count 行 [x1, y1, x2, y2, score, cls]
+  void addRows(const float* rows, int count);
+  void clear();
+
+  int size() const { return size_; }
+  int capacity() const { return capacity_; }
+  // 列首地址，长度 size()。add 可能重新分配，之前取到的指针随之失效
+  const float* column(DetColumn c) const {
+    return data_.empty() ? NULL
+                         : &data_[static_cast<size_t>(c) * capacity_];
+  }
+  float value(int i, DetColumn c) const { return column(c)[i]; }
+
+  // 类别在 classes 中（为空表示不限）且分数不低于 min_score 的下标，升序
+  std::vector<int> selectClasses(const std::vector<int>& classes,
+                                 float min_score) const;
+
+  // 贪心 NMS，返回保留的下标（按分数从高到低）。每确定一个框，
+  // 对剩余候选整列计算 IoU，内层循环无分支
+  std::vector<int> nms(float iou_threshold, bool class_agnostic) const;
+
+  // 中心落在矩形内（含边界）的下标，升序；与 scene_prepare 的 pile 内过滤一致
+  std::vector<int> centersInside(float x1, float y1, float x2, float y2) const;
+
+  // 与矩形相交的下标，升序；min_cover > 0 时还要求交集占自身面积不低于 min_cover。
+  // 调过 buildIndex 时只查矩形覆盖的格子，否则整列扫描
+  std::vector<int> intersecting(float x1, float y1, float x2, float y2,
+                                float min_cover) const;
+
+  // 按 cell_size 像素的格网建索引（每个框登记到它覆盖的所有格子）。add 后索引失效
+  void buildIndex(float cell_size);
+  bool indexed() const { return indexed_; }
+
+  DetectionSet subset(const std::vector<int>& indices) const;
+
+ private:
+  void grow(int capacity);
+  float* col(DetColumn c) {
+    return &data_[static_cast<size_t>(c) * capacity_];
+  }
+
+  int size_;
+  int capacity_;
+  std::vector<float> data_;
+
+  // 格网索引（CSR）：cell_start_[k]..cell_start_[k+1] 为格子 k 内的框下标
+  bool indexed_;
+  float cell_;
+  float origin_x_;
+  float origin_y_;
+  int grid_w_;
+  int grid_h_;
+  std::vector<int> cell_start_;
+  std::vector<int> cell_items_;
+  std::vector<int> box_cell_x_;  // 每个框左上角所在格
+  std::vector<int> box_cell_y_;
+};
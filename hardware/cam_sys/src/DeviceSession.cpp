@@ -0,0 +1,215 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 15:31:48
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 15:31:48
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/DeviceSession.cpp
+ * @Description: 一次设备登录（相机或 NVR）下管理多个通道的码流
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "DeviceSession.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <thread>
+
+namespace {
+
+// 拷贝字符串到 SDK 的定长字段，保证以 '\0' 结尾且不越界读取源串
+template <size_t N>
+void copyField(char (&dst)[N], const std::string& src) {
+  size_t n = src.size() < N - 1 ? src.size() : N - 1;
+  memcpy(dst, src.c_str(), n);
+  dst[n] = '\0';
+}
+
+}  // namespace
+
+DeviceSession::DeviceSession() : user_id_(-1) {
+  CamController::acquireSdk();
+}
+
+DeviceSession::~DeviceSession() {
+  logout();
+  CamController::releaseSdk();
+}
+
+bool DeviceSession::login(const std::string& deviceAddress,
+                          unsigned short port, const std::string& userName,
+                          const std::string& password) {
+  if (cancel_token_.cancelled()) {
+    printf("登录已取消（储位时间预算耗尽）\n");
+    return false;
+  }
+  if (user_id_ >= 0) {
+    logout();
+  }
+
+  NET_DVR_USER_LOGIN_INFO struLoginInfo = {0};
+  struLoginInfo.bUseAsynLogin = 0;  // 同步登录方式
+  copyField(struLoginInfo.sDeviceAddress, deviceAddress);
+  struLoginInfo.wPort = port;
+  copyField(struLoginInfo.sUserName, userName);
+  copyField(struLoginInfo.sPassword, password);
+
+  NET_DVR_DEVICEINFO_V40 struDeviceInfoV40 = {0};
+  user_id_ = NET_DVR_Login_V40(&struLoginInfo, &struDeviceInfoV40);
+  if (user_id_ < 0) {
+    printf("Login failed, error code: %d\n", NET_DVR_GetLastError());
+    return false;
+  }
+
+  // 模拟/本机通道从 byStartChan 起 byChanNum 个；
+  // IP 通道从 byStartDChan 起，个数由 byIPChanNum（低 8 位）和 byHighDChanNum（高 8 位）组成
+  const NET_DVR_DEVICEINFO_V30& dev = struDeviceInfoV40.struDeviceV30;
+  char serial[SERIALNO_LEN + 1] = {0};
+  memcpy(serial, dev.sSerialNumber, SERIALNO_LEN);
+  serial_ = serial;
+  channels_.clear();
+  for (int i = 0; i < dev.byChanNum; i++) {
+    ChannelInfo info;
+    info.channel = dev.byStartChan + i;
+    info.digital = false;
+    channels_.push_back(info);
+  }
+  const int ip_chans = dev.byIPChanNum + dev.byHighDChanNum * 256;
+  for (int i = 0; i < ip_chans; i++) {
+    ChannelInfo info;
+    info.channel = dev.byStartDChan + i;
+    info.digital = true;
+    channels_.push_back(info);
+  }
+  printf("设备登录成功: 序列号=%s, 模拟通道 %d 个(起始 %d), IP 通道 %d 个(起始 %d)\n",
+         serial_.c_str(), dev.byChanNum, dev.byStartChan, ip_chans,
+         dev.byStartDChan);
+  return true;
+}
+
+bool DeviceSession::logout() {
+  // 先让各通道关流、等抓图结束，再登出共用的 lUserID
+  std::map<int, std::shared_ptr<CamController> > streams;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams.swap(streams_);
+  }
+  for (std::map<int, std::shared_ptr<CamController> >::iterator it =
+           streams.begin();
+       it != streams.end(); ++it) {
+    it->second->logout();
+  }
+  streams.clear();
+
+  if (user_id_ < 0) {
+    return false;
+  }
+  BOOL ok = NET_DVR_Logout(user_id_);
+  user_id_ = -1;
+  channels_.clear();
+  return ok == TRUE;
+}
+
+bool DeviceSession::hasChannel(int channel_no) const {
+  for (size_t i = 0; i < channels_.size(); i++) {
+    if (channels_[i].channel == channel_no) {
+      return true;
+    }
+  }
+  return false;
+}
+
+CamController* DeviceSession::channel(int channel_no) {
+  if (user_id_ < 0) {
+    printf("设备未登录，无法获取通道 %d\n", channel_no);
+    return NULL;
+  }
+  if (!hasChannel(channel_no)) {
+    printf("设备 %s 上没有通道 %d\n", serial_.c_str(), channel_no);
+    return NULL;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::shared_ptr<CamController>& cam = streams_[channel_no];
+  if (!cam) {
+    cam.reset(new CamController());
+    cam->attach(user_id_);
+    cam->setCancelToken(cancel_token_);
+    // 默认按通道号区分抓图目录，调用方可再 setCameraType 覆盖
+    cam->setCameraType("channel_" + std::to_string(channel_no));
+  }
+  return cam.get();
+}
+
+int DeviceSession::startStreams(const std::vector<int>& channel_nos,
+                                unsigned short stream_type,
+                                unsigned short linkMode,
+                                unsigned short blocked) {
+  std::vector<CamController*> cams;
+  std::vector<int> nos;
+  for (size_t i = 0; i < channel_nos.size(); i++) {
+    CamController* cam = channel(channel_nos[i]);
+    if (cam != NULL) {
+      cams.push_back(cam);
+      nos.push_back(channel_nos[i]);
+    }
+  }
+
+  // startRealPlay 会等待本路解码器就绪（最长 30 秒），逐路串行会把等待叠加
+  std::vector<char> ok(cams.size(), 0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < cams.size(); i++) {
+    threads.push_back(std::thread([&, i]() {
+      ok[i] = cams[i]->startRealPlay(static_cast<unsigned short>(nos[i]),
+                                     stream_type, linkMode, blocked);
+    }));
+  }
+  int started = 0;
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+    started += ok[i] ? 1 : 0;
+  }
+  printf("通道开流: 请求 %zu 路, 成功 %d 路\n", channel_nos.size(), started);
+  return started;
+}
+
+void DeviceSession::stopStreams() {
+  std::vector<std::shared_ptr<CamController> > cams;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::map<int, std::shared_ptr<CamController> >::iterator it =
+             streams_.begin();
+         it != streams_.end(); ++it) {
+      cams.push_back(it->second);
+    }
+  }
+  for (size_t i = 0; i < cams.size(); i++) {
+    cams[i]->stopRealPlay();
+  }
+}
+
+std::vector<StreamStats> DeviceSession::stats() {
+  std::vector<std::shared_ptr<CamController> > cams;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::map<int, std::shared_ptr<CamController> >::iterator it =
+             streams_.begin();
+         it != streams_.end(); ++it) {
+      cams.push_back(it->second);
+    }
+  }
+  std::vector<StreamStats> out;
+  for (size_t i = 0; i < cams.size(); i++) {
+    out.push_back(cams[i]->stats());
+  }
+  return out;
+}
+
+void DeviceSession::setCancelToken(const CancelToken& token) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cancel_token_ = token;
+  for (std::map<int, std::shared_ptr<CamController> >::iterator it =
+           streams_.begin();
+       it != streams_.end(); ++it) {
+    it->second->setCancelToken(token);
+  }
+}
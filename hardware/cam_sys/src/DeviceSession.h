@@ -0,0 +1,73 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 15:31:48
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 15:31:48
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/DeviceSession.h
+ * @Description: 一次设备登录（相机或 NVR）下管理多个通道的码流
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CamController.h"
+#include "CancelToken.h"
+
+// 设备上可预览的一个通道
+struct ChannelInfo {
+  int channel;   // 传给 NET_DVR_RealPlay_V40 的通道号
+  bool digital;  // true 为 IP 通道（NVR 接入的网络相机），false 为模拟/本机通道
+};
+
+// 登录一次设备，按 NET_DVR_DEVICEINFO_V40 枚举通道，每个通道一个挂接在
+// 本次登录上的 CamController（抓图、录制、帧历史、统计各自独立）。
+// 几十路相机接在同一台 NVR 上时只需要一个登录、一个对象。
+class DeviceSession {
+ public:
+  DeviceSession();
+  ~DeviceSession();
+
+  bool login(const std::string& deviceAddress, unsigned short port,
+             const std::string& userName, const std::string& password);
+  // 关闭所有通道的码流后登出
+  bool logout();
+  bool loggedIn() const { return user_id_ >= 0; }
+
+  const std::string& serialNumber() const { return serial_; }
+  std::vector<ChannelInfo> channels() const { return channels_; }
+
+  // 通道对应的控制器，首次访问时创建；设备上没有该通道或未登录时返回 NULL。
+  // 返回的指针在 logout 之前有效
+  CamController* channel(int channel_no);
+
+  // 各通道并发开流（每路等待解码器就绪互不阻塞），返回成功的路数
+  int startStreams(const std::vector<int>& channel_nos,
+                   unsigned short stream_type, unsigned short linkMode,
+                   unsigned short blocked);
+  void stopStreams();
+
+  // 已创建通道的统计，按通道号排序
+  std::vector<StreamStats> stats();
+
+  // 同时下发给已创建和之后创建的通道
+  void setCancelToken(const CancelToken& token);
+
+ private:
+  DeviceSession(const DeviceSession&);
+  DeviceSession& operator=(const DeviceSession&);
+
+  bool hasChannel(int channel_no) const;
+
+  LONG user_id_;
+  std::string serial_;
+  std::vector<ChannelInfo> channels_;
+  std::mutex mutex_;
+  std::map<int, std::shared_ptr<CamController> > streams_;
+  CancelToken cancel_token_;
+};
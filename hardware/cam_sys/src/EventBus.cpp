@@ -0,0 +1,246 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 23:20:06
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 23:20:06
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/EventBus.cpp
+ * @Description: 按键分发的事件总线：等待者只在自己的事件到达时被唤醒，通过 eventfd 接入 asyncio
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "EventBus.h"
+
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+// 从键队列里摘掉一个编号；被摘的几乎总在队首
+template <typename T>
+void eraseFrom(std::deque<T>* q, T value) {
+  typename std::deque<T>::iterator it = std::find(q->begin(), q->end(), value);
+  if (it != q->end()) {
+    q->erase(it);
+  }
+}
+
+}  // namespace
+
+EventBus::EventBus(size_t capacity)
+    : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      capacity_(std::max<size_t>(1, capacity)),
+      next_waiter_(0),
+      next_event_(0) {
+  if (fd_ < 0) {
+    printf("EventBus: eventfd 创建失败，只能轮询 drain\n");
+  }
+}
+
+EventBus::~EventBus() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+int64_t EventBus::nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void EventBus::signal() {
+  if (fd_ >= 0) {
+    const uint64_t one = 1;
+    if (write(fd_, &one, sizeof(one)) != sizeof(one)) {
+      // 计数器溢出前 drain 一定会被调用，失败可忽略
+    }
+  }
+}
+
+void EventBus::deliver(long waiter, const std::string& key,
+                       const Event& event) {
+  std::unordered_map<long, std::vector<std::string> >::iterator w =
+      waiter_keys_.find(waiter);
+  if (w != waiter_keys_.end()) {
+    for (size_t i = 0; i < w->second.size(); i++) {
+      std::unordered_map<std::string, std::deque<long> >::iterator q =
+          waiting_.find(w->second[i]);
+      if (q != waiting_.end()) {
+        eraseFrom(&q->second, waiter);
+        if (q->second.empty()) {
+          waiting_.erase(q);
+        }
+      }
+    }
+    waiter_keys_.erase(w);
+  }
+  BusDelivery d;
+  d.waiter = waiter;
+  d.key = key;
+  d.payload = event.payload;
+  d.timestamp_us = event.timestamp_us;
+  ready_.push_back(d);
+  signal();
+}
+
+void EventBus::removeEvent(uint64_t id) {
+  std::map<uint64_t, Event>::iterator e = events_.find(id);
+  if (e == events_.end()) {
+    return;
+  }
+  for (size_t i = 0; i < e->second.keys.size(); i++) {
+    std::unordered_map<std::string, std::deque<uint64_t> >::iterator q =
+        pending_.find(e->second.keys[i]);
+    if (q != pending_.end()) {
+      eraseFrom(&q->second, id);
+      if (q->second.empty()) {
+        pending_.erase(q);
+      }
+    }
+  }
+  events_.erase(e);
+}
+
+void EventBus::publish(const std::vector<std::string>& keys,
+                       const std::string& payload) {
+  if (keys.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  Event event;
+  event.payload = payload;
+  event.timestamp_us = nowMicros();
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::unordered_map<std::string, std::deque<long> >::iterator q =
+        waiting_.find(keys[i]);
+    if (q != waiting_.end() && !q->second.empty()) {
+      deliver(q->second.front(), keys[i], event);
+      return;
+    }
+  }
+  if (events_.size() >= capacity_) {
+    removeEvent(events_.begin()->first);
+  }
+  const uint64_t id = ++next_event_;
+  event.keys = keys;
+  for (size_t i = 0; i < keys.size(); i++) {
+    pending_[keys[i]].push_back(id);
+  }
+  std::swap(events_[id], event);
+}
+
+long EventBus::wait(const std::vector<std::string>& keys) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const long waiter = ++next_waiter_;
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::unordered_map<std::string, std::deque<uint64_t> >::iterator q =
+        pending_.find(keys[i]);
+    if (q != pending_.end() && !q->second.empty()) {
+      const uint64_t id = q->second.front();
+      const std::string key = keys[i];
+      const Event event = events_[id];
+      removeEvent(id);
+      deliver(waiter, key, event);
+      return waiter;
+    }
+  }
+  waiter_keys_[waiter] = keys;
+  for (size_t i = 0; i < keys.size(); i++) {
+    waiting_[keys[i]].push_back(waiter);
+  }
+  return waiter;
+}
+
+bool EventBus::cancel(long waiter) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unordered_map<long, std::vector<std::string> >::iterator w =
+      waiter_keys_.find(waiter);
+  if (w == waiter_keys_.end()) {
+    return false;
+  }
+  for (size_t i = 0; i < w->second.size(); i++) {
+    std::unordered_map<std::string, std::deque<long> >::iterator q =
+        waiting_.find(w->second[i]);
+    if (q != waiting_.end()) {
+      eraseFrom(&q->second, waiter);
+      if (q->second.empty()) {
+        waiting_.erase(q);
+      }
+    }
+  }
+  waiter_keys_.erase(w);
+  return true;
+}
+
+std::vector<BusDelivery> EventBus::drain() {
+  std::vector<BusDelivery> out;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ >= 0) {
+    uint64_t count = 0;
+    if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+      // EAGAIN：没有新的投递
+    }
+  }
+  out.swap(ready_);
+  return out;
+}
+
+bool EventBus::take(const std::vector<std::string>& keys, BusDelivery* out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::unordered_map<std::string, std::deque<uint64_t> >::iterator q =
+        pending_.find(keys[i]);
+    if (q != pending_.end() && !q->second.empty()) {
+      const uint64_t id = q->second.front();
+      const Event& event = events_[id];
+      out->waiter = 0;
+      out->key = keys[i];
+      out->payload = event.payload;
+      out->timestamp_us = event.timestamp_us;
+      removeEvent(id);
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t EventBus::discard(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unordered_map<std::string, std::deque<uint64_t> >::iterator q =
+      pending_.find(key);
+  if (q == pending_.end()) {
+    return 0;
+  }
+  const std::deque<uint64_t> ids = q->second;
+  for (size_t i = 0; i < ids.size(); i++) {
+    removeEvent(ids[i]);
+  }
+  return ids.size();
+}
+
+std::vector<std::string> EventBus::pendingKeys() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> keys;
+  keys.reserve(pending_.size());
+  for (std::unordered_map<std::string, std::deque<uint64_t> >::const_iterator
+           it = pending_.begin();
+       it != pending_.end(); ++it) {
+    keys.push_back(it->first);
+  }
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+size_t EventBus::pending() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return events_.size();
+}
+
+size_t EventBus::waiters() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return waiter_keys_.size();
+}
@@ -0,0 +1,97 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 23:20:06
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 23:20:06
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/EventBus.h
+ * @Description: 按键分发的事件总线：等待者只在自己的事件到达时被唤醒，通过 eventfd 接入 asyncio
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 一次投递：waiter 为 wait 返回的编号（take 取走时为 0），key 为命中的键
+struct BusDelivery {
+  long waiter;
+  std::string key;
+  std::string payload;
+  int64_t timestamp_us;  // publish 时刻，CLOCK_MONOTONIC（同 time.monotonic）
+};
+
+// 事件可以同时挂在多个键上（例如 "<robotTaskCode>|end"、"task:<任务号>|end"、
+// "*|end"），投递一次即从所有键上摘除。publish 和 wait 都只看各自键队列的队首，
+// 与等待者、积压事件的总数无关；没有扫描。
+//
+// 投递结果放在就绪表里并写 eventfd，事件循环在 fd 可读时调用 drain 取走，
+// 因此 publish 可以在任意线程调用。线程安全。
+class EventBus {
+ public:
+  // capacity 为积压（已发布未被取走）事件的上限，超出时丢弃最早的
+  explicit EventBus(size_t capacity = 4096);
+  ~EventBus();
+
+  // eventfd（非阻塞），有投递时可读；创建失败时为 -1，此时只能轮询 drain
+  int fd() const { return fd_; }
+
+  // keys 按优先级排列：投给第一个有等待者的键上最早的等待者；
+  // 都没有等待者时积压在所有键上
+  void publish(const std::vector<std::string>& keys,
+               const std::string& payload);
+
+  // 登记等待 keys 中任一键的事件，返回等待者编号。已有积压事件时立即投递
+  // （按 keys 顺序取第一个有积压的键上最早的事件）
+  long wait(const std::vector<std::string>& keys);
+  // 撤销等待；返回 false 表示已经投递（结果在下一次 drain 里）或编号无效
+  bool cancel(long waiter);
+
+  // 取走所有就绪的投递并清零 eventfd
+  std::vector<BusDelivery> drain();
+
+  // 不登记等待，直接取走 keys 上最早的积压事件
+  bool take(const std::vector<std::string>& keys, BusDelivery* out);
+
+  // 丢弃某键上的全部积压事件（同时从它们的其他键上摘除），返回丢弃数
+  size_t discard(const std::string& key);
+  // 有积压事件的键
+  std::vector<std::string> pendingKeys();
+  size_t pending();
+  size_t waiters();
+
+  static int64_t nowMicros();
+
+ private:
+  EventBus(const EventBus&);
+  EventBus& operator=(const EventBus&);
+
+  struct Event {
+    std::vector<std::string> keys;
+    std::string payload;
+    int64_t timestamp_us;
+  };
+
+  // 以下均要求持有 mutex_
+  void removeEvent(uint64_t id);
+  void deliver(long waiter, const std::string& key, const Event& event);
+  void signal();
+
+  std::mutex mutex_;
+  int fd_;
+  size_t capacity_;
+  long next_waiter_;
+  uint64_t next_event_;
+  std::map<uint64_t, Event> events_;  // 积压事件，按发布顺序
+  std::unordered_map<std::string, std::deque<uint64_t> > pending_;
+  std::unordered_map<std::string, std::deque<long> > waiting_;
+  std::unordered_map<long, std::vector<std::string> > waiter_keys_;
+  std::vector<BusDelivery> ready_;
+};
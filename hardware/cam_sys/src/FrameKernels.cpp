@@ -0,0 +1,350 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 11:20:40
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 11:20:40
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/FrameKernels.cpp
+ * @Description: 帧处理的原生计算核
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "FrameKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+inline unsigned char clampByte(int v) {
+  return static_cast<unsigned char>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+}  // namespace
+
+void FrameKernels::yv12ToBgr(const unsigned char* yv12, int width, int height,
+                             unsigned char* bgr) {
+  const int cw = width / 2;
+  const unsigned char* y_plane = yv12;
+  const unsigned char* v_plane = yv12 + width * height;
+  const unsigned char* u_plane = v_plane + cw * (height / 2);
+
+  // 定点 BT.601（limited range），一行色度对应两行亮度
+  for (int row = 0; row < height; row++) {
+    const unsigned char* yr = y_plane + row * width;
+    const unsigned char* ur = u_plane + (row / 2) * cw;
+    const unsigned char* vr = v_plane + (row / 2) * cw;
+    unsigned char* out = bgr + static_cast<size_t>(row) * width * 3;
+    for (int col = 0; col < width; col += 2) {
+      int d = ur[col / 2] - 128;
+      int e = vr[col / 2] - 128;
+      int rv = 409 * e + 128;
+      int gv = -100 * d - 208 * e + 128;
+      int bv = 516 * d + 128;
+      for (int k = 0; k < 2; k++) {
+        int c = 298 * (yr[col + k] - 16);
+        out[0] = clampByte((c + bv) >> 8);
+        out[1] = clampByte((c + gv) >> 8);
+        out[2] = clampByte((c + rv) >> 8);
+        out += 3;
+      }
+    }
+  }
+}
+
+// 按 stride 读取源平面，输出 ow x oh；源区域超出部分由调用方保证不会访问
+static void downscalePlane(const unsigned char* src, int stride, int factor,
+                           int ow, int oh, unsigned char* dst) {
+  const int area = factor * factor;
+  std::vector<int> acc(ow);
+  for (int oy = 0; oy < oh; oy++) {
+    std::fill(acc.begin(), acc.end(), 0);
+    for (int k = 0; k < factor; k++) {
+      const unsigned char* row = src + (oy * factor + k) * stride;
+      for (int ox = 0; ox < ow; ox++) {
+        const unsigned char* p = row + ox * factor;
+        int s = 0;
+        for (int j = 0; j < factor; j++) {
+          s += p[j];
+        }
+        acc[ox] += s;
+      }
+    }
+    unsigned char* out = dst + static_cast<size_t>(oy) * ow;
+    for (int ox = 0; ox < ow; ox++) {
+      out[ox] = static_cast<unsigned char>((acc[ox] + area / 2) / area);
+    }
+  }
+}
+
+void FrameKernels::downscaleYv12(const unsigned char* src, int width,
+                                 int height, int factor,
+                                 std::vector<unsigned char>* dst,
+                                 int* out_width, int* out_height) {
+  if (factor <= 1) {
+    dst->assign(src, src + static_cast<size_t>(width) * height * 3 / 2);
+    *out_width = width;
+    *out_height = height;
+    return;
+  }
+  // 输出保持偶数宽高，色度平面正好是亮度的一半
+  const int ow = (width / factor) & ~1;
+  const int oh = (height / factor) & ~1;
+  const size_t y_size = static_cast<size_t>(ow) * oh;
+  dst->resize(y_size * 3 / 2);
+  *out_width = ow;
+  *out_height = oh;
+  if (ow == 0 || oh == 0) {
+    return;
+  }
+  const int cw = width / 2;
+  const int ch = height / 2;
+  const unsigned char* v = src + static_cast<size_t>(width) * height;
+  const unsigned char* u = v + static_cast<size_t>(cw) * ch;
+  downscalePlane(src, width, factor, ow, oh, &(*dst)[0]);
+  downscalePlane(v, cw, factor, ow / 2, oh / 2, &(*dst)[y_size]);
+  downscalePlane(u, cw, factor, ow / 2, oh / 2, &(*dst)[y_size + y_size / 4]);
+}
+
+// 块 [x0,x1)x[y0,y1) 的均值写回整块
+static void flattenBlock(unsigned char* plane, int stride, int x0, int y0,
+                         int x1, int y1) {
+  int sum = 0;
+  for (int y = y0; y < y1; y++) {
+    const unsigned char* row = plane + static_cast<size_t>(y) * stride;
+    for (int x = x0; x < x1; x++) {
+      sum += row[x];
+    }
+  }
+  const int n = (x1 - x0) * (y1 - y0);
+  const unsigned char mean = static_cast<unsigned char>((sum + n / 2) / n);
+  for (int y = y0; y < y1; y++) {
+    memset(plane + static_cast<size_t>(y) * stride + x0, mean, x1 - x0);
+  }
+}
+
+void FrameKernels::flattenOutside(unsigned char* yv12, int width, int height,
+                                  const std::vector<PixelRect>& keep,
+                                  int block) {
+  if (block < 2) {
+    block = 2;
+  }
+  block &= ~1;  // 色度块为一半，须为偶数
+  const int cw = width / 2;
+  const int ch = height / 2;
+  unsigned char* v = yv12 + static_cast<size_t>(width) * height;
+  unsigned char* u = v + static_cast<size_t>(cw) * ch;
+  for (int by = 0; by < height; by += block) {
+    const int by1 = std::min(by + block, height);
+    for (int bx = 0; bx < width; bx += block) {
+      const int bx1 = std::min(bx + block, width);
+      bool inside = false;
+      for (size_t i = 0; i < keep.size() && !inside; i++) {
+        const PixelRect& r = keep[i];
+        inside = bx < r.x + r.width && r.x < bx1 && by < r.y + r.height &&
+                 r.y < by1;
+      }
+      if (inside) {
+        continue;
+      }
+      flattenBlock(yv12, width, bx, by, bx1, by1);
+      const int cx0 = bx / 2;
+      const int cy0 = by / 2;
+      const int cx1 = std::min(bx1 / 2, cw);
+      const int cy1 = std::min(by1 / 2, ch);
+      if (cx1 > cx0 && cy1 > cy0) {
+        flattenBlock(v, cw, cx0, cy0, cx1, cy1);
+        flattenBlock(u, cw, cx0, cy0, cx1, cy1);
+      }
+    }
+  }
+}
+
+bool FrameKernels::cropYv12(const unsigned char* src, int width, int height,
+                            const PixelRect& rect,
+                            std::vector<unsigned char>* dst,
+                            PixelRect* actual) {
+  // 起点向下、终点向上取偶数，保证色度平面按 2x2 对齐
+  int x0 = std::max(0, rect.x) & ~1;
+  int y0 = std::max(0, rect.y) & ~1;
+  int x1 = std::min(width, rect.x + rect.width);
+  int y1 = std::min(height, rect.y + rect.height);
+  x1 = std::min(width & ~1, (x1 + 1) & ~1);
+  y1 = std::min(height & ~1, (y1 + 1) & ~1);
+  if (x1 <= x0 || y1 <= y0) {
+    return false;
+  }
+  const int w = x1 - x0;
+  const int h = y1 - y0;
+  const int cw = width / 2;
+  const int ch = height / 2;
+  dst->resize(static_cast<size_t>(w) * h * 3 / 2);
+  unsigned char* out = &(*dst)[0];
+  for (int y = 0; y < h; y++) {
+    memcpy(out + static_cast<size_t>(y) * w,
+           src + static_cast<size_t>(y0 + y) * width + x0, w);
+  }
+  const unsigned char* v = src + static_cast<size_t>(width) * height;
+  const unsigned char* u = v + static_cast<size_t>(cw) * ch;
+  unsigned char* ov = out + static_cast<size_t>(w) * h;
+  unsigned char* ou = ov + static_cast<size_t>(w / 2) * (h / 2);
+  for (int y = 0; y < h / 2; y++) {
+    const size_t src_off = static_cast<size_t>(y0 / 2 + y) * cw + x0 / 2;
+    memcpy(ov + static_cast<size_t>(y) * (w / 2), v + src_off, w / 2);
+    memcpy(ou + static_cast<size_t>(y) * (w / 2), u + src_off, w / 2);
+  }
+  actual->x = x0;
+  actual->y = y0;
+  actual->width = w;
+  actual->height = h;
+  return true;
+}
+
+void FrameKernels::downscaleGray(const unsigned char* src, int width,
+                                 int height, int factor,
+                                 std::vector<unsigned char>* dst) {
+  if (factor < 1) {
+    factor = 1;
+  }
+  const int ow = width / factor;
+  const int oh = height / factor;
+  const int area = factor * factor;
+  dst->resize(static_cast<size_t>(ow) * oh);
+
+  std::vector<int> acc(ow);
+  for (int oy = 0; oy < oh; oy++) {
+    std::fill(acc.begin(), acc.end(), 0);
+    for (int k = 0; k < factor; k++) {
+      const unsigned char* row = src + (oy * factor + k) * width;
+      for (int ox = 0; ox < ow; ox++) {
+        const unsigned char* p = row + ox * factor;
+        int s = 0;
+        for (int j = 0; j < factor; j++) {
+          s += p[j];
+        }
+        acc[ox] += s;
+      }
+    }
+    unsigned char* out = &(*dst)[static_cast<size_t>(oy) * ow];
+    for (int ox = 0; ox < ow; ox++) {
+      out[ox] = static_cast<unsigned char>((acc[ox] + area / 2) / area);
+    }
+  }
+}
+
+namespace {
+
+const int kPhashSize = 32;
+const int kPhashLow = 8;
+// 32x32 均值图的最大最小值之差低于此值（灰度级）视为没有纹理，不给哈希
+const float kPhashMinContrast = 2.0f;
+
+// DCT-II 的余弦表，只需要前 8 个频率
+struct PhashCosTable {
+  float c[kPhashLow][kPhashSize];
+  PhashCosTable() {
+    for (int u = 0; u < kPhashLow; u++) {
+      for (int x = 0; x < kPhashSize; x++) {
+        c[u][x] = static_cast<float>(
+            cos((2 * x + 1) * u * M_PI / (2.0 * kPhashSize)));
+      }
+    }
+  }
+};
+
+}  // namespace
+
+uint64_t FrameKernels::phash(const unsigned char* gray, int width, int height,
+                             const PixelRect* rect) {
+  const int kSize = kPhashSize;
+  const int kLow = kPhashLow;
+  int x0 = 0;
+  int y0 = 0;
+  int x1 = width;
+  int y1 = height;
+  if (rect != NULL) {
+    x0 = std::max(0, rect->x);
+    y0 = std::max(0, rect->y);
+    x1 = std::min(width, rect->x + rect->width);
+    y1 = std::min(height, rect->y + rect->height);
+  }
+  if (x1 - x0 < kSize || y1 - y0 < kSize) {
+    return 0;
+  }
+
+  // 区域均值缩放：每个输出格覆盖 [x0 + i*w/32, x0 + (i+1)*w/32)
+  float small[kSize * kSize];
+  int xs[kSize + 1];
+  int ys[kSize + 1];
+  for (int i = 0; i <= kSize; i++) {
+    xs[i] = x0 + (x1 - x0) * i / kSize;
+    ys[i] = y0 + (y1 - y0) * i / kSize;
+  }
+  std::vector<uint32_t> col_sum(kSize);
+  for (int gy = 0; gy < kSize; gy++) {
+    std::fill(col_sum.begin(), col_sum.end(), 0u);
+    for (int y = ys[gy]; y < ys[gy + 1]; y++) {
+      const unsigned char* row = gray + static_cast<size_t>(y) * width;
+      for (int gx = 0; gx < kSize; gx++) {
+        uint32_t sum = 0;
+        for (int x = xs[gx]; x < xs[gx + 1]; x++) {
+          sum += row[x];
+        }
+        col_sum[gx] += sum;
+      }
+    }
+    for (int gx = 0; gx < kSize; gx++) {
+      const int n = (xs[gx + 1] - xs[gx]) * (ys[gy + 1] - ys[gy]);
+      small[gy * kSize + gx] = static_cast<float>(col_sum[gx]) / n;
+    }
+  }
+  // 全黑、全白、镜头遮挡这类画面所有系数都在中位数上下，比特只由噪声决定，
+  // 两张这样的画面会被当成同一画面
+  const std::pair<const float*, const float*> range =
+      std::minmax_element(small, small + kSize * kSize);
+  if (*range.second - *range.first < kPhashMinContrast) {
+    return 0;
+  }
+
+  // 只需要低频 8x8：先对每行做 8 个系数，再对列做 8 个系数
+  static const PhashCosTable table;  // C++11 局部静态变量的初始化是线程安全的
+  const float (*cos_table)[kPhashSize] = table.c;
+  float rows[kSize][kLow];
+  for (int y = 0; y < kSize; y++) {
+    for (int u = 0; u < kLow; u++) {
+      float acc = 0.0f;
+      for (int x = 0; x < kSize; x++) {
+        acc += small[y * kSize + x] * cos_table[u][x];
+      }
+      rows[y][u] = acc;
+    }
+  }
+  float coeffs[kLow * kLow];
+  for (int v = 0; v < kLow; v++) {
+    for (int u = 0; u < kLow; u++) {
+      float acc = 0.0f;
+      for (int y = 0; y < kSize; y++) {
+        acc += rows[y][u] * cos_table[v][y];
+      }
+      coeffs[v * kLow + u] = acc;
+    }
+  }
+
+  // 中位数不含直流分量，否则亮度整体变化会影响阈值
+  std::vector<float> ac(coeffs + 1, coeffs + kLow * kLow);
+  std::nth_element(ac.begin(), ac.begin() + ac.size() / 2, ac.end());
+  const float med = ac[ac.size() / 2];
+  uint64_t hash = 0;
+  for (int i = 1; i < kLow * kLow; i++) {
+    if (coeffs[i] > med) {
+      hash |= 1ULL << i;
+    }
+  }
+  return hash;
+}
+
+int FrameKernels::hammingDistance(uint64_t a, uint64_t b) {
+  return __builtin_popcountll(a ^ b);
+}
@@ -0,0 +1,63 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 11:20:40
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 11:20:40
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/FrameKernels.h
+ * @Description: 帧处理的原生计算核
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// 图像上的矩形区域（像素）
+struct PixelRect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+// 这些计算核都是无状态的纯函数，可以在任意线程并发调用
+class FrameKernels {
+ public:
+  // YV12（Y 平面 + V 平面 + U 平面，即播放库 T_YV12）转 BGR24，BT.601
+  // width/height 须为偶数，bgr 至少 width*height*3 字节
+  static void yv12ToBgr(const unsigned char* yv12, int width, int height,
+                        unsigned char* bgr);
+
+  // 对灰度平面（例如 YV12 的 Y 平面）做整数倍的均值下采样
+  static void downscaleGray(const unsigned char* src, int width, int height,
+                            int factor, std::vector<unsigned char>* dst);
+
+  // YV12 三个平面同时做整数倍均值下采样，输出宽高向下取偶数，仍为 YV12。
+  // 返回输出宽高，factor<=1 时原样拷贝
+  static void downscaleYv12(const unsigned char* src, int width, int height,
+                            int factor, std::vector<unsigned char>* dst,
+                            int* out_width, int* out_height);
+
+  // 把不与任何 keep 区域相交的 block x block 亮度块（及对应色度块）替换为块均值。
+  // block 取 16 时与 4:2:0 JPEG 的 MCU 对齐，抹平的块编码后只剩直流系数，
+  // 相当于 ROI 外用无穷大的量化步长，ROI 内画质与坐标都不变
+  static void flattenOutside(unsigned char* yv12, int width, int height,
+                             const std::vector<PixelRect>& keep, int block);
+
+  // 裁出 rect（外扩到偶数坐标并裁剪到图像内）为新的 YV12，实际区域写入 actual
+  static bool cropYv12(const unsigned char* src, int width, int height,
+                       const PixelRect& rect, std::vector<unsigned char>* dst,
+                       PixelRect* actual);
+
+  // 灰度平面（YV12 的 Y 平面）上 rect 区域的 DCT 感知哈希：区域均值缩到 32x32，
+  // 做二维 DCT，取左上 8x8 低频系数与其中位数（不含直流）比较得到 64 位。
+  // 光照整体变化、轻微噪声和 JPEG 压缩下汉明距离很小，画面内容变了则距离大。
+  // rect 为 NULL 时取整幅。区域小于 32x32 或画面几乎没有纹理（全黑、全白、遮挡）时返回 0，
+  // 表示没有哈希（正常画面的 63 个交流比特不会全为 0）
+  static uint64_t phash(const unsigned char* gray, int width, int height,
+                        const PixelRect* rect);
+  static int hammingDistance(uint64_t a, uint64_t b);
+};
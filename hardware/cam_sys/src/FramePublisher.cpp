@@ -0,0 +1,315 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 16:40:12
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 16:40:12
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/FramePublisher.cpp
+ * @Description: 一路解码码流分发给多个订阅者，各自的帧率、分辨率和格式
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "FramePublisher.h"
+
+#include <string.h>
+
+#include <chrono>
+
+#include "FrameKernels.h"
+
+namespace {
+
+const int kScaledYv12 = -1;
+
+}  // namespace
+
+const SharedFrame::Rendition* SharedFrame::find(int format, int factor,
+                                                int quality) const {
+  for (size_t i = 0; i < renditions_.size(); i++) {
+    const Rendition& r = renditions_[i];
+    if (r.format == format && r.factor == factor &&
+        (format != kFrameJpeg || r.quality == quality)) {
+      return &renditions_[i];
+    }
+  }
+  return NULL;
+}
+
+// 下采样后的 YV12，factor 为 1 时直接引用原始像素
+const SharedFrame::Rendition* SharedFrame::scaled(int factor) {
+  const Rendition* hit = find(kScaledYv12, factor, 0);
+  if (hit != NULL) {
+    return hit;
+  }
+  Rendition r;
+  r.format = kScaledYv12;
+  r.factor = factor;
+  r.quality = 0;
+  if (factor <= 1) {
+    r.width = frame_.width;
+    r.height = frame_.height;
+    r.data = frame_.yv12;
+  } else {
+    std::shared_ptr<std::vector<unsigned char> > buf =
+        std::make_shared<std::vector<unsigned char> >();
+    FrameKernels::downscaleYv12(&(*frame_.yv12)[0], frame_.width,
+                                frame_.height, factor, buf.get(), &r.width,
+                                &r.height);
+    r.data = buf;
+  }
+  renditions_.push_back(r);
+  return &renditions_.back();
+}
+
+bool SharedFrame::render(int format, int factor, int quality,
+                         JpegEncoder* encoder, PublishedFrame* out) {
+  if (!frame_.yv12 || frame_.width <= 0 || frame_.height <= 0) {
+    return false;
+  }
+  if (factor < 1) {
+    factor = 1;
+  }
+  out->meta = frame_;
+  out->format = format;
+
+  // 同一帧的转换串行做：两个参数相同的订阅者同时到达时只算一次
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Rendition* hit = find(format, factor, quality);
+  if (hit == NULL) {
+    // renditions_ 可能在 push_back 时搬家，先拷出需要的字段
+    const Rendition* src = scaled(factor);
+    const int w = src->width;
+    const int h = src->height;
+    std::shared_ptr<const std::vector<unsigned char> > yv12 = src->data;
+    if (w <= 0 || h <= 0) {
+      return false;
+    }
+    Rendition r;
+    r.format = format;
+    r.factor = factor;
+    r.quality = quality;
+    r.width = w;
+    r.height = h;
+    std::shared_ptr<std::vector<unsigned char> > buf =
+        std::make_shared<std::vector<unsigned char> >();
+    const size_t y_size = static_cast<size_t>(w) * h;
+    if (format == kFrameGray) {
+      buf->assign(yv12->begin(), yv12->begin() + y_size);
+    } else if (format == kFrameBgr) {
+      buf->resize(y_size * 3);
+      FrameKernels::yv12ToBgr(&(*yv12)[0], w, h, &(*buf)[0]);
+    } else if (format == kFrameJpeg) {
+      if (encoder == NULL) {
+        return false;
+      }
+      encoder->setQuality(quality);
+      if (!encoder->encodeYv12(&(*yv12)[0], w, h, buf.get())) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+    r.data = buf;
+    renditions_.push_back(r);
+    hit = &renditions_.back();
+  }
+  out->width = hit->width;
+  out->height = hit->height;
+  out->data = hit->data;
+  return true;
+}
+
+FrameSubscription::FrameSubscription(const SubscriberOptions& options)
+    : options_(options),
+      interval_us_(options.max_fps > 0.0
+                       ? static_cast<int64_t>(1000000.0 / options.max_fps)
+                       : 0),
+      next_due_us_(0),
+      encoder_(options.jpeg_quality),
+      closed_(false),
+      delivered_(0),
+      dropped_(0) {
+  if (options_.queue_depth < 1) {
+    options_.queue_depth = 1;
+  }
+}
+
+bool FrameSubscription::due(int64_t host_us) const {
+  return interval_us_ == 0 || next_due_us_ == 0 || host_us >= next_due_us_;
+}
+
+void FrameSubscription::offer(const std::shared_ptr<SharedFrame>& frame) {
+  if (interval_us_ > 0) {
+    const int64_t host_us = frame->frame().host_us;
+    // 按节拍累加，平均帧率贴近 max_fps 而不是被源帧间隔向下取整；
+    // 落后太多（断流）或时钟重估后时间倒退时重新对齐
+    next_due_us_ += interval_us_;
+    if (next_due_us_ <= host_us - interval_us_ ||
+        next_due_us_ > host_us + 2 * interval_us_) {
+      next_due_us_ = host_us + interval_us_;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return;
+    }
+    while (queue_.size() >= static_cast<size_t>(options_.queue_depth)) {
+      queue_.pop_front();
+      dropped_++;
+    }
+    queue_.push_back(frame);
+  }
+  cond_.notify_one();
+}
+
+bool FrameSubscription::next(PublishedFrame* out, int timeout_ms) {
+  std::shared_ptr<SharedFrame> frame;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (timeout_ms < 0) {
+      cond_.wait(lock, [this]() { return closed_ || !queue_.empty(); });
+    } else {
+      cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                     [this]() { return closed_ || !queue_.empty(); });
+    }
+    if (queue_.empty()) {
+      return false;
+    }
+    frame = queue_.front();
+    queue_.pop_front();
+  }
+
+  // 转换在订阅者自己的线程上做，不占解码回调
+  int factor = 1;
+  const int width = frame->frame().width;
+  if (options_.max_width > 0 && width > options_.max_width) {
+    factor = (width + options_.max_width - 1) / options_.max_width;
+  }
+  if (!frame->render(options_.format, factor, options_.jpeg_quality, &encoder_,
+                     out)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  delivered_++;
+  return true;
+}
+
+void FrameSubscription::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    queue_.clear();
+  }
+  cond_.notify_all();
+}
+
+bool FrameSubscription::closed() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return closed_;
+}
+
+uint64_t FrameSubscription::delivered() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return delivered_;
+}
+
+uint64_t FrameSubscription::dropped() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_;
+}
+
+FramePublisher::FramePublisher() {}
+
+FramePublisher::~FramePublisher() { closeAll(); }
+
+std::shared_ptr<FrameSubscription> FramePublisher::subscribe(
+    const SubscriberOptions& options) {
+  std::shared_ptr<FrameSubscription> sub =
+      std::make_shared<FrameSubscription>(options);
+  std::lock_guard<std::mutex> lock(mutex_);
+  prune();
+  subs_.push_back(sub);
+  return sub;
+}
+
+void FramePublisher::prune() {
+  size_t kept = 0;
+  for (size_t i = 0; i < subs_.size(); i++) {
+    std::shared_ptr<FrameSubscription> sub = subs_[i].lock();
+    if (sub && !sub->closed()) {
+      subs_[kept++] = subs_[i];
+    }
+  }
+  subs_.resize(kept);
+}
+
+size_t FramePublisher::subscribers() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  prune();
+  return subs_.size();
+}
+
+bool FramePublisher::wants(int64_t host_us) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < subs_.size(); i++) {
+    std::shared_ptr<FrameSubscription> sub = subs_[i].lock();
+    if (sub && sub->due(host_us)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void FramePublisher::publish(const TimedFrame& frame) {
+  if (!frame.yv12) {
+    return;
+  }
+  std::shared_ptr<SharedFrame> shared;
+  std::lock_guard<std::mutex> lock(mutex_);
+  prune();
+  for (size_t i = 0; i < subs_.size(); i++) {
+    std::shared_ptr<FrameSubscription> sub = subs_[i].lock();
+    if (!sub || !sub->due(frame.host_us)) {
+      continue;
+    }
+    if (!shared) {
+      shared = std::make_shared<SharedFrame>(frame);
+    }
+    sub->offer(shared);
+  }
+}
+
+void FramePublisher::closeAll() {
+  std::vector<std::weak_ptr<FrameSubscription> > subs;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    subs.swap(subs_);
+  }
+  for (size_t i = 0; i < subs.size(); i++) {
+    std::shared_ptr<FrameSubscription> sub = subs[i].lock();
+    if (sub) {
+      sub->close();
+    }
+  }
+}
+
+std::shared_ptr<const std::vector<unsigned char> > FrameBufferPool::copy(
+    const unsigned char* data, size_t size) {
+  std::shared_ptr<std::vector<unsigned char> > buf;
+  for (size_t i = 0; i < buffers_.size(); i++) {
+    // 只有池自己引用时说明历史和订阅者都已放手
+    if (buffers_[i].use_count() == 1) {
+      buf = buffers_[i];
+      break;
+    }
+  }
+  if (!buf) {
+    buf = std::make_shared<std::vector<unsigned char> >();
+    if (buffers_.size() < max_cached_) {
+      buffers_.push_back(buf);
+    }
+  }
+  buf->resize(size);
+  memcpy(&(*buf)[0], data, size);
+  return buf;
+}
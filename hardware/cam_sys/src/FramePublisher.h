@@ -0,0 +1,157 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 16:40:12
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 16:40:12
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/FramePublisher.h
+ * @Description: 一路解码码流分发给多个订阅者，各自的帧率、分辨率和格式
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "FrameSync.h"
+#include "JpegEncoder.h"
+
+// 订阅者拿到的像素格式
+enum FrameFormat {
+  kFrameGray = 0,  // 只有 Y 平面
+  kFrameBgr = 1,   // BGR24，可直接交给 OpenCV
+  kFrameJpeg = 2,  // JPEG 字节流
+};
+
+struct SubscriberOptions {
+  int format;        // FrameFormat
+  double max_fps;    // 0 表示每帧都要
+  int max_width;     // 输出宽度上限，按整数倍下采样；0 表示原始分辨率
+  int jpeg_quality;  // 仅 kFrameJpeg
+  int queue_depth;   // 未取走的帧超过该数时丢弃最旧的
+
+  SubscriberOptions()
+      : format(kFrameGray), max_fps(0.0), max_width(0), jpeg_quality(80),
+        queue_depth(2) {}
+};
+
+struct PublishedFrame {
+  TimedFrame meta;  // 原始帧的时间信息与宽高，meta.yv12 为原始像素
+  int format;
+  int width;   // 输出宽高
+  int height;
+  // 同一帧同样参数的输出在订阅者之间共享，只读
+  std::shared_ptr<const std::vector<unsigned char> > data;
+
+  PublishedFrame() : format(kFrameGray), width(0), height(0) {}
+};
+
+// 一帧及其已生成的各种输出。格式转换在订阅者线程上按需进行，
+// 第一个需要某种输出的订阅者生成后缓存，后面参数相同的直接共享
+class SharedFrame {
+ public:
+  explicit SharedFrame(const TimedFrame& frame) : frame_(frame) {}
+
+  const TimedFrame& frame() const { return frame_; }
+  // encoder 由调用方（订阅者）提供，kFrameJpeg 以外可为 NULL
+  bool render(int format, int factor, int quality, JpegEncoder* encoder,
+              PublishedFrame* out);
+
+ private:
+  struct Rendition {
+    int format;  // -1 表示下采样后的 YV12 中间结果
+    int factor;
+    int quality;
+    int width;
+    int height;
+    std::shared_ptr<const std::vector<unsigned char> > data;
+  };
+
+  const Rendition* find(int format, int factor, int quality) const;
+  const Rendition* scaled(int factor);
+
+  TimedFrame frame_;
+  std::mutex mutex_;
+  std::vector<Rendition> renditions_;
+};
+
+// 订阅者持有；析构即退订。next 只应在一个线程上调用
+class FrameSubscription {
+ public:
+  explicit FrameSubscription(const SubscriberOptions& options);
+
+  // 等待下一帧，超时或已关闭返回 false。timeout_ms < 0 表示一直等
+  bool next(PublishedFrame* out, int timeout_ms);
+  void close();
+  bool closed();
+
+  const SubscriberOptions& options() const { return options_; }
+  uint64_t delivered();
+  // 因为取得太慢被挤掉的帧
+  uint64_t dropped();
+
+ private:
+  friend class FramePublisher;
+
+  // 按帧率判断这一帧是否轮到本订阅者，只在发布线程调用
+  bool due(int64_t host_us) const;
+  void offer(const std::shared_ptr<SharedFrame>& frame);
+
+  SubscriberOptions options_;
+  int64_t interval_us_;
+  int64_t next_due_us_;  // 发布线程独占
+  JpegEncoder encoder_;  // 订阅者线程独占
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::shared_ptr<SharedFrame> > queue_;
+  bool closed_;
+  uint64_t delivered_;
+  uint64_t dropped_;
+};
+
+// 解码回调线程调用 publish，只做入队（不拷贝、不转换），慢的订阅者只会丢自己的帧
+class FramePublisher {
+ public:
+  FramePublisher();
+  ~FramePublisher();
+
+  std::shared_ptr<FrameSubscription> subscribe(const SubscriberOptions& options);
+  size_t subscribers();
+
+  // 是否有订阅者需要 host_us 这一帧，用来决定解码回调里要不要拷贝像素
+  bool wants(int64_t host_us);
+  // frame.yv12 须已指向共享的像素
+  void publish(const TimedFrame& frame);
+  // 关闭所有订阅，阻塞在 next 上的订阅者立即返回
+  void closeAll();
+
+ private:
+  FramePublisher(const FramePublisher&);
+  FramePublisher& operator=(const FramePublisher&);
+
+  // 清理已析构的订阅，调用方持有 mutex_
+  void prune();
+
+  std::mutex mutex_;
+  std::vector<std::weak_ptr<FrameSubscription> > subs_;
+};
+
+// 解码回调里拷贝像素用的缓冲区池：没有人再引用的缓冲区直接复用
+class FrameBufferPool {
+ public:
+  explicit FrameBufferPool(size_t max_cached = 8) : max_cached_(max_cached) {}
+
+  std::shared_ptr<const std::vector<unsigned char> > copy(
+      const unsigned char* data, size_t size);
+
+ private:
+  size_t max_cached_;
+  std::vector<std::shared_ptr<std::vector<unsigned char> > > buffers_;
+};
@@ -0,0 +1,240 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 14:20:36
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 14:20:36
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/FrameSync.cpp
+ * @Description: 码流时钟到主机单调时钟的偏移估计，以及带时间戳的解码帧历史
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "FrameSync.h"
+
+#include <string.h>
+
+ClockOffsetEstimator::ClockOffsetEstimator() { reset(); }
+
+void ClockOffsetEstimator::reset() {
+  started_ = false;
+  last_raw_ = 0;
+  last_stamp_ms_ = 0;
+  last_arrival_us_ = 0;
+  count_ = 0;
+  next_ = 0;
+  offset_us_ = 0;
+  jitter_us_ = 0;
+}
+
+// nStamp 是 32 位毫秒计数，按与上一帧的有符号差值展开，回绕后仍单调
+int64_t ClockOffsetEstimator::unwrap(int stamp_ms) const {
+  int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(stamp_ms) -
+                                       static_cast<uint32_t>(last_raw_));
+  return last_stamp_ms_ + delta;
+}
+
+int64_t ClockOffsetEstimator::observe(int stamp_ms, int64_t arrival_us) {
+  int64_t stamp = started_ ? unwrap(stamp_ms) : stamp_ms;
+  if (started_) {
+    int64_t stamp_step = (stamp - last_stamp_ms_) * 1000;
+    int64_t host_step = arrival_us - last_arrival_us_;
+    int64_t gap = stamp_step - host_step;
+    if (gap > kResyncUs || gap < -kResyncUs) {
+      // 码流时间与主机时间推进不一致：重连或相机时钟跳变，旧样本作废
+      count_ = 0;
+      next_ = 0;
+    }
+  }
+  started_ = true;
+  last_raw_ = stamp_ms;
+  last_stamp_ms_ = stamp;
+  last_arrival_us_ = arrival_us;
+
+  samples_[next_] = arrival_us - stamp * 1000;
+  next_ = (next_ + 1) % kWindow;
+  if (count_ < kWindow) {
+    count_++;
+  }
+
+  int64_t lo = samples_[0];
+  for (int i = 1; i < count_; i++) {
+    if (samples_[i] < lo) {
+      lo = samples_[i];
+    }
+  }
+  int64_t excess = 0;
+  for (int i = 0; i < count_; i++) {
+    excess += samples_[i] - lo;
+  }
+  offset_us_ = lo;
+  jitter_us_ = excess / count_;
+  return stamp;
+}
+
+int64_t ClockOffsetEstimator::toHostUs(int64_t stamp_ms) const {
+  if (!valid()) {
+    return -1;
+  }
+  return stamp_ms * 1000 + offset_us_;
+}
+
+FrameHistory::FrameHistory(size_t depth)
+    : slots_(depth > 0 ? depth : 1),
+      next_(0),
+      count_(0),
+      keep_pixels_(false),
+      pushed_(0) {}
+
+void FrameHistory::configure(size_t depth, bool keep_pixels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  slots_.assign(depth > 0 ? depth : 1, TimedFrame());
+  next_ = 0;
+  count_ = 0;
+  keep_pixels_ = keep_pixels;
+}
+
+bool FrameHistory::keepPixels() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return keep_pixels_;
+}
+
+void FrameHistory::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < slots_.size(); i++) {
+    slots_[i] = TimedFrame();
+  }
+  next_ = 0;
+  count_ = 0;
+}
+
+size_t FrameHistory::depth() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slots_.size();
+}
+
+size_t FrameHistory::pixelBytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (size_t i = 0; i < slots_.size(); i++) {
+    if (slots_[i].yv12) {
+      bytes += slots_[i].yv12->size();
+    }
+  }
+  return bytes;
+}
+
+size_t FrameHistory::shrink(size_t depth) {
+  std::vector<TimedFrame> evicted;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (depth == 0 || depth >= slots_.size()) {
+    return 0;
+  }
+  std::vector<TimedFrame> kept;
+  kept.reserve(depth);
+  const size_t start = (next_ + slots_.size() - count_) % slots_.size();
+  for (size_t i = 0; i < count_; i++) {
+    TimedFrame& f = slots_[(start + i) % slots_.size()];
+    if (count_ - i > depth) {
+      evicted.push_back(f);
+    } else {
+      kept.push_back(f);
+    }
+  }
+  size_t freed = 0;
+  for (size_t i = 0; i < evicted.size(); i++) {
+    // 读者还持有的缓冲区要等读者放手才释放
+    if (evicted[i].yv12 && evicted[i].yv12.use_count() == 2) {
+      freed += evicted[i].yv12->size();
+    }
+  }
+  slots_.assign(depth, TimedFrame());
+  for (size_t i = 0; i < kept.size(); i++) {
+    slots_[i] = kept[i];
+  }
+  count_ = kept.size();
+  next_ = count_ % depth;
+  return freed;
+}
+
+void FrameHistory::push(const TimedFrame& meta, const unsigned char* yv12,
+                        size_t size) {
+  std::shared_ptr<std::vector<unsigned char> > buf;
+  size_t slot = 0;
+  bool copy = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slot = next_;
+    copy = keep_pixels_ && yv12 != NULL && size > 0;
+    if (copy) {
+      // 取走即将被覆盖的最旧一帧的缓冲区；读者还持有时另开一块
+      std::shared_ptr<const std::vector<unsigned char> >& old =
+          slots_[slot].yv12;
+      if (old && old.use_count() == 1) {
+        buf = std::const_pointer_cast<std::vector<unsigned char> >(old);
+      }
+      old.reset();
+    }
+  }
+
+  // 拷贝放在锁外，读者只会在提交后看到这一帧
+  if (copy) {
+    if (!buf) {
+      buf = std::make_shared<std::vector<unsigned char> >();
+    }
+    buf->resize(size);
+    memcpy(&(*buf)[0], yv12, size);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (slot >= slots_.size()) {
+    return;  // 拷贝期间被 configure 缩小
+  }
+  slots_[slot] = meta;
+  slots_[slot].yv12 = buf;
+  next_ = (slot + 1) % slots_.size();
+  if (count_ < slots_.size()) {
+    count_++;
+  }
+  pushed_++;
+}
+
+void FrameHistory::push(const TimedFrame& meta) {
+  std::shared_ptr<const std::vector<unsigned char> > evicted;
+  std::lock_guard<std::mutex> lock(mutex_);
+  // 被挤出的旧帧缓冲区放到锁外释放
+  evicted.swap(slots_[next_].yv12);
+  slots_[next_] = meta;
+  if (!keep_pixels_) {
+    slots_[next_].yv12.reset();
+  }
+  next_ = (next_ + 1) % slots_.size();
+  if (count_ < slots_.size()) {
+    count_++;
+  }
+  pushed_++;
+}
+
+std::vector<TimedFrame> FrameHistory::snapshot() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<TimedFrame> out;
+  out.reserve(count_);
+  // 最旧的一帧在 next_ - count_ 处
+  size_t start = (next_ + slots_.size() - count_) % slots_.size();
+  for (size_t i = 0; i < count_; i++) {
+    out.push_back(slots_[(start + i) % slots_.size()]);
+  }
+  return out;
+}
+
+bool FrameHistory::latest(TimedFrame* out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (count_ == 0) {
+    return false;
+  }
+  *out = slots_[(next_ + slots_.size() - 1) % slots_.size()];
+  return true;
+}
+
+uint64_t FrameHistory::pushed() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pushed_;
+}
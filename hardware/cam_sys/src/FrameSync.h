@@ -0,0 +1,108 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 14:20:36
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 14:20:36
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/FrameSync.h
+ * @Description: 码流时钟到主机单调时钟的偏移估计，以及带时间戳的解码帧历史
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 每路码流一个估计器。样本为 (码流时间戳, 主机收到该帧最后一个包的时刻)，
+// 传输和解码延迟只会让到达时刻偏晚，所以取最近 kWindow 个样本里
+// (到达时刻 - 码流时间) 的最小值作为偏移，窗口滑动即可跟上相机时钟漂移。
+// 码流时间戳与主机时间的推进差超过 kResyncUs（断线重连、相机重启）时重新估计。
+class ClockOffsetEstimator {
+ public:
+  ClockOffsetEstimator();
+
+  void reset();
+  // stamp_ms 为播放库 FRAME_INFO::nStamp，arrival_us 为 StreamRecorder::nowMicros()
+  // 返回展开回绕后的码流时间戳（毫秒）
+  int64_t observe(int stamp_ms, int64_t arrival_us);
+
+  // 样本数达到 kMinSamples 之前估计值不可靠
+  bool valid() const { return count_ >= kMinSamples; }
+  // 码流时间（毫秒，已展开）换算到主机单调时钟（微秒）；未就绪时返回 -1
+  int64_t toHostUs(int64_t stamp_ms) const;
+  int64_t offsetUs() const { return offset_us_; }
+  // 窗口内样本相对最小偏移的平均值，反映传输/解码抖动
+  int64_t jitterUs() const { return jitter_us_; }
+
+  static const int kWindow = 64;
+  static const int kMinSamples = 4;
+  static const int64_t kResyncUs = 2000000;
+
+ private:
+  int64_t unwrap(int stamp_ms) const;
+
+  bool started_;
+  int last_raw_;
+  int64_t last_stamp_ms_;
+  int64_t last_arrival_us_;
+  int64_t samples_[kWindow];
+  int count_;
+  int next_;
+  int64_t offset_us_;
+  int64_t jitter_us_;
+};
+
+// 一帧解码图像及其时间信息
+struct TimedFrame {
+  int64_t host_us;     // 按时钟偏移换算到主机单调时钟的成像时刻
+  int64_t arrival_us;  // 该帧最后一个码流包到达主机的时刻
+  int64_t stamp_ms;    // 展开回绕后的码流时间戳
+  uint32_t frame_num;
+  int width;
+  int height;
+  // YV12 像素，未开启像素缓存时为空；持有期间不会被后续帧覆盖
+  std::shared_ptr<const std::vector<unsigned char> > yv12;
+
+  TimedFrame()
+      : host_us(0), arrival_us(0), stamp_ms(0), frame_num(0), width(0),
+        height(0) {}
+};
+
+// 最近 depth 帧的环。push 在解码回调线程调用，稳态下复用像素缓冲区，
+// 只有读者仍持有旧缓冲区时才重新分配。
+class FrameHistory {
+ public:
+  explicit FrameHistory(size_t depth = 32);
+
+  // keep_pixels 为 false 时只记录时间信息（开销可忽略）
+  void configure(size_t depth, bool keep_pixels);
+  bool keepPixels();
+  void clear();
+  size_t depth();
+  // 当前缓存的像素字节数（与订阅者共享的缓冲区也算在内）
+  size_t pixelBytes();
+  // 缩到 depth 帧，保留最新的，返回不再被引用的像素字节数
+  size_t shrink(size_t depth);
+
+  // yv12 可为 NULL（非 YV12 帧或不缓存像素）
+  void push(const TimedFrame& meta, const unsigned char* yv12, size_t size);
+  // meta.yv12 已是共享缓冲区（与 FramePublisher 共用同一份拷贝），
+  // 不缓存像素时只记录时间信息
+  void push(const TimedFrame& meta);
+
+  // 按写入顺序（从旧到新）返回当前历史，像素共享不拷贝
+  std::vector<TimedFrame> snapshot();
+  bool latest(TimedFrame* out);
+  uint64_t pushed();
+
+ private:
+  std::mutex mutex_;
+  std::vector<TimedFrame> slots_;
+  size_t next_;
+  size_t count_;
+  bool keep_pixels_;
+  uint64_t pushed_;
+};
@@ -0,0 +1,336 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 01:05:42
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 01:05:42
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/JobGraph.cpp
+ * @Description: 单储位作业图：各阶段在自己的输入就绪时启动，先出暂定结果，输入到齐后定稿
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "JobGraph.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "EventBus.h"
+
+JobGraph::JobGraph() : begin_us_(EventBus::nowMicros()) {}
+
+int JobGraph::find(const std::string& name) const {
+  std::map<std::string, size_t>::const_iterator it = index_.find(name);
+  return it == index_.end() ? -1 : static_cast<int>(it->second);
+}
+
+bool JobGraph::resolveAll(const std::vector<std::string>& names,
+                          std::vector<size_t>* out) const {
+  for (size_t i = 0; i < names.size(); i++) {
+    const int k = find(names[i]);
+    if (k < 0) {
+      printf("JobGraph: 依赖 %s 不存在\n", names[i].c_str());
+      return false;
+    }
+    out->push_back(static_cast<size_t>(k));
+  }
+  return true;
+}
+
+bool JobGraph::addInput(const std::string& name) {
+  return addNode(name, std::vector<std::string>(), kJoinAll,
+                 std::vector<std::string>(), true);
+}
+
+bool JobGraph::addStage(const std::string& name,
+                        const std::vector<std::string>& deps, int join,
+                        const std::vector<std::string>& soft) {
+  return addNode(name, deps, join, soft, false);
+}
+
+bool JobGraph::addNode(const std::string& name,
+                       const std::vector<std::string>& deps, int join,
+                       const std::vector<std::string>& soft, bool input) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (name.empty() || find(name) >= 0) {
+    printf("JobGraph: 节点名为空或重复: %s\n", name.c_str());
+    return false;
+  }
+  Node n;
+  if (!resolveAll(deps, &n.deps) || !resolveAll(soft, &n.soft)) {
+    return false;
+  }
+  n.record.name = name;
+  n.record.input = input;
+  n.record.state = kJobWaiting;
+  n.record.runs = 0;
+  n.record.ready_us = -1;
+  n.record.start_us = -1;
+  n.record.end_us = -1;
+  n.record.busy_ms = 0.0;
+  n.join = join;
+  n.version = 0;
+  n.final_run = false;
+  n.rerun = false;
+  const size_t id = nodes_.size();
+  for (size_t i = 0; i < n.deps.size(); i++) {
+    nodes_[n.deps[i]].dependents.push_back(id);
+  }
+  for (size_t i = 0; i < n.soft.size(); i++) {
+    nodes_[n.soft[i]].dependents.push_back(id);
+  }
+  nodes_.push_back(n);
+  index_[name] = id;
+  return true;
+}
+
+bool JobGraph::hasValue(size_t i) const {
+  const int s = nodes_[i].record.state;
+  if (s == kJobDone || s == kJobProvisional) {
+    return true;
+  }
+  if (s == kJobFailed || s == kJobSkipped) {
+    return false;
+  }
+  // 暂定结果正在重算，下游仍可用旧结果
+  return nodes_[i].version > 0;
+}
+
+bool JobGraph::terminal(size_t i) const {
+  const int s = nodes_[i].record.state;
+  return s == kJobDone || s == kJobFailed || s == kJobSkipped;
+}
+
+int JobGraph::hardReady(const Node& n) const {
+  if (n.deps.empty()) {
+    return 1;
+  }
+  size_t with_value = 0;
+  size_t without = 0;
+  for (size_t i = 0; i < n.deps.size(); i++) {
+    if (hasValue(n.deps[i])) {
+      with_value++;
+    } else if (terminal(n.deps[i])) {
+      without++;
+    }
+  }
+  if (n.join == kJoinAny) {
+    if (with_value > 0) {
+      return 1;
+    }
+    return without == n.deps.size() ? -1 : 0;
+  }
+  if (without > 0) {
+    return -1;
+  }
+  return with_value == n.deps.size() ? 1 : 0;
+}
+
+bool JobGraph::finalNow(const Node& n) const {
+  for (size_t i = 0; i < n.soft.size(); i++) {
+    if (!terminal(n.soft[i])) {
+      return false;
+    }
+  }
+  if (n.join == kJoinAny) {
+    for (size_t i = 0; i < n.deps.size(); i++) {
+      if (nodes_[n.deps[i]].record.state == kJobDone) {
+        return true;
+      }
+    }
+    return n.deps.empty();
+  }
+  for (size_t i = 0; i < n.deps.size(); i++) {
+    if (nodes_[n.deps[i]].record.state != kJobDone) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool JobGraph::needed(const Node& n) const {
+  if (n.dependents.empty()) {
+    return true;
+  }
+  for (size_t i = 0; i < n.dependents.size(); i++) {
+    if (!terminal(n.dependents[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<long> JobGraph::versions(const Node& n) const {
+  std::vector<long> v;
+  v.reserve(n.deps.size() + n.soft.size());
+  for (size_t i = 0; i < n.deps.size(); i++) {
+    v.push_back(nodes_[n.deps[i]].version);
+  }
+  for (size_t i = 0; i < n.soft.size(); i++) {
+    v.push_back(nodes_[n.soft[i]].version);
+  }
+  return v;
+}
+
+void JobGraph::settle() {
+  const int64_t now = EventBus::nowMicros();
+  // 加入顺序即拓扑序，一遍即可把跳过、定稿传递到下游
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    Node& n = nodes_[i];
+    if (n.record.input) {
+      continue;
+    }
+    const int s = n.record.state;
+    if (s != kJobWaiting && s != kJobProvisional) {
+      continue;
+    }
+    const int ready = hardReady(n);
+    if (ready < 0) {
+      // 依赖失败：未运行的跳过，暂定结果作废
+      n.record.state = kJobSkipped;
+      n.record.end_us = now;
+    } else if (s == kJobWaiting) {
+      if (ready > 0 && n.record.ready_us < 0) {
+        n.record.ready_us = now;
+      }
+    } else if (finalNow(n)) {
+      // 依赖已定稿：期间没有新结果就直接定稿，否则重算
+      if (versions(n) == n.seen) {
+        n.record.state = kJobDone;
+      } else {
+        n.record.state = kJobWaiting;
+        n.rerun = true;
+      }
+    }
+  }
+}
+
+bool JobGraph::provide(const std::string& name, bool ok) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int k = find(name);
+  if (k < 0 || !nodes_[k].record.input ||
+      nodes_[k].record.state != kJobWaiting) {
+    printf("JobGraph: 输入 %s 不存在或已标记\n", name.c_str());
+    return false;
+  }
+  Node& n = nodes_[k];
+  const int64_t now = EventBus::nowMicros();
+  n.record.state = ok ? kJobDone : kJobFailed;
+  n.record.ready_us = now;
+  n.record.end_us = now;
+  if (ok) {
+    n.version++;
+  }
+  return true;
+}
+
+std::vector<std::string> JobGraph::takeReady() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  settle();
+  std::vector<std::string> out;
+  const int64_t now = EventBus::nowMicros();
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    Node& n = nodes_[i];
+    if (n.record.input || n.record.state != kJobWaiting) {
+      continue;
+    }
+    if (!n.rerun && hardReady(n) <= 0) {
+      continue;
+    }
+    if (!needed(n)) {
+      n.record.state = kJobSkipped;
+      n.record.end_us = now;
+      continue;
+    }
+    n.record.state = kJobRunning;
+    n.record.start_us = now;
+    n.record.runs++;
+    n.final_run = finalNow(n);
+    n.seen = versions(n);
+    n.rerun = false;
+    out.push_back(n.record.name);
+  }
+  return out;
+}
+
+bool JobGraph::finalRun(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int k = find(name);
+  return k >= 0 && nodes_[k].final_run;
+}
+
+bool JobGraph::finish(const std::string& name, bool ok) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int k = find(name);
+  if (k < 0 || nodes_[k].record.state != kJobRunning) {
+    // cancel 之后结束的阶段落在这里，结果丢弃
+    return false;
+  }
+  Node& n = nodes_[k];
+  const int64_t now = EventBus::nowMicros();
+  n.record.end_us = now;
+  n.record.busy_ms += (now - n.record.start_us) / 1000.0;
+  if (!ok) {
+    n.record.state = kJobFailed;
+  } else {
+    n.version++;
+    n.record.state = n.final_run ? kJobDone : kJobProvisional;
+  }
+  settle();
+  return true;
+}
+
+void JobGraph::cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int64_t now = EventBus::nowMicros();
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    if (!terminal(i)) {
+      nodes_[i].record.state = kJobSkipped;
+      nodes_[i].record.end_us = now;
+    }
+  }
+}
+
+bool JobGraph::done() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  settle();
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    if (!terminal(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int JobGraph::state(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int k = find(name);
+  return k < 0 ? -1 : nodes_[k].record.state;
+}
+
+double JobGraph::makespanMs() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t last = begin_us_;
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    last = std::max(last, nodes_[i].record.end_us);
+  }
+  return (last - begin_us_) / 1000.0;
+}
+
+double JobGraph::busyMs() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  double total = 0.0;
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    total += nodes_[i].record.busy_ms;
+  }
+  return total;
+}
+
+std::vector<JobRecord> JobGraph::records() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<JobRecord> out;
+  out.reserve(nodes_.size());
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    out.push_back(nodes_[i].record);
+  }
+  return out;
+}
@@ -0,0 +1,128 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 01:05:42
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 01:05:42
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/JobGraph.h
+ * @Description: 单储位作业图：各阶段在自己的输入就绪时启动，先出暂定结果，输入到齐后定稿
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum JobState {
+  kJobWaiting = 0,      // 依赖未满足，或暂定结果等待重算
+  kJobRunning = 1,      // 已由 takeReady 取走
+  kJobProvisional = 2,  // 已完成，但运行时有依赖未定稿，结果是暂定的
+  kJobDone = 3,         // 已完成且为终值
+  kJobFailed = 4,       // 运行失败，或输入未到（provide ok=false）
+  kJobSkipped = 5,      // 依赖失败或结果已不被需要，不运行
+};
+
+enum JobJoin {
+  kJoinAll = 0,  // 全部硬依赖有结果才启动，任一失败即跳过
+  kJoinAny = 1,  // 任一硬依赖有结果即启动，全部失败才跳过
+};
+
+struct JobRecord {
+  std::string name;
+  bool input;
+  int state;
+  int runs;          // 运行次数，暂定结果重算后大于 1
+  int64_t ready_us;  // 依赖满足时刻；输入为到达时刻（-1 表示尚未）
+  int64_t start_us;  // 最近一次开始
+  int64_t end_us;    // 最近一次结束
+  double busy_ms;    // 各次运行耗时合计
+};
+
+// 节点分输入和阶段两种：输入由 provide 标记到达或缺失，阶段由调用方执行。
+// 阶段的依赖必须先于它加入，图因此天然无环，按加入顺序即拓扑序。
+//
+// 硬依赖决定何时启动；软依赖（soft）不阻塞启动，但运行时若有软依赖未结束、
+// 或用到的硬依赖结果是暂定的，本次结果记为 kJobProvisional。依赖全部定稿后：
+// 期间依赖没有产生新结果则直接转为 kJobDone，否则重新放回就绪队列重算。
+// 例如计数阶段以条码解析为软依赖：3D 帧一到就按默认垛型出数，条码解析出垛型
+// 后再按新垛型重算一次。
+//
+// 调用方循环：takeReady 取出可运行阶段 → 执行 → finish，直到 done。
+// 一个阶段的所有下游都已结束时，它不会再被取出（记为 kJobSkipped），
+// 例如任一台扫码相机已解析出品规时，另一台还没开始的解码就不再运行。
+// 线程安全。
+class JobGraph {
+ public:
+  JobGraph();
+
+  bool addInput(const std::string& name);
+  // deps 为硬依赖，soft 为软依赖，均须已存在
+  bool addStage(const std::string& name, const std::vector<std::string>& deps,
+                int join = kJoinAll,
+                const std::vector<std::string>& soft =
+                    std::vector<std::string>());
+
+  // 输入到达（ok=true）或确定缺失（ok=false）；只能标记一次
+  bool provide(const std::string& name, bool ok);
+
+  // 取出当前可运行的阶段并标记为 kJobRunning，按加入顺序
+  std::vector<std::string> takeReady();
+  // 该阶段本次运行的结果是否为终值（运行时依赖已全部定稿）
+  bool finalRun(const std::string& name);
+  // 阶段结束；ok=false 时下游按依赖方式跳过
+  bool finish(const std::string& name, bool ok);
+
+  // 放弃：尚未结束的节点全部记为 kJobSkipped（运行中的阶段 finish 时忽略）
+  void cancel();
+  // 所有节点均已结束（kJobDone/kJobFailed/kJobSkipped）
+  bool done();
+
+  int state(const std::string& name);
+  // 建图到最后一个节点结束的时间，即关键路径长度
+  double makespanMs();
+  // 各阶段运行耗时合计，即串行执行所需时间
+  double busyMs();
+  std::vector<JobRecord> records();
+
+ private:
+  JobGraph(const JobGraph&);
+  JobGraph& operator=(const JobGraph&);
+
+  struct Node {
+    JobRecord record;
+    int join;
+    std::vector<size_t> deps;
+    std::vector<size_t> soft;
+    std::vector<size_t> dependents;  // 以本节点为硬依赖或软依赖的阶段
+    long version;                    // 每产生一次结果加 1
+    bool final_run;
+    std::vector<long> seen;  // 本次运行开始时各依赖（deps 后接 soft）的 version
+    bool rerun;              // 暂定结果需要重算
+  };
+
+  bool addNode(const std::string& name, const std::vector<std::string>& deps,
+               int join, const std::vector<std::string>& soft, bool input);
+
+  // 以下均要求持有 mutex_
+  int find(const std::string& name) const;
+  bool resolveAll(const std::vector<std::string>& names,
+                  std::vector<size_t>* out) const;
+  bool hasValue(size_t i) const;
+  bool terminal(size_t i) const;
+  // 硬依赖：1 可启动，0 继续等，-1 跳过
+  int hardReady(const Node& n) const;
+  bool finalNow(const Node& n) const;
+  bool needed(const Node& n) const;
+  std::vector<long> versions(const Node& n) const;
+  void settle();
+
+  std::mutex mutex_;
+  int64_t begin_us_;
+  std::vector<Node> nodes_;
+  std::map<std::string, size_t> index_;
+};
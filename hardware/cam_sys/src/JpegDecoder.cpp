@@ -0,0 +1,212 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 23:05:41
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 23:05:41
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/JpegDecoder.cpp
+ * @Description: 基于 libjpeg 的 JPEG 解码，支持 DCT 域缩小和输出时旋转
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "JpegDecoder.h"
+
+#include <setjmp.h>
+#include <string.h>
+
+// libjpeg 默认出错直接 exit()，这里改为 longjmp 回到调用处
+struct JpegDecoder::ErrorMgr {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+void JpegDecoder::onError(j_common_ptr cinfo) {
+  char msg[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, msg);
+  printf("[JpegDecoder] 解码失败: %s\n", msg);
+  longjmp(reinterpret_cast<ErrorMgr*>(cinfo->err)->jump, 1);
+}
+
+JpegDecoder::JpegDecoder()
+    : err_(new ErrorMgr()), out_w_(0), out_h_(0), out_c_(0) {
+  cinfo_.err = jpeg_std_error(&err_->pub);
+  err_->pub.error_exit = onError;
+  // 损坏数据的警告不刷屏
+  err_->pub.output_message = [](j_common_ptr) {};
+  jpeg_create_decompress(&cinfo_);
+}
+
+JpegDecoder::~JpegDecoder() {
+  jpeg_destroy_decompress(&cinfo_);
+  delete err_;
+}
+
+int JpegDecoder::pickScale(int width, int height, int min_long_side) {
+  const int long_side = width > height ? width : height;
+  int denom = 1;
+  while (denom < 8 && long_side / (denom * 2) >= min_long_side) {
+    denom *= 2;
+  }
+  return denom;
+}
+
+bool JpegDecoder::readFile(const std::string& path) {
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp) {
+    printf("[JpegDecoder] 无法打开 %s\n", path.c_str());
+    return false;
+  }
+  fseek(fp, 0, SEEK_END);
+  const long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  bool ok = size > 0;
+  if (ok) {
+    file_.resize(static_cast<size_t>(size));
+    ok = fread(&file_[0], 1, file_.size(), fp) == file_.size();
+  }
+  fclose(fp);
+  if (!ok) {
+    printf("[JpegDecoder] 读取 %s 失败\n", path.c_str());
+  }
+  return ok;
+}
+
+bool JpegDecoder::decodeFile(const std::string& path,
+                             const DecodeOptions& options, DecodedImage* out) {
+  return readFile(path) && decode(&file_[0], file_.size(), options, out);
+}
+
+void JpegDecoder::placeRow(int y, const unsigned char* row, int rotate,
+                           unsigned char* dst) const {
+  const int w = out_w_;
+  const int h = out_h_;
+  const int c = out_c_;
+  switch (rotate) {
+    case 90:
+      // 逆时针 90°：输出宽 h 高 w，源 (y, x) -> 输出 (w-1-x, y)
+      for (int x = 0; x < w; x++) {
+        memcpy(dst + (static_cast<size_t>(w - 1 - x) * h + y) * c,
+               row + x * c, c);
+      }
+      break;
+    case 180: {
+      unsigned char* out = dst + static_cast<size_t>(h - 1 - y) * w * c;
+      for (int x = 0; x < w; x++) {
+        memcpy(out + (w - 1 - x) * c, row + x * c, c);
+      }
+      break;
+    }
+    case 270:
+      // 逆时针 270°（顺时针 90°）：源 (y, x) -> 输出 (x, h-1-y)
+      for (int x = 0; x < w; x++) {
+        memcpy(dst + (static_cast<size_t>(x) * h + (h - 1 - y)) * c,
+               row + x * c, c);
+      }
+      break;
+    default:
+      memcpy(dst + static_cast<size_t>(y) * w * c, row,
+             static_cast<size_t>(w) * c);
+      break;
+  }
+}
+
+bool JpegDecoder::decode(const unsigned char* data, size_t size,
+                         const DecodeOptions& options, DecodedImage* out) {
+  const int rotate = options.rotate;
+  if (rotate != 0 && rotate != 90 && rotate != 180 && rotate != 270) {
+    printf("[JpegDecoder] 不支持旋转 %d°\n", rotate);
+    return false;
+  }
+  if (!data || size == 0) {
+    return false;
+  }
+  // 输出缓冲放在成员里：longjmp 不会跳过局部对象的析构
+  if (setjmp(err_->jump)) {
+    jpeg_abort_decompress(&cinfo_);
+    pixels_.reset();
+    return false;
+  }
+  jpeg_mem_src(&cinfo_, const_cast<unsigned char*>(data),
+               static_cast<unsigned long>(size));
+  jpeg_read_header(&cinfo_, TRUE);
+
+  int denom = options.scale_denom;
+  if (denom <= 0) {
+    denom = pickScale(cinfo_.image_width, cinfo_.image_height,
+                      options.min_long_side);
+  }
+  if (denom != 1 && denom != 2 && denom != 4 && denom != 8) {
+    printf("[JpegDecoder] 不支持缩小倍数 1/%d\n", denom);
+    jpeg_abort_decompress(&cinfo_);
+    return false;
+  }
+  // 缩小在 IDCT 里完成：1/8 时每个 8x8 块只算直流分量，不解全分辨率再缩
+  cinfo_.scale_num = 1;
+  cinfo_.scale_denom = denom;
+  cinfo_.dct_method = options.fast ? JDCT_IFAST : JDCT_ISLOW;
+  cinfo_.do_fancy_upsampling = options.fast ? FALSE : TRUE;
+  const bool gray = options.format == kDecodeGray;
+  bool swap_rb = false;
+  if (gray) {
+    cinfo_.out_color_space = JCS_GRAYSCALE;
+  } else {
+#ifdef JCS_EXTENSIONS
+    cinfo_.out_color_space = JCS_EXT_BGR;
+#else
+    // 原版 libjpeg 不支持 BGR 输出，解成 RGB 后逐行交换
+    cinfo_.out_color_space = JCS_RGB;
+    swap_rb = true;
+#endif
+  }
+  jpeg_start_decompress(&cinfo_);
+
+  out_w_ = cinfo_.output_width;
+  out_h_ = cinfo_.output_height;
+  out_c_ = cinfo_.output_components;
+  const size_t row_bytes = static_cast<size_t>(out_w_) * out_c_;
+  pixels_.reset(new std::vector<unsigned char>(row_bytes * out_h_));
+  unsigned char* dst = &(*pixels_)[0];
+  const bool direct = rotate == 0 && !swap_rb;
+  // 一次取 rec_outbuf_height 行（缩小或上采样时为 1~4 行）
+  const int n = cinfo_.rec_outbuf_height > 1
+                    ? (cinfo_.rec_outbuf_height < 16 ? cinfo_.rec_outbuf_height
+                                                     : 16)
+                    : 1;
+  if (!direct) {
+    rows_.resize(row_bytes * n);
+  }
+  JSAMPROW rows[16];
+  while (cinfo_.output_scanline < cinfo_.output_height) {
+    const int y0 = cinfo_.output_scanline;
+    for (int i = 0; i < n; i++) {
+      const int y = y0 + i < out_h_ ? y0 + i : out_h_ - 1;
+      rows[i] = direct ? dst + y * row_bytes : &rows_[i * row_bytes];
+    }
+    const int got = jpeg_read_scanlines(&cinfo_, rows, n);
+    if (direct) {
+      continue;
+    }
+    for (int i = 0; i < got; i++) {
+      unsigned char* row = rows[i];
+      if (swap_rb) {
+        for (int x = 0; x < out_w_; x++) {
+          const unsigned char r = row[x * 3];
+          row[x * 3] = row[x * 3 + 2];
+          row[x * 3 + 2] = r;
+        }
+      }
+      placeRow(y0 + i, row, rotate, dst);
+    }
+  }
+  jpeg_finish_decompress(&cinfo_);
+
+  const bool swap_wh = rotate == 90 || rotate == 270;
+  out->width = swap_wh ? out_h_ : out_w_;
+  out->height = swap_wh ? out_w_ : out_h_;
+  out->channels = out_c_;
+  out->src_width = cinfo_.image_width;
+  out->src_height = cinfo_.image_height;
+  out->scale_denom = denom;
+  out->data = pixels_;
+  pixels_.reset();
+  return true;
+}
@@ -0,0 +1,88 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 23:05:41
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 23:05:41
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/JpegDecoder.h
+ * @Description: 基于 libjpeg 的 JPEG 解码，支持 DCT 域缩小和输出时旋转
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <jpeglib.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+enum DecodeFormat {
+  kDecodeGray = 0,  // 只解亮度，彩色图跳过色度上采样和颜色转换
+  kDecodeBgr = 1,   // BGR24，可直接交给 OpenCV / YOLO
+};
+
+struct DecodeOptions {
+  int format;           // DecodeFormat
+  int scale_denom;      // DCT 域缩小为 1/1、1/2、1/4、1/8；0 表示按下一项自动选
+  int min_long_side;    // 自动选倍数时缩小后的长边不小于该值（YOLO 输入边长）
+  int rotate;           // 逆时针旋转 0/90/180/270，与 PIL Image.rotate 同向
+  bool fast;            // 整数快速 IDCT、不做平滑上采样：快约三成，画质略降
+
+  DecodeOptions()
+      : format(kDecodeBgr), scale_denom(1), min_long_side(640), rotate(0),
+        fast(false) {}
+};
+
+struct DecodedImage {
+  int width;  // 缩小、旋转之后
+  int height;
+  int channels;
+  int src_width;  // 原图宽高
+  int src_height;
+  int scale_denom;  // 实际使用的缩小倍数，原图坐标 = 解码坐标 * scale_denom
+  std::shared_ptr<const std::vector<unsigned char> > data;
+
+  DecodedImage()
+      : width(0), height(0), channels(0), src_width(0), src_height(0),
+        scale_denom(1) {}
+};
+
+// 复用同一个 jpeg_decompress_struct 和文件缓冲区。
+// 单个实例不可跨线程并发使用，每个线程各建一个即可。
+class JpegDecoder {
+ public:
+  JpegDecoder();
+  ~JpegDecoder();
+
+  bool decode(const unsigned char* data, size_t size,
+              const DecodeOptions& options, DecodedImage* out);
+  bool decodeFile(const std::string& path, const DecodeOptions& options,
+                  DecodedImage* out);
+
+  // 缩小后长边仍不小于 min_long_side 的最大倍数（1/2/4/8）
+  static int pickScale(int width, int height, int min_long_side);
+
+ private:
+  JpegDecoder(const JpegDecoder&);
+  JpegDecoder& operator=(const JpegDecoder&);
+
+  struct ErrorMgr;
+  static void onError(j_common_ptr cinfo);
+
+  bool readFile(const std::string& path);
+  // 解码出的一行按 rotate 写入输出
+  void placeRow(int y, const unsigned char* row, int rotate,
+                unsigned char* dst) const;
+
+  jpeg_decompress_struct cinfo_;
+  ErrorMgr* err_;
+  std::vector<unsigned char> file_;  // decodeFile 的文件内容，跨图复用
+  std::vector<unsigned char> rows_;  // 旋转时的行缓冲
+  std::shared_ptr<std::vector<unsigned char> > pixels_;  // 正在解的输出
+  int out_w_;                        // 当前图解码（未旋转）的宽高和通道数
+  int out_h_;
+  int out_c_;
+};
@@ -0,0 +1,183 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 11:42:08
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 11:42:08
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/JpegEncoder.cpp
+ * @Description: 基于 libjpeg 的内存 JPEG 编码
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "JpegEncoder.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+
+// libjpeg 默认出错直接 exit()，这里改为 longjmp 回到调用处
+struct JpegEncoder::ErrorMgr {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+void JpegEncoder::onError(j_common_ptr cinfo) {
+  char msg[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, msg);
+  printf("[JpegEncoder] 编码失败: %s\n", msg);
+  longjmp(reinterpret_cast<ErrorMgr*>(cinfo->err)->jump, 1);
+}
+
+JpegEncoder::JpegEncoder(int quality)
+    : quality_(quality),
+      err_(new ErrorMgr()),
+      mem_(NULL),
+      mem_size_(0),
+      prev_mem_(NULL) {
+  cinfo_.err = jpeg_std_error(&err_->pub);
+  err_->pub.error_exit = onError;
+  jpeg_create_compress(&cinfo_);
+}
+
+JpegEncoder::~JpegEncoder() {
+  jpeg_destroy_compress(&cinfo_);
+  free(mem_);
+  delete err_;
+}
+
+bool JpegEncoder::begin(int width, int height, int components,
+                        J_COLOR_SPACE space, std::vector<unsigned char>* out) {
+  out->clear();
+  // 复用上一帧的输出缓冲区；不够时 libjpeg 会另行 malloc 并更新 mem_，
+  // 但不会释放我们传入的那块，由 releaseStale() 负责
+  prev_mem_ = mem_;
+  jpeg_mem_dest(&cinfo_, &mem_, &mem_size_);
+  cinfo_.image_width = width;
+  cinfo_.image_height = height;
+  cinfo_.input_components = components;
+  cinfo_.in_color_space = space;
+  jpeg_set_defaults(&cinfo_);
+  jpeg_set_quality(&cinfo_, quality_, TRUE);
+  cinfo_.dct_method = JDCT_ISLOW;
+  return true;
+}
+
+bool JpegEncoder::finish(std::vector<unsigned char>* out) {
+  jpeg_finish_compress(&cinfo_);
+  // 完成后 mem_size_ 是实际数据长度，也作为下一帧可安全使用的缓冲区大小
+  out->assign(mem_, mem_ + mem_size_);
+  releaseStale();
+  return true;
+}
+
+bool JpegEncoder::fail() {
+  jpeg_abort_compress(&cinfo_);
+  releaseStale();
+  return false;
+}
+
+void JpegEncoder::releaseStale() {
+  if (mem_ != prev_mem_) {
+    free(prev_mem_);
+    prev_mem_ = mem_;
+  }
+}
+
+bool JpegEncoder::encodeYv12(const unsigned char* yv12, int width, int height,
+                             std::vector<unsigned char>* out) {
+  if (width <= 0 || height <= 0 || (width & 1) || (height & 1)) {
+    return false;
+  }
+  if (setjmp(err_->jump)) {
+    return fail();
+  }
+  begin(width, height, 3, JCS_YCbCr, out);
+  jpeg_set_colorspace(&cinfo_, JCS_YCbCr);
+  cinfo_.raw_data_in = TRUE;
+#if JPEG_LIB_VERSION >= 70
+  cinfo_.do_fancy_downsampling = FALSE;
+#endif
+  // 4:2:0 采样：Y 2x2，Cb/Cr 1x1
+  cinfo_.comp_info[0].h_samp_factor = 2;
+  cinfo_.comp_info[0].v_samp_factor = 2;
+  cinfo_.comp_info[1].h_samp_factor = 1;
+  cinfo_.comp_info[1].v_samp_factor = 1;
+  cinfo_.comp_info[2].h_samp_factor = 1;
+  cinfo_.comp_info[2].v_samp_factor = 1;
+  jpeg_start_compress(&cinfo_, TRUE);
+
+  const int cw = width / 2;
+  const int ch = height / 2;
+  const unsigned char* y_plane = yv12;
+  const unsigned char* v_plane = yv12 + width * height;  // YV12 先 V 后 U
+  const unsigned char* u_plane = v_plane + cw * ch;
+
+  JSAMPROW y_rows[16];
+  JSAMPROW cb_rows[8];
+  JSAMPROW cr_rows[8];
+  JSAMPARRAY planes[3] = {y_rows, cb_rows, cr_rows};
+  while (cinfo_.next_scanline < cinfo_.image_height) {
+    const int base = cinfo_.next_scanline;
+    // 最后一个 MCU 行不足 16 行时重复最后一行
+    for (int i = 0; i < 16; i++) {
+      int r = base + i < height ? base + i : height - 1;
+      y_rows[i] = const_cast<JSAMPROW>(y_plane + r * width);
+    }
+    for (int i = 0; i < 8; i++) {
+      int r = base / 2 + i < ch ? base / 2 + i : ch - 1;
+      cb_rows[i] = const_cast<JSAMPROW>(u_plane + r * cw);
+      cr_rows[i] = const_cast<JSAMPROW>(v_plane + r * cw);
+    }
+    jpeg_write_raw_data(&cinfo_, planes, 16);
+  }
+  return finish(out);
+}
+
+bool JpegEncoder::encodeBgr(const unsigned char* bgr, int width, int height,
+                            std::vector<unsigned char>* out) {
+  if (width <= 0 || height <= 0) {
+    return false;
+  }
+  if (setjmp(err_->jump)) {
+    return fail();
+  }
+#ifdef JCS_EXTENSIONS
+  begin(width, height, 3, JCS_EXT_BGR, out);
+  jpeg_start_compress(&cinfo_, TRUE);
+  while (cinfo_.next_scanline < cinfo_.image_height) {
+    JSAMPROW row = const_cast<JSAMPROW>(bgr + cinfo_.next_scanline * width * 3);
+    jpeg_write_scanlines(&cinfo_, &row, 1);
+  }
+#else
+  // 原版 libjpeg 不支持 BGR 输入，逐行交换成 RGB
+  begin(width, height, 3, JCS_RGB, out);
+  jpeg_start_compress(&cinfo_, TRUE);
+  std::vector<unsigned char> rgb(width * 3);
+  while (cinfo_.next_scanline < cinfo_.image_height) {
+    const unsigned char* src = bgr + cinfo_.next_scanline * width * 3;
+    for (int x = 0; x < width; x++) {
+      rgb[x * 3] = src[x * 3 + 2];
+      rgb[x * 3 + 1] = src[x * 3 + 1];
+      rgb[x * 3 + 2] = src[x * 3];
+    }
+    JSAMPROW row = &rgb[0];
+    jpeg_write_scanlines(&cinfo_, &row, 1);
+  }
+#endif
+  return finish(out);
+}
+
+bool JpegEncoder::encodeGray(const unsigned char* gray, int width, int height,
+                             std::vector<unsigned char>* out) {
+  if (width <= 0 || height <= 0) {
+    return false;
+  }
+  if (setjmp(err_->jump)) {
+    return fail();
+  }
+  begin(width, height, 1, JCS_GRAYSCALE, out);
+  jpeg_start_compress(&cinfo_, TRUE);
+  while (cinfo_.next_scanline < cinfo_.image_height) {
+    JSAMPROW row = const_cast<JSAMPROW>(gray + cinfo_.next_scanline * width);
+    jpeg_write_scanlines(&cinfo_, &row, 1);
+  }
+  return finish(out);
+}
@@ -0,0 +1,55 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 11:42:08
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 11:42:08
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/JpegEncoder.h
+ * @Description: 基于 libjpeg 的内存 JPEG 编码
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdio.h>
+
+#include <jpeglib.h>
+
+#include <vector>
+
+// 复用同一个 jpeg_compress_struct，避免每帧重新分配编码器。
+// 单个实例不可跨线程并发使用，每个线程各建一个即可。
+class JpegEncoder {
+ public:
+  explicit JpegEncoder(int quality = 90);
+  ~JpegEncoder();
+
+  void setQuality(int quality) { quality_ = quality; }
+
+  // YV12 直接以 raw_data 方式送入编码器，省去颜色空间转换（抓图主路径）
+  bool encodeYv12(const unsigned char* yv12, int width, int height,
+                  std::vector<unsigned char>* out);
+  bool encodeBgr(const unsigned char* bgr, int width, int height,
+                 std::vector<unsigned char>* out);
+  bool encodeGray(const unsigned char* gray, int width, int height,
+                  std::vector<unsigned char>* out);
+
+ private:
+  JpegEncoder(const JpegEncoder&);
+  JpegEncoder& operator=(const JpegEncoder&);
+
+  struct ErrorMgr;
+  static void onError(j_common_ptr cinfo);
+
+  bool begin(int width, int height, int components, J_COLOR_SPACE space,
+             std::vector<unsigned char>* out);
+  bool finish(std::vector<unsigned char>* out);
+  bool fail();
+  void releaseStale();
+
+  int quality_;
+  jpeg_compress_struct cinfo_;
+  ErrorMgr* err_;
+  unsigned char* mem_;  // jpeg_mem_dest 的输出缓冲区，跨帧复用
+  unsigned long mem_size_;
+  unsigned char* prev_mem_;
+};
@@ -0,0 +1,399 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 13:42:07
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 13:42:07
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/MemoryGovernor.cpp
+ * @Description: 进程内存预算：各子系统登记预算和当前用量，接近上限时按优先级回调收缩
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "MemoryGovernor.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+const char* levelName(int level) {
+  return level == kMemHard ? "hard" : level == kMemSoft ? "soft" : "normal";
+}
+
+// 在 /proc 下的 "Key:   123 kB" 格式文件里取一项，返回字节
+int64_t readProcKb(const char* path, const char* key) {
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  const size_t key_len = strlen(key);
+  char line[256];
+  int64_t value = -1;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (strncmp(line, key, key_len) == 0 && line[key_len] == ':') {
+      long long kb = 0;
+      if (sscanf(line + key_len + 1, "%lld", &kb) == 1) {
+        value = static_cast<int64_t>(kb) * 1024;
+      }
+      break;
+    }
+  }
+  fclose(fp);
+  return value;
+}
+
+}  // namespace
+
+MemoryGovernor& MemoryGovernor::instance() {
+  static MemoryGovernor governor;
+  return governor;
+}
+
+MemoryGovernor::MemoryGovernor()
+    : limit_(0),
+      soft_ratio_(0.85),
+      hard_ratio_(0.95),
+      min_available_(0),
+      next_id_(1),
+      accounted_(0),
+      last_rss_(-1),
+      last_available_(-1),
+      level_(kMemNormal),
+      soft_events_(0),
+      hard_events_(0),
+      interval_ms_(1000),
+      stopping_(false) {}
+
+MemoryGovernor::~MemoryGovernor() { stopMonitor(); }
+
+void MemoryGovernor::configure(int64_t limit_bytes, double soft_ratio,
+                               double hard_ratio, int64_t min_available) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  limit_ = std::max<int64_t>(limit_bytes, 0);
+  hard_ratio_ = hard_ratio > 0.0 ? hard_ratio : 0.95;
+  soft_ratio_ = soft_ratio > 0.0 ? std::min(soft_ratio, hard_ratio_)
+                                 : std::min(0.85, hard_ratio_);
+  min_available_ = std::max<int64_t>(min_available, 0);
+  printf("内存预算: 上限 %lld MB, soft %.2f, hard %.2f, 系统可用下限 %lld MB\n",
+         static_cast<long long>(limit_ >> 20), soft_ratio_, hard_ratio_,
+         static_cast<long long>(min_available_ >> 20));
+}
+
+long MemoryGovernor::attach(const std::string& name, int64_t budget,
+                            int priority, ShrinkCallback cb) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry e;
+  e.account.id = next_id_++;
+  e.account.name = name;
+  e.account.budget = budget;
+  e.account.used = 0;
+  e.account.peak = 0;
+  e.account.priority = priority;
+  e.account.shrinks = 0;
+  e.account.released = 0;
+  e.account.deferred = 0;
+  e.cb = cb;
+  entries_[e.account.id] = e;
+  return e.account.id;
+}
+
+void MemoryGovernor::detach(long id) {
+  // 先拿收缩锁：正在进行的收缩回调结束后才摘除
+  std::lock_guard<std::mutex> shrink_lock(shrink_mutex_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<long, Entry>::iterator it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+  accounted_ -= it->second.account.used;
+  entries_.erase(it);
+}
+
+void MemoryGovernor::setBudget(long id, int64_t budget) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<long, Entry>::iterator it = entries_.find(id);
+  if (it != entries_.end()) {
+    it->second.account.budget = budget;
+  }
+}
+
+void MemoryGovernor::set(long id, int64_t used) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<long, Entry>::iterator it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+  MemoryAccount& a = it->second.account;
+  used = std::max<int64_t>(used, 0);
+  accounted_ += used - a.used;
+  a.used = used;
+  a.peak = std::max(a.peak, used);
+}
+
+void MemoryGovernor::add(long id, int64_t delta) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<long, Entry>::iterator it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+  MemoryAccount& a = it->second.account;
+  const int64_t used = std::max<int64_t>(a.used + delta, 0);
+  accounted_ += used - a.used;
+  a.used = used;
+  a.peak = std::max(a.peak, used);
+}
+
+int MemoryGovernor::evaluate(int64_t rss, int64_t available, int64_t extra,
+                             int64_t* excess) const {
+  int level = kMemNormal;
+  *excess = 0;
+  if (limit_ > 0) {
+    const int64_t usage = std::max(rss, accounted_) + extra;
+    const int64_t soft = static_cast<int64_t>(limit_ * soft_ratio_);
+    const int64_t hard = static_cast<int64_t>(limit_ * hard_ratio_);
+    if (usage >= hard) {
+      level = kMemHard;
+    } else if (usage >= soft) {
+      level = kMemSoft;
+    }
+    *excess = std::max<int64_t>(usage - soft, 0);
+  }
+  if (min_available_ > 0 && available >= 0) {
+    const int64_t avail = available - extra;
+    if (avail < min_available_ / 2) {
+      level = kMemHard;
+    } else if (avail < min_available_) {
+      level = std::max<int>(level, kMemSoft);
+    }
+    *excess = std::max(*excess, min_available_ - avail);
+  }
+  return level;
+}
+
+void MemoryGovernor::setLevel(int level) {
+  if (level == level_) {
+    return;
+  }
+  if (level >= kMemSoft && level_ < kMemSoft) {
+    soft_events_++;
+  }
+  if (level == kMemHard) {
+    hard_events_++;
+  }
+  printf("内存压力 %s -> %s: RSS %lld MB, 账目 %lld MB, 系统可用 %lld MB\n",
+         levelName(level_), levelName(level),
+         static_cast<long long>(last_rss_ >> 20),
+         static_cast<long long>(accounted_ >> 20),
+         static_cast<long long>(last_available_ >> 20));
+  level_ = level;
+}
+
+int64_t MemoryGovernor::shrink(int level, int64_t excess) {
+  struct Ask {
+    long id;
+    int64_t amount;  // 超预算的部分；0 表示按剩余超出量
+    ShrinkCallback cb;
+  };
+  std::vector<Ask> over;
+  std::vector<std::pair<int, Ask> > rest;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::map<long, Entry>::iterator it = entries_.begin();
+         it != entries_.end(); ++it) {
+      const MemoryAccount& a = it->second.account;
+      if (!it->second.cb || a.used <= 0) {
+        continue;
+      }
+      Ask ask;
+      ask.id = a.id;
+      ask.cb = it->second.cb;
+      ask.amount = a.budget > 0 ? a.used - a.budget : 0;
+      if (ask.amount > 0) {
+        over.push_back(ask);
+      } else {
+        ask.amount = 0;
+        rest.push_back(std::make_pair(a.priority, ask));
+      }
+    }
+  }
+  std::sort(over.begin(), over.end(), [](const Ask& x, const Ask& y) {
+    return x.amount > y.amount;
+  });
+  std::stable_sort(
+      rest.begin(), rest.end(),
+      [](const std::pair<int, Ask>& x, const std::pair<int, Ask>& y) {
+        return x.first < y.first;
+      });
+
+  // 超预算的全部回调一遍；其余的按优先级，释放够了就停
+  std::vector<Ask> order(over);
+  for (size_t i = 0; i < rest.size(); i++) {
+    order.push_back(rest[i].second);
+  }
+  int64_t freed_total = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    const bool over_budget = i < over.size();
+    const int64_t remaining = excess - freed_total;
+    if (!over_budget && remaining <= 0) {
+      break;
+    }
+    const int64_t ask = over_budget ? std::max(order[i].amount, remaining)
+                                    : remaining;
+    int64_t freed = order[i].cb(level, ask);
+    freed = std::max<int64_t>(freed, 0);
+    freed_total += freed;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<long, Entry>::iterator it = entries_.find(order[i].id);
+    if (it != entries_.end()) {
+      it->second.account.shrinks++;
+      it->second.account.released += freed;
+    }
+  }
+  return freed_total;
+}
+
+int MemoryGovernor::check() {
+  const int64_t rss = readRss();
+  const int64_t available = readAvailable();
+  std::lock_guard<std::mutex> shrink_lock(shrink_mutex_);
+  int level = kMemNormal;
+  int64_t excess = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_rss_ = rss;
+    last_available_ = available;
+    level = evaluate(rss, available, 0, &excess);
+    setLevel(level);
+  }
+  if (level > kMemNormal) {
+    shrink(level, excess);
+  }
+  return level;
+}
+
+bool MemoryGovernor::reserve(long id, int64_t bytes) {
+  int64_t rss = readRss();
+  const int64_t available = readAvailable();
+  std::lock_guard<std::mutex> shrink_lock(shrink_mutex_);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    int64_t excess = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::map<long, Entry>::iterator it = entries_.find(id);
+      if (it == entries_.end()) {
+        return false;
+      }
+      if (evaluate(rss, available, bytes, &excess) < kMemHard) {
+        MemoryAccount& a = it->second.account;
+        a.used += bytes;
+        a.peak = std::max(a.peak, a.used);
+        accounted_ += bytes;
+        return true;
+      }
+      if (attempt > 0) {
+        it->second.account.deferred++;
+        return false;
+      }
+    }
+    // 释放的内存不一定立即还给系统，重新采样 RSS 只作参考
+    shrink(kMemHard, excess);
+    rss = readRss();
+  }
+  return false;
+}
+
+int MemoryGovernor::level() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return level_;
+}
+
+void MemoryGovernor::monitorLoop() {
+  std::unique_lock<std::mutex> lock(monitor_mutex_);
+  while (!stopping_) {
+    monitor_cv_.wait_for(lock, std::chrono::milliseconds(interval_ms_));
+    if (stopping_) {
+      break;
+    }
+    lock.unlock();
+    check();
+    lock.lock();
+  }
+}
+
+void MemoryGovernor::startMonitor(int interval_ms) {
+  std::lock_guard<std::mutex> lock(monitor_mutex_);
+  interval_ms_ = std::max(interval_ms, 10);
+  if (monitor_.joinable()) {
+    monitor_cv_.notify_all();
+    return;
+  }
+  stopping_ = false;
+  monitor_ = std::thread(&MemoryGovernor::monitorLoop, this);
+}
+
+void MemoryGovernor::stopMonitor() {
+  std::thread monitor;
+  {
+    std::lock_guard<std::mutex> lock(monitor_mutex_);
+    stopping_ = true;
+    monitor_cv_.notify_all();
+    monitor.swap(monitor_);
+  }
+  if (monitor.joinable()) {
+    monitor.join();
+  }
+}
+
+std::vector<MemoryAccount> MemoryGovernor::accounts() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<MemoryAccount> out;
+  out.reserve(entries_.size());
+  for (std::map<long, Entry>::iterator it = entries_.begin();
+       it != entries_.end(); ++it) {
+    out.push_back(it->second.account);
+  }
+  return out;
+}
+
+MemoryStats MemoryGovernor::stats() {
+  const int64_t rss = readRss();
+  const int64_t rss_peak = readRssPeak();
+  const int64_t available = readAvailable();
+  std::lock_guard<std::mutex> lock(mutex_);
+  MemoryStats st;
+  st.limit = limit_;
+  st.accounted = accounted_;
+  st.rss = rss;
+  st.rss_peak = rss_peak;
+  st.available = available;
+  st.level = level_;
+  st.soft_events = soft_events_;
+  st.hard_events = hard_events_;
+  return st;
+}
+
+int64_t MemoryGovernor::readRss() {
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  long long size = 0;
+  long long resident = 0;
+  const int n = fscanf(fp, "%lld %lld", &size, &resident);
+  fclose(fp);
+  if (n != 2) {
+    return -1;
+  }
+  return static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+int64_t MemoryGovernor::readRssPeak() {
+  return readProcKb("/proc/self/status", "VmHWM");
+}
+
+int64_t MemoryGovernor::readAvailable() {
+  return readProcKb("/proc/meminfo", "MemAvailable");
+}
@@ -0,0 +1,148 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 13:42:07
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 13:42:07
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/MemoryGovernor.h
+ * @Description: 进程内存预算：各子系统登记预算和当前用量，接近上限时按优先级回调收缩
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 压力等级
+enum MemoryPressure {
+  kMemNormal = 0,
+  kMemSoft = 1,  // 接近上限：收缩缓存
+  kMemHard = 2,  // 即将超限：降到最低配置，推迟批量工作
+};
+
+// 一个子系统的账目（字节）
+struct MemoryAccount {
+  long id;
+  std::string name;
+  int64_t budget;
+  int64_t used;
+  int64_t peak;
+  int priority;       // 越小越先被收缩
+  uint64_t shrinks;   // 被回调收缩的次数
+  int64_t released;   // 回调累计报告释放的字节
+  uint64_t deferred;  // reserve 被拒绝的次数
+};
+
+struct MemoryStats {
+  int64_t limit;          // 0 表示只看系统可用内存
+  int64_t accounted;      // 各账目 used 之和
+  int64_t rss;            // 本进程常驻内存，读取失败为 -1
+  int64_t rss_peak;       // VmHWM
+  int64_t available;      // 系统 MemAvailable，读取失败为 -1
+  int level;              // MemoryPressure
+  uint64_t soft_events;   // 进入 soft 的次数
+  uint64_t hard_events;   // 进入 hard 的次数
+};
+
+// 同一台工控机上 gateway、worker、Redis、模拟器一起跑，各进程按 config.json
+// 给的上限自律。本进程的用量取 max(RSS, 各账目之和)，与 soft/hard 比例比较；
+// 系统可用内存低于 min_available 时同样算作有压力（不管本进程占多少）。
+//
+// 有压力时按以下顺序回调收缩，直到释放量覆盖超出部分：
+//   1. 用量超过自己预算的账目，超得多的先；
+//   2. 其余账目按 priority 从小到大。
+// 回调返回实际释放的字节，收缩后应自行 set 新用量。
+//
+// set/add 只更新计数（解码回调线程可调用），不触发回调；
+// check 或监控线程负责评估和回调，reserve 在拒绝前先做一次收缩。
+// 回调串行执行，不持有账目锁；回调里可以 set/add，不能 detach/check/reserve。
+// 线程安全。
+class MemoryGovernor {
+ public:
+  // level 为当前压力，excess 为希望该账目释放的字节（可能为 0）
+  typedef std::function<int64_t(int level, int64_t excess)> ShrinkCallback;
+
+  static MemoryGovernor& instance();
+
+  // limit_bytes 为 0 时只看系统可用内存
+  void configure(int64_t limit_bytes, double soft_ratio = 0.85,
+                 double hard_ratio = 0.95, int64_t min_available = 0);
+
+  // 返回账目编号；detach 返回后回调不会再被调用
+  long attach(const std::string& name, int64_t budget, int priority,
+              ShrinkCallback cb = ShrinkCallback());
+  void detach(long id);
+  void setBudget(long id, int64_t budget);
+
+  void set(long id, int64_t used);
+  void add(long id, int64_t delta);
+  // 申请临时用量（批量工作开始前）：会超过 hard 线时先收缩一轮，
+  // 仍不够则返回 false，调用方推迟；成功时计入 used，做完用 add(id, -bytes)
+  bool reserve(long id, int64_t bytes);
+
+  // 采样并评估，有压力时回调收缩，返回评估时的等级
+  int check();
+  int level();
+
+  // 后台每 interval_ms 调用一次 check；重复调用只改间隔
+  void startMonitor(int interval_ms);
+  void stopMonitor();
+
+  std::vector<MemoryAccount> accounts();
+  MemoryStats stats();
+
+  // 读取失败返回 -1
+  static int64_t readRss();
+  static int64_t readRssPeak();
+  static int64_t readAvailable();
+
+ private:
+  MemoryGovernor();
+  ~MemoryGovernor();
+  MemoryGovernor(const MemoryGovernor&);
+  MemoryGovernor& operator=(const MemoryGovernor&);
+
+  struct Entry {
+    MemoryAccount account;
+    ShrinkCallback cb;
+  };
+
+  // 以下要求持有 mutex_
+  int evaluate(int64_t rss, int64_t available, int64_t extra,
+               int64_t* excess) const;
+  void setLevel(int level);
+
+  // 以下要求持有 shrink_mutex_
+  int64_t shrink(int level, int64_t excess);
+
+  void monitorLoop();
+
+  std::mutex shrink_mutex_;  // 串行化收缩回调，先于 mutex_ 获取
+  std::mutex mutex_;
+  int64_t limit_;
+  double soft_ratio_;
+  double hard_ratio_;
+  int64_t min_available_;
+  long next_id_;
+  std::map<long, Entry> entries_;
+  int64_t accounted_;
+  int64_t last_rss_;
+  int64_t last_available_;
+  int level_;
+  uint64_t soft_events_;
+  uint64_t hard_events_;
+
+  std::mutex monitor_mutex_;
+  std::condition_variable monitor_cv_;
+  std::thread monitor_;
+  int interval_ms_;
+  bool stopping_;
+};
@@ -0,0 +1,382 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 17:25:03
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 17:25:03
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/PreviewServer.cpp
+ * @Description: 抓图码流的低帧率 MJPEG 预览（HTTP），供 Web 界面查看相机画面
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "PreviewServer.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+const int kAcceptPollMs = 200;     // stop 最多等这么久
+const int kFramePollMs = 500;      // 等帧的间隔，期间检查是否停止
+const int kSnapshotWaitMs = 3000;  // /snapshot 等下一帧的上限
+const int kIoTimeoutSec = 5;       // 观看端卡住（不读）超过该时间就断开
+const size_t kMaxRequest = 4096;
+const char kBoundary[] = "leafdepotframe";
+
+void setTimeouts(int fd) {
+  struct timeval tv;
+  tv.tv_sec = kIoTimeoutSec;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// 写完全部 iov；对端断开或超时返回 false。MSG_NOSIGNAL 避免 SIGPIPE 杀掉抓图进程
+bool sendAll(int fd, struct iovec* iov, int count) {
+  while (count > 0) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    size_t left = static_cast<size_t>(n);
+    while (count > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+      iov->iov_len -= left;
+    }
+  }
+  return true;
+}
+
+bool sendString(int fd, const std::string& s) {
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(s.data());
+  iov.iov_len = s.size();
+  return sendAll(fd, &iov, 1);
+}
+
+void sendStatus(int fd, const char* status, const std::string& body) {
+  std::string resp = std::string("HTTP/1.0 ") + status +
+                     "\r\nContent-Type: text/plain; charset=utf-8"
+                     "\r\nAccess-Control-Allow-Origin: *"
+                     "\r\nConnection: close"
+                     "\r\nContent-Length: " +
+                     std::to_string(body.size()) + "\r\n\r\n" + body;
+  sendString(fd, resp);
+}
+
+// 读到请求头结束，只取请求行的方法和路径
+bool readRequest(int fd, std::string* method, std::string* path) {
+  std::string req;
+  char buf[1024];
+  while (req.find("\r\n\r\n") == std::string::npos) {
+    if (req.size() > kMaxRequest) {
+      return false;
+    }
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    req.append(buf, n);
+  }
+  size_t sp1 = req.find(' ');
+  size_t sp2 = sp1 == std::string::npos ? sp1 : req.find(' ', sp1 + 1);
+  if (sp2 == std::string::npos) {
+    return false;
+  }
+  *method = req.substr(0, sp1);
+  *path = req.substr(sp1 + 1, sp2 - sp1 - 1);
+  size_t query = path->find('?');
+  if (query != std::string::npos) {
+    path->resize(query);
+  }
+  return true;
+}
+
+bool startsWith(const std::string& s, const char* prefix) {
+  return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+}  // namespace
+
+PreviewServer::PreviewServer()
+    : listen_fd_(-1), port_(0), running_(false), viewers_(0) {}
+
+PreviewServer::~PreviewServer() { stop(); }
+
+void PreviewServer::setOptions(const PreviewOptions& options) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  options_ = options;
+}
+
+void PreviewServer::addSource(const std::string& name, CamController* cam) {
+  if (cam == NULL) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  sources_[name] = cam;
+}
+
+void PreviewServer::removeSource(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sources_.erase(name);
+}
+
+bool PreviewServer::start(unsigned short port,
+                          const std::string& bind_address) {
+  if (running_) {
+    return true;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    printf("预览服务创建 socket 失败: %s\n", strerror(errno));
+    return false;
+  }
+  // 抓图脚本逐个运行，上一个进程的连接还在 TIME_WAIT 时也要能立即绑定
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr) != 1) {
+    printf("预览服务地址无效: %s\n", bind_address.c_str());
+    close(fd);
+    return false;
+  }
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 16) != 0) {
+    printf("预览服务监听 %s:%u 失败: %s\n", bind_address.c_str(), port,
+           strerror(errno));
+    close(fd);
+    return false;
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+  port_ = ntohs(addr.sin_port);
+  listen_fd_ = fd;
+  running_ = true;
+  accept_thread_ = std::thread(&PreviewServer::acceptLoop, this);
+  printf("预览服务已启动: http://%s:%u/streams\n", bind_address.c_str(), port_);
+  return true;
+}
+
+void PreviewServer::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  if (accept_thread_.joinable()) {
+    accept_thread_.join();
+  }
+  close(listen_fd_);
+  listen_fd_ = -1;
+  reap(true);
+  printf("预览服务已停止\n");
+}
+
+void PreviewServer::acceptLoop() {
+  while (running_) {
+    struct pollfd pfd;
+    pfd.fd = listen_fd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, kAcceptPollMs);
+    reap(false);
+    if (ready <= 0) {
+      continue;
+    }
+    int fd = accept4(listen_fd_, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    setTimeouts(fd);
+    std::shared_ptr<Connection> conn = std::make_shared<Connection>();
+    conn->fd = fd;
+    conn->thread = std::thread(&PreviewServer::serve, this, conn.get());
+    std::lock_guard<std::mutex> lock(conn_mutex_);
+    connections_.push_back(conn);
+  }
+}
+
+void PreviewServer::reap(bool all) {
+  std::vector<std::shared_ptr<Connection> > finished;
+  {
+    std::lock_guard<std::mutex> lock(conn_mutex_);
+    size_t kept = 0;
+    for (size_t i = 0; i < connections_.size(); i++) {
+      if (all || connections_[i]->done) {
+        finished.push_back(connections_[i]);
+      } else {
+        connections_[kept++] = connections_[i];
+      }
+    }
+    connections_.resize(kept);
+  }
+  // 先 shutdown 让阻塞在 send/recv 上的线程返回，join 之后再 close，
+  // 避免线程还在用的 fd 号被新连接复用
+  for (size_t i = 0; i < finished.size(); i++) {
+    shutdown(finished[i]->fd, SHUT_RDWR);
+    finished[i]->thread.join();
+    close(finished[i]->fd);
+  }
+}
+
+void PreviewServer::serve(Connection* conn) {
+  std::string method;
+  std::string path;
+  if (!readRequest(conn->fd, &method, &path)) {
+    conn->done = true;
+    return;
+  }
+  if (method != "GET") {
+    sendStatus(conn->fd, "405 Method Not Allowed", "only GET\n");
+  } else if (path == "/" || path == "/streams") {
+    serveIndex(conn->fd);
+  } else if (startsWith(path, "/stream/")) {
+    serveStream(conn->fd, path.substr(strlen("/stream/")), false);
+  } else if (startsWith(path, "/snapshot/")) {
+    serveStream(conn->fd, path.substr(strlen("/snapshot/")), true);
+  } else {
+    sendStatus(conn->fd, "404 Not Found", "unknown path\n");
+  }
+  conn->done = true;
+}
+
+void PreviewServer::serveIndex(int fd) {
+  std::string body = "{\"streams\": [";
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool first = true;
+    for (std::map<std::string, CamController*>::const_iterator it =
+             sources_.begin();
+         it != sources_.end(); ++it) {
+      body += first ? "" : ", ";
+      body += "{\"name\": \"" + it->first +
+              "\", \"viewers\": " + std::to_string(source_viewers_[it->first]) +
+              "}";
+      first = false;
+    }
+  }
+  body += "]}\n";
+  std::string resp =
+      "HTTP/1.0 200 OK\r\nContent-Type: application/json"
+      "\r\nAccess-Control-Allow-Origin: *\r\nCache-Control: no-cache"
+      "\r\nConnection: close\r\nContent-Length: " +
+      std::to_string(body.size()) + "\r\n\r\n" + body;
+  sendString(fd, resp);
+}
+
+std::shared_ptr<FrameSubscription> PreviewServer::subscribe(
+    const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, CamController*>::iterator it = sources_.find(name);
+  if (it == sources_.end()) {
+    return std::shared_ptr<FrameSubscription>();
+  }
+  // 同一帧参数相同的订阅共享编码结果，多个观看者只编码一次
+  SubscriberOptions opt;
+  opt.format = kFrameJpeg;
+  opt.max_fps = options_.max_fps;
+  opt.max_width = options_.max_width;
+  opt.jpeg_quality = options_.jpeg_quality;
+  opt.queue_depth = 1;  // 只看最新画面
+  source_viewers_[name]++;
+  return it->second->subscribe(opt);
+}
+
+void PreviewServer::serveStream(int fd, const std::string& name, bool single) {
+  int max_viewers = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_viewers = options_.max_viewers;
+  }
+  if (viewers_.fetch_add(1) >= max_viewers) {
+    viewers_--;
+    sendStatus(fd, "503 Service Unavailable", "too many viewers\n");
+    return;
+  }
+  std::shared_ptr<FrameSubscription> sub = subscribe(name);
+  if (!sub) {
+    viewers_--;
+    sendStatus(fd, "404 Not Found", "unknown stream: " + name + "\n");
+    return;
+  }
+
+  if (single) {
+    PublishedFrame frame;
+    if (sub->next(&frame, kSnapshotWaitMs)) {
+      std::string header =
+          "HTTP/1.0 200 OK\r\nContent-Type: image/jpeg"
+          "\r\nAccess-Control-Allow-Origin: *\r\nCache-Control: no-cache"
+          "\r\nConnection: close\r\nContent-Length: " +
+          std::to_string(frame.data->size()) + "\r\n\r\n";
+      struct iovec iov[2];
+      iov[0].iov_base = const_cast<char*>(header.data());
+      iov[0].iov_len = header.size();
+      iov[1].iov_base = const_cast<unsigned char*>(frame.data->data());
+      iov[1].iov_len = frame.data->size();
+      sendAll(fd, iov, 2);
+    } else {
+      sendStatus(fd, "503 Service Unavailable", "no frame (stream not running?)\n");
+    }
+  } else {
+    std::string header =
+        std::string("HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=") +
+        kBoundary +
+        "\r\nAccess-Control-Allow-Origin: *\r\nCache-Control: no-cache"
+        "\r\nConnection: close\r\n\r\n";
+    bool ok = sendString(fd, header);
+    PublishedFrame frame;
+    while (ok && running_) {
+      if (!sub->next(&frame, kFramePollMs)) {
+        if (sub->closed()) {
+          break;  // 相机已登出
+        }
+        continue;
+      }
+      // 分片头、JPEG、分片尾一次 sendmsg 发出，JPEG 不再拷贝
+      std::string part = std::string("--") + kBoundary +
+                         "\r\nContent-Type: image/jpeg\r\nContent-Length: " +
+                         std::to_string(frame.data->size()) + "\r\n\r\n";
+      struct iovec iov[3];
+      iov[0].iov_base = const_cast<char*>(part.data());
+      iov[0].iov_len = part.size();
+      iov[1].iov_base = const_cast<unsigned char*>(frame.data->data());
+      iov[1].iov_len = frame.data->size();
+      iov[2].iov_base = const_cast<char*>("\r\n");
+      iov[2].iov_len = 2;
+      ok = sendAll(fd, iov, 3);
+    }
+  }
+
+  // 退订后没有观看者的码流不再拷贝和编码
+  sub->close();
+  sub.reset();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    source_viewers_[name]--;
+  }
+  viewers_--;
+}
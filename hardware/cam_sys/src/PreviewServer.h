@@ -0,0 +1,91 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 17:25:03
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 17:25:03
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/PreviewServer.h
+ * @Description: 抓图码流的低帧率 MJPEG 预览（HTTP），供 Web 界面查看相机画面
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CamController.h"
+
+struct PreviewOptions {
+  double max_fps;   // 每个观看者的帧率上限
+  int max_width;    // 预览宽度上限
+  int jpeg_quality;
+  int max_viewers;  // 同时观看的连接数上限，超出返回 503
+
+  PreviewOptions()
+      : max_fps(2.0), max_width(640), jpeg_quality(70), max_viewers(8) {}
+};
+
+// 预览画面来自抓图已在解码的码流（CamController::subscribe），不新开相机会话。
+// 没有观看者时不订阅，解码回调里也就不拷贝、不编码，对抓图几乎零开销。
+// 接口（均为 GET，带 Access-Control-Allow-Origin: *）：
+//   /streams              JSON：各路名称与当前观看数
+//   /stream/<name>        multipart/x-mixed-replace MJPEG，可直接放进 <img src>
+//   /snapshot/<name>      等下一帧，返回单张 JPEG
+// 相机须比服务器活得久（先 stop 再 logout/析构相机）。
+class PreviewServer {
+ public:
+  PreviewServer();
+  ~PreviewServer();
+
+  void setOptions(const PreviewOptions& options);
+  // name 为 URL 中的名称，一般用相机类型（3d_camera、scan_camera_1 ...）
+  void addSource(const std::string& name, CamController* cam);
+  void removeSource(const std::string& name);
+
+  // port 为 0 时由系统分配，实际端口见 port()。
+  // 预览没有鉴权，默认只监听本机；对外开放须显式传地址
+  bool start(unsigned short port,
+             const std::string& bind_address = "127.0.0.1");
+  void stop();
+  bool running() const { return running_; }
+  unsigned short port() const { return port_; }
+  int viewers() const { return viewers_; }
+
+ private:
+  PreviewServer(const PreviewServer&);
+  PreviewServer& operator=(const PreviewServer&);
+
+  struct Connection {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> done;
+    Connection() : fd(-1), done(false) {}
+  };
+
+  void acceptLoop();
+  void serve(Connection* conn);
+  void serveStream(int fd, const std::string& name, bool single);
+  void serveIndex(int fd);
+  // 回收已结束的连接线程，stop 时 all 为 true 则全部回收
+  void reap(bool all);
+
+  std::shared_ptr<FrameSubscription> subscribe(const std::string& name);
+
+  PreviewOptions options_;
+  std::mutex mutex_;
+  std::map<std::string, CamController*> sources_;
+  std::map<std::string, int> source_viewers_;
+
+  int listen_fd_;
+  unsigned short port_;
+  std::atomic<bool> running_;
+  std::atomic<int> viewers_;
+  std::thread accept_thread_;
+  std::mutex conn_mutex_;
+  std::vector<std::shared_ptr<Connection> > connections_;
+};
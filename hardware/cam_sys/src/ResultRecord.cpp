@@ -0,0 +1,336 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 21:14:33
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 21:14:33
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/ResultRecord.cpp
+ * @Description: worker 与 gateway 之间的储位结果记录：定长头、varint 字段、共享字典字符串
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "ResultRecord.h"
+
+#include <string.h>
+
+#include <unordered_map>
+
+namespace {
+
+const uint8_t kVersion = 1;
+const size_t kHeaderSize = 5;
+
+// 版本 1 的共享字典，只能在末尾追加（services/api/shared/result_record.py 有同一份）
+const char* const kDictionary[] = {
+    "",
+    "成功",
+    "异常",
+    "未识别",
+    "无",
+    "success",
+    "failed",
+    "no_match",
+    "disabled",
+    "3d_camera/main.jpg",
+    "3d_camera/depth.jpg",
+    "3d_camera/main_rotated.jpg",
+    "3d_camera/depth_color.jpg",
+    "scan_camera_1/main.jpg",
+    "scan_camera_2/main.jpg",
+    "未匹配到烟箱信息",
+    "所有相机抓图失败",
+    "检测超时（储位时间预算耗尽）",
+    "未找到图片",
+    "条码识别前储位时间预算已耗尽",
+    "3D相机抓图失败：未找到main.jpg",
+    "3D相机抓图失败：未找到depth.jpg",
+    "扫码相机拍照失败：未找到图片",
+};
+
+const char* const kStrGroups[kResultStrCount] = {
+    "", "", "", "", "", "", "", "", "",
+    "detect_result", "detect_result",
+    "barcode_result", "barcode_result", "barcode_result", "barcode_result",
+    "barcode_result", "barcode_result",
+    "",
+};
+
+const char* const kStrKeys[kResultStrCount] = {
+    NULL,
+    NULL,
+    "status",
+    "actualSpec",
+    "error",
+    "photo3dPath",
+    "photoDepthPath",
+    "photoScan1Path",
+    "photoScan2Path",
+    "status",
+    "error",
+    "status",
+    "six_digit_code",
+    "product_name",
+    "tobacco_code",
+    "message",
+    "error",
+    NULL,
+};
+
+const char* const kIntGroups[kResultIntCount] = {
+    "", "detect_result", "detect_result", "barcode_result", "",
+};
+
+const char* const kIntKeys[kResultIntCount] = {
+    "actualQuantity", "total_count", "pile_id", "mapped_pile_id", NULL,
+};
+
+bool isPhoto(int field) {
+  return field >= kResPhoto3d && field <= kResPhotoScan2;
+}
+
+void putVarint(uint64_t v, std::string* out) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<char>(v));
+}
+
+// 读到结尾或超过 10 字节时返回 false
+bool getVarint(const uint8_t** p, const uint8_t* end, uint64_t* v) {
+  uint64_t r = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const uint8_t b = *(*p)++;
+    r |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      *v = r;
+      return true;
+    }
+  }
+  return false;
+}
+
+const std::unordered_map<std::string, int>& dictionaryIndex() {
+  static const std::unordered_map<std::string, int> index = [] {
+    std::unordered_map<std::string, int> m;
+    const std::vector<std::string>& dict = ResultCodec::dictionary();
+    for (size_t i = 0; i < dict.size(); i++) {
+      m[dict[i]] = static_cast<int>(i);
+    }
+    return m;
+  }();
+  return index;
+}
+
+void putString(const char* s, size_t len, std::string* out) {
+  const std::unordered_map<std::string, int>& index = dictionaryIndex();
+  std::unordered_map<std::string, int>::const_iterator it =
+      index.find(std::string(s, len));
+  if (it != index.end()) {
+    putVarint(static_cast<uint64_t>(it->second) << 1 | 1, out);
+    return;
+  }
+  putVarint(static_cast<uint64_t>(len) << 1, out);
+  out->append(s, len);
+}
+
+// 读一个字符串；dict_id 为字典编号，内联时为 -1
+bool getString(const uint8_t** p, const uint8_t* end, std::string* out,
+               int* dict_id) {
+  uint64_t v = 0;
+  if (!getVarint(p, end, &v)) {
+    return false;
+  }
+  if (v & 1) {
+    const std::vector<std::string>& dict = ResultCodec::dictionary();
+    if ((v >> 1) >= dict.size()) {
+      return false;
+    }
+    *dict_id = static_cast<int>(v >> 1);
+    *out = dict[*dict_id];
+    return true;
+  }
+  const uint64_t len = v >> 1;
+  if (len > static_cast<uint64_t>(end - *p)) {
+    return false;
+  }
+  *dict_id = -1;
+  out->assign(reinterpret_cast<const char*>(*p), static_cast<size_t>(len));
+  *p += len;
+  return true;
+}
+
+struct Masks {
+  uint64_t str_mask;
+  uint64_t str_null_mask;
+  uint64_t int_mask;
+  uint64_t int_null_mask;
+  uint64_t rel_mask;
+};
+
+bool getHeader(const uint8_t** p, const uint8_t* end, Masks* m) {
+  return getVarint(p, end, &m->str_mask) &&
+         getVarint(p, end, &m->str_null_mask) &&
+         getVarint(p, end, &m->int_mask) &&
+         getVarint(p, end, &m->int_null_mask) &&
+         getVarint(p, end, &m->rel_mask);
+}
+
+}  // namespace
+
+ResultRecord::ResultRecord()
+    : kind(kResultFinal),
+      flags(0),
+      str_mask(0),
+      str_null_mask(0),
+      int_mask(0),
+      int_null_mask(0) {
+  for (int i = 0; i < kResultIntCount; i++) {
+    ints[i] = 0;
+  }
+  for (int i = 0; i < kResultStrCount; i++) {
+    dict_ids[i] = -1;
+  }
+}
+
+const std::vector<std::string>& ResultCodec::dictionary() {
+  static const std::vector<std::string> dict(
+      kDictionary, kDictionary + sizeof(kDictionary) / sizeof(kDictionary[0]));
+  return dict;
+}
+
+void ResultCodec::strKey(int field, const char** group, const char** key) {
+  *group = kStrGroups[field];
+  *key = kStrKeys[field];
+}
+
+void ResultCodec::intKey(int field, const char** group, const char** key) {
+  *group = kIntGroups[field];
+  *key = kIntKeys[field];
+}
+
+bool ResultCodec::isRecord(const char* data, size_t len) {
+  return len >= kHeaderSize && data[0] == 'L' && data[1] == 'R';
+}
+
+void ResultCodec::encode(const ResultRecord& record, std::string* out) {
+  out->clear();
+  out->push_back('L');
+  out->push_back('R');
+  out->push_back(static_cast<char>(kVersion));
+  out->push_back(static_cast<char>(record.kind));
+  out->push_back(static_cast<char>(record.flags));
+
+  // 照片路径以 "/<任务>/<储位>/" 开头时只存后缀，后缀多半在字典里
+  std::string prefix;
+  const uint32_t both = (1u << kResTaskNo) | (1u << kResBin);
+  if ((record.str_mask & both) == both) {
+    prefix = "/" + record.strs[kResTaskNo] + "/" + record.strs[kResBin] + "/";
+  }
+  uint32_t rel_mask = 0;
+  for (int i = kResPhoto3d; i <= kResPhotoScan2 && !prefix.empty(); i++) {
+    if ((record.str_mask & (1u << i)) &&
+        record.strs[i].compare(0, prefix.size(), prefix) == 0) {
+      rel_mask |= 1u << i;
+    }
+  }
+  putVarint(record.str_mask, out);
+  putVarint(record.str_null_mask, out);
+  putVarint(record.int_mask, out);
+  putVarint(record.int_null_mask, out);
+  putVarint(rel_mask, out);
+
+  for (int i = 0; i < kResultStrCount; i++) {
+    if ((record.str_mask & (1u << i)) == 0) {
+      continue;
+    }
+    const std::string& s = record.strs[i];
+    if (rel_mask & (1u << i)) {
+      putString(s.data() + prefix.size(), s.size() - prefix.size(), out);
+    } else {
+      putString(s.data(), s.size(), out);
+    }
+  }
+  for (int i = 0; i < kResultIntCount; i++) {
+    if (record.int_mask & (1u << i)) {
+      const int64_t v = record.ints[i];
+      const uint64_t zigzag =
+          (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+      putVarint(zigzag, out);
+    }
+  }
+}
+
+bool ResultCodec::decode(const char* data, size_t len, ResultRecord* record) {
+  if (!isRecord(data, len) || static_cast<uint8_t>(data[2]) != kVersion) {
+    return false;
+  }
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data) + kHeaderSize;
+  const uint8_t* end = reinterpret_cast<const uint8_t*>(data) + len;
+  Masks m;
+  if (!getHeader(&p, end, &m)) {
+    return false;
+  }
+  *record = ResultRecord();
+  record->kind = static_cast<uint8_t>(data[3]);
+  record->flags = static_cast<uint8_t>(data[4]);
+  record->str_mask = static_cast<uint32_t>(m.str_mask);
+  record->str_null_mask = static_cast<uint32_t>(m.str_null_mask);
+  record->int_mask = static_cast<uint32_t>(m.int_mask);
+  record->int_null_mask = static_cast<uint32_t>(m.int_null_mask);
+  for (int i = 0; i < kResultStrCount; i++) {
+    if ((m.str_mask & (1u << i)) == 0) {
+      continue;
+    }
+    if (!getString(&p, end, &record->strs[i], &record->dict_ids[i])) {
+      return false;
+    }
+    if ((m.rel_mask & (1u << i)) && isPhoto(i)) {
+      record->strs[i] = "/" + record->strs[kResTaskNo] + "/" +
+                        record->strs[kResBin] + "/" + record->strs[i];
+      record->dict_ids[i] = -1;
+    }
+  }
+  for (int i = 0; i < kResultIntCount; i++) {
+    if (m.int_mask & (1u << i)) {
+      uint64_t v = 0;
+      if (!getVarint(&p, end, &v)) {
+        return false;
+      }
+      record->ints[i] =
+          static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+  }
+  return true;
+}
+
+bool ResultCodec::peek(const char* data, size_t len, int field,
+                       std::string* out) {
+  if (field < 0 || field >= kResultStrCount || !isRecord(data, len) ||
+      static_cast<uint8_t>(data[2]) != kVersion) {
+    return false;
+  }
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data) + kHeaderSize;
+  const uint8_t* end = reinterpret_cast<const uint8_t*>(data) + len;
+  Masks m;
+  if (!getHeader(&p, end, &m) || (m.str_mask & (1u << field)) == 0) {
+    return false;
+  }
+  for (int i = 0; i < field; i++) {
+    if ((m.str_mask & (1u << i)) == 0) {
+      continue;
+    }
+    // 跳过前面的字段，字典引用没有后续字节
+    uint64_t v = 0;
+    if (!getVarint(&p, end, &v)) {
+      return false;
+    }
+    if ((v & 1) == 0) {
+      if ((v >> 1) > static_cast<uint64_t>(end - p)) {
+        return false;
+      }
+      p += v >> 1;
+    }
+  }
+  int dict_id = -1;
+  return getString(&p, end, out, &dict_id);
+}
@@ -0,0 +1,104 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-19 21:14:33
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-19 21:14:33
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/ResultRecord.h
+ * @Description: worker 与 gateway 之间的储位结果记录：定长头、varint 字段、共享字典字符串
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+enum ResultKind {
+  kResultFinal = 0,        // 最终结果（results 列表）
+  kResultProvisional = 1,  // 暂定结果（provisional hash）
+  kResultProgress = 2,     // 进度（只有储位和 step）
+};
+
+// 字符串字段，编号即编码顺序；组和键名见 resultStrKey
+enum ResultStrField {
+  kResTaskNo = 0,
+  kResBin = 1,
+  kResStatus = 2,
+  kResSpec = 3,
+  kResError = 4,
+  kResPhoto3d = 5,
+  kResPhotoDepth = 6,
+  kResPhotoScan1 = 7,
+  kResPhotoScan2 = 8,
+  kResDetectStatus = 9,
+  kResDetectError = 10,
+  kResBarcodeStatus = 11,
+  kResBarcodeCode = 12,
+  kResBarcodeProduct = 13,
+  kResBarcodeTobacco = 14,
+  kResBarcodeMessage = 15,
+  kResBarcodeError = 16,
+  kResExtra = 17,  // 不在 schema 里的键，JSON
+  kResultStrCount = 18,
+};
+
+enum ResultIntField {
+  kResQuantity = 0,
+  kResDetectCount = 1,
+  kResDetectPile = 2,
+  kResBarcodePile = 3,
+  kResStep = 4,
+  kResultIntCount = 5,
+};
+
+// ResultRecord::flags
+enum ResultFlag {
+  kRecordHasBin = 1,        // 结果里带 binLocation（与 kResBin 相同）
+  kRecordHasDetect = 2,     // 结果里有 detect_result 键
+  kRecordDetectDict = 4,    // detect_result 是 dict（否则为 None 或见 extra）
+  kRecordHasBarcode = 8,
+  kRecordBarcodeDict = 16,
+  kRecordProvisionalKey = 32,  // 暂定结果里带 provisional: True
+};
+
+// 每个字段三态：不在 mask 里为键不存在，在 null_mask 里为 None，在 mask 里为有值
+struct ResultRecord {
+  int kind;
+  int flags;
+  uint32_t str_mask;
+  uint32_t str_null_mask;
+  uint32_t int_mask;
+  uint32_t int_null_mask;
+  std::string strs[kResultStrCount];
+  int64_t ints[kResultIntCount];
+  int dict_ids[kResultStrCount];  // decode 填：取自共享字典的编号，内联为 -1
+
+  ResultRecord();
+};
+
+// 编码格式（版本 1）：
+//   'L' 'R' 版本 kind flags              定长 5 字节，JSON 不会以 'L' 开头
+//   varint str_mask str_null_mask int_mask int_null_mask rel_mask
+//   有值的字符串字段按编号：varint v，v 为奇数时是字典编号 v>>1，
+//     否则后跟 v>>1 字节 UTF-8；rel_mask 中的照片路径省略 "/<任务>/<储位>/" 前缀
+//   有值的整数字段按编号：zigzag varint
+// 字典只能在末尾追加，改动已有条目须升版本。
+class ResultCodec {
+ public:
+  static void encode(const ResultRecord& record, std::string* out);
+  // 数据不完整、版本不认识时返回 false
+  static bool decode(const char* data, size_t len, ResultRecord* record);
+  // 只解出一个字符串字段（解到该字段即停，不拼照片路径前缀）；
+  // 字段不存在、为 None 或数据无效时返回 false
+  static bool peek(const char* data, size_t len, int field, std::string* out);
+  static bool isRecord(const char* data, size_t len);
+
+  static const std::vector<std::string>& dictionary();
+  // 字段在结果 dict 里的位置：group 为 "" / "detect_result" /
+  // "barcode_result"，key 为 NULL 表示不是结果里的键（任务号、储位、extra、step）
+  static void strKey(int field, const char** group, const char** key);
+  static void intKey(int field, const char** group, const char** key);
+};
@@ -0,0 +1,250 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 10:05:12
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 10:05:12
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/StreamRecorder.cpp
+ * @Description: 原始码流预触发环形录制与回放文件读写
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "StreamRecorder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+namespace {
+
+const char kMagic[8] = {'L', 'D', 'P', 'S', 'R', 'E', 'C', '1'};
+const uint32_t kVersion = 1;
+
+template <typename T>
+void appendPod(std::vector<char>* out, T value) {
+  const char* p = reinterpret_cast<const char*>(&value);
+  out->insert(out->end(), p, p + sizeof(T));
+}
+
+template <typename T>
+bool readPod(FILE* fp, T* value) {
+  return fread(value, sizeof(T), 1, fp) == 1;
+}
+
+}  // namespace
+
+const uint32_t StreamRecorder::kSysHeadType;
+
+StreamRecorder::StreamRecorder()
+    : window_us_(0),
+      capacity_(0),
+      write_pos_(0),
+      used_(0),
+      head_(0),
+      count_(0) {}
+
+int64_t StreamRecorder::nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void StreamRecorder::configure(double window_sec, size_t capacity_bytes,
+                               size_t max_packets) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  window_us_ = static_cast<int64_t>(window_sec * 1e6);
+  // 重新配置为更小的容量时要真正还回内存，assign 不会缩减 capacity
+  std::vector<unsigned char>(capacity_bytes, 0).swap(buf_);
+  std::vector<Entry>(max_packets, Entry()).swap(entries_);
+  capacity_ = capacity_bytes;
+  write_pos_ = 0;
+  used_ = 0;
+  head_ = 0;
+  count_ = 0;
+}
+
+void StreamRecorder::disable() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<unsigned char>().swap(buf_);
+  std::vector<Entry>().swap(entries_);
+  capacity_ = 0;
+  used_ = 0;
+  count_ = 0;
+}
+
+void StreamRecorder::popFront() {
+  const Entry& e = entries_[head_];
+  used_ -= e.size;
+  head_ = (head_ + 1) % entries_.size();
+  count_--;
+}
+
+void StreamRecorder::push(uint32_t data_type, const unsigned char* data,
+                          size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (capacity_ == 0 || size == 0) {
+    return;
+  }
+  int64_t now = nowMicros();
+
+  // 系统头只在开流时出现一次，单独保存，不参与淘汰
+  if (data_type == kSysHeadType) {
+    syshead_.assign(data, data + size);
+    return;
+  }
+  if (size > capacity_) {
+    return;
+  }
+
+  // 按时间窗口、字节容量、索引容量依次淘汰最旧的包
+  while (count_ > 0 && now - entries_[head_].host_us > window_us_) {
+    popFront();
+  }
+  while (count_ > 0 && (used_ + size > capacity_ || count_ == entries_.size())) {
+    popFront();
+  }
+
+  Entry& e = entries_[(head_ + count_) % entries_.size()];
+  e.host_us = now;
+  e.data_type = data_type;
+  e.offset = write_pos_;
+  e.size = size;
+
+  size_t first = capacity_ - write_pos_;
+  if (first >= size) {
+    memcpy(&buf_[write_pos_], data, size);
+  } else {
+    memcpy(&buf_[write_pos_], data, first);
+    memcpy(&buf_[0], data + first, size - first);
+  }
+  write_pos_ = (write_pos_ + size) % capacity_;
+  used_ += size;
+  count_++;
+}
+
+void StreamRecorder::copyOut(size_t offset, size_t size, char* dst) const {
+  size_t first = capacity_ - offset;
+  if (first >= size) {
+    memcpy(dst, &buf_[offset], size);
+  } else {
+    memcpy(dst, &buf_[offset], first);
+    memcpy(dst + first, &buf_[0], size - first);
+  }
+}
+
+bool StreamRecorder::snapshot(std::vector<char>* out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (count_ == 0) {
+    return false;
+  }
+
+  const int64_t start_us = entries_[head_].host_us;
+  const uint32_t total =
+      static_cast<uint32_t>(count_ + (syshead_.empty() ? 0 : 1));
+  out->clear();
+  out->reserve(24 + used_ + syshead_.size() + total * 16);
+  out->insert(out->end(), kMagic, kMagic + sizeof(kMagic));
+  appendPod(out, kVersion);
+  appendPod(out, total);
+  appendPod(out, start_us);
+
+  if (!syshead_.empty()) {
+    appendPod(out, static_cast<uint64_t>(0));
+    appendPod(out, kSysHeadType);
+    appendPod(out, static_cast<uint32_t>(syshead_.size()));
+    out->insert(out->end(), syshead_.begin(), syshead_.end());
+  }
+
+  for (size_t i = 0; i < count_; i++) {
+    const Entry& e = entries_[(head_ + i) % entries_.size()];
+    appendPod(out, static_cast<uint64_t>(e.host_us - start_us));
+    appendPod(out, e.data_type);
+    appendPod(out, static_cast<uint32_t>(e.size));
+    size_t pos = out->size();
+    out->resize(pos + e.size);
+    copyOut(e.offset, e.size, &(*out)[pos]);
+  }
+  return true;
+}
+
+size_t StreamRecorder::packetCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return count_;
+}
+
+size_t StreamRecorder::bytesUsed() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return used_;
+}
+
+size_t StreamRecorder::capacityBytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return capacity_;
+}
+
+double StreamRecorder::windowSec() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return window_us_ / 1e6;
+}
+
+bool StreamRecorder::load(const std::string& path,
+                          std::vector<RecordedPacket>* packets) {
+  struct stat st;
+  FILE* fp = stat(path.c_str(), &st) == 0 ? fopen(path.c_str(), "rb") : NULL;
+  if (!fp) {
+    printf("[StreamRecorder] 无法打开录制文件: %s\n", path.c_str());
+    return false;
+  }
+  // 包数和包长都来自文件内容，按剩余字节数核对，损坏的文件不能撑爆内存
+  const uint64_t kHeaderSize = 24;
+  const uint64_t kPacketHeaderSize = 16;
+  uint64_t remaining = static_cast<uint64_t>(st.st_size);
+
+  char magic[8];
+  uint32_t version = 0;
+  uint32_t total = 0;
+  int64_t start_us = 0;
+  bool ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+            memcmp(magic, kMagic, sizeof(kMagic)) == 0 &&
+            readPod(fp, &version) && version == kVersion &&
+            readPod(fp, &total) && readPod(fp, &start_us) &&
+            remaining >= kHeaderSize &&
+            total <= (remaining - kHeaderSize) / kPacketHeaderSize;
+  if (!ok) {
+    printf("[StreamRecorder] 录制文件格式错误: %s\n", path.c_str());
+    fclose(fp);
+    return false;
+  }
+
+  packets->clear();
+  packets->reserve(total);
+  remaining -= kHeaderSize;
+  for (uint32_t i = 0; i < total; i++) {
+    RecordedPacket pkt;
+    uint32_t size = 0;
+    if (!readPod(fp, &pkt.ts_us) || !readPod(fp, &pkt.data_type) ||
+        !readPod(fp, &size)) {
+      ok = false;
+      break;
+    }
+    if (remaining < kPacketHeaderSize ||
+        size > remaining - kPacketHeaderSize) {
+      ok = false;
+      break;
+    }
+    remaining -= kPacketHeaderSize + size;
+    pkt.data.resize(size);
+    if (size > 0 && fread(&pkt.data[0], 1, size, fp) != size) {
+      ok = false;
+      break;
+    }
+    packets->push_back(pkt);
+  }
+  fclose(fp);
+
+  if (!ok) {
+    printf("[StreamRecorder] 录制文件被截断: %s，已读取 %zu 个包\n",
+           path.c_str(), packets->size());
+  }
+  return !packets->empty();
+}
@@ -0,0 +1,81 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 10:05:12
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 10:05:12
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/StreamRecorder.h
+ * @Description: 原始码流预触发环形录制与回放文件读写
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 录制文件格式（小端）：
+//   文件头: "LDPSREC1"(8B) | version u32 | packet_count u32 | start_us i64
+//   每个包: ts_us u64(相对 start_us) | data_type u32 | size u32 | data
+// 第一个包总是最近一次收到的系统头（NET_DVR_SYSHEAD），保证回放能打开播放库。
+struct RecordedPacket {
+  uint64_t ts_us;  // 相对录制起点的时间戳（微秒）
+  uint32_t data_type;
+  std::vector<unsigned char> data;
+};
+
+// 预分配的字节环 + 索引环，只保留最近 window_sec 秒的码流包。
+// push 在 SDK 码流回调线程调用，不做内存分配。
+class StreamRecorder {
+ public:
+  StreamRecorder();
+
+  // 分配环形缓冲区，capacity_bytes 为码流数据上限，max_packets 为索引上限
+  void configure(double window_sec, size_t capacity_bytes,
+                 size_t max_packets = 16384);
+  void disable();
+  bool enabled() const { return capacity_ > 0; }
+
+  void push(uint32_t data_type, const unsigned char* data, size_t size);
+
+  // 把当前环中的内容序列化为录制文件内容；环中无数据时返回 false
+  bool snapshot(std::vector<char>* out);
+
+  size_t packetCount();
+  size_t bytesUsed();
+  size_t capacityBytes();
+  double windowSec();
+
+  static int64_t nowMicros();
+  static bool load(const std::string& path,
+                   std::vector<RecordedPacket>* packets);
+
+  static const uint32_t kSysHeadType = 1;  // 与 NET_DVR_SYSHEAD 一致
+
+ private:
+  struct Entry {
+    int64_t host_us;
+    uint32_t data_type;
+    size_t offset;
+    size_t size;
+  };
+
+  void popFront();
+  void copyOut(size_t offset, size_t size, char* dst) const;
+
+  std::mutex mutex_;
+  int64_t window_us_;
+
+  std::vector<unsigned char> buf_;
+  size_t capacity_;
+  size_t write_pos_;
+  size_t used_;
+
+  std::vector<Entry> entries_;
+  size_t head_;  // 最旧的索引
+  size_t count_;
+
+  std::vector<unsigned char> syshead_;
+};
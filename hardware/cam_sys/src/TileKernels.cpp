@@ -0,0 +1,244 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 21:10:12
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 21:10:12
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/TileKernels.cpp
+ * @Description: 高分辨率图像分块检测：切块、无纹理块跳过、打包成批与跨块 NMS
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#include "TileKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int kMaxThreads = 8;
+const uint8_t kPadValue = 114;
+
+int threadCount(int jobs, int threads) {
+  if (threads <= 0) {
+    threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (threads <= 0) {
+      threads = 1;
+    }
+    threads = std::min(threads, kMaxThreads);
+  }
+  return std::max(1, std::min(threads, jobs));
+}
+
+// [0, count) 均分给 workers 个线程，fn(begin, end)
+template <typename Fn>
+void parallelFor(int count, int workers, Fn fn) {
+  if (workers <= 1) {
+    fn(0, count);
+    return;
+  }
+  std::vector<std::thread> pool;
+  pool.reserve(workers - 1);
+  for (int w = 1; w < workers; w++) {
+    pool.push_back(std::thread(fn, count * w / workers,
+                               count * (w + 1) / workers));
+  }
+  fn(0, count / workers);
+  for (size_t i = 0; i < pool.size(); i++) {
+    pool[i].join();
+  }
+}
+
+// 一个方向上各块的起点：步长 tile - overlap，最后一块贴齐末端
+std::vector<int> tileStarts(int length, int tile, int overlap) {
+  std::vector<int> starts;
+  if (length <= tile) {
+    starts.push_back(0);
+    return starts;
+  }
+  const int step = std::max(1, tile - overlap);
+  for (int s = 0; s + tile < length; s += step) {
+    starts.push_back(s);
+  }
+  starts.push_back(length - tile);
+  return starts;
+}
+
+inline float area(const TileDetection& d) {
+  return std::max(0.0f, d.x2 - d.x1) * std::max(0.0f, d.y2 - d.y1);
+}
+
+}  // namespace
+
+std::vector<Tile> TileKernels::planTiles(const uint8_t* bgr, int width,
+                                         int height, int stride,
+                                         const TileOptions& options) {
+  std::vector<Tile> tiles;
+  if (bgr == NULL || width <= 0 || height <= 0 || options.tile_size <= 0) {
+    return tiles;
+  }
+  const int cell = std::max(4, options.cell_size);
+  const int step = std::max(1, options.sample_step);
+  const int gw = (width + cell - 1) / cell;
+  const int gh = (height + cell - 1) / cell;
+
+  // 小格灰度标准差（整数近似亮度 (29B + 150G + 77R) >> 8），按小格行并行
+  std::vector<float> cell_std(static_cast<size_t>(gw) * gh);
+  float* out = &cell_std[0];
+  parallelFor(gh, threadCount(gh, options.threads), [=](int r0, int r1) {
+    for (int gy = r0; gy < r1; gy++) {
+      const int y_end = std::min(height, (gy + 1) * cell);
+      for (int gx = 0; gx < gw; gx++) {
+        const int x_end = std::min(width, (gx + 1) * cell);
+        int64_t sum = 0;
+        int64_t sum2 = 0;
+        int n = 0;
+        for (int y = gy * cell; y < y_end; y += step) {
+          const uint8_t* row = bgr + static_cast<size_t>(y) * stride;
+          for (int x = gx * cell; x < x_end; x += step) {
+            const uint8_t* p = row + x * 3;
+            const int luma = (29 * p[0] + 150 * p[1] + 77 * p[2]) >> 8;
+            sum += luma;
+            sum2 += luma * luma;
+            n++;
+          }
+        }
+        const double mean = static_cast<double>(sum) / n;
+        const double var = static_cast<double>(sum2) / n - mean * mean;
+        out[static_cast<size_t>(gy) * gw + gx] =
+            static_cast<float>(sqrt(std::max(0.0, var)));
+      }
+    }
+  });
+
+  const std::vector<int> xs =
+      tileStarts(width, options.tile_size, options.overlap);
+  const std::vector<int> ys =
+      tileStarts(height, options.tile_size, options.overlap);
+  tiles.reserve(xs.size() * ys.size());
+  for (size_t j = 0; j < ys.size(); j++) {
+    for (size_t i = 0; i < xs.size(); i++) {
+      Tile t;
+      t.rect.x = xs[i];
+      t.rect.y = ys[j];
+      t.rect.width = std::min(options.tile_size, width);
+      t.rect.height = std::min(options.tile_size, height);
+      // 完全落在块内的小格；块比小格还窄时退化为相交的小格
+      int gx0 = (t.rect.x + cell - 1) / cell;
+      int gy0 = (t.rect.y + cell - 1) / cell;
+      int gx1 = (t.rect.x + t.rect.width) / cell;
+      int gy1 = (t.rect.y + t.rect.height) / cell;
+      if (gx1 <= gx0) {
+        gx0 = t.rect.x / cell;
+        gx1 = std::min(gw, gx0 + 1);
+      }
+      if (gy1 <= gy0) {
+        gy0 = t.rect.y / cell;
+        gy1 = std::min(gh, gy0 + 1);
+      }
+      float s = 0.0f;
+      for (int gy = gy0; gy < gy1; gy++) {
+        for (int gx = gx0; gx < gx1; gx++) {
+          s = std::max(s, cell_std[static_cast<size_t>(gy) * gw + gx]);
+        }
+      }
+      t.stddev = s;
+      t.skipped = s < options.min_stddev;
+      tiles.push_back(t);
+    }
+  }
+  return tiles;
+}
+
+int TileKernels::packTiles(const uint8_t* bgr, int width, int height,
+                           int stride, const std::vector<Tile>& tiles,
+                           int tile_size, uint8_t* batch, int threads) {
+  std::vector<const Tile*> kept;
+  for (size_t i = 0; i < tiles.size(); i++) {
+    if (!tiles[i].skipped) {
+      kept.push_back(&tiles[i]);
+    }
+  }
+  const int count = static_cast<int>(kept.size());
+  if (count == 0 || bgr == NULL || batch == NULL || tile_size <= 0) {
+    return 0;
+  }
+  const size_t tile_bytes = static_cast<size_t>(tile_size) * tile_size * 3;
+  const Tile* const* list = &kept[0];
+  parallelFor(count, threadCount(count, threads), [=](int t0, int t1) {
+    for (int t = t0; t < t1; t++) {
+      const PixelRect& r = list[t]->rect;
+      const int x0 = std::max(0, r.x);
+      const int y0 = std::max(0, r.y);
+      const int w = std::max(0, std::min(std::min(r.width, tile_size),
+                                         width - x0));
+      const int h = std::max(0, std::min(std::min(r.height, tile_size),
+                                         height - y0));
+      uint8_t* dst = batch + tile_bytes * t;
+      for (int y = 0; y < tile_size; y++) {
+        uint8_t* drow = dst + static_cast<size_t>(y) * tile_size * 3;
+        if (y < h) {
+          memcpy(drow, bgr + static_cast<size_t>(y0 + y) * stride + x0 * 3,
+                 static_cast<size_t>(w) * 3);
+          memset(drow + w * 3, kPadValue,
+                 static_cast<size_t>(tile_size - w) * 3);
+        } else {
+          memset(drow, kPadValue, static_cast<size_t>(tile_size) * 3);
+        }
+      }
+    }
+  });
+  return count;
+}
+
+std::vector<TileDetection> TileKernels::mergeDetections(
+    const std::vector<TileDetection>& detections, float iou_threshold,
+    float containment_threshold, bool class_agnostic) {
+  std::vector<int> order(detections.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = static_cast<int>(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return detections[a].score > detections[b].score;
+  });
+
+  std::vector<TileDetection> kept;
+  for (size_t i = 0; i < order.size(); i++) {
+    const TileDetection& d = detections[order[i]];
+    const float da = area(d);
+    if (da <= 0.0f) {
+      continue;
+    }
+    bool suppressed = false;
+    for (size_t k = 0; k < kept.size() && !suppressed; k++) {
+      TileDetection& m = kept[k];
+      if (!class_agnostic && m.cls != d.cls) {
+        continue;
+      }
+      const float iw = std::min(m.x2, d.x2) - std::max(m.x1, d.x1);
+      const float ih = std::min(m.y2, d.y2) - std::max(m.y1, d.y1);
+      if (iw <= 0.0f || ih <= 0.0f) {
+        continue;
+      }
+      const float inter = iw * ih;
+      const float ma = area(m);
+      if (inter / (ma + da - inter) > iou_threshold) {
+        suppressed = true;
+      } else if (inter / std::min(ma, da) > containment_threshold) {
+        // 一个是块边缘截断的残框：合成外接框，分数取较高者（即已保留的）
+        m.x1 = std::min(m.x1, d.x1);
+        m.y1 = std::min(m.y1, d.y1);
+        m.x2 = std::max(m.x2, d.x2);
+        m.y2 = std::max(m.y2, d.y2);
+        suppressed = true;
+      }
+    }
+    if (!suppressed) {
+      kept.push_back(d);
+    }
+  }
+  return kept;
+}
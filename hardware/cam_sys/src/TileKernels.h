@@ -0,0 +1,68 @@
+/*
+ * @Author: big box big box@qq.com
+ * @Date: 2026-10-18 21:10:12
+ * @LastEditors: big box big box@qq.com
+ * @LastEditTime: 2026-10-18 21:10:12
+ * @FilePath: /LeafDepot/hardware/cam_sys/src/TileKernels.h
+ * @Description: 高分辨率图像分块检测：切块、无纹理块跳过、打包成批与跨块 NMS
+ *
+ * Copyright (c) 2025 by lizh, All Rights Reserved.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "FrameKernels.h"
+
+struct TileOptions {
+  int tile_size;      // 块边长，取检测模型的输入尺寸，块内不再缩放
+  int overlap;        // 相邻块重叠像素，应不小于远处标签的最大尺寸
+  int cell_size;      // 纹理判断的小格边长
+  int sample_step;    // 小格内隔点采样
+  double min_stddev;  // 块内所有小格灰度标准差都低于该值时跳过该块
+  int threads;        // 0 表示硬件线程数
+
+  TileOptions()
+      : tile_size(640), overlap(128), cell_size(32), sample_step(2),
+        min_stddev(12.0), threads(0) {}
+};
+
+struct Tile {
+  PixelRect rect;  // 原图坐标，图像小于 tile_size 的方向上比 tile_size 小
+  float stddev;    // 块内小格灰度标准差的最大值
+  bool skipped;
+};
+
+// 原图坐标下的检测框
+struct TileDetection {
+  float x1;
+  float y1;
+  float x2;
+  float y2;
+  float score;
+  int cls;
+};
+
+// 纯函数，线程安全
+class TileKernels {
+ public:
+  // 按 tile_size、overlap 铺满整幅，最后一行/列贴齐图像边缘（不越界、不补边）；
+  // 按小格灰度标准差标出无纹理块。bgr 为 BGR24，stride 为每行字节数
+  static std::vector<Tile> planTiles(const uint8_t* bgr, int width, int height,
+                                     int stride, const TileOptions& options);
+
+  // 把未跳过的块依次拷到 batch（N x tile_size x tile_size x 3，连续），
+  // 不足 tile_size 的部分填 114（与 YOLO letterbox 同色），返回块数
+  static int packTiles(const uint8_t* bgr, int width, int height, int stride,
+                       const std::vector<Tile>& tiles, int tile_size,
+                       uint8_t* batch, int threads = 0);
+
+  // 跨块合并：按置信度从高到低，与已保留框 IoU 超过 iou_threshold 的丢弃；
+  // 交集占较小框比例超过 containment_threshold 的（块边缘截断的半个标签）
+  // 并入已保留框，保留框扩成两者外接框
+  static std::vector<TileDetection> mergeDetections(
+      const std::vector<TileDetection>& detections, float iou_threshold,
+      float containment_threshold, bool class_agnostic);
+};
@@ -8,26 +8,1323 @@
  *
  * Copyright (c) 2025 by lizh, All Rights Reserved.
  */
+#include <string.h>
+
+#include <map>
+
+#include "ArrivalTrigger.h"
+#include "AsyncFileWriter.h"
 #include "CamController.h"
+#include "CaptureFlow.h"
+#include "CaptureGroup.h"
+#include "CaptureLoop.h"
+#include "CheckpointStore.h"
+#include "CompletionPort.h"
+#include "DecodePipeline.h"
+#include "DepthKernels.h"
+#include "DetectionSet.h"
+#include "DeviceSession.h"
+#include "EventBus.h"
+#include "JobGraph.h"
+#include "MemoryGovernor.h"
+#include "PreviewServer.h"
+#include "ResultRecord.h"
+#include "TileKernels.h"
+#include "pybind11/functional.h"  // 用于支持回调函数
+#include "pybind11/numpy.h"
 #include "pybind11/pybind11.h"
 #include "pybind11/stl.h"  // 用于支持 STL 容器
 
 namespace py = pybind11;
 
+namespace {
+
+// 完成端口里的结果：完成线程只构造、析构 C++ 值，
+// 转成 Python 对象放到 drain 里（事件循环线程，已持有 GIL）一批做完
+struct PortValue {
+  virtual ~PortValue() {}
+  virtual py::object toPython() const = 0;
+};
+
+template <typename T>
+struct PortValueOf : PortValue {
+  explicit PortValueOf(const T& v) : value(v) {}
+  py::object toPython() const { return py::cast(value); }
+  T value;
+};
+
+template <typename T>
+std::shared_ptr<void> portValue(const T& value) {
+  return std::shared_ptr<PortValue>(new PortValueOf<T>(value));
+}
+
+// 结果记录 schema：(组, 键) → 字段编号，整数字段编号加 kResultStrCount
+const std::map<std::pair<std::string, std::string>, int>& resultKeys() {
+  static const std::map<std::pair<std::string, std::string>, int> keys = [] {
+    std::map<std::pair<std::string, std::string>, int> m;
+    const char* group = NULL;
+    const char* key = NULL;
+    for (int i = 0; i < kResultStrCount; i++) {
+      ResultCodec::strKey(i, &group, &key);
+      if (key != NULL) {
+        m[std::make_pair(std::string(group), std::string(key))] = i;
+      }
+    }
+    for (int i = 0; i < kResultIntCount; i++) {
+      ResultCodec::intKey(i, &group, &key);
+      if (key != NULL) {
+        m[std::make_pair(std::string(group), std::string(key))] =
+            kResultStrCount + i;
+      }
+    }
+    return m;
+  }();
+  return keys;
+}
+
+// 字典字符串转成的 Python 对象只建一次，解码时直接复用（进程退出时不析构）
+py::object resultDictString(int id) {
+  static std::vector<py::object>* cache = new std::vector<py::object>();
+  if (cache->empty()) {
+    const std::vector<std::string>& dict = ResultCodec::dictionary();
+    for (size_t i = 0; i < dict.size(); i++) {
+      cache->push_back(py::str(dict[i]));
+    }
+  }
+  return (*cache)[id];
+}
+
+// 把一组键拆进记录；schema 外的键、类型不符的值放进 extra[group]
+void putResultGroup(const py::dict& src, const std::string& group,
+                    ResultRecord* rec, py::dict* extra) {
+  const std::map<std::pair<std::string, std::string>, int>& keys =
+      resultKeys();
+  py::dict rest;
+  for (auto item : src) {
+    if (!py::isinstance<py::str>(item.first)) {
+      rest[item.first] = item.second;
+      continue;
+    }
+    const std::string key = item.first.cast<std::string>();
+    const py::handle v = item.second;
+    std::map<std::pair<std::string, std::string>, int>::const_iterator it =
+        keys.find(std::make_pair(group, key));
+    if (it != keys.end() && it->second < kResultStrCount) {
+      const int f = it->second;
+      if (v.is_none()) {
+        rec->str_null_mask |= 1u << f;
+        continue;
+      }
+      if (py::isinstance<py::str>(v)) {
+        rec->str_mask |= 1u << f;
+        rec->strs[f] = v.cast<std::string>();
+        continue;
+      }
+    } else if (it != keys.end()) {
+      const int f = it->second - kResultStrCount;
+      if (v.is_none()) {
+        rec->int_null_mask |= 1u << f;
+        continue;
+      }
+      if (PyLong_CheckExact(v.ptr())) {
+        int overflow = 0;
+        const long long n = PyLong_AsLongLongAndOverflow(v.ptr(), &overflow);
+        if (overflow == 0) {
+          rec->int_mask |= 1u << f;
+          rec->ints[f] = n;
+          continue;
+        }
+      }
+    } else if (group.empty()) {
+      if (key == "binLocation" && py::isinstance<py::str>(v) &&
+          v.cast<std::string>() == rec->strs[kResBin]) {
+        rec->flags |= kRecordHasBin;
+        continue;
+      }
+      if (key == "provisional" && v.ptr() == Py_True &&
+          rec->kind == kResultProvisional) {
+        rec->flags |= kRecordProvisionalKey;
+        continue;
+      }
+      const bool detect = key == "detect_result";
+      if (detect || key == "barcode_result") {
+        if (v.is_none() || py::isinstance<py::dict>(v)) {
+          rec->flags |= detect ? kRecordHasDetect : kRecordHasBarcode;
+          if (!v.is_none()) {
+            rec->flags |= detect ? kRecordDetectDict : kRecordBarcodeDict;
+            putResultGroup(py::reinterpret_borrow<py::dict>(v), key, rec,
+                           extra);
+          }
+          continue;
+        }
+      }
+    }
+    rest[item.first] = item.second;
+  }
+  if (py::len(rest) > 0) {
+    (*extra)[py::str(group)] = rest;
+  }
+}
+
+void getResultGroup(const ResultRecord& rec, const std::string& group,
+                    const py::dict& extra, py::dict* out) {
+  const char* g = NULL;
+  const char* key = NULL;
+  for (int i = 0; i < kResultStrCount; i++) {
+    ResultCodec::strKey(i, &g, &key);
+    if (key == NULL || group != g) {
+      continue;
+    }
+    if (rec.str_mask & (1u << i)) {
+      (*out)[key] = rec.dict_ids[i] >= 0 ? resultDictString(rec.dict_ids[i])
+                                         : py::str(rec.strs[i]);
+    } else if (rec.str_null_mask & (1u << i)) {
+      (*out)[key] = py::none();
+    }
+  }
+  for (int i = 0; i < kResultIntCount; i++) {
+    ResultCodec::intKey(i, &g, &key);
+    if (key == NULL || group != g) {
+      continue;
+    }
+    if (rec.int_mask & (1u << i)) {
+      (*out)[key] = py::int_(static_cast<long long>(rec.ints[i]));
+    } else if (rec.int_null_mask & (1u << i)) {
+      (*out)[key] = py::none();
+    }
+  }
+  if (extra.contains(group)) {
+    for (auto item : py::reinterpret_borrow<py::dict>(extra[py::str(group)])) {
+      (*out)[item.first] = item.second;
+    }
+  }
+}
+
+// 解码成 (kind, task_no, bin_location, result, step)；数据无效时为 None
+py::object resultToPython(const ResultRecord& rec) {
+  py::dict extra;
+  if (rec.str_mask & (1u << kResExtra)) {
+    extra = py::module::import("json").attr("loads")(py::str(
+        rec.strs[kResExtra]));
+  }
+  py::object result = py::none();
+  if (rec.kind != kResultProgress) {
+    py::dict d;
+    if (rec.flags & kRecordHasBin) {
+      d["binLocation"] = py::str(rec.strs[kResBin]);
+    }
+    getResultGroup(rec, "", extra, &d);
+    const char* groups[] = {"detect_result", "barcode_result"};
+    const int has[] = {kRecordHasDetect, kRecordHasBarcode};
+    const int is_dict[] = {kRecordDetectDict, kRecordBarcodeDict};
+    for (int i = 0; i < 2; i++) {
+      if ((rec.flags & has[i]) == 0) {
+        continue;
+      }
+      if (rec.flags & is_dict[i]) {
+        py::dict sub;
+        getResultGroup(rec, groups[i], extra, &sub);
+        d[groups[i]] = sub;
+      } else {
+        d[groups[i]] = py::none();
+      }
+    }
+    if (rec.flags & kRecordProvisionalKey) {
+      d["provisional"] = true;
+    }
+    result = d;
+  }
+  py::object task_no = py::none();
+  if (rec.str_mask & (1u << kResTaskNo)) {
+    task_no = py::str(rec.strs[kResTaskNo]);
+  }
+  py::object step = py::none();
+  if (rec.int_mask & (1u << kResStep)) {
+    step = py::int_(static_cast<long long>(rec.ints[kResStep]));
+  }
+  return py::make_tuple(rec.kind, task_no, py::str(rec.strs[kResBin]), result,
+                        step);
+}
+
+py::object decodeResultBytes(py::handle data) {
+  char* buf = NULL;
+  Py_ssize_t len = 0;
+  if (!PyBytes_Check(data.ptr()) ||
+      PyBytes_AsStringAndSize(data.ptr(), &buf, &len) != 0) {
+    PyErr_Clear();
+    return py::none();
+  }
+  ResultRecord rec;
+  if (!ResultCodec::decode(buf, static_cast<size_t>(len), &rec)) {
+    return py::none();
+  }
+  return resultToPython(rec);
+}
+
+}  // namespace
+
 PYBIND11_MODULE(camera_api, m) {
+  py::class_<CancelToken>(m, "CancelToken")
+      .def(py::init<>())
+      .def_static("withTimeout", &CancelToken::withTimeout,
+                  py::arg("timeout_ms"))
+      .def("child", &CancelToken::child, py::arg("timeout_ms") = -1)
+      .def("cancel", &CancelToken::cancel)
+      .def("cancelled", &CancelToken::cancelled)
+      .def("remainingMs", &CancelToken::remainingMs)
+      .def("sleepFor", &CancelToken::sleepFor, py::arg("ms"),
+           py::call_guard<py::gil_scoped_release>());
+
+  // setCaptureRois 的默认参数要求 RoiCaptureOptions 先注册
+  py::class_<PixelRect>(m, "PixelRect")
+      .def(py::init([](int x, int y, int width, int height) {
+             PixelRect r;
+             r.x = x;
+             r.y = y;
+             r.width = width;
+             r.height = height;
+             return r;
+           }),
+           py::arg("x"), py::arg("y"), py::arg("width"), py::arg("height"))
+      .def_readwrite("x", &PixelRect::x)
+      .def_readwrite("y", &PixelRect::y)
+      .def_readwrite("width", &PixelRect::width)
+      .def_readwrite("height", &PixelRect::height);
+
+  py::enum_<RoiMode>(m, "RoiMode")
+      .value("SMOOTH", kRoiSmooth)
+      .value("CROP", kRoiCrop)
+      .export_values();
+
+  py::class_<RoiCaptureOptions>(m, "RoiCaptureOptions")
+      .def(py::init<>())
+      .def_readwrite("mode", &RoiCaptureOptions::mode)
+      .def_readwrite("margin", &RoiCaptureOptions::margin)
+      .def_readwrite("block", &RoiCaptureOptions::block)
+      .def_readwrite("context_width", &RoiCaptureOptions::context_width)
+      .def_readwrite("context_quality", &RoiCaptureOptions::context_quality)
+      .def_readwrite("quality", &RoiCaptureOptions::quality);
+
   py::class_<CamController>(m, "CamController")
       .def(py::init<>())
       .def("login", &CamController::login, py::arg("deviceAddress"),
            py::arg("port"), py::arg("userName"), py::arg("password"))
-      .def("logout", &CamController::logout)
+      .def("logout", &CamController::logout, py::arg("flush_writes") = true)
       .def("startRealPlay", &CamController::startRealPlay, py::arg("channel"),
            py::arg("streamType"), py::arg("linkMode"), py::arg("blocked"))
       .def("stopRealPlay", &CamController::stopRealPlay)
       .def("getCapture", &CamController::getCapture)
+      .def("setCaptureWaitMs", &CamController::setCaptureWaitMs, py::arg("ms"))
       .def("setTaskInfo", &CamController::setTaskInfo, py::arg("task_id"),
            py::arg("bin_code"))
       .def("setCameraType", &CamController::setCameraType,
-           py::arg("camera_type"));
+           py::arg("camera_type"))
+      .def("setCancelToken", &CamController::setCancelToken, py::arg("token"))
+      .def("enableRecording", &CamController::enableRecording,
+           py::arg("seconds"), py::arg("capacity_mb") = 64)
+      .def("disableRecording", &CamController::disableRecording)
+      .def("triggerRecording", &CamController::triggerRecording,
+           py::arg("reason") = "manual")
+      .def("startReplay", &CamController::startReplay, py::arg("path"),
+           py::arg("realtime") = true)
+      .def("stopReplay", &CamController::stopReplay,
+           py::call_guard<py::gil_scoped_release>())
+      .def("enableFrameHistory", &CamController::enableFrameHistory,
+           py::arg("depth") = 8)
+      .def("frameHistory", &CamController::frameHistory)
+      .def("stats", &CamController::stats)
+      .def("setCaptureRois", &CamController::setCaptureRois, py::arg("rois"),
+           py::arg("options") = RoiCaptureOptions())
+      .def("clearCaptureRois", &CamController::clearCaptureRois)
+      .def("enableCaptureHash", &CamController::enableCaptureHash,
+           py::arg("enable") = true)
+      .def("lastCaptureHash", &CamController::lastCaptureHash)
+      .def("subscribe", &CamController::subscribe, py::arg("options"))
+      .def("subscribers", &CamController::subscribers)
+      .def("clockOffset",
+           [](CamController& self) -> py::object {
+             double offset_ms = 0.0;
+             double jitter_ms = 0.0;
+             if (!self.clockOffset(&offset_ms, &jitter_ms)) {
+               return py::none();
+             }
+             return py::make_tuple(offset_ms, jitter_ms);
+           });
+
+  py::class_<StreamStats>(m, "StreamStats")
+      .def_readonly("channel", &StreamStats::channel)
+      .def_readonly("stream_type", &StreamStats::stream_type)
+      .def_readonly("streaming", &StreamStats::streaming)
+      .def_readonly("packets", &StreamStats::packets)
+      .def_readonly("bytes", &StreamStats::bytes)
+      .def_readonly("frames", &StreamStats::frames)
+      .def_readonly("sysheads", &StreamStats::sysheads)
+      .def_readonly("captures", &StreamStats::captures)
+      .def_readonly("capture_failures", &StreamStats::capture_failures)
+      .def_readonly("last_frame_us", &StreamStats::last_frame_us);
+
+  py::class_<ChannelInfo>(m, "ChannelInfo")
+      .def_readonly("channel", &ChannelInfo::channel)
+      .def_readonly("digital", &ChannelInfo::digital);
+
+  py::class_<DeviceSession>(m, "DeviceSession")
+      .def(py::init<>())
+      .def("login", &DeviceSession::login, py::arg("deviceAddress"),
+           py::arg("port"), py::arg("userName"), py::arg("password"))
+      .def("logout", &DeviceSession::logout,
+           py::call_guard<py::gil_scoped_release>())
+      .def("loggedIn", &DeviceSession::loggedIn)
+      .def("serialNumber", &DeviceSession::serialNumber)
+      .def("channels", &DeviceSession::channels)
+      // 通道对象归会话所有，reference_internal 保证会话不会先于通道对象被回收
+      .def("channel", &DeviceSession::channel, py::arg("channel"),
+           py::return_value_policy::reference_internal)
+      .def("startStreams", &DeviceSession::startStreams, py::arg("channels"),
+           py::arg("streamType"), py::arg("linkMode"), py::arg("blocked"),
+           py::call_guard<py::gil_scoped_release>())
+      .def("stopStreams", &DeviceSession::stopStreams,
+           py::call_guard<py::gil_scoped_release>())
+      .def("stats", &DeviceSession::stats)
+      .def("setCancelToken", &DeviceSession::setCancelToken, py::arg("token"));
+
+  // 只暴露时间信息，像素留在 C++ 侧
+  py::class_<TimedFrame>(m, "TimedFrame")
+      .def_readonly("host_us", &TimedFrame::host_us)
+      .def_readonly("arrival_us", &TimedFrame::arrival_us)
+      .def_readonly("stamp_ms", &TimedFrame::stamp_ms)
+      .def_readonly("frame_num", &TimedFrame::frame_num)
+      .def_readonly("width", &TimedFrame::width)
+      .def_readonly("height", &TimedFrame::height);
+
+  py::enum_<FrameFormat>(m, "FrameFormat")
+      .value("GRAY", kFrameGray)
+      .value("BGR", kFrameBgr)
+      .value("JPEG", kFrameJpeg)
+      .export_values();
+
+  py::class_<SubscriberOptions>(m, "SubscriberOptions")
+      .def(py::init<>())
+      .def_readwrite("format", &SubscriberOptions::format)
+      .def_readwrite("max_fps", &SubscriberOptions::max_fps)
+      .def_readwrite("max_width", &SubscriberOptions::max_width)
+      .def_readwrite("jpeg_quality", &SubscriberOptions::jpeg_quality)
+      .def_readwrite("queue_depth", &SubscriberOptions::queue_depth);
+
+  // 支持 buffer 协议：np.frombuffer(frame, np.uint8) 不拷贝，
+  // GRAY 再 reshape(height, width)，BGR reshape(height, width, 3)
+  py::class_<PublishedFrame>(m, "PublishedFrame", py::buffer_protocol())
+      .def_readonly("meta", &PublishedFrame::meta)
+      .def_readonly("format", &PublishedFrame::format)
+      .def_readonly("width", &PublishedFrame::width)
+      .def_readonly("height", &PublishedFrame::height)
+      .def("bytes",
+           [](const PublishedFrame& self) {
+             if (!self.data) {
+               return py::bytes();
+             }
+             return py::bytes(reinterpret_cast<const char*>(self.data->data()),
+                              self.data->size());
+           })
+      .def_buffer([](PublishedFrame& self) -> py::buffer_info {
+        static unsigned char empty = 0;
+        const unsigned char* ptr = self.data ? self.data->data() : &empty;
+        py::ssize_t size =
+            self.data ? static_cast<py::ssize_t>(self.data->size()) : 0;
+        return py::buffer_info(const_cast<unsigned char*>(ptr), size, true);
+      });
+
+  py::class_<FrameSubscription, std::shared_ptr<FrameSubscription> >(
+      m, "FrameSubscription")
+      .def("next",
+           [](FrameSubscription& self, int timeout_ms) -> py::object {
+             PublishedFrame frame;
+             bool ok = false;
+             {
+               py::gil_scoped_release release;
+               ok = self.next(&frame, timeout_ms);
+             }
+             if (!ok) {
+               return py::none();
+             }
+             return py::cast(frame);
+           },
+           py::arg("timeout_ms") = 1000)
+      .def("close", &FrameSubscription::close)
+      .def("closed", &FrameSubscription::closed)
+      .def("delivered", &FrameSubscription::delivered)
+      .def("dropped", &FrameSubscription::dropped);
+
+  py::class_<SyncedFrame>(m, "SyncedFrame")
+      .def_readonly("camera_type", &SyncedFrame::camera_type)
+      .def_readonly("stream_type", &SyncedFrame::stream_type)
+      .def_readonly("host_us", &SyncedFrame::host_us)
+      .def_readonly("stamp_ms", &SyncedFrame::stamp_ms)
+      .def_readonly("frame_num", &SyncedFrame::frame_num)
+      .def_readonly("width", &SyncedFrame::width)
+      .def_readonly("height", &SyncedFrame::height)
+      .def_readonly("skew_ms", &SyncedFrame::skew_ms)
+      .def_readonly("path", &SyncedFrame::path);
+
+  py::class_<CaptureGroup>(m, "CaptureGroup")
+      .def(py::init<>())
+      // 组内保存相机指针，keep_alive 保证相机对象不会先于组被回收
+      .def("add", &CaptureGroup::add, py::arg("cam"),
+           py::arg("history_depth") = 8, py::keep_alive<1, 2>())
+      .def("clear", &CaptureGroup::clear)
+      .def("size", &CaptureGroup::size)
+      .def("setCancelToken", &CaptureGroup::setCancelToken, py::arg("token"))
+      .def("setTaskInfo", &CaptureGroup::setTaskInfo, py::arg("task_id"),
+           py::arg("bin_code"))
+      .def("capture", &CaptureGroup::capture, py::arg("tolerance_ms"),
+           py::arg("timeout_ms"), py::arg("max_age_ms") = 0,
+           py::call_guard<py::gil_scoped_release>())
+      .def("lastSpreadMs", &CaptureGroup::lastSpreadMs);
+
+  py::class_<PreviewOptions>(m, "PreviewOptions")
+      .def(py::init<>())
+      .def_readwrite("max_fps", &PreviewOptions::max_fps)
+      .def_readwrite("max_width", &PreviewOptions::max_width)
+      .def_readwrite("jpeg_quality", &PreviewOptions::jpeg_quality)
+      .def_readwrite("max_viewers", &PreviewOptions::max_viewers);
+
+  py::class_<PreviewServer>(m, "PreviewServer")
+      .def(py::init<>())
+      .def("setOptions", &PreviewServer::setOptions, py::arg("options"))
+      // 服务器保存相机指针，keep_alive 保证相机对象不会先于服务器被回收
+      .def("addSource", &PreviewServer::addSource, py::arg("name"),
+           py::arg("cam"), py::keep_alive<1, 3>())
+      .def("removeSource", &PreviewServer::removeSource, py::arg("name"))
+      .def("start", &PreviewServer::start, py::arg("port"),
+           py::arg("bind_address") = "127.0.0.1")
+      .def("stop", &PreviewServer::stop,
+           py::call_guard<py::gil_scoped_release>())
+      .def("running", &PreviewServer::running)
+      .def("port", &PreviewServer::port)
+      .def("viewers", &PreviewServer::viewers);
+
+  py::class_<DepthFillOptions>(m, "DepthFillOptions")
+      .def(py::init<>())
+      .def_readwrite("min_disparity", &DepthFillOptions::min_disparity)
+      .def_readwrite("invalid_grow", &DepthFillOptions::invalid_grow)
+      .def_readwrite("median", &DepthFillOptions::median)
+      .def_readwrite("fill_radius", &DepthFillOptions::fill_radius)
+      .def_readwrite("sigma_space", &DepthFillOptions::sigma_space)
+      .def_readwrite("sigma_color", &DepthFillOptions::sigma_color)
+      .def_readwrite("min_weight", &DepthFillOptions::min_weight)
+      .def_readwrite("threads", &DepthFillOptions::threads);
+
+  py::class_<DepthFillStats>(m, "DepthFillStats")
+      .def_readonly("valid_before", &DepthFillStats::valid_before)
+      .def_readonly("masked", &DepthFillStats::masked)
+      .def_readonly("filled", &DepthFillStats::filled)
+      .def_readonly("valid_after", &DepthFillStats::valid_after);
+
+  // SGBM 原始视差（int16，x16）后处理，返回 (新视差数组, 统计)；guide 为同尺寸左目灰度图
+  m.def(
+      "postprocessDisparity",
+      [](py::array_t<int16_t, py::array::c_style | py::array::forcecast> disp,
+         py::array_t<uint8_t, py::array::c_style | py::array::forcecast> guide,
+         const DepthFillOptions& options) {
+        if (disp.ndim() != 2 || guide.ndim() != 2 ||
+            disp.shape(0) != guide.shape(0) ||
+            disp.shape(1) != guide.shape(1)) {
+          throw py::value_error("disp 与 guide 须为同尺寸二维数组");
+        }
+        const int height = static_cast<int>(disp.shape(0));
+        const int width = static_cast<int>(disp.shape(1));
+        py::array_t<int16_t> out({height, width});
+        int16_t* dst = out.mutable_data();
+        memcpy(dst, disp.data(), sizeof(int16_t) * width * height);
+        const uint8_t* g = guide.data();
+        DepthFillStats stats;
+        {
+          py::gil_scoped_release release;
+          stats = DepthKernels::postprocess(dst, g, width, height, options);
+        }
+        return py::make_tuple(out, stats);
+      },
+      py::arg("disp"), py::arg("guide"),
+      py::arg("options") = DepthFillOptions());
+
+  py::class_<CameraIntrinsics>(m, "CameraIntrinsics")
+      .def(py::init<>())
+      .def(py::init([](double fx, double fy, double cx, double cy) {
+             CameraIntrinsics k;
+             k.fx = fx;
+             k.fy = fy;
+             k.cx = cx;
+             k.cy = cy;
+             return k;
+           }),
+           py::arg("fx"), py::arg("fy"), py::arg("cx"), py::arg("cy"))
+      .def_readwrite("fx", &CameraIntrinsics::fx)
+      .def_readwrite("fy", &CameraIntrinsics::fy)
+      .def_readwrite("cx", &CameraIntrinsics::cx)
+      .def_readwrite("cy", &CameraIntrinsics::cy);
+
+  py::class_<LayerSegOptions>(m, "LayerSegOptions")
+      .def(py::init<>())
+      .def_readwrite("stride", &LayerSegOptions::stride)
+      .def_readwrite("min_depth_mm", &LayerSegOptions::min_depth_mm)
+      .def_readwrite("max_depth_mm", &LayerSegOptions::max_depth_mm)
+      .def_readwrite("bin_mm", &LayerSegOptions::bin_mm)
+      .def_readwrite("surface_tolerance_mm",
+                     &LayerSegOptions::surface_tolerance_mm)
+      .def_readwrite("min_separation_mm", &LayerSegOptions::min_separation_mm)
+      .def_readwrite("min_fraction", &LayerSegOptions::min_fraction)
+      .def_readwrite("max_tilt_deg", &LayerSegOptions::max_tilt_deg)
+      .def_readwrite("ransac_iterations", &LayerSegOptions::ransac_iterations)
+      .def_readwrite("ransac_samples", &LayerSegOptions::ransac_samples)
+      .def_readwrite("threads", &LayerSegOptions::threads);
+
+  py::class_<LayerSurface>(m, "LayerSurface")
+      .def_readonly("height_mm", &LayerSurface::height_mm)
+      .def_readonly("points", &LayerSurface::points)
+      .def_readonly("fraction", &LayerSurface::fraction)
+      .def_readonly("extent", &LayerSurface::extent)
+      .def_readonly("depth_min_mm", &LayerSurface::depth_min_mm)
+      .def_readonly("depth_max_mm", &LayerSurface::depth_max_mm);
+
+  py::class_<LayerSegResult>(m, "LayerSegResult")
+      .def_readonly("success", &LayerSegResult::success)
+      .def_property_readonly("up",
+                             [](const LayerSegResult& self) {
+                               return py::make_tuple(self.up[0], self.up[1],
+                                                     self.up[2]);
+                             })
+      .def_readonly("up_from_ransac", &LayerSegResult::up_from_ransac)
+      .def_readonly("valid_points", &LayerSegResult::valid_points)
+      .def_readonly("min_height_mm", &LayerSegResult::min_height_mm)
+      .def_readonly("max_height_mm", &LayerSegResult::max_height_mm)
+      .def_readonly("surfaces", &LayerSegResult::surfaces);
+
+  // 深度图（毫米，float32 二维数组）在 roi 内分割各层顶面
+  m.def(
+      "segmentLayers",
+      [](py::array_t<float, py::array::c_style | py::array::forcecast> depth,
+         const CameraIntrinsics& intrinsics, const PixelRect& roi,
+         const LayerSegOptions& options) {
+        if (depth.ndim() != 2) {
+          throw py::value_error("depth 须为二维数组");
+        }
+        const float* data = depth.data();
+        const int height = static_cast<int>(depth.shape(0));
+        const int width = static_cast<int>(depth.shape(1));
+        py::gil_scoped_release release;
+        return DepthKernels::segmentLayers(data, width, height, intrinsics,
+                                           roi, options);
+      },
+      py::arg("depth"), py::arg("intrinsics"), py::arg("roi"),
+      py::arg("options") = LayerSegOptions());
+
+  py::class_<TileOptions>(m, "TileOptions")
+      .def(py::init<>())
+      .def_readwrite("tile_size", &TileOptions::tile_size)
+      .def_readwrite("overlap", &TileOptions::overlap)
+      .def_readwrite("cell_size", &TileOptions::cell_size)
+      .def_readwrite("sample_step", &TileOptions::sample_step)
+      .def_readwrite("min_stddev", &TileOptions::min_stddev)
+      .def_readwrite("threads", &TileOptions::threads);
+
+  py::class_<Tile>(m, "Tile")
+      .def_readonly("rect", &Tile::rect)
+      .def_readonly("stddev", &Tile::stddev)
+      .def_readonly("skipped", &Tile::skipped);
+
+  // BGR 图（uint8，HxWx3）切块并标出无纹理块
+  m.def(
+      "planTiles",
+      [](py::array_t<uint8_t, py::array::c_style | py::array::forcecast> bgr,
+         const TileOptions& options) {
+        if (bgr.ndim() != 3 || bgr.shape(2) != 3) {
+          throw py::value_error("bgr 须为 HxWx3 数组");
+        }
+        const uint8_t* data = bgr.data();
+        const int height = static_cast<int>(bgr.shape(0));
+        const int width = static_cast<int>(bgr.shape(1));
+        py::gil_scoped_release release;
+        return TileKernels::planTiles(data, width, height, width * 3, options);
+      },
+      py::arg("bgr"), py::arg("options") = TileOptions());
+
+  // 未跳过的块打包为 (N, tile_size, tile_size, 3) 数组，顺序与 tiles 中未跳过的块一致
+  m.def(
+      "packTiles",
+      [](py::array_t<uint8_t, py::array::c_style | py::array::forcecast> bgr,
+         const std::vector<Tile>& tiles, int tile_size, int threads) {
+        if (bgr.ndim() != 3 || bgr.shape(2) != 3) {
+          throw py::value_error("bgr 须为 HxWx3 数组");
+        }
+        if (tile_size <= 0) {
+          throw py::value_error("tile_size 须为正数");
+        }
+        int count = 0;
+        for (size_t i = 0; i < tiles.size(); i++) {
+          count += tiles[i].skipped ? 0 : 1;
+        }
+        const int height = static_cast<int>(bgr.shape(0));
+        const int width = static_cast<int>(bgr.shape(1));
+        py::array_t<uint8_t> batch({count, tile_size, tile_size, 3});
+        const uint8_t* src = bgr.data();
+        uint8_t* dst = batch.mutable_data();
+        {
+          py::gil_scoped_release release;
+          TileKernels::packTiles(src, width, height, width * 3, tiles,
+                                 tile_size, dst, threads);
+        }
+        return batch;
+      },
+      py::arg("bgr"), py::arg("tiles"), py::arg("tile_size"),
+      py::arg("threads") = 0);
+
+  // 跨块 NMS：detections 为 (N, 6) 的 [x1, y1, x2, y2, score, cls]（原图坐标），返回同格式
+  m.def(
+      "mergeDetections",
+      [](py::array_t<float, py::array::c_style | py::array::forcecast> dets,
+         float iou_threshold, float containment_threshold,
+         bool class_agnostic) {
+        if (dets.size() != 0 && (dets.ndim() != 2 || dets.shape(1) != 6)) {
+          throw py::value_error("detections 须为 (N, 6) 数组");
+        }
+        const int n = dets.size() == 0 ? 0 : static_cast<int>(dets.shape(0));
+        const float* d = dets.data();
+        std::vector<TileDetection> in(n);
+        for (int i = 0; i < n; i++) {
+          const float* row = d + i * 6;
+          in[i].x1 = row[0];
+          in[i].y1 = row[1];
+          in[i].x2 = row[2];
+          in[i].y2 = row[3];
+          in[i].score = row[4];
+          in[i].cls = static_cast<int>(row[5]);
+        }
+        std::vector<TileDetection> kept;
+        {
+          py::gil_scoped_release release;
+          kept = TileKernels::mergeDetections(in, iou_threshold,
+                                              containment_threshold,
+                                              class_agnostic);
+        }
+        py::array_t<float> out({static_cast<int>(kept.size()), 6});
+        float* o = out.mutable_data();
+        for (size_t i = 0; i < kept.size(); i++) {
+          o[i * 6 + 0] = kept[i].x1;
+          o[i * 6 + 1] = kept[i].y1;
+          o[i * 6 + 2] = kept[i].x2;
+          o[i * 6 + 3] = kept[i].y2;
+          o[i * 6 + 4] = kept[i].score;
+          o[i * 6 + 5] = static_cast<float>(kept[i].cls);
+        }
+        return out;
+      },
+      py::arg("detections"), py::arg("iou_threshold") = 0.5f,
+      py::arg("containment_threshold") = 0.8f,
+      py::arg("class_agnostic") = false);
+
+  py::enum_<DetColumn>(m, "DetColumn")
+      .value("X1", kDetX1)
+      .value("Y1", kDetY1)
+      .value("X2", kDetX2)
+      .value("Y2", kDetY2)
+      .value("SCORE", kDetScore)
+      .value("CLASS", kDetClass)
+      .value("CX", kDetCx)
+      .value("CY", kDetCy)
+      .value("WIDTH", kDetWidth)
+      .value("HEIGHT", kDetHeight)
+      .value("AREA", kDetArea);
+
+  // 检测结果容器：np.asarray(ds) 得到 (DetColumn 数, len(ds)) 的 float32 视图（不拷贝），
+  // 行号即 DetColumn。add/addRows 可能重新分配，之前取到的视图随之失效
+  py::class_<DetectionSet>(m, "DetectionSet", py::buffer_protocol())
+      .def(py::init<>())
+      .def_buffer([](DetectionSet& self) -> py::buffer_info {
+        self.reserve(1);  // 空容器也给出有效地址
+        return py::buffer_info(
+            const_cast<float*>(self.column(kDetX1)), sizeof(float),
+            py::format_descriptor<float>::format(), 2,
+            {static_cast<ssize_t>(kDetColumns),
+             static_cast<ssize_t>(self.size())},
+            {static_cast<ssize_t>(sizeof(float) * self.capacity()),
+             static_cast<ssize_t>(sizeof(float))});
+      })
+      .def("__len__", &DetectionSet::size)
+      .def("reserve", &DetectionSet::reserve, py::arg("capacity"))
+      .def("add", &DetectionSet::add, py::arg("x1"), py::arg("y1"),
+           py::arg("x2"), py::arg("y2"), py::arg("score"), py::arg("cls"))
+      // rows 为 (N, 6) 的 [x1, y1, x2, y2, score, cls]
+      .def(
+          "addRows",
+          [](DetectionSet& self,
+             py::array_t<float, py::array::c_style | py::array::forcecast>
+                 rows) {
+            if (rows.size() == 0) {
+              return;
+            }
+            if (rows.ndim() != 2 || rows.shape(1) != 6) {
+              throw py::value_error("rows 须为 (N, 6) 数组");
+            }
+            self.addRows(rows.data(), static_cast<int>(rows.shape(0)));
+          },
+          py::arg("rows"))
+      .def("clear", &DetectionSet::clear)
+      .def("selectClasses", &DetectionSet::selectClasses, py::arg("classes"),
+           py::arg("min_score") = 0.0f)
+      .def("nms", &DetectionSet::nms, py::arg("iou_threshold") = 0.7f,
+           py::arg("class_agnostic") = false,
+           py::call_guard<py::gil_scoped_release>())
+      .def("centersInside", &DetectionSet::centersInside, py::arg("x1"),
+           py::arg("y1"), py::arg("x2"), py::arg("y2"))
+      .def("intersecting", &DetectionSet::intersecting, py::arg("x1"),
+           py::arg("y1"), py::arg("x2"), py::arg("y2"),
+           py::arg("min_cover") = 0.0f)
+      .def("buildIndex", &DetectionSet::buildIndex, py::arg("cell_size"))
+      .def("indexed", &DetectionSet::indexed)
+      .def("subset", &DetectionSet::subset, py::arg("indices"));
+
+  // 机器人状态事件总线：fd 交给 loop.add_reader，可读时 drain 一次取走全部投递，
+  // 每条为 (waiter, key, payload, timestamp_us)
+  py::class_<EventBus>(m, "EventBus")
+      .def(py::init<size_t>(), py::arg("capacity") = 4096)
+      .def("fd", &EventBus::fd)
+      .def("publish", &EventBus::publish, py::arg("keys"), py::arg("payload"))
+      .def("wait", &EventBus::wait, py::arg("keys"))
+      .def("cancel", &EventBus::cancel, py::arg("waiter"))
+      .def("drain",
+           [](EventBus& self) {
+             std::vector<BusDelivery> ready = self.drain();
+             py::list out;
+             for (size_t i = 0; i < ready.size(); i++) {
+               out.append(py::make_tuple(ready[i].waiter, ready[i].key,
+                                         ready[i].payload,
+                                         ready[i].timestamp_us));
+             }
+             return out;
+           })
+      .def(
+          "take",
+          [](EventBus& self, const std::vector<std::string>& keys) {
+            BusDelivery d;
+            if (!self.take(keys, &d)) {
+              return py::object(py::none());
+            }
+            return py::object(
+                py::make_tuple(d.key, d.payload, d.timestamp_us));
+          },
+          py::arg("keys"))
+      .def("discard", &EventBus::discard, py::arg("key"))
+      .def("pendingKeys", &EventBus::pendingKeys)
+      .def("pending", &EventBus::pending)
+      .def("waiters", &EventBus::waiters)
+      .def_static("nowMicros", &EventBus::nowMicros);
+
+  py::class_<TriggerOptions>(m, "TriggerOptions")
+      .def(py::init<>())
+      .def_readwrite("tolerance_ms", &TriggerOptions::tolerance_ms)
+      .def_readwrite("timeout_ms", &TriggerOptions::timeout_ms)
+      .def_readwrite("max_age_ms", &TriggerOptions::max_age_ms);
+
+  // 到位抓图：到达报文经本机 socket 直达监听线程，命中登记即同步抓图，
+  // 结果在 results()（EventBus）上按 resultKey 发布
+  py::class_<ArrivalTrigger>(m, "ArrivalTrigger")
+      .def(py::init<CaptureGroup*>(), py::arg("group"), py::keep_alive<1, 2>())
+      .def("listen", &ArrivalTrigger::listen, py::arg("socket_path"))
+      .def("stop", &ArrivalTrigger::stop,
+           py::call_guard<py::gil_scoped_release>())
+      .def("running", &ArrivalTrigger::running)
+      .def("socketPath", &ArrivalTrigger::socketPath)
+      .def("arm", &ArrivalTrigger::arm, py::arg("robot_code"),
+           py::arg("task_id"), py::arg("bin_code"),
+           py::arg("options") = TriggerOptions())
+      .def("disarm", &ArrivalTrigger::disarm, py::arg("robot_code"),
+           py::arg("bin_code"))
+      .def("armed", &ArrivalTrigger::armed)
+      .def("unmatched", &ArrivalTrigger::unmatched)
+      .def("results", &ArrivalTrigger::results,
+           py::return_value_policy::reference_internal)
+      .def_static("resultKey", &ArrivalTrigger::resultKey,
+                  py::arg("robot_code"), py::arg("bin_code"))
+      .def_static("notify", &ArrivalTrigger::notify, py::arg("socket_path"),
+                  py::arg("robot_code"), py::arg("bin_code"));
+
+  // 单储位作业图：Python 侧循环 takeReady → 在线程池执行阶段 → finish
+  py::enum_<JobState>(m, "JobState")
+      .value("WAITING", kJobWaiting)
+      .value("RUNNING", kJobRunning)
+      .value("PROVISIONAL", kJobProvisional)
+      .value("DONE", kJobDone)
+      .value("FAILED", kJobFailed)
+      .value("SKIPPED", kJobSkipped)
+      .export_values();
+
+  py::enum_<JobJoin>(m, "JobJoin")
+      .value("ALL", kJoinAll)
+      .value("ANY", kJoinAny)
+      .export_values();
+
+  py::class_<JobRecord>(m, "JobRecord")
+      .def_readonly("name", &JobRecord::name)
+      .def_readonly("input", &JobRecord::input)
+      .def_readonly("state", &JobRecord::state)
+      .def_readonly("runs", &JobRecord::runs)
+      .def_readonly("ready_us", &JobRecord::ready_us)
+      .def_readonly("start_us", &JobRecord::start_us)
+      .def_readonly("end_us", &JobRecord::end_us)
+      .def_readonly("busy_ms", &JobRecord::busy_ms);
+
+  py::class_<JobGraph>(m, "JobGraph")
+      .def(py::init<>())
+      .def("addInput", &JobGraph::addInput, py::arg("name"))
+      .def("addStage", &JobGraph::addStage, py::arg("name"), py::arg("deps"),
+           py::arg("join") = static_cast<int>(kJoinAll),
+           py::arg("soft") = std::vector<std::string>())
+      .def("provide", &JobGraph::provide, py::arg("name"), py::arg("ok"))
+      .def("takeReady", &JobGraph::takeReady)
+      .def("finalRun", &JobGraph::finalRun, py::arg("name"))
+      .def("finish", &JobGraph::finish, py::arg("name"), py::arg("ok"))
+      .def("cancel", &JobGraph::cancel)
+      .def("done", &JobGraph::done)
+      .def("state", &JobGraph::state, py::arg("name"))
+      .def("makespanMs", &JobGraph::makespanMs)
+      .def("busyMs", &JobGraph::busyMs)
+      .def("records", &JobGraph::records);
+
+  // 单储位检查点：commit/valid 要读取并哈希产物，执行时释放 GIL
+  py::class_<CheckpointEntry>(m, "CheckpointEntry")
+      .def_readonly("stage", &CheckpointEntry::stage)
+      .def_readonly("payload", &CheckpointEntry::payload)
+      .def_readonly("paths", &CheckpointEntry::paths)
+      .def_readonly("sizes", &CheckpointEntry::sizes)
+      .def_readonly("hashes", &CheckpointEntry::hashes)
+      .def_readonly("time_us", &CheckpointEntry::time_us);
+
+  py::class_<CheckpointStore>(m, "CheckpointStore")
+      .def(py::init<const std::string&>(), py::arg("dir"))
+      .def("dir", &CheckpointStore::dir)
+      .def("commit", &CheckpointStore::commit, py::arg("stage"),
+           py::arg("artifacts"), py::arg("payload"),
+           py::call_guard<py::gil_scoped_release>())
+      .def("invalidate", &CheckpointStore::invalidate, py::arg("stage"))
+      .def("clear", &CheckpointStore::clear)
+      .def("has", &CheckpointStore::has, py::arg("stage"))
+      .def("valid", &CheckpointStore::valid, py::arg("stage"),
+           py::call_guard<py::gil_scoped_release>())
+      .def("payload", &CheckpointStore::payload, py::arg("stage"))
+      .def("resumeAt", &CheckpointStore::resumeAt, py::arg("stages"),
+           py::call_guard<py::gil_scoped_release>())
+      .def("stages", &CheckpointStore::stages)
+      .def("entries", &CheckpointStore::entries)
+      .def_static(
+          "hashFile",
+          [](const std::string& path) -> py::object {
+            uint64_t hash = 0;
+            int64_t size = 0;
+            bool ok;
+            {
+              py::gil_scoped_release release;
+              ok = CheckpointStore::hashFile(path, &hash, &size);
+            }
+            if (!ok) {
+              return py::none();
+            }
+            return py::make_tuple(hash, size);
+          },
+          py::arg("path"));
+
+  // 进程内存预算（单例）：收缩回调在监控线程或 reserve 的调用线程上执行，
+  // 会先取 GIL；check/reserve/detach/stopMonitor 执行时释放 GIL
+  py::enum_<MemoryPressure>(m, "MemoryPressure")
+      .value("NORMAL", kMemNormal)
+      .value("SOFT", kMemSoft)
+      .value("HARD", kMemHard)
+      .export_values();
+
+  py::class_<MemoryAccount>(m, "MemoryAccount")
+      .def_readonly("id", &MemoryAccount::id)
+      .def_readonly("name", &MemoryAccount::name)
+      .def_readonly("budget", &MemoryAccount::budget)
+      .def_readonly("used", &MemoryAccount::used)
+      .def_readonly("peak", &MemoryAccount::peak)
+      .def_readonly("priority", &MemoryAccount::priority)
+      .def_readonly("shrinks", &MemoryAccount::shrinks)
+      .def_readonly("released", &MemoryAccount::released)
+      .def_readonly("deferred", &MemoryAccount::deferred);
+
+  py::class_<MemoryStats>(m, "MemoryStats")
+      .def_readonly("limit", &MemoryStats::limit)
+      .def_readonly("accounted", &MemoryStats::accounted)
+      .def_readonly("rss", &MemoryStats::rss)
+      .def_readonly("rss_peak", &MemoryStats::rss_peak)
+      .def_readonly("available", &MemoryStats::available)
+      .def_readonly("level", &MemoryStats::level)
+      .def_readonly("soft_events", &MemoryStats::soft_events)
+      .def_readonly("hard_events", &MemoryStats::hard_events);
+
+  py::class_<MemoryGovernor, std::unique_ptr<MemoryGovernor, py::nodelete> >(
+      m, "MemoryGovernor")
+      .def_static("instance", &MemoryGovernor::instance,
+                  py::return_value_policy::reference)
+      .def("configure", &MemoryGovernor::configure, py::arg("limit_bytes"),
+           py::arg("soft_ratio") = 0.85, py::arg("hard_ratio") = 0.95,
+           py::arg("min_available") = 0)
+      .def("attach", &MemoryGovernor::attach, py::arg("name"),
+           py::arg("budget"), py::arg("priority"),
+           py::arg("callback") = nullptr)
+      .def("detach", &MemoryGovernor::detach, py::arg("id"),
+           py::call_guard<py::gil_scoped_release>())
+      .def("setBudget", &MemoryGovernor::setBudget, py::arg("id"),
+           py::arg("budget"))
+      .def("set", &MemoryGovernor::set, py::arg("id"), py::arg("used"))
+      .def("add", &MemoryGovernor::add, py::arg("id"), py::arg("delta"))
+      .def("reserve", &MemoryGovernor::reserve, py::arg("id"),
+           py::arg("bytes"), py::call_guard<py::gil_scoped_release>())
+      .def("check", &MemoryGovernor::check,
+           py::call_guard<py::gil_scoped_release>())
+      .def("level", &MemoryGovernor::level)
+      .def("startMonitor", &MemoryGovernor::startMonitor,
+           py::arg("interval_ms"))
+      .def("stopMonitor", &MemoryGovernor::stopMonitor,
+           py::call_guard<py::gil_scoped_release>())
+      .def("accounts", &MemoryGovernor::accounts)
+      .def("stats", &MemoryGovernor::stats);
+
+  py::class_<PortStats>(m, "PortStats")
+      .def_readonly("completed", &PortStats::completed)
+      .def_readonly("dropped", &PortStats::dropped)
+      .def_readonly("signals", &PortStats::signals)
+      .def_readonly("batches", &PortStats::batches)
+      .def_readonly("max_batch", &PortStats::max_batch)
+      .def_readonly("outstanding", &PortStats::outstanding)
+      .def_readonly("max_latency_ms", &PortStats::max_latency_ms);
+
+  // 原生异步操作的完成端口：fd 交给 loop.add_reader，可读时 drain 一次取走
+  // 全部完成，每条为 (token, 结果)；各类操作的发起见 CaptureLoop.startFlow 等
+  py::class_<CompletionPort, std::shared_ptr<CompletionPort> >(
+      m, "CompletionPort")
+      .def(py::init<>())
+      .def("fd", &CompletionPort::fd)
+      .def("cancel", &CompletionPort::cancel, py::arg("token"))
+      .def("drain",
+           [](CompletionPort& self) {
+             std::vector<PortCompletion> ready = self.drain();
+             py::list out;
+             for (size_t i = 0; i < ready.size(); i++) {
+               const PortValue* v =
+                   static_cast<const PortValue*>(ready[i].value.get());
+               out.append(py::make_tuple(
+                   ready[i].token, v != NULL ? v->toPython() : py::none()));
+             }
+             return out;
+           })
+      .def("outstanding", &CompletionPort::outstanding)
+      .def("stats", &CompletionPort::stats);
+
+  // 抓图事件循环：run 并发跑完一组相机的抓图流程，执行期间释放 GIL
+  py::enum_<CaptureStep>(m, "CaptureStep")
+      .value("LOGIN", kStepLogin)
+      .value("STREAM", kStepStream)
+      .value("READY", kStepReady)
+      .value("GRAB", kStepGrab)
+      .value("ENCODE", kStepEncode)
+      .value("WRITE", kStepWrite)
+      .value("DONE", kStepDone)
+      .export_values();
+
+  py::class_<CaptureFlowOptions>(m, "CaptureFlowOptions")
+      .def(py::init<>())
+      .def_readwrite("address", &CaptureFlowOptions::address)
+      .def_readwrite("port", &CaptureFlowOptions::port)
+      .def_readwrite("user", &CaptureFlowOptions::user)
+      .def_readwrite("password", &CaptureFlowOptions::password)
+      .def_readwrite("channel", &CaptureFlowOptions::channel)
+      .def_readwrite("streams", &CaptureFlowOptions::streams)
+      .def_readwrite("link_mode", &CaptureFlowOptions::link_mode)
+      .def_readwrite("task_id", &CaptureFlowOptions::task_id)
+      .def_readwrite("bin_code", &CaptureFlowOptions::bin_code)
+      .def_readwrite("camera_type", &CaptureFlowOptions::camera_type)
+      .def_readwrite("rois", &CaptureFlowOptions::rois)
+      .def_readwrite("roi_options", &CaptureFlowOptions::roi_options)
+      .def_readwrite("capture_hash", &CaptureFlowOptions::capture_hash)
+      .def_readwrite("login_timeout_ms", &CaptureFlowOptions::login_timeout_ms)
+      .def_readwrite("ready_timeout_ms", &CaptureFlowOptions::ready_timeout_ms)
+      .def_readwrite("grab_timeout_ms", &CaptureFlowOptions::grab_timeout_ms)
+      .def_readwrite("write_timeout_ms", &CaptureFlowOptions::write_timeout_ms)
+      .def_readwrite("settle_ms", &CaptureFlowOptions::settle_ms)
+      .def_readwrite("deadline_ms", &CaptureFlowOptions::deadline_ms);
+
+  py::class_<CaptureShot>(m, "CaptureShot")
+      .def_readonly("stream_type", &CaptureShot::stream_type)
+      .def_readonly("path", &CaptureShot::path)
+      .def_readonly("frame_us", &CaptureShot::frame_us)
+      .def_readonly("ready_ms", &CaptureShot::ready_ms)
+      .def_readonly("grab_ms", &CaptureShot::grab_ms)
+      .def_readonly("encode_ms", &CaptureShot::encode_ms)
+      .def_readonly("write_ms", &CaptureShot::write_ms);
+
+  py::class_<CaptureFlowResult>(m, "CaptureFlowResult")
+      .def_readonly("camera_type", &CaptureFlowResult::camera_type)
+      .def_readonly("success", &CaptureFlowResult::success)
+      .def_readonly("failed_step", &CaptureFlowResult::failed_step)
+      .def_readonly("error", &CaptureFlowResult::error)
+      .def_readonly("shots", &CaptureFlowResult::shots)
+      .def_readonly("login_ms", &CaptureFlowResult::login_ms)
+      .def_readonly("total_ms", &CaptureFlowResult::total_ms);
+
+  py::class_<CaptureLoopStats>(m, "CaptureLoopStats")
+      .def_readonly("tasks", &CaptureLoopStats::tasks)
+      .def_readonly("timers", &CaptureLoopStats::timers)
+      .def_readonly("cancelled", &CaptureLoopStats::cancelled)
+      .def_readonly("offloaded", &CaptureLoopStats::offloaded)
+      .def_readonly("pending_timers", &CaptureLoopStats::pending_timers)
+      .def_readonly("max_lag_ms", &CaptureLoopStats::max_lag_ms)
+      .def_readonly("mean_lag_ms", &CaptureLoopStats::mean_lag_ms);
+
+  py::class_<CaptureLoop>(m, "CaptureLoop")
+      .def(py::init<int, int>(), py::arg("threads") = 2, py::arg("workers") = 2)
+      .def(
+          "run",
+          [](CaptureLoop& self, const std::vector<CaptureFlowOptions>& flows) {
+            return CaptureFlow::runAll(&self, flows);
+          },
+          py::arg("flows"), py::call_guard<py::gil_scoped_release>())
+      // 发起一个流程立即返回端口编号，结束时结果（CaptureFlowResult）投递到
+      // port；撤销编号即取消流程
+      .def(
+          "startFlow",
+          [](CaptureLoop& self, std::shared_ptr<CompletionPort> port,
+             const CaptureFlowOptions& options) {
+            const long token = port->reserve();
+            std::shared_ptr<CaptureFlow> flow = CaptureFlow::start(
+                &self, options, [port, token](const CaptureFlowResult& r) {
+                  port->complete(token, portValue(r));
+                });
+            std::weak_ptr<CaptureFlow> weak(flow);
+            port->onCancel(token, [weak] {
+              std::shared_ptr<CaptureFlow> f = weak.lock();
+              if (f) {
+                f->cancel();
+              }
+            });
+            return token;
+          },
+          py::arg("port"), py::arg("options"))
+      // delay_ms 后在循环线程投递 True（循环已停止时立即投递 False）
+      .def(
+          "sleepAsync",
+          [](CaptureLoop& self, std::shared_ptr<CompletionPort> port,
+             int delay_ms) {
+            const long token = port->reserve();
+            if (self.postAfter(delay_ms, [port, token] {
+                  port->complete(token, portValue(true));
+                }) == 0) {
+              port->complete(token, portValue(false));
+            }
+            return token;
+          },
+          py::arg("port"), py::arg("delay_ms"))
+      .def("stop", &CaptureLoop::stop,
+           py::call_guard<py::gil_scoped_release>())
+      .def("stats", &CaptureLoop::stats);
+
+  // worker ↔ gateway 的储位结果记录（格式见 ResultRecord.h）；
+  // services/api/shared/result_record.py 有同格式的 Python 实现
+  py::enum_<ResultKind>(m, "ResultKind")
+      .value("FINAL", kResultFinal)
+      .value("PROVISIONAL", kResultProvisional)
+      .value("PROGRESS", kResultProgress)
+      .export_values();
+
+  m.def(
+      "encodeResult",
+      [](int kind, py::object task_no, const std::string& bin_location,
+         py::object result, py::object step) {
+        ResultRecord rec;
+        rec.kind = kind;
+        if (!task_no.is_none()) {
+          rec.str_mask |= 1u << kResTaskNo;
+          rec.strs[kResTaskNo] = task_no.cast<std::string>();
+        }
+        rec.str_mask |= 1u << kResBin;
+        rec.strs[kResBin] = bin_location;
+        if (!step.is_none()) {
+          rec.int_mask |= 1u << kResStep;
+          rec.ints[kResStep] = step.cast<int64_t>();
+        }
+        if (!result.is_none()) {
+          py::dict extra;
+          putResultGroup(result.cast<py::dict>(), "", &rec, &extra);
+          if (py::len(extra) > 0) {
+            rec.str_mask |= 1u << kResExtra;
+            rec.strs[kResExtra] =
+                py::module::import("json")
+                    .attr("dumps")(extra, py::arg("ensure_ascii") = false,
+                                   py::arg("default") =
+                                       py::module::import("builtins")
+                                           .attr("str"))
+                    .cast<std::string>();
+          }
+        }
+        std::string out;
+        ResultCodec::encode(rec, &out);
+        return py::bytes(out);
+      },
+      py::arg("kind"), py::arg("task_no"), py::arg("bin_location"),
+      py::arg("result"), py::arg("step") = py::none());
+  m.def("decodeResult", &decodeResultBytes, py::arg("data"));
+  m.def(
+      "decodeResults",
+      [](const py::list& items) {
+        py::list out;
+        for (auto item : items) {
+          out.append(decodeResultBytes(item));
+        }
+        return out;
+      },
+      py::arg("items"));
+  // 只取储位（或任务号），不解整条记录；不是记录时返回 None
+  m.def(
+      "peekResultBin",
+      [](py::bytes data, bool task_no) {
+        char* buf = NULL;
+        Py_ssize_t len = 0;
+        PyBytes_AsStringAndSize(data.ptr(), &buf, &len);
+        std::string out;
+        if (!ResultCodec::peek(buf, static_cast<size_t>(len),
+                               task_no ? kResTaskNo : kResBin, &out)) {
+          return py::object(py::none());
+        }
+        return py::object(py::str(out));
+      },
+      py::arg("data"), py::arg("task_no") = false);
+
+  // JPEG 解码：DCT 域缩小（scale_denom 为 0 时按 min_long_side 自动选）、
+  // 输出时旋转；批量用 DecodePipeline 在后台线程预取
+  py::enum_<DecodeFormat>(m, "DecodeFormat")
+      .value("GRAY", kDecodeGray)
+      .value("BGR", kDecodeBgr)
+      .export_values();
+
+  py::class_<DecodeOptions>(m, "DecodeOptions")
+      .def(py::init<>())
+      .def_readwrite("format", &DecodeOptions::format)
+      .def_readwrite("scale_denom", &DecodeOptions::scale_denom)
+      .def_readwrite("min_long_side", &DecodeOptions::min_long_side)
+      .def_readwrite("rotate", &DecodeOptions::rotate)
+      .def_readwrite("fast", &DecodeOptions::fast);
+
+  // 支持 buffer 协议：np.asarray(image) 不拷贝，BGR 为 HxWx3，GRAY 为 HxW
+  py::class_<DecodedImage>(m, "DecodedImage", py::buffer_protocol())
+      .def_readonly("width", &DecodedImage::width)
+      .def_readonly("height", &DecodedImage::height)
+      .def_readonly("channels", &DecodedImage::channels)
+      .def_readonly("src_width", &DecodedImage::src_width)
+      .def_readonly("src_height", &DecodedImage::src_height)
+      .def_readonly("scale_denom", &DecodedImage::scale_denom)
+      .def_buffer([](DecodedImage& self) -> py::buffer_info {
+        static unsigned char empty = 0;
+        unsigned char* ptr =
+            self.data ? const_cast<unsigned char*>(self.data->data())
+                      : &empty;
+        const py::ssize_t h = self.data ? self.height : 0;
+        const py::ssize_t w = self.data ? self.width : 0;
+        const py::ssize_t c = self.channels > 0 ? self.channels : 1;
+        const std::string fmt = py::format_descriptor<uint8_t>::format();
+        if (c == 1) {
+          return py::buffer_info(ptr, 1, fmt, 2, {h, w}, {w, py::ssize_t(1)},
+                                 true);
+        }
+        return py::buffer_info(ptr, 1, fmt, 3, {h, w, c},
+                               {w * c, c, py::ssize_t(1)}, true);
+      });
+
+  // 单张解码（调用线程上执行，释放 GIL），失败返回 None
+  m.def(
+      "decodeJpeg",
+      [](const std::string& path, const DecodeOptions& options) {
+        DecodedImage image;
+        bool ok = false;
+        {
+          py::gil_scoped_release release;
+          JpegDecoder decoder;
+          ok = decoder.decodeFile(path, options, &image);
+        }
+        return ok ? py::cast(image) : py::object(py::none());
+      },
+      py::arg("path"), py::arg("options") = DecodeOptions());
+
+  py::class_<DecodeJob>(m, "DecodeJob")
+      .def(py::init<>())
+      .def(py::init([](int64_t tag, const std::string& path,
+                       const DecodeOptions& options) {
+             DecodeJob job;
+             job.tag = tag;
+             job.path = path;
+             job.options = options;
+             return job;
+           }),
+           py::arg("tag"), py::arg("path"),
+           py::arg("options") = DecodeOptions())
+      .def_readwrite("tag", &DecodeJob::tag)
+      .def_readwrite("path", &DecodeJob::path)
+      .def_readwrite("options", &DecodeJob::options);
+
+  py::class_<DecodeResult>(m, "DecodeResult")
+      .def_readonly("tag", &DecodeResult::tag)
+      .def_readonly("path", &DecodeResult::path)
+      .def_readonly("ok", &DecodeResult::ok)
+      .def_readonly("image", &DecodeResult::image)
+      .def_readonly("decode_ms", &DecodeResult::decode_ms);
+
+  py::class_<DecodeStats>(m, "DecodeStats")
+      .def_readonly("submitted", &DecodeStats::submitted)
+      .def_readonly("delivered", &DecodeStats::delivered)
+      .def_readonly("failed", &DecodeStats::failed)
+      .def_readonly("pixel_bytes", &DecodeStats::pixel_bytes)
+      .def_readonly("decode_ms", &DecodeStats::decode_ms)
+      .def_readonly("wait_ms", &DecodeStats::wait_ms)
+      .def_readonly("stall_ms", &DecodeStats::stall_ms);
+
+  // 预取解码：next 按提交顺序交付，超时或已全部交付时返回 None（用 done() 区分）
+  py::class_<DecodePipeline>(m, "DecodePipeline")
+      .def(py::init<int, int>(), py::arg("threads") = 2, py::arg("depth") = 8)
+      .def("submit", &DecodePipeline::submit, py::arg("jobs"),
+           py::call_guard<py::gil_scoped_release>())
+      .def("finish", &DecodePipeline::finish)
+      .def("next",
+           [](DecodePipeline& self, int timeout_ms) -> py::object {
+             DecodeResult result;
+             bool ok = false;
+             {
+               py::gil_scoped_release release;
+               ok = self.next(&result, timeout_ms);
+             }
+             if (!ok) {
+               return py::none();
+             }
+             return py::cast(std::move(result));
+           },
+           py::arg("timeout_ms") = 1000)
+      .def("done", &DecodePipeline::done)
+      .def("close", &DecodePipeline::close,
+           py::call_guard<py::gil_scoped_release>())
+      .def("stats", &DecodePipeline::stats);
+
+  // 异步写文件：拷贝数据后立即返回，完成后在写入线程调用 callback(path, ok)
+  m.def(
+      "writeFileAsync",
+      [](const std::string& path, py::bytes data,
+         AsyncFileWriter::Callback callback) {
+        char* buf = NULL;
+        Py_ssize_t len = 0;
+        PyBytes_AsStringAndSize(data.ptr(), &buf, &len);
+        return AsyncFileWriter::instance().write(path, buf,
+                                                 static_cast<size_t>(len),
+                                                 callback);
+      },
+      py::arg("path"), py::arg("data"), py::arg("callback") = nullptr);
+  m.def(
+      "flushWrites", []() { AsyncFileWriter::instance().flush(); },
+      py::call_guard<py::gil_scoped_release>());
 
   //  // 绑定无参版本：使用函数指针类型转换明确指定
   //  .def("doGetCapturePicture_JPG",
@@ -14,6 +14,8 @@ from services.api.shared.websocket_manager import ws_manager
 from services.api.shared.config import logger, logs_dir, CORS_ORIGINS, set_service_name
 set_service_name("gateway")
 from services.api.shared.operation_log import log_operation
+from services.api.inventory import arrival_capture
+from services.api.shared import memory_governor, native_async
 
 # 导入各服务模块的路由
 from services.api.auth.router import router as auth_router
@@ -78,6 +80,15 @@ async def health_check():
     """健康检查接口"""
     return {"status": "healthy", "service": "gateway"}
 
+# 内存账目：gateway 本进程，以及 worker 每处理完一个储位写出的快照
+@app.get("/memory")
+async def memory_accounting():
+    """各进程的内存上限、RSS 和各子系统的预算/用量"""
+    return {
+        "gateway": memory_governor.accounting(),
+        "worker": memory_governor.load_exported("worker"),
+    }
+
 # 根路径
 @app.get("/")
 async def root():
@@ -129,12 +140,20 @@ async def startup_event():
         details={"version": "1.0.0"}
     )
 
+    # 内存预算先于到位抓图配置，常驻相机的帧历史登记后即受管
+    memory_governor.setup("gateway")
+
+    # 到位即抓图：常驻登录、开流相机（arrival_capture.enabled 为 true 时）
+    await arrival_capture.start_service()
+
 
 # 关闭事件
 @app.on_event("shutdown")
 async def shutdown_event():
     """应用关闭事件"""
     logger.info("Gateway服务关闭")
+    await arrival_capture.stop_service()
+    native_async.close()
     log_operation(
         operation_type="system",
         action="服务关闭",
@@ -0,0 +1,195 @@
+"""
+到位即抓图（见 hardware/cam_sys/src/ArrivalTrigger.h）
+
+gateway 进程内常驻登录、开流各相机并组成 CaptureGroup；下发储位时按 (robotTaskCode, 储位) 登记触发，
+RCS 的 END 回调一到，robot/router 就往本机 socket 发一条到达报文，同步抓图在 cam_sys 的监听线程里
+直接完成，不再等工作流被唤醒、启动抓图脚本、登录和开流。结果经 eventfd 回到事件循环。
+配置见 config.json 的 arrival_capture；未启用、相机未就绪或抓图失败时，调用方照常走 capture_images_with_scripts
+"""
+import asyncio
+import time
+from typing import Any, Dict, List, Optional
+
+from services.api.robot.status_bus import RobotStatusBus
+from services.api.shared.config import logger, ARRIVAL_CAPTURE, REUSE_UNCHANGED_BINS
+from services.api.shared.native import load_camera_api
+
+# 相机类型 → capture_images_with_scripts 结果里的相机名
+CAMERA_NAMES = {"scan_camera_1": "scan_1", "scan_camera_2": "scan_2", "3d_camera": "3d"}
+
+# 与抓图脚本一致的默认相机；3d 相机的主码流和第四码流（depth.jpg）各占一路
+DEFAULT_CAMERAS = [
+    {"camera_type": "scan_camera_1", "address": "10.16.82.181", "stream_type": 0},
+    {"camera_type": "scan_camera_2", "address": "10.16.82.182", "stream_type": 0},
+    {"camera_type": "3d_camera", "address": "10.16.82.180", "stream_type": 0},
+    {"camera_type": "3d_camera", "address": "10.16.82.180", "stream_type": 3},
+]
+
+
+def _load_camera_api():
+    return load_camera_api("ArrivalTrigger", "到位抓图改用抓图脚本")
+
+
+class ArrivalCaptureService:
+    """常驻相机 + 到位触发。start/stop 会阻塞（登录、开流），在线程池里调用"""
+
+    def __init__(self, config: Optional[Dict[str, Any]] = None):
+        config = config or {}
+        self.socket_path = config.get("socket", "/tmp/leafdepot_arrival.sock")
+        self.cameras = config.get("cameras") or DEFAULT_CAMERAS
+        self.tolerance_ms = config.get("tolerance_ms", 40)
+        self.timeout_ms = config.get("timeout_ms", 1500)
+        self.max_age_ms = config.get("max_age_ms", 0)
+        self._controllers: List[Any] = []
+        self._group = None
+        self._trigger = None
+        self._results: Optional[RobotStatusBus] = None
+
+    @property
+    def running(self) -> bool:
+        return self._trigger is not None and self._trigger.running()
+
+    def start(self) -> bool:
+        api = _load_camera_api()
+        if api is None:
+            return False
+        group = api.CaptureGroup()
+        for cam_cfg in self.cameras:
+            cam = api.CamController()
+            if not cam.login(cam_cfg["address"], cam_cfg.get("port", 8000),
+                             cam_cfg.get("user", "admin"), cam_cfg.get("password", "qwe147852")):
+                logger.error(f"到位抓图: 相机登录失败 {cam_cfg['camera_type']} {cam_cfg['address']}")
+                self._release()
+                return False
+            self._controllers.append(cam)
+            cam.setCameraType(cam_cfg["camera_type"])
+            cam.enableCaptureHash(REUSE_UNCHANGED_BINS)
+            group.add(cam, cam_cfg.get("history_depth", 8))
+            if not cam.startRealPlay(cam_cfg.get("channel", 1), cam_cfg.get("stream_type", 0), 0, 1):
+                logger.error(f"到位抓图: 开流失败 {cam_cfg['camera_type']} 码流 {cam_cfg.get('stream_type', 0)}")
+                self._release()
+                return False
+        trigger = api.ArrivalTrigger(group)
+        if not trigger.listen(self.socket_path):
+            self._release()
+            return False
+        self._group = group
+        self._trigger = trigger
+        self._results = RobotStatusBus(bus=trigger.results())
+        logger.info(f"到位抓图已就绪: {len(self._controllers)} 路码流, socket={self.socket_path}")
+        return True
+
+    def detach(self):
+        """摘下结果总线的 eventfd，须在事件循环线程里、stop 之前调用"""
+        if self._results is not None:
+            self._results.close()
+
+    def stop(self):
+        if self._trigger is not None:
+            self._trigger.stop()
+        self._release()
+
+    def _release(self):
+        self._trigger = None
+        self._results = None
+        self._group = None
+        for cam in self._controllers:
+            cam.stopRealPlay()
+            cam.logout()
+        self._controllers = []
+
+    def arm(self, robot_code: str, task_no: str, bin_location: str) -> bool:
+        """下发储位后登记；未就绪时返回 False，调用方走抓图脚本"""
+        if not self.running or not robot_code:
+            return False
+        options = _load_camera_api().TriggerOptions()
+        options.tolerance_ms = self.tolerance_ms
+        options.timeout_ms = self.timeout_ms
+        options.max_age_ms = self.max_age_ms
+        self._trigger.arm(robot_code, task_no, bin_location, options)
+        return True
+
+    def disarm(self, robot_code: str, bin_location: str):
+        if self.running:
+            self._trigger.disarm(robot_code, bin_location)
+
+    def notify_arrival(self, robot_code: str, bin_location: str = "") -> bool:
+        """发到达报文；储位为空时按 robotTaskCode 命中（每次单储位下发，robotTaskCode 唯一）"""
+        if not self.running or not robot_code:
+            return False
+        return _load_camera_api().ArrivalTrigger.notify(self.socket_path, robot_code, bin_location)
+
+    async def wait_result(self, robot_code: str, bin_location: str,
+                          deadline=None) -> Optional[Dict[str, Any]]:
+        """等抓图完成，返回与 capture_images_with_scripts 相同结构的结果；超时或未就绪返回 None。
+        最多等抓图超时再加 2 秒（报文排队、写图），且不超过储位时间预算"""
+        if self._results is None:
+            return None
+        timeout = self.timeout_ms / 1000.0 + 2.0
+        if deadline is not None:
+            timeout = deadline.clamp(timeout)
+        key = _load_camera_api().ArrivalTrigger.resultKey(robot_code, bin_location)
+        try:
+            result, _ = await self._results.wait([key], timeout)
+        except asyncio.TimeoutError:
+            self.disarm(robot_code, bin_location)
+            logger.warning(f"到位抓图超时: {bin_location}, rt_code={robot_code}")
+            return None
+        now_us = int(time.monotonic() * 1e6)
+        logger.info(f"到位抓图: bin={bin_location}, 到达→成像 {(result['frame_us'] - result['arrival_us']) / 1000:.1f}ms, "
+                    f"到达→通知 {(now_us - result['arrival_us']) / 1000:.1f}ms, 跨度 {result['spread_ms']:.1f}ms")
+        return _to_capture_result(result)
+
+
+def _to_capture_result(result: Dict[str, Any]) -> Dict[str, Any]:
+    task_no, bin_location = result["task_no"], result["bin"]
+    cameras: Dict[str, Dict[str, Any]] = {}
+    for frame in result.get("frames", []):
+        name = CAMERA_NAMES.get(frame["camera"], frame["camera"])
+        ok = bool(frame.get("path")) and cameras.get(name, {}).get("success", True)
+        cameras[name] = {"success": ok} if ok else {"success": False, "error": "同步抓图写图失败"}
+    if not result.get("success"):
+        return {"success": False, "cameras": cameras, "errors": ["同步抓图未找到同一时刻的一组帧"]}
+    errors = [f"{name}: {r['error']}" for name, r in cameras.items() if not r["success"]]
+    has_depth = any(f["camera"] == "3d_camera" and f.get("stream_type") == 3 and f.get("path")
+                    for f in result.get("frames", []))
+    return {
+        "success": True,
+        "partial": bool(errors),
+        "cameras": cameras,
+        "errors": errors,
+        "photo3dPath": f"/{task_no}/{bin_location}/3d_camera/main.jpg" if cameras.get("3d", {}).get("success") else None,
+        "photoDepthPath": f"/{task_no}/{bin_location}/3d_camera/depth.jpg" if has_depth else None,
+        "photoScan1Path": f"/{task_no}/{bin_location}/scan_camera_1/main.jpg" if cameras.get("scan_1", {}).get("success") else None,
+        "photoScan2Path": f"/{task_no}/{bin_location}/scan_camera_2/main.jpg" if cameras.get("scan_2", {}).get("success") else None,
+        "image_count": sum(1 for f in result.get("frames", []) if f["camera"] == "3d_camera" and f.get("path")),
+    }
+
+
+_service: Optional[ArrivalCaptureService] = None
+
+
+def get_service() -> Optional[ArrivalCaptureService]:
+    """已启动的服务；未启用或启动失败时为 None"""
+    return _service if _service is not None and _service.running else None
+
+
+async def start_service():
+    """gateway 启动时调用：arrival_capture.enabled 为 true 时在线程池里登录开流"""
+    global _service
+    if not ARRIVAL_CAPTURE.get("enabled"):
+        return
+    service = ArrivalCaptureService(ARRIVAL_CAPTURE)
+    ok = await asyncio.get_running_loop().run_in_executor(None, service.start)
+    if ok:
+        _service = service
+    else:
+        logger.warning("到位抓图启动失败，抓图走脚本")
+
+
+async def stop_service():
+    global _service
+    service, _service = _service, None
+    if service is not None:
+        service.detach()
+        await asyncio.get_running_loop().run_in_executor(None, service.stop)
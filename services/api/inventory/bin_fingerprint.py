@@ -0,0 +1,108 @@
+"""
+储位画面指纹（感知哈希）
+抓图脚本在各相机目录写 main.phash（cam_sys 计算的 64 位 DCT 感知哈希），
+这里按储位保存最近一次已核实结果对应的哈希。复盘同一储位时，各相机画面哈希距离都不超过阈值
+（3D 相机看垛位、两台扫码相机看条码区域），说明货物没动，直接沿用上次结果并标记 reused。
+全 0 的哈希表示画面无法哈希（区域过小或全黑、全白、遮挡，见 FrameKernels::phash），这样的相机按缺失处理。
+"""
+import json
+from datetime import datetime
+from pathlib import Path
+from typing import Dict, Optional
+
+from services.api.shared.config import logger, project_root
+
+STORE_FILE = project_root / "output" / "bin_fingerprints.json"
+
+# 参与比对的相机目录：3D 相机（垛位）+ 两台扫码相机（条码区域）
+FINGERPRINT_CAMERAS = ["3d_camera", "scan_camera_1", "scan_camera_2"]
+
+
+def _load() -> dict:
+    """加载指纹库"""
+    STORE_FILE.parent.mkdir(parents=True, exist_ok=True)
+    if STORE_FILE.exists():
+        try:
+            with open(STORE_FILE, "r", encoding="utf-8") as f:
+                return json.load(f)
+        except (json.JSONDecodeError, IOError) as e:
+            logger.warning(f"加载 bin_fingerprints.json 失败: {e}")
+    return {}
+
+
+def _save(data: dict):
+    """保存指纹库"""
+    STORE_FILE.parent.mkdir(parents=True, exist_ok=True)
+    try:
+        with open(STORE_FILE, "w", encoding="utf-8") as f:
+            json.dump(data, f, ensure_ascii=False, indent=2)
+    except IOError as e:
+        logger.error(f"保存 bin_fingerprints.json 失败: {e}")
+
+
+def hamming_distance(a: str, b: str) -> int:
+    """两个十六进制哈希的汉明距离"""
+    return bin(int(a, 16) ^ int(b, 16)).count("1")
+
+
+def is_valid_hash(value) -> bool:
+    """十六进制且不为 0；两张无法哈希的画面都是 0，距离为 0 会被当成没变化"""
+    try:
+        return int(value, 16) != 0
+    except (TypeError, ValueError):
+        return False
+
+
+def read_capture_hashes(capture_dir: Path) -> Dict[str, str]:
+    """读取本次抓图各相机的 main.phash，缺失或无效的相机不出现在结果中"""
+    hashes = {}
+    for camera in FINGERPRINT_CAMERAS:
+        path = Path(capture_dir) / camera / "main.phash"
+        try:
+            with open(path, "r", encoding="utf-8") as f:
+                value = json.load(f)["phash"]
+        except (IOError, ValueError, KeyError):
+            continue
+        if is_valid_hash(value):
+            hashes[camera] = value
+    return hashes
+
+
+def find_reusable(bin_location: str, hashes: Dict[str, str], max_distance: int) -> Optional[dict]:
+    """
+    查找可沿用的上次结果：所有相机的哈希都齐全有效且距离均不超过 max_distance 时返回上次记录，否则返回 None
+    """
+    if set(hashes) != set(FINGERPRINT_CAMERAS) or not all(map(is_valid_hash, hashes.values())):
+        return None
+    previous = _load().get(bin_location)
+    if not previous:
+        return None
+    old_hashes = previous.get("hashes", {})
+    distances = {}
+    for camera, value in hashes.items():
+        # 库里旧记录中的全 0 哈希同样不算
+        if not is_valid_hash(old_hashes.get(camera)):
+            return None
+        distances[camera] = hamming_distance(value, old_hashes[camera])
+    if max(distances.values()) > max_distance:
+        logger.info(f"[fingerprint] {bin_location} 画面有变化，重新识别: {distances}")
+        return None
+    logger.info(f"[fingerprint] {bin_location} 画面未变化（{distances}），沿用任务 {previous.get('task_no')} 的结果")
+    return previous
+
+
+def remember(bin_location: str, task_no: str, hashes: Dict[str, str],
+             detect_result: dict, barcode_result: dict):
+    """识别成功后记录本储位的指纹与结果；哈希不全或有无效哈希时不记录"""
+    if set(hashes) != set(FINGERPRINT_CAMERAS) or not all(map(is_valid_hash, hashes.values())):
+        return
+    data = _load()
+    data[bin_location] = {
+        "task_no": task_no,
+        "hashes": hashes,
+        "detect_result": detect_result,
+        "barcode_result": barcode_result,
+        "verified_at": datetime.now().isoformat(),
+    }
+    _save(data)
+
@@ -0,0 +1,542 @@
+"""
+单储位作业图（见 hardware/cam_sys/src/JobGraph.h）
+
+一个储位的识别拆成五个阶段，各自在自己的输入到达时启动，不再等三台相机全部抓完：
+
+    3d ───────→ scene（YOLO、深度、分层，与垛型无关）──→ count
+    scan_1 ───→ barcode_1 ─┐                           ↑ 软依赖
+    scan_2 ───→ barcode_2 ─┴→ spec（任一台解析出品规即可）┘
+
+count 以 spec 为软依赖：场景先出来就按默认垛型出暂定数量，品规解析出垛型后按新垛型重算；
+任一台扫码相机已解析出品规时，另一台还没开始的解码不再运行。储位耗时从各阶段之和变为图上最长路径。
+
+gateway 用脚本抓图时按相机逐台写 inputs.json（CaptureManifest），3D 帧一到就把储位推给 worker；
+worker 按清单等扫码帧。没有清单（到位抓图、测试图片目录、旧流程）时按目录里已有的图片一次到齐。
+camera_api 没有 JobGraph 或 bin_graph.enabled 为 false 时，run_barcode_and_detect 按原来的顺序执行。
+
+scene、barcode_1/2、count 完成后写检查点（见 services/api/shared/bin_checkpoint.py），
+worker 重启后续做同一储位时，产物未变的阶段直接读检查点
+
+YOLO 模型在 worker 内跨储位复用，scene 开始前向内存预算申请 memory.scene_reserve_mb
+（见 services/api/shared/memory_governor.py），内存紧张时推迟，hard 时丢弃缓存的模型
+"""
+import asyncio
+import json
+import os
+import threading
+import time
+from pathlib import Path
+from typing import Any, Callable, Dict, List, Optional
+
+from services.api.shared.config import (
+    logger,
+    project_root,
+    ENABLE_BARCODE,
+    BARCODE_MODULE_AVAILABLE,
+    DETECT_MODULE_AVAILABLE,
+    ENABLE_DEBUG,
+    ENABLE_VISUALIZATION,
+    BARCODE_TILING,
+    BIN_GRAPH,
+    MEMORY,
+)
+from services.api.shared.native import load_camera_api
+from services.api.shared import bin_checkpoint, memory_governor
+
+# 输入名 → 相机目录
+INPUT_DIRS = {"3d": "3d_camera", "scan_1": "scan_camera_1", "scan_2": "scan_camera_2"}
+MANIFEST_NAME = "inputs.json"
+IMAGE_EXTENSIONS = ['.jpg', '.jpeg', '.png', '.bmp']
+# 场景检查点（储位目录下 checkpoint/）
+SCENE_PICKLE = "scene.pkl"
+
+# 清单轮询间隔（秒）
+_POLL_SEC = 0.05
+
+
+def _load_camera_api():
+    return load_camera_api("JobGraph", "识别按顺序执行")
+
+
+def available() -> bool:
+    return BIN_GRAPH.get("enabled", True) and _load_camera_api() is not None
+
+
+# ==================== 输入清单 ====================
+
+def main_image(detect_dir: Path) -> Optional[Path]:
+    """3D 相机主图：main 优先，兜底 main_rotated/raw/image"""
+    for name in ['main', 'main_rotated', 'raw', 'image']:
+        for ext in IMAGE_EXTENSIONS:
+            path = detect_dir / f"{name}{ext}"
+            if path.exists():
+                return path
+    return None
+
+
+def _images(cam_dir: Path) -> List[Path]:
+    try:
+        return sorted(f for f in cam_dir.iterdir() if f.is_file() and f.suffix.lower() in IMAGE_EXTENSIONS)
+    except OSError:
+        return []
+
+
+def input_present(name: str, cam_dir: Path) -> bool:
+    """3d 要求主图和 depth.jpg 都在，扫码相机有一张图即可"""
+    if cam_dir is None or not cam_dir.exists():
+        return False
+    if name == "3d":
+        return main_image(cam_dir) is not None and (cam_dir / "depth.jpg").exists()
+    return bool(_images(cam_dir))
+
+
+def read_manifest(bin_dir: Path) -> Optional[Dict[str, Any]]:
+    try:
+        with open(bin_dir / MANIFEST_NAME, "r", encoding="utf-8") as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return None
+
+
+def clear_manifest(bin_dir: Path):
+    """删掉上次留下的清单（如抓图中途重启），worker 按目录里已有的图片一次放行"""
+    try:
+        (bin_dir / MANIFEST_NAME).unlink()
+    except FileNotFoundError:
+        pass
+    except OSError as e:
+        logger.warning(f"删除输入清单失败: {bin_dir}: {e}")
+
+
+class CaptureManifest:
+    """gateway 抓图时写的输入清单：{"landed": {"3d": true, ...}, "complete": false}，整文件替换写入"""
+
+    def __init__(self, bin_dir: Path):
+        self.bin_dir = bin_dir
+        self.landed: Dict[str, bool] = {}
+        self.complete = False
+        self._write()
+
+    def land(self, name: str) -> bool:
+        """标记一台相机的图已写好；返回 True 表示首次标记"""
+        if self.landed.get(name):
+            return False
+        self.landed[name] = True
+        self._write()
+        return True
+
+    def finish(self):
+        """抓图结束，未标记的相机视为缺失"""
+        self.complete = True
+        self._write()
+
+    def _write(self):
+        try:
+            self.bin_dir.mkdir(parents=True, exist_ok=True)
+            tmp = self.bin_dir / f".{MANIFEST_NAME}.tmp"
+            with open(tmp, "w", encoding="utf-8") as f:
+                json.dump({"landed": self.landed, "complete": self.complete}, f)
+            os.replace(tmp, self.bin_dir / MANIFEST_NAME)
+        except OSError as e:
+            logger.warning(f"写输入清单失败: {self.bin_dir}: {e}")
+
+
+async def _watch_inputs(graph, inputs: Dict[str, Path], bin_dir: Path, deadline,
+                        changed: asyncio.Event):
+    """按清单把到达/缺失的输入标到图上；没有清单时按目录现状一次标完"""
+    pending = dict(inputs)
+    wait_limit = BIN_GRAPH.get("input_wait_sec", 120)
+    give_up_at = time.monotonic() + (deadline.clamp(wait_limit) if deadline is not None else wait_limit)
+    while pending:
+        manifest = read_manifest(bin_dir)
+        timed_out = manifest is not None and not manifest.get("complete") and time.monotonic() >= give_up_at
+        if timed_out:
+            logger.warning(f"等待扫码帧超时，按缺失处理: {bin_dir}, 未到: {list(pending)}")
+        final = manifest is None or manifest.get("complete") or timed_out
+        landed = (manifest or {}).get("landed", {})
+        for name, cam_dir in list(pending.items()):
+            if manifest is not None and not landed.get(name) and not final:
+                continue
+            ok = input_present(name, cam_dir)
+            if ok or final:
+                graph.provide(name, ok)
+                del pending[name]
+                changed.set()
+        if pending:
+            await asyncio.sleep(_POLL_SEC)
+
+
+# ==================== 阶段 ====================
+
+class _BinContext:
+    """各阶段在线程池里执行，只写自己的字段"""
+
+    def __init__(self, task_no: str, bin_location: str, scan_dirs: List[Path], detect_dir: Path,
+                 pile_id: int, code_type: str, deadline):
+        self.task_no = task_no
+        self.bin_location = bin_location
+        self.scan_dirs = scan_dirs
+        self.detect_dir = detect_dir
+        self.default_pile_id = pile_id
+        self.code_type = code_type
+        self.deadline = deadline
+        self.factory = None
+        self.scene = None
+        self.scene_error: Optional[str] = None
+        self.resolved: Dict[str, Dict[str, Any]] = {}
+        self.barcode_errors: List[str] = []
+        self.spec: Optional[Dict[str, Any]] = None
+        self.count: Optional[int] = None
+        self.count_pile: Optional[int] = None
+        self.count_error: Optional[str] = None
+        self.store = bin_checkpoint.open_store(detect_dir.parent)
+
+    @property
+    def pile_id(self) -> int:
+        return self.spec["pile_id"] if self.spec else self.default_pile_id
+
+    def frames_3d(self) -> List[str]:
+        """场景与计数检查点依赖的 3D 帧"""
+        frames = [str(main_image(self.detect_dir) or self.detect_dir / "main.jpg")]
+        depth_path = self.detect_dir / "depth.jpg"
+        if depth_path.exists():
+            frames.append(str(depth_path))
+        return frames
+
+    def scene_artifacts(self) -> List[str]:
+        """3D 帧，以及场景 pickle 和它引用的旋转图、深度矩阵缓存"""
+        artifacts = self.frames_3d()
+        if self.scene is not None:
+            artifacts.append(str(bin_checkpoint.artifact_path(self.store, SCENE_PICKLE)))
+            for key in ("processing_image_path", "depth_matrix_csv_path"):
+                ref = self.scene.get(key)
+                if ref and Path(ref).is_file() and str(ref) not in artifacts:
+                    artifacts.append(str(ref))
+        return artifacts
+
+
+# ==================== 模型复用与内存预算 ====================
+
+# 原先每个储位的 StackProcessorFactory 都重新加载一次模型。取用时从缓存拿走、用完放回，
+# 上一个储位的 scene 还没结束（预算耗尽后仍在线程池里跑）时新储位自己加载
+_model_lock = threading.Lock()
+_cached_model = None
+_model_account = None
+_scene_account = None
+# 加载后的权重、融合层和推理缓冲粗估为权重文件的 3 倍
+_MODEL_FOOTPRINT = 3
+
+
+def _model_bytes() -> int:
+    path = project_root / "shared" / "models" / "yolo" / "pile+box.pt"
+    return path.stat().st_size * _MODEL_FOOTPRINT if path.exists() else 0
+
+
+def _on_model_pressure(level: int, excess: int) -> int:
+    """hard 时丢弃缓存的模型（正在用的不动），返回粗估释放的字节"""
+    global _cached_model
+    if level < memory_governor.HARD:
+        return 0
+    with _model_lock:
+        model, _cached_model = _cached_model, None
+    if model is None:
+        return 0
+    memory_governor.set_usage(_model_account, 0)
+    logger.warning("[memory] 内存压力，丢弃缓存的 YOLO 模型，下一个储位重新加载")
+    return _model_bytes()
+
+
+def _take_model():
+    global _cached_model
+    if not MEMORY.get("model_cache", True):
+        return None
+    with _model_lock:
+        model, _cached_model = _cached_model, None
+    return model
+
+
+def _put_model(model):
+    global _cached_model, _model_account
+    if model is None or not MEMORY.get("model_cache", True):
+        return
+    with _model_lock:
+        if _cached_model is not None:
+            return
+        _cached_model = model
+        if _model_account is None:
+            # 重新加载约 1s，缓存里最后让出
+            _model_account = memory_governor.attach("yolo_model", _model_bytes(), 20, _on_model_pressure)
+    memory_governor.set_usage(_model_account, _model_bytes())
+
+
+def _scene_reservation(ctx: _BinContext):
+    """scene 的内存预留：压力大时等到其他进程/缓存让出内存，最多等到储位预算耗尽"""
+    global _scene_account
+    if _scene_account is None:
+        _scene_account = memory_governor.attach("scene", 0, 30)
+    wait_sec = ctx.deadline.clamp(30.0) if ctx.deadline is not None else 30.0
+    return memory_governor.reserved(_scene_account, int(MEMORY.get("scene_reserve_mb", 600)) << 20, wait_sec)
+
+
+def _stage_scene(ctx: _BinContext) -> bool:
+    from core.detection.processors.factory import StackProcessorFactory
+
+    image = main_image(ctx.detect_dir)
+    if image is None:
+        ctx.scene_error = "未找到图片"
+        return False
+    depth_path = ctx.detect_dir / "depth.jpg"
+    debug_output_dir = project_root / "debug" / ctx.task_no / ctx.bin_location
+    debug_output_dir.mkdir(parents=True, exist_ok=True)
+    try:
+        ctx.factory = StackProcessorFactory(
+            enable_debug=ENABLE_DEBUG,
+            enable_visualization=ENABLE_VISUALIZATION,
+            output_dir=str(debug_output_dir),
+        )
+        cached = bin_checkpoint.load(ctx.store, bin_checkpoint.STAGE_SCENE)
+        if cached is not None:
+            ctx.scene = bin_checkpoint.load_pickle(ctx.store, SCENE_PICKLE) if cached.get("scene") else None
+            logger.info(f"[checkpoint] 沿用场景分析: {ctx.bin_location}")
+            return True
+        ctx.factory.model = _take_model()
+        try:
+            with _scene_reservation(ctx):
+                ctx.scene = ctx.factory.analyze(str(image),
+                                                depth_image_path=str(depth_path) if depth_path.exists() else None)
+        finally:
+            _put_model(ctx.factory.model)
+        if ctx.store is not None and (ctx.scene is None or bin_checkpoint.save_pickle(ctx.store, SCENE_PICKLE, ctx.scene)):
+            bin_checkpoint.commit(ctx.store, bin_checkpoint.STAGE_SCENE, ctx.scene_artifacts(),
+                                  {"scene": SCENE_PICKLE if ctx.scene is not None else None})
+        return True
+    except Exception as e:
+        logger.error(f"数量检测失败: {str(e)}")
+        ctx.scene_error = str(e)
+        return False
+
+
+def _stage_barcode(ctx: _BinContext, name: str, scan_dir: Path) -> bool:
+    """解一台扫码相机的图，取第一个能解析出品规的条码"""
+    from core.vision.barcode_recognizer import BarcodeRecognizer
+    from services.api.shared.tobacco_resolver import get_tobacco_case_resolver
+    from services.api.inventory.service import _extract_barcode_text_from_recognizer_result
+
+    cached = bin_checkpoint.load(ctx.store, name)
+    if cached is not None:
+        logger.info(f"[checkpoint] 沿用条码解析 {name}: {ctx.bin_location}")
+        if cached.get("resolved"):
+            ctx.resolved[name] = cached["resolved"]
+            return True
+        return False
+    try:
+        recognizer = BarcodeRecognizer(code_type=ctx.code_type, tiling=BARCODE_TILING)
+        results = recognizer.process_folder(input_dir=str(scan_dir), deadline=ctx.deadline)
+        resolver = get_tobacco_case_resolver()
+        found = None
+        for br in results:
+            barcode_text = _extract_barcode_text_from_recognizer_result(br)
+            if barcode_text:
+                info = resolver.resolve(barcode_text)
+                if info['success']:
+                    found = info
+                    break
+        # 预算耗尽时解码可能没跑完，"未解析出"不能当成结论记下
+        if found is not None or ctx.deadline is None or not ctx.deadline.expired:
+            bin_checkpoint.commit(ctx.store, name, [str(f) for f in _images(scan_dir)], {"resolved": found})
+        if found is not None:
+            ctx.resolved[name] = found
+            return True
+        return False
+    except Exception as e:
+        logger.error(f"条码识别失败: {str(e)}")
+        ctx.barcode_errors.append(str(e))
+        return False
+
+
+def _stage_spec(ctx: _BinContext) -> bool:
+    for name in ("barcode_1", "barcode_2"):
+        if name in ctx.resolved:
+            ctx.spec = ctx.resolved[name]
+            return True
+    return False
+
+
+def _stage_count(ctx: _BinContext) -> bool:
+    pile_id = ctx.pile_id
+    if ctx.count is not None and ctx.count_pile == pile_id:
+        # 解析出的垛型与暂定计数所用相同，不必重算
+        return True
+    cached = bin_checkpoint.load(ctx.store, bin_checkpoint.STAGE_COUNT)
+    if cached is not None and cached.get("pile_id") == pile_id:
+        logger.info(f"[checkpoint] 沿用计数: {ctx.bin_location}, pile_id={pile_id}")
+        ctx.count = cached["count"]
+        ctx.count_pile = pile_id
+        return True
+    try:
+        ctx.count = ctx.factory.count_scene(ctx.scene, pile_id)
+        ctx.count_pile = pile_id
+        bin_checkpoint.commit(ctx.store, bin_checkpoint.STAGE_COUNT, ctx.scene_artifacts(),
+                              {"pile_id": pile_id, "count": ctx.count})
+        return True
+    except Exception as e:
+        logger.error(f"数量检测失败: {str(e)}")
+        ctx.count = None
+        ctx.count_error = str(e)
+        return False
+
+
+def _build_graph(api, with_barcode: bool, with_detect: bool):
+    graph = api.JobGraph()
+    for name in INPUT_DIRS:
+        graph.addInput(name)
+    stages: Dict[str, Callable[[_BinContext], bool]] = {}
+    if with_detect:
+        graph.addStage("scene", ["3d"])
+        stages["scene"] = _stage_scene
+    if with_barcode:
+        graph.addStage("barcode_1", ["scan_1"])
+        graph.addStage("barcode_2", ["scan_2"])
+        graph.addStage("spec", ["barcode_1", "barcode_2"], api.JobJoin.ANY)
+        stages["spec"] = _stage_spec
+    if with_detect:
+        graph.addStage("count", ["scene"], api.JobJoin.ALL, ["spec"] if with_barcode else [])
+        stages["count"] = _stage_count
+    return graph, stages
+
+
+# ==================== 结果 ====================
+
+def _barcode_result(ctx: _BinContext, with_barcode: bool) -> Dict[str, Any]:
+    if not with_barcode:
+        return {"status": "disabled"}
+    if ctx.spec:
+        return {
+            "status": "success",
+            "six_digit_code": ctx.spec['six_digit_code'],
+            "product_name": ctx.spec['product_name'],
+            "tobacco_code": ctx.spec['tobacco_code'],
+            "mapped_pile_id": ctx.spec['pile_id'],
+        }
+    if ctx.barcode_errors:
+        return {"status": "failed", "error": ctx.barcode_errors[0]}
+    return {"status": "no_match", "message": "未匹配到烟箱信息"}
+
+
+def _detect_result(ctx: _BinContext, with_detect: bool, provisional: bool = False) -> Dict[str, Any]:
+    if not with_detect:
+        return {"status": "disabled"}
+    if ctx.count is not None:
+        result = {"status": "success", "total_count": ctx.count, "pile_id": ctx.count_pile}
+        if provisional:
+            result["provisional"] = True
+        return result
+    error = ctx.count_error or ctx.scene_error or "未找到图片"
+    return {"status": "failed", "error": error}
+
+
+def _input_failure(ctx: _BinContext, graph, api) -> Optional[str]:
+    """与顺序执行的前置检查一致：3D 主图/深度图缺失优先，其次两台扫码相机都没有图"""
+    if graph.state("3d") == api.JobState.FAILED:
+        if main_image(ctx.detect_dir) is None:
+            return "3D相机抓图失败：未找到main.jpg"
+        return "3D相机抓图失败：未找到depth.jpg"
+    if graph.state("scan_1") == api.JobState.FAILED and graph.state("scan_2") == api.JobState.FAILED:
+        return "扫码相机拍照失败：未找到图片"
+    return None
+
+
+def _timeline(graph) -> Dict[str, Any]:
+    stages = {}
+    for r in graph.records():
+        if r.input:
+            continue
+        stages[r.name] = {"state": int(r.state), "runs": r.runs, "busy_ms": round(r.busy_ms, 1)}
+    return {"makespan_ms": round(graph.makespanMs(), 1), "busy_ms": round(graph.busyMs(), 1), "stages": stages}
+
+
+# ==================== 执行 ====================
+
+def _run_stage(stage, ctx: _BinContext) -> bool:
+    """线程池里排到时储位已取消或预算耗尽，不再开始该阶段"""
+    if ctx.deadline is not None and ctx.deadline.expired:
+        return False
+    return stage(ctx)
+
+
+async def run(task_no: str, bin_location: str, scan_dirs: List[Path], detect_dir: Path,
+              pile_id: int = 1, code_type: str = "ucc128", deadline=None,
+              on_update: Optional[Callable[[Dict[str, Any]], None]] = None) -> Dict[str, Any]:
+    """按作业图执行条码识别和数量检测，返回与 run_barcode_and_detect 相同结构的结果
+
+    on_update(recognition) 在暂定数量或品规产生、但储位尚未定稿时调用（事件循环线程），
+    detect_result 带 provisional=True。储位预算耗尽时不再启动新阶段，已有暂定数量则以它收尾。
+    """
+    api = _load_camera_api()
+    with_barcode = bool(ENABLE_BARCODE and BARCODE_MODULE_AVAILABLE)
+    with_detect = bool(DETECT_MODULE_AVAILABLE)
+    graph, stages = _build_graph(api, with_barcode, with_detect)
+    for k, scan_dir in enumerate(scan_dirs[:2]):
+        name = f"barcode_{k + 1}"
+        stages[name] = lambda ctx, name=name, scan_dir=scan_dir: _stage_barcode(ctx, name, scan_dir)
+    ctx = _BinContext(task_no, bin_location, scan_dirs, detect_dir, pile_id, code_type, deadline)
+
+    inputs = {"3d": detect_dir}
+    for k, name in enumerate(("scan_1", "scan_2")):
+        inputs[name] = scan_dirs[k] if k < len(scan_dirs) else None
+    changed = asyncio.Event()
+    loop = asyncio.get_running_loop()
+    watcher = asyncio.ensure_future(_watch_inputs(graph, inputs, detect_dir.parent, deadline, changed))
+    running: Dict[asyncio.Future, str] = {}
+    expired = False
+    try:
+        while True:
+            if deadline is not None and deadline.expired:
+                expired = True
+                graph.cancel()
+                break
+            changed.clear()
+            for name in graph.takeReady():
+                running[loop.run_in_executor(None, _run_stage, stages[name], ctx)] = name
+            if graph.done():
+                break
+            input_changed = asyncio.ensure_future(changed.wait())
+            done, _ = await asyncio.wait(list(running) + [input_changed],
+                                         timeout=deadline.clamp(1.0) if deadline is not None else 1.0,
+                                         return_when=asyncio.FIRST_COMPLETED)
+            input_changed.cancel()
+            for fut in done:
+                name = running.pop(fut, None)
+                if name is None:
+                    continue
+                try:
+                    ok = bool(fut.result())
+                except Exception as e:
+                    logger.error(f"作业图阶段 {name} 异常: {e}")
+                    ok = False
+                graph.finish(name, ok)
+                if name in ("count", "spec") and on_update is not None and not graph.done() \
+                        and (ctx.count is not None or ctx.spec):
+                    on_update({
+                        "barcode_result": _barcode_result(ctx, with_barcode),
+                        "detect_result": _detect_result(ctx, with_detect, provisional=True),
+                    })
+    finally:
+        watcher.cancel()
+
+    result: Dict[str, Any] = {"photos": [], "barcode_result": _barcode_result(ctx, with_barcode)}
+    if with_barcode:
+        result["pile_id"] = ctx.pile_id
+    failure = _input_failure(ctx, graph, api)
+    if failure:
+        result["detect_result"] = {"status": "failed", "error": failure}
+    elif expired and ctx.count is None:
+        reason = "储位已取消" if deadline.cancelled else "储位时间预算已耗尽"
+        result["detect_result"] = {"status": "failed", "error": f"数量检测前{reason}"}
+    else:
+        result["detect_result"] = _detect_result(ctx, with_detect, provisional=expired)
+    result["timeline"] = _timeline(graph)
+    logger.info(f"作业图: {bin_location}, 关键路径 {result['timeline']['makespan_ms']:.0f}ms, "
+                f"各阶段合计 {result['timeline']['busy_ms']:.0f}ms, "
+                f"计数运行 {result['timeline']['stages'].get('count', {}).get('runs', 0)} 次")
+    return result
@@ -0,0 +1,132 @@
+"""
+进程内抓图流程（见 hardware/cam_sys/src/CaptureFlow.h）
+
+抓图脚本逐台相机启动进程、同步登录、sleep 轮询解码器和 JPEG，三台相机串行要十几秒。
+这里把每台相机的 登录 → 开流 → 等就绪 → 取帧 → 编码 → 落盘 交给 cam_sys 的 CaptureLoop：
+各步由 SDK 回调和定时器推进，几台相机在两个循环线程上并发，每一步都有精确的超时，
+整个流程受储位时间预算约束。同一台相机的多路码流（3d 的主码流和第四码流）在一个流程里依次抓。
+每台相机的结果经 native_async 的完成端口直接唤醒事件循环，哪台先抓完先回调，不占线程池线程。
+
+配置见 config.json 的 capture_loop；未启用或原生模块不可用时 capture_bin 返回 None，
+调用方照常走抓图脚本，流程失败的相机也由脚本重试
+"""
+import asyncio
+import atexit
+from typing import Any, Callable, Dict, List, Optional
+
+from services.api.inventory.arrival_capture import CAMERA_NAMES, DEFAULT_CAMERAS
+from services.api.shared import native_async
+from services.api.shared.config import logger, CAPTURE_LOOP, CAPTURE_ROIS, CAPTURE_ROI_MODE, REUSE_UNCHANGED_BINS
+from services.api.shared.native import load_camera_api
+
+_loop = None
+
+
+def _load_camera_api():
+    return load_camera_api("CaptureLoop", "抓图流程改用抓图脚本")
+
+
+def available() -> bool:
+    return bool(CAPTURE_LOOP.get("enabled")) and _load_camera_api() is not None
+
+
+def _get_loop():
+    """进程内共用一个 CaptureLoop，首次使用时创建"""
+    global _loop
+    if _loop is None:
+        _loop = _load_camera_api().CaptureLoop(CAPTURE_LOOP.get("threads", 2), CAPTURE_LOOP.get("workers", 2))
+        atexit.register(_loop.stop)
+    return _loop
+
+
+def _camera_groups() -> List[Dict[str, Any]]:
+    """按相机地址合并码流：同一台相机只登录一次，码流依次抓"""
+    groups: Dict[tuple, Dict[str, Any]] = {}
+    for cam in CAPTURE_LOOP.get("cameras") or DEFAULT_CAMERAS:
+        key = (cam["camera_type"], cam["address"], cam.get("channel", 1))
+        group = groups.setdefault(key, dict(cam, streams=[]))
+        group["streams"].append(cam.get("stream_type", 0))
+    return list(groups.values())
+
+
+def _flow_options(cam: Dict[str, Any], task_no: str, bin_location: str, deadline_ms: Optional[int]):
+    api = _load_camera_api()
+    o = api.CaptureFlowOptions()
+    o.address = cam["address"]
+    o.port = cam.get("port", 8000)
+    o.user = cam.get("user", "admin")
+    o.password = cam.get("password", "qwe147852")
+    o.channel = cam.get("channel", 1)
+    o.streams = cam["streams"]
+    o.task_id = task_no
+    o.bin_code = bin_location
+    o.camera_type = cam["camera_type"]
+    rois = CAPTURE_ROIS.get(cam["camera_type"], [])
+    if rois:
+        o.rois = [api.PixelRect(*[int(v) for v in r]) for r in rois]
+        roi_options = api.RoiCaptureOptions()
+        roi_options.mode = api.RoiMode.CROP if CAPTURE_ROI_MODE == "crop" else api.RoiMode.SMOOTH
+        o.roi_options = roi_options
+    o.capture_hash = REUSE_UNCHANGED_BINS
+    for key in ("login_timeout_ms", "ready_timeout_ms", "grab_timeout_ms", "write_timeout_ms", "settle_ms"):
+        if key in CAPTURE_LOOP:
+            setattr(o, key, int(CAPTURE_LOOP[key]))
+    if deadline_ms is not None:
+        o.deadline_ms = deadline_ms  # 不限制时保持默认（负数）
+    return o
+
+
+def _summarize(name: str, r) -> Dict[str, Any]:
+    if r.success:
+        logger.info(f"[抓图流程] {name}: 登录 {r.login_ms:.0f}ms, "
+                    + ", ".join(f"码流{s.stream_type} 就绪 {s.ready_ms:.0f}ms 取帧 {s.grab_ms:.0f}ms "
+                                f"编码 {s.encode_ms:.0f}ms 落盘 {s.write_ms:.0f}ms" for s in r.shots)
+                    + f", 共 {r.total_ms:.0f}ms")
+        return {"success": True, "image_count": len(r.shots), "elapsed_ms": round(r.total_ms, 1)}
+    step_names = {int(v): k for k, v in _load_camera_api().CaptureStep.__members__.items()}
+    step = step_names.get(r.failed_step, str(r.failed_step))
+    logger.warning(f"[抓图流程] {name} 失败于 {step}: {r.error}")
+    return {"success": False, "error": f"抓图流程 {step}: {r.error}"}
+
+
+async def capture_bin(task_no: str, bin_location: str, deadline=None,
+                      on_result: Optional[Callable[[str, Dict[str, Any]], None]] = None
+                      ) -> Optional[Dict[str, Dict[str, Any]]]:
+    """并发抓一个储位的全部相机，返回 {相机名: {"success", "error"?}}（相机名同 capture_images_with_scripts）；
+    on_result(相机名, 结果) 在每台相机的流程结束时立即回调（不等其他相机）。未启用时返回 None。
+    被取消（含 deadline.cancel()）时各相机的流程一并取消（相机照常登出）"""
+    if not available():
+        return None
+    bridge = native_async.get_bridge()
+    if bridge is None:
+        return None
+    deadline_ms = None
+    if deadline is not None:
+        deadline.check("抓图")
+        deadline_ms = deadline.remaining_ms()
+    loop = _get_loop()
+    out: Dict[str, Dict[str, Any]] = {}
+
+    async def _one(cam: Dict[str, Any]):
+        name = CAMERA_NAMES.get(cam["camera_type"], cam["camera_type"])
+        r = await bridge.submit(loop.startFlow, _flow_options(cam, task_no, bin_location, deadline_ms))
+        out[name] = _summarize(name, r)
+        if on_result is not None:
+            on_result(name, out[name])
+
+    flows = asyncio.gather(*(_one(cam) for cam in _camera_groups()))
+    unregister = None
+    if deadline is not None:
+        event_loop = asyncio.get_running_loop()
+        unregister = deadline.on_cancel(lambda: event_loop.call_soon_threadsafe(flows.cancel))
+    try:
+        await flows
+    except asyncio.CancelledError:
+        # 储位取消只结束本次抓图，调用方按已出结果收尾；外层任务被取消时照常上抛
+        if deadline is None or not deadline.cancelled:
+            raise
+        logger.warning(f"[抓图流程] 储位已取消，停止抓图: {task_no}/{bin_location}")
+    finally:
+        if unregister is not None:
+            unregister()
+    return out
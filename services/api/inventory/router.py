@@ -22,6 +22,7 @@ from services.api.shared.config import (
     IS_SIM,
     ENABLE_DEBUG,
     ENABLE_VISUALIZATION,
+    BARCODE_TILING,
 )
 from services.api.shared.models import (
     TaskStatus,
@@ -52,6 +53,7 @@ from services.api.inventory.service import (
     continue_inventory_task,
     _active_bin_tracker,
     _get_next_task_no,
+    cancel_active_bin_deadline,
 )
 from services.api.robot.router import inject_cancel_end
 from services.api.shared.websocket_manager import ws_manager
@@ -309,7 +311,7 @@ async def get_inventory_progress(taskNo: str):
 
         # RCS END 收到后立即计数（rcs_completed），worker 检测完再追加（worker_completed）
         # 取两者的较大值，前端在整个过程中都能看到实时进度
-        from services.api.shared.redis_queue import get_completed_count
+        from services.api.shared.redis_queue import get_completed_count, get_provisional_results
         rcs_done = get_completed_count(taskNo, "rcs_completed")
         worker_done = get_completed_count(taskNo, "worker_completed")
         completed_count = max(rcs_done, worker_done)
@@ -339,6 +341,11 @@ async def get_inventory_progress(taskNo: str):
         if task_details.get("inventoryItems"):
             response_data["inventoryItems"] = task_details["inventoryItems"]
 
+        # 作业图先出的暂定数量/品规（worker 定稿前），按储位返回，前端可先行展示
+        provisional = get_provisional_results(taskNo)
+        if provisional:
+            response_data["provisionalResults"] = provisional
+
         return JSONResponse(
             status_code=status.HTTP_200_OK,
             content={
@@ -578,7 +585,7 @@ async def scan_and_recognize(request: ScanAndRecognizeRequest = Body(...)):
         scan_dir_2 = image_dir.parent / "scan_camera_2"
         if ENABLE_BARCODE and BARCODE_MODULE_AVAILABLE and BarcodeRecognizer:
             try:
-                recognizer = BarcodeRecognizer(code_type=request.code_type)
+                recognizer = BarcodeRecognizer(code_type=request.code_type, tiling=BARCODE_TILING)
                 all_barcode_results = []
                 for scan_dir in [scan_dir_1, scan_dir_2]:
                     if scan_dir.exists():
@@ -1093,6 +1100,8 @@ async def cancel_inventory(taskNo: str = Query(..., description="任务编号"))
             # 执行中取消：设状态为 cancelled，workflow 循环会在下次迭代检测到并自然退出
             inventory_tasks[taskNo].status = "cancelled"
             inventory_tasks[taskNo].end_time = datetime.now().isoformat()
+            # 当前储位的抓图/等待立即放弃
+            cancel_active_bin_deadline(taskNo)
             logger.info(f"任务已取消: {taskNo}（执行中取消，workflow 将自然退出）")
         else:
             # 其他中间状态（pending/interrupted）：直接清除
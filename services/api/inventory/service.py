@@ -11,7 +11,7 @@ import shutil
 import concurrent.futures
 from pathlib import Path
 from datetime import datetime
-from typing import Dict, List, Any, Optional
+from typing import Dict, List, Any, Optional, Tuple
 
 import requests
 import aiohttp
@@ -39,8 +39,20 @@ from services.api.shared.config import (
     DETECT_MODULE_AVAILABLE,
     ENABLE_DEBUG,
     ENABLE_VISUALIZATION,
+    ENABLE_PREVIEW,
+    PREVIEW_BIND,
+    CAMSYS_PORT,
+    CAPTURE_ROIS,
+    CAPTURE_ROI_MODE,
+    REUSE_UNCHANGED_BINS,
+    BARCODE_TILING,
 )
 from services.api.shared.websocket_manager import ws_manager
+from services.api.shared.deadline import Deadline
+from services.api.inventory import arrival_capture
+from services.api.inventory import capture_flows
+from services.api.inventory import bin_graph
+from services.api.shared import bin_checkpoint
 from services.api.shared.excel_writer import build_excel_data, write_excel
 
 # 从 robot/router 导入状态管理（避免与 services.api.state 混淆）
@@ -49,7 +61,6 @@ from services.api.robot.router import (
     prune_robot_status_queue,
     update_robot_status as _router_update_status,
     wait_for_robot_status as _router_wait_status,
-    _robot_status_queue,
 )
 from services.api.inventory.task_state import (
     mark_running,
@@ -65,6 +76,7 @@ from services.api.shared.redis_queue import (
     clear_task_sets,
     clear_task_results,
     flush_single_bin_queue_by_task,
+    mark_bin_cancelled,
     wait_for_bin_result,
 )
 
@@ -96,6 +108,18 @@ _TASKNO_COUNTER_FILE = str(logs_dir / "task_no_counter.txt")
 # 活跃任务的 bin 追踪数据，供取消时发送剩余 continue
 _active_bin_tracker: Dict[str, dict] = {}
 
+# 活跃任务当前储位的 (储位, 时间预算)，取消任务时一并取消，使抓图等阶段立即放弃
+_active_bin_deadlines: Dict[str, Tuple[str, Deadline]] = {}
+
+
+def cancel_active_bin_deadline(task_no: str):
+    """取消任务当前储位的时间预算：结束正在运行的抓图脚本，并发布取消标记让 worker 放弃该储位"""
+    active = _active_bin_deadlines.pop(task_no, None)
+    if active is not None:
+        bin_location, deadline = active
+        deadline.cancel()
+        mark_bin_cancelled(task_no, bin_location)
+
 
 async def _wait_for_bin_result(task_no: str, bin_location: str) -> Optional[Dict]:
     """Gateway 内部用：等待 bin 检测结果（调用 redis_queue 中的 async 版本）"""
@@ -680,14 +704,36 @@ async def check_image_exists(task_no: str, bin_location: str, camera_type: str)
         return False
 
 
-async def execute_capture_script(script_path: str, task_no: str, bin_location: str) -> Dict[str, Any]:
-    """执行单个抓图脚本"""
+async def execute_capture_script(script_path: str, task_no: str, bin_location: str,
+                                 deadline: Optional[Deadline] = None,
+                                 camera_dir: str = "") -> Dict[str, Any]:
+    """执行单个抓图脚本
+
+    deadline 不为空时，剩余预算以 --deadline-ms 传给脚本（C++ 侧据此提前退出），
+    并在预算耗尽后再给 5 秒收尾时间，仍未退出则强制结束脚本进程；deadline 被取消时立即结束脚本进程。
+    camera_dir 在 config.json 的 capture_rois 中配置了 ROI 时，以 --roi 传给脚本按 ROI 编码。
+    """
     conda_env = "tobacco_env"
     try:
         logger.info(f"在 Conda 环境 '{conda_env}' 中执行抓图脚本: {script_path}")
 
         cmd = [sys.executable, script_path,
                "--task-no", task_no, "--bin-location", bin_location]
+        if deadline is not None:
+            deadline.check("抓图")
+            remaining_ms = deadline.remaining_ms()
+            if remaining_ms is not None:
+                cmd += ["--deadline-ms", str(remaining_ms)]
+        if ENABLE_PREVIEW:
+            # 抓图脚本逐个运行，同一时刻只有一个进程占用预览端口
+            cmd += ["--preview-port", str(CAMSYS_PORT), "--preview-bind", PREVIEW_BIND]
+        if REUSE_UNCHANGED_BINS:
+            # 哈希要缓存解码帧像素，只在会比对时计算
+            cmd += ["--capture-hash"]
+        for roi in CAPTURE_ROIS.get(camera_dir, []):
+            cmd += ["--roi", ",".join(str(int(v)) for v in roi)]
+        if CAPTURE_ROIS.get(camera_dir):
+            cmd += ["--roi-mode", CAPTURE_ROI_MODE]
 
         process = await asyncio.create_subprocess_exec(
             *cmd,
@@ -696,7 +742,24 @@ async def execute_capture_script(script_path: str, task_no: str, bin_location: s
             cwd=str(project_root)  # 让子进程从项目根目录运行，C++ 相对路径才能解析正确
         )
 
-        stdout, stderr = await process.communicate()
+        wait_timeout = None
+        if deadline is not None and deadline.expires_at is not None:
+            wait_timeout = deadline.remaining() + 5
+        unregister = deadline.on_cancel(lambda: _terminate_process(process)) if deadline is not None else None
+        try:
+            stdout, stderr = await asyncio.wait_for(process.communicate(), timeout=wait_timeout)
+        except asyncio.TimeoutError:
+            process.kill()
+            await process.wait()
+            logger.error(f"抓图脚本超出储位时间预算，已强制结束: {script_path}")
+            return {"success": False, "error": "抓图超时（储位时间预算耗尽）"}
+        finally:
+            if unregister is not None:
+                unregister()
+
+        if deadline is not None and deadline.cancelled:
+            logger.warning(f"储位已取消，抓图脚本已结束: {script_path}")
+            return {"success": False, "error": "抓图已取消"}
 
         if process.returncode == 0:
             logger.info(f"抓图脚本执行成功: {script_path}")
@@ -710,6 +773,14 @@ async def execute_capture_script(script_path: str, task_no: str, bin_location: s
         return {"success": False, "error": str(e)}
 
 
+def _terminate_process(process):
+    """结束抓图脚本进程（SIGTERM，相机会话由 SDK 超时回收）；进程已退出时忽略"""
+    try:
+        process.terminate()
+    except ProcessLookupError:
+        pass
+
+
 def _ping_camera(host: str, timeout: int = 3) -> bool:
     """检测相机是否网络可达"""
     import socket
@@ -797,11 +868,15 @@ async def _capture_from_test_dir(task_no: str, bin_location: str, test_dir: str)
         return {"success": False, "cameras": camera_results, "errors": all_errors}
 
 
-async def capture_images_with_scripts(task_no: str, bin_location: str) -> Dict[str, Any]:
+async def capture_images_with_scripts(task_no: str, bin_location: str,
+                                      deadline: Optional[Deadline] = None,
+                                      on_camera=None) -> Dict[str, Any]:
     """使用脚本抓取图片（带重试机制）
 
     如果配置了 CAMERA_TEST_DIR，则从本地目录复制图片用于测试；
     否则执行真实相机脚本。
+    deadline 不为空时，重试循环和每个脚本都受储位时间预算约束，耗尽后不再重试。
+    on_camera(cam_name) 在某台相机的图片写好时调用（3d 相机先抓，检测只等它）。
 
     返回值包含:
     - success: bool, 至少有一个相机成功抓图
@@ -828,22 +903,43 @@ async def capture_images_with_scripts(task_no: str, bin_location: str) -> Dict[s
     # 成功的相机状态跨重试保留，只重试仍然失败的相机
     camera_results = {cam_name: {"success": False, "error": ""} for cam_name in CAMERA_NAMES}
 
+    # 启用进程内抓图流程时各相机先并发抓一次，失败的相机再走脚本重试；
+    # 每台相机抓完即回调，3d 先到时作业图不必等扫码相机
+    def _on_flow(cam_name: str, r: Dict[str, Any]):
+        if cam_name not in camera_results:
+            return
+        camera_results[cam_name] = r
+        cam_dir = project_root / "capture_img" / task_no / bin_location / CAMERA_DIRS[CAMERA_NAMES.index(cam_name)]
+        if r.get("success") and on_camera is not None and bin_graph.input_present(cam_name, cam_dir):
+            on_camera(cam_name)
+
+    try:
+        await capture_flows.capture_bin(task_no, bin_location, deadline, on_result=_on_flow)
+    except Exception as e:
+        logger.warning(f"抓图流程异常，改用抓图脚本: {e}")
+
     while retry_count < max_retries:
         # 检查仍然失败的相机
         failed_cameras = [name for name, r in camera_results.items() if not r.get("success")]
         if not failed_cameras:
             # 全部成功
             break
+        if deadline is not None and deadline.expired:
+            logger.warning(f"储位时间预算耗尽，停止抓图重试: {task_no}/{bin_location}, 失败相机: {failed_cameras}")
+            for name in failed_cameras:
+                camera_results[name] = {"success": False, "error": "抓图超时（储位时间预算耗尽）"}
+            break
 
         try:
             if not _ping_camera("10.16.82.180"):
                 logger.warning(f"相机 10.16.82.180 不可达，等待重试...")
-                await asyncio.sleep(5)
+                await (deadline.sleep(5) if deadline is not None else asyncio.sleep(5))
 
             logger.info(f"开始抓图: {task_no}/{bin_location}, 第 {retry_count + 1} 次尝试，失败相机: {failed_cameras}")
 
-            # 只对仍未成功的相机执行脚本
-            for i, script_path in enumerate(CAPTURE_SCRIPTS):
+            # 只对仍未成功的相机执行脚本；3d 相机先抓，作业图拿到 3D 帧就能开始检测
+            for i in sorted(range(len(CAPTURE_SCRIPTS)), key=lambda k: CAMERA_NAMES[k] != "3d"):
+                script_path = CAPTURE_SCRIPTS[i]
                 cam_name = CAMERA_NAMES[i]
                 if camera_results[cam_name].get("success"):
                     # 已成功，跳过
@@ -853,11 +949,19 @@ async def capture_images_with_scripts(task_no: str, bin_location: str) -> Dict[s
                     logger.warning(f"抓图脚本不存在: {script_path}")
                     continue
 
+                if deadline is not None and deadline.expired:
+                    camera_results[cam_name] = {"success": False, "error": "抓图超时（储位时间预算耗尽）"}
+                    continue
+
                 try:
-                    result = await execute_capture_script(script_path, task_no, bin_location)
+                    result = await execute_capture_script(script_path, task_no, bin_location, deadline,
+                                                          camera_dir=CAMERA_DIRS[i])
                     if result.get("success"):
                         camera_results[cam_name] = {"success": True}
                         logger.info(f"相机 {cam_name} 抓图成功")
+                        cam_dir = project_root / "capture_img" / task_no / bin_location / CAMERA_DIRS[i]
+                        if on_camera is not None and bin_graph.input_present(cam_name, cam_dir):
+                            on_camera(cam_name)
                     else:
                         camera_results[cam_name] = {"success": False, "error": result.get("error", "未知错误")}
                         logger.warning(f"相机 {cam_name} 抓图失败: {result.get('error')}")
@@ -866,7 +970,7 @@ async def capture_images_with_scripts(task_no: str, bin_location: str) -> Dict[s
                     logger.warning(f"相机 {cam_name} 抓图异常: {cam_err}")
 
             # 等待图片生成
-            await asyncio.sleep(2)
+            await (deadline.sleep(2) if deadline is not None else asyncio.sleep(2))
 
             # 检查各目录下的图片（无论之前是否成功都检查，确保状态正确）
             for i, cam_name in enumerate(CAMERA_NAMES):
@@ -876,6 +980,8 @@ async def capture_images_with_scripts(task_no: str, bin_location: str) -> Dict[s
                     if image_files:
                         camera_results[cam_name] = {"success": True, "image_count": len(image_files)}
                         logger.info(f"相机 {cam_name} 检测到图片文件 {len(image_files)} 张")
+                        if on_camera is not None and bin_graph.input_present(cam_name, cam_dir):
+                            on_camera(cam_name)
                     elif not camera_results[cam_name].get("success"):
                         camera_results[cam_name] = {"success": False, "error": "未生成图片文件"}
                 elif not camera_results[cam_name].get("success"):
@@ -888,13 +994,13 @@ async def capture_images_with_scripts(task_no: str, bin_location: str) -> Dict[s
 
             retry_count += 1
             if not any_success and retry_count < max_retries:
-                await asyncio.sleep(5)
+                await (deadline.sleep(5) if deadline is not None else asyncio.sleep(5))
 
         except Exception as e:
             retry_count += 1
             logger.error(f"抓图失败 (尝试 {retry_count}/{max_retries}): {str(e)}")
             if retry_count < max_retries:
-                await asyncio.sleep(5)
+                await (deadline.sleep(5) if deadline is not None else asyncio.sleep(5))
 
     # 组装返回结果
     any_success = any(r.get("success") for r in camera_results.values())
@@ -917,8 +1023,43 @@ async def capture_images_with_scripts(task_no: str, bin_location: str) -> Dict[s
         return {"success": False, "cameras": camera_results, "errors": all_errors}
 
 
+async def _capture_with_early_push(task_no: str, bin_location: str,
+                                   deadline: Optional[Deadline]) -> Dict[str, Any]:
+    """脚本抓图，作业图可用时 3D 帧一写好就推 worker，扫码相机还在抓。
+
+    各相机的到达情况写进储位目录的 inputs.json，worker 的作业图据此放行条码阶段；
+    返回的结果带 early_pushed，调用方据此不再重复推送。
+    """
+    if not bin_graph.available():
+        return await capture_images_with_scripts(task_no, bin_location, deadline)
+
+    manifest = bin_graph.CaptureManifest(project_root / "capture_img" / task_no / bin_location)
+    pushed = []
+
+    def _on_camera(cam_name: str):
+        if manifest.land(cam_name) and cam_name == "3d" and not pushed:
+            push_single_bin_task(task_no, bin_location, expires_at=deadline.expires_at if deadline else None)
+            pushed.append(cam_name)
+            logger.info(f"3D 帧已到，提前推 worker: {bin_location}")
+
+    try:
+        result = await capture_images_with_scripts(task_no, bin_location, deadline, on_camera=_on_camera)
+    finally:
+        manifest.finish()
+    result["early_pushed"] = bool(pushed)
+    return result
+
+
+def _commit_capture(capture_dir: Path, capture_result: Dict[str, Any]):
+    """抓图完成后写检查点，重启后重新下发同一储位时沿用（见 bin_checkpoint.reusable_capture）"""
+    payload = {k: v for k, v in capture_result.items() if k != "early_pushed"}
+    bin_checkpoint.commit(bin_checkpoint.open_store(capture_dir), bin_checkpoint.STAGE_CAPTURE,
+                          bin_checkpoint.frame_artifacts(capture_dir), payload)
+
+
 # ==================== 识别函数 ====================
 
+
 def _extract_barcode_text_from_recognizer_result(br: dict) -> str | None:
     """从 barcode recognizer 返回的结果中提取真正的条码字符串
 
@@ -953,9 +1094,21 @@ async def run_barcode_and_detect(
     scan_dirs: list[Path],
     detect_dir: Path,
     pile_id: int = 1,
-    code_type: str = "ucc128"
+    code_type: str = "ucc128",
+    deadline: Optional[Deadline] = None,
+    on_update=None
 ) -> Dict[str, Any]:
-    """执行条码识别和数量检测"""
+    """执行条码识别和数量检测
+
+    deadline 不为空时在条码、检测两个阶段开始前检查，预算耗尽则直接返回失败。
+    作业图可用时交给 bin_graph.run：各阶段在自己的相机图片到达时启动，
+    on_update(recognition) 收到暂定数量/品规（见 bin_graph.py）。
+    """
+    if bin_graph.available():
+        return await bin_graph.run(task_no, bin_location, scan_dirs, detect_dir,
+                                   pile_id=pile_id, code_type=code_type,
+                                   deadline=deadline, on_update=on_update)
+
     result = {
         "barcode_result": None,
         "detect_result": None,
@@ -1005,17 +1158,21 @@ async def run_barcode_and_detect(
         result["detect_result"] = {"status": "failed", "error": "扫码相机拍照失败：未找到图片"}
         return result
 
+    if deadline is not None and deadline.expired:
+        result["detect_result"] = {"status": "failed", "error": "条码识别前储位时间预算已耗尽"}
+        return result
+
     # 条码识别：处理 scan_camera_1 和 scan_camera_2 目录
     if ENABLE_BARCODE and BARCODE_MODULE_AVAILABLE:
         try:
             from core.vision.barcode_recognizer import BarcodeRecognizer
             from services.api.shared.tobacco_resolver import get_tobacco_case_resolver
 
-            recognizer = BarcodeRecognizer(code_type=code_type)
+            recognizer = BarcodeRecognizer(code_type=code_type, tiling=BARCODE_TILING)
             all_barcode_results = []
             for scan_dir in scan_dirs:
                 if scan_dir.exists():
-                    barcode_results = recognizer.process_folder(input_dir=str(scan_dir))
+                    barcode_results = recognizer.process_folder(input_dir=str(scan_dir), deadline=deadline)
                     all_barcode_results.extend(barcode_results)
             resolver = get_tobacco_case_resolver()
 
@@ -1051,6 +1208,10 @@ async def run_barcode_and_detect(
     else:
         result["barcode_result"] = {"status": "disabled"}
 
+    if deadline is not None and deadline.expired:
+        result["detect_result"] = {"status": "failed", "error": "数量检测前储位时间预算已耗尽"}
+        return result
+
     # 数量检测：处理 3d_camera 目录
     if DETECT_MODULE_AVAILABLE:
         try:
@@ -1145,12 +1306,13 @@ async def process_single_bin_location(
             # 模拟模式：END 到达时照片已由 RCS 准备好（robot已到达库位），拍照后交给 worker 检测
             logger.info(f"模拟模式：处理储位 {bin_location}")
 
-            from services.api.shared.config import WITH_CAMERA, CAMERA_TEST_DIR
+            from services.api.shared.config import WITH_CAMERA, CAMERA_TEST_DIR, BIN_BUDGET_SEC
 
             # WITH_CAMERA=true 或 CAMERA_TEST_DIR 配置了 → 拍照后推 Redis 让 worker 检测
             if WITH_CAMERA or CAMERA_TEST_DIR:
                 logger.info(f"模拟模式：拍照 for {bin_location}（camera_test_dir={CAMERA_TEST_DIR}）")
-                capture_results = await capture_images_with_scripts(task_no, bin_location)
+                bin_deadline = Deadline(BIN_BUDGET_SEC)
+                capture_results = await capture_images_with_scripts(task_no, bin_location, bin_deadline)
 
                 # 全部相机失败 → 返回异常
                 if not capture_results.get("success"):
@@ -1160,7 +1322,7 @@ async def process_single_bin_location(
                     return result
 
                 # 推 Redis 让 worker 检测（is_sim=False：worker 内检测模块走完整路径，会写 core.* 日志）
-                push_single_bin_task(task_no, bin_location)
+                push_single_bin_task(task_no, bin_location, expires_at=bin_deadline.expires_at)
                 add_to_completed_set(task_no, "worker_completed", bin_location)
                 logger.info(f"模拟模式：已拍照，已推 Redis 等 worker: {bin_location}")
 
@@ -1310,7 +1472,9 @@ async def process_single_bin_location(
             # 真实模式：wait_for_robot_status 已在 execute_inventory_workflow 层处理，此处直接拍照
             logger.info(f"============拍照: {bin_location}")
             try:
-                capture_results = await capture_images_with_scripts(task_no, bin_location)
+                from services.api.shared.config import BIN_BUDGET_SEC
+                bin_deadline = Deadline(BIN_BUDGET_SEC)
+                capture_results = await capture_images_with_scripts(task_no, bin_location, bin_deadline)
                 result["captureResults"] = capture_results
 
                 if not capture_results.get("success"):
@@ -1342,7 +1506,8 @@ async def process_single_bin_location(
                     scan_dirs=[capture_img_dir / "scan_camera_1", capture_img_dir / "scan_camera_2"],
                     detect_dir=capture_img_dir / "3d_camera",
                     pile_id=1,
-                    code_type="ucc128"
+                    code_type="ucc128",
+                    deadline=bin_deadline
                 )
 
                 detect_result = (recognition_result or {}).get("detect_result") or {}
@@ -1605,6 +1770,8 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                 logger.info(f"第 {i+1}/{len(sorted_bins)} 个库位已下发: {bin_location}, robotTaskCode={robot_task_code}")
                 _active_bin_tracker[task_no] = {"bin_to_task_code": {bin_location: robot_task_code}}
                 prune_robot_status_queue({robot_task_code})
+                if not is_sim and arrival_capture.get_service() is not None:
+                    arrival_capture.get_service().arm(robot_task_code, task_no, bin_location)
 
             _bin_start = time.time()
             try:
@@ -1617,19 +1784,10 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                 )
             except asyncio.TimeoutError:
                 # 超时：先检查队列里是否已有 END（可能刚好在超时前后到达）
-                from services.api.robot.router import _robot_status_queue
-                queued_end = None
-                for j in range(len(_robot_status_queue) - 1, -1, -1):
-                    item = _robot_status_queue[j]
-                    if item.get("method") != "end":
-                        continue
-                    item_code = item.get("robotTaskCode", "")
-                    if item_code == robot_task_code:
-                        queued_end = item
-                        del _robot_status_queue[j]
-                        logger.info(f"[超时前队列] 发现 END: bin={bin_location}, rt_code={robot_task_code}")
-                        break
+                from services.api.robot.router import take_robot_status
+                queued_end = take_robot_status("end", robot_task_code)
                 if queued_end:
+                    logger.info(f"[超时前队列] 发现 END: bin={bin_location}, rt_code={robot_task_code}")
                     # END 已在队列中，当作正常处理
                     ctu_status = queued_end
                     bin_code = ctu_status.get("binCode", "") or bin_location
@@ -1642,6 +1800,8 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                 else:
                     # END 确实没收到（未取消）。RCS 任务节点可能已清理，此时发 continue 无意义，直接跳过
                     logger.warning(f"等待 END 超时且队列中无 END，跳过库位（不发送 continue）: {bin_location}")
+                    if arrival_capture.get_service() is not None:
+                        arrival_capture.get_service().disarm(robot_task_code, bin_location)
                     i += 1
                     continue
 
@@ -1658,10 +1818,35 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                     submitted_bins.pop()
                 break
 
+            # 本储位的时间预算从 END 到达开始计算，抓图、worker 检测共用
+            from services.api.shared.config import BIN_BUDGET_SEC
+            bin_deadline = Deadline(BIN_BUDGET_SEC)
+            _active_bin_deadlines[task_no] = (bin_location, bin_deadline)
+
             # 2. 拍照（异步等待，不阻塞事件循环，确保 RCS 回调能被及时处理）
+            early_pushed = False
             if not is_sim:
                 try:
-                    capture_result = await capture_images_with_scripts(task_no, bin_location)
+                    # 到位即抓图：END 回调时已在 cam_sys 里触发，这里只等结果；未就绪或失败时走抓图脚本
+                    capture_result = None
+                    if arrival_capture.get_service() is not None:
+                        capture_result = await arrival_capture.get_service().wait_result(
+                            robot_task_code, bin_location, bin_deadline)
+                    capture_dir = project_root / "capture_img" / task_no / bin_location
+                    if not capture_result or not capture_result.get("success"):
+                        # 重启后重新下发的储位：检查点里帧未变的抓图直接沿用，不再跑抓图脚本
+                        loop = asyncio.get_running_loop()
+                        reused = await loop.run_in_executor(None, bin_checkpoint.reusable_capture, capture_dir)
+                        if reused is not None:
+                            bin_graph.clear_manifest(capture_dir)
+                            capture_result = reused
+                        else:
+                            capture_result = await _capture_with_early_push(task_no, bin_location, bin_deadline)
+                            early_pushed = capture_result.get("early_pushed", False)
+                    if capture_result.get("success") and not capture_result.get("partial"):
+                        # 哈希各帧要读文件，放线程池
+                        await asyncio.get_running_loop().run_in_executor(
+                            None, _commit_capture, capture_dir, capture_result)
                     logger.info(f"拍照完成: bin={bin_location}, result={capture_result.get('success')}")
                 except Exception as e:
                     logger.error(f"拍照失败: bin={bin_location}, error={e}")
@@ -1670,7 +1855,7 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                 try:
                     from services.api.shared.config import CAMERA_TEST_DIR
                     if CAMERA_TEST_DIR:
-                        capture_result = await capture_images_with_scripts(task_no, bin_location)
+                        capture_result = await capture_images_with_scripts(task_no, bin_location, bin_deadline)
                         if capture_result.get("success"):
                             logger.info(f"模拟模式拍照完成: {bin_location}")
                         else:
@@ -1680,8 +1865,10 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                 except Exception as e:
                     logger.error(f"模拟模式拍照异常: {bin_location}, error={e}")
 
-            # 推 Redis 触发 worker 检测（提前推，不等 continue）
-            push_single_bin_task(task_no, bin_location)
+            # 推 Redis 触发 worker 检测（提前推，不等 continue），截止时间随任务下发；
+            # 脚本抓图时 3D 帧一到已经推过
+            if not early_pushed:
+                push_single_bin_task(task_no, bin_location, expires_at=bin_deadline.expires_at)
 
             add_to_completed_set(task_no, "rcs_completed", bin_location)
             update_progress(task_no, i + 1)
@@ -1699,6 +1886,8 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                 next_rt_code = submit_result.get("robotTaskCode", "")
                 pending_next_bin = next_bin
                 pending_next_rt_code = next_rt_code
+                if not is_sim and arrival_capture.get_service() is not None:
+                    arrival_capture.get_service().arm(next_rt_code, task_no, next_bin)
                 logger.info(f"提前下发下一个库位: {next_bin}, rt_code={next_rt_code}，AMR 可在检测期间移动")
                 _active_bin_tracker[task_no] = {"bin_to_task_code": {next_bin: next_rt_code}}
                 from services.api.robot.router import prune_robot_status_queue
@@ -1721,6 +1910,7 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                         logger.error(f"发送 continue 失败: bin={_prev_bin_location}, rt_code={_prev_robot_code}, error={e}")
                 break  # 最后一个库位处理完毕，退出主循环
 
+        _active_bin_deadlines.pop(task_no, None)
         logger.info(f"RCS END 全部处理完毕（{len(submitted_bins)}/{len(sorted_bins)}），等待 worker 检测结果...")
 
         worker_done_count = 0
@@ -1758,6 +1948,8 @@ async def execute_inventory_workflow(task_no: str, bin_locations: List[str], is_
                 "photoScan1Path": result_data.get("photoScan1Path", ""),
                 "photoScan2Path": result_data.get("photoScan2Path", ""),
                 "error": result_data.get("error"),
+                "reused": bool(result_data.get("reused")),
+                "reusedFrom": result_data.get("reusedFrom"),
                 "specName": inventory_item.get("productName", "") if inventory_item else "",
                 "systemQuantity": system_qty,
                 "difference": actual_qty - system_qty,
@@ -80,7 +80,11 @@ def clear_task(task_no: str):
 
 
 def on_server_startup():
-    """Gateway 启动时自动调用：清空所有未完成任务，让系统处于干净状态"""
+    """Gateway 启动时自动调用：清空所有未完成任务，让系统处于干净状态。
+
+    储位检查点（capture_img/<任务号>/<储位>/checkpoint.log）不清：任务重新下发时帧未变的抓图直接沿用，
+    worker 也会续做重启前在途的储位（见 services/api/shared/bin_checkpoint.py）
+    """
     data = _load()
     if not data:
         return
@@ -5,18 +5,18 @@ import json
 import time
 import asyncio
 import logging
-from collections import deque
 from typing import Dict, Any, Optional
 from fastapi import APIRouter, Request, HTTPException
 from services.api.shared.config import debug_logger
 
 from services.api.shared.config import logger, rcs_logger
+from services.api.robot.status_bus import RobotStatusBus, event_keys, wait_keys
 
 router = APIRouter(prefix="/api/robot", tags=["robot"])
 
-# 机器人状态队列（deque，支持多 END 并发到达不丢失）
-_robot_status_queue: deque = deque()
-_status_event = asyncio.Event()
+# 机器人状态事件总线（按 robotTaskCode + method 分键，多 END 并发到达不丢失，
+# 每个等待者只被自己的 END 唤醒）
+_status_bus = RobotStatusBus()
 
 # Sim 模式：binCode → robotTaskCode 映射（START 回调时建立，END 时查表）
 _bin_to_robot_code: Dict[str, str] = {}
@@ -66,45 +66,51 @@ def inject_cancel_end(bin_location: str, robot_task_code: str, task_no: str):
         "binCode": bin_location,
         "task_no": task_no,
     }
-    _robot_status_queue.append(store)
-    _status_event.set()
-    logger.info(f"[取消] 注入假 END，唤醒 wait: bin={bin_location}, rt_code={robot_task_code}, 队列长度: {len(_robot_status_queue)}")
+    _status_bus.publish(store, event_keys("end", robot_task_code, task_no))
+    logger.info(f"[取消] 注入假 END，唤醒 wait: bin={bin_location}, rt_code={robot_task_code}, 积压: {_status_bus.pending()}")
 
 
 def clear_robot_status_queue():
     """清空状态队列（模拟模式循环开始时调用，防止旧状态残留）
-    如果队列已有 END 则不清，避免丢失已到达的 END
+    已到达的 END 不清，避免丢失；总线按键投递，旧状态不会误唤醒，无需清理，保留接口兼容
     """
-    if not _robot_status_queue:
-        _robot_status_queue.clear()
-        _status_event.clear()
 
 
 def prune_robot_status_queue(valid_robot_codes: set):
-    """从队列中移除不属于当前任务的旧 END 回调，释放内存。
+    """从总线上移除不属于当前任务的旧回调（按 robotTaskCode 键整键丢弃），释放内存。
 
     Args:
         valid_robot_codes: 当前任务有效的 robotTaskCode 集合。
     """
-    original_len = len(_robot_status_queue)
-    new_queue = deque(item for item in _robot_status_queue
-                      if item.get("method") != "end"
-                      or not item.get("robotTaskCode")
-                      or item.get("robotTaskCode") in valid_robot_codes)
-    _robot_status_queue.clear()
-    _robot_status_queue.extend(new_queue)
-    pruned = original_len - len(_robot_status_queue)
+    pruned = 0
+    for key in _status_bus.pending_keys():
+        code = key.rpartition("|")[0]
+        if not code or code == "*" or code.startswith("task:") or code in valid_robot_codes:
+            continue
+        pruned += _status_bus.discard(key)
     if pruned > 0:
-        logger.info(f"清理旧 END 回调 {pruned} 条，队列剩余 {len(_robot_status_queue)} 条")
+        logger.info(f"清理旧回调 {pruned} 条，积压剩余 {_status_bus.pending()} 条")
+
+
+def take_robot_status(expected_method: str, robot_task_code: str) -> Optional[Dict]:
+    """不等待，取走总线上某个 robotTaskCode 已到达的状态（超时后补查用），没有返回 None"""
+    hit = _status_bus.take([f"{robot_task_code}|{expected_method}"])
+    return hit[0] if hit else None
 
 
 async def update_robot_status(method: str, data: Optional[Dict] = None, robot_task_code: str = ""):
-    """更新机器人状态。END 入队并触发事件；OUTBIN 只入队不触发事件。
+    """更新机器人状态：按 robotTaskCode、task_no 分键发布到事件总线，只唤醒对应的等待者。
 
     原因：Real RCS 只发 END；Sim RCS 先发 OUTBIN（不触发）再等 continue 才发 END（触发）。
     """
     if method not in ("end", "outbin"):
         return
+    # 到位即抓图：先把到达报文发给 cam_sys，抓图与下面的入队、工作流唤醒并行
+    if method == "end":
+        from services.api.inventory.arrival_capture import get_service
+        capture = get_service()
+        if capture is not None:
+            capture.notify_arrival(robot_task_code)
     store = {
         "method": method,
         "timestamp": time.time(),
@@ -120,23 +126,21 @@ async def update_robot_status(method: str, data: Optional[Dict] = None, robot_ta
     task_no = _robot_code_to_task.get(robot_task_code, "")
     if task_no:
         store["task_no"] = task_no
-    # END 入队并触发事件，让 gateway 能及时响应；OUTBIN 只入队不触发事件
+    # END 和 OUTBIN 分键发布：gateway 只等 END，OUTBIN 不会唤醒它
     # 原因：Real RCS 只发 END；Sim RCS 先发 OUTBIN（不触发）再等 continue 才发 END（触发）
-    _robot_status_queue.append(store)
-    logger.info(f"更新机器人状态: {method}，队列长度: {len(_robot_status_queue)}")
-    if method == "end":
-        _status_event.set()
+    _status_bus.publish(store, event_keys(method, robot_task_code, task_no))
+    logger.info(f"更新机器人状态: {method}，积压: {_status_bus.pending()}")
 
 
 async def wait_for_robot_status(expected_method: str, timeout: int = 300, valid_robot_codes: set = None, task_no: str = "", start_time: float = None):
-    """等待特定机器人状态，从队列中弹出匹配的条目。
+    """等待特定机器人状态，从总线上取走匹配的条目。
 
     Args:
         expected_method: 期望的方法名（如 "end"）
         timeout: 超时时间（秒）
         valid_robot_codes: 当前任务有效的 robotTaskCode 集合。
-                         若传入，队列中 robotTaskCode 不在集合内的 END 会被跳过（保留在队列中）。
-        task_no: 当前任务号。END 必须匹配此 task_no 才消费，不匹配则保留在队列中供其他 workflow 使用。
+                         若传入，robotTaskCode 不在集合内的 END 不会投递给本次等待（保留在总线上）。
+        task_no: 当前任务号。END 必须匹配此 task_no 才消费，不匹配则保留在总线上供其他 workflow 使用。
         start_time: 已累计的等待开始时间戳（由外部传入，避免重复计时）
     """
     if start_time is None:
@@ -144,58 +148,18 @@ async def wait_for_robot_status(expected_method: str, timeout: int = 300, valid_
     logger.info(f"[DEBUG router.wait_for_robot_status] expected={expected_method}, timeout={timeout}, task_no={task_no}")
     logger.debug(f"开始等待机器人状态: {expected_method}, 超时: {timeout}秒, task_no={task_no}")
 
-    while True:
-        # 先从队列中查找匹配的 END（防止已有 END 在队列中等待）
-        for j in range(len(_robot_status_queue) - 1, -1, -1):
-            item = _robot_status_queue[j]
-            if item.get("method") != expected_method:
-                continue
-            # 按 task_no 过滤：不属于当前任务的 END 保留在队列中，不消费
-            # task_no 不匹配时直接跳过，不检查 valid_robot_codes
-            if task_no:
-                item_task_no = item.get("task_no", "")
-                if item_task_no and item_task_no != task_no:
-                    logger.debug(f"跳过队列中的非本任务 END (task_no={item_task_no}, binCode={item.get('binCode', '')}), 保留在队列")
-                    continue
-            # task_no 匹配（或未提供），才按 robotTaskCode 过滤（兼容旧逻辑）
-            if valid_robot_codes is not None:
-                item_code = item.get("robotTaskCode", "")
-                if item_code and item_code not in valid_robot_codes:
-                    debug_logger.debug(f"[RCS回调] END的robotTaskCode不匹配！期望={valid_robot_codes}，实际={item_code}，slotName={item.get('binCode', '')}，保留在队列等待")
-                    continue
-            # 命中，弹出并返回
-            del _robot_status_queue[j]
-            logger.info(f"从队列中取出期望状态: {expected_method}，binCode={item.get('binCode', '')}，task_no={item.get('task_no', '')}，剩余: {len(_robot_status_queue)}")
-            # 队列非空时不清除事件，让下一轮立即处理剩余 END
-            if not _robot_status_queue:
-                _status_event.clear()
-            return item
-
-        elapsed = time.time() - start_time
-        remaining = timeout - elapsed
-        if remaining <= 0:
-            raise asyncio.TimeoutError(f"等待 {expected_method} 状态超时")
-
-        try:
-            # 等待剩余全部时间（不再固定 1 秒），避免长处理期间漏掉回调
-            await asyncio.wait_for(_status_event.wait(), timeout=remaining)
-        except asyncio.TimeoutError:
-            # 只有队列空时才清除事件，防止已到达的回调被漏掉
-            if not _robot_status_queue:
-                _status_event.clear()
-            elapsed = time.time() - start_time
-            if elapsed >= timeout:
-                raise asyncio.TimeoutError(f"等待 {expected_method} 状态超时")
-            # 正常轮询超时（sim 模式下 RCS 移动需要 15 秒），不打印日志直接继续
-            continue
-            # 只有队列空时才清除事件，防止已到达的回调被漏掉
-            if not _robot_status_queue:
-                _status_event.clear()
-            elapsed = time.time() - start_time
-            if elapsed >= timeout:
-                raise asyncio.TimeoutError(f"等待 {expected_method} 状态超时")
-            continue
-
+    remaining = timeout - (time.time() - start_time)
+    if remaining <= 0:
+        raise asyncio.TimeoutError(f"等待 {expected_method} 状态超时")
+    keys = wait_keys(expected_method, valid_robot_codes, task_no)
+    try:
+        # 等待剩余全部时间，期间其他 robotTaskCode 的回调不会唤醒本协程
+        item, published_us = await _status_bus.wait(keys, remaining)
+    except asyncio.TimeoutError:
+        raise asyncio.TimeoutError(f"等待 {expected_method} 状态超时")
+    latency_ms = (_status_bus.now_micros() - published_us) / 1000.0
+    logger.info(f"从总线取出期望状态: {expected_method}，binCode={item.get('binCode', '')}，task_no={item.get('task_no', '')}，投递延迟: {latency_ms:.1f}ms，积压: {_status_bus.pending()}")
+    return item
 
 
 @router.post("/reporter/task")
@@ -0,0 +1,255 @@
+"""
+机器人状态事件总线：按 robotTaskCode + method 分键投递，等待者只在自己的 END 到达时被唤醒
+
+每条状态以三个键发布："<robotTaskCode>|<method>"、"task:<任务号>|<method>"、"*|<method>"
+（缺失的部分留空）。等待者按过滤条件登记键，投递由 hardware/cam_sys 编译出的
+camera_api.EventBus 完成，publish/wait 只看对应键的队首，与积压条数无关；
+结果通过 eventfd + loop.add_reader 送回事件循环。camera_api 不可用时退回纯 Python 实现
+"""
+import asyncio
+import json
+import time
+from collections import OrderedDict, deque
+from typing import Dict, Iterable, List, Optional, Tuple
+
+from services.api.shared.native import load_camera_api
+
+
+def _load_camera_api():
+    return load_camera_api("EventBus", "状态事件总线使用 Python 实现")
+
+
+def event_keys(method: str, robot_code: str = "", task_no: str = "") -> List[str]:
+    """一条状态发布到的键，按投递优先级排列"""
+    return [f"{robot_code}|{method}", f"task:{task_no}|{method}", f"*|{method}"]
+
+
+def wait_keys(method: str, valid_robot_codes: Optional[Iterable[str]] = None,
+              task_no: str = "") -> List[str]:
+    """等待者登记的键，与旧队列扫描的过滤条件一致：
+
+    - 给了 valid_robot_codes：只收这些 robotTaskCode 的状态，以及没带 robotTaskCode 的状态
+      （robotTaskCode 每次下发唯一，不再额外核对 task_no）
+    - 只给了 task_no：收该任务的状态，以及查不到任务号的状态
+    - 都没给：收任意状态
+    """
+    if valid_robot_codes is not None:
+        return [f"{code}|{method}" for code in sorted(valid_robot_codes)] + [f"|{method}"]
+    if task_no:
+        return [f"task:{task_no}|{method}", f"task:|{method}"]
+    return [f"*|{method}"]
+
+
+class _PyStatusBus:
+    """camera_api.EventBus 的纯 Python 版本，接口相同；没有 eventfd，fd() 为 -1"""
+
+    def __init__(self, capacity: int = 4096):
+        self._capacity = max(1, capacity)
+        self._next_waiter = 0
+        self._next_event = 0
+        self._events: "OrderedDict[int, Tuple[List[str], str, int]]" = OrderedDict()
+        self._pending: Dict[str, deque] = {}
+        self._waiting: Dict[str, deque] = {}
+        self._waiter_keys: Dict[int, List[str]] = {}
+        self._ready: list = []
+
+    @staticmethod
+    def nowMicros() -> int:
+        return int(time.monotonic() * 1e6)
+
+    def fd(self) -> int:
+        return -1
+
+    def _remove_event(self, event_id: int):
+        event = self._events.pop(event_id, None)
+        if event is None:
+            return
+        for key in event[0]:
+            q = self._pending.get(key)
+            if q is not None:
+                q.remove(event_id)
+                if not q:
+                    del self._pending[key]
+
+    def _deliver(self, waiter: int, key: str, payload: str, ts: int):
+        for k in self._waiter_keys.pop(waiter, []):
+            q = self._waiting.get(k)
+            if q is not None:
+                q.remove(waiter)
+                if not q:
+                    del self._waiting[k]
+        self._ready.append((waiter, key, payload, ts))
+
+    def publish(self, keys: List[str], payload: str):
+        if not keys:
+            return
+        ts = self.nowMicros()
+        for key in keys:
+            q = self._waiting.get(key)
+            if q:
+                self._deliver(q[0], key, payload, ts)
+                return
+        if len(self._events) >= self._capacity:
+            self._remove_event(next(iter(self._events)))
+        self._next_event += 1
+        self._events[self._next_event] = (list(keys), payload, ts)
+        for key in keys:
+            self._pending.setdefault(key, deque()).append(self._next_event)
+
+    def wait(self, keys: List[str]) -> int:
+        self._next_waiter += 1
+        waiter = self._next_waiter
+        for key in keys:
+            q = self._pending.get(key)
+            if q:
+                _, payload, ts = self._events[q[0]]
+                self._remove_event(q[0])
+                self._ready.append((waiter, key, payload, ts))
+                return waiter
+        self._waiter_keys[waiter] = list(keys)
+        for key in keys:
+            self._waiting.setdefault(key, deque()).append(waiter)
+        return waiter
+
+    def cancel(self, waiter: int) -> bool:
+        if waiter not in self._waiter_keys:
+            return False
+        for k in self._waiter_keys.pop(waiter):
+            q = self._waiting.get(k)
+            if q is not None:
+                q.remove(waiter)
+                if not q:
+                    del self._waiting[k]
+        return True
+
+    def drain(self) -> list:
+        ready, self._ready = self._ready, []
+        return ready
+
+    def take(self, keys: List[str]):
+        for key in keys:
+            q = self._pending.get(key)
+            if q:
+                _, payload, ts = self._events[q[0]]
+                self._remove_event(q[0])
+                return key, payload, ts
+        return None
+
+    def discard(self, key: str) -> int:
+        ids = list(self._pending.get(key, ()))
+        for event_id in ids:
+            self._remove_event(event_id)
+        return len(ids)
+
+    def pendingKeys(self) -> List[str]:
+        return sorted(self._pending)
+
+    def pending(self) -> int:
+        return len(self._events)
+
+    def waiters(self) -> int:
+        return len(self._waiter_keys)
+
+
+class RobotStatusBus:
+    """事件总线的 asyncio 封装。状态以 dict 发布，wait 返回 (dict, 发布时刻 monotonic 微秒)"""
+
+    def __init__(self, capacity: int = 4096, bus=None):
+        """bus 不为空时封装已有的 camera_api.EventBus（如 ArrivalTrigger.results()）"""
+        if bus is None:
+            api = _load_camera_api()
+            bus = api.EventBus(capacity) if api is not None else _PyStatusBus(capacity)
+        self._bus = bus
+        self._loop: Optional[asyncio.AbstractEventLoop] = None
+        self._futures: Dict[int, asyncio.Future] = {}
+        # 已投递、但等待者已超时/取消的结果，等 wait 收尾时取回
+        self._orphans: Dict[int, Tuple[str, str, int]] = {}
+
+    def _attach(self):
+        """首次 wait 时把 eventfd 挂到当前事件循环"""
+        loop = asyncio.get_running_loop()
+        if self._loop is loop:
+            return
+        fd = self._bus.fd()
+        if self._loop is not None and fd >= 0 and not self._loop.is_closed():
+            self._loop.remove_reader(fd)
+        self._loop = loop
+        if fd >= 0:
+            loop.add_reader(fd, self._on_ready)
+
+    def close(self):
+        """从事件循环上摘下 eventfd（底层总线销毁前调用，须在事件循环线程里）"""
+        fd = self._bus.fd()
+        if self._loop is not None and fd >= 0 and not self._loop.is_closed():
+            self._loop.remove_reader(fd)
+        self._loop = None
+
+    def _kick(self):
+        """没有 eventfd 时手动安排一次 drain"""
+        if self._bus.fd() < 0 and self._loop is not None and not self._loop.is_closed():
+            self._loop.call_soon_threadsafe(self._on_ready)
+
+    def _on_ready(self):
+        for waiter, key, payload, ts in self._bus.drain():
+            fut = self._futures.pop(waiter, None)
+            if fut is None or fut.done():
+                self._orphans[waiter] = (key, payload, ts)
+            else:
+                fut.set_result((key, payload, ts))
+
+    def _reclaim(self, waiter: int) -> Optional[Tuple[str, str, int]]:
+        """撤销等待；撤销时已投递（与超时擦肩而过）则取回该结果"""
+        self._futures.pop(waiter, None)
+        if self._bus.cancel(waiter):
+            return None
+        self._on_ready()
+        return self._orphans.pop(waiter, None)
+
+    def publish(self, store: Dict, keys: List[str]):
+        self._bus.publish(keys, json.dumps(store, ensure_ascii=False))
+        self._kick()
+
+    async def wait(self, keys: List[str], timeout: float) -> Tuple[Dict, int]:
+        """等待 keys 上的下一条状态，超时抛 asyncio.TimeoutError"""
+        self._attach()
+        fut = self._loop.create_future()
+        waiter = self._bus.wait(keys)
+        self._futures[waiter] = fut
+        self._kick()
+        try:
+            key, payload, ts = await asyncio.wait_for(fut, timeout=max(0.0, timeout))
+        except asyncio.TimeoutError:
+            hit = self._reclaim(waiter)
+            if hit is None:
+                raise
+            key, payload, ts = hit
+        except asyncio.CancelledError:
+            # 等待方被取消：已投递的状态按发布时的全部键放回，按任务号或通配等待的也能收到
+            hit = self._reclaim(waiter)
+            if hit is not None:
+                store = json.loads(hit[1])
+                keys = event_keys(store.get("method", ""), store.get("robotTaskCode", ""),
+                                  store.get("task_no", ""))
+                self._bus.publish(keys, hit[1])
+                self._kick()
+            raise
+        return json.loads(payload), ts
+
+    def take(self, keys: List[str]) -> Optional[Tuple[Dict, int]]:
+        """不等待，直接取走 keys 上最早的积压状态"""
+        hit = self._bus.take(keys)
+        if hit is None:
+            return None
+        return json.loads(hit[1]), hit[2]
+
+    def discard(self, key: str) -> int:
+        return self._bus.discard(key)
+
+    def pending_keys(self) -> List[str]:
+        return list(self._bus.pendingKeys())
+
+    def pending(self) -> int:
+        return self._bus.pending()
+
+    def now_micros(self) -> int:
+        return self._bus.nowMicros()
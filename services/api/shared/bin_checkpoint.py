@@ -0,0 +1,204 @@
+"""
+单储位检查点（见 hardware/cam_sys/src/CheckpointStore.h）
+
+每个储位目录（capture_img/<任务号>/<储位>）下有一份只追加的 checkpoint.log，记录已完成的阶段、
+阶段结果（JSON）和产物的内容哈希：
+
+    capture    gateway 抓图完成：3D 主图、depth.jpg、扫码图
+    scene      YOLO 检测、深度矩阵、分层（checkpoint/scene.pkl 及其引用的深度矩阵缓存、旋转图）
+    barcode_1/2 各扫码相机的条码解析结果
+    count      按某个垛型的计数
+    result     worker 的最终结果
+
+阶段只有在产物内容与提交时一致时才算完成，产物被重拍、改写或截断就从该阶段重算。
+worker 把取到的储位记入 output/worker_inflight.json，推完结果再移除；进程崩溃或凌晨重启后，
+启动时按登记续做，已完成的阶段直接读检查点，只补缺失的部分。
+camera_api 没有 CheckpointStore 或 checkpoint.enabled 为 false 时不记录，行为与原来相同
+"""
+import json
+import os
+import pickle
+import time
+from pathlib import Path
+from typing import Any, Dict, List, Optional
+
+from services.api.shared.config import logger, project_root, CHECKPOINT
+from services.api.shared.native import load_camera_api
+
+INFLIGHT_FILE = project_root / "output" / "worker_inflight.json"
+
+# 阶段产物（pickle 等）放在储位目录下的子目录
+ARTIFACT_DIR = "checkpoint"
+
+STAGE_CAPTURE = "capture"
+STAGE_SCENE = "scene"
+STAGE_COUNT = "count"
+STAGE_RESULT = "result"
+
+# 抓图产物：3D 相机只取原始帧（检测会在同目录写 main_rotated/depth_color），扫码相机取全部图片
+_FRAME_DIRS = ["3d_camera", "scan_camera_1", "scan_camera_2"]
+_IMAGE_EXTENSIONS = ['.jpg', '.jpeg', '.png', '.bmp']
+
+
+def _load_camera_api():
+    return load_camera_api("CheckpointStore", "不记录检查点")
+
+
+def open_store(bin_dir: Path):
+    """储位检查点；未启用或 camera_api 不可用时返回 None（以下函数都接受 None）"""
+    if not CHECKPOINT.get("enabled", True):
+        return None
+    api = _load_camera_api()
+    if api is None:
+        return None
+    return api.CheckpointStore(str(bin_dir))
+
+
+def frame_artifacts(bin_dir: Path) -> List[str]:
+    """本储位已有的原始帧"""
+    artifacts = []
+    for cam in _FRAME_DIRS:
+        cam_dir = Path(bin_dir) / cam
+        if not cam_dir.is_dir():
+            continue
+        for f in sorted(cam_dir.iterdir()):
+            if not f.is_file() or f.suffix.lower() not in _IMAGE_EXTENSIONS:
+                continue
+            if cam == "3d_camera" and f.stem not in ("main", "depth", "raw", "image"):
+                continue
+            artifacts.append(str(f))
+    return artifacts
+
+
+def artifact_path(store, name: str) -> Path:
+    return Path(store.dir()) / ARTIFACT_DIR / name
+
+
+def commit(store, stage: str, artifacts: List[str], payload: Any) -> bool:
+    if store is None:
+        return False
+    ok = store.commit(stage, [str(a) for a in artifacts], json.dumps(payload, ensure_ascii=False, default=str))
+    if not ok:
+        logger.warning(f"[checkpoint] 阶段 {stage} 提交失败: {store.dir()}")
+    return ok
+
+
+def load(store, stage: str) -> Optional[Any]:
+    """阶段已完成（产物未变）时返回其结果，否则 None"""
+    if store is None or not store.has(stage) or not store.valid(stage):
+        return None
+    try:
+        return json.loads(store.payload(stage))
+    except ValueError:
+        return None
+
+
+def age_sec(store, stage: str) -> Optional[float]:
+    """阶段提交至今的秒数；没有记录时为 None"""
+    if store is None:
+        return None
+    for entry in store.entries():
+        if entry.stage == stage:
+            return time.time() - entry.time_us / 1e6
+    return None
+
+
+def save_pickle(store, name: str, obj: Any) -> Optional[Path]:
+    """写 checkpoint/<name>，先写临时文件再替换，返回路径（失败为 None）"""
+    path = artifact_path(store, name)
+    try:
+        path.parent.mkdir(parents=True, exist_ok=True)
+        tmp = path.with_name(f".{name}.tmp")
+        with open(tmp, "wb") as f:
+            pickle.dump(obj, f, protocol=pickle.HIGHEST_PROTOCOL)
+        os.replace(tmp, path)
+        return path
+    except (OSError, pickle.PicklingError) as e:
+        logger.warning(f"[checkpoint] 保存 {path} 失败: {e}")
+        return None
+
+
+def load_pickle(store, name: str) -> Any:
+    """读 checkpoint/<name>；调用方须先确认对应阶段 valid（内容哈希已核对）"""
+    with open(artifact_path(store, name), "rb") as f:
+        return pickle.load(f)
+
+
+def reusable_capture(bin_dir: Path) -> Optional[Dict[str, Any]]:
+    """重新下发同一储位时，capture_reuse_sec 以内且帧未变的抓图结果直接沿用"""
+    reuse_sec = CHECKPOINT.get("capture_reuse_sec", 1800)
+    if reuse_sec <= 0:
+        return None
+    store = open_store(bin_dir)
+    age = age_sec(store, STAGE_CAPTURE)
+    if age is None or age > reuse_sec:
+        return None
+    result = load(store, STAGE_CAPTURE)
+    if result is not None:
+        logger.info(f"[checkpoint] 沿用 {age:.0f}s 前的抓图: {bin_dir}")
+    return result
+
+
+# ==================== worker 在途储位 ====================
+
+def _load_inflight() -> dict:
+    INFLIGHT_FILE.parent.mkdir(parents=True, exist_ok=True)
+    if INFLIGHT_FILE.exists():
+        try:
+            with open(INFLIGHT_FILE, "r", encoding="utf-8") as f:
+                return json.load(f)
+        except (json.JSONDecodeError, IOError) as e:
+            logger.warning(f"加载 worker_inflight.json 失败: {e}")
+    return {}
+
+
+def _save_inflight(data: dict):
+    INFLIGHT_FILE.parent.mkdir(parents=True, exist_ok=True)
+    try:
+        tmp = INFLIGHT_FILE.with_name(f".{INFLIGHT_FILE.name}.tmp")
+        with open(tmp, "w", encoding="utf-8") as f:
+            json.dump(data, f, ensure_ascii=False, indent=2)
+        os.replace(tmp, INFLIGHT_FILE)
+    except IOError as e:
+        logger.error(f"保存 worker_inflight.json 失败: {e}")
+
+
+def mark_inflight(task_no: str, bin_location: str, task: Dict[str, Any]):
+    """worker 取到储位时登记（task 为 Redis 里的原始消息）"""
+    data = _load_inflight()
+    data[f"{task_no}/{bin_location}"] = {"task": task, "received_at": time.time()}
+    _save_inflight(data)
+
+
+def clear_inflight(task_no: str, bin_location: str):
+    """结果已推回 gateway 后移除"""
+    data = _load_inflight()
+    if data.pop(f"{task_no}/{bin_location}", None) is not None:
+        _save_inflight(data)
+
+
+# 续做过仍没做完（续做时又崩溃）的储位不再续做，避免坏数据让 worker 反复重启
+_MAX_RESUMES = 1
+
+
+def get_inflight() -> List[Dict[str, Any]]:
+    """worker 启动时取上次未完成的储位（按取到的先后），其余等推完结果再由 clear_inflight 移除。
+    过期的、已续做过一次的直接移除"""
+    data = _load_inflight()
+    if not data:
+        return []
+    max_age = CHECKPOINT.get("inflight_max_age_hours", 24) * 3600
+    now = time.time()
+    pending = []
+    dropped = []
+    for key, info in sorted(data.items(), key=lambda kv: kv[1].get("received_at", 0)):
+        if now - info.get("received_at", 0) > max_age or info.get("resumes", 0) >= _MAX_RESUMES:
+            dropped.append(key)
+            del data[key]
+            continue
+        info["resumes"] = info.get("resumes", 0) + 1
+        pending.append(info["task"])
+    if dropped:
+        logger.info(f"[checkpoint] 在途储位已过期或续做失败，不再续做: {dropped}")
+    _save_inflight(data)
+    return pending
@@ -134,6 +134,63 @@ WITH_CAMERA = _config.get("with_camera", False)
 #       scan_camera_1/main.jpg, scan_camera_2/main.jpg
 CAMERA_TEST_DIR = _config.get("camera_test_dir", "")
 
+# 每个储位从 RCS END 到达起的处理时间预算（秒），覆盖抓图、条码、检测全流程
+# 预算耗尽后各阶段立即放弃该储位（见 services/api/shared/deadline.py）
+BIN_BUDGET_SEC = _config.get("bin_budget_sec", 180)
+
+# 抓图期间的 Web 实时预览（MJPEG，端口为 ports.camsys）：抓图脚本在自己的码流上开预览服务，
+# 浏览器 <img src="http://<host>:<camsys>/stream/3d_camera"> 即可查看，无人观看时不编码。
+# 预览没有鉴权且允许跨域，默认关闭；开启后只监听 preview_bind（默认本机），其他机器要看须显式配置地址
+ENABLE_PREVIEW = _config.get("enable_preview", False)
+PREVIEW_BIND = _config.get("preview_bind", "127.0.0.1")
+
+# 按 ROI 抓图：{"3d_camera": [[x, y, w, h], ...], ...}（原图像素坐标），未配置的相机照常整幅抓图。
+# capture_roi_mode 为 smooth（ROI 外抹平，文件和坐标不变）或 crop（ROI 裁图 + 全景缩略图）
+CAPTURE_ROIS = _config.get("capture_rois", {})
+CAPTURE_ROI_MODE = _config.get("capture_roi_mode", "smooth")
+
+# 复盘时画面未变化的储位沿用上次结果（见 services/api/inventory/bin_fingerprint.py）：
+# 各相机感知哈希的汉明距离（0~64）都不超过 phash_max_distance 时跳过检测和条码识别
+REUSE_UNCHANGED_BINS = _config.get("reuse_unchanged_bins", False)
+PHASH_MAX_DISTANCE = _config.get("phash_max_distance", 4)
+
+# 条码分块检测（见 core/vision/tiling.py）：扫码原图按模型输入尺寸切成重叠块检测，远处小标签不再被缩没。
+# 键：enabled / tile_size / overlap / min_stddev（无纹理块跳过阈值）/ batch_size，缺省项用 BarcodeRecognizer.DEFAULT_TILING
+BARCODE_TILING = _config.get("barcode_tiling", {})
+
+# 到位即抓图（见 services/api/inventory/arrival_capture.py）：gateway 常驻登录、开流各相机，RCS END 到达时
+# 经本机 socket 直接触发 cam_sys 同步抓图，不再启动抓图脚本。键：enabled / socket / tolerance_ms / timeout_ms /
+# max_age_ms / cameras（[{camera_type, address, port, user, password, channel, stream_type}]，缺省同抓图脚本）
+ARRIVAL_CAPTURE = _config.get("arrival_capture", {})
+
+# 单储位作业图（见 services/api/inventory/bin_graph.py）：3D 帧到达即开始检测，扫码帧到一台解一台，
+# 计数先按默认垛型出暂定结果，条码解析出垛型后重算。键：enabled / input_wait_sec（没有储位预算时等扫码帧的上限）
+BIN_GRAPH = _config.get("bin_graph", {})
+
+# 单储位检查点（见 services/api/shared/bin_checkpoint.py）：各阶段完成后记录产物的内容哈希，worker 重启后从第一个未完成的阶段继续。
+# 键：enabled / resume_on_start（worker 启动时续做在途储位）/ capture_reuse_sec（重新下发时沿用多久以内的抓图，0 不沿用）/
+# inflight_max_age_hours（超过该时长的在途储位不再续做）
+CHECKPOINT = _config.get("checkpoint", {})
+
+# 进程内存预算（见 services/api/shared/memory_governor.py）：各子系统登记用量，RSS 接近上限时按优先级收缩缓存、推迟批量工作。
+# 键：enabled / limits_mb（按进程角色 gateway、worker）/ soft_ratio、hard_ratio（开始收缩、推迟批量工作的比例）/
+# min_available_mb（系统可用内存低于该值同样算作有压力）/ sample_ms / model_cache（worker 跨储位复用 YOLO 模型）/
+# scene_reserve_mb（场景分析开始前预留的内存）
+MEMORY = _config.get("memory", {})
+
+# 进程内抓图流程（见 services/api/inventory/capture_flows.py）：各相机的登录、开流、取帧、编码、落盘在 cam_sys 的
+# CaptureLoop 上并发推进，不再逐台启动抓图脚本；失败的相机仍由脚本重试。键：enabled / threads / workers /
+# login_timeout_ms / ready_timeout_ms / grab_timeout_ms / write_timeout_ms / settle_ms / cameras（缺省同 arrival_capture）
+CAPTURE_LOOP = _config.get("capture_loop", {})
+
+# worker → gateway 结果在 Redis 里的格式："binary"（result_record 二进制记录）或 "json"（旧格式，回退用）；
+# 读取两种都认
+RESULT_FORMAT = _config.get("result_format", "binary")
+
+# 历史抓图批量重识别（services/worker/redetect.py）：processes 为 0 时每个 CPU 核一个进程，
+# 各进程 decode_threads 个解码线程、最多预取 prefetch 张图，batch 张一批送 YOLO
+REDETECT = _config.get("redetect", {})
+
 # 检测调试配置（从 JSON 文件读取）
 ENABLE_DEBUG = _config.get("enable_debug", False)
 ENABLE_VISUALIZATION = _config.get("enable_visualization", False)
@@ -0,0 +1,111 @@
+"""
+储位时间预算（截止时间/取消）
+
+gateway 在 RCS END 到达后为每个储位创建一个 Deadline，依次传给抓图、条码、检测各阶段：
+- 抓图脚本：以 --deadline-ms 传入剩余预算（不限制时不传），C++ 侧用 camera_api.CancelToken 在重试循环中检查；
+  cancel() 时 gateway 直接结束脚本进程
+- worker：以 expires_at（墙钟时间戳）随 Redis 任务下发，worker 据此重建 Deadline，
+  并经 cancel_probe 轮询 gateway 发布的储位取消标记
+- 各阶段边界调用 check()，预算耗尽或取消后立即放弃该储位，不再占用 CPU 和相机
+"""
+import asyncio
+import threading
+import time
+from typing import Callable, List, Optional
+
+# cancel_probe 的最小间隔（秒），阶段边界频繁检查时不必每次都查 Redis
+_PROBE_INTERVAL = 0.5
+
+
+class DeadlineExceeded(Exception):
+    """储位时间预算耗尽或被取消"""
+
+    def __init__(self, stage: str):
+        super().__init__(f"{stage}: 储位时间预算已耗尽")
+        self.stage = stage
+
+
+class Deadline:
+    """基于墙钟时间的截止时间，便于跨进程（gateway → 抓图脚本 / worker）传递"""
+
+    def __init__(self, budget_sec: Optional[float] = None, expires_at: Optional[float] = None,
+                 cancel_probe: Optional[Callable[[], bool]] = None):
+        if expires_at is None and budget_sec is not None:
+            expires_at = time.time() + budget_sec
+        self.expires_at = expires_at  # None 表示不限制
+        self._cancelled = False
+        self._cancel_probe = cancel_probe  # 返回 True 表示已被其他进程取消
+        self._next_probe = 0.0
+        self._callbacks: List[Callable[[], None]] = []
+        self._lock = threading.Lock()
+
+    @classmethod
+    def from_payload(cls, expires_at: Optional[float],
+                     cancel_probe: Optional[Callable[[], bool]] = None) -> "Deadline":
+        return cls(expires_at=expires_at, cancel_probe=cancel_probe)
+
+    def cancel(self):
+        with self._lock:
+            if self._cancelled:
+                return
+            self._cancelled = True
+            callbacks, self._callbacks = self._callbacks, []
+        for fn in callbacks:
+            fn()
+
+    def on_cancel(self, fn: Callable[[], None]) -> Callable[[], None]:
+        """cancel() 时调用 fn（已取消则立即调用）；返回注销函数"""
+        with self._lock:
+            if not self._cancelled:
+                self._callbacks.append(fn)
+                return lambda: self._remove_callback(fn)
+        fn()
+        return lambda: None
+
+    def _remove_callback(self, fn: Callable[[], None]):
+        with self._lock:
+            if fn in self._callbacks:
+                self._callbacks.remove(fn)
+
+    @property
+    def cancelled(self) -> bool:
+        if not self._cancelled and self._cancel_probe is not None:
+            now = time.monotonic()
+            if now >= self._next_probe:
+                self._next_probe = now + _PROBE_INTERVAL
+                if self._cancel_probe():
+                    self.cancel()
+        return self._cancelled
+
+    @property
+    def expired(self) -> bool:
+        if self.cancelled:
+            return True
+        return self.expires_at is not None and time.time() >= self.expires_at
+
+    def remaining(self) -> float:
+        """剩余秒数；不限制时返回 inf"""
+        if self.cancelled:
+            return 0.0
+        if self.expires_at is None:
+            return float("inf")
+        return max(0.0, self.expires_at - time.time())
+
+    def remaining_ms(self) -> Optional[int]:
+        """传给 C++ 的剩余毫秒数；不限制时返回 None（不传 --deadline-ms），耗尽或取消时返回 0"""
+        if self.expires_at is None and not self.cancelled:
+            return None
+        return int(self.remaining() * 1000)
+
+    def clamp(self, timeout: float) -> float:
+        """把阶段自身的超时限制在剩余预算内"""
+        return min(timeout, self.remaining())
+
+    def check(self, stage: str):
+        if self.expired:
+            raise DeadlineExceeded(stage)
+
+    async def sleep(self, seconds: float) -> bool:
+        """睡眠不超过剩余预算；返回 False 表示预算已耗尽"""
+        await asyncio.sleep(self.clamp(seconds))
+        return not self.expired
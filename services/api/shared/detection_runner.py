@@ -67,10 +67,23 @@ def _make_recognition_result(bin_location: str, capture_dir: Path, is_sim: bool)
     )
 
 
-async def run_detection(task_no: str, bin_location: str, is_sim: bool) -> Dict[str, Any]:
+def _abandoned(deadline, task_no: str, bin_location: str, result: Dict[str, Any]) -> bool:
+    """预算耗尽或被取消时把 result 填成异常并返回 True"""
+    if deadline is None or not deadline.expired:
+        return False
+    reason = "已取消" if deadline.cancelled else "时间预算耗尽"
+    logger.warning(f"[DetectionRunner] 储位{reason}，跳过检测: {task_no}/{bin_location}")
+    result["status"] = "异常"
+    result["error"] = f"检测{'取消' if deadline.cancelled else '超时'}（储位{reason}）"
+    result["actualQuantity"] = 0
+    return True
+
+
+async def run_detection(task_no: str, bin_location: str, is_sim: bool, deadline=None) -> Dict[str, Any]:
     """
     执行单个库位的检测：拍照 + 识别，返回原始结果 dict。
     供 worker 调用，结果写回 Redis 由 gateway 消费。
+    deadline: 储位时间预算（services.api.shared.deadline.Deadline），耗尽后不再开始新阶段
     """
     result = {
         "binLocation": bin_location,
@@ -88,6 +101,10 @@ async def run_detection(task_no: str, bin_location: str, is_sim: bool) -> Dict[s
 
     capture_dir = _project_root / "capture_img" / task_no / bin_location
 
+    # 排队期间预算已耗尽或储位已取消：gateway 已放弃该储位，不再占用 CPU
+    if _abandoned(deadline, task_no, bin_location, result):
+        return result
+
     # 1. 拍照
     logger.info(f"[DetectionRunner] 拍照: {task_no}/{bin_location}, is_sim={is_sim}")
     try:
@@ -108,25 +125,68 @@ async def run_detection(task_no: str, bin_location: str, is_sim: bool) -> Dict[s
         result["actualQuantity"] = 0
         return result
 
+    # 上次已出结果且帧未变（worker 重启后续做、重复推送）：直接返回
+    from services.api.shared import bin_checkpoint
+    store = bin_checkpoint.open_store(capture_dir)
+    cached = bin_checkpoint.load(store, bin_checkpoint.STAGE_RESULT)
+    if cached is not None:
+        logger.info(f"[DetectionRunner] 沿用检查点结果: {task_no}/{bin_location}, qty={cached.get('actualQuantity')}")
+        return cached
+
     # 设置图片路径
     result["photo3dPath"] = f"/{task_no}/{bin_location}/3d_camera/main.jpg"
     result["photoDepthPath"] = f"/{task_no}/{bin_location}/3d_camera/depth.jpg"
     result["photoScan1Path"] = f"/{task_no}/{bin_location}/scan_camera_1/main.jpg"
     result["photoScan2Path"] = f"/{task_no}/{bin_location}/scan_camera_2/main.jpg"
 
-    # 2. 条码 + 数量识别
-    logger.info(f"[DetectionRunner] 识别: {task_no}/{bin_location}, capture_dir={capture_dir}")
-    try:
-        recognition_result = await run_detection_async(
-            task_no=task_no,
-            bin_location=bin_location,
-            capture_dir=capture_dir,
-        )
-    except Exception as e:
-        logger.error(f"[DetectionRunner] 识别异常: {e}")
-        result["status"] = "异常"
-        result["error"] = f"识别异常: {str(e)}"
-        return result
+    # 画面与上次核实时相同（货物未动）→ 沿用上次结果，跳过检测和条码识别
+    from services.api.shared.config import REUSE_UNCHANGED_BINS, PHASH_MAX_DISTANCE
+    from services.api.inventory import bin_fingerprint
+    capture_hashes = bin_fingerprint.read_capture_hashes(capture_dir) if REUSE_UNCHANGED_BINS else {}
+    previous = bin_fingerprint.find_reusable(bin_location, capture_hashes, PHASH_MAX_DISTANCE) if capture_hashes else None
+    if previous:
+        recognition_result = {
+            "detect_result": previous["detect_result"],
+            "barcode_result": previous["barcode_result"],
+        }
+        result["reused"] = True
+        result["reusedFrom"] = previous.get("task_no")
+    else:
+        recognition_result = None
+
+    # 2. 条码 + 数量识别；作业图先出的暂定数量写 Redis，进度接口可提前展示
+    def _on_update(recognition: Dict[str, Any]):
+        from services.api.shared.redis_queue import push_provisional_result
+        detect = recognition.get("detect_result") or {}
+        if detect.get("status") != "success":
+            return
+        spec = _get_actual_spec(recognition.get("barcode_result") or {})
+        push_provisional_result(task_no, bin_location, {
+            "binLocation": bin_location,
+            "status": "成功",
+            "actualQuantity": detect.get("total_count", 0),
+            "actualSpec": spec,
+            "provisional": True,
+        })
+
+    if previous is None:
+        # 拍照、查检查点期间可能已被取消，开始识别前再查一次
+        if _abandoned(deadline, task_no, bin_location, result):
+            return result
+        logger.info(f"[DetectionRunner] 识别: {task_no}/{bin_location}, capture_dir={capture_dir}")
+        try:
+            recognition_result = await run_detection_async(
+                task_no=task_no,
+                bin_location=bin_location,
+                capture_dir=capture_dir,
+                deadline=deadline,
+                on_update=_on_update,
+            )
+        except Exception as e:
+            logger.error(f"[DetectionRunner] 识别异常: {e}")
+            result["status"] = "异常"
+            result["error"] = f"识别异常: {str(e)}"
+            return result
 
     detect_result = (recognition_result or {}).get("detect_result") or {}
     barcode_result = (recognition_result or {}).get("barcode_result") or {}
@@ -137,8 +197,10 @@ async def run_detection(task_no: str, bin_location: str, is_sim: bool) -> Dict[s
     logger.info(f"[DetectionRunner] detect_result={detect_result}, barcode_result={barcode_result}")
 
     if detect_result.get("status") == "success":
-        result["photo3dPath"] = f"/{task_no}/{bin_location}/3d_camera/main_rotated.jpg"
-        result["photoDepthPath"] = f"/{task_no}/{bin_location}/3d_camera/depth_color.jpg"
+        # 沿用结果时本次没有生成旋转/彩色图，仍用原始抓图路径
+        if not previous:
+            result["photo3dPath"] = f"/{task_no}/{bin_location}/3d_camera/main_rotated.jpg"
+            result["photoDepthPath"] = f"/{task_no}/{bin_location}/3d_camera/depth_color.jpg"
         result["actualSpec"] = _get_actual_spec(barcode_result)
         result["status"] = "成功"
         if result["actualSpec"] == "未识别":
@@ -152,11 +214,19 @@ async def run_detection(task_no: str, bin_location: str, is_sim: bool) -> Dict[s
         result["actualSpec"] = _get_actual_spec(barcode_result)
         result["actualQuantity"] = 0
 
+    # 只记成功的结果：失败多半是预算耗尽或缺图，续做时应当重试
+    if result["status"] == "成功":
+        bin_checkpoint.commit(store, bin_checkpoint.STAGE_RESULT, bin_checkpoint.frame_artifacts(capture_dir), result)
+        # 新识别且品规已识别的结果作为该储位下次复盘的比对基准
+        if not previous and result["actualSpec"] != "未识别":
+            bin_fingerprint.remember(bin_location, task_no, capture_hashes, detect_result, barcode_result)
+
     return result
 
 
-async def run_detection_async(task_no: str, bin_location: str, capture_dir: Path) -> Dict[str, Any]:
-    """执行条码和数量识别（调用 service 中的同步函数）"""
+async def run_detection_async(task_no: str, bin_location: str, capture_dir: Path, deadline=None,
+                              on_update=None) -> Dict[str, Any]:
+    """执行条码和数量识别（调用 service 中的同步函数）；on_update 收暂定结果，见 bin_graph.run"""
     # run_barcode_and_detect is an async function in service.py
     from services.api.inventory.service import run_barcode_and_detect
     return await run_barcode_and_detect(
@@ -165,5 +235,7 @@ async def run_detection_async(task_no: str, bin_location: str, capture_dir: Path
         scan_dirs=[capture_dir / "scan_camera_1", capture_dir / "scan_camera_2"],
         detect_dir=capture_dir / "3d_camera",
         pile_id=1,
-        code_type="ucc128"
+        code_type="ucc128",
+        deadline=deadline,
+        on_update=on_update,
     )
@@ -0,0 +1,158 @@
+"""
+进程内存预算（见 hardware/cam_sys/src/MemoryGovernor.h）
+
+gateway、worker、Redis、LMS/RCS 模拟器和 web 在同一台工控机上，各进程按 config.json 的 memory.limits_mb
+自律：本进程 RSS 接近上限（或系统可用内存低于 min_available_mb）时，按优先级回调各子系统收缩：
+
+    camera/<类型>   帧历史像素、录制环（C++ 侧 CamController 自动登记，priority 10）
+    yolo_model      worker 跨储位复用的 YOLO 模型，hard 时丢弃（bin_graph，priority 20）
+    scene           场景分析（YOLO + 深度）开始前 reserve，hard 时推迟（bin_graph）
+
+各进程的账目写到 output/memory_<角色>.json，gateway 的 /memory 汇总返回。
+camera_api 没有 MemoryGovernor 或 memory.enabled 为 false 时以下函数都是空操作
+"""
+import atexit
+import json
+import os
+import time
+from contextlib import contextmanager
+from typing import Any, Callable, Dict, Optional
+
+from services.api.shared.config import logger, project_root, MEMORY
+from services.api.shared.native import load_camera_api
+
+EXPORT_DIR = project_root / "output"
+
+_MB = 1 << 20
+
+# 与 camera_api.MemoryPressure 一致
+NORMAL, SOFT, HARD = 0, 1, 2
+
+_governor = None
+_role: Optional[str] = None
+
+
+def _load_camera_api():
+    return load_camera_api("MemoryGovernor", "不做内存治理")
+
+
+def setup(role: str):
+    """进程启动时调用一次：按角色（gateway/worker）配置上限并启动监控线程"""
+    global _governor, _role
+    if _governor is not None or not MEMORY.get("enabled", True):
+        return _governor
+    api = _load_camera_api()
+    if api is None:
+        return None
+    _role = role
+    _governor = api.MemoryGovernor.instance()
+    limit_mb = MEMORY.get("limits_mb", {}).get(role, 0)
+    _governor.configure(int(limit_mb * _MB),
+                        MEMORY.get("soft_ratio", 0.85),
+                        MEMORY.get("hard_ratio", 0.95),
+                        int(MEMORY.get("min_available_mb", 512) * _MB))
+    _governor.startMonitor(int(MEMORY.get("sample_ms", 1000)))
+    # 解释器退出前停掉监控线程，避免回调落在已销毁的 Python 对象上
+    atexit.register(_governor.stopMonitor)
+    logger.info(f"[memory] {role} 内存上限 {limit_mb}MB")
+    export()
+    return _governor
+
+
+def attach(name: str, budget: int, priority: int,
+           on_pressure: Optional[Callable[[int, int], int]] = None) -> Optional[int]:
+    """登记账目，返回编号（未启用时 None）。on_pressure(level, excess) 在监控线程调用，返回释放的字节"""
+    if _governor is None:
+        return None
+    return _governor.attach(name, int(budget), priority, on_pressure)
+
+
+def set_usage(account: Optional[int], used: int):
+    if _governor is not None and account is not None:
+        _governor.set(account, int(used))
+
+
+def level() -> int:
+    """当前压力等级（0 正常 / 1 soft / 2 hard），未启用时为 0"""
+    return _governor.level() if _governor is not None else 0
+
+
+@contextmanager
+def reserved(account: Optional[int], nbytes: int, wait_sec: float = 30.0):
+    """批量工作开始前申请 nbytes：会越过 hard 线时每 0.2s 重试，最多等 wait_sec 后照常执行。
+    返回是否拿到预留，退出时归还"""
+    if _governor is None or account is None:
+        yield True
+        return
+    deadline = time.monotonic() + max(wait_sec, 0.0)
+    granted = _governor.reserve(account, int(nbytes))
+    if not granted:
+        logger.warning(f"[memory] 内存压力，推迟 {nbytes // _MB}MB 的工作（最多 {wait_sec:g}s）")
+        while not granted and time.monotonic() < deadline:
+            time.sleep(0.2)
+            granted = _governor.reserve(account, int(nbytes))
+        if not granted:
+            logger.warning("[memory] 等待超时，不预留直接执行")
+    try:
+        yield granted
+    finally:
+        if granted:
+            _governor.add(account, -int(nbytes))
+
+
+def accounting() -> Dict[str, Any]:
+    """本进程的账目（字节换算为 MB）"""
+    if _governor is None:
+        return {"enabled": False}
+    st = _governor.stats()
+    to_mb = lambda v: round(v / _MB, 1) if v >= 0 else None
+    return {
+        "enabled": True,
+        "role": _role,
+        "pid": os.getpid(),
+        "time": time.time(),
+        "limit_mb": to_mb(st.limit),
+        "rss_mb": to_mb(st.rss),
+        "rss_peak_mb": to_mb(st.rss_peak),
+        "accounted_mb": to_mb(st.accounted),
+        "available_mb": to_mb(st.available),
+        "level": st.level,
+        "soft_events": st.soft_events,
+        "hard_events": st.hard_events,
+        "accounts": [{
+            "name": a.name,
+            "budget_mb": to_mb(a.budget),
+            "used_mb": to_mb(a.used),
+            "peak_mb": to_mb(a.peak),
+            "priority": a.priority,
+            "shrinks": a.shrinks,
+            "released_mb": to_mb(a.released),
+            "deferred": a.deferred,
+        } for a in _governor.accounts()],
+    }
+
+
+def export():
+    """写 output/memory_<角色>.json，供其他进程（gateway /memory）读取"""
+    if _governor is None:
+        return
+    path = EXPORT_DIR / f"memory_{_role}.json"
+    try:
+        path.parent.mkdir(parents=True, exist_ok=True)
+        tmp = path.with_name(f".{path.name}.tmp")
+        with open(tmp, "w", encoding="utf-8") as f:
+            json.dump(accounting(), f, ensure_ascii=False, indent=2)
+        os.replace(tmp, path)
+    except IOError as e:
+        logger.warning(f"[memory] 写 {path} 失败: {e}")
+
+
+def load_exported(role: str) -> Optional[Dict[str, Any]]:
+    path = EXPORT_DIR / f"memory_{role}.json"
+    if not path.exists():
+        return None
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            return json.load(f)
+    except (json.JSONDecodeError, IOError):
+        return None
@@ -0,0 +1,48 @@
+"""
+按需加载 hardware/cam_sys 编译出的 camera_api 模块（services 侧各原生加速共用）
+
+load_camera_api(required_attr, purpose) 只导入一次；模块缺失或版本过旧（没有 required_attr）时返回 None，
+每个 purpose 只提示一次，调用方按 purpose 所说的方式退回
+"""
+import sys
+import threading
+from pathlib import Path
+from typing import Optional, Set
+
+from services.api.shared.config import logger
+
+# camera_api*.so 与抓图脚本放在同一目录
+CAM_SYS_DIR = Path(__file__).resolve().parents[3] / "hardware" / "cam_sys"
+
+_camera_api = None
+_import_error: Optional[str] = None
+_warned: Set[str] = set()
+_lock = threading.Lock()
+
+
+def _import():
+    global _camera_api, _import_error
+    with _lock:
+        if _camera_api is not None or _import_error is not None:
+            return
+        try:
+            if str(CAM_SYS_DIR) not in sys.path and CAM_SYS_DIR.is_dir():
+                sys.path.insert(0, str(CAM_SYS_DIR))
+            import camera_api
+            _camera_api = camera_api
+        except ImportError as e:
+            _import_error = str(e)
+
+
+def load_camera_api(required_attr: str, purpose: str):
+    """返回 camera_api；不可用或缺少 required_attr 时返回 None，并以
+    "camera_api 不可用，<purpose>" 提示一次（purpose 写明退回方式，如 "状态事件总线使用 Python 实现"）"""
+    if _camera_api is None and _import_error is None:
+        _import()
+    if _camera_api is not None and hasattr(_camera_api, required_attr):
+        return _camera_api
+    if purpose not in _warned:
+        _warned.add(purpose)
+        error = _import_error or f"版本过旧，缺少 {required_attr}"
+        logger.warning(f"camera_api 不可用，{purpose}: {error}")
+    return None
@@ -0,0 +1,112 @@
+"""
+原生异步操作的 asyncio 接口（见 hardware/cam_sys/src/CompletionPort.h）
+
+camera_api 的异步操作（如 CaptureLoop.startFlow）发起后立即返回编号，完成时由原生线程投递到
+CompletionPort，投递不碰 Python、不拿 GIL。每个事件循环一个端口，eventfd 挂在 loop.add_reader 上：
+一次唤醒 drain 一次，这期间完成的全部操作一批转成 Python 对象并 set_result，GIL 每批只拿一次。
+
+    bridge = native_async.get_bridge()
+    result = await bridge.submit(capture_loop.startFlow, options)
+
+取消返回的 future（包括 wait_for 超时）会撤销编号，并取消对应的原生操作。
+camera_api 不可用时 get_bridge 返回 None，调用方走原来的路径
+"""
+import asyncio
+import functools
+import weakref
+from typing import Any, Callable, Dict, Optional
+
+from services.api.shared.native import load_camera_api
+
+# 没有 eventfd 时轮询 drain 的间隔（秒）
+_POLL_INTERVAL = 0.005
+
+_bridges: "weakref.WeakKeyDictionary[asyncio.AbstractEventLoop, NativeBridge]" = weakref.WeakKeyDictionary()
+
+
+def _load_camera_api():
+    return load_camera_api("CompletionPort", "不启用原生异步桥")
+
+
+class NativeBridge:
+    """一个事件循环上的完成端口。只在该事件循环线程里使用"""
+
+    def __init__(self, loop: asyncio.AbstractEventLoop, api):
+        self._loop = loop
+        self._port = api.CompletionPort()
+        self._futures: Dict[int, asyncio.Future] = {}
+        self._polling = False
+        self._fd = self._port.fd()
+        if self._fd >= 0:
+            loop.add_reader(self._fd, self._on_ready)
+
+    @property
+    def port(self):
+        return self._port
+
+    def submit(self, start: Callable[..., int], *args: Any) -> asyncio.Future:
+        """调用 start(port, *args) 发起原生操作，返回结果的 future"""
+        token = start(self._port, *args)
+        fut = self._loop.create_future()
+        self._futures[token] = fut
+        fut.add_done_callback(functools.partial(self._on_done, token))
+        if self._fd < 0 and not self._polling:
+            self._polling = True
+            self._loop.call_later(_POLL_INTERVAL, self._poll)
+        return fut
+
+    def _on_ready(self):
+        for token, value in self._port.drain():
+            fut = self._futures.pop(token, None)
+            if fut is not None and not fut.done():
+                fut.set_result(value)
+
+    def _on_done(self, token: int, fut: asyncio.Future):
+        # 等待方取消：撤销编号并取消原生操作；已完成未 drain 的结果随后被丢弃
+        if fut.cancelled() and self._futures.pop(token, None) is not None:
+            self._port.cancel(token)
+
+    def _poll(self):
+        self._on_ready()
+        if self._futures and not self._loop.is_closed():
+            self._loop.call_later(_POLL_INTERVAL, self._poll)
+        else:
+            self._polling = False
+
+    def pending(self) -> int:
+        return len(self._futures)
+
+    def stats(self):
+        return self._port.stats()
+
+    def close(self):
+        """摘下 eventfd 并取消未完成的操作（须在事件循环线程里）"""
+        if self._fd >= 0 and not self._loop.is_closed():
+            self._loop.remove_reader(self._fd)
+            self._fd = -1
+        for fut in list(self._futures.values()):
+            fut.cancel()
+
+
+def get_bridge() -> Optional[NativeBridge]:
+    """当前运行中事件循环的桥，首次调用时创建；camera_api 不可用时返回 None"""
+    api = _load_camera_api()
+    if api is None:
+        return None
+    loop = asyncio.get_running_loop()
+    bridge = _bridges.get(loop)
+    if bridge is None:
+        bridge = NativeBridge(loop, api)
+        _bridges[loop] = bridge
+    return bridge
+
+
+def close():
+    """关闭当前事件循环的桥（服务关闭时调用）"""
+    try:
+        loop = asyncio.get_running_loop()
+    except RuntimeError:
+        return
+    bridge = _bridges.pop(loop, None)
+    if bridge is not None:
+        bridge.close()
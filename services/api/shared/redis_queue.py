@@ -1,14 +1,21 @@
 """
 Redis 队列工具：用于 gateway 和 inventory_worker 之间的任务分发
+
+worker → gateway 的结果、暂定结果和进度按 result_record 的二进制记录写入（config.json 的
+result_format 为 "json" 时仍写 JSON），读取两种格式都认
 """
 import json
 import logging
 from typing import Dict, List, Any, Optional
 
+from services.api.shared import result_record
+from services.api.shared.config import RESULT_FORMAT
+
 logger = logging.getLogger(__name__)
 
-# Redis 连接（lazy init）
+# Redis 连接（lazy init）；raw 连接不解码，读写二进制结果记录
 _redis_client: Optional[Any] = None
+_redis_raw_client: Optional[Any] = None
 _redis_last_fail: float = 0.0  # 上次连接失败的时间戳
 _REDIS_RETRY_INTERVAL = 30     # 连接失败后 30 秒内不重试
 _REDIS_HOST = "localhost"
@@ -19,26 +26,32 @@ PENDING_QUEUE = "inventory:pending_queue"           # 旧批量队列（废弃
 SINGLE_BIN_QUEUE = "inventory:single_bin_queue"   # 单bin队列（gateway → worker，逐个推送）
 _RESULT_KEY_BASE = "inventory:task"               # 统一前缀
 RESULT_KEY_PREFIX = "inventory:task:results:"     # 向后兼容，结果 key = results:{task_no}
+PROVISIONAL_KEY_PREFIX = "inventory:task:provisional:"  # 暂定结果 hash，field = 储位
 
 
-def _get_redis():
-    """获取 Redis 连接（lazy init，失败后 30 秒内不重试）"""
+def _get_redis(raw: bool = False):
+    """获取 Redis 连接（lazy init，失败后 30 秒内不重试）；raw=True 时返回不解码的连接"""
     import time as _time
-    global _redis_client, _redis_last_fail
-    if _redis_client is None:
+    global _redis_client, _redis_raw_client, _redis_last_fail
+    client = _redis_raw_client if raw else _redis_client
+    if client is None:
         now = _time.time()
         if now - _redis_last_fail < _REDIS_RETRY_INTERVAL:
             return None
         try:
             import redis
-            _redis_client = redis.Redis(host=_REDIS_HOST, port=_REDIS_PORT, decode_responses=True)
-            _redis_client.ping()
-            logger.info(f"[Redis] 连接成功: {_REDIS_HOST}:{_REDIS_PORT}")
+            client = redis.Redis(host=_REDIS_HOST, port=_REDIS_PORT, decode_responses=not raw)
+            client.ping()
+            logger.info(f"[Redis] 连接成功: {_REDIS_HOST}:{_REDIS_PORT}{'（二进制）' if raw else ''}")
         except Exception as e:
             logger.warning(f"[Redis] 连接失败: {e}，{_REDIS_RETRY_INTERVAL}秒后重试")
-            _redis_client = None
+            client = None
             _redis_last_fail = now
-    return _redis_client
+        if raw:
+            _redis_raw_client = client
+        else:
+            _redis_client = client
+    return client
 
 
 def _to_json(obj: Any) -> str:
@@ -49,6 +62,31 @@ def _from_json(s: str) -> Any:
     return json.loads(s)
 
 
+def _encode_result(kind: int, task_no: str, bin_location: str, result: Optional[Dict] = None,
+                   step: Optional[int] = None):
+    """按 result_format 编码一条结果；JSON 时与旧格式相同"""
+    if RESULT_FORMAT == "json":
+        if kind == result_record.FINAL:
+            return _to_json({"bin_location": bin_location, "result": result})
+        if kind == result_record.PROGRESS:
+            return _to_json({"bin_location": bin_location, "step": step})
+        return _to_json(result)
+    return result_record.encode(kind, task_no, bin_location, result, step)
+
+
+def _unwrap_result(decoded: Any) -> Any:
+    """二进制记录还原成旧 JSON 的结构：最终结果 {"bin_location", "result"}、
+    暂定结果为结果 dict、进度 {"bin_location", "step"}；旧 JSON 原样返回"""
+    if not isinstance(decoded, tuple):
+        return decoded
+    kind, _, bin_location, result, step = decoded
+    if kind == result_record.FINAL:
+        return {"bin_location": bin_location, "result": result}
+    if kind == result_record.PROGRESS:
+        return {"bin_location": bin_location, "step": step}
+    return result
+
+
 # ==================== Gateway → Worker ====================
 
 def push_task(task_no: str, bin_locations: List[str], task_info: Dict) -> bool:
@@ -102,16 +140,12 @@ def push_bin_result(task_no: str, bin_location: str, result: Dict) -> bool:
     """
     worker 调用：写入单个库位的处理结果
     """
-    client = _get_redis()
+    client = _get_redis(raw=True)
     if client is None:
         return False
     try:
         key = f"{RESULT_KEY_PREFIX}{task_no}"
-        payload = _to_json({
-            "bin_location": bin_location,
-            "result": result,
-        })
-        client.lpush(key, payload)
+        client.lpush(key, _encode_result(result_record.FINAL, task_no, bin_location, result))
         return True
     except Exception as e:
         logger.error(f"[Redis] 写入结果失败: {e}")
@@ -122,28 +156,62 @@ def get_bin_results(task_no: str) -> List[Dict]:
     """
     gateway 调用：读取某任务的所有已处理结果
     """
-    client = _get_redis()
+    client = _get_redis(raw=True)
     if client is None:
         return []
     try:
         key = f"{RESULT_KEY_PREFIX}{task_no}"
         items = client.lrange(key, 0, -1)
-        return [_from_json(item) for item in items]
+        return [_unwrap_result(item) for item in result_record.decode_many(items) if item is not None]
     except Exception as e:
         logger.error(f"[Redis] 读取结果失败: {e}")
         return []
 
 
+def push_provisional_result(task_no: str, bin_location: str, result: Dict) -> bool:
+    """
+    worker 调用：写入储位的暂定结果（作业图先出的数量/品规），同一储位后写覆盖先写。
+    最终结果仍走 push_bin_result
+    """
+    client = _get_redis(raw=True)
+    if client is None:
+        return False
+    try:
+        client.hset(f"{PROVISIONAL_KEY_PREFIX}{task_no}", bin_location,
+                    _encode_result(result_record.PROVISIONAL, task_no, bin_location, result))
+        return True
+    except Exception as e:
+        logger.error(f"[Redis] 写入暂定结果失败: {e}")
+        return False
+
+
+def get_provisional_results(task_no: str) -> Dict[str, Dict]:
+    """
+    gateway 调用：读取某任务各储位的暂定结果 {储位: result}
+    """
+    client = _get_redis(raw=True)
+    if client is None:
+        return {}
+    try:
+        items = client.hgetall(f"{PROVISIONAL_KEY_PREFIX}{task_no}")
+        decoded = result_record.decode_many(list(items.values()))
+        return {bin_location.decode("utf-8"): _unwrap_result(item)
+                for bin_location, item in zip(items.keys(), decoded) if item is not None}
+    except Exception as e:
+        logger.error(f"[Redis] 读取暂定结果失败: {e}")
+        return {}
+
+
 def clear_task_results(task_no: str) -> bool:
     """
-    gateway 调用：任务完成后清除结果缓存
+    gateway 调用：任务完成后清除结果缓存（含暂定结果）
     """
     client = _get_redis()
     if client is None:
         return False
     try:
         key = f"{RESULT_KEY_PREFIX}{task_no}"
-        client.delete(key)
+        client.delete(key, f"{PROVISIONAL_KEY_PREFIX}{task_no}")
         return True
     except Exception as e:
         logger.error(f"[Redis] 清除结果失败: {e}")
@@ -198,13 +266,12 @@ def delete_task_status(task_no: str) -> bool:
 
 def append_bin_progress(task_no: str, bin_location: str, step: int) -> bool:
     """worker 每处理完一个库位，上报进度"""
-    client = _get_redis()
+    client = _get_redis(raw=True)
     if client is None:
         return False
     try:
         key = f"inventory:task:progress:{task_no}"
-        payload = _to_json({"bin_location": bin_location, "step": step})
-        client.lpush(key, payload)
+        client.lpush(key, _encode_result(result_record.PROGRESS, task_no, bin_location, step=step))
         return True
     except Exception as e:
         logger.error(f"[Redis] 写入进度失败: {e}")
@@ -213,13 +280,13 @@ def append_bin_progress(task_no: str, bin_location: str, step: int) -> bool:
 
 def get_progress(task_no: str) -> List[Dict]:
     """gateway 读取进度"""
-    client = _get_redis()
+    client = _get_redis(raw=True)
     if client is None:
         return []
     try:
         key = f"inventory:task:progress:{task_no}"
         items = client.lrange(key, 0, -1)
-        return [_from_json(item) for item in items]
+        return [_unwrap_result(item) for item in result_record.decode_many(items) if item is not None]
     except Exception as e:
         logger.error(f"[Redis] 读取进度失败: {e}")
         return []
@@ -229,9 +296,10 @@ def get_progress(task_no: str) -> List[Dict]:
 
 # ==================== 单bin队列（Gateway → Worker）====================
 
-def push_single_bin_task(task_no: str, bin_location: str) -> bool:
+def push_single_bin_task(task_no: str, bin_location: str, expires_at: Optional[float] = None) -> bool:
     """
     gateway 调用：推送单个 bin 给 worker 处理
+    expires_at: 该储位时间预算的截止时间戳（time.time()），None 表示不限制
     """
     client = _get_redis()
     if client is None:
@@ -240,6 +308,7 @@ def push_single_bin_task(task_no: str, bin_location: str) -> bool:
         payload = _to_json({
             "task_no": task_no,
             "bin_location": bin_location,
+            "expires_at": expires_at,
         })
         client.lpush(SINGLE_BIN_QUEUE, payload)
         logger.info(f"[Redis] 单bin入队: task={task_no}, bin={bin_location}")
@@ -252,7 +321,7 @@ def push_single_bin_task(task_no: str, bin_location: str) -> bool:
 def pop_single_bin_task(timeout: int = 5) -> Optional[Dict]:
     """
     worker 调用：阻塞消费单个 bin（timeout=5秒）
-    返回: {"task_no": ..., "bin_location": ...}
+    返回: {"task_no": ..., "bin_location": ..., "expires_at": ...}
     """
     client = _get_redis()
     if client is None:
@@ -302,6 +371,37 @@ def flush_single_bin_queue_by_task(task_no: str) -> int:
         return 0
 
 
+# ==================== 储位取消标记（Gateway → Worker）====================
+
+def _bin_cancel_key(task_no: str, bin_location: str) -> str:
+    return f"{_RESULT_KEY_BASE}:bin_cancelled:{task_no}:{bin_location}"
+
+
+def mark_bin_cancelled(task_no: str, bin_location: str) -> bool:
+    """gateway 放弃储位时调用：worker 在阶段边界看到标记后不再继续检测"""
+    client = _get_redis()
+    if client is None:
+        return False
+    try:
+        client.set(_bin_cancel_key(task_no, bin_location), 1, ex=86400)  # 1天过期
+        logger.info(f"[Redis] 储位已取消: task={task_no}, bin={bin_location}")
+        return True
+    except Exception as e:
+        logger.error(f"[Redis] 写入储位取消标记失败: {e}")
+        return False
+
+
+def is_bin_cancelled(task_no: str, bin_location: str) -> bool:
+    """worker 调用：储位是否已被 gateway 取消"""
+    client = _get_redis()
+    if client is None:
+        return False
+    try:
+        return bool(client.exists(_bin_cancel_key(task_no, bin_location)))
+    except Exception:
+        return False
+
+
 # ==================== 已完成集合（Gateway 用）========================
 
 def add_to_completed_set(task_no: str, set_name: str, bin_location: str) -> bool:
@@ -368,7 +468,7 @@ async def wait_for_bin_result(task_no: str, bin_location: str, timeout: int = 0)
     返回: {"bin_location": ..., "result": {...}}
     """
     import asyncio
-    client = _get_redis()
+    client = _get_redis(raw=True)
     if client is None:
         return None
     key = f"{RESULT_KEY_PREFIX}{task_no}"
@@ -378,10 +478,18 @@ async def wait_for_bin_result(task_no: str, bin_location: str, timeout: int = 0)
         try:
             items = client.lrange(key, 0, -1)
             for item in items:
-                parsed = _from_json(item)
-                if parsed.get("bin_location") == bin_location:
-                    client.lrem(key, 1, item)
-                    return parsed
+                # 二进制记录只看储位，命中的那条才整条解码
+                hit = result_record.peek_bin(item)
+                if hit is None:
+                    parsed = _unwrap_result(result_record.decode(item))
+                    if not isinstance(parsed, dict) or parsed.get("bin_location") != bin_location:
+                        continue
+                elif hit != bin_location:
+                    continue
+                else:
+                    parsed = _unwrap_result(result_record.decode(item))
+                client.lrem(key, 1, item)
+                return parsed
         except Exception as e:
             logger.error(f"[Redis] 轮询结果失败: {e}")
             return None
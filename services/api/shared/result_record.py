@@ -0,0 +1,321 @@
+"""
+worker ↔ gateway 的储位结果记录（见 hardware/cam_sys/src/ResultRecord.h）
+
+最终结果、暂定结果和进度原先是 JSON 字符串，gateway 每次轮询都要把整个列表反序列化一遍。
+记录为定长头 + varint 字段：状态、品规、照片路径后缀等常见字符串存成共享字典编号，
+照片路径省略 "/<任务>/<储位>/" 前缀，schema 外的键才落到 extra（JSON）。
+peek_bin 不解整条记录就能取出储位，轮询只解码命中的那一条。
+
+编码、解码优先用 camera_api（字典字符串直接复用同一个 Python 对象），不可用时用本模块的
+Python 实现，两者输出逐字节相同，worker 和 gateway 可以各用各的。
+decode 同时认旧的 JSON 字符串，升级期间队列里残留的旧结果照常读取
+"""
+import json
+import struct
+from typing import Any, Dict, List, Optional, Tuple
+
+from services.api.shared.native import load_camera_api
+
+# 与 camera_api.ResultKind 一致
+FINAL, PROVISIONAL, PROGRESS = 0, 1, 2
+
+_VERSION = 1
+_HEADER = struct.Struct("<2sBBB")
+
+# 版本 1 的共享字典，与 ResultRecord.cpp 的 kDictionary 相同，只能在末尾追加
+DICTIONARY = [
+    "",
+    "成功",
+    "异常",
+    "未识别",
+    "无",
+    "success",
+    "failed",
+    "no_match",
+    "disabled",
+    "3d_camera/main.jpg",
+    "3d_camera/depth.jpg",
+    "3d_camera/main_rotated.jpg",
+    "3d_camera/depth_color.jpg",
+    "scan_camera_1/main.jpg",
+    "scan_camera_2/main.jpg",
+    "未匹配到烟箱信息",
+    "所有相机抓图失败",
+    "检测超时（储位时间预算耗尽）",
+    "未找到图片",
+    "条码识别前储位时间预算已耗尽",
+    "3D相机抓图失败：未找到main.jpg",
+    "3D相机抓图失败：未找到depth.jpg",
+    "扫码相机拍照失败：未找到图片",
+]
+_DICT_INDEX = {s: i for i, s in enumerate(DICTIONARY)}
+
+# 字段 (组, 键)，顺序即编号；键为 None 的不是结果里的键
+_D, _B = "detect_result", "barcode_result"
+STR_FIELDS = [
+    ("", None), ("", None),  # 任务号、储位
+    ("", "status"), ("", "actualSpec"), ("", "error"),
+    ("", "photo3dPath"), ("", "photoDepthPath"), ("", "photoScan1Path"), ("", "photoScan2Path"),
+    (_D, "status"), (_D, "error"),
+    (_B, "status"), (_B, "six_digit_code"), (_B, "product_name"), (_B, "tobacco_code"),
+    (_B, "message"), (_B, "error"),
+    ("", None),  # extra
+]
+INT_FIELDS = [("", "actualQuantity"), (_D, "total_count"), (_D, "pile_id"), (_B, "mapped_pile_id"), ("", None)]
+_TASK, _BIN, _EXTRA, _STEP = 0, 1, 17, 4
+_PHOTOS = range(5, 9)
+_KEYS = {**{f: i for i, f in enumerate(STR_FIELDS) if f[1]},
+         **{f: len(STR_FIELDS) + i for i, f in enumerate(INT_FIELDS) if f[1]}}
+
+HAS_BIN, HAS_DETECT, DETECT_DICT, HAS_BARCODE, BARCODE_DICT, PROVISIONAL_KEY = 1, 2, 4, 8, 16, 32
+
+
+def _load_camera_api():
+    return load_camera_api("encodeResult", "结果记录使用 Python 实现")
+
+
+# ==================== Python 实现（与 ResultRecord.cpp 逐字节相同） ====================
+
+def _put_varint(v: int, out: bytearray):
+    while v >= 0x80:
+        out.append((v & 0x7F) | 0x80)
+        v >>= 7
+    out.append(v)
+
+
+def _get_varint(data: bytes, pos: int) -> Tuple[int, int]:
+    r = shift = 0
+    while shift < 64:
+        b = data[pos]
+        pos += 1
+        r |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return r, pos
+        shift += 7
+    raise ValueError("varint 过长")
+
+
+def _put_string(s: str, out: bytearray):
+    i = _DICT_INDEX.get(s)
+    if i is not None:
+        _put_varint(i << 1 | 1, out)
+        return
+    raw = s.encode("utf-8")
+    _put_varint(len(raw) << 1, out)
+    out += raw
+
+
+def _get_string(data: bytes, pos: int) -> Tuple[str, int]:
+    v, pos = _get_varint(data, pos)
+    if v & 1:
+        return DICTIONARY[v >> 1], pos
+    end = pos + (v >> 1)
+    if end > len(data):
+        raise ValueError("字符串越界")
+    return data[pos:end].decode("utf-8"), end
+
+
+class _Record:
+    __slots__ = ("kind", "flags", "str_mask", "str_null", "int_mask", "int_null", "strs", "ints")
+
+    def __init__(self, kind: int):
+        self.kind = kind
+        self.flags = self.str_mask = self.str_null = self.int_mask = self.int_null = 0
+        self.strs: List[Optional[str]] = [None] * len(STR_FIELDS)
+        self.ints: List[int] = [0] * len(INT_FIELDS)
+
+
+def _put_group(src: Dict, group: str, rec: _Record, extra: Dict):
+    rest = {}
+    for key, v in src.items():
+        if not isinstance(key, str):
+            rest[key] = v
+            continue
+        f = _KEYS.get((group, key))
+        if f is not None and f < len(STR_FIELDS):
+            if v is None:
+                rec.str_null |= 1 << f
+                continue
+            if isinstance(v, str):
+                rec.str_mask |= 1 << f
+                rec.strs[f] = v
+                continue
+        elif f is not None:
+            f -= len(STR_FIELDS)
+            if v is None:
+                rec.int_null |= 1 << f
+                continue
+            if type(v) is int and -(1 << 63) <= v < (1 << 63):
+                rec.int_mask |= 1 << f
+                rec.ints[f] = v
+                continue
+        elif not group:
+            if key == "binLocation" and isinstance(v, str) and v == rec.strs[_BIN]:
+                rec.flags |= HAS_BIN
+                continue
+            if key == "provisional" and v is True and rec.kind == PROVISIONAL:
+                rec.flags |= PROVISIONAL_KEY
+                continue
+            if key in (_D, _B) and (v is None or isinstance(v, dict)):
+                detect = key == _D
+                rec.flags |= HAS_DETECT if detect else HAS_BARCODE
+                if v is not None:
+                    rec.flags |= DETECT_DICT if detect else BARCODE_DICT
+                    _put_group(v, key, rec, extra)
+                continue
+        rest[key] = v
+    if rest:
+        extra[group] = rest
+
+
+def _py_encode(kind: int, task_no: Optional[str], bin_location: str, result: Optional[Dict],
+               step: Optional[int]) -> bytes:
+    rec = _Record(kind)
+    if task_no is not None:
+        rec.str_mask |= 1 << _TASK
+        rec.strs[_TASK] = task_no
+    rec.str_mask |= 1 << _BIN
+    rec.strs[_BIN] = bin_location
+    if step is not None:
+        rec.int_mask |= 1 << _STEP
+        rec.ints[_STEP] = step
+    if result is not None:
+        extra: Dict[str, Dict] = {}
+        _put_group(result, "", rec, extra)
+        if extra:
+            rec.str_mask |= 1 << _EXTRA
+            rec.strs[_EXTRA] = json.dumps(extra, ensure_ascii=False, default=str)
+
+    out = bytearray(_HEADER.pack(b"LR", _VERSION, kind, rec.flags))
+    prefix = None
+    if rec.str_mask & (1 << _TASK) and rec.str_mask & (1 << _BIN):
+        prefix = f"/{rec.strs[_TASK]}/{rec.strs[_BIN]}/"
+    rel_mask = 0
+    for i in _PHOTOS:
+        if prefix and rec.str_mask & (1 << i) and rec.strs[i].startswith(prefix):
+            rel_mask |= 1 << i
+    for m in (rec.str_mask, rec.str_null, rec.int_mask, rec.int_null, rel_mask):
+        _put_varint(m, out)
+    for i, s in enumerate(rec.strs):
+        if rec.str_mask & (1 << i):
+            _put_string(s[len(prefix):] if rel_mask & (1 << i) else s, out)
+    for i, v in enumerate(rec.ints):
+        if rec.int_mask & (1 << i):
+            _put_varint(((v << 1) ^ (v >> 63)) & 0xFFFFFFFFFFFFFFFF, out)
+    return bytes(out)
+
+
+def _get_group(group: str, strs, str_mask, str_null, ints, int_mask, int_null, extra, out: Dict):
+    for i, (g, key) in enumerate(STR_FIELDS):
+        if key is None or g != group:
+            continue
+        if str_mask & (1 << i):
+            out[key] = strs[i]
+        elif str_null & (1 << i):
+            out[key] = None
+    for i, (g, key) in enumerate(INT_FIELDS):
+        if key is None or g != group:
+            continue
+        if int_mask & (1 << i):
+            out[key] = ints[i]
+        elif int_null & (1 << i):
+            out[key] = None
+    out.update(extra.get(group, {}))
+
+
+def _py_decode(data: bytes):
+    if len(data) < _HEADER.size:
+        return None
+    magic, version, kind, flags = _HEADER.unpack_from(data)
+    if magic != b"LR" or version != _VERSION:
+        return None
+    try:
+        pos = _HEADER.size
+        masks = []
+        for _ in range(5):
+            m, pos = _get_varint(data, pos)
+            masks.append(m)
+        str_mask, str_null, int_mask, int_null, rel_mask = masks
+        strs: List[Optional[str]] = [None] * len(STR_FIELDS)
+        for i in range(len(STR_FIELDS)):
+            if str_mask & (1 << i):
+                strs[i], pos = _get_string(data, pos)
+                if rel_mask & (1 << i) and i in _PHOTOS:
+                    strs[i] = f"/{strs[_TASK]}/{strs[_BIN]}/{strs[i]}"
+        ints = [0] * len(INT_FIELDS)
+        for i in range(len(INT_FIELDS)):
+            if int_mask & (1 << i):
+                v, pos = _get_varint(data, pos)
+                ints[i] = (v >> 1) ^ -(v & 1)
+    except (IndexError, ValueError):
+        return None
+
+    extra = json.loads(strs[_EXTRA]) if str_mask & (1 << _EXTRA) else {}
+    result = None
+    if kind != PROGRESS:
+        result = {}
+        if flags & HAS_BIN:
+            result["binLocation"] = strs[_BIN]
+        _get_group("", strs, str_mask, str_null, ints, int_mask, int_null, extra, result)
+        for group, has, is_dict in ((_D, HAS_DETECT, DETECT_DICT), (_B, HAS_BARCODE, BARCODE_DICT)):
+            if flags & has:
+                sub = None
+                if flags & is_dict:
+                    sub = {}
+                    _get_group(group, strs, str_mask, str_null, ints, int_mask, int_null, extra, sub)
+                result[group] = sub
+        if flags & PROVISIONAL_KEY:
+            result["provisional"] = True
+    step = ints[_STEP] if int_mask & (1 << _STEP) else None
+    return kind, strs[_TASK], strs[_BIN] or "", result, step
+
+
+def _py_peek_bin(data: bytes) -> Optional[str]:
+    decoded = _py_decode(data)
+    return decoded[2] if decoded is not None else None
+
+
+# ==================== 接口 ====================
+
+def encode(kind: int, task_no: Optional[str], bin_location: str, result: Optional[Dict] = None,
+           step: Optional[int] = None) -> bytes:
+    api = _load_camera_api()
+    if api is not None:
+        return api.encodeResult(kind, task_no, bin_location, result, step)
+    return _py_encode(kind, task_no, bin_location, result, step)
+
+
+def is_record(data) -> bool:
+    return isinstance(data, bytes) and data[:2] == b"LR"
+
+
+def decode(data):
+    """解成 (kind, task_no, bin_location, result, step)；旧 JSON 按原结构解析后原样返回（类型为 dict），
+    无法解析时返回 None"""
+    if not is_record(data):
+        try:
+            return json.loads(data)
+        except (TypeError, ValueError):
+            return None
+    api = _load_camera_api()
+    if api is not None:
+        return api.decodeResult(data)
+    return _py_decode(data)
+
+
+def decode_many(items: List[Any]) -> List[Any]:
+    """批量解码（原生实现一次调用解完整个列表）"""
+    api = _load_camera_api()
+    if api is not None and all(is_record(item) for item in items):
+        return api.decodeResults(items)
+    return [decode(item) for item in items]
+
+
+def peek_bin(data) -> Optional[str]:
+    """只取记录的储位；旧 JSON 返回 None，由调用方整条解析"""
+    if not is_record(data):
+        return None
+    api = _load_camera_api()
+    if api is not None:
+        return api.peekResultBin(data)
+    return _py_peek_bin(data)
@@ -0,0 +1,3 @@
+"""
+services 共享模块测试
+"""
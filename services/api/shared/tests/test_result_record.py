@@ -0,0 +1,204 @@
+"""
+result_record 编解码一致性测试
+
+services/api/shared/result_record.py 是 hardware/cam_sys/src/ResultRecord.cpp 的 Python 实现，
+worker 和 gateway 可能一边用原生、一边用 Python。这里用一种实现编码、另一种解码，
+并比较两边编码的字节，任何字段或字典改动没有同步到两边都会失败。
+camera_api 不可用（未编译或版本过旧）时跳过。
+
+使用方法:
+    python -m services.api.shared.tests.test_result_record
+    或
+    python services/api/shared/tests/test_result_record.py
+"""
+
+import random
+import sys
+from pathlib import Path
+
+# 添加项目根目录到路径
+_project_root = Path(__file__).resolve().parent.parent.parent.parent.parent
+if str(_project_root) not in sys.path:
+    sys.path.insert(0, str(_project_root))
+
+from services.api.shared import result_record as rr
+
+TASK_NO = "HS2026101801"
+BIN_LOCATION = "A01-02-03"
+PREFIX = f"/{TASK_NO}/{BIN_LOCATION}/"
+
+
+def _sample(rnd):
+    """随机构造一条储位结果，覆盖字典/非字典字符串、None、相对/绝对照片路径、嵌套结果和 extra 键"""
+    result = {
+        "binLocation": BIN_LOCATION,
+        "status": rnd.choice(["成功", "异常", "自定义状态"]),
+        "actualQuantity": rnd.choice([None, 0, 37, -1, 2 ** 40, -(2 ** 40)]),
+        "actualSpec": rnd.choice(["未识别", "无", "黄鹤楼(硬珍品)", ""]),
+        "photo3dPath": rnd.choice([None, PREFIX + "3d_camera/main_rotated.jpg", "/other/x.jpg"]),
+        "photoDepthPath": PREFIX + "3d_camera/depth_color.jpg",
+        "photoScan1Path": rnd.choice(["", PREFIX + "scan_camera_1/main.jpg"]),
+        "photoScan2Path": PREFIX + "scan_camera_2/main.jpg",
+        "error": rnd.choice([None, "所有相机抓图失败", "识别异常: boom"]),
+        "barcode_result": rnd.choice([
+            None,
+            {"status": "success", "six_digit_code": "123456", "product_name": "中华",
+             "tobacco_code": "X1", "mapped_pile_id": 3},
+            {"status": "no_match", "message": "未匹配到烟箱信息"},
+            {"status": "failed", "error": "e", "weird": [1, 2]},
+        ]),
+        "detect_result": rnd.choice([
+            None,
+            {"status": "success", "total_count": 12, "pile_id": 1},
+            {"status": "disabled"},
+            "oops",
+        ]),
+    }
+    if rnd.random() < 0.3:
+        del result["binLocation"]
+    if rnd.random() < 0.3:
+        del result["detect_result"]
+    if rnd.random() < 0.2:
+        result["reused"] = True
+        result["reusedFrom"] = "HS2026101701"
+    if rnd.random() < 0.1:
+        result["extra_key"] = {"a": 1}
+    return result
+
+
+def _check(kind, task_no, bin_location, result, step):
+    """原生编码 → Python 解码、Python 编码 → 原生解码，且两边字节相同"""
+    api = rr._load_camera_api()
+    expected = (kind, task_no, bin_location, result, step)
+    native = api.encodeResult(kind, task_no, bin_location, result, step)
+    python = rr._py_encode(kind, task_no, bin_location, result, step)
+    if native != python:
+        print(f"❌ 编码字节不一致: {expected}\n  原生: {native!r}\n  Python: {python!r}")
+        return False
+    if rr._py_decode(native) != expected:
+        print(f"❌ 原生编码 → Python 解码不一致: {expected} -> {rr._py_decode(native)}")
+        return False
+    if api.decodeResult(python) != expected:
+        print(f"❌ Python 编码 → 原生解码不一致: {expected} -> {api.decodeResult(python)}")
+        return False
+    if api.peekResultBin(python) != rr._py_peek_bin(native):
+        print(f"❌ peek 储位不一致: {api.peekResultBin(python)} / {rr._py_peek_bin(native)}")
+        return False
+    return True
+
+
+def test_round_trip_results():
+    """最终结果和暂定结果"""
+    print("\n" + "="*60)
+    print("🧪 测试1: 最终/暂定结果交叉编解码")
+    print("="*60)
+
+    rnd = random.Random(7)
+    for _ in range(2000):
+        result = _sample(rnd)
+        kind = rnd.choice([rr.FINAL, rr.PROVISIONAL])
+        if kind == rr.PROVISIONAL:
+            result["provisional"] = True
+        task_no = rnd.choice([TASK_NO, None])
+        if not _check(kind, task_no, BIN_LOCATION, result, None):
+            return False
+    print("✅ 2000 条结果两边一致")
+    return True
+
+
+def test_round_trip_progress():
+    """进度记录"""
+    print("\n" + "="*60)
+    print("🧪 测试2: 进度记录交叉编解码")
+    print("="*60)
+
+    for step in (0, 1, 5, 127, 128, 2 ** 31):
+        if not _check(rr.PROGRESS, TASK_NO, BIN_LOCATION, None, step):
+            return False
+    print("✅ 进度记录两边一致")
+    return True
+
+
+def test_dictionary():
+    """每个共享字典字符串都按编号存取"""
+    print("\n" + "="*60)
+    print("🧪 测试3: 共享字典")
+    print("="*60)
+
+    for word in rr.DICTIONARY:
+        result = {"status": word, "actualSpec": word}
+        if not _check(rr.FINAL, TASK_NO, BIN_LOCATION, result, None):
+            return False
+    print(f"✅ {len(rr.DICTIONARY)} 个字典字符串两边一致")
+    return True
+
+
+def test_truncated():
+    """截断的记录两边都解不出"""
+    print("\n" + "="*60)
+    print("🧪 测试4: 截断记录")
+    print("="*60)
+
+    api = rr._load_camera_api()
+    data = rr._py_encode(rr.FINAL, TASK_NO, BIN_LOCATION, _sample(random.Random(1)), None)
+    for cut in range(len(data)):
+        if api.decodeResult(data[:cut]) is not None or rr._py_decode(data[:cut]) is not None:
+            print(f"❌ 截断到 {cut} 字节仍被解码")
+            return False
+    print("✅ 截断记录两边都返回 None")
+    return True
+
+
+def run_all_tests():
+    """运行所有测试"""
+    print("\n" + "="*60)
+    print("🚀 result_record 原生/Python 编解码一致性测试")
+    print("="*60)
+
+    if rr._load_camera_api() is None:
+        print("⏭️  camera_api 不可用，跳过")
+        return 0
+
+    tests = [
+        ("最终/暂定结果", test_round_trip_results),
+        ("进度记录", test_round_trip_progress),
+        ("共享字典", test_dictionary),
+        ("截断记录", test_truncated),
+    ]
+
+    results = []
+    for name, test_func in tests:
+        try:
+            result = test_func()
+            results.append((name, result))
+        except Exception as e:
+            print(f"\n❌ 测试 '{name}' 执行异常: {e}")
+            import traceback
+            traceback.print_exc()
+            results.append((name, False))
+
+    # 汇总结果
+    print("\n" + "="*60)
+    print("📊 测试结果汇总")
+    print("="*60)
+
+    passed = sum(1 for _, result in results if result)
+    total = len(results)
+
+    for name, result in results:
+        status = "✅ 通过" if result else "❌ 失败"
+        print(f"{status} - {name}")
+
+    print(f"\n总计: {passed}/{total} 测试通过")
+
+    if passed == total:
+        print("🎉 所有测试通过！")
+        return 0
+    else:
+        print("⚠️  部分测试失败")
+        return 1
+
+
+if __name__ == "__main__":
+    exit_code = run_all_tests()
+    sys.exit(exit_code)
@@ -13,7 +13,7 @@ from typing import Dict, Optional, Tuple
 from ultralytics import YOLO
 import logging
 
-from core.detection.utils.yolo_utils import extract_yolo_detections
+from core.detection.utils.yolo_utils import extract_yolo_detections, extract_detection_set
 from core.detection.core.scene_prepare import prepare_logic
 from core.detection.core.layer_filter import remove_fake_top_layer
 from core.detection.core.layer_clustering import cluster_layers_with_box_roi
@@ -157,7 +157,8 @@ class BoxCountService:
             )
             
             # Step 2: 提取检测结果
-            detections = extract_yolo_detections(results)
+            detection_set = extract_detection_set(results)
+            detections = detection_set.to_dicts() if detection_set is not None else extract_yolo_detections(results)
             logger.info(f"YOLO检测到 {len(detections)} 个对象")
             
             if not detections:
@@ -168,7 +169,8 @@ class BoxCountService:
                 }
             
             # Step 3: 场景准备（过滤并找到pile）
-            prepared = prepare_logic(detections, conf_thr=self.confidence_threshold)
+            prepared = prepare_logic(detection_set if detection_set is not None else detections,
+                                     conf_thr=self.confidence_threshold)
             if prepared is None:
                 return {
                     "success": False,
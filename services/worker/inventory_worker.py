@@ -29,8 +29,11 @@ from services.api.shared.redis_queue import (
     pop_single_bin_task,
     push_bin_result,
     add_to_completed_set,
+    is_bin_cancelled,
 )
-from services.api.shared.config import CAMERA_TEST_DIR, IS_SIM, logs_dir
+from services.api.shared.config import CAMERA_TEST_DIR, IS_SIM, CHECKPOINT, logs_dir
+from services.api.shared.deadline import Deadline
+from services.api.shared import bin_checkpoint, memory_governor
 from datetime import datetime
 
 # 设置 worker 日志文件（独立于 gateway，不调用 set_service_name 避免覆盖 gateway 的 root logger）
@@ -68,15 +71,74 @@ _core_fh.setFormatter(logging.Formatter(
 _core_logger.addHandler(_core_fh)
 
 
-async def process_one_bin(task_no: str, bin_location: str, is_sim: bool) -> dict:
+async def process_one_bin(task_no: str, bin_location: str, is_sim: bool, deadline: Deadline = None) -> dict:
     """执行单个库位的检测，返回结果 dict"""
     from services.api.shared.detection_runner import run_detection
-    return await run_detection(task_no, bin_location, is_sim)
+    return await run_detection(task_no, bin_location, is_sim, deadline)
+
+
+async def handle_bin_task(task: dict, resumed: bool = False):
+    """检测一个储位并把结果推回 gateway。resumed 为上次进程未做完、启动时续做的储位"""
+    task_no = task.get("task_no", "?")
+    bin_location = task.get("bin_location", "?")
+    # camera_test_dir 不为空时走模拟图片，worker 可以处理
+    use_sim_images = IS_SIM or bool(CAMERA_TEST_DIR)
+
+    # gateway 下发的储位截止时间（旧消息没有该字段时不限制）；续做时原预算早已过去，不再限制，
+    # 已完成的阶段从检查点读取，只补缺失的部分。gateway 取消储位时发布取消标记，各阶段边界经 deadline 检查
+    deadline = Deadline.from_payload(None if resumed else task.get("expires_at"),
+                                     cancel_probe=lambda: is_bin_cancelled(task_no, bin_location))
+
+    if resumed:
+        logger.info(f"[{task_no}] 续做上次未完成的储位: bin={bin_location}")
+    else:
+        logger.info(f"[{task_no}] 收到任务: bin={bin_location}, 剩余预算={deadline.remaining():.1f}s")
+        bin_checkpoint.mark_inflight(task_no, bin_location, task)
+
+    try:
+        result = await process_one_bin(task_no, bin_location, use_sim_images, deadline)
+        push_bin_result(task_no, bin_location, result)
+        logger.info(f"[{task_no}] 库位 {bin_location} 检测完成: status={result.get('status')}, qty={result.get('actualQuantity')}")
+    except Exception as e:
+        logger.error(f"[{task_no}] 库位 {bin_location} 检测异常: {e}")
+        result = {
+            "status": "异常",
+            "error": str(e),
+            "actualQuantity": -1,
+            "actualSpec": "未识别",
+            "photo3dPath": None,
+            "photoDepthPath": None,
+            "photoScan1Path": "",
+            "photoScan2Path": "",
+        }
+        push_bin_result(task_no, bin_location, result)
+    bin_checkpoint.clear_inflight(task_no, bin_location)
+    memory_governor.export()
+
+    # 标记 worker 完成
+    add_to_completed_set(task_no, "worker_completed", bin_location)
+    logger.info(f"[{task_no}] 库位 {bin_location} 已标记完成: worker_completed")
+
+
+async def resume_inflight_bins():
+    """启动时续做上次崩溃/重启时在途的储位（checkpoint.resume_on_start）"""
+    if not CHECKPOINT.get("resume_on_start", True):
+        return
+    pending = bin_checkpoint.get_inflight()
+    if pending:
+        logger.info(f"上次未完成的储位 {len(pending)} 个，按检查点续做")
+    for task in pending:
+        try:
+            await handle_bin_task(task, resumed=True)
+        except Exception as e:
+            logger.error(f"续做储位异常: {task.get('task_no')}/{task.get('bin_location')}: {e}")
 
 
 async def run_worker_loop():
     """主循环：从单bin队列消费，检测，写 Redis"""
     logger.info("Inventory Worker 启动，等待任务...")
+    memory_governor.setup("worker")
+    await resume_inflight_bins()
 
     while True:
         try:
@@ -84,35 +146,7 @@ async def run_worker_loop():
             task = pop_single_bin_task(timeout=5)
             if task is None:
                 continue
-
-            task_no = task.get("task_no", "?")
-            bin_location = task.get("bin_location", "?")
-            # camera_test_dir 不为空时走模拟图片，worker 可以处理
-            use_sim_images = IS_SIM or bool(CAMERA_TEST_DIR)
-
-            logger.info(f"[{task_no}] 收到任务: bin={bin_location}")
-
-            try:
-                result = await process_one_bin(task_no, bin_location, use_sim_images)
-                push_bin_result(task_no, bin_location, result)
-                logger.info(f"[{task_no}] 库位 {bin_location} 检测完成: status={result.get('status')}, qty={result.get('actualQuantity')}")
-            except Exception as e:
-                logger.error(f"[{task_no}] 库位 {bin_location} 检测异常: {e}")
-                result = {
-                    "status": "异常",
-                    "error": str(e),
-                    "actualQuantity": -1,
-                    "actualSpec": "未识别",
-                    "photo3dPath": None,
-                    "photoDepthPath": None,
-                    "photoScan1Path": "",
-                    "photoScan2Path": "",
-                }
-                push_bin_result(task_no, bin_location, result)
-
-            # 标记 worker 完成
-            add_to_completed_set(task_no, "worker_completed", bin_location)
-            logger.info(f"[{task_no}] 库位 {bin_location} 已标记完成: worker_completed")
+            await handle_bin_task(task)
 
         except Exception as e:
             logger.error(f"Worker 主循环异常: {e}")
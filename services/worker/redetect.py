@@ -0,0 +1,610 @@
+#!/usr/bin/env python3
+"""
+历史抓图批量重识别：换了 YOLO 模型或垛型模板后，对 capture_img 下几周的储位重跑计数，与当时的结果对比。
+
+用法:
+    conda run -n tobacco_env python services/worker/redetect.py --since 20261001 --until 20261031 \\
+        --out output/redetect/model_v3 --model shared/models/yolo/pile+box_v3.pt
+    # 只改了垛型模板：读检查点里的场景（YOLO、深度、分层的结果），不解码、不推理，只重新计数
+    conda run -n tobacco_env python services/worker/redetect.py --reuse-scene \\
+        --pile-config core/config/pile_config_new.json --out output/redetect/pile_v2
+
+每个进程一条流水线，进程数默认等于 CPU 核数（config.json 的 redetect，见 services/api/shared/config.py）：
+
+    capture_img/<任务>/<储位>/3d_camera/main.jpg
+      → camera_api.DecodePipeline：后台线程在 DCT 域缩小解码（长边不小于 YOLO 输入，4MP 主图解 1/4），
+        同时逆时针旋转 90°（与 analyze 里的旋转一致），最多预取 prefetch 张，按提交顺序交付
+      → 凑够 batch 张一次 model.predict，框坐标乘回缩小倍数，即旋转后原图坐标
+      → StackProcessorFactory.analyze(detections=..., image_size=...) 做深度处理和分层（不再旋转、另存和读回主图），
+        count_scene 按垛型计数
+
+analyze 会在图片所在目录写深度缓存和 depth.jpg，3D 帧先拷到进程自己的临时目录再分析，
+历史目录只读（检查点的产物哈希不受影响）。垛型依次取：--pile-id、检查点里条码解析出的垛型、
+检查点里计数所用的垛型、1；当时的数量取检查点的 result / count 阶段。
+
+结果按列存放：输出目录下每 flush_rows 行写一个 part-NNNNN.npz（每列一个数组，先写临时文件再改名），
+全部做完合并为 results.npz。中断（Ctrl-C、断电）后重跑同一条命令，已写入 part 的储位跳过，从断点继续；
+失败的储位重跑时再做一次，同一储位有多行时以最后写入的为准。
+运行中 progress.json 随时可读。读取结果：
+
+    import numpy as np, pandas as pd
+    df = pd.DataFrame(dict(np.load("output/redetect/model_v3/results.npz")))
+    df[df["count"] != df["old_count"]]
+
+camera_api 没有 DecodePipeline 时用 cv2.imread(IMREAD_REDUCED_COLOR_n) 在推理线程上逐张解码（同样在 DCT 域缩小）。
+用 GPU 推理时进程数按显存设为 2~4 即可，解码仍在各进程的后台线程上并行。
+"""
+import argparse
+import contextlib
+import json
+import multiprocessing
+import os
+import re
+import shutil
+import sys
+import tempfile
+import time
+from datetime import datetime
+from pathlib import Path
+from typing import Any, Dict, Iterator, List, Optional, Tuple
+
+import numpy as np
+
+# 设置 project_root
+_current_file = Path(__file__).resolve()
+_project_root = _current_file.parent.parent.parent  # LeafDepot 根目录
+sys.path.insert(0, str(_project_root))
+
+from services.api.shared.config import logger, project_root, set_service_name, REDETECT
+from services.api.shared.native import load_camera_api
+from services.api.shared import bin_checkpoint
+
+CAPTURE_ROOT = project_root / "capture_img"
+DEFAULT_MODEL = project_root / "shared" / "models" / "yolo" / "pile+box.pt"
+DEFAULT_PILE_CONFIG = project_root / "core" / "config" / "pile_config.json"
+
+RESULTS_FILE = "results.npz"
+PROGRESS_FILE = "progress.json"
+RUN_FILE = "run.json"
+_PART_RE = re.compile(r"^part-(\d{5})\.npz$")
+# 任务号 HS{YYYYMMDD}{NN}
+_TASK_DATE_RE = re.compile(r"^HS(\d{8})")
+
+# 结果列：名称 → dtype（字符串列按实际最长值定宽）
+COLUMNS = {
+    "key": str,             # <任务号>/<储位>
+    "task_no": str,
+    "bin_location": str,
+    "pile_id": np.int32,
+    "pile_source": str,     # arg / barcode / count / default
+    "count": np.int32,      # 失败为 -1
+    "old_count": np.int32,  # 检查点里当时的数量，没有为 -1
+    "status": str,          # success / empty（未检测到 pile 或有效层，计数 0）/ failed
+    "error": str,
+    "boxes": np.int32,      # YOLO 检测框数
+    "layers": np.int32,
+    "scale": np.int32,      # 解码缩小倍数，沿用场景时为 0
+    "decode_ms": np.float32,
+    "detect_ms": np.float32,  # 批量推理按张均摊
+    "count_ms": np.float32,   # analyze（推理以外部分）+ count_scene
+}
+
+
+def _load_camera_api():
+    return load_camera_api("DecodePipeline", "预取解码改用 cv2 逐张解码")
+
+
+# ==================== 枚举储位 ====================
+
+def _task_date(task_dir: os.DirEntry) -> str:
+    """任务日期 YYYYMMDD：取自任务号，不是标准任务号时用目录修改时间"""
+    m = _TASK_DATE_RE.match(task_dir.name)
+    if m:
+        return m.group(1)
+    return datetime.fromtimestamp(task_dir.stat().st_mtime).strftime("%Y%m%d")
+
+
+def _main_jpeg(detect_dir: Path) -> Optional[Path]:
+    """3D 主图（未旋转的原始帧）；只有旋转图的老目录不重做，避免重复旋转"""
+    for name in ("main.jpg", "main.jpeg", "main.JPG"):
+        path = detect_dir / name
+        if path.is_file():
+            return path
+    return None
+
+
+def enumerate_bins(root: Path, tasks: Optional[List[str]] = None,
+                   since: Optional[str] = None, until: Optional[str] = None) -> Tuple[List[Tuple[str, str]], int]:
+    """返回 ([(任务号, 储位)], 没有 3D 主图而跳过的储位数)，按任务号、储位排序"""
+    wanted = set(tasks) if tasks else None
+    bins = []
+    skipped = 0
+    try:
+        task_dirs = sorted((e for e in os.scandir(root) if e.is_dir()), key=lambda e: e.name)
+    except OSError as e:
+        logger.error(f"[redetect] 无法读取 {root}: {e}")
+        return [], 0
+    for task_dir in task_dirs:
+        if wanted is not None and task_dir.name not in wanted:
+            continue
+        if since or until:
+            date = _task_date(task_dir)
+            if (since and date < since) or (until and date > until):
+                continue
+        for bin_dir in sorted((e for e in os.scandir(task_dir.path) if e.is_dir()), key=lambda e: e.name):
+            if _main_jpeg(Path(bin_dir.path) / "3d_camera") is None:
+                skipped += 1
+                continue
+            bins.append((task_dir.name, bin_dir.name))
+    return bins, skipped
+
+
+# ==================== 历史结果 ====================
+
+def _history(bin_dir: Path) -> Dict[str, Any]:
+    """检查点里当时的垛型和数量，只作对比，不核对产物哈希"""
+    info: Dict[str, Any] = {}
+    store = bin_checkpoint.open_store(bin_dir)
+    if store is None:
+        return info
+
+    def payload(stage: str):
+        if not store.has(stage):
+            return None
+        try:
+            return json.loads(store.payload(stage))
+        except ValueError:
+            return None
+
+    for name in ("barcode_1", "barcode_2"):
+        resolved = (payload(name) or {}).get("resolved")
+        if resolved and resolved.get("pile_id") is not None:
+            info.setdefault("pile_id", (int(resolved["pile_id"]), "barcode"))
+    count = payload(bin_checkpoint.STAGE_COUNT)
+    if count:
+        info.setdefault("pile_id", (int(count["pile_id"]), "count"))
+        info["old_count"] = count.get("count")
+    result = payload(bin_checkpoint.STAGE_RESULT)
+    if result and isinstance(result.get("actualQuantity"), int):
+        info["old_count"] = result["actualQuantity"]
+    return info
+
+
+# ==================== 工作进程 ====================
+
+class _Options:
+    """工作进程需要的参数（spawn 时 pickle 传过去）"""
+
+    def __init__(self, args: argparse.Namespace):
+        self.capture_root = str(args.capture_root)
+        self.model = str(args.model)
+        self.pile_config = str(args.pile_config)
+        self.pile_id = args.pile_id
+        self.reuse_scene = args.reuse_scene
+        self.decode_threads = args.decode_threads
+        self.prefetch = args.prefetch
+        self.batch = args.batch
+        self.min_long_side = args.min_long_side
+        self.torch_threads = args.torch_threads
+
+
+class _Worker:
+    """每个进程一份：模型、计数工厂和临时目录跨储位复用"""
+
+    def __init__(self, opts: _Options):
+        from core.detection.processors.factory import StackProcessorFactory
+
+        self.opts = opts
+        self.root = Path(opts.capture_root)
+        self.factory = StackProcessorFactory(enable_debug=False, model_path=opts.model,
+                                             pile_config_path=opts.pile_config)
+        self.scratch = Path(tempfile.mkdtemp(prefix="redetect_"))
+        self.api = _load_camera_api()
+        self.devnull = open(os.devnull, "w")
+
+    def close(self):
+        shutil.rmtree(self.scratch, ignore_errors=True)
+        self.devnull.close()
+
+    # ---------- 解码 ----------
+
+    def _decoded(self, bins: List[Tuple[str, str]]) -> Iterator[
+            Tuple[int, Optional[np.ndarray], Tuple[float, float], Tuple[int, int], float]]:
+        """按顺序产出 (序号, BGR 图或 None, (x 倍数, y 倍数), 旋转后原图 (宽, 高), 解码毫秒)，图已旋转到 analyze 的方向"""
+        paths = [str(_main_jpeg(self.root / t / b / "3d_camera")) for t, b in bins]
+        if self.api is None:
+            yield from self._decoded_cv2(paths)
+            return
+        options = self.api.DecodeOptions()
+        options.format = self.api.DecodeFormat.BGR
+        options.scale_denom = 0
+        options.min_long_side = self.opts.min_long_side
+        options.rotate = 90
+        pipeline = self.api.DecodePipeline(self.opts.decode_threads, self.opts.prefetch)
+        try:
+            pipeline.submit([self.api.DecodeJob(i, p, options) for i, p in enumerate(paths)])
+            pipeline.finish()
+            while not pipeline.done():
+                res = pipeline.next(1000)
+                if res is None:
+                    continue
+                if not res.ok:
+                    yield res.tag, None, (1.0, 1.0), (0, 0), res.decode_ms
+                    continue
+                img = res.image
+                # 旋转 90° 后原图宽为 src_height；缩小时向上取整，按实际宽高算倍数
+                size = (img.src_height, img.src_width)
+                scale = (size[0] / img.width, size[1] / img.height)
+                yield res.tag, np.asarray(img), scale, size, res.decode_ms
+        finally:
+            pipeline.close()
+
+    def _decoded_cv2(self, paths: List[str]):
+        import cv2
+        from PIL import Image
+        reduced = {1: cv2.IMREAD_COLOR, 2: cv2.IMREAD_REDUCED_COLOR_2,
+                   4: cv2.IMREAD_REDUCED_COLOR_4, 8: cv2.IMREAD_REDUCED_COLOR_8}
+        for i, path in enumerate(paths):
+            start = time.perf_counter()
+            # 4MP 主图：长边 2688，按 min_long_side 取最大的缩小倍数
+            # 原图宽高只读 JPEG 头
+            try:
+                with Image.open(path) as header:
+                    src_width, src_height = header.size
+            except OSError:
+                yield i, None, (1.0, 1.0), (0, 0), (time.perf_counter() - start) * 1000
+                continue
+            denom = 1
+            while denom < 8 and max(src_width, src_height) // (denom * 2) >= self.opts.min_long_side:
+                denom *= 2
+            img = cv2.imread(path, reduced[denom])
+            if img is None:
+                yield i, None, (1.0, 1.0), (0, 0), (time.perf_counter() - start) * 1000
+                continue
+            img = np.ascontiguousarray(np.rot90(img, 1))
+            size = (src_height, src_width)
+            yield i, img, (size[0] / img.shape[1], size[1] / img.shape[0]), size, (time.perf_counter() - start) * 1000
+
+    # ---------- 推理与计数 ----------
+
+    def _detections(self, res, scale: Tuple[float, float]):
+        """单张推理结果换算到旋转后原图坐标：Detections（camera_api 可用时）或字典列表"""
+        from core.detection.utils.detections import Detections, result_rows
+
+        rows = result_rows(res)
+        rows[:, [0, 2]] *= scale[0]
+        rows[:, [1, 3]] *= scale[1]
+        names = getattr(res, "names", None) or {}
+        detections = Detections.from_rows(rows, names)
+        if detections is not None:
+            return detections
+        return [{"cls": names.get(int(c), str(int(c))), "conf": float(conf),
+                 "x1": float(x1), "y1": float(y1), "x2": float(x2), "y2": float(y2)}
+                for x1, y1, x2, y2, conf, c in rows.tolist()]
+
+    def _stage(self, task_no: str, bin_location: str) -> Tuple[Path, Optional[Path]]:
+        """3D 帧拷到临时目录（每个储位清空重建）"""
+        work = self.scratch / "bin"
+        shutil.rmtree(work, ignore_errors=True)
+        work.mkdir(parents=True)
+        detect_dir = self.root / task_no / bin_location / "3d_camera"
+        main_path = work / "main.jpg"
+        shutil.copyfile(_main_jpeg(detect_dir), main_path)
+        depth_path = None
+        if (detect_dir / "depth.jpg").is_file():
+            depth_path = work / "depth.jpg"
+            shutil.copyfile(detect_dir / "depth.jpg", depth_path)
+        return main_path, depth_path
+
+    def _row(self, task_no: str, bin_location: str) -> Dict[str, Any]:
+        history = _history(self.root / task_no / bin_location)
+        if self.opts.pile_id is not None:
+            pile_id, source = self.opts.pile_id, "arg"
+        else:
+            pile_id, source = history.get("pile_id", (1, "default"))
+        old = history.get("old_count")
+        return {"key": f"{task_no}/{bin_location}", "task_no": task_no, "bin_location": bin_location,
+                "pile_id": pile_id, "pile_source": source, "count": -1,
+                "old_count": old if isinstance(old, int) else -1, "status": "failed", "error": "",
+                "boxes": 0, "layers": 0, "scale": 0, "decode_ms": 0.0, "detect_ms": 0.0, "count_ms": 0.0}
+
+    def _count(self, row: Dict[str, Any], scene: Optional[Dict]):
+        start = time.perf_counter()
+        with contextlib.redirect_stdout(self.devnull):
+            row["count"] = self.factory.count_scene(scene, row["pile_id"])
+        row["count_ms"] += (time.perf_counter() - start) * 1000
+        row["status"] = "success" if scene else "empty"
+        if scene:
+            row["boxes"] = len(scene["detections"])
+            row["layers"] = len(scene["layers"])
+
+    def _reuse_scene(self, row: Dict[str, Any]) -> bool:
+        """检查点里有有效场景时直接按新模板计数"""
+        store = bin_checkpoint.open_store(self.root / row["task_no"] / row["bin_location"])
+        cached = bin_checkpoint.load(store, bin_checkpoint.STAGE_SCENE)
+        if cached is None:
+            return False
+        try:
+            scene = bin_checkpoint.load_pickle(store, "scene.pkl") if cached.get("scene") else None
+            self._count(row, scene)
+        except Exception as e:
+            row["error"] = f"沿用场景失败: {e}"
+            return False
+        row["error"] = ""
+        return True
+
+    def run_chunk(self, bins: List[Tuple[str, str]]) -> List[Dict[str, Any]]:
+        rows = [self._row(t, b) for t, b in bins]
+        todo = [i for i, row in enumerate(rows) if not (self.opts.reuse_scene and self._reuse_scene(row))]
+        pending: List[Tuple[int, np.ndarray, Tuple[float, float], Tuple[int, int]]] = []
+
+        def flush():
+            if not pending:
+                return
+            start = time.perf_counter()
+            try:
+                results = self.factory.model.predict(source=[img for _, img, _, _ in pending], save=False,
+                                                     conf=self.factory.confidence_threshold, verbose=False)
+            except Exception as e:
+                for i, _, _, _ in pending:
+                    rows[todo[i]]["error"] = f"推理失败: {e}"
+                pending.clear()
+                return
+            per_image = (time.perf_counter() - start) * 1000 / len(pending)
+            for (i, _, scale, size), res in zip(pending, results):
+                row = rows[todo[i]]
+                row["detect_ms"] = per_image
+                try:
+                    detections = self._detections(res, scale)
+                    main_path, depth_path = self._stage(row["task_no"], row["bin_location"])
+                    start = time.perf_counter()
+                    with contextlib.redirect_stdout(self.devnull):
+                        scene = self.factory.analyze(str(main_path),
+                                                     depth_image_path=str(depth_path) if depth_path else None,
+                                                     detections=detections, image_size=size)
+                    row["count_ms"] = (time.perf_counter() - start) * 1000
+                    self._count(row, scene)
+                except Exception as e:
+                    row["status"] = "failed"
+                    row["error"] = str(e)
+            pending.clear()
+
+        for i, img, scale, size, decode_ms in self._decoded([bins[j] for j in todo]):
+            row = rows[todo[i]]
+            row["decode_ms"] = decode_ms
+            if img is None:
+                row["error"] = "3D 主图解码失败"
+                continue
+            row["scale"] = int(round(scale[0]))
+            pending.append((i, img, scale, size))
+            if len(pending) >= self.opts.batch:
+                flush()
+        flush()
+        return rows
+
+
+_worker: Optional[_Worker] = None
+
+
+def _init_worker(opts: _Options):
+    global _worker
+    import logging
+    if multiprocessing.parent_process() is not None:
+        # spawn 出来的子进程重新导入了 config，日志同样写 redetect 文件
+        set_service_name("redetect")
+    # 计数流程每个储位十几行 INFO，批量时只留警告
+    logging.getLogger("core").setLevel(logging.WARNING)
+    if opts.torch_threads > 0:
+        import torch
+        torch.set_num_threads(opts.torch_threads)
+    _worker = _Worker(opts)
+    import atexit
+    atexit.register(_worker.close)
+
+
+def _run_chunk(bins: List[Tuple[str, str]]) -> List[Dict[str, Any]]:
+    return _worker.run_chunk(bins)
+
+
+# ==================== 列存结果 ====================
+
+def _columns(rows: List[Dict[str, Any]]) -> Dict[str, np.ndarray]:
+    return {name: np.array([row[name] for row in rows], dtype=dtype) for name, dtype in COLUMNS.items()}
+
+
+def _atomic_savez(path: Path, columns: Dict[str, np.ndarray]):
+    tmp = path.with_name(f".{path.name}.tmp")
+    with open(tmp, "wb") as f:
+        np.savez(f, **columns)
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(tmp, path)
+
+
+def _parts(out_dir: Path) -> List[Path]:
+    return sorted(p for p in out_dir.iterdir() if _PART_RE.match(p.name))
+
+
+def load_results(out_dir: Path) -> Dict[str, np.ndarray]:
+    """合并全部 part 文件（按 key 排序，同一储位只留最后写入的一行）；读不了的 part 提示后跳过，其中的储位下次重做"""
+    tables = []
+    for part in _parts(out_dir):
+        try:
+            with np.load(part) as data:
+                tables.append({name: data[name] for name in COLUMNS})
+        except (OSError, ValueError, KeyError) as e:
+            logger.warning(f"[redetect] 忽略无法读取的 {part.name}: {e}")
+    if not tables:
+        return {name: np.array([], dtype=dtype) for name, dtype in COLUMNS.items()}
+    merged = {name: np.concatenate([t[name] for t in tables]) for name in COLUMNS}
+    order = np.argsort(merged["key"], kind="stable")
+    # 失败后重做的储位在后面的 part 里还有一行，part 按写入顺序合并，同 key 取最后一行
+    keys = merged["key"][order]
+    last = np.ones(len(keys), dtype=bool)
+    last[:-1] = keys[1:] != keys[:-1]
+    order = order[last]
+    return {name: col[order] for name, col in merged.items()}
+
+
+class _PartWriter:
+    """攒够 flush_rows 行写一个 part 文件"""
+
+    def __init__(self, out_dir: Path, flush_rows: int):
+        self.out_dir = out_dir
+        self.flush_rows = max(1, flush_rows)
+        self.rows: List[Dict[str, Any]] = []
+        parts = _parts(out_dir)
+        self.next_index = int(_PART_RE.match(parts[-1].name).group(1)) + 1 if parts else 0
+
+    def add(self, rows: List[Dict[str, Any]]):
+        self.rows.extend(rows)
+        if len(self.rows) >= self.flush_rows:
+            self.flush()
+
+    def flush(self):
+        if not self.rows:
+            return
+        _atomic_savez(self.out_dir / f"part-{self.next_index:05d}.npz", _columns(self.rows))
+        self.next_index += 1
+        self.rows = []
+
+
+class _Progress:
+    """定期打印进度并写 progress.json"""
+
+    def __init__(self, out_dir: Path, total: int, done: int, interval: float):
+        self.path = out_dir / PROGRESS_FILE
+        self.total = total
+        self.start_done = done
+        self.done = done
+        self.failed = 0
+        self.changed = 0
+        self.interval = interval
+        self.started = time.monotonic()
+        self.last = 0.0
+
+    def update(self, rows: List[Dict[str, Any]]):
+        self.done += len(rows)
+        for row in rows:
+            self.failed += row["status"] == "failed"
+            self.changed += row["old_count"] >= 0 and row["count"] >= 0 and row["count"] != row["old_count"]
+        if time.monotonic() - self.last >= self.interval:
+            self.report()
+
+    def report(self, finished: bool = False):
+        self.last = time.monotonic()
+        elapsed = self.last - self.started
+        rate = (self.done - self.start_done) / elapsed if elapsed > 0 else 0.0
+        eta = (self.total - self.done) / rate if rate > 0 else None
+        logger.info(f"[redetect] {self.done}/{self.total} 储位 ({self.done * 100 / max(self.total, 1):.1f}%)，"
+                    f"{rate:.2f} 储位/秒，"
+                    + (f"预计剩余 {eta / 60:.1f} 分钟，" if eta is not None and not finished else "")
+                    + f"本次失败 {self.failed}，计数变化 {self.changed}")
+        state = {"total": self.total, "done": self.done, "failed": self.failed, "changed": self.changed,
+                 "rate_per_sec": round(rate, 3), "eta_sec": round(eta) if eta is not None else None,
+                 "finished": finished, "updated_at": datetime.now().isoformat(timespec="seconds")}
+        try:
+            tmp = self.path.with_name(f".{self.path.name}.tmp")
+            with open(tmp, "w", encoding="utf-8") as f:
+                json.dump(state, f, ensure_ascii=False, indent=2)
+            os.replace(tmp, self.path)
+        except OSError as e:
+            logger.warning(f"[redetect] 写 {self.path} 失败: {e}")
+
+
+# ==================== 入口 ====================
+
+def _parse_args(argv: Optional[List[str]]) -> argparse.Namespace:
+    cpu = os.cpu_count() or 1
+    parser = argparse.ArgumentParser(description="历史抓图批量重识别")
+    parser.add_argument("--out", required=True, help="输出目录，重跑同一目录即续做")
+    parser.add_argument("--capture-root", type=Path, default=CAPTURE_ROOT)
+    parser.add_argument("--tasks", nargs="*", help="只做这些任务号")
+    parser.add_argument("--since", help="任务日期下限 YYYYMMDD（含）")
+    parser.add_argument("--until", help="任务日期上限 YYYYMMDD（含）")
+    parser.add_argument("--model", type=Path, default=DEFAULT_MODEL)
+    parser.add_argument("--pile-config", type=Path, default=DEFAULT_PILE_CONFIG)
+    parser.add_argument("--pile-id", type=int, help="所有储位按该垛型计数（默认取检查点里当时的垛型）")
+    parser.add_argument("--reuse-scene", action="store_true", help="有有效场景检查点的储位只重新计数")
+    parser.add_argument("--processes", type=int, default=REDETECT.get("processes", 0) or cpu)
+    parser.add_argument("--decode-threads", type=int, default=REDETECT.get("decode_threads", 2))
+    parser.add_argument("--prefetch", type=int, default=REDETECT.get("prefetch", 8))
+    parser.add_argument("--batch", type=int, default=REDETECT.get("batch", 8))
+    parser.add_argument("--min-long-side", type=int, default=REDETECT.get("min_long_side", 640))
+    parser.add_argument("--chunk-bins", type=int, default=REDETECT.get("chunk_bins", 32))
+    parser.add_argument("--flush-rows", type=int, default=REDETECT.get("flush_rows", 256))
+    parser.add_argument("--progress-sec", type=float, default=REDETECT.get("progress_sec", 10))
+    parser.add_argument("--fresh", action="store_true", help="丢弃输出目录里已有的结果，从头做")
+    args = parser.parse_args(argv)
+    # 多进程时各进程的推理线程平分 CPU，避免 torch 默认每个进程占满全部核
+    args.torch_threads = max(1, cpu // args.processes) if args.processes > 1 else 0
+    return args
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    set_service_name("redetect")
+    args = _parse_args(argv)
+    out_dir = Path(args.out)
+    out_dir.mkdir(parents=True, exist_ok=True)
+    if args.fresh:
+        for path in _parts(out_dir) + [out_dir / RESULTS_FILE, out_dir / PROGRESS_FILE]:
+            path.unlink(missing_ok=True)
+
+    # 失败的储位（解码、推理或计数出错）不算完成，重跑时再做
+    previous = load_results(out_dir)
+    done = set(previous["key"][previous["status"] != "failed"].tolist())
+    bins, skipped = enumerate_bins(args.capture_root, args.tasks, args.since, args.until)
+    todo = [b for b in bins if f"{b[0]}/{b[1]}" not in done]
+    logger.info(f"[redetect] 储位 {len(bins)} 个（另有 {skipped} 个没有 3D 主图），已完成 {len(bins) - len(todo)}，"
+                f"本次 {len(todo)}；{args.processes} 个进程，每进程解码线程 {args.decode_threads}、"
+                f"预取 {args.prefetch}、批 {args.batch}")
+    with open(out_dir / RUN_FILE, "w", encoding="utf-8") as f:
+        json.dump({"argv": sys.argv[1:] if argv is None else argv, "model": str(args.model),
+                   "pile_config": str(args.pile_config),
+                   "pile_config_mtime": args.pile_config.stat().st_mtime if args.pile_config.exists() else None,
+                   "started_at": datetime.now().isoformat(timespec="seconds")},
+                  f, ensure_ascii=False, indent=2)
+
+    chunks = [todo[i:i + args.chunk_bins] for i in range(0, len(todo), max(args.chunk_bins, 1))]
+    writer = _PartWriter(out_dir, args.flush_rows)
+    progress = _Progress(out_dir, len(bins), len(bins) - len(todo), args.progress_sec)
+    opts = _Options(args)
+    try:
+        if args.processes <= 1:
+            _init_worker(opts)
+            for chunk in chunks:
+                rows = _run_chunk(chunk)
+                writer.add(rows)
+                progress.update(rows)
+        else:
+            # spawn：父进程已导入 torch（CUDA 不能跨 fork），子进程各自加载模型
+            ctx = multiprocessing.get_context("spawn")
+            with ctx.Pool(args.processes, initializer=_init_worker, initargs=(opts,)) as pool:
+                for rows in pool.imap_unordered(_run_chunk, chunks):
+                    writer.add(rows)
+                    progress.update(rows)
+    except KeyboardInterrupt:
+        logger.warning("[redetect] 中断，已完成的储位已保存，重跑同一命令续做")
+        return 130
+    finally:
+        # 中断时也把已拿到的结果落盘，续做时跳过
+        writer.flush()
+
+    results = load_results(out_dir)
+    _atomic_savez(out_dir / RESULTS_FILE, results)
+    progress.report(finished=True)
+    compared = (results["old_count"] >= 0) & (results["count"] >= 0)
+    logger.info(f"[redetect] 完成：{len(results['key'])} 个储位写入 {out_dir / RESULTS_FILE}，"
+                f"失败 {int((results['status'] == 'failed').sum())}，"
+                f"有历史数量的 {int(compared.sum())} 个中计数变化 "
+                f"{int((results['count'] != results['old_count'])[compared].sum())}")
+    return 0
+
+
+if __name__ == "__main__":
+    import logging
+    # 进度同时打到终端
+    _console = logging.StreamHandler()
+    _console.setFormatter(logging.Formatter('%(asctime)s - %(levelname)s - %(message)s', datefmt='%H:%M:%S'))
+    logging.getLogger().addHandler(_console)
+    sys.exit(main())